@@ -90,6 +90,11 @@ CCoordinateMappingBasics::CCoordinateMappingBasics() :
     m_backgroundRGBX = new BYTE[m_colorWidth*m_colorHeight*cBytesPerPixel];
     m_outputRGBX = new BYTE[m_colorWidth*m_colorHeight*cBytesPerPixel];
 
+    // remap the color of player pixels onto the color sized output, keeping the mapping
+    // while the scene stays still
+    m_colorRemap.Initialize(m_depthWidth, m_depthHeight, m_colorWidth, m_colorHeight, m_colorToDepthDivisor, false, NuiColorToDepthRemap::MapPlayerPixels);
+    m_colorRemap.SetCacheTolerance(cRemapDepthToleranceMm, m_depthWidth*m_depthHeight/cRemapMaxChangedPixelsDivisor);
+
     // Create an event that will be signaled when depth data is available
     m_hNextDepthFrameEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
@@ -273,49 +278,8 @@ void CCoordinateMappingBasics::Update()
 
     if (needToDraw)
     {
-        int outputIndex = 0;
-        LONG* pDest;
-        LONG* pSrc;
-
-        // loop over each row and column of the color
-        for (LONG y = 0; y < m_colorHeight; ++y)
-        {
-            for (LONG x = 0; x < m_colorWidth; ++x)
-            {
-                // calculate index into depth array
-                int depthIndex = x/m_colorToDepthDivisor + y/m_colorToDepthDivisor * m_depthWidth;
-
-                USHORT depth  = m_depthD16[depthIndex];
-                USHORT player = NuiDepthPixelToPlayerIndex(depth);
-
-                // default setting source to copy from the background pixel
-                pSrc  = (LONG *)m_backgroundRGBX + outputIndex;
-
-                // if we're tracking a player for the current pixel, draw from the color camera
-                if ( player > 0 )
-                {
-                    // retrieve the depth to color mapping for the current depth pixel
-                    LONG colorInDepthX = m_colorCoordinates[depthIndex * 2];
-                    LONG colorInDepthY = m_colorCoordinates[depthIndex * 2 + 1];
-
-                    // make sure the depth pixel maps to a valid point in color space
-                    if ( colorInDepthX >= 0 && colorInDepthX < m_colorWidth && colorInDepthY >= 0 && colorInDepthY < m_colorHeight )
-                    {
-                        // calculate index into color array
-                        LONG colorIndex = colorInDepthX + colorInDepthY * m_colorWidth;
-
-                        // set source for copy to the color pixel
-                        pSrc  = (LONG *)m_colorRGBX + colorIndex;
-                    }
-                }
-
-                // calculate output pixel location
-                pDest = (LONG *)m_outputRGBX + outputIndex++;
-
-                // write output
-                *pDest = *pSrc;
-            }
-        }
+        // copy player pixels from the color camera and the rest from the background
+        m_colorRemap.Apply(m_colorRGBX, m_outputRGBX, m_colorWidth * cBytesPerPixel, m_backgroundRGBX);
 
         // Draw the data with Direct2D
         m_pDrawCoordinateMappingBasics->Draw(m_outputRGBX, m_colorWidth * m_colorHeight * cBytesPerPixel);
@@ -478,6 +442,9 @@ HRESULT CCoordinateMappingBasics::CreateFirstConnected()
 
     if (SUCCEEDED(hr) && NULL != m_pNuiSensor)
     {
+        // Each sensor has its own calibration, so recalculate the color mapping
+        m_colorRemap.Invalidate();
+
         // Open a depth image stream to receive depth frames
         hr = m_pNuiSensor->NuiImageStreamOpen(
             NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX,
@@ -554,16 +521,24 @@ HRESULT CCoordinateMappingBasics::ProcessDepth()
     // Release the frame
     m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
 
-    // Get of x, y coordinates for color in depth space
+    // Get of x, y coordinates for color in depth space, unless the depth barely changed since they were last calculated
     // This will allow us to later compensate for the differences in location, angle, etc between the depth and color cameras
-    m_pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
-        cColorResolution,
-        cDepthResolution,
-        m_depthWidth*m_depthHeight,
-        m_depthD16,
-        m_depthWidth*m_depthHeight*2,
-        m_colorCoordinates
-        );
+    if ( m_colorRemap.BeginFrame(m_depthD16) )
+    {
+        HRESULT hrMap = m_pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
+            cColorResolution,
+            cDepthResolution,
+            m_depthWidth*m_depthHeight,
+            m_depthD16,
+            m_depthWidth*m_depthHeight*2,
+            m_colorCoordinates
+            );
+
+        if ( SUCCEEDED(hrMap) )
+        {
+            m_colorRemap.UpdateTable(m_colorCoordinates);
+        }
+    }
 
     return hr;
 }
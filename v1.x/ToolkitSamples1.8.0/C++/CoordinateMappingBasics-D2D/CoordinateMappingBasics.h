@@ -26,6 +26,7 @@
 
 #include <NuiSensorChooser.h>
 #include "NuiSensorChooserUI.h"
+#include <NuiColorToDepthRemap.h>
 
 class CCoordinateMappingBasics
 {
@@ -38,6 +39,11 @@ class CCoordinateMappingBasics
 
     static const int        cStatusMessageMaxLen = MAX_PATH*2;
 
+    // the color mapping is recalculated once more than 1 in cRemapMaxChangedPixelsDivisor
+    // depth pixels moved by more than cRemapDepthToleranceMm, or entered or left a player
+    static const USHORT     cRemapDepthToleranceMm = 20;
+    static const int        cRemapMaxChangedPixelsDivisor = 200;
+
 public:
     /// <summary>
     /// Constructor
@@ -113,6 +119,7 @@ private:
     BYTE*                   m_backgroundRGBX;
     BYTE*                   m_outputRGBX;
     LONG*                   m_colorCoordinates;
+    NuiColorToDepthRemap    m_colorRemap;
 
     LARGE_INTEGER           m_depthTimeStamp;
     LARGE_INTEGER           m_colorTimeStamp;
@@ -165,6 +165,9 @@ CDepthWithColorD3D::CDepthWithColorD3D()
     m_colorCoordinates = new LONG[m_depthWidth*m_depthHeight*2];
     m_colorRGBX = new BYTE[m_colorWidth*m_colorHeight*cBytesPerPixel];
 
+    m_colorRemap.Initialize(m_depthWidth, m_depthHeight, m_colorWidth, m_colorHeight, m_colorToDepthDivisor, false, NuiColorToDepthRemap::MapAllPixels);
+    m_colorRemap.SetCacheTolerance(cRemapDepthToleranceMm, m_depthWidth*m_depthHeight/cRemapMaxChangedPixelsDivisor);
+
     m_bNearMode = false;
 
     m_bPaused = false;
@@ -752,53 +755,32 @@ HRESULT CDepthWithColorD3D::MapColorToDepth()
 {
     HRESULT hr;
 
-    // Get of x, y coordinates for color in depth space
+    // Get of x, y coordinates for color in depth space, unless the depth barely changed since they were last calculated
     // This will allow us to later compensate for the differences in location, angle, etc between the depth and color cameras
-    m_pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
-        cColorResolution,
-        cDepthResolution,
-        m_depthWidth*m_depthHeight,
-        m_depthD16,
-        m_depthWidth*m_depthHeight*2,
-        m_colorCoordinates
-        );
+    if ( m_colorRemap.BeginFrame(m_depthD16) )
+    {
+        hr = m_pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
+            cColorResolution,
+            cDepthResolution,
+            m_depthWidth*m_depthHeight,
+            m_depthD16,
+            m_depthWidth*m_depthHeight*2,
+            m_colorCoordinates
+            );
+
+        if ( SUCCEEDED(hr) )
+        {
+            m_colorRemap.UpdateTable(m_colorCoordinates);
+        }
+    }
 
     // copy to our d3d 11 color texture
     D3D11_MAPPED_SUBRESOURCE msT;
     hr = m_pImmediateContext->Map(m_pColorTexture2D, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &msT);
     if ( FAILED(hr) ) { return hr; }
     
-    // loop over each row and column of the color
-    for (LONG y = 0; y < m_colorHeight; ++y)
-    {
-        LONG* pDest = (LONG*)((BYTE*)msT.pData + msT.RowPitch * y);
-        for (LONG x = 0; x < m_colorWidth; ++x)
-        {
-            // calculate index into depth array
-            int depthIndex = x/m_colorToDepthDivisor + y/m_colorToDepthDivisor * m_depthWidth;
-
-            // retrieve the depth to color mapping for the current depth pixel
-            LONG colorInDepthX = m_colorCoordinates[depthIndex * 2];
-            LONG colorInDepthY = m_colorCoordinates[depthIndex * 2 + 1];
-
-            // make sure the depth pixel maps to a valid point in color space
-            if ( colorInDepthX >= 0 && colorInDepthX < m_colorWidth && colorInDepthY >= 0 && colorInDepthY < m_colorHeight )
-            {
-                // calculate index into color array
-                LONG colorIndex = colorInDepthX + colorInDepthY * m_colorWidth;
-
-                // set source for copy to the color pixel
-                LONG* pSrc = (LONG *)m_colorRGBX + colorIndex;
-                *pDest = *pSrc;
-            }
-            else
-            {
-                *pDest = 0;
-            }
-
-            pDest++;
-        }
-    }
+    // copy each pixel of the color texture from the color camera, or black where none maps
+    m_colorRemap.Apply(m_colorRGBX, (BYTE*)msT.pData, msT.RowPitch, NULL);
 
     m_pImmediateContext->Unmap(m_pColorTexture2D, NULL);
 
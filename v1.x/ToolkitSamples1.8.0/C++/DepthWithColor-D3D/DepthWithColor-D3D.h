@@ -27,6 +27,7 @@
 #include <xnamath.h>
 
 #include "NuiApi.h"
+#include "NuiColorToDepthRemap.h"
 
 #include "Camera.h"
 #include "DX11Utils.h"
@@ -49,6 +50,11 @@ class CDepthWithColorD3D
     static const NUI_IMAGE_RESOLUTION   cDepthResolution = NUI_IMAGE_RESOLUTION_640x480;
     static const NUI_IMAGE_RESOLUTION   cColorResolution = NUI_IMAGE_RESOLUTION_640x480;
 
+    // color is remapped with the previous coordinates until more than 1 in cRemapMaxChangedPixelsDivisor
+    // depth pixels moved by more than cRemapDepthToleranceMm
+    static const USHORT                 cRemapDepthToleranceMm = 20;
+    static const int                    cRemapMaxChangedPixelsDivisor = 200;
+
 public:
     /// <summary>
     /// Constructor
@@ -150,6 +156,7 @@ private:
     USHORT*                             m_depthD16;
     BYTE*                               m_colorRGBX;
     LONG*                               m_colorCoordinates;
+    NuiColorToDepthRemap                m_colorRemap;
 
     // to prevent drawing until we have data for both streams
     bool                                m_bDepthReceived;
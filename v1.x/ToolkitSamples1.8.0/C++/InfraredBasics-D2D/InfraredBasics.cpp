@@ -48,6 +48,7 @@ CInfraredBasics::CInfraredBasics() :
     m_pNuiSensor(NULL),
     m_pTempColorBuffer(NULL)
 {
+    m_infraredToneMapper.SetTemporalDenoise(true, 0.35f, 24);
 }
 
 /// <summary>
@@ -369,19 +370,21 @@ void CInfraredBasics::ProcessColor()
             m_pTempColorBuffer = new RGBQUAD[cColorWidth * cColorHeight];
         }
 
-        for (int i = 0; i < cColorWidth * cColorHeight; ++i)
+        // Convert the infrared levels to gray, with auto exposure and temporal denoise
+        hr = m_infraredToneMapper.Initialize(cColorWidth, cColorHeight);
+        if (SUCCEEDED(hr))
         {
-            BYTE intensity = reinterpret_cast<USHORT*>(LockedRect.pBits)[i] >> 8;
-
-            RGBQUAD *pQuad = &m_pTempColorBuffer[i];
-            pQuad->rgbBlue = intensity;
-            pQuad->rgbGreen = intensity;
-            pQuad->rgbRed = intensity;
-            pQuad->rgbReserved = 255;
+            hr = m_infraredToneMapper.Apply(
+                reinterpret_cast<USHORT*>(LockedRect.pBits),
+                reinterpret_cast<BYTE*>(m_pTempColorBuffer),
+                cColorWidth * sizeof(RGBQUAD));
         }
 
-        // Draw the data with Direct2D
-        m_pDrawColor->Draw(reinterpret_cast<BYTE*>(m_pTempColorBuffer), cColorWidth * cColorHeight * sizeof(RGBQUAD));
+        if (SUCCEEDED(hr))
+        {
+            // Draw the data with Direct2D
+            m_pDrawColor->Draw(reinterpret_cast<BYTE*>(m_pTempColorBuffer), cColorWidth * cColorHeight * sizeof(RGBQUAD));
+        }
     }
 
     // We're done with the texture so unlock it
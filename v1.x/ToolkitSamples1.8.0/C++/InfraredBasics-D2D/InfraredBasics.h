@@ -23,6 +23,7 @@
 #include "resource.h"
 #include "NuiApi.h"
 #include "ImageRenderer.h"
+#include "NuiInfraredToneMapper.h"
 
 class CInfraredBasics
 {
@@ -84,6 +85,9 @@ private:
 
     RGBQUAD*                m_pTempColorBuffer;
 
+    // Stretches the dim infrared levels over the display range
+    NuiInfraredToneMapper   m_infraredToneMapper;
+
     /// <summary>
     /// Main processing function
     /// </summary>
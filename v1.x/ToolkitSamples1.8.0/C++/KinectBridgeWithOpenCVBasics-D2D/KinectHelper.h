@@ -22,6 +22,7 @@
 
 #include "windows.h"
 #include <NuiApi.h>
+#include "NuiFrameBufferPool.h"
 #include <stdlib.h>
 #include <algorithm>
 #include <iterator>
@@ -248,6 +249,8 @@ namespace Microsoft {
             BYTE* m_pDepthBuffer;
             INT m_depthBufferSize;
             INT m_depthBufferPitch;
+            NuiPooledBuffer m_pooledColorBuffer;
+            NuiPooledBuffer m_pooledDepthBuffer;
 
             // Image stream resolution information
             NUI_IMAGE_RESOLUTION m_colorResolution;
@@ -758,14 +761,15 @@ namespace Microsoft {
                 // Only reallocate memory if the buffer size has changed
                 if (size != m_colorBufferSize)
                 {
-                    delete [] m_pColorBuffer;
-                    m_pColorBuffer = new BYTE[size];
-                    m_colorBufferSize = size;
+                    m_pColorBuffer = m_pooledColorBuffer.Reset(size);
+                    m_colorBufferSize = (NULL != m_pColorBuffer) ? size : 0;
                 }
-                memcpy_s(m_pColorBuffer, size, pBuffer, size);
 
-
-                m_colorBufferPitch = pitch;
+                if (NULL != m_pColorBuffer)
+                {
+                    memcpy_s(m_pColorBuffer, size, pBuffer, size);
+                    m_colorBufferPitch = pitch;
+                }
             }
 
             // Unlock texture
@@ -825,13 +829,15 @@ namespace Microsoft {
                 // Only reallocate memory if the buffer size has changed
                 if (size != m_depthBufferSize)
                 {
-                    delete [] m_pDepthBuffer;
-                    m_pDepthBuffer = new BYTE[size];
-                    m_depthBufferSize = size;
+                    m_pDepthBuffer = m_pooledDepthBuffer.Reset(size);
+                    m_depthBufferSize = (NULL != m_pDepthBuffer) ? size : 0;
                 }
-                memcpy_s(m_pDepthBuffer, size, pBuffer, size);
 
-                m_depthBufferPitch = pitch;
+                if (NULL != m_pDepthBuffer)
+                {
+                    memcpy_s(m_pDepthBuffer, size, pBuffer, size);
+                    m_depthBufferPitch = pitch;
+                }
             }
 
             // Unlock texture
@@ -151,6 +151,31 @@ void KinectSettings::ProcessMenuCommand(WORD commandId, WORD param, bool previou
 
         m_pColorStream->OpenStream();
     }
+    else if (ID_COLORSTREAM_DEMOSAIC_START <= commandId && ID_COLORSTREAM_DEMOSAIC_END >= commandId)
+    {
+        // Set color stream bayer demosaic method
+        BAYER_DEMOSAIC method = (BAYER_DEMOSAIC)(commandId - ID_COLORSTREAM_DEMOSAIC_START);
+        if (m_pColorStream)
+        {
+            m_pColorStream->SetBayerDemosaic(method);
+        }
+    }
+    else if (ID_COLORSTREAM_INFRAREDAUTOEXPOSURE == commandId)
+    {
+        // Turn infrared auto exposure on or off
+        if (m_pColorStream)
+        {
+            m_pColorStream->SetInfraredAutoExposure(!previouslyChecked);
+        }
+    }
+    else if (ID_COLORSTREAM_INFRAREDDENOISE == commandId)
+    {
+        // Turn infrared temporal denoise on or off
+        if (m_pColorStream)
+        {
+            m_pColorStream->SetInfraredDenoise(!previouslyChecked);
+        }
+    }
     else if (ID_DEPTHSTREAM_PAUSE == commandId)
     {
         // Pause depth stream
@@ -271,8 +296,39 @@ void KinectSettings::ProcessMenuCommand(WORD commandId, WORD param, bool previou
             m_pNuiSensor->NuiSetForceInfraredEmitterOff(param);
             break;
 
+            // Compare the bayer demosaic methods
+        case ID_DEMOSAIC_BENCHMARK:
+            ShowDemosaicBenchmark();
+            break;
+
         default:
             break;
         }
     }
 }
+
+/// <summary>
+/// Measure the bayer demosaic methods on a 1280x960 test pattern and show the results
+/// </summary>
+void KinectSettings::ShowDemosaicBenchmark()
+{
+    static const WCHAR* methodNames[BAYER_DEMOSAIC_COUNT] = { L"Block2x2", L"Bilinear", L"MalvarHeCutler" };
+
+    NuiBayerDemosaic demosaic;
+    BayerDemosaicBenchmark results;
+    if (!demosaic.Benchmark(1280, 960, 30, &results))
+    {
+        return;
+    }
+
+    WCHAR text[MaxStringChars];
+    int length = swprintf_s(text, MaxStringChars, L"%ux%u test pattern\n", results.width, results.height);
+
+    for (int method = 0; method < BAYER_DEMOSAIC_COUNT && length > 0; method++)
+    {
+        length += swprintf_s(text + length, MaxStringChars - length, L"\n%s: %.2f dB, %.2f ms",
+                             methodNames[method], results.psnr[method], results.milliseconds[method]);
+    }
+
+    MessageBoxW(m_pPrimaryView->GetWindow(), text, L"Bayer Demosaic Benchmark", MB_OK | MB_ICONINFORMATION);
+}
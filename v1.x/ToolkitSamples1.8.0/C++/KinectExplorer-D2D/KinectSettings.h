@@ -54,6 +54,12 @@ public:
     /// <param name="previouslyChecked">Check status of menu item before command is issued</param>
     void ProcessMenuCommand(WORD commandId, WORD param, bool previouslyChecked);
 
+private:
+    /// <summary>
+    /// Measure the bayer demosaic methods on a 1280x960 test pattern and show the results
+    /// </summary>
+    void ShowDemosaicBenchmark();
+
 private:
     INuiSensor*              m_pNuiSensor;
     // Stream viewers
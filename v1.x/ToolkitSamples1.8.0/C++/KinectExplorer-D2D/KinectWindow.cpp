@@ -36,7 +36,7 @@
 #define TAB_CONTROL_FIXED_HEIGHT    25
 #define GAP_BETWEEN_VIEWS           5
 
-// Reoccurence period in millisecond of waitable timer. This timer is used to trigger processing of timed stream data.
+// Reoccurence period in millisecond of scheduler timer. This timer is used to trigger processing of timed stream data.
 #define TIMER_PERIOD                20
 
 // Titles of tab control items
@@ -70,24 +70,30 @@ static const int SkeletonChooserModeMenuPosition    = 2;
 /// <param name="hInstance">Handle to the application instance</param>
 /// <param name="hWndParent">Handle to main console window</param>
 /// <param name="pNuiSensor">Pointer to Nui sensor instance</param>
-KinectWindow::KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNuiSensor)
+/// <param name="pScheduler">Scheduler shared by all Kinect windows to process stream events</param>
+KinectWindow::KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNuiSensor, NuiStreamScheduler* pScheduler)
     : NuiViewer(nullptr)
     , m_hWndTab(nullptr)
     , m_hWndParent(hWndParent)
     , m_hInstance(hInstance)
-    , m_hTimer(nullptr)
     , m_hThread(nullptr)
     , m_pNuiSensor(pNuiSensor)
     , m_bSupportCameraSettings(true)
     , m_hStartWindow(INVALID_HANDLE_VALUE)
-    , m_hStopStreamEventThread(INVALID_HANDLE_VALUE)
+    , m_pScheduler(pScheduler)
+    , m_bStreamsScheduled(false)
+    , m_streamEventPending(0)
+    , m_timerEventPending(0)
 {
     assert(m_pNuiSensor);
     m_pNuiSensor->AddRef();
 
+    assert(m_pScheduler);
+    InitializeCriticalSection(&m_frameLock);
+
     // Create instances of sub views
-    m_pPrimaryView    = new NuiStreamViewer(this);
-    m_pSecondaryView  = new NuiStreamViewer(this);
+    m_pPrimaryView    = new NuiStreamViewer(this, &m_frameLock);
+    m_pSecondaryView  = new NuiStreamViewer(this, &m_frameLock);
     m_pAudioView      = new NuiAudioViewer(this);
     m_pAccelView      = new NuiAccelerometerViewer(this);
     m_pTiltAngleView  = new NuiTiltAngleViewer(this, pNuiSensor);
@@ -142,6 +148,8 @@ KinectWindow::KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNu
 KinectWindow::~KinectWindow()
 {
     CleanUp();
+
+    DeleteCriticalSection(&m_frameLock);
 }
 
 /// <summary>
@@ -327,10 +335,6 @@ DWORD WINAPI KinectWindow::ThreadProc(KinectWindow* pThis)
 /// <returns>wParam of last received message</returns>
 WPARAM KinectWindow::MessageLoop()
 {
-    m_hStopStreamEventThread = CreateEventW(nullptr, TRUE, FALSE, nullptr);
-
-    HANDLE hEventThread = CreateThread(nullptr, 0, (LPTHREAD_START_ROUTINE)StreamEventThread, this, 0, nullptr);
-
     MSG  msg = {0};
     BOOL ret;
     while (0 != (ret = GetMessageW(&msg, nullptr, 0, 0)))
@@ -349,9 +353,6 @@ WPARAM KinectWindow::MessageLoop()
         DispatchMessageW(&msg);
     }
 
-    WaitForSingleObject(hEventThread, INFINITE);
-    CloseHandle(hEventThread);
-
     return msg.wParam;
 }
 
@@ -368,10 +369,12 @@ LRESULT KinectWindow::DialogProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPa
     switch (uMsg)
     {
     case WM_STREAMEVENT:
-        UpdateStreams();
+        InterlockedExchange(&m_streamEventPending, 0);
+        UpdateStreamViews();
         break;
 
     case WM_TIMEREVENT:
+        InterlockedExchange(&m_timerEventPending, 0);
         UpdateTimedStreams();
         break;
 
@@ -541,7 +544,7 @@ void KinectWindow::BringUpWindow()
 }
 
 /// <summary>
-/// Start all streams and timer
+/// Start all streams and schedule their processing
 /// </sumamry>
 void KinectWindow::StartStreams()
 {
@@ -560,20 +563,21 @@ void KinectWindow::StartStreams()
     // Accelerometer reading stream
     m_pAccelerometerStream->StartStream();
 
-    // Start waitble timer
-    StartTimer();
+    // Wait on the frame events with the streams of the other sensors, and start the timer
+    NuiStream* streams[] = {m_pColorStream, m_pDepthStream, m_pSkeletonStream};
+    m_bStreamsScheduled = m_pScheduler->AddClient(this, streams, ARRAYSIZE(streams), TIMER_PERIOD);
 }
 
 /// <summary>
-/// Start the waitable timer to trigger process of timed streams
+/// Stop the processing of streams by the scheduler
 /// </summary>
-void KinectWindow::StartTimer()
+void KinectWindow::StopStreams()
 {
-    m_hTimer = CreateWaitableTimerW(nullptr, FALSE, nullptr);
-    if (m_hTimer)
+    if (m_bStreamsScheduled)
     {
-        LARGE_INTEGER dueTime = {0};
-        SetWaitableTimer(m_hTimer, &dueTime, TIMER_PERIOD, nullptr, nullptr, FALSE);
+        // Returns after the callbacks in progress have finished
+        m_pScheduler->RemoveClient(this);
+        m_bStreamsScheduled = false;
     }
 }
 
@@ -582,11 +586,7 @@ void KinectWindow::StartTimer()
 /// </summary>
 void KinectWindow::CleanUp()
 {
-    if (m_hTimer)
-    {
-        CloseHandle(m_hTimer);
-        m_hTimer = nullptr;
-    }
+    StopStreams();
 
     SafeDelete(m_pColorStream);
     SafeDelete(m_pDepthStream);
@@ -609,12 +609,6 @@ void KinectWindow::CleanUp()
         CloseHandle(m_hStartWindow);
         m_hStartWindow = INVALID_HANDLE_VALUE;
     }
-
-    if (INVALID_HANDLE_VALUE != m_hStopStreamEventThread)
-    {
-        CloseHandle(m_hStopStreamEventThread);
-        m_hStopStreamEventThread = INVALID_HANDLE_VALUE;
-    }
 }
 
 /// <summary>
@@ -662,8 +656,13 @@ void KinectWindow::OnCommand(WPARAM wParam)
     // Update memu item status
     if (ProcessMenuItem(id, itemChecked))
     {
-        // Process menu item command
+        // Process menu item command. Streams may be reopened or switch viewers, so
+        // hold off frame processing meanwhile
+        EnterCriticalSection(&m_frameLock);
         m_pSettings->ProcessMenuCommand(id, param, itemChecked);
+        LeaveCriticalSection(&m_frameLock);
+
+        UpdateStreamViews();
     }
 }
 
@@ -681,6 +680,11 @@ void KinectWindow::InitializeMenu()
                              ID_COLORSTREAM_RESOLUTION_END,
                              ID_RESOLUTION_RGBRESOLUTION640X480FPS30,
                              MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_COLORSTREAM_DEMOSAIC_START,
+                             ID_COLORSTREAM_DEMOSAIC_END,
+                             ID_DEMOSAIC_MALVARHECUTLER,
+                             MF_BYCOMMAND);
         CheckMenuRadioItem(hMenu,
                              ID_DEPTHSTREAM_RANGEMODE_START,
                              ID_DEPTHSTREAM_RANGEMODE_END,
@@ -769,9 +773,15 @@ bool KinectWindow::ProcessMenuItem(UINT id, bool& checked)
             }
             break;
 
+        // For infrared options, invert check status
+        case ID_COLORSTREAM_INFRAREDAUTOEXPOSURE:
+        case ID_COLORSTREAM_INFRAREDDENOISE:
+            return InvertCheckMenuItem(hMenu, id, checked);
+
         case ID_VIEWS_SWITCH:
         case ID_CAMERA_COLORSETTINGS:
         case ID_CAMERA_EXPOSURESETTINGS:
+        case ID_DEMOSAIC_BENCHMARK:
             // These item don't need to modify their check status
             return true;
 
@@ -815,6 +825,11 @@ bool KinectWindow::ProcessMenuItem(UINT id, bool& checked)
                     // Color stream image resolution
                     return true;
                 }
+                else if (CheckRadioItem(id, ID_COLORSTREAM_DEMOSAIC_START, ID_COLORSTREAM_DEMOSAIC_END, hMenu))
+                {
+                    // Color stream bayer demosaic method
+                    return true;
+                }
             }
         }
     }
@@ -931,11 +946,8 @@ void KinectWindow::OnClose(HWND hWnd, WPARAM wParam)
         m_hWndParent = nullptr; // Don't need Kinect window send back message of quit in this case
     }
 
-    // Stop stream event thread
-    if (INVALID_HANDLE_VALUE != m_hStopStreamEventThread)
-    {
-        SetEvent(m_hStopStreamEventThread);
-    }
+    // Stop processing stream events
+    StopStreams();
 
     // Shut down the device
     if (nullptr != m_pNuiSensor)
@@ -996,53 +1008,66 @@ bool KinectWindow::CalculateViewRects(RECT& priRect, RECT& secRect, RECT& tabRec
 }
 
 /// <summary>
-/// Process color, depth and skeleton streams
+/// Process the frame of a stream. Called by the stream scheduler on a worker thread
 /// </summary>
-void KinectWindow::UpdateStreams()
+/// <param name="pStream">The stream with a frame ready</param>
+void KinectWindow::OnStreamEvent(NuiStream* pStream)
 {
-    m_pColorStream->ProcessStreamFrame();
-    m_pDepthStream->ProcessStreamFrame();
-    m_pSkeletonStream->ProcessStreamFrame();
+    if (pStream == m_pSkeletonStream)
+    {
+        // Skeleton frames are published through skeleton history, which viewers read without the lock
+        pStream->ProcessStreamFrame();
+    }
+    else
+    {
+        EnterCriticalSection(&m_frameLock);
+        pStream->ProcessStreamFrame();
+        LeaveCriticalSection(&m_frameLock);
+    }
+
+    // Frames of all streams arriving before the window gets to repaint share one repaint
+    PostCoalescedMessage(WM_STREAMEVENT, &m_streamEventPending);
 }
 
 /// <summary>
-/// Process audio, accelerometer and tilt angle streams
+/// Trigger process of timed streams. Called by the stream scheduler on a worker thread
 /// </summary>
-void KinectWindow::UpdateTimedStreams()
+void KinectWindow::OnTimerEvent()
 {
-    m_pAudioStream->ProcessStream();
-    m_pAccelerometerStream->ProcessStream();
+    // Audio and accelerometer readings update controls of the window, so are processed on its thread
+    PostCoalescedMessage(WM_TIMEREVENT, &m_timerEventPending);
 }
 
 /// <summary>
-/// Thread to handle stream events
+/// Post a message to the window, unless the same message is already waiting in the queue
 /// </summary>
-/// <param name="pThis">Pionter to Kinect window instance</param>
-/// <returns>Exit result from thread</returns>
-DWORD KinectWindow::StreamEventThread(KinectWindow* pThis)
+/// <param name="uMsg">The message identifier</param>
+/// <param name="pPending">Flag set while the message is waiting</param>
+void KinectWindow::PostCoalescedMessage(UINT uMsg, volatile LONG* pPending)
 {
-    HANDLE events[] = {pThis->m_hStopStreamEventThread, 
-                       pThis->m_hTimer, 
-                       pThis->m_pColorStream->GetFrameReadyEvent(), 
-                       pThis->m_pDepthStream->GetFrameReadyEvent(), 
-                       pThis->m_pSkeletonStream->GetFrameReadyEvent()};
-
-    while (true)
+    if (0 == InterlockedExchange(pPending, 1))
     {
-        DWORD ret = WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE);
-
-        if (WAIT_OBJECT_0 == ret)
-            break;
-
-        if (WAIT_OBJECT_0 + 1 == ret)
+        if (!PostMessageW(m_hWnd, uMsg, 0, 0))
         {
-            SendMessageW(pThis->GetWindow(), WM_TIMEREVENT, 0, 0);
-        }
-        else if(WAIT_OBJECT_0 + 4 >= ret)
-        {
-            SendMessageW(pThis->GetWindow(), WM_STREAMEVENT, 0, 0);
+            InterlockedExchange(pPending, 0);
         }
     }
+}
 
-    return 0;
+/// <summary>
+/// Repaint the stream viewers with the latest processed frames
+/// </summary>
+void KinectWindow::UpdateStreamViews()
+{
+    InvalidateRect(m_pPrimaryView->GetWindow(), nullptr, FALSE);
+    InvalidateRect(m_pSecondaryView->GetWindow(), nullptr, FALSE);
+}
+
+/// <summary>
+/// Process audio, accelerometer and tilt angle streams
+/// </summary>
+void KinectWindow::UpdateTimedStreams()
+{
+    m_pAudioStream->ProcessStream();
+    m_pAccelerometerStream->ProcessStream();
 }
@@ -28,9 +28,10 @@
 #include "NuiAudioStream.h"
 #include "NuiAccelerometerStream.h"
 #include "NuiTiltAngleViewer.h"
+#include "NuiStreamScheduler.h"
 #include "KinectSettings.h"
 
-class KinectWindow : public NuiViewer
+class KinectWindow : public NuiViewer, public NuiStreamSchedulerClient
 {
 public:
     /// <summary>
@@ -39,7 +40,8 @@ public:
     /// <param name="hInstance">Handle to the application instance</param>
     /// <param name="hWndParent">Handle to main console window</param>
     /// <param name="pNuiSensor">Pointer to Nui sensor instance</param>
-    KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNuiSensor);
+    /// <param name="pScheduler">Scheduler shared by all Kinect windows to process stream events</param>
+    KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNuiSensor, NuiStreamScheduler* pScheduler);
 
     /// <summary>
     /// Destructor. Kinect window object is deleted in its own thread. Can not be deleted in other place explicitly
@@ -64,6 +66,17 @@ public:
     /// <returns>The thread handle</returns>
     HANDLE GetThreadHandle() const;
 
+    /// <summary>
+    /// Process the frame of a stream. Called by the stream scheduler on a worker thread
+    /// </summary>
+    /// <param name="pStream">The stream with a frame ready</param>
+    virtual void OnStreamEvent(NuiStream* pStream);
+
+    /// <summary>
+    /// Trigger process of timed streams. Called by the stream scheduler on a worker thread
+    /// </summary>
+    virtual void OnTimerEvent();
+
 private:
     /// <summary>
     /// Initialize common control.
@@ -135,19 +148,26 @@ private:
     void CleanUp();
 
     /// <summary>
-    /// Start all streams and timer
+    /// Start all streams and schedule their processing
     /// </sumamry>
     void StartStreams();
 
     /// <summary>
-    /// Start the waitable timer to trigger process of timed streams
+    /// Stop the processing of streams by the scheduler
+    /// </summary>
+    void StopStreams();
+
+    /// <summary>
+    /// Post a message to the window, unless the same message is already waiting in the queue
     /// </summary>
-    void StartTimer();
+    /// <param name="uMsg">The message identifier</param>
+    /// <param name="pPending">Flag set while the message is waiting</param>
+    void PostCoalescedMessage(UINT uMsg, volatile LONG* pPending);
 
     /// <summary>
-    /// Process color, depth and skeleton streams
+    /// Repaint the stream viewers with the latest processed frames
     /// </summary>
-    void UpdateStreams();
+    void UpdateStreamViews();
 
     /// <summary>
     /// Process audio, accelerometer and tilt angle streams
@@ -250,20 +270,18 @@ private:
     /// <param name="wParam">Command parameter</param>
     void OnClose(HWND hWnd, WPARAM wParam);
 
-    /// <summary>
-    /// Thread to handle stream events
-    /// </summary>
-    /// <param name="pThis">Pionter to Kinect window instance</param>
-    static DWORD WINAPI StreamEventThread(KinectWindow* pThis);
-
 private:
     HINSTANCE               m_hInstance;                // Handle to application instance
     HWND                    m_hWndTab;                  // Handle to window of tab control
     HWND                    m_hWndParent;               // Handle to window of main console
-    HANDLE                  m_hTimer;                   // Handle to waitable timer
     HANDLE                  m_hThread;                  // Handle to thread instance
     HANDLE                  m_hStartWindow;             // Handle to the start window sync event
-    HANDLE                  m_hStopStreamEventThread;   // Event to stop stream events thread
+
+    NuiStreamScheduler*     m_pScheduler;               // Pointer to scheduler processing stream events
+    bool                    m_bStreamsScheduled;        // Indicate whether the streams are added to the scheduler
+    CRITICAL_SECTION        m_frameLock;                // Held while image streams process frames or stream settings change
+    volatile LONG           m_streamEventPending;       // Set while a WM_STREAMEVENT message is waiting
+    volatile LONG           m_timerEventPending;        // Set while a WM_TIMEREVENT message is waiting
 
     KinectSettings*         m_pSettings;                // Pointer to Kinect setting object
 
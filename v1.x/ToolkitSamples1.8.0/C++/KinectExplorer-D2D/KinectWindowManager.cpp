@@ -171,7 +171,7 @@ void KinectWindowManager::UpdateKinectWindow(HRESULT hrSensorCallbackStatus, INu
 /// </summary>
 KinectWindow* KinectWindowManager::CreateKinectWindow(INuiSensor* pNuiSensor)
 {
-    KinectWindow* pKinectWindow = new KinectWindow(GetModuleHandle(0), m_hWnd, pNuiSensor);
+    KinectWindow* pKinectWindow = new KinectWindow(GetModuleHandle(0), m_hWnd, pNuiSensor, &m_streamScheduler);
     pKinectWindow->StartWindow();
     PostMessageW(pKinectWindow->GetWindow(), WM_SHOWKINECTWINDOW, m_kinectWindowShowParam, 0);
     return pKinectWindow;
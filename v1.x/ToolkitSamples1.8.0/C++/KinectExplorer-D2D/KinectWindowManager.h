@@ -25,6 +25,7 @@
 #include <NuiApi.h>
 
 #include "KinectWindow.h"
+#include "NuiStreamScheduler.h"
 
 /// <summary>
 /// Each connected sensor is displayed with a kinect window,
@@ -132,4 +133,7 @@ private:
 
     /// The parameter of showing kinect windows
     DWORD    m_kinectWindowShowParam;
+
+    /// Processes the stream events of all the kinect windows on a shared pool of worker threads
+    NuiStreamScheduler    m_streamScheduler;
 };
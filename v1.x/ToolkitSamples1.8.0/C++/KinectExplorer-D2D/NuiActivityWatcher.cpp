@@ -28,7 +28,7 @@
 /// Constructor
 /// </summary>
 /// <param name="skeleton">Referece to skeleton data</param>
-NuiActivityWatcher::NuiActivityWatcher(NUI_SKELETON_DATA& skeleton)
+NuiActivityWatcher::NuiActivityWatcher(const NUI_SKELETON_DATA& skeleton)
 {
     m_updated       = false;
     m_trackingID    = skeleton.dwTrackingID;
@@ -67,7 +67,7 @@ bool NuiActivityWatcher::GetUpdateFlag()
 /// Calculate new activity level based on skeleton new position and old activity level
 /// </summary>
 /// <param name="skeleton">Skeleton data containing skeleton positions</param>
-void NuiActivityWatcher::UpdateActivity(NUI_SKELETON_DATA& skeleton)
+void NuiActivityWatcher::UpdateActivity(const NUI_SKELETON_DATA& skeleton)
 {
     // Caculate skeleton movement
     FLOAT deltaX = skeleton.Position.x - m_prevPosition.x;
@@ -33,7 +33,7 @@ public:
     /// Constructor
     /// </summary>
     /// <param name="skeleton">Referece to skeleton data</param>
-    NuiActivityWatcher(NUI_SKELETON_DATA& skeleton);
+    NuiActivityWatcher(const NUI_SKELETON_DATA& skeleton);
 
     /// <summary>
     /// Destructor
@@ -57,7 +57,7 @@ public:
     /// Calculate new activity level based on skeleton new position and old activity level
     /// </summary>
     /// <param name="skeleton">Skeleton data containing skeleton positions</param>
-    void UpdateActivity(NUI_SKELETON_DATA& skeleton);
+    void UpdateActivity(const NUI_SKELETON_DATA& skeleton);
 
     /// <summary>
     /// Get calculated activity level
@@ -0,0 +1,493 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiBayerDemosaic.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include <cmath>
+#include <emmintrin.h>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+#include "NuiBayerDemosaic.h"
+#include "Utility.h"
+
+#define BAND_ROWS               16      // Rows of each band converted by a task
+#define PAD_COLUMNS             2       // Mirrored columns on either side of a padded row
+#define PAD_ROWS                2       // Mirrored rows above and below a band
+#define PIXELS_PER_ITERATION    8
+
+/// <summary>
+/// Mirror a row or column index around the image edges, keeping the bayer pattern
+/// </summary>
+/// <param name="index">Index, at most two outside the image</param>
+/// <param name="size">Size of image along the index</param>
+/// <returns>Index inside the image</returns>
+static inline int MirrorIndex(int index, int size)
+{
+    if (index < 0)
+    {
+        return -index;
+    }
+
+    if (index >= size)
+    {
+        return 2 * (size - 1) - index;
+    }
+
+    return index;
+}
+
+/// <summary>
+/// Clamp an interpolated value to the range of a color component
+/// </summary>
+static inline BYTE ClampColor(int value)
+{
+    return (BYTE)(value < 0 ? 0 : (value > UCHAR_MAX ? UCHAR_MAX : value));
+}
+
+/// <summary>
+/// Load 8 samples as 16-bit values
+/// </summary>
+static inline __m128i LoadSamples(const BYTE* pSamples)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)pSamples), _mm_setzero_si128());
+}
+
+/// <summary>
+/// Select the even lanes of one value and the odd lanes of another
+/// </summary>
+static inline __m128i SelectEvenOdd(__m128i evenMask, __m128i even, __m128i odd)
+{
+    return _mm_or_si128(_mm_and_si128(evenMask, even), _mm_andnot_si128(evenMask, odd));
+}
+
+/// <summary>
+/// Interpolate one pixel from the padded rows around it
+/// </summary>
+/// <param name="pRows">Padded rows two above to two below the pixel, at the pixel's column</param>
+/// <param name="evenRow">Whether the pixel is on a green and red row</param>
+/// <param name="evenColumn">Whether the pixel is on an even column</param>
+/// <param name="gradientCorrected">Whether to use the Malvar-He-Cutler method</param>
+/// <returns>The pixel color</returns>
+static UINT InterpolatePixel(const BYTE* const pRows[5], bool evenRow, bool evenColumn, bool gradientCorrected)
+{
+    int center     = pRows[2][0];
+    int horizontal = pRows[2][-1] + pRows[2][1];
+    int vertical   = pRows[1][0] + pRows[3][0];
+    int diagonal   = pRows[1][-1] + pRows[1][1] + pRows[3][-1] + pRows[3][1];
+
+    // Colors at the pixel from the crossing, horizontal, vertical and diagonal neighbors
+    int cross, fromHorizontal, fromVertical, fromDiagonal;
+
+    if (gradientCorrected)
+    {
+        int horizontal2 = pRows[2][-2] + pRows[2][2];
+        int vertical2   = pRows[0][0] + pRows[4][0];
+
+        cross          = (8 * center + 4 * (horizontal + vertical) - 2 * (horizontal2 + vertical2) + 8) >> 4;
+        fromHorizontal = (10 * center + 8 * horizontal - 2 * horizontal2 - 2 * diagonal + vertical2 + 8) >> 4;
+        fromVertical   = (10 * center + 8 * vertical - 2 * vertical2 - 2 * diagonal + horizontal2 + 8) >> 4;
+        fromDiagonal   = (12 * center + 4 * diagonal - 3 * (horizontal2 + vertical2) + 8) >> 4;
+    }
+    else
+    {
+        cross          = (horizontal + vertical + 2) >> 2;
+        fromHorizontal = (horizontal + 1) >> 1;
+        fromVertical   = (vertical + 1) >> 1;
+        fromDiagonal   = (diagonal + 2) >> 2;
+    }
+
+    int r, g, b;
+    if (evenRow)
+    {
+        r = evenColumn ? fromHorizontal : center;
+        g = evenColumn ? center : cross;
+        b = evenColumn ? fromVertical : fromDiagonal;
+    }
+    else
+    {
+        r = evenColumn ? fromDiagonal : fromVertical;
+        g = evenColumn ? cross : center;
+        b = evenColumn ? center : fromHorizontal;
+    }
+
+    return 0xFF000000 | (ClampColor(r) << 16) | (ClampColor(g) << 8) | ClampColor(b);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+NuiBayerDemosaic::NuiBayerDemosaic()
+    : m_width(0)
+    , m_height(0)
+    , m_paddedWidth(0)
+    , m_nPaddedRowsSize(0)
+    , m_pPaddedRows(nullptr)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+NuiBayerDemosaic::~NuiBayerDemosaic()
+{
+    SafeDeleteArray(m_pPaddedRows);
+}
+
+/// <summary>
+/// Allocate the padded row buffer for an image size
+/// </summary>
+/// <param name="width">Width of image</param>
+/// <param name="height">Height of image</param>
+void NuiBayerDemosaic::ResetPaddedRows(UINT width, UINT height)
+{
+    m_width  = width;
+    m_height = height;
+
+    // Round the rows up to a multiple of 16 bytes
+    m_paddedWidth = (width + 2 * PAD_COLUMNS + 15) & ~15;
+
+    UINT bandCount = (height + BAND_ROWS - 1) / BAND_ROWS;
+    UINT size = bandCount * (BAND_ROWS + 2 * PAD_ROWS) * m_paddedWidth;
+
+    if (!m_pPaddedRows || m_nPaddedRowsSize != size)
+    {
+        SafeDeleteArray(m_pPaddedRows);
+
+        m_pPaddedRows = new BYTE[size];
+        m_nPaddedRowsSize = size;
+    }
+}
+
+/// <summary>
+/// Convert raw bayer data to an RGB image
+/// </summary>
+/// <param name="pBayer">Raw bayer data, with green and red samples on even rows and blue and green samples on odd rows</param>
+/// <param name="width">Width of image, which must be even</param>
+/// <param name="height">Height of image, which must be even</param>
+/// <param name="method">Demosaic method</param>
+/// <param name="pRgb">Buffer of width * height pixels receiving the image</param>
+/// <returns>Indicates success or failure</returns>
+bool NuiBayerDemosaic::Demosaic(const BYTE* pBayer, UINT width, UINT height, BAYER_DEMOSAIC method, UINT* pRgb)
+{
+    if (!pBayer || !pRgb || 0 != width % 2 || 0 != height % 2)
+    {
+        return false;
+    }
+
+    // The interpolation mirrors two rows and columns around the edges, which needs 4 of each
+    if (BAYER_DEMOSAIC_BLOCK2X2 == method || width < 4 || height < 4)
+    {
+        DemosaicBlock2x2(pBayer, width, height, pRgb);
+        return true;
+    }
+
+    if (width != m_width || height != m_height || !m_pPaddedRows)
+    {
+        ResetPaddedRows(width, height);
+    }
+
+    bool gradientCorrected = (BAYER_DEMOSAIC_MALVARHECUTLER == method);
+    UINT bandCount = (height + BAND_ROWS - 1) / BAND_ROWS;
+
+    Concurrency::parallel_for(0u, bandCount, [&](UINT band)
+    {
+        DemosaicBand(pBayer, band, gradientCorrected, pRgb);
+    });
+
+    return true;
+}
+
+/// <summary>
+/// Copy the colors of each 2x2 block to all four of its pixels
+/// </summary>
+void NuiBayerDemosaic::DemosaicBlock2x2(const BYTE* pBayer, UINT width, UINT height, UINT* pRgb)
+{
+    // Run through pixels
+    for (DWORD y = 0; y < height; y += 2)
+    {
+        for (DWORD x = 0; x < width; x += 2)
+        {
+            int firstRowOffset  = (y * width) + x;
+            int secondRowOffset = firstRowOffset + width;
+                                                    //  _____
+            // Get bayer colors from source image   // |  |  |
+            BYTE r  = pBayer[firstRowOffset + 1];   // |g1|r |
+            BYTE g1 = pBayer[firstRowOffset];       // |--|--|
+            BYTE g2 = pBayer[secondRowOffset + 1];  // |b |g2|
+            BYTE b  = pBayer[secondRowOffset];      // |__|__|
+
+            UINT color1 = 0xFF000000 | (r << 16) | (g1 << 8) | b;
+            UINT color2 = 0xFF000000 | (r << 16) | (g2 << 8) | b;
+
+            // Set color to pixels
+            pRgb[firstRowOffset]       = color1;
+            pRgb[firstRowOffset + 1]   = color1;
+            pRgb[secondRowOffset]      = color2;
+            pRgb[secondRowOffset + 1]  = color2;
+        }
+    }
+}
+
+/// <summary>
+/// Interpolate the rows of a band
+/// </summary>
+/// <param name="pBayer">Raw bayer data</param>
+/// <param name="band">Index of band</param>
+/// <param name="gradientCorrected">Whether to use the Malvar-He-Cutler method rather than the bilinear one</param>
+/// <param name="pRgb">Buffer receiving the image</param>
+void NuiBayerDemosaic::DemosaicBand(const BYTE* pBayer, UINT band, bool gradientCorrected, UINT* pRgb)
+{
+    int width    = (int)m_width;
+    int height   = (int)m_height;
+    int firstRow = (int)(band * BAND_ROWS);
+    int endRow   = min(firstRow + BAND_ROWS, height);
+
+    // Copy the source rows of the band with mirrored edges. Padded row i holds source row firstRow - PAD_ROWS + i,
+    // and column x of the image is at PAD_COLUMNS + x
+    BYTE* pPadded = m_pPaddedRows + band * (BAND_ROWS + 2 * PAD_ROWS) * m_paddedWidth;
+    int paddedRowCount = endRow - firstRow + 2 * PAD_ROWS;
+
+    for (int i = 0; i < paddedRowCount; i++)
+    {
+        const BYTE* pSrc = pBayer + MirrorIndex(firstRow - PAD_ROWS + i, height) * width;
+        BYTE* pDest = pPadded + i * m_paddedWidth;
+
+        memcpy(pDest + PAD_COLUMNS, pSrc, width);
+        for (int x = 1; x <= PAD_COLUMNS; x++)
+        {
+            pDest[PAD_COLUMNS - x]             = pSrc[x];
+            pDest[PAD_COLUMNS + width - 1 + x] = pSrc[width - 1 - x];
+        }
+    }
+
+    const __m128i zero      = _mm_setzero_si128();
+    const __m128i alpha     = _mm_set1_epi8((char)0xFF);
+    const __m128i evenMask  = _mm_set_epi16(0, -1, 0, -1, 0, -1, 0, -1);
+    const __m128i round1    = _mm_set1_epi16(1);
+    const __m128i round2    = _mm_set1_epi16(2);
+    const __m128i round8    = _mm_set1_epi16(8);
+
+    for (int y = firstRow; y < endRow; y++)
+    {
+        // Padded rows two above to two below the row, at column 0 of the image
+        const BYTE* pRows[5];
+        for (int i = 0; i < 5; i++)
+        {
+            pRows[i] = pPadded + (y - firstRow + i) * m_paddedWidth + PAD_COLUMNS;
+        }
+
+        bool evenRow = (0 == y % 2);
+        UINT* pDest = pRgb + y * width;
+        int x = 0;
+
+        // Run through pixels, starting on even columns
+        for (; x + PIXELS_PER_ITERATION <= width; x += PIXELS_PER_ITERATION)
+        {
+            __m128i center     = LoadSamples(pRows[2] + x);
+            __m128i horizontal = _mm_add_epi16(LoadSamples(pRows[2] + x - 1), LoadSamples(pRows[2] + x + 1));
+            __m128i vertical   = _mm_add_epi16(LoadSamples(pRows[1] + x), LoadSamples(pRows[3] + x));
+            __m128i diagonal   = _mm_add_epi16(
+                _mm_add_epi16(LoadSamples(pRows[1] + x - 1), LoadSamples(pRows[1] + x + 1)),
+                _mm_add_epi16(LoadSamples(pRows[3] + x - 1), LoadSamples(pRows[3] + x + 1)));
+
+            // Colors at the pixels from the crossing, horizontal, vertical and diagonal neighbors
+            __m128i cross, fromHorizontal, fromVertical, fromDiagonal;
+
+            if (gradientCorrected)
+            {
+                __m128i horizontal2 = _mm_add_epi16(LoadSamples(pRows[2] + x - 2), LoadSamples(pRows[2] + x + 2));
+                __m128i vertical2   = _mm_add_epi16(LoadSamples(pRows[0] + x), LoadSamples(pRows[4] + x));
+                __m128i outer       = _mm_add_epi16(horizontal2, vertical2);
+
+                // 8 * center + 4 * (horizontal + vertical) - 2 * (horizontal2 + vertical2)
+                cross = _mm_sub_epi16(
+                    _mm_add_epi16(_mm_slli_epi16(center, 3), _mm_slli_epi16(_mm_add_epi16(horizontal, vertical), 2)),
+                    _mm_slli_epi16(outer, 1));
+
+                // 10 * center - 2 * diagonal, shared by the horizontal and vertical kernels
+                __m128i common = _mm_sub_epi16(
+                    _mm_add_epi16(_mm_slli_epi16(center, 3), _mm_slli_epi16(center, 1)),
+                    _mm_slli_epi16(diagonal, 1));
+
+                // + 8 * horizontal - 2 * horizontal2 + vertical2
+                fromHorizontal = _mm_add_epi16(common,
+                    _mm_add_epi16(_mm_sub_epi16(_mm_slli_epi16(horizontal, 3), _mm_slli_epi16(horizontal2, 1)), vertical2));
+
+                // + 8 * vertical - 2 * vertical2 + horizontal2
+                fromVertical = _mm_add_epi16(common,
+                    _mm_add_epi16(_mm_sub_epi16(_mm_slli_epi16(vertical, 3), _mm_slli_epi16(vertical2, 1)), horizontal2));
+
+                // 12 * center + 4 * diagonal - 3 * (horizontal2 + vertical2)
+                fromDiagonal = _mm_sub_epi16(
+                    _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(center, 3), _mm_slli_epi16(center, 2)), _mm_slli_epi16(diagonal, 2)),
+                    _mm_add_epi16(_mm_slli_epi16(outer, 1), outer));
+
+                cross          = _mm_srai_epi16(_mm_add_epi16(cross, round8), 4);
+                fromHorizontal = _mm_srai_epi16(_mm_add_epi16(fromHorizontal, round8), 4);
+                fromVertical   = _mm_srai_epi16(_mm_add_epi16(fromVertical, round8), 4);
+                fromDiagonal   = _mm_srai_epi16(_mm_add_epi16(fromDiagonal, round8), 4);
+            }
+            else
+            {
+                cross          = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(horizontal, vertical), round2), 2);
+                fromHorizontal = _mm_srli_epi16(_mm_add_epi16(horizontal, round1), 1);
+                fromVertical   = _mm_srli_epi16(_mm_add_epi16(vertical, round1), 1);
+                fromDiagonal   = _mm_srli_epi16(_mm_add_epi16(diagonal, round2), 2);
+            }
+
+            __m128i r, g, b;
+            if (evenRow)
+            {
+                r = SelectEvenOdd(evenMask, fromHorizontal, center);
+                g = SelectEvenOdd(evenMask, center, cross);
+                b = SelectEvenOdd(evenMask, fromVertical, fromDiagonal);
+            }
+            else
+            {
+                r = SelectEvenOdd(evenMask, fromDiagonal, fromVertical);
+                g = SelectEvenOdd(evenMask, cross, center);
+                b = SelectEvenOdd(evenMask, center, fromHorizontal);
+            }
+
+            // Clamp the colors to bytes and interleave them into BGRA pixels
+            __m128i blueGreen = _mm_unpacklo_epi8(_mm_packus_epi16(b, zero), _mm_packus_epi16(g, zero));
+            __m128i redAlpha  = _mm_unpacklo_epi8(_mm_packus_epi16(r, zero), alpha);
+
+            _mm_storeu_si128((__m128i*)(pDest + x),     _mm_unpacklo_epi16(blueGreen, redAlpha));
+            _mm_storeu_si128((__m128i*)(pDest + x + 4), _mm_unpackhi_epi16(blueGreen, redAlpha));
+        }
+
+        // Run through remaining pixels
+        for (; x < width; x++)
+        {
+            const BYTE* pPixelRows[5] = { pRows[0] + x, pRows[1] + x, pRows[2] + x, pRows[3] + x, pRows[4] + x };
+            pDest[x] = InterpolatePixel(pPixelRows, evenRow, 0 == x % 2, gradientCorrected);
+        }
+    }
+}
+
+/// <summary>
+/// Measure the quality and speed of each demosaic method on a synthetic test pattern
+/// </summary>
+/// <param name="width">Width of pattern</param>
+/// <param name="height">Height of pattern</param>
+/// <param name="iterations">Number of frames converted by each method</param>
+/// <param name="pResults">Receives the results</param>
+/// <returns>Indicates success or failure</returns>
+bool NuiBayerDemosaic::Benchmark(UINT width, UINT height, UINT iterations, BayerDemosaicBenchmark* pResults)
+{
+    if (!pResults || 0 == iterations || 0 != width % 2 || 0 != height % 2 || width < 4 || height < 4)
+    {
+        return false;
+    }
+
+    UINT  pixelCount = width * height;
+    UINT* pPattern   = new UINT[pixelCount];
+    UINT* pRgb       = new UINT[pixelCount];
+    BYTE* pBayer     = new BYTE[pixelCount];
+
+    bool result = true;
+
+    // A zone plate, whose rings reach half the sampling limit at the corners, tinted by a smooth
+    // color gradient over the top half, and color bars with hard edges over the bottom half
+    const double pi = 3.14159265358979;
+    double cornerRadius = 0.5 * sqrt((double)width * width + (double)height * height);
+
+    for (UINT y = 0; y < height; y++)
+    {
+        for (UINT x = 0; x < width; x++)
+        {
+            BYTE r, g, b;
+            if (y < height / 2)
+            {
+                double dx = x - 0.5 * width;
+                double dy = y - 0.5 * height;
+                double ring = 0.5 + 0.5 * cos(0.25 * pi * (dx * dx + dy * dy) / cornerRadius);
+                double tint = (double)x / width;
+
+                r = (BYTE)(32.0 + 192.0 * ring * (1.0 - 0.5 * tint));
+                g = (BYTE)(32.0 + 192.0 * ring);
+                b = (BYTE)(32.0 + 192.0 * ring * (0.5 + 0.5 * tint));
+            }
+            else
+            {
+                UINT bar = x * 8 / width;
+                r = (bar & 1) ? 224 : 32;
+                g = (bar & 2) ? 224 : 32;
+                b = (bar & 4) ? 224 : 32;
+            }
+
+            pPattern[y * width + x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+
+            // Sample the pattern as the camera would
+            int shift = (0 == y % 2) ? ((0 == x % 2) ? 8 : 16) : ((0 == x % 2) ? 0 : 8);
+            pBayer[y * width + x] = (BYTE)(pPattern[y * width + x] >> shift);
+        }
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    pResults->width  = width;
+    pResults->height = height;
+
+    for (int method = 0; method < BAYER_DEMOSAIC_COUNT && result; method++)
+    {
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+
+        for (UINT i = 0; i < iterations && result; i++)
+        {
+            result = Demosaic(pBayer, width, height, (BAYER_DEMOSAIC)method, pRgb);
+        }
+
+        QueryPerformanceCounter(&end);
+        pResults->milliseconds[method] = 1000.0 * (end.QuadPart - start.QuadPart) / frequency.QuadPart / iterations;
+
+        // Compare the color components with the pattern, leaving out the mirrored edges
+        double squaredError = 0.0;
+        for (UINT y = 2; y < height - 2; y++)
+        {
+            for (UINT x = 2; x < width - 2; x++)
+            {
+                UINT i = y * width + x;
+                for (int shift = 0; shift < 24; shift += 8)
+                {
+                    int difference = (int)((pRgb[i] >> shift) & 0xFF) - (int)((pPattern[i] >> shift) & 0xFF);
+                    squaredError += difference * difference;
+                }
+            }
+        }
+
+        double meanSquaredError = squaredError / (3.0 * (width - 4) * (height - 4));
+        pResults->psnr[method] = (meanSquaredError > 0.0) ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+    }
+
+    SafeDeleteArray(pPattern);
+    SafeDeleteArray(pRgb);
+    SafeDeleteArray(pBayer);
+
+    return result;
+}
@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiBayerDemosaic.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+enum BAYER_DEMOSAIC
+{
+    BAYER_DEMOSAIC_BLOCK2X2,
+    BAYER_DEMOSAIC_BILINEAR,
+    BAYER_DEMOSAIC_MALVARHECUTLER,
+    BAYER_DEMOSAIC_COUNT,
+};
+
+/// <summary>
+/// Quality and speed of each demosaic method on a synthetic test pattern
+/// </summary>
+struct BayerDemosaicBenchmark
+{
+    UINT   width;
+    UINT   height;
+    double psnr[BAYER_DEMOSAIC_COUNT];              // Peak signal to noise ratio against the pattern, in dB
+    double milliseconds[BAYER_DEMOSAIC_COUNT];      // Time per frame
+};
+
+/// <summary>
+/// Converts raw bayer data to RGB images. The block method copies the colors of each 2x2 block
+/// of the pattern to all four of its pixels. The bilinear method interpolates each missing color
+/// from the nearest samples of that color, and the Malvar-He-Cutler method corrects the bilinear
+/// interpolation with the gradient of the color sampled at the pixel. The interpolating methods
+/// process bands of rows in parallel, 8 pixels at a time.
+/// </summary>
+class NuiBayerDemosaic
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    NuiBayerDemosaic();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~NuiBayerDemosaic();
+
+public:
+    /// <summary>
+    /// Convert raw bayer data to an RGB image
+    /// </summary>
+    /// <param name="pBayer">Raw bayer data, with green and red samples on even rows and blue and green samples on odd rows</param>
+    /// <param name="width">Width of image, which must be even</param>
+    /// <param name="height">Height of image, which must be even</param>
+    /// <param name="method">Demosaic method</param>
+    /// <param name="pRgb">Buffer of width * height pixels receiving the image</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Demosaic(const BYTE* pBayer, UINT width, UINT height, BAYER_DEMOSAIC method, UINT* pRgb);
+
+    /// <summary>
+    /// Measure the quality and speed of each demosaic method on a synthetic test pattern
+    /// </summary>
+    /// <param name="width">Width of pattern</param>
+    /// <param name="height">Height of pattern</param>
+    /// <param name="iterations">Number of frames converted by each method</param>
+    /// <param name="pResults">Receives the results</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Benchmark(UINT width, UINT height, UINT iterations, BayerDemosaicBenchmark* pResults);
+
+private:
+    /// <summary>
+    /// Copy the colors of each 2x2 block to all four of its pixels
+    /// </summary>
+    void DemosaicBlock2x2(const BYTE* pBayer, UINT width, UINT height, UINT* pRgb);
+
+    /// <summary>
+    /// Interpolate the rows of a band
+    /// </summary>
+    /// <param name="pBayer">Raw bayer data</param>
+    /// <param name="band">Index of band</param>
+    /// <param name="gradientCorrected">Whether to use the Malvar-He-Cutler method rather than the bilinear one</param>
+    /// <param name="pRgb">Buffer receiving the image</param>
+    void DemosaicBand(const BYTE* pBayer, UINT band, bool gradientCorrected, UINT* pRgb);
+
+    /// <summary>
+    /// Allocate the padded row buffer for an image size
+    /// </summary>
+    /// <param name="width">Width of image</param>
+    /// <param name="height">Height of image</param>
+    void ResetPaddedRows(UINT width, UINT height);
+
+private:
+    UINT                m_width;
+    UINT                m_height;
+
+    // Each band copies the source rows it reads, with the first and last two rows and columns
+    // mirrored around the image edges, so the interpolation needs no edge cases
+    UINT                m_paddedWidth;
+    UINT                m_nPaddedRowsSize;
+    BYTE*               m_pPaddedRows;
+};
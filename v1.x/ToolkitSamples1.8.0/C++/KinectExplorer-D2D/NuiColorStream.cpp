@@ -30,6 +30,9 @@ NuiColorStream::NuiColorStream(INuiSensor* pNuiSensor)
     : NuiStream(pNuiSensor)
     , m_imageType(NUI_IMAGE_TYPE_COLOR)
     , m_imageResolution(NUI_IMAGE_RESOLUTION_640x480)
+    , m_bayerDemosaic(BAYER_DEMOSAIC_MALVARHECUTLER)
+    , m_infraredAutoExposure(true)
+    , m_infraredDenoise(true)
 {
 }
 
@@ -132,16 +135,40 @@ void NuiColorStream::SetImageResolution(NUI_IMAGE_RESOLUTION resolution)
     }
 }
 
+/// <summary>
+/// Set the method converting raw bayer data to color images
+/// </summary>
+/// <param name="method">Demosaic method to set</param>
+void NuiColorStream::SetBayerDemosaic(BAYER_DEMOSAIC method)
+{
+    m_bayerDemosaic = method;
+}
+
+/// <summary>
+/// Turn the auto exposure of infrared images on or off
+/// </summary>
+/// <param name="autoExposure">Whether to stretch the infrared levels over the display range</param>
+void NuiColorStream::SetInfraredAutoExposure(bool autoExposure)
+{
+    m_infraredAutoExposure = autoExposure;
+}
+
+/// <summary>
+/// Turn the temporal denoise of infrared images on or off
+/// </summary>
+/// <param name="denoise">Whether to apply the temporal denoise</param>
+void NuiColorStream::SetInfraredDenoise(bool denoise)
+{
+    m_infraredDenoise = denoise;
+}
+
 /// <summary>
 /// Process a incoming stream frame
 /// </summary>
 void NuiColorStream::ProcessStreamFrame()
 {
-    if (WAIT_OBJECT_0 == WaitForSingleObject(GetFrameReadyEvent(), 0))
-    {
-        // Frame ready event has been set. Proceed to process incoming frame
-        ProcessColor();
-    }
+    // Frame ready event has been set. Proceed to process incoming frame
+    ProcessColor();
 }
 
 /// <summary>
@@ -177,11 +204,11 @@ void NuiColorStream::ProcessColor()
         switch (m_imageType)
         {
         case NUI_IMAGE_TYPE_COLOR_RAW_BAYER:    // Convert raw bayer data to color image and copy to image buffer
-            m_imageBuffer.CopyBayer(lockedRect.pBits, lockedRect.size);
+            m_imageBuffer.CopyBayer(lockedRect.pBits, lockedRect.size, m_bayerDemosaic);
             break;
 
         case NUI_IMAGE_TYPE_COLOR_INFRARED:     // Convert infrared data to color image and copy to image buffer
-            m_imageBuffer.CopyInfrared(lockedRect.pBits, lockedRect.size);
+            m_imageBuffer.CopyInfrared(lockedRect.pBits, lockedRect.size, m_infraredAutoExposure, m_infraredDenoise);
             break;
 
         default:    // Copy color data to image buffer
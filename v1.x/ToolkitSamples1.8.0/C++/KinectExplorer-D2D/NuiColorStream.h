@@ -74,6 +74,24 @@ public:
     /// <param name="resolution">Image resolution to be set</param>
     void SetImageResolution(NUI_IMAGE_RESOLUTION resolution);
 
+    /// <summary>
+    /// Set the method converting raw bayer data to color images
+    /// </summary>
+    /// <param name="method">Demosaic method to set</param>
+    void SetBayerDemosaic(BAYER_DEMOSAIC method);
+
+    /// <summary>
+    /// Turn the auto exposure of infrared images on or off
+    /// </summary>
+    /// <param name="autoExposure">Whether to stretch the infrared levels over the display range</param>
+    void SetInfraredAutoExposure(bool autoExposure);
+
+    /// <summary>
+    /// Turn the temporal denoise of infrared images on or off
+    /// </summary>
+    /// <param name="denoise">Whether to apply the temporal denoise</param>
+    void SetInfraredDenoise(bool denoise);
+
 private:
     /// <summary>
     /// Process the incoming color frame
@@ -84,4 +102,7 @@ private:
     NUI_IMAGE_TYPE       m_imageType;
     NUI_IMAGE_RESOLUTION m_imageResolution;
     NuiImageBuffer       m_imageBuffer;
+    BAYER_DEMOSAIC       m_bayerDemosaic;
+    bool                 m_infraredAutoExposure;
+    bool                 m_infraredDenoise;
 };
@@ -120,11 +120,8 @@ HRESULT NuiDepthStream::OpenStream(NUI_IMAGE_RESOLUTION resolution)
 /// </summary>
 void NuiDepthStream::ProcessStreamFrame()
 {
-    if (WAIT_OBJECT_0 == WaitForSingleObject(GetFrameReadyEvent(), 0))
-    {
-        // if we have received any valid new depth data we may need to draw
-        ProcessDepth();
-    }
+    // if we have received any valid new depth data we may need to draw
+    ProcessDepth();
 }
 
 /// <summary>
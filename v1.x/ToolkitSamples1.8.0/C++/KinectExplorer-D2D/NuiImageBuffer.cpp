@@ -20,6 +20,7 @@
 
 #include "stdafx.h"
 #include <cmath>
+#include <emmintrin.h>
 #include "NuiImageBuffer.h"
 #include "Utility.h"
 
@@ -40,6 +41,10 @@
 #define TOO_NEAR_COLOR              0x001F7FFF
 #define TOO_FAR_COLOR               0x007F0F3F
 #define NEAREST_COLOR               0x00FFFFFF
+#define INTENSITY_TABLE_SIZE        (MAX_DEPTH - MIN_DEPTH + 2)
+
+#define INFRARED_DENOISE_WEIGHT     0.35f   // Weight of a new infrared frame in the temporal denoise
+#define INFRARED_MOTION_THRESHOLD   24      // Largest infrared change treated as noise, in 10-bit levels
 
 // intensity shift table to generate different render colors for different tracked players
 const BYTE NuiImageBuffer::m_intensityShiftR[] = {0, 2, 0, 2, 0, 0, 2};
@@ -58,8 +63,10 @@ NuiImageBuffer::NuiImageBuffer()
     , m_srcWidth(0)
     , m_srcHeight(0)
     , m_pBuffer(nullptr)
+    , m_pDepthIntensityTable(nullptr)
 {
-    InitDepthColorTable();
+    InitDepthIntensityTable();
+    UpdateDepthColorRanges();
 }
 
 /// <summary>
@@ -67,7 +74,7 @@ NuiImageBuffer::NuiImageBuffer()
 /// </summary>
 NuiImageBuffer::~NuiImageBuffer()
 {
-    SafeDelete(m_pBuffer);
+    SafeDeleteArray(m_pDepthIntensityTable);
 }
 
 /// <summary>
@@ -134,18 +141,15 @@ BYTE* NuiImageBuffer::GetBuffer() const
 /// Allocate a buffer of size and return it
 /// </summary>
 /// <param name="size">Size of buffer to allocate</param>
-/// <returns>The pointer to the allocated buffer. If size hasn't changed, the previously allocated buffer is returned</returns>
+/// <returns>The pointer to the allocated buffer, or nullptr if it could not be allocated. If size hasn't changed, the previously allocated buffer is returned</returns>
 BYTE* NuiImageBuffer::ResetBuffer(UINT size)
 {
     if (!m_pBuffer || m_nSizeInBytes != size)
     {
-        SafeDeleteArray(m_pBuffer);
-
-        if (0 != size)
-        {
-            m_pBuffer = new BYTE[size];
-        }
-        m_nSizeInBytes = size;
+        // The buffer comes from the pool shared by all streams, so a resolution change reuses
+        // a buffer another stream has released instead of reallocating
+        m_pBuffer      = m_buffer.Reset(size);
+        m_nSizeInBytes = m_pBuffer ? size : 0;
     }
 
     return m_pBuffer;
@@ -162,85 +166,103 @@ void NuiImageBuffer::Clear()
 }
 
 /// <summary>
-/// Initialize the depth-color mapping table.
+/// Initialize the depth-intensity mapping table.
 /// </summary>
-void NuiImageBuffer::InitDepthColorTable()
+void NuiImageBuffer::InitDepthIntensityTable()
 {
-    // Get the min and max reliable depth
-    USHORT minReliableDepth = (m_nearMode ? NUI_IMAGE_DEPTH_MINIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MINIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
-    USHORT maxReliableDepth = (m_nearMode ? NUI_IMAGE_DEPTH_MAXIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MAXIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+    // The table only covers the depths with a gradient, so it stays in the cache while a frame is colored
+    m_pDepthIntensityTable = new BYTE[INTENSITY_TABLE_SIZE];
 
-    ZeroMemory(m_depthColorTable, sizeof(m_depthColorTable));
+    for (int depth = MIN_DEPTH; depth <= MAX_DEPTH; depth++)
+    {
+        m_pDepthIntensityTable[depth - MIN_DEPTH] = GetIntensity(depth);
+    }
 
-    // Set color for unknown depth
-    m_depthColorTable[0][UNKNOWN_DEPTH] = UNKNOWN_DEPTH_COLOR;
+    // All other depths have the intensity of the nearest and farthest ones
+    m_pDepthIntensityTable[INTENSITY_TABLE_SIZE - 1] = GetIntensity(UNKNOWN_DEPTH);
+}
+
+/// <summary>
+/// Set the reliable depth range and the colors outside it for the range mode and depth treatment.
+/// </summary>
+void NuiImageBuffer::UpdateDepthColorRanges()
+{
+    // Get the min and max reliable depth
+    m_minReliableDepth = (m_nearMode ? NUI_IMAGE_DEPTH_MINIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MINIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+    m_maxReliableDepth = (m_nearMode ? NUI_IMAGE_DEPTH_MAXIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MAXIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+
+    ZeroMemory(&m_tooNearColor, sizeof(m_tooNearColor));
+    ZeroMemory(&m_tooFarColor, sizeof(m_tooFarColor));
 
     switch (m_depthTreatment)
     {
     case CLAMP_UNRELIABLE_DEPTHS:
-        // Fill in the "near" portion of the table with solid color
-        for (int depth = UNKNOWN_DEPTH + 1; depth < minReliableDepth; depth++)
-        {
-            m_depthColorTable[0][depth] = TOO_NEAR_COLOR;
-        }
-
-        // Fill in the "far" portion of the table with solid color
-        for (int depth = maxReliableDepth + 1; depth <= USHRT_MAX; depth++)
-        {
-            m_depthColorTable[0][depth] = TOO_FAR_COLOR;
-        }
+        // Show the "near" and "far" depths in solid colors
+        m_tooNearColor.color = TOO_NEAR_COLOR;
+        m_tooFarColor.color  = TOO_FAR_COLOR;
         break;
 
     case TINT_UNRELIABLE_DEPTHS:
-        {
-            // Fill in the "near" portion of the table with a tinted gradient
-            for (int depth = UNKNOWN_DEPTH + 1; depth < minReliableDepth; depth++)
-            {
-                BYTE intensity = GetIntensity(depth);
-                BYTE r = intensity >> 3;
-                BYTE g = intensity >> 1;
-                BYTE b = intensity;
-                SetColor(&m_depthColorTable[0][depth], r, g, b);
-            }
-
-            // Fill in the "far" portion of the table with a tinted gradient
-            for (int depth = maxReliableDepth + 1; depth <= USHRT_MAX; depth++)
-            {
-                BYTE intensity = GetIntensity(depth);
-                BYTE r = intensity;
-                BYTE g = intensity >> 3;
-                BYTE b = intensity >> 1;
-                SetColor(&m_depthColorTable[0][depth], r, g, b);
-            }
-        }
+        // Show the "near" depths in a blue gradient of intensity (>> 3, >> 1, >> 0)
+        m_tooNearColor.multiplierR = 1;
+        m_tooNearColor.multiplierG = 4;
+        m_tooNearColor.multiplierB = 8;
+        m_tooNearColor.alpha       = UCHAR_MAX;
+
+        // Show the "far" depths in a red gradient of intensity (>> 0, >> 3, >> 1)
+        m_tooFarColor.multiplierR = 8;
+        m_tooFarColor.multiplierG = 1;
+        m_tooFarColor.multiplierB = 4;
+        m_tooFarColor.alpha       = UCHAR_MAX;
         break;
 
     case DISPLAY_ALL_DEPTHS:
-        minReliableDepth = MIN_DEPTH;
-        maxReliableDepth = MAX_DEPTH;
+        m_minReliableDepth = MIN_DEPTH;
+        m_maxReliableDepth = MAX_DEPTH;
 
-        for (int depth = UNKNOWN_DEPTH + 1; depth < minReliableDepth; depth++)
-        {
-            m_depthColorTable[0][depth] = NEAREST_COLOR;
-        }
+        m_tooNearColor.color = NEAREST_COLOR;
         break;
 
     default:
         break;
     }
+}
 
-    for (USHORT depth = minReliableDepth; depth <= maxReliableDepth; depth++)
+/// <summary>
+/// Get the color of a depth pixel
+/// </summary>
+/// <param name="depth">Depth in millimeters</param>
+/// <param name="index">Player index</param>
+/// <returns>Color of the pixel</returns>
+UINT NuiImageBuffer::GetDepthColor(USHORT depth, USHORT index) const
+{
+    if (index > MAX_PLAYER_INDEX)
     {
-        BYTE intensity = GetIntensity(depth);
+        return 0;
+    }
 
-        for (int index = 0; index <= MAX_PLAYER_INDEX; index++)
+    UINT tableIndex = (UINT)depth - MIN_DEPTH;
+    BYTE intensity  = m_pDepthIntensityTable[min(tableIndex, (UINT)(INTENSITY_TABLE_SIZE - 1))];
+
+    UINT color = 0;
+    if (depth >= m_minReliableDepth && depth <= m_maxReliableDepth)
+    {
+        // Tint the reliable depths of each player differently
+        SetColor(&color, intensity >> m_intensityShiftR[index], intensity >> m_intensityShiftG[index], intensity >> m_intensityShiftB[index]);
+    }
+    else if (0 == index)
+    {
+        if (UNKNOWN_DEPTH == depth)
         {
-            BYTE r = intensity >> m_intensityShiftR[index];
-            BYTE g = intensity >> m_intensityShiftG[index];
-            BYTE b = intensity >> m_intensityShiftB[index];
-            SetColor(&m_depthColorTable[index][depth], r, g, b);
+            return UNKNOWN_DEPTH_COLOR;
         }
+
+        const DepthRangeColor& range = (depth < m_minReliableDepth) ? m_tooNearColor : m_tooFarColor;
+        SetColor(&color, (BYTE)((intensity * range.multiplierR) >> 3), (BYTE)((intensity * range.multiplierG) >> 3), (BYTE)((intensity * range.multiplierB) >> 3), range.alpha);
+        color |= range.color;
     }
+
+    return color;
 }
 
 /// <summary>
@@ -251,7 +273,7 @@ void NuiImageBuffer::InitDepthColorTable()
 /// <param name="green">Green component of the color</parma>
 /// <param name="blue">Blue component of the color</param>
 /// <param name="alpha">Alpha component of the color</param>
-void NuiImageBuffer::SetColor(UINT* pColor, BYTE red, BYTE green, BYTE blue, BYTE alpha)
+void NuiImageBuffer::SetColor(UINT* pColor, BYTE red, BYTE green, BYTE blue, BYTE alpha) const
 {
     if (!pColor)
         return;
@@ -305,7 +327,10 @@ void NuiImageBuffer::CopyRGB(const BYTE* pImage, UINT size)
     m_height = m_srcHeight;
 
     // Allocate buffer for image
-    ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
+    if (!ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB))
+    {
+        return;
+    }
 
     // Copy source image to buffer
     memcpy_s(m_pBuffer, m_nSizeInBytes, pImage, size);
@@ -316,7 +341,8 @@ void NuiImageBuffer::CopyRGB(const BYTE* pImage, UINT size)
 /// </summary>
 /// <param name="pImage">The pointer to the frame image to copy</param>
 /// <param name="size">Size in bytes to copy</param>
-void NuiImageBuffer::CopyBayer(const BYTE* pImage, UINT size)
+/// <param name="method">Demosaic method</param>
+void NuiImageBuffer::CopyBayer(const BYTE* pImage, UINT size, BAYER_DEMOSAIC method)
 {
     // Check source buffer size
     if (size != m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_BAYER)
@@ -336,28 +362,12 @@ void NuiImageBuffer::CopyBayer(const BYTE* pImage, UINT size)
 
     // Allocate buffer for image
     UINT* pBuffer = (UINT*)ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
-
-    // Run through pixels
-    for (DWORD y = 0; y < m_srcHeight; y += 2)
+    if (!pBuffer)
     {
-        for (DWORD x = 0; x < m_srcWidth; x += 2)
-        {
-            int firstRowOffset  = (y * m_srcWidth) + x;
-            int secondRowOffset = firstRowOffset + m_srcWidth;
-                                                    //  _____
-            // Get bayer colors from source image   // |  |  |
-            BYTE r  = pImage[firstRowOffset + 1];   // |g1|r |
-            BYTE g1 = pImage[firstRowOffset];       // |--|--|
-            BYTE g2 = pImage[secondRowOffset + 1];  // |b |g2|
-            BYTE b  = pImage[secondRowOffset];      // |__|__|
-
-            // Set color to buffered pixel
-            SetColor(pBuffer + firstRowOffset,      r, g1, b);
-            SetColor(pBuffer + firstRowOffset  + 1, r, g1, b);
-            SetColor(pBuffer + secondRowOffset,     r, g2, b);
-            SetColor(pBuffer + secondRowOffset + 1, r, g2, b);
-        }
+        return;
     }
+
+    m_bayerDemosaic.Demosaic(pImage, m_width, m_height, method, pBuffer);
 }
 
 /// <summary>
@@ -365,7 +375,9 @@ void NuiImageBuffer::CopyBayer(const BYTE* pImage, UINT size)
 /// </summary>
 /// <param name="pImage">The pointer to the frame image to copy</param>
 /// <param name="size">Size in bytes to copy</param>
-void NuiImageBuffer::CopyInfrared(const BYTE* pImage, UINT size)
+/// <param name="autoExposure">Whether to stretch the infrared levels over the display range</param>
+/// <param name="denoise">Whether to apply the temporal denoise</param>
+void NuiImageBuffer::CopyInfrared(const BYTE* pImage, UINT size, bool autoExposure, bool denoise)
 {
     // Check source buffer size
     if (size != m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_INFRARED)
@@ -378,24 +390,14 @@ void NuiImageBuffer::CopyInfrared(const BYTE* pImage, UINT size)
     m_height = m_srcHeight;
 
     // Allocate buffer for image
-    UINT*   pBuffer   = (UINT*)ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
-
-    // Initialize pixel pointers
-    USHORT* pPixelRun = (USHORT*)pImage;
-    USHORT* pPixelEnd = pPixelRun + size / BYTES_PER_PIXEL_INFRARED;
+    BYTE* pBuffer = ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
 
-    // Run through pixels
-    while (pPixelRun < pPixelEnd)
+    if (pBuffer && SUCCEEDED(m_infraredToneMapper.Initialize(m_width, m_height)))
     {
-        // Convert pixel from 16-bit to 8-bit intensity
-        BYTE intensity = (*pPixelRun) >> 8;
-
-        // Set pixel color with R, G and B components all equal to intensity
-        SetColor(pBuffer, intensity, intensity, intensity);
-
-        // Move to next pixel
-        ++pPixelRun;
-        ++pBuffer;
+        // Convert pixels from 16-bit to 8-bit intensity, with R, G and B components all equal to intensity
+        m_infraredToneMapper.SetAutoExposure(autoExposure);
+        m_infraredToneMapper.SetTemporalDenoise(denoise, INFRARED_DENOISE_WEIGHT, INFRARED_MOTION_THRESHOLD);
+        m_infraredToneMapper.Apply((const USHORT*)pImage, pBuffer, m_width * BYTES_PER_PIXEL_RGB);
     }
 }
 
@@ -414,13 +416,13 @@ void NuiImageBuffer::CopyDepth(const BYTE* pImage, UINT size, BOOL nearMode, DEP
         return;
     }
 
-    // Check if range mode and depth treatment have been changed. Re-initlialize depth-color table with changed parameters
+    // Check if range mode and depth treatment have been changed. Update depth color ranges with changed parameters
     if (m_nearMode != (FALSE != nearMode) || m_depthTreatment != treatment)
     {
         m_nearMode       = (FALSE != nearMode);
         m_depthTreatment = treatment;
 
-        InitDepthColorTable();
+        UpdateDepthColorRanges();
     }
 
     // Converted image size is equal to source image size
@@ -429,20 +431,131 @@ void NuiImageBuffer::CopyDepth(const BYTE* pImage, UINT size, BOOL nearMode, DEP
 
     // Allocate buffer for color image. If required buffer size hasn't changed, the previously allocated buffer is returned
     UINT* rgbrun = (UINT*)ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
+    if (!rgbrun)
+    {
+        return;
+    }
 
     // Initialize pixel pointers to start and end of image buffer
-    NUI_DEPTH_IMAGE_PIXEL* pPixelRun = (NUI_DEPTH_IMAGE_PIXEL*)pImage;
-    NUI_DEPTH_IMAGE_PIXEL* pPixelEnd = pPixelRun + m_srcWidth * m_srcHeight;
+    const NUI_DEPTH_IMAGE_PIXEL* pPixelRun = (const NUI_DEPTH_IMAGE_PIXEL*)pImage;
+    const NUI_DEPTH_IMAGE_PIXEL* pPixelEnd = pPixelRun + m_srcWidth * m_srcHeight;
+
+    // Depths are compared as signed 16-bit values offset by 0x8000, which keeps their unsigned order
+    const __m128i offset       = _mm_set1_epi16((short)0x8000);
+    const __m128i zero         = _mm_setzero_si128();
+    const __m128i minReliable  = _mm_set1_epi16((short)(m_minReliableDepth ^ 0x8000));
+    const __m128i maxReliable  = _mm_set1_epi16((short)(m_maxReliableDepth ^ 0x8000));
+    const __m128i tableMin     = _mm_set1_epi16(MIN_DEPTH);
+    const __m128i tableLast    = _mm_set1_epi16((short)((INTENSITY_TABLE_SIZE - 1) ^ 0x8000));
+    const __m128i opaque       = _mm_set1_epi16(UCHAR_MAX);
+    const __m128i unknownColor = _mm_set1_epi32(UNKNOWN_DEPTH_COLOR);
+
+    // Each channel is the intensity times a multiplier divided by 8, which shifts it right by 0 to 3 bits
+    __m128i playerMultiplierR[MAX_PLAYER_INDEX + 1];
+    __m128i playerMultiplierG[MAX_PLAYER_INDEX + 1];
+    __m128i playerMultiplierB[MAX_PLAYER_INDEX + 1];
+    for (int index = 0; index <= MAX_PLAYER_INDEX; index++)
+    {
+        playerMultiplierR[index] = _mm_set1_epi16(8 >> m_intensityShiftR[index]);
+        playerMultiplierG[index] = _mm_set1_epi16(8 >> m_intensityShiftG[index]);
+        playerMultiplierB[index] = _mm_set1_epi16(8 >> m_intensityShiftB[index]);
+    }
 
-    // Run through pixels
-    while (pPixelRun < pPixelEnd)
+    const __m128i nearMultiplierR = _mm_set1_epi16(m_tooNearColor.multiplierR);
+    const __m128i nearMultiplierG = _mm_set1_epi16(m_tooNearColor.multiplierG);
+    const __m128i nearMultiplierB = _mm_set1_epi16(m_tooNearColor.multiplierB);
+    const __m128i nearAlpha       = _mm_set1_epi16(m_tooNearColor.alpha);
+    const __m128i nearColor       = _mm_set1_epi32(m_tooNearColor.color);
+    const __m128i farMultiplierR  = _mm_set1_epi16(m_tooFarColor.multiplierR);
+    const __m128i farMultiplierG  = _mm_set1_epi16(m_tooFarColor.multiplierG);
+    const __m128i farMultiplierB  = _mm_set1_epi16(m_tooFarColor.multiplierB);
+    const __m128i farAlpha        = _mm_set1_epi16(m_tooFarColor.alpha);
+    const __m128i farColor        = _mm_set1_epi32(m_tooFarColor.color);
+
+    // Run through pixels, 8 at a time
+    while (pPixelRun + 8 <= pPixelEnd)
     {
-        // Get pixel depth and player index
-        USHORT depth = pPixelRun->depth;
-        USHORT index = pPixelRun->playerIndex;
+        // Separate the player indices and depths of the pixels
+        __m128i first  = _mm_loadu_si128((const __m128i*)pPixelRun);
+        __m128i second = _mm_loadu_si128((const __m128i*)(pPixelRun + 4));
+        first  = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(first, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        second = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(second, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+
+        __m128i index = _mm_unpacklo_epi64(first, second);
+        __m128i depth = _mm_unpackhi_epi64(first, second);
+
+        // Look up the intensities of the depths
+        USHORT tableIndex[8];
+        __m128i clamped = _mm_min_epi16(_mm_xor_si128(_mm_sub_epi16(depth, tableMin), offset), tableLast);
+        _mm_storeu_si128((__m128i*)tableIndex, _mm_xor_si128(clamped, offset));
+
+        __m128i intensity = _mm_setr_epi16(
+            m_pDepthIntensityTable[tableIndex[0]], m_pDepthIntensityTable[tableIndex[1]],
+            m_pDepthIntensityTable[tableIndex[2]], m_pDepthIntensityTable[tableIndex[3]],
+            m_pDepthIntensityTable[tableIndex[4]], m_pDepthIntensityTable[tableIndex[5]],
+            m_pDepthIntensityTable[tableIndex[6]], m_pDepthIntensityTable[tableIndex[7]]);
+
+        // Classify the depths
+        __m128i offsetDepth = _mm_xor_si128(depth, offset);
+        __m128i tooNear     = _mm_cmplt_epi16(offsetDepth, minReliable);
+        __m128i tooFar      = _mm_cmpgt_epi16(offsetDepth, maxReliable);
+        __m128i unreliable  = _mm_or_si128(tooNear, tooFar);
+        __m128i player0     = _mm_cmpeq_epi16(index, zero);
+        __m128i unknown     = _mm_and_si128(player0, _mm_cmpeq_epi16(depth, zero));
+        __m128i near0       = _mm_andnot_si128(unknown, _mm_and_si128(player0, tooNear));
+        __m128i far0        = _mm_and_si128(player0, tooFar);
+
+        // Tint the reliable depths by player
+        __m128i multiplierR = zero;
+        __m128i multiplierG = zero;
+        __m128i multiplierB = zero;
+        __m128i alpha       = zero;
+        for (int player = 0; player <= MAX_PLAYER_INDEX; player++)
+        {
+            __m128i isPlayer = _mm_andnot_si128(unreliable, _mm_cmpeq_epi16(index, _mm_set1_epi16((short)player)));
+            multiplierR = _mm_or_si128(multiplierR, _mm_and_si128(isPlayer, playerMultiplierR[player]));
+            multiplierG = _mm_or_si128(multiplierG, _mm_and_si128(isPlayer, playerMultiplierG[player]));
+            multiplierB = _mm_or_si128(multiplierB, _mm_and_si128(isPlayer, playerMultiplierB[player]));
+            alpha       = _mm_or_si128(alpha, _mm_and_si128(isPlayer, opaque));
+        }
+
+        // Tint the unreliable depths of pixels without a player by treatment
+        multiplierR = _mm_or_si128(multiplierR, _mm_or_si128(_mm_and_si128(near0, nearMultiplierR), _mm_and_si128(far0, farMultiplierR)));
+        multiplierG = _mm_or_si128(multiplierG, _mm_or_si128(_mm_and_si128(near0, nearMultiplierG), _mm_and_si128(far0, farMultiplierG)));
+        multiplierB = _mm_or_si128(multiplierB, _mm_or_si128(_mm_and_si128(near0, nearMultiplierB), _mm_and_si128(far0, farMultiplierB)));
+        alpha       = _mm_or_si128(alpha, _mm_or_si128(_mm_and_si128(near0, nearAlpha), _mm_and_si128(far0, farAlpha)));
+
+        __m128i r = _mm_srli_epi16(_mm_mullo_epi16(intensity, multiplierR), 3);
+        __m128i g = _mm_srli_epi16(_mm_mullo_epi16(intensity, multiplierG), 3);
+        __m128i b = _mm_srli_epi16(_mm_mullo_epi16(intensity, multiplierB), 3);
+
+        // Interleave the channels into BGRA pixels and add the solid colors
+        __m128i blueGreen = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        __m128i redAlpha  = _mm_or_si128(r, _mm_slli_epi16(alpha, 8));
+
+        __m128i colors[2] = { _mm_unpacklo_epi16(blueGreen, redAlpha), _mm_unpackhi_epi16(blueGreen, redAlpha) };
+        __m128i unknowns[2] = { _mm_unpacklo_epi16(unknown, unknown), _mm_unpackhi_epi16(unknown, unknown) };
+        __m128i nears[2] = { _mm_unpacklo_epi16(near0, near0), _mm_unpackhi_epi16(near0, near0) };
+        __m128i fars[2] = { _mm_unpacklo_epi16(far0, far0), _mm_unpackhi_epi16(far0, far0) };
 
-        // Get mapped color from depth-color table
-        *rgbrun = m_depthColorTable[index][depth];
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i solid = _mm_or_si128(
+                _mm_and_si128(unknowns[half], unknownColor),
+                _mm_or_si128(_mm_and_si128(nears[half], nearColor), _mm_and_si128(fars[half], farColor)));
+
+            _mm_storeu_si128((__m128i*)(rgbrun + 4 * half), _mm_or_si128(colors[half], solid));
+        }
+
+        // Move the pointers to next pixels
+        rgbrun    += 8;
+        pPixelRun += 8;
+    }
+
+    // Run through remaining pixels
+    while (pPixelRun < pPixelEnd)
+    {
+        *rgbrun = GetDepthColor(pPixelRun->depth, pPixelRun->playerIndex);
 
         // Move the pointers to next pixel
         ++rgbrun;
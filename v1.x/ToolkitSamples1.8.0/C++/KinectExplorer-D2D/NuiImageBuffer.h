@@ -21,6 +21,9 @@
 #pragma once
 
 #include <NuiApi.h>
+#include "NuiBayerDemosaic.h"
+#include "NuiFrameBufferPool.h"
+#include "NuiInfraredToneMapper.h"
 
 #define MAX_PLAYER_INDEX    6
 
@@ -95,14 +98,17 @@ public:
     /// </summary>
     /// <param name="pImage">The pointer to the frame image to copy</param>
     /// <param name="size">Size in bytes to copy</param>
-    void CopyBayer(const BYTE* source, UINT size);
+    /// <param name="method">Demosaic method</param>
+    void CopyBayer(const BYTE* source, UINT size, BAYER_DEMOSAIC method);
 
     /// <summary>
     /// Copy and convert infrared frame image to image buffer
     /// </summary>
     /// <param name="pImage">The pointer to the frame image to copy</param>
     /// <param name="size">Size in bytes to copy</param>
-    void CopyInfrared(const BYTE* source, UINT size);
+    /// <param name="autoExposure">Whether to stretch the infrared levels over the display range</param>
+    /// <param name="denoise">Whether to apply the temporal denoise</param>
+    void CopyInfrared(const BYTE* source, UINT size, bool autoExposure, bool denoise);
 
     /// <summary>
     /// Copy and convert depth frame image to image buffer
@@ -125,9 +131,22 @@ private:
     void GetImageSize(NUI_IMAGE_RESOLUTION resolution, DWORD& width, DWORD& height);
 
     /// <summary>
-    /// Initialize the depth-color mapping table.
+    /// Initialize the depth-intensity mapping table.
     /// </summary>
-    void InitDepthColorTable();
+    void InitDepthIntensityTable();
+
+    /// <summary>
+    /// Set the reliable depth range and the colors outside it for the range mode and depth treatment.
+    /// </summary>
+    void UpdateDepthColorRanges();
+
+    /// <summary>
+    /// Get the color of a depth pixel
+    /// </summary>
+    /// <param name="depth">Depth in millimeters</param>
+    /// <param name="index">Player index</param>
+    /// <returns>Color of the pixel</returns>
+    UINT GetDepthColor(USHORT depth, USHORT index) const;
 
     /// <summary>
     /// Set color value
@@ -137,7 +156,7 @@ private:
     /// <param name="green">Green component of the color</parma>
     /// <param name="blue">Blue component of the color</param>
     /// <param name="alpha">Alpha component of the color</param>
-    inline void SetColor(UINT* pColor, BYTE red, BYTE green, BYTE blue, BYTE alpha = 255);
+    inline void SetColor(UINT* pColor, BYTE red, BYTE green, BYTE blue, BYTE alpha = 255) const;
 
     /// <summary>
     /// Calculate intensity of a certain depth
@@ -150,14 +169,34 @@ private:
     /// Allocate a buffer of size and return it
     /// </summary>
     /// <param name="size">Size of buffer to allocate. Zeor to release buffer memory</param>
-    /// <returns>The pointer to the allocated buffer. If size hasn't changed, the previously allocated buffer is returned</returns>
+    /// <returns>The pointer to the allocated buffer, or nullptr if it could not be allocated. If size hasn't changed, the previously allocated buffer is returned</returns>
     BYTE* ResetBuffer(UINT size);
 
 private:
+    /// <summary>
+    /// Color of player 0 pixels on one side of the reliable depth range. Each color channel is
+    /// the depth intensity times its multiplier divided by 8, combined with a solid color.
+    /// </summary>
+    struct DepthRangeColor
+    {
+        BYTE multiplierR;
+        BYTE multiplierG;
+        BYTE multiplierB;
+        BYTE alpha;
+        UINT color;
+    };
+
     static const BYTE    m_intensityShiftR[MAX_PLAYER_INDEX + 1];
     static const BYTE    m_intensityShiftG[MAX_PLAYER_INDEX + 1];
     static const BYTE    m_intensityShiftB[MAX_PLAYER_INDEX + 1];
-    UINT                 m_depthColorTable[MAX_PLAYER_INDEX + 1][USHRT_MAX + 1];
+
+    // Intensity of each depth from MIN_DEPTH to MAX_DEPTH, followed by the intensity of all other depths
+    BYTE*                m_pDepthIntensityTable;
+
+    USHORT               m_minReliableDepth;
+    USHORT               m_maxReliableDepth;
+    DepthRangeColor      m_tooNearColor;
+    DepthRangeColor      m_tooFarColor;
 
     bool                m_nearMode;
     DWORD               m_width;
@@ -166,5 +205,8 @@ private:
     DWORD               m_srcHeight;
     DWORD               m_nSizeInBytes;
     BYTE*               m_pBuffer;
+    NuiPooledBuffer     m_buffer;
     DEPTH_TREATMENT     m_depthTreatment;
+    NuiBayerDemosaic    m_bayerDemosaic;
+    NuiInfraredToneMapper m_infraredToneMapper;
 };
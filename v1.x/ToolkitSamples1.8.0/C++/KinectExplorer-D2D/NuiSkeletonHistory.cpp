@@ -0,0 +1,235 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiSkeletonHistory.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "NuiSkeletonHistory.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+NuiSkeletonHistory::NuiSkeletonHistory()
+    : m_writeSequence(0)
+    , m_latestSequence(0)
+{
+    ZeroMemory(m_slots, sizeof(m_slots));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+NuiSkeletonHistory::~NuiSkeletonHistory()
+{
+}
+
+/// <summary>
+/// Get the slot to write the next frame into
+/// </summary>
+/// <returns>The pointer to the frame to write</returns>
+NUI_SKELETON_FRAME* NuiSkeletonHistory::BeginWrite()
+{
+    Slot& slot = m_slots[(m_writeSequence + 1) & (FrameCount - 1)];
+
+    // Invalidate the slot before the frame in it changes. The interlocked write is a full barrier
+    InterlockedExchange(&slot.sequence, 0);
+
+    return &slot.frame;
+}
+
+/// <summary>
+/// Publish the frame written since BeginWrite as the latest frame
+/// </summary>
+/// <returns>The pointer to the published frame</returns>
+const NUI_SKELETON_FRAME* NuiSkeletonHistory::Publish()
+{
+    LONG  sequence = ++m_writeSequence;
+    Slot& slot     = m_slots[sequence & (FrameCount - 1)];
+
+    // The frame is complete before readers can see its sequence number
+    InterlockedExchange(&slot.sequence, sequence);
+    InterlockedExchange(&m_latestSequence, sequence);
+
+    return &slot.frame;
+}
+
+/// <summary>
+/// Drop all frames
+/// </summary>
+void NuiSkeletonHistory::Clear()
+{
+    InterlockedExchange(&m_latestSequence, 0);
+
+    // Also invalidate the older frames, so no interpolation spans the gap to the next frame
+    for (int i = 0; i < FrameCount; i++)
+    {
+        InterlockedExchange(&m_slots[i].sequence, 0);
+    }
+}
+
+/// <summary>
+/// Get the sequence number of the latest frame
+/// </summary>
+/// <returns>Sequence number of the latest frame, or 0 if there is none</returns>
+LONG NuiSkeletonHistory::GetLatestSequence() const
+{
+    return m_latestSequence;
+}
+
+/// <summary>
+/// Get a frame in the ring by its sequence number
+/// </summary>
+/// <param name="sequence">Sequence number of the frame</param>
+/// <returns>The pointer to the frame, or nullptr if it is not in the ring</returns>
+const NUI_SKELETON_FRAME* NuiSkeletonHistory::GetFrame(LONG sequence) const
+{
+    if (sequence <= 0)
+    {
+        return nullptr;
+    }
+
+    const Slot& slot = m_slots[sequence & (FrameCount - 1)];
+    if (slot.sequence != sequence)
+    {
+        // Overwritten, being written, or not yet published
+        return nullptr;
+    }
+
+    return &slot.frame;
+}
+
+/// <summary>
+/// Get the latest frame
+/// </summary>
+/// <returns>The pointer to the latest frame, or nullptr if there is none</returns>
+const NUI_SKELETON_FRAME* NuiSkeletonHistory::GetLatestFrame() const
+{
+    return GetFrame(GetLatestSequence());
+}
+
+/// <summary>
+/// Check that a frame got from GetFrame has not been overwritten since
+/// </summary>
+/// <param name="sequence">Sequence number of the frame</param>
+/// <returns>Indicates if the data read from the frame is valid</returns>
+bool NuiSkeletonHistory::IsFrameValid(LONG sequence) const
+{
+    // Finish the reads of the frame before reading its sequence number again
+    MemoryBarrier();
+
+    return sequence > 0 && m_slots[sequence & (FrameCount - 1)].sequence == sequence;
+}
+
+/// <summary>
+/// Get the joint positions of a tracked skeleton at a time between two frames in the ring
+/// </summary>
+/// <param name="timeStamp">Time in milliseconds, in the time base of the frame time stamps</param>
+/// <param name="trackingID">Tracking ID of the skeleton</param>
+/// <param name="positions">Returns the joint positions</param>
+/// <returns>Indicates if the positions are returned</returns>
+bool NuiSkeletonHistory::GetInterpolatedJoints(LONGLONG timeStamp, DWORD trackingID, Vector4 positions[NUI_SKELETON_POSITION_COUNT]) const
+{
+    LONG latest = GetLatestSequence();
+
+    // Walk back from the latest frame to the first frame at or before the time. The slot
+    // after the latest frame is skipped as the writer may be rewriting it
+    LONG     after     = 0;
+    LONGLONG afterTime = 0;
+    for (LONG sequence = latest; sequence > 0 && latest - sequence < FrameCount - 1; sequence--)
+    {
+        const NUI_SKELETON_FRAME* pFrame = GetFrame(sequence);
+        if (!pFrame)
+        {
+            return false;
+        }
+
+        LONGLONG frameTime = pFrame->liTimeStamp.QuadPart;
+        if (!IsFrameValid(sequence))
+        {
+            return false;
+        }
+
+        if (frameTime > timeStamp)
+        {
+            after     = sequence;
+            afterTime = frameTime;
+            continue;
+        }
+
+        const NUI_SKELETON_DATA* pBefore = FindTrackedSkeleton(*pFrame, trackingID);
+        if (!pBefore)
+        {
+            return false;
+        }
+
+        if (frameTime == timeStamp)
+        {
+            CopyMemory(positions, pBefore->SkeletonPositions, sizeof(pBefore->SkeletonPositions));
+            return IsFrameValid(sequence);
+        }
+
+        if (!after)
+        {
+            // The time is later than the latest frame
+            return false;
+        }
+
+        const NUI_SKELETON_FRAME* pAfterFrame = GetFrame(after);
+        const NUI_SKELETON_DATA*  pAfter      = pAfterFrame ? FindTrackedSkeleton(*pAfterFrame, trackingID) : nullptr;
+        if (!pAfter)
+        {
+            return false;
+        }
+
+        FLOAT weight = static_cast<FLOAT>(timeStamp - frameTime) / static_cast<FLOAT>(afterTime - frameTime);
+        for (int i = 0; i < NUI_SKELETON_POSITION_COUNT; i++)
+        {
+            const Vector4& p0 = pBefore->SkeletonPositions[i];
+            const Vector4& p1 = pAfter->SkeletonPositions[i];
+
+            positions[i].x = p0.x + (p1.x - p0.x) * weight;
+            positions[i].y = p0.y + (p1.y - p0.y) * weight;
+            positions[i].z = p0.z + (p1.z - p0.z) * weight;
+            positions[i].w = p0.w + (p1.w - p0.w) * weight;
+        }
+
+        return IsFrameValid(sequence) && IsFrameValid(after);
+    }
+
+    // The time is earlier than the ring holds
+    return false;
+}
+
+/// <summary>
+/// Find a tracked skeleton in a frame
+/// </summary>
+/// <param name="frame">Skeleton frame</param>
+/// <param name="trackingID">Tracking ID of the skeleton</param>
+/// <returns>The pointer to the skeleton data, or nullptr if it is not tracked</returns>
+const NUI_SKELETON_DATA* NuiSkeletonHistory::FindTrackedSkeleton(const NUI_SKELETON_FRAME& frame, DWORD trackingID)
+{
+    for (int i = 0; i < NUI_SKELETON_COUNT; i++)
+    {
+        if (NUI_SKELETON_TRACKED == frame.SkeletonData[i].eTrackingState && trackingID == frame.SkeletonData[i].dwTrackingID)
+        {
+            return &frame.SkeletonData[i];
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiSkeletonHistory.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <NuiApi.h>
+
+/// <summary>
+/// Ring of the last skeleton frames of a stream. One writer at a time writes frames into the ring in
+/// place and publishes them, and any number of readers read them in place without taking a
+/// lock. Each slot carries the sequence number of the frame it holds, which is cleared while
+/// the slot is rewritten, so a reader checks with IsFrameValid after reading a frame that it
+/// was not overwritten meanwhile.
+/// </summary>
+class NuiSkeletonHistory
+{
+public:
+    // Number of frames kept, about one second of skeleton frames. Must be a power of two
+    static const LONG FrameCount = 32;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    NuiSkeletonHistory();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~NuiSkeletonHistory();
+
+public:
+    /// <summary>
+    /// Get the slot to write the next frame into. The slot holds the oldest frame, which
+    /// readers no longer see once this is called. Only the writer may call this.
+    /// </summary>
+    /// <returns>The pointer to the frame to write</returns>
+    NUI_SKELETON_FRAME* BeginWrite();
+
+    /// <summary>
+    /// Publish the frame written since BeginWrite as the latest frame. Only the writer
+    /// may call this.
+    /// </summary>
+    /// <returns>The pointer to the published frame</returns>
+    const NUI_SKELETON_FRAME* Publish();
+
+    /// <summary>
+    /// Drop all frames, so readers see no latest frame until the next one is published.
+    /// Only the writer may call this.
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// Get the sequence number of the latest frame
+    /// </summary>
+    /// <returns>Sequence number of the latest frame, or 0 if there is none</returns>
+    LONG GetLatestSequence() const;
+
+    /// <summary>
+    /// Get a frame in the ring by its sequence number. The frame stays in the ring until
+    /// FrameCount - 1 newer frames are published.
+    /// </summary>
+    /// <param name="sequence">Sequence number of the frame</param>
+    /// <returns>The pointer to the frame, or nullptr if it is not in the ring</returns>
+    const NUI_SKELETON_FRAME* GetFrame(LONG sequence) const;
+
+    /// <summary>
+    /// Get the latest frame
+    /// </summary>
+    /// <returns>The pointer to the latest frame, or nullptr if there is none</returns>
+    const NUI_SKELETON_FRAME* GetLatestFrame() const;
+
+    /// <summary>
+    /// Check that a frame got from GetFrame has not been overwritten since
+    /// </summary>
+    /// <param name="sequence">Sequence number of the frame</param>
+    /// <returns>Indicates if the data read from the frame is valid</returns>
+    bool IsFrameValid(LONG sequence) const;
+
+    /// <summary>
+    /// Get the joint positions of a tracked skeleton at a time between two frames in the
+    /// ring, interpolated linearly between them. Velocities and accelerations of joints
+    /// can be calculated from positions at a few times.
+    /// </summary>
+    /// <param name="timeStamp">Time in milliseconds, in the time base of the frame time stamps</param>
+    /// <param name="trackingID">Tracking ID of the skeleton</param>
+    /// <param name="positions">Returns the joint positions</param>
+    /// <returns>
+    /// True if the skeleton was tracked in both frames around the time. False if the time
+    /// is out of the ring or a frame was overwritten while it was read
+    /// </returns>
+    bool GetInterpolatedJoints(LONGLONG timeStamp, DWORD trackingID, Vector4 positions[NUI_SKELETON_POSITION_COUNT]) const;
+
+private:
+    /// <summary>
+    /// Find a tracked skeleton in a frame
+    /// </summary>
+    /// <param name="frame">Skeleton frame</param>
+    /// <param name="trackingID">Tracking ID of the skeleton</param>
+    /// <returns>The pointer to the skeleton data, or nullptr if it is not tracked</returns>
+    static const NUI_SKELETON_DATA* FindTrackedSkeleton(const NUI_SKELETON_FRAME& frame, DWORD trackingID);
+
+private:
+    struct Slot
+    {
+        volatile LONG       sequence;
+        NUI_SKELETON_FRAME  frame;
+    };
+
+    Slot            m_slots[FrameCount];
+    LONG            m_writeSequence;
+    volatile LONG   m_latestSequence;
+};
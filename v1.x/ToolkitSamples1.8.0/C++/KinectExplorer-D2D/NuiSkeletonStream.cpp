@@ -31,10 +31,13 @@ NuiSkeletonStream::NuiSkeletonStream(INuiSensor* pNuiSensor)
     , m_near(false)
     , m_seated(false)
     , m_chooserMode(ChooserModeDefault)
+    , m_pSkeletonFrame(nullptr)
     , m_pSecondStreamViewer(nullptr)
 {
     m_stickyIDs[FirstTrackID] = 0;
     m_stickyIDs[SecondTrackID] = 0;
+
+    InitializeCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -42,12 +45,25 @@ NuiSkeletonStream::NuiSkeletonStream(INuiSensor* pNuiSensor)
 /// </summary>
 NuiSkeletonStream::~NuiSkeletonStream()
 {
+    // Detach skeleton history from stream viewers
+    if (m_pStreamViewer)
+    {
+        m_pStreamViewer->SetSkeletonHistory(nullptr);
+    }
+
+    if (m_pSecondStreamViewer)
+    {
+        m_pSecondStreamViewer->SetSkeletonHistory(nullptr);
+    }
+
     // Clear activity watchers
     for (auto itr = m_activityWatchers.begin(); itr != m_activityWatchers.end(); ++itr)
     {
         delete itr->second;
     }
     m_activityWatchers.clear();
+
+    DeleteCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -56,11 +72,15 @@ NuiSkeletonStream::~NuiSkeletonStream()
 /// <param name="nearMode">True to enable near mode. False to disable</param>
 void NuiSkeletonStream::SetNearMode(bool nearMode)
 {
+    EnterCriticalSection(&m_writeLock);
+
     if (m_near != nearMode)
     {
         m_near = nearMode;
         StartStream();  // Restart stream with new parameter value
     }
+
+    LeaveCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -69,11 +89,15 @@ void NuiSkeletonStream::SetNearMode(bool nearMode)
 /// <param name="seated">True to enable seated mode. False to disable</param>
 void NuiSkeletonStream::SetSeatedMode(bool seated)
 {
+    EnterCriticalSection(&m_writeLock);
+
     if (m_seated != seated)
     {
         m_seated = seated;
         StartStream();  // Restart stream with new parameter value
     }
+
+    LeaveCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -82,11 +106,15 @@ void NuiSkeletonStream::SetSeatedMode(bool seated)
 /// <param name="mode">Chooser mode to be set</param>
 void NuiSkeletonStream::SetChooserMode(ChooserMode mode)
 {
+    EnterCriticalSection(&m_writeLock);
+
     if (m_chooserMode != mode)
     {
         m_chooserMode = mode;
         StartStream();  // Restart stream with new parameter value
     }
+
+    LeaveCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -95,34 +123,71 @@ void NuiSkeletonStream::SetChooserMode(ChooserMode mode)
 /// <param name="pStreamViewer">The pointer to the stream viewer to be attached</param>
 void NuiSkeletonStream::SetSecondStreamViewer(NuiStreamViewer* pStreamViewer)
 {
+    if (pStreamViewer)
+    {
+        // The viewer draws the latest frame in skeleton history
+        pStreamViewer->SetSkeletonHistory(&m_skeletonHistory);
+    }
+
     m_pSecondStreamViewer = pStreamViewer;
 }
 
+/// <summary>
+/// Attach stream viewer to display skeleton
+/// </summary>
+/// <param name="pStreamViewer">The pointer to the stream viewer to be attached</param>
+/// <returns>Previously attached viewer object. If none, returns nullptr</returns>
+NuiStreamViewer* NuiSkeletonStream::SetStreamViewer(NuiStreamViewer* pStreamViewer)
+{
+    if (pStreamViewer)
+    {
+        // The viewer draws the latest frame in skeleton history
+        pStreamViewer->SetSkeletonHistory(&m_skeletonHistory);
+    }
+
+    return NuiStream::SetStreamViewer(pStreamViewer);
+}
+
+/// <summary>
+/// Get the history of skeleton frames
+/// </summary>
+/// <returns>The skeleton frame history</returns>
+const NuiSkeletonHistory* NuiSkeletonStream::GetSkeletonHistory() const
+{
+    return &m_skeletonHistory;
+}
+
 /// <summary>
 /// Start stream processing
 /// </summary>
 HRESULT NuiSkeletonStream::StartStream()
 {
+    HRESULT hr = E_FAIL;
+
+    EnterCriticalSection(&m_writeLock);
+
     if (HasSkeletalEngine(m_pNuiSensor))
     {
         if (m_paused)
         {
             // Clear skeleton data in stream viewers
-            AssignSkeletonFrameToStreamViewers(nullptr);
+            m_skeletonHistory.Clear();
 
             // Disable tracking skeleton
-            return m_pNuiSensor->NuiSkeletonTrackingDisable();
+            hr = m_pNuiSensor->NuiSkeletonTrackingDisable();
         }
         else
         {
             // Enable tracking skeleton
             DWORD flags = (m_seated ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0) | (m_near ? NUI_SKELETON_TRACKING_FLAG_ENABLE_IN_NEAR_RANGE : 0)
                 | (ChooserModeDefault != m_chooserMode ? NUI_SKELETON_TRACKING_FLAG_TITLE_SETS_TRACKED_SKELETONS : 0);
-            return m_pNuiSensor->NuiSkeletonTrackingEnable(GetFrameReadyEvent(), flags);
+            hr = m_pNuiSensor->NuiSkeletonTrackingEnable(GetFrameReadyEvent(), flags);
         }
     }
 
-    return E_FAIL;
+    LeaveCriticalSection(&m_writeLock);
+
+    return hr;
 }
 
 /// <summary>
@@ -131,11 +196,15 @@ HRESULT NuiSkeletonStream::StartStream()
 /// <param name="pause">True to pause the stream and false to resume</param>
 void NuiSkeletonStream::PauseStream(bool pause)
 {
+    EnterCriticalSection(&m_writeLock);
+
     if (m_paused != pause)
     {
         m_paused = pause;
         StartStream();
     }
+
+    LeaveCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -143,11 +212,10 @@ void NuiSkeletonStream::PauseStream(bool pause)
 /// </summary>
 void NuiSkeletonStream::ProcessStreamFrame()
 {
-    if (WAIT_OBJECT_0 == WaitForSingleObject(GetFrameReadyEvent(), 0))
-    {
-        // if we have received any valid new depth data we may need to draw
-        ProcessSkeleton();
-    }
+    // if we have received any valid new skeleton data we may need to draw
+    EnterCriticalSection(&m_writeLock);
+    ProcessSkeleton();
+    LeaveCriticalSection(&m_writeLock);
 }
 
 /// <summary>
@@ -155,21 +223,22 @@ void NuiSkeletonStream::ProcessStreamFrame()
 /// <summary>
 void NuiSkeletonStream::ProcessSkeleton()
 {
-    // Retrieve skeleton frame
-    HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, &m_skeletonFrame);
+    // Retrieve skeleton frame straight into the next slot of skeleton history
+    NUI_SKELETON_FRAME* pFrame = m_skeletonHistory.BeginWrite();
+    HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, pFrame);
     if (FAILED(hr) || m_paused)
     {
         // If occur error when get skeleton data or pause tracking skeleton,
         // clear skeleton data in stream viewers
-        AssignSkeletonFrameToStreamViewers(nullptr);
+        m_skeletonHistory.Clear();
         return;
     }
 
     // smooth out the skeleton data
-    m_pNuiSensor->NuiTransformSmooth(&m_skeletonFrame, nullptr);
+    m_pNuiSensor->NuiTransformSmooth(pFrame, nullptr);
 
-    // Set skeleton data to stream viewers
-    AssignSkeletonFrameToStreamViewers(&m_skeletonFrame);
+    // Publish the frame to stream viewers and other readers of skeleton history
+    m_pSkeletonFrame = m_skeletonHistory.Publish();
 
     UpdateTrackedSkeletons();
 }
@@ -216,13 +285,13 @@ void NuiSkeletonStream::ChooseClosestSkeletons(DWORD trackIDs[TrackIDIndexCount]
 
     for (int i = 0; i < NUI_SKELETON_COUNT; i++)
     {
-        if (NUI_SKELETON_NOT_TRACKED != m_skeletonFrame.SkeletonData[i].eTrackingState)
+        if (NUI_SKELETON_NOT_TRACKED != m_pSkeletonFrame->SkeletonData[i].eTrackingState)
         {
             LONG   x, y;
             USHORT depth;
 
             // Transform skeleton coordinates to depth image
-            NuiTransformSkeletonToDepthImage(m_skeletonFrame.SkeletonData[i].Position, &x, &y, &depth);
+            NuiTransformSkeletonToDepthImage(m_pSkeletonFrame->SkeletonData[i].Position, &x, &y, &depth);
 
             // Compare depth to peviously found item
             if (depth < nearestDepth[FirstTrackID])
@@ -232,13 +301,13 @@ void NuiSkeletonStream::ChooseClosestSkeletons(DWORD trackIDs[TrackIDIndexCount]
                 nearestDepth[FirstTrackID]  = depth;
 
                 trackIDs[SecondTrackID] = trackIDs[FirstTrackID];
-                trackIDs[FirstTrackID]  = m_skeletonFrame.SkeletonData[i].dwTrackingID;
+                trackIDs[FirstTrackID]  = m_pSkeletonFrame->SkeletonData[i].dwTrackingID;
             }
             else if (depth < nearestDepth[SecondTrackID])
             {
                 // Replace old depth and track ID in second place with the newly found closer one
                 nearestDepth[SecondTrackID] = depth;
-                trackIDs[SecondTrackID]     = m_skeletonFrame.SkeletonData[i].dwTrackingID;
+                trackIDs[SecondTrackID]     = m_pSkeletonFrame->SkeletonData[i].dwTrackingID;
             }
         }
     }
@@ -270,9 +339,9 @@ void NuiSkeletonStream::FindStickyIDs(DWORD trackIDs[TrackIDIndexCount])
     {
         for(int j = 0; j < NUI_SKELETON_COUNT; j++)
         {
-            if(NUI_SKELETON_NOT_TRACKED != m_skeletonFrame.SkeletonData[j].eTrackingState)
+            if(NUI_SKELETON_NOT_TRACKED != m_pSkeletonFrame->SkeletonData[j].eTrackingState)
             {
-                DWORD trackID = m_skeletonFrame.SkeletonData[j].dwTrackingID;
+                DWORD trackID = m_pSkeletonFrame->SkeletonData[j].dwTrackingID;
                 if(trackID == m_stickyIDs[i])
                 {
                     trackIDs[i] = trackID;
@@ -296,9 +365,9 @@ void NuiSkeletonStream::AssignNewStickyIDs(DWORD trackIDs[TrackIDIndexCount])
             break;
         }
 
-        if (NUI_SKELETON_NOT_TRACKED != m_skeletonFrame.SkeletonData[i].eTrackingState)
+        if (NUI_SKELETON_NOT_TRACKED != m_pSkeletonFrame->SkeletonData[i].eTrackingState)
         {
-            DWORD trackID = m_skeletonFrame.SkeletonData[i].dwTrackingID;
+            DWORD trackID = m_pSkeletonFrame->SkeletonData[i].dwTrackingID;
 
             if (!trackIDs[FirstTrackID] && trackID != trackIDs[SecondTrackID])
             {
@@ -351,21 +420,21 @@ void NuiSkeletonStream::UpdateActivityWatchers()
 {
     for (int i = 0; i < NUI_SKELETON_COUNT; i++)
     {
-        if (NUI_SKELETON_NOT_TRACKED != m_skeletonFrame.SkeletonData[i].eTrackingState)
+        if (NUI_SKELETON_NOT_TRACKED != m_pSkeletonFrame->SkeletonData[i].eTrackingState)
         {
-            DWORD id  = m_skeletonFrame.SkeletonData[i].dwTrackingID;
+            DWORD id  = m_pSkeletonFrame->SkeletonData[i].dwTrackingID;
             auto  itr = m_activityWatchers.find(id);
 
             if (m_activityWatchers.end() != itr)
             {
                 // Activity watcher related to this ID is found. Update its activity level
-                itr->second->UpdateActivity(m_skeletonFrame.SkeletonData[i]);
+                itr->second->UpdateActivity(m_pSkeletonFrame->SkeletonData[i]);
                 itr->second->SetUpdateFlag(true);
             }
             else
             {
                 // No activity watcher related to this ID is found. Create a new one for it
-                NuiActivityWatcher* pWatcher = new NuiActivityWatcher(m_skeletonFrame.SkeletonData[i]);
+                NuiActivityWatcher* pWatcher = new NuiActivityWatcher(m_pSkeletonFrame->SkeletonData[i]);
                 pWatcher->SetUpdateFlag(true);
 
                 m_activityWatchers.insert(std::make_pair(id, pWatcher));
@@ -426,20 +495,3 @@ void NuiSkeletonStream::FindMostActiveIDs(DWORD trackIDs[TrackIDIndexCount])
         }
     }
 }
-
-/// <summary>
-/// Assign the skeleton data to the stream viewers
-/// </summary>
-/// <param name="pFrame">The pointer to skeleton frame</param>
-void NuiSkeletonStream::AssignSkeletonFrameToStreamViewers(const NUI_SKELETON_FRAME* pFrame)
-{
-    if (m_pStreamViewer)
-    {
-        m_pStreamViewer->SetSkeleton(pFrame);
-    }
-
-    if (m_pSecondStreamViewer)
-    {
-        m_pSecondStreamViewer->SetSkeleton(pFrame);
-    }
-}
@@ -23,6 +23,7 @@
 #include <map>
 #include "NuiStream.h"
 #include "NuiActivityWatcher.h"
+#include "NuiSkeletonHistory.h"
 
 // Nui skeleton chooser mode
 enum ChooserMode
@@ -75,6 +76,19 @@ public:
     /// </summary>
     void ProcessStreamFrame();
 
+    /// <summary>
+    /// Attach stream viewer to display skeleton
+    /// </summary>
+    /// <param name="pStreamViewer">The pointer to the stream viewer to be attached</param>
+    /// <returns>Previously attached viewer object. If none, returns nullptr</returns>
+    virtual NuiStreamViewer* SetStreamViewer(NuiStreamViewer* pStreamViewer);
+
+    /// <summary>
+    /// Get the history of skeleton frames, which readers may read on any thread
+    /// </summary>
+    /// <returns>The skeleton frame history</returns>
+    const NuiSkeletonHistory* GetSkeletonHistory() const;
+
     /// <summary>
     /// Set near mode
     /// </summary>
@@ -161,19 +175,15 @@ private:
     /// <param name="trackIDs">Array of skeleton tracking IDs</param>
     void FindMostActiveIDs(DWORD trackIDs[TrackIDIndexCount]);
 
-    /// <summary>
-    /// Assign the skeleton data to the stream viewers
-    /// </summary>
-    /// <param name="pFrame">The pointer to skeleton frame</param>
-    void AssignSkeletonFrameToStreamViewers(const NUI_SKELETON_FRAME* pFrame);
-
 private:
     bool                m_near;
     bool                m_seated;
     DWORD               m_stickyIDs[TrackIDIndexCount];
     ChooserMode         m_chooserMode;
-    NUI_SKELETON_FRAME  m_skeletonFrame;
+    NuiSkeletonHistory  m_skeletonHistory;
+    const NUI_SKELETON_FRAME*   m_pSkeletonFrame;
     NuiStreamViewer*    m_pSecondStreamViewer;
+    CRITICAL_SECTION    m_writeLock;            // Serializes frame processing with setting changes, the writers of skeleton history
 
     std::map<int, NuiActivityWatcher*> m_activityWatchers;
 };
@@ -48,7 +48,8 @@ public:
 
     /// <summary>
     /// Subclass should override this method to process the next incoming
-    /// stream frame when stream event is set.
+    /// stream frame. Called by the stream scheduler on a worker thread when
+    /// the frame ready event is set.
     /// </summary>
     virtual void ProcessStreamFrame() = 0;
 
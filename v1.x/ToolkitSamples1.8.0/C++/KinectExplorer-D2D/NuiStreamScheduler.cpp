@@ -0,0 +1,233 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiStreamScheduler.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "NuiStreamScheduler.h"
+
+// Most worker threads processing stream frames. Processing of one sensor is serialized by its
+// window, so more workers than sensors only help the streams of a sensor overlap.
+#define MAX_STREAM_WORKERS          4
+
+/// <summary>
+/// Constructor
+/// </summary>
+NuiStreamScheduler::NuiStreamScheduler()
+    : m_pPool(nullptr)
+{
+    InitializeCriticalSection(&m_lock);
+    InitializeThreadpoolEnvironment(&m_callbackEnviron);
+
+    // Use a private pool so the workers are bounded. If it can't be created, callbacks
+    // run on the default pool of the process
+    m_pPool = CreateThreadpool(nullptr);
+    if (m_pPool)
+    {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+
+        DWORD workers = min(max(systemInfo.dwNumberOfProcessors, 1UL), (DWORD)MAX_STREAM_WORKERS);
+        SetThreadpoolThreadMaximum(m_pPool, workers);
+        SetThreadpoolThreadMinimum(m_pPool, 1);
+        SetThreadpoolCallbackPool(&m_callbackEnviron, m_pPool);
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+NuiStreamScheduler::~NuiStreamScheduler()
+{
+    for (auto itr = m_clients.begin(); itr != m_clients.end(); itr++)
+    {
+        CloseClientEntry(*itr);
+    }
+    m_clients.clear();
+
+    if (m_pPool)
+    {
+        CloseThreadpool(m_pPool);
+    }
+
+    DestroyThreadpoolEnvironment(&m_callbackEnviron);
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Start scheduling the stream events of a client
+/// </summary>
+/// <param name="pClient">The client to receive the events</param>
+/// <param name="ppStreams">The streams whose frame ready events are waited on</param>
+/// <param name="streamCount">Number of streams</param>
+/// <param name="timerPeriod">Period of the timer event in milliseconds. Zero for no timer</param>
+/// <returns>Indicates success or failure</returns>
+bool NuiStreamScheduler::AddClient(NuiStreamSchedulerClient* pClient, NuiStream* const* ppStreams, UINT streamCount, DWORD timerPeriod)
+{
+    if (!pClient || (streamCount && !ppStreams))
+    {
+        return false;
+    }
+
+    ClientEntry* pEntry = new ClientEntry();
+    pEntry->pClient = pClient;
+    pEntry->pTimer  = nullptr;
+
+    bool succeeded = true;
+
+    for (UINT i = 0; i < streamCount && succeeded; ++i)
+    {
+        StreamWait* pStreamWait = new StreamWait();
+        pStreamWait->pClient  = pClient;
+        pStreamWait->pStream  = ppStreams[i];
+        pStreamWait->stopping = 0;
+        pStreamWait->pWait    = CreateThreadpoolWait(WaitCallback, pStreamWait, &m_callbackEnviron);
+
+        if (pStreamWait->pWait)
+        {
+            pEntry->waits.push_back(pStreamWait);
+        }
+        else
+        {
+            delete pStreamWait;
+            succeeded = false;
+        }
+    }
+
+    if (succeeded && timerPeriod)
+    {
+        pEntry->pTimer = CreateThreadpoolTimer(TimerCallback, pClient, &m_callbackEnviron);
+        succeeded = (nullptr != pEntry->pTimer);
+    }
+
+    if (!succeeded)
+    {
+        CloseClientEntry(pEntry);
+        return false;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_clients.push_back(pEntry);
+    LeaveCriticalSection(&m_lock);
+
+    // Start waiting once the entry is complete
+    for (auto itr = pEntry->waits.begin(); itr != pEntry->waits.end(); itr++)
+    {
+        SetThreadpoolWait((*itr)->pWait, (*itr)->pStream->GetFrameReadyEvent(), nullptr);
+    }
+
+    if (pEntry->pTimer)
+    {
+        // Let the pool coalesce the timers of all clients within a quarter of their period
+        ULARGE_INTEGER dueTime;
+        dueTime.QuadPart = (ULONGLONG)-((LONGLONG)timerPeriod * 10000);
+
+        FILETIME fileTime;
+        fileTime.dwLowDateTime  = dueTime.LowPart;
+        fileTime.dwHighDateTime = dueTime.HighPart;
+
+        SetThreadpoolTimer(pEntry->pTimer, &fileTime, timerPeriod, timerPeriod / 4);
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Stop scheduling the events of a client
+/// </summary>
+/// <param name="pClient">The client to remove</param>
+void NuiStreamScheduler::RemoveClient(NuiStreamSchedulerClient* pClient)
+{
+    ClientEntry* pEntry = nullptr;
+
+    EnterCriticalSection(&m_lock);
+    for (auto itr = m_clients.begin(); itr != m_clients.end(); itr++)
+    {
+        if (pClient == (*itr)->pClient)
+        {
+            pEntry = *itr;
+            m_clients.erase(itr);
+            break;
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+
+    if (pEntry)
+    {
+        CloseClientEntry(pEntry);
+    }
+}
+
+/// <summary>
+/// Stop and free the waits and timer of a client
+/// </summary>
+/// <param name="pEntry">The client entry to free</param>
+void NuiStreamScheduler::CloseClientEntry(ClientEntry* pEntry)
+{
+    for (auto itr = pEntry->waits.begin(); itr != pEntry->waits.end(); itr++)
+    {
+        StreamWait* pStreamWait = *itr;
+        InterlockedExchange(&pStreamWait->stopping, 1);
+
+        // A callback in progress may have set the wait again before it saw the stop flag,
+        // so clear the wait a second time once the callbacks have finished
+        SetThreadpoolWait(pStreamWait->pWait, nullptr, nullptr);
+        WaitForThreadpoolWaitCallbacks(pStreamWait->pWait, TRUE);
+        SetThreadpoolWait(pStreamWait->pWait, nullptr, nullptr);
+        WaitForThreadpoolWaitCallbacks(pStreamWait->pWait, TRUE);
+
+        CloseThreadpoolWait(pStreamWait->pWait);
+        delete pStreamWait;
+    }
+
+    if (pEntry->pTimer)
+    {
+        SetThreadpoolTimer(pEntry->pTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(pEntry->pTimer, TRUE);
+        CloseThreadpoolTimer(pEntry->pTimer);
+    }
+
+    delete pEntry;
+}
+
+/// <summary>
+/// Thread pool callback when a frame ready event is set
+/// </summary>
+VOID CALLBACK NuiStreamScheduler::WaitCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WAIT pWait, TP_WAIT_RESULT waitResult)
+{
+    StreamWait* pStreamWait = (StreamWait*)pContext;
+
+    if (WAIT_OBJECT_0 == waitResult)
+    {
+        pStreamWait->pClient->OnStreamEvent(pStreamWait->pStream);
+    }
+
+    // A wait fires once, so set it again for the next frame
+    if (0 == pStreamWait->stopping)
+    {
+        SetThreadpoolWait(pWait, pStreamWait->pStream->GetFrameReadyEvent(), nullptr);
+    }
+}
+
+/// <summary>
+/// Thread pool callback of the timer of a client
+/// </summary>
+VOID CALLBACK NuiStreamScheduler::TimerCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_TIMER pTimer)
+{
+    ((NuiStreamSchedulerClient*)pContext)->OnTimerEvent();
+}
@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiStreamScheduler.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiApi.h>
+#include "NuiStream.h"
+
+/// <summary>
+/// Receives the stream events scheduled by NuiStreamScheduler
+/// </summary>
+class NuiStreamSchedulerClient
+{
+public:
+    /// <summary>
+    /// Called on a worker thread when the frame ready event of a stream is set.
+    /// Calls for the streams of one client may run at the same time.
+    /// </summary>
+    /// <param name="pStream">The stream with a frame ready</param>
+    virtual void OnStreamEvent(NuiStream* pStream) = 0;
+
+    /// <summary>
+    /// Called on a worker thread every timer period
+    /// </summary>
+    virtual void OnTimerEvent() = 0;
+};
+
+/// <summary>
+/// Waits on the frame ready events of the streams of all sensors and dispatches their frame
+/// processing to a small pool of worker threads, so the number of threads does not grow with
+/// the number of sensors. The events and timers of all clients are waited on together by the
+/// thread pool, and processing runs on whichever worker is free.
+/// </summary>
+class NuiStreamScheduler
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    NuiStreamScheduler();
+
+    /// <summary>
+    /// Destructor. All clients must have been removed.
+    /// </summary>
+   ~NuiStreamScheduler();
+
+public:
+    /// <summary>
+    /// Start scheduling the stream events of a client
+    /// </summary>
+    /// <param name="pClient">The client to receive the events</param>
+    /// <param name="ppStreams">The streams whose frame ready events are waited on</param>
+    /// <param name="streamCount">Number of streams</param>
+    /// <param name="timerPeriod">Period of the timer event in milliseconds. Zero for no timer</param>
+    /// <returns>Indicates success or failure</returns>
+    bool AddClient(NuiStreamSchedulerClient* pClient, NuiStream* const* ppStreams, UINT streamCount, DWORD timerPeriod);
+
+    /// <summary>
+    /// Stop scheduling the events of a client. Returns after the callbacks of the client in
+    /// progress have finished, and no further callbacks are made.
+    /// </summary>
+    /// <param name="pClient">The client to remove</param>
+    void RemoveClient(NuiStreamSchedulerClient* pClient);
+
+private:
+    /// <summary>
+    /// Wait on the frame ready event of a stream
+    /// </summary>
+    struct StreamWait
+    {
+        NuiStreamSchedulerClient*   pClient;
+        NuiStream*                  pStream;
+        PTP_WAIT                    pWait;
+        volatile LONG               stopping;   // Set when the wait is being closed, so it is not set again
+    };
+
+    /// <summary>
+    /// Waits and timer of a client
+    /// </summary>
+    struct ClientEntry
+    {
+        NuiStreamSchedulerClient*   pClient;
+        std::vector<StreamWait*>    waits;
+        PTP_TIMER                   pTimer;
+    };
+
+    /// <summary>
+    /// Thread pool callback when a frame ready event is set
+    /// </summary>
+    static VOID CALLBACK WaitCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WAIT pWait, TP_WAIT_RESULT waitResult);
+
+    /// <summary>
+    /// Thread pool callback of the timer of a client
+    /// </summary>
+    static VOID CALLBACK TimerCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_TIMER pTimer);
+
+    /// <summary>
+    /// Stop and free the waits and timer of a client
+    /// </summary>
+    /// <param name="pEntry">The client entry to free</param>
+    void CloseClientEntry(ClientEntry* pEntry);
+
+private:
+    PTP_POOL                    m_pPool;
+    TP_CALLBACK_ENVIRON         m_callbackEnviron;
+    CRITICAL_SECTION            m_lock;
+    std::vector<ClientEntry*>   m_clients;
+};
@@ -28,16 +28,18 @@
 /// Constructor
 /// </summary>
 /// <param name="pParent">The pointer to parent window</param>
-NuiStreamViewer::NuiStreamViewer(const NuiViewer* pParent)
+/// <param name="pFrameLock">The lock held by streams while they update the image and skeletons</param>
+NuiStreamViewer::NuiStreamViewer(const NuiViewer* pParent, CRITICAL_SECTION* pFrameLock)
     : NuiViewer(pParent)
     , m_imageType(NUI_IMAGE_TYPE_COLOR)
     , m_pImage(nullptr)
     , m_pauseSkeleton(false)
-    , m_pSkeletonFrame(nullptr)
+    , m_pSkeletonHistory(nullptr)
     , m_drawEdgeFlags(0)
     , m_frameCount(0)
     , m_lastFrameCount(0)
     , m_fps(0)
+    , m_pFrameLock(pFrameLock)
 {
     m_pImageRenderer = new ImageRenderer();
 
@@ -71,7 +73,11 @@ LRESULT NuiStreamViewer::DialogProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
         return (LRESULT)GetStockObject(BLACK_BRUSH);
 
     case WM_PAINT:
+        // Streams update the image buffer on worker threads. Skeleton frames are read from
+        // skeleton history, which the skeleton stream writes without this lock
+        EnterCriticalSection(m_pFrameLock);
         OnPaint(wParam, lParam);
+        LeaveCriticalSection(m_pFrameLock);
         break;
 
     case WM_SIZE:
@@ -122,8 +128,12 @@ void NuiStreamViewer::OnPaint(WPARAM wParam, LPARAM lParam)
     // Draw stream images
     DrawImage(imageRect);
 
-    // Draw skeletons
-    DrawSkeletons(imageRect);
+    // Draw skeletons. If the frame was overwritten meanwhile, drop it by drawing the image over it
+    if (!DrawSkeletons(imageRect))
+    {
+        m_drawEdgeFlags = 0;
+        DrawImage(imageRect);
+    }
 
     // Draw image resolution
     DrawResolution(clientRect);
@@ -154,29 +164,43 @@ void NuiStreamViewer::DrawImage(const D2D1_RECT_F& imageRect)
 /// Draw skeletons
 /// </summary>
 /// <param name="imageRect">The rect which the color or depth stream image is streched to fit</param>
-void NuiStreamViewer::DrawSkeletons(const D2D1_RECT_F& imageRect)
+/// <returns>False if the skeleton frame was overwritten while it was drawn</returns>
+bool NuiStreamViewer::DrawSkeletons(const D2D1_RECT_F& imageRect)
 {
-    if (m_pSkeletonFrame && !m_pauseSkeleton)
+    if (!m_pSkeletonHistory || m_pauseSkeleton)
+    {
+        return true;
+    }
+
+    // Draw the latest skeleton frame in place. The skeleton stream may rewrite its slot meanwhile,
+    // so the sequence number is checked again after drawing
+    LONG sequence = m_pSkeletonHistory->GetLatestSequence();
+    const NUI_SKELETON_FRAME* pFrame = m_pSkeletonHistory->GetFrame(sequence);
+    if (pFrame)
     {
         // Clip the area to avoid drawing outside the image
         m_pImageRenderer->SetClipRect(imageRect);
 
         for (int i = 0; i < NUI_SKELETON_COUNT; i++)
         {
-            NUI_SKELETON_TRACKING_STATE state = m_pSkeletonFrame->SkeletonData[i].eTrackingState;
+            NUI_SKELETON_TRACKING_STATE state = pFrame->SkeletonData[i].eTrackingState;
             if (NUI_SKELETON_TRACKED == state)
             {
                 // Draw bones and joints of tracked skeleton
-                DrawSkeleton(m_pSkeletonFrame->SkeletonData[i], imageRect);
+                DrawSkeleton(pFrame->SkeletonData[i], imageRect);
             }
             else if (NUI_SKELETON_POSITION_ONLY == state)
             {
-                DrawPosition(m_pSkeletonFrame->SkeletonData[i], imageRect);
+                DrawPosition(pFrame->SkeletonData[i], imageRect);
             }
         }
 
         m_pImageRenderer->ResetClipRect();
+
+        return m_pSkeletonHistory->IsFrameValid(sequence);
     }
+
+    return true;
 }
 
 /// <summary>
@@ -430,26 +454,17 @@ void NuiStreamViewer::SetImage(const NuiImageBuffer* pImage)
     m_pImage = pImage;
     if (m_pImage &&  m_pImage->GetBufferSize() && m_hWnd)
     {
-        InvalidateRect(m_hWnd, nullptr, FALSE);
-
         UpdateFrameRate();
     }
 }
 
 /// <summary>
-/// Attach skeleton data.
+/// Attach the skeleton frame history, of which the latest frame is drawn.
 /// </summary>
-/// <param name="pFrame">The pointer to skeleton frame</param>
-void NuiStreamViewer::SetSkeleton(const NUI_SKELETON_FRAME* pFrame)
+/// <param name="pSkeletonHistory">The pointer to skeleton frame history</param>
+void NuiStreamViewer::SetSkeletonHistory(const NuiSkeletonHistory* pSkeletonHistory)
 {
-    if (!m_hWnd)
-    {
-        return;
-    }
-
-    m_pSkeletonFrame = pFrame;
-
-    InvalidateRect(m_hWnd, nullptr, FALSE);
+    m_pSkeletonHistory = pSkeletonHistory;
 }
 
 /// <summary>
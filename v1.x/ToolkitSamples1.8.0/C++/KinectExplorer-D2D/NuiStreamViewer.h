@@ -24,6 +24,7 @@
 #include "Utility.h"
 #include "NuiViewer.h"
 #include "NuiImageBuffer.h"
+#include "NuiSkeletonHistory.h"
 #include "ImageRenderer.h"
 
 enum DRAW_EDGE_FLAG
@@ -41,7 +42,8 @@ public:
     /// Constructor
     /// </summary>
     /// <param name="pParent">The pointer to parent window</param>
-    NuiStreamViewer(const NuiViewer* pParent);
+    /// <param name="pFrameLock">The lock held by streams while they update the image and skeletons</param>
+    NuiStreamViewer(const NuiViewer* pParent, CRITICAL_SECTION* pFrameLock);
 
     /// <summary>
     /// Destructor
@@ -50,16 +52,17 @@ public:
 
 public:
     /// <summary>
-    /// Set the buffer containing the image pixels.
+    /// Set the buffer containing the image pixels. The owner of the viewer invalidates it.
     /// </summary>
     /// <param name="pImage">The pointer to image buffer object</param>
     void SetImage(const NuiImageBuffer* pImage);
 
     /// <summary>
-    /// Attach skeleton data.
+    /// Attach the skeleton frame history, of which the latest frame is drawn. The owner
+    /// of the viewer invalidates it when a frame is published.
     /// </summary>
-    /// <param name="pFrame">The pointer to skeleton frame</param>
-    void SetSkeleton(const NUI_SKELETON_FRAME* pFrame);
+    /// <param name="pSkeletonHistory">The pointer to skeleton frame history</param>
+    void SetSkeletonHistory(const NuiSkeletonHistory* pSkeletonHistory);
 
     /// <summary>
     /// Pause the skeleton
@@ -112,7 +115,8 @@ private:
     /// Draw skeletons
     /// </summary>
     /// <param name="imageRect">The rect which the color or depth stream image is streched to fit</param>
-    void DrawSkeletons(const D2D1_RECT_F& imageRect);
+    /// <returns>False if the skeleton frame was overwritten while it was drawn</returns>
+    bool DrawSkeletons(const D2D1_RECT_F& imageRect);
 
     /// <summary>
     /// Draw a skeleton and overlay it on color or depth image
@@ -200,7 +204,7 @@ private:
     NUI_IMAGE_TYPE              m_imageType;
 
     const NuiImageBuffer*       m_pImage;
-    const NUI_SKELETON_FRAME*   m_pSkeletonFrame;
+    const NuiSkeletonHistory*   m_pSkeletonHistory;
 
     bool                m_pauseSkeleton;
     UINT                m_fps;
@@ -210,4 +214,5 @@ private:
     DWORD               m_drawEdgeFlags;
 
     ImageRenderer*      m_pImageRenderer;
+    CRITICAL_SECTION*   m_pFrameLock;
 };
@@ -138,6 +138,15 @@
 #define ID_VIEWS                        40039
 #define ID_VIEWS_SWITCH                 40040
 #define ID_FORCE_OFF_IR                 40041
+#define ID_COLORSTREAM_DEMOSAIC         40042
+#define ID_COLORSTREAM_DEMOSAIC_START   40043
+#define ID_DEMOSAIC_BLOCK2X2            40043
+#define ID_DEMOSAIC_BILINEAR            40044
+#define ID_DEMOSAIC_MALVARHECUTLER      40045
+#define ID_COLORSTREAM_DEMOSAIC_END     40045
+#define ID_DEMOSAIC_BENCHMARK           40046
+#define ID_COLORSTREAM_INFRAREDAUTOEXPOSURE 40047
+#define ID_COLORSTREAM_INFRAREDDENOISE  40048
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
@@ -145,7 +154,7 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        147
-#define _APS_NEXT_COMMAND_VALUE         40042
+#define _APS_NEXT_COMMAND_VALUE         40049
 #define _APS_NEXT_CONTROL_VALUE         1045
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
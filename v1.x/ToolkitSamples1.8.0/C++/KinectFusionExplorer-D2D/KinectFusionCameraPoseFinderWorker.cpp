@@ -0,0 +1,563 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionCameraPoseFinderWorker.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <new>
+
+// Project includes
+#include "KinectFusionCameraPoseFinderWorker.h"
+#include "KinectFusionHelper.h"
+
+namespace
+{
+    /// <summary>
+    /// Create a frame, or recreate it when its type or size has changed.
+    /// </summary>
+    HRESULT CreateFrameIfChanged(
+        NUI_FUSION_IMAGE_TYPE frameType,
+        unsigned int width,
+        unsigned int height,
+        NUI_FUSION_IMAGE_FRAME **ppImageFrame)
+    {
+        if (nullptr != *ppImageFrame &&
+            ((*ppImageFrame)->width != width || (*ppImageFrame)->height != height || (*ppImageFrame)->imageType != frameType))
+        {
+            SAFE_FUSION_RELEASE_IMAGE_FRAME(*ppImageFrame);
+        }
+
+        if (nullptr == *ppImageFrame)
+        {
+            return NuiFusionCreateImageFrame(frameType, width, height, nullptr, ppImageFrame);
+        }
+
+        return S_OK;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="instrumentation">Records the time of each insertion and query.</param>
+KinectFusionCameraPoseFinderWorker::KinectFusionCameraPoseFinderWorker(KinectFusionInstrumentation &instrumentation) :
+    m_instrumentation(instrumentation),
+    m_pCameraPoseFinder(nullptr),
+    m_hThread(nullptr),
+    m_pDepthFloatImage(nullptr),
+    m_pColorImage(nullptr),
+    m_pResampledColorImage(nullptr),
+    m_fDistanceThresholdAccept(0),
+    m_cStoredPoses(0),
+    m_cLoadedKeyframes(0),
+    m_bInsertResultPending(false)
+{
+    InitializeCriticalSection(&m_lock);
+
+    m_hStopEvent = CreateEvent(
+        nullptr,
+        TRUE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hWorkEvent = CreateEvent(
+        nullptr,
+        FALSE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hIdleEvent = CreateEvent(
+        nullptr,
+        TRUE, /* bManualReset */ 
+        TRUE, /* bInitialState */
+        nullptr);
+
+    ZeroMemory(&m_insertResult, sizeof(m_insertResult));
+    SetIdentityMatrix(m_worldToCameraTransform);
+}
+
+/// <summary>
+/// Destructor, stopping the worker thread
+/// </summary>
+KinectFusionCameraPoseFinderWorker::~KinectFusionCameraPoseFinderWorker()
+{
+    Stop();
+
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pDepthFloatImage);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pColorImage);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pResampledColorImage);
+
+    if (nullptr != m_hStopEvent)
+    {
+        CloseHandle(m_hStopEvent);
+    }
+    if (nullptr != m_hWorkEvent)
+    {
+        CloseHandle(m_hWorkEvent);
+    }
+    if (nullptr != m_hIdleEvent)
+    {
+        CloseHandle(m_hIdleEvent);
+    }
+
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Set the camera pose finder. Only called while the worker thread is stopped.
+/// </summary>
+/// <param name="pCameraPoseFinder">The camera pose finder, or nullptr before it is released.</param>
+void KinectFusionCameraPoseFinderWorker::SetCameraPoseFinder(INuiFusionCameraPoseFinder *pCameraPoseFinder)
+{
+    _ASSERT(nullptr == m_hThread);
+
+    m_pCameraPoseFinder = pCameraPoseFinder;
+    m_cStoredPoses = (nullptr != pCameraPoseFinder) ? static_cast<LONG>(pCameraPoseFinder->GetStoredPoseCount()) : 0;
+    m_bInsertResultPending = false;
+}
+
+/// <summary>
+/// Set the most key frames kept in the keyframe database, as set for the camera pose finder.
+/// </summary>
+/// <param name="maxKeyframes">The most key frames.</param>
+void KinectFusionCameraPoseFinderWorker::SetMaxKeyframes(unsigned int maxKeyframes)
+{
+    EnterCriticalSection(&m_lock);
+
+    m_keyframes.SetMaxKeyframes(maxKeyframes);
+    m_cLoadedKeyframes = static_cast<LONG>(m_keyframes.GetLoadedKeyframeCount());
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Start the worker thread adding key frames to the camera pose finder.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCameraPoseFinderWorker::Start()
+{
+    Stop();
+
+    if (nullptr == m_pCameraPoseFinder)
+    {
+        return E_FAIL;
+    }
+
+    if (nullptr == m_hStopEvent || nullptr == m_hWorkEvent || nullptr == m_hIdleEvent)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    ResetEvent(m_hStopEvent);
+    ResetEvent(m_hWorkEvent);
+    SetEvent(m_hIdleEvent);
+
+    m_hThread = CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+    if (nullptr == m_hThread)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stop the worker thread, after the key frame being added if there is one.
+/// </summary>
+void KinectFusionCameraPoseFinderWorker::Stop()
+{
+    if (nullptr != m_hThread)
+    {
+        SetEvent(m_hStopEvent);
+        WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+        m_hThread = nullptr;
+    }
+
+    // A frame submitted but not started is discarded
+    if (nullptr != m_hIdleEvent)
+    {
+        SetEvent(m_hIdleEvent);
+    }
+}
+
+/// <summary>
+/// Submit a key frame to add to the database if it is not similar to the stored frames.
+/// The images are copied, so they may be reused as soon as this returns.
+/// </summary>
+/// <param name="pDepthFloatImage">The depth float image of the key frame.</param>
+/// <param name="pColorImage">The color image of the key frame, resampled to the depth size by the worker.</param>
+/// <param name="worldToCameraTransform">The camera pose of the key frame.</param>
+/// <param name="distanceThresholdAccept">The minimum distance to the stored frames for the frame to be added.</param>
+/// <returns>S_OK if submitted, S_FALSE if skipped as the worker is busy, otherwise failure code</returns>
+HRESULT KinectFusionCameraPoseFinderWorker::Submit(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+    const NUI_FUSION_IMAGE_FRAME *pColorImage,
+    const Matrix4 &worldToCameraTransform,
+    float distanceThresholdAccept)
+{
+    if (nullptr == pDepthFloatImage || nullptr == pColorImage)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr == m_hThread)
+    {
+        return E_FAIL;
+    }
+
+    if (WaitForSingleObject(m_hIdleEvent, 0) != WAIT_OBJECT_0)
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = CreateFrameIfChanged(NUI_FUSION_IMAGE_TYPE_FLOAT, pDepthFloatImage->width, pDepthFloatImage->height, &m_pDepthFloatImage);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateFrameIfChanged(NUI_FUSION_IMAGE_TYPE_COLOR, pColorImage->width, pColorImage->height, &m_pColorImage);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateFrameIfChanged(NUI_FUSION_IMAGE_TYPE_COLOR, pDepthFloatImage->width, pDepthFloatImage->height, &m_pResampledColorImage);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CopyImageFrame(pDepthFloatImage, m_pDepthFloatImage);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CopyImageFrame(pColorImage, m_pColorImage);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_worldToCameraTransform = worldToCameraTransform;
+    m_fDistanceThresholdAccept = distanceThresholdAccept;
+
+    ResetEvent(m_hIdleEvent);
+    SetEvent(m_hWorkEvent);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Get the outcome of the most recently added key frame, once per key frame.
+/// </summary>
+/// <param name="result">Returns the outcome.</param>
+/// <returns>true if a key frame was added since the last call</returns>
+bool KinectFusionCameraPoseFinderWorker::TakeInsertResult(KinectFusionCameraPoseFinderInsert &result)
+{
+    EnterCriticalSection(&m_lock);
+
+    bool pending = m_bInsertResultPending;
+    if (pending)
+    {
+        result = m_insertResult;
+        m_bInsertResultPending = false;
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    return pending;
+}
+
+/// <summary>
+/// Find the stored key frames most similar to a frame, waiting for the key frame being added.
+/// The matches of the camera pose finder alternate with those of the loaded key frames.
+/// </summary>
+/// <param name="pDepthFloatImage">The depth float image.</param>
+/// <param name="pColorImage">The color image, the same size as the depth image.</param>
+/// <param name="maxPoses">The most poses to return.</param>
+/// <param name="ppPoses">Returns the poses of the matched key frames, most similar first, valid until the next call.</param>
+/// <param name="pcPoses">Returns the number of poses.</param>
+/// <param name="pMinDistance">Returns the normalized distance to the most similar key frame.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCameraPoseFinderWorker::FindCameraPose(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+    const NUI_FUSION_IMAGE_FRAME *pColorImage,
+    unsigned int maxPoses,
+    const Matrix4 **ppPoses,
+    unsigned int *pcPoses,
+    float *pMinDistance)
+{
+    if (nullptr == ppPoses || nullptr == pcPoses || nullptr == pMinDistance)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ppPoses = nullptr;
+    *pcPoses = 0;
+    *pMinDistance = 1.0f;   // the maximum normalized distance
+
+    if (nullptr == m_pCameraPoseFinder)
+    {
+        return E_FAIL;
+    }
+
+    EnterCriticalSection(&m_lock);
+
+    double startTime = m_instrumentation.Now();
+
+    // The camera pose finder returns an error code if there are no matched frames in its database
+    INuiFusionMatchCandidates *pMatchCandidates = nullptr;
+    const Matrix4 *pFinderPoses = nullptr;
+    unsigned int cFinderPoses = 0;
+
+    HRESULT hr = m_pCameraPoseFinder->FindCameraPose(pDepthFloatImage, pColorImage, &pMatchCandidates);
+
+    if (SUCCEEDED(hr) && nullptr != pMatchCandidates)
+    {
+        float minDistance = 1.0f;
+        if (SUCCEEDED(pMatchCandidates->CalculateMinimumDistance(&minDistance)) &&
+            SUCCEEDED(pMatchCandidates->GetMatchPoses(&pFinderPoses)))
+        {
+            cFinderPoses = min(pMatchCandidates->MatchPoseCount(), maxPoses);
+            *pMinDistance = minDistance;
+        }
+    }
+
+    // Key frames of an earlier session are only in the keyframe database. Those added this session
+    // are also in the camera pose finder, which has already returned them, so only the loaded key
+    // frames are searched.
+    KinectFusionKeyframeMatch keyframeMatches[KinectFusionKeyframeDatabase::cMaxMatches];
+    unsigned int cKeyframeMatches = 0;
+
+    if (m_keyframes.GetLoadedKeyframeCount() > 0)
+    {
+        UINT64 descriptor[KinectFusionKeyframeFormat::DescriptorWords];
+        if (SUCCEEDED(m_keyframes.Describe(pDepthFloatImage, pColorImage, descriptor)))
+        {
+            cKeyframeMatches = m_keyframes.FindNearest(descriptor, maxPoses, true, keyframeMatches);
+        }
+
+        if (cKeyframeMatches > 0)
+        {
+            *pMinDistance = min(*pMinDistance, keyframeMatches[0].distance);
+        }
+    }
+
+    try
+    {
+        m_matchPoses.clear();
+
+        for (unsigned int i = 0; m_matchPoses.size() < maxPoses && (i < cFinderPoses || i < cKeyframeMatches); ++i)
+        {
+            if (i < cFinderPoses)
+            {
+                m_matchPoses.push_back(pFinderPoses[i]);
+            }
+
+            if (i < cKeyframeMatches && m_matchPoses.size() < maxPoses)
+            {
+                m_matchPoses.push_back(m_keyframes.GetKeyframe(keyframeMatches[i].index).worldToCameraTransform);
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_matchPoses.clear();
+        hr = E_OUTOFMEMORY;
+    }
+
+    if (!m_matchPoses.empty())
+    {
+        *ppPoses = &m_matchPoses[0];
+        *pcPoses = static_cast<unsigned int>(m_matchPoses.size());
+        hr = S_OK;
+    }
+
+    SafeRelease(pMatchCandidates);
+
+    m_instrumentation.AddSample(KinectFusionStageCameraPoseFinderFindCameraPose, m_instrumentation.Now() - startTime);
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/// <summary>
+/// Clear the database, waiting for the key frame being added.
+/// </summary>
+void KinectFusionCameraPoseFinderWorker::Reset()
+{
+    if (nullptr == m_pCameraPoseFinder)
+    {
+        return;
+    }
+
+    WaitForIdle();
+
+    EnterCriticalSection(&m_lock);
+
+    m_pCameraPoseFinder->ResetCameraPoseFinder();
+    m_keyframes.RemoveAddedKeyframes();
+    m_cStoredPoses = 0;
+    m_bInsertResultPending = false;
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Save the key frames, waiting for the key frame being added.
+/// </summary>
+/// <param name="szFileName">The path of the keyframe database file.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCameraPoseFinderWorker::SaveKeyframes(LPCWSTR szFileName)
+{
+    WaitForIdle();
+
+    EnterCriticalSection(&m_lock);
+
+    HRESULT hr = m_keyframes.Save(szFileName);
+    m_cLoadedKeyframes = static_cast<LONG>(m_keyframes.GetLoadedKeyframeCount());
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/// <summary>
+/// Load the key frames of an earlier session, waiting for the key frame being added.
+/// </summary>
+/// <param name="szFileName">The path of the keyframe database file.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCameraPoseFinderWorker::LoadKeyframes(LPCWSTR szFileName)
+{
+    WaitForIdle();
+
+    EnterCriticalSection(&m_lock);
+
+    HRESULT hr = m_keyframes.Load(szFileName);
+    m_cLoadedKeyframes = static_cast<LONG>(m_keyframes.GetLoadedKeyframeCount());
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/// <summary>
+/// Worker thread procedure
+/// </summary>
+DWORD WINAPI KinectFusionCameraPoseFinderWorker::ThreadProc(LPVOID lpParameter)
+{
+    return reinterpret_cast<KinectFusionCameraPoseFinderWorker*>(lpParameter)->WorkerLoop();
+}
+
+/// <summary>
+/// Add each submitted key frame until stopped.
+/// </summary>
+DWORD KinectFusionCameraPoseFinderWorker::WorkerLoop()
+{
+    HANDLE handles[] = { m_hStopEvent, m_hWorkEvent };
+
+    while (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        ProcessSubmittedFrame();
+        SetEvent(m_hIdleEvent);
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Add the submitted key frame to the database.
+/// </summary>
+void KinectFusionCameraPoseFinderWorker::ProcessSubmittedFrame()
+{
+    HRESULT hr = S_OK;
+    const NUI_FUSION_IMAGE_FRAME *pColorImage = m_pColorImage;
+
+    // The camera pose finder needs color the same size as depth, so other sizes are re-sampled
+    // using nearest neighbor
+    if (m_pColorImage->width != m_pDepthFloatImage->width || m_pColorImage->height != m_pDepthFloatImage->height)
+    {
+        if (m_pColorImage->width > m_pResampledColorImage->width)
+        {
+            unsigned int factor = m_pColorImage->width / m_pResampledColorImage->width;
+            hr = m_colorPyramid.Downsample(m_pColorImage, m_pResampledColorImage, factor, PyramidFilterNearest, 0.0f);
+        }
+        else
+        {
+            unsigned int factor = m_pResampledColorImage->width / m_pColorImage->width;
+            hr = UpsampleFrameNearestNeighbor(m_pColorImage, m_pResampledColorImage, factor);
+        }
+
+        pColorImage = m_pResampledColorImage;
+    }
+
+    KinectFusionCameraPoseFinderInsert result;
+    ZeroMemory(&result, sizeof(result));
+    result.distanceThresholdAccept = m_fDistanceThresholdAccept;
+
+    EnterCriticalSection(&m_lock);
+
+    if (SUCCEEDED(hr))
+    {
+        double startTime = m_instrumentation.Now();
+
+        hr = m_pCameraPoseFinder->ProcessFrame(
+            m_pDepthFloatImage,
+            pColorImage,
+            &m_worldToCameraTransform,
+            m_fDistanceThresholdAccept,
+            &result.addedPose,
+            &result.poseHistoryTrimmed);
+
+        m_instrumentation.AddSample(KinectFusionStageCameraPoseFinderProcessFrame, m_instrumentation.Now() - startTime);
+
+        // Keep the key frame in the keyframe database too, so it can be saved
+        if (SUCCEEDED(hr) && result.addedPose)
+        {
+            UINT64 descriptor[KinectFusionKeyframeFormat::DescriptorWords];
+            if (SUCCEEDED(m_keyframes.Describe(m_pDepthFloatImage, pColorImage, descriptor)))
+            {
+                m_keyframes.Add(descriptor, m_worldToCameraTransform);
+            }
+
+            m_cLoadedKeyframes = static_cast<LONG>(m_keyframes.GetLoadedKeyframeCount());
+        }
+
+        m_cStoredPoses = static_cast<LONG>(m_pCameraPoseFinder->GetStoredPoseCount());
+    }
+
+    result.hr = hr;
+    result.storedPoseCount = static_cast<unsigned int>(m_cStoredPoses);
+
+    m_insertResult = result;
+    m_bInsertResultPending = true;
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Wait until the submitted key frame has been added.
+/// </summary>
+void KinectFusionCameraPoseFinderWorker::WaitForIdle()
+{
+    if (nullptr != m_hThread)
+    {
+        WaitForSingleObject(m_hIdleEvent, INFINITE);
+    }
+}
@@ -0,0 +1,215 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionCameraPoseFinderWorker.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionImagePyramid.h"
+#include "KinectFusionInstrumentation.h"
+#include "KinectFusionKeyframeDatabase.h"
+
+/// <summary>
+/// The outcome of adding a key frame to the camera pose finder database.
+/// </summary>
+struct KinectFusionCameraPoseFinderInsert
+{
+    HRESULT                     hr;
+    BOOL                        addedPose;
+    BOOL                        poseHistoryTrimmed;
+    unsigned int                storedPoseCount;
+    float                       distanceThresholdAccept;
+};
+
+/// <summary>
+/// Adds key frames to a camera pose finder database on a background thread, so the tracking
+/// stage only pays for copying the depth and color images of a key frame. Submitted frames are
+/// skipped while the previous one is still being added, as the database only needs a key frame
+/// every few frames. Every other use of the camera pose finder goes through this object, which
+/// serializes it with the key frame being added. Each added key frame is also kept in a
+/// keyframe database which can be saved and loaded, as the camera pose finder database cannot,
+/// and the key frames of a loaded database are searched along with the camera pose finder.
+/// </summary>
+class KinectFusionCameraPoseFinderWorker
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="instrumentation">Records the time of each insertion and query.</param>
+    KinectFusionCameraPoseFinderWorker(KinectFusionInstrumentation &instrumentation);
+
+    /// <summary>
+    /// Destructor, stopping the worker thread
+    /// </summary>
+    ~KinectFusionCameraPoseFinderWorker();
+
+    /// <summary>
+    /// Set the camera pose finder. Only called while the worker thread is stopped.
+    /// </summary>
+    /// <param name="pCameraPoseFinder">The camera pose finder, or nullptr before it is released.</param>
+    void                        SetCameraPoseFinder(INuiFusionCameraPoseFinder *pCameraPoseFinder);
+
+    /// <summary>
+    /// Set the most key frames kept in the keyframe database, as set for the camera pose finder.
+    /// </summary>
+    /// <param name="maxKeyframes">The most key frames.</param>
+    void                        SetMaxKeyframes(unsigned int maxKeyframes);
+
+    /// <summary>
+    /// Start the worker thread adding key frames to the camera pose finder.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Start();
+
+    /// <summary>
+    /// Stop the worker thread, after the key frame being added if there is one.
+    /// </summary>
+    void                        Stop();
+
+    /// <summary>
+    /// Submit a key frame to add to the database if it is not similar to the stored frames.
+    /// The images are copied, so they may be reused as soon as this returns.
+    /// </summary>
+    /// <param name="pDepthFloatImage">The depth float image of the key frame.</param>
+    /// <param name="pColorImage">The color image of the key frame, resampled to the depth size by the worker.</param>
+    /// <param name="worldToCameraTransform">The camera pose of the key frame.</param>
+    /// <param name="distanceThresholdAccept">The minimum distance to the stored frames for the frame to be added.</param>
+    /// <returns>S_OK if submitted, S_FALSE if skipped as the worker is busy, otherwise failure code</returns>
+    HRESULT                     Submit(
+        const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+        const NUI_FUSION_IMAGE_FRAME *pColorImage,
+        const Matrix4 &worldToCameraTransform,
+        float distanceThresholdAccept);
+
+    /// <summary>
+    /// Get the outcome of the most recently added key frame, once per key frame.
+    /// </summary>
+    /// <param name="result">Returns the outcome.</param>
+    /// <returns>true if a key frame was added since the last call</returns>
+    bool                        TakeInsertResult(KinectFusionCameraPoseFinderInsert &result);
+
+    /// <summary>
+    /// Find the stored key frames most similar to a frame, waiting for the key frame being added.
+    /// The matches of the camera pose finder alternate with those of the loaded key frames.
+    /// </summary>
+    /// <param name="pDepthFloatImage">The depth float image.</param>
+    /// <param name="pColorImage">The color image, the same size as the depth image.</param>
+    /// <param name="maxPoses">The most poses to return.</param>
+    /// <param name="ppPoses">Returns the poses of the matched key frames, most similar first, valid until the next call.</param>
+    /// <param name="pcPoses">Returns the number of poses.</param>
+    /// <param name="pMinDistance">Returns the normalized distance to the most similar key frame.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     FindCameraPose(
+        const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+        const NUI_FUSION_IMAGE_FRAME *pColorImage,
+        unsigned int maxPoses,
+        const Matrix4 **ppPoses,
+        unsigned int *pcPoses,
+        float *pMinDistance);
+
+    /// <summary>
+    /// Clear the database, waiting for the key frame being added. Loaded key frames are kept.
+    /// </summary>
+    void                        Reset();
+
+    /// <summary>
+    /// Save the key frames, waiting for the key frame being added.
+    /// </summary>
+    /// <param name="szFileName">The path of the keyframe database file.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     SaveKeyframes(LPCWSTR szFileName);
+
+    /// <summary>
+    /// Load the key frames of an earlier session, waiting for the key frame being added.
+    /// </summary>
+    /// <param name="szFileName">The path of the keyframe database file.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     LoadKeyframes(LPCWSTR szFileName);
+
+    /// <summary>
+    /// The number of key frames in the database, without waiting for the key frame being added.
+    /// </summary>
+    unsigned int                GetStoredPoseCount() const
+    {
+        return static_cast<unsigned int>(m_cStoredPoses);
+    }
+
+    /// <summary>
+    /// The number of loaded key frames, without waiting for the key frame being added.
+    /// </summary>
+    unsigned int                GetLoadedKeyframeCount() const
+    {
+        return static_cast<unsigned int>(m_cLoadedKeyframes);
+    }
+
+private:
+    /// <summary>
+    /// Worker thread procedure
+    /// </summary>
+    static DWORD WINAPI         ThreadProc(LPVOID lpParameter);
+
+    /// <summary>
+    /// Add each submitted key frame until stopped.
+    /// </summary>
+    DWORD                       WorkerLoop();
+
+    /// <summary>
+    /// Add the submitted key frame to the database.
+    /// </summary>
+    void                        ProcessSubmittedFrame();
+
+    /// <summary>
+    /// Wait until the submitted key frame has been added.
+    /// </summary>
+    void                        WaitForIdle();
+
+    // Not copyable, as the worker thread refers to this object
+    KinectFusionCameraPoseFinderWorker(const KinectFusionCameraPoseFinderWorker&);
+    KinectFusionCameraPoseFinderWorker& operator=(const KinectFusionCameraPoseFinderWorker&);
+
+    KinectFusionInstrumentation& m_instrumentation;
+    INuiFusionCameraPoseFinder* m_pCameraPoseFinder;
+
+    HANDLE                      m_hThread;
+    HANDLE                      m_hStopEvent;
+    HANDLE                      m_hWorkEvent;
+    HANDLE                      m_hIdleEvent;
+
+    // Guards the camera pose finder, the keyframe database and the insert result
+    CRITICAL_SECTION            m_lock;
+
+    // The submitted key frame, only written by the submitting thread while the worker is idle
+    NUI_FUSION_IMAGE_FRAME*     m_pDepthFloatImage;
+    NUI_FUSION_IMAGE_FRAME*     m_pColorImage;
+    NUI_FUSION_IMAGE_FRAME*     m_pResampledColorImage;
+    Matrix4                     m_worldToCameraTransform;
+    float                       m_fDistanceThresholdAccept;
+    KinectFusionImagePyramid    m_colorPyramid;
+
+    KinectFusionKeyframeDatabase m_keyframes;
+    std::vector<Matrix4>        m_matchPoses;
+
+    volatile LONG               m_cStoredPoses;
+    volatile LONG               m_cLoadedKeyframes;
+    KinectFusionCameraPoseFinderInsert m_insertResult;
+    bool                        m_bInsertResultPending;
+};
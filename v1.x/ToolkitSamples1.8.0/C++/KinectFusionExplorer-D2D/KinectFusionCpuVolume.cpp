@@ -0,0 +1,887 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionCpuVolume.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <malloc.h>
+#include <new>
+#include <algorithm>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionCpuVolume.h"
+#include "KinectFusionVoxelKernels.h"
+#include "Timer.h"
+
+using namespace KinectFusionVoxel;
+
+/// <summary>
+/// Intersect the range of x for which the linear constraint a + b * x >= 0 holds
+/// with the range [xMin, xMax].
+/// </summary>
+/// <param name="a">The constant term of the constraint.</param>
+/// <param name="b">The x term of the constraint.</param>
+/// <param name="xMin">The lower bound of the range, updated in place.</param>
+/// <param name="xMax">The upper bound of the range, updated in place.</param>
+static void ClipRow(float a, float b, float &xMin, float &xMax)
+{
+    if (b > 0.0f)
+    {
+        xMin = max(xMin, -a / b);
+    }
+    else if (b < 0.0f)
+    {
+        xMax = min(xMax, -a / b);
+    }
+    else if (a < 0.0f)
+    {
+        // Constraint never holds along this row
+        xMax = -1.0f;
+    }
+}
+
+/// <summary>
+/// Voxel accessor of the dense volume for the shared raycast kernel.
+/// </summary>
+struct DenseVoxelAccessor
+{
+    const unsigned int* pVoxels;
+    const unsigned int* pColorVoxels;
+    UINT64              strideY;
+    UINT64              strideZ;
+
+    inline UINT64 Index(int x, int y, int z) const
+    {
+        return (z * strideZ) + (y * strideY) + x;
+    }
+
+    inline unsigned int Voxel(int x, int y, int z) const
+    {
+        return pVoxels[Index(x, y, z)];
+    }
+
+    inline unsigned int ColorVoxel(int x, int y, int z) const
+    {
+        return pColorVoxels[Index(x, y, z)];
+    }
+
+    inline void Corners(int x, int y, int z, unsigned int corners[8]) const
+    {
+        const unsigned int *pVoxel = pVoxels + Index(x, y, z);
+
+        corners[0] = pVoxel[0];
+        corners[1] = pVoxel[1];
+        corners[2] = pVoxel[strideY];
+        corners[3] = pVoxel[strideY + 1];
+        corners[4] = pVoxel[strideZ];
+        corners[5] = pVoxel[strideZ + 1];
+        corners[6] = pVoxel[strideZ + strideY];
+        corners[7] = pVoxel[strideZ + strideY + 1];
+    }
+
+    inline float SkipUnallocated(const float [3], const float [3], float t) const
+    {
+        // Every voxel of the dense volume is stored
+        return t;
+    }
+};
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionCpuVolume::KinectFusionCpuVolume() :
+    m_pVoxels(nullptr),
+    m_pColorVoxels(nullptr),
+    m_cVoxels(0),
+    m_blockCountX(0),
+    m_blockCountY(0),
+    m_blockCountZ(0),
+    m_bChangesReset(true)
+{
+    ZeroMemory(&m_params, sizeof(m_params));
+    SetIdentityMatrix(m_worldToVolumeTransform);
+    SetIdentityMatrix(m_defaultWorldToVolumeTransform);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionCpuVolume::~KinectFusionCpuVolume()
+{
+    FreeVoxels();
+}
+
+/// <summary>
+/// Release the voxel storage.
+/// </summary>
+void KinectFusionCpuVolume::FreeVoxels()
+{
+    if (nullptr != m_pVoxels)
+    {
+        _aligned_free(m_pVoxels);
+        m_pVoxels = nullptr;
+    }
+
+    if (nullptr != m_pColorVoxels)
+    {
+        _aligned_free(m_pColorVoxels);
+        m_pColorVoxels = nullptr;
+    }
+
+    m_cVoxels = 0;
+
+    std::vector<unsigned char>().swap(m_changedBlocks);
+    m_blockCountX = m_blockCountY = m_blockCountZ = 0;
+}
+
+/// <summary>
+/// Allocate the color voxels on first use. They are cleared before they are published, as a
+/// raycast may be running.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::AllocateColorVoxels()
+{
+    if (nullptr != m_pColorVoxels)
+    {
+        return S_OK;
+    }
+
+    unsigned int *pColorVoxels = reinterpret_cast<unsigned int*>(_aligned_malloc(static_cast<size_t>(m_cVoxels * sizeof(unsigned int)), 16));
+    if (nullptr == pColorVoxels)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory(pColorVoxels, static_cast<size_t>(m_cVoxels * sizeof(unsigned int)));
+
+    MemoryBarrier();
+    m_pColorVoxels = pColorVoxels;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Allocate the volume.
+/// </summary>
+/// <param name="reconstructionParams">The size and resolution of the volume. voxelCountX must be a multiple of 4.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::Initialize(const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams)
+{
+    if (reconstructionParams.voxelsPerMeter <= 0.0f
+        || 0 == reconstructionParams.voxelCountX
+        || 0 == reconstructionParams.voxelCountY
+        || 0 == reconstructionParams.voxelCountZ
+        || 0 != reconstructionParams.voxelCountX % 4)
+    {
+        return E_INVALIDARG;
+    }
+
+    FreeVoxels();
+
+    UINT64 cVoxels = static_cast<UINT64>(reconstructionParams.voxelCountX)
+        * reconstructionParams.voxelCountY
+        * reconstructionParams.voxelCountZ;
+
+    if (cVoxels * sizeof(unsigned int) > static_cast<UINT64>(static_cast<size_t>(-1)))
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_pVoxels = reinterpret_cast<unsigned int*>(_aligned_malloc(static_cast<size_t>(cVoxels * sizeof(unsigned int)), 16));
+    if (nullptr == m_pVoxels)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_cVoxels = cVoxels;
+    m_params = reconstructionParams;
+
+    m_blockCountX = static_cast<int>((m_params.voxelCountX + BlockSize - 1) / BlockSize);
+    m_blockCountY = static_cast<int>((m_params.voxelCountY + BlockSize - 1) / BlockSize);
+    m_blockCountZ = static_cast<int>((m_params.voxelCountZ + BlockSize - 1) / BlockSize);
+
+    try
+    {
+        m_changedBlocks.assign(static_cast<size_t>(m_blockCountX) * m_blockCountY * m_blockCountZ, 0);
+    }
+    catch (const std::bad_alloc&)
+    {
+        FreeVoxels();
+        return E_OUTOFMEMORY;
+    }
+
+    // Match the default world to volume transform of the Kinect Fusion SDK volume: the
+    // camera sits at the center of the front face of the volume, looking along +z
+    SetIdentityMatrix(m_defaultWorldToVolumeTransform);
+    m_defaultWorldToVolumeTransform.M11 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M22 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M33 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M41 = static_cast<float>(m_params.voxelCountX / 2);
+    m_defaultWorldToVolumeTransform.M42 = static_cast<float>(m_params.voxelCountY / 2);
+    m_defaultWorldToVolumeTransform.M43 = 0.0f;
+
+    return ResetReconstruction(nullptr);
+}
+
+/// <summary>
+/// Clear the volume and optionally set a new world to volume transform.
+/// </summary>
+/// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::ResetReconstruction(const Matrix4 *pWorldToVolumeTransform)
+{
+    if (nullptr == m_pVoxels)
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_worldToVolumeTransform = (nullptr != pWorldToVolumeTransform) ? *pWorldToVolumeTransform : m_defaultWorldToVolumeTransform;
+
+    const size_t sliceBytes = static_cast<size_t>(m_params.voxelCountX) * m_params.voxelCountY * sizeof(unsigned int);
+
+    // The color storage is cleared rather than released, so a raycast running meanwhile never
+    // reads released memory
+    Concurrency::parallel_for(0u, m_params.voxelCountZ, [&](unsigned int z)
+    {
+        ZeroMemory(m_pVoxels + VoxelIndex(0, 0, z), sliceBytes);
+
+        if (nullptr != m_pColorVoxels)
+        {
+            ZeroMemory(m_pColorVoxels + VoxelIndex(0, 0, z), sliceBytes);
+        }
+    });
+
+    std::fill(m_changedBlocks.begin(), m_changedBlocks.end(), static_cast<unsigned char>(0));
+    m_bChangesReset = true;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Get the current world to volume transform.
+/// </summary>
+/// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const
+{
+    if (nullptr == pWorldToVolumeTransform)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pWorldToVolumeTransform = m_worldToVolumeTransform;
+    return S_OK;
+}
+
+/// <summary>
+/// Number of bytes of host memory currently allocated by the volume.
+/// </summary>
+UINT64 KinectFusionCpuVolume::GetResidentBytes() const
+{
+    UINT64 bytes = 0;
+
+    if (nullptr != m_pVoxels)
+    {
+        bytes += m_cVoxels * sizeof(unsigned int);
+    }
+
+    if (nullptr != m_pColorVoxels)
+    {
+        bytes += m_cVoxels * sizeof(unsigned int);
+    }
+
+    bytes += m_changedBlocks.capacity();
+
+    return bytes;
+}
+
+/// <summary>
+/// Integrate a depth float frame, and optionally a depth aligned color frame, into the volume.
+/// </summary>
+/// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+/// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+/// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+/// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::IntegrateFrame(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+    USHORT maxIntegrationWeight,
+    const Matrix4 *pWorldToCameraTransform)
+{
+    HRESULT hr = S_OK;
+
+    if (nullptr == m_pVoxels)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pDepthFloatFrame || nullptr == pDepthFloatFrame->pFrameTexture || nullptr == pWorldToCameraTransform
+        || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr != pColorFrame
+        && (nullptr == pColorFrame->pFrameTexture
+        || NUI_FUSION_IMAGE_TYPE_COLOR != pColorFrame->imageType
+        || pColorFrame->width != pDepthFloatFrame->width
+        || pColorFrame->height != pDepthFloatFrame->height))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr != pColorFrame && FAILED(hr = AllocateColorVoxels()))
+    {
+        return hr;
+    }
+
+    NUI_LOCKED_RECT depthLockedRect;
+    hr = pDepthFloatFrame->pFrameTexture->LockRect(0, &depthLockedRect, nullptr, 0);
+    if (FAILED(hr) || depthLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    NUI_LOCKED_RECT colorLockedRect;
+    colorLockedRect.pBits = nullptr;
+    colorLockedRect.Pitch = 0;
+
+    if (nullptr != pColorFrame)
+    {
+        hr = pColorFrame->pFrameTexture->LockRect(0, &colorLockedRect, nullptr, 0);
+        if (FAILED(hr) || colorLockedRect.Pitch == 0)
+        {
+            pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+            return E_NOINTERFACE;
+        }
+    }
+
+    const unsigned char *pDepthBuffer = depthLockedRect.pBits;
+    const unsigned char *pColorBuffer = colorLockedRect.pBits;
+    const int depthPitch = depthLockedRect.Pitch;
+    const int colorPitch = colorLockedRect.Pitch;
+
+    const int width = static_cast<int>(pDepthFloatFrame->width);
+    const int height = static_cast<int>(pDepthFloatFrame->height);
+
+    // Voxels further than the furthest depth pixel plus the truncation distance cannot be updated
+    const float maxDepth = FindMaxDepth(pDepthBuffer, depthPitch, width, height);
+
+    if (maxDepth > 0.0f)
+    {
+        IntegrationFrame frame;
+        frame.pDepth = pDepthBuffer;
+        frame.depthPitch = depthPitch;
+        frame.pColor = pColorBuffer;
+        frame.colorPitch = colorPitch;
+        frame.width = width;
+        frame.height = height;
+        frame.maxWeight = static_cast<float>(max(maxIntegrationWeight, static_cast<USHORT>(1)));
+        frame.maxColorWeight = min(static_cast<unsigned int>(frame.maxWeight), 255u);
+        GetFrameIntrinsics(pDepthFloatFrame, frame.flx, frame.fly, frame.ppx, frame.ppy);
+
+        const float flx = frame.flx;
+        const float fly = frame.fly;
+        const float ppx = frame.ppx;
+        const float ppy = frame.ppy;
+
+        const Matrix4 volumeToCamera = MultiplyMatrix4(InvertMatrix4Affine(m_worldToVolumeTransform), *pWorldToCameraTransform);
+        const float farDepth = maxDepth + TruncationDistance;
+        const float maxU = static_cast<float>(width - 1);
+        const float maxV = static_cast<float>(height - 1);
+
+        const int voxelCountX = static_cast<int>(m_params.voxelCountX);
+        const int voxelCountY = static_cast<int>(m_params.voxelCountY);
+        const int voxelCountZ = static_cast<int>(m_params.voxelCountZ);
+
+        Concurrency::parallel_for(0, voxelCountZ, [&](int z)
+        {
+            for (int y = 0; y < voxelCountY; ++y)
+            {
+                // Camera space position of voxel (0, y, z); positions along the row are linear in x
+                const float baseX = volumeToCamera.M41 + (volumeToCamera.M21 * y) + (volumeToCamera.M31 * z);
+                const float baseY = volumeToCamera.M42 + (volumeToCamera.M22 * y) + (volumeToCamera.M32 * z);
+                const float baseZ = volumeToCamera.M43 + (volumeToCamera.M23 * y) + (volumeToCamera.M33 * z);
+
+                // Clip the row to the voxels in front of the camera which project inside the image
+                float xMin = 0.0f;
+                float xMax = static_cast<float>(voxelCountX - 1);
+
+                ClipRow(baseZ - MinimumDepth, volumeToCamera.M13, xMin, xMax);
+                ClipRow(farDepth - baseZ, -volumeToCamera.M13, xMin, xMax);
+                ClipRow(flx * baseX + ppx * baseZ, flx * volumeToCamera.M11 + ppx * volumeToCamera.M13, xMin, xMax);
+                ClipRow((maxU - ppx) * baseZ - flx * baseX, (maxU - ppx) * volumeToCamera.M13 - flx * volumeToCamera.M11, xMin, xMax);
+                ClipRow(fly * baseY + ppy * baseZ, fly * volumeToCamera.M12 + ppy * volumeToCamera.M13, xMin, xMax);
+                ClipRow((maxV - ppy) * baseZ - fly * baseY, (maxV - ppy) * volumeToCamera.M13 - fly * volumeToCamera.M12, xMin, xMax);
+
+                if (xMin > xMax)
+                {
+                    continue;
+                }
+
+                const int xBegin = max(0, static_cast<int>(ceilf(xMin)));
+                const int xEnd = min(voxelCountX - 1, static_cast<int>(floorf(xMax)));
+
+                if (xBegin > xEnd)
+                {
+                    continue;
+                }
+
+                // Runs start on a block boundary, the voxels before xBegin are masked out
+                const int xRun = xBegin & ~(BlockSize - 1);
+                const int count = ((xEnd - xRun) | 3) + 1;
+
+                unsigned int *pVoxelRun = m_pVoxels + VoxelIndex(xRun, y, z);
+                unsigned int *pColorVoxelRun = (nullptr != pColorBuffer) ? m_pColorVoxels + VoxelIndex(xRun, y, z) : nullptr;
+
+                // Rows of the same block are integrated concurrently, but only ever set its flag
+                unsigned char *pChangedBlocks = &m_changedBlocks[BlockIndex(xRun / BlockSize, y / BlockSize, z / BlockSize)];
+
+                IntegrateVoxelRun(frame, volumeToCamera, xRun, y, z, count, xBegin - xRun, xEnd - xRun, pVoxelRun, pColorVoxelRun, pChangedBlocks);
+            }
+        });
+    }
+
+    if (nullptr != pColorFrame)
+    {
+        pColorFrame->pFrameTexture->UnlockRect(0);
+    }
+
+    pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Raycast the volume from the given camera pose.
+/// </summary>
+/// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+/// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+/// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+/// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::CalculatePointCloudAndDepth(
+    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+    const Matrix4 *pWorldToCameraTransform)
+{
+    HRESULT hr = S_OK;
+
+    if (nullptr == m_pVoxels)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pPointCloudFrame || nullptr == pPointCloudFrame->pFrameTexture || nullptr == pWorldToCameraTransform
+        || NUI_FUSION_IMAGE_TYPE_POINT_CLOUD != pPointCloudFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    const unsigned int width = pPointCloudFrame->width;
+    const unsigned int height = pPointCloudFrame->height;
+
+    if ((nullptr != pDepthFloatFrame
+        && (nullptr == pDepthFloatFrame->pFrameTexture || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType
+        || width != pDepthFloatFrame->width || height != pDepthFloatFrame->height))
+        || (nullptr != pColorFrame
+        && (nullptr == pColorFrame->pFrameTexture || NUI_FUSION_IMAGE_TYPE_COLOR != pColorFrame->imageType
+        || width != pColorFrame->width || height != pColorFrame->height)))
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_LOCKED_RECT pointCloudLockedRect;
+    hr = pPointCloudFrame->pFrameTexture->LockRect(0, &pointCloudLockedRect, nullptr, 0);
+    if (FAILED(hr) || pointCloudLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    NUI_LOCKED_RECT depthLockedRect;
+    depthLockedRect.pBits = nullptr;
+    depthLockedRect.Pitch = 0;
+
+    NUI_LOCKED_RECT colorLockedRect;
+    colorLockedRect.pBits = nullptr;
+    colorLockedRect.Pitch = 0;
+
+    if (nullptr != pDepthFloatFrame)
+    {
+        hr = pDepthFloatFrame->pFrameTexture->LockRect(0, &depthLockedRect, nullptr, 0);
+        if (FAILED(hr) || depthLockedRect.Pitch == 0)
+        {
+            pPointCloudFrame->pFrameTexture->UnlockRect(0);
+            return E_NOINTERFACE;
+        }
+    }
+
+    if (nullptr != pColorFrame)
+    {
+        hr = pColorFrame->pFrameTexture->LockRect(0, &colorLockedRect, nullptr, 0);
+        if (FAILED(hr) || colorLockedRect.Pitch == 0)
+        {
+            if (nullptr != pDepthFloatFrame)
+            {
+                pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+            }
+
+            pPointCloudFrame->pFrameTexture->UnlockRect(0);
+            return E_NOINTERFACE;
+        }
+    }
+
+    RaycastFrame frame;
+    frame.pPointCloud = pointCloudLockedRect.pBits;
+    frame.pointCloudPitch = pointCloudLockedRect.Pitch;
+    frame.pDepth = depthLockedRect.pBits;
+    frame.depthPitch = depthLockedRect.Pitch;
+    frame.pColor = colorLockedRect.pBits;
+    frame.colorPitch = colorLockedRect.Pitch;
+    frame.width = width;
+    frame.height = height;
+    frame.voxelsPerMeter = m_params.voxelsPerMeter;
+    frame.hasColor = nullptr != pColorFrame && nullptr != m_pColorVoxels;
+    GetFrameIntrinsics(pPointCloudFrame, frame.flx, frame.fly, frame.ppx, frame.ppy);
+
+    // Trilinear sampling and central differences need one voxel either side of the sample
+    frame.boxMin[0] = frame.boxMin[1] = frame.boxMin[2] = 1.0f;
+    frame.boxMax[0] = static_cast<float>(m_params.voxelCountX) - 2.001f;
+    frame.boxMax[1] = static_cast<float>(m_params.voxelCountY) - 2.001f;
+    frame.boxMax[2] = static_cast<float>(m_params.voxelCountZ) - 2.001f;
+
+    DenseVoxelAccessor volume;
+    volume.pVoxels = m_pVoxels;
+    volume.pColorVoxels = m_pColorVoxels;
+    volume.strideY = m_params.voxelCountX;
+    volume.strideZ = static_cast<UINT64>(m_params.voxelCountX) * m_params.voxelCountY;
+
+    RaycastVolume(volume, frame, m_worldToVolumeTransform, *pWorldToCameraTransform);
+
+    if (nullptr != pColorFrame)
+    {
+        pColorFrame->pFrameTexture->UnlockRect(0);
+    }
+
+    if (nullptr != pDepthFloatFrame)
+    {
+        pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+    }
+
+    pPointCloudFrame->pFrameTexture->UnlockRect(0);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Get the blocks whose signed distance or color changed since the last call, and start
+/// collecting changes again.
+/// </summary>
+/// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each changed block.</param>
+/// <param name="bReset">Returns true if the volume was reset since the last call.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset)
+{
+    if (nullptr == m_pVoxels)
+    {
+        return E_UNEXPECTED;
+    }
+
+    blockKeys.clear();
+
+    try
+    {
+        size_t index = 0;
+        for (int blockZ = 0; blockZ < m_blockCountZ; ++blockZ)
+        {
+            for (int blockY = 0; blockY < m_blockCountY; ++blockY)
+            {
+                for (int blockX = 0; blockX < m_blockCountX; ++blockX, ++index)
+                {
+                    if (0 != m_changedBlocks[index])
+                    {
+                        blockKeys.push_back(BlockKey(blockX, blockY, blockZ));
+                        m_changedBlocks[index] = 0;
+                    }
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    bReset = m_bChangesReset;
+    m_bChangesReset = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume read as zero.
+/// </summary>
+/// <param name="x">The x coordinate of the first voxel of the box.</param>
+/// <param name="y">The y coordinate of the first voxel of the box.</param>
+/// <param name="z">The z coordinate of the first voxel of the box.</param>
+/// <param name="size">The number of voxels along each edge of the box.</param>
+/// <param name="pVoxels">Returns the voxels of the box.</param>
+/// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+void KinectFusionCpuVolume::CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const
+{
+    const size_t boxBytes = static_cast<size_t>(size) * size * size * sizeof(unsigned int);
+
+    ZeroMemory(pVoxels, boxBytes);
+    if (nullptr != pColorVoxels)
+    {
+        ZeroMemory(pColorVoxels, boxBytes);
+    }
+
+    if (nullptr == m_pVoxels)
+    {
+        return;
+    }
+
+    // Clip the row of the box to the volume
+    const int xBegin = max(x, 0);
+    const int xEnd = min(x + size, static_cast<int>(m_params.voxelCountX));
+    if (xBegin >= xEnd)
+    {
+        return;
+    }
+
+    const size_t rowBytes = (xEnd - xBegin) * sizeof(unsigned int);
+
+    for (int boxZ = 0; boxZ < size; ++boxZ)
+    {
+        const int voxelZ = z + boxZ;
+        if (voxelZ < 0 || voxelZ >= static_cast<int>(m_params.voxelCountZ))
+        {
+            continue;
+        }
+
+        for (int boxY = 0; boxY < size; ++boxY)
+        {
+            const int voxelY = y + boxY;
+            if (voxelY < 0 || voxelY >= static_cast<int>(m_params.voxelCountY))
+            {
+                continue;
+            }
+
+            const UINT64 sourceIndex = VoxelIndex(xBegin, voxelY, voxelZ);
+            const size_t boxIndex = ((static_cast<size_t>(boxZ) * size) + boxY) * size + (xBegin - x);
+
+            CopyMemory(pVoxels + boxIndex, m_pVoxels + sourceIndex, rowBytes);
+
+            if (nullptr != pColorVoxels && nullptr != m_pColorVoxels)
+            {
+                CopyMemory(pColorVoxels + boxIndex, m_pColorVoxels + sourceIndex, rowBytes);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Get the blocks which may hold observed voxels. Every block of a dense volume is stored.
+/// </summary>
+/// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::GetStoredBlocks(std::vector<UINT64> &blockKeys) const
+{
+    if (nullptr == m_pVoxels)
+    {
+        return E_UNEXPECTED;
+    }
+
+    blockKeys.clear();
+
+    try
+    {
+        blockKeys.reserve(m_changedBlocks.size());
+
+        for (int blockZ = 0; blockZ < m_blockCountZ; ++blockZ)
+        {
+            for (int blockY = 0; blockY < m_blockCountY; ++blockY)
+            {
+                for (int blockX = 0; blockX < m_blockCountX; ++blockX)
+                {
+                    blockKeys.push_back(BlockKey(blockX, blockY, blockZ));
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Overwrite the voxels of a block, ordered x fastest, then y, then z.
+/// </summary>
+/// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+/// <param name="pVoxels">The voxels of the block.</param>
+/// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels)
+{
+    if (nullptr == m_pVoxels)
+    {
+        return E_UNEXPECTED;
+    }
+
+    int blockX, blockY, blockZ;
+    BlockCoordinates(blockKey, blockX, blockY, blockZ);
+
+    if (nullptr == pVoxels || blockX >= m_blockCountX || blockY >= m_blockCountY || blockZ >= m_blockCountZ)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr != pColorVoxels)
+    {
+        HRESULT hr = AllocateColorVoxels();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    // Clip the rows of the block to the volume
+    const int x = blockX * BlockSize;
+    const int y = blockY * BlockSize;
+    const int z = blockZ * BlockSize;
+    const int yEnd = min(y + BlockSize, static_cast<int>(m_params.voxelCountY));
+    const int zEnd = min(z + BlockSize, static_cast<int>(m_params.voxelCountZ));
+    const size_t rowBytes = (min(x + BlockSize, static_cast<int>(m_params.voxelCountX)) - x) * sizeof(unsigned int);
+
+    for (int voxelZ = z; voxelZ < zEnd; ++voxelZ)
+    {
+        for (int voxelY = y; voxelY < yEnd; ++voxelY)
+        {
+            const UINT64 destIndex = VoxelIndex(x, voxelY, voxelZ);
+            const size_t blockIndex = ((static_cast<size_t>(voxelZ - z) * BlockSize) + (voxelY - y)) * BlockSize;
+
+            CopyMemory(m_pVoxels + destIndex, pVoxels + blockIndex, rowBytes);
+
+            if (nullptr != pColorVoxels)
+            {
+                CopyMemory(m_pColorVoxels + destIndex, pColorVoxels + blockIndex, rowBytes);
+            }
+        }
+    }
+
+    m_changedBlocks[BlockIndex(blockX, blockY, blockZ)] = 1;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Time the integration of a sequence of depth frames with the integration limited to 1, 2, 4
+/// and so on cores up to all cores of the host.
+/// </summary>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="ppDepthFloatFrames">The depth float frames.</param>
+/// <param name="cFrames">The number of frames.</param>
+/// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+/// <param name="pResults">Returns the times.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionCpuVolume::Benchmark(
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    const NUI_FUSION_IMAGE_FRAME * const *ppDepthFloatFrames,
+    unsigned int cFrames,
+    USHORT maxIntegrationWeight,
+    KinectFusionIntegrationBenchmark *pResults)
+{
+    if (nullptr == ppDepthFloatFrames || 0 == cFrames || nullptr == pResults)
+    {
+        return E_INVALIDARG;
+    }
+
+    KinectFusionCpuVolume *pVolume = new(std::nothrow) KinectFusionCpuVolume();
+    if (nullptr == pVolume)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = pVolume->Initialize(reconstructionParams);
+
+    Matrix4 worldToCameraTransform;
+    SetIdentityMatrix(worldToCameraTransform);
+
+    Timing::Timer timer;
+    const unsigned int cProcessors = Concurrency::GetProcessorCount();
+
+    pResults->frames = cFrames;
+    pResults->coreCounts = 0;
+
+    for (unsigned int cores = 1; SUCCEEDED(hr) && pResults->coreCounts < KinectFusionIntegrationBenchmark::cMaxCoreCounts; cores *= 2)
+    {
+        // Always finish with all cores
+        cores = min(cores, cProcessors);
+
+        hr = pVolume->ResetReconstruction(nullptr);
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        // The parallel loops of the integration run on the scheduler attached to this thread
+        Concurrency::SchedulerPolicy policy(2,
+            Concurrency::MinConcurrency, cores,
+            Concurrency::MaxConcurrency, cores);
+        Concurrency::CurrentScheduler::Create(policy);
+
+        double startTime = timer.AbsoluteTime();
+
+        for (unsigned int i = 0; i < cFrames && SUCCEEDED(hr); ++i)
+        {
+            hr = pVolume->IntegrateFrame(ppDepthFloatFrames[i], nullptr, maxIntegrationWeight, &worldToCameraTransform);
+        }
+
+        double elapsedTime = timer.AbsoluteTime() - startTime;
+
+        Concurrency::CurrentScheduler::Detach();
+
+        pResults->cores[pResults->coreCounts] = cores;
+        pResults->integrationTime[pResults->coreCounts] = (elapsedTime * 1000.0) / cFrames;
+        ++pResults->coreCounts;
+
+        if (cores == cProcessors)
+        {
+            break;
+        }
+    }
+
+    delete pVolume;
+
+    return hr;
+}
@@ -0,0 +1,220 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionCpuVolume.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionVolume.h"
+
+/// <summary>
+/// Integration times of KinectFusionCpuVolume::Benchmark by number of cores, in milliseconds per frame.
+/// </summary>
+struct KinectFusionIntegrationBenchmark
+{
+    static const unsigned int   cMaxCoreCounts = 8;
+
+    unsigned int                frames;
+    unsigned int                coreCounts;
+    unsigned int                cores[cMaxCoreCounts];
+    double                      integrationTime[cMaxCoreCounts];
+};
+
+/// <summary>
+/// Dense TSDF reconstruction volume integrated and raycast on the host CPU.
+/// Work is split across cores with the Parallel Patterns Library and the voxel
+/// update is vectorized with SSE2, four voxels at a time along the x axis.
+/// </summary>
+class KinectFusionCpuVolume : public KinectFusionVolume
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionCpuVolume();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionCpuVolume();
+
+    /// <summary>
+    /// Allocate the volume.
+    /// </summary>
+    /// <param name="reconstructionParams">The size and resolution of the volume. voxelCountX must be a multiple of 4.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Initialize(const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams);
+
+    /// <summary>
+    /// Clear the volume and optionally set a new world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ResetReconstruction(const Matrix4 *pWorldToVolumeTransform);
+
+    /// <summary>
+    /// Get the current world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const;
+
+    /// <summary>
+    /// Integrate a depth float frame, and optionally a depth aligned color frame, into the volume.
+    /// </summary>
+    /// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+    /// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+    /// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     IntegrateFrame(
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    USHORT maxIntegrationWeight,
+                                    const Matrix4 *pWorldToCameraTransform);
+
+    /// <summary>
+    /// Raycast the volume from the given camera pose.
+    /// </summary>
+    /// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+    /// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+    /// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CalculatePointCloudAndDepth(
+                                    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    const Matrix4 *pWorldToCameraTransform);
+
+    /// <summary>
+    /// Number of bytes of host memory currently allocated by the volume.
+    /// </summary>
+    UINT64                      GetResidentBytes() const;
+
+    /// <summary>
+    /// Raycasts only read the voxels, so several may run at once.
+    /// </summary>
+    bool                        SupportsConcurrentRaycasts() const { return true; }
+
+    /// <summary>
+    /// The voxel storage stays in place until the volume is released, so raycasts may run while
+    /// frames are integrated or the volume is reset.
+    /// </summary>
+    bool                        SupportsRaycastDuringUpdates() const { return true; }
+
+    /// <summary>
+    /// Get the blocks whose signed distance or color changed since the last call, and start
+    /// collecting changes again.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each changed block.</param>
+    /// <param name="bReset">Returns true if the volume was reset since the last call.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset);
+
+    /// <summary>
+    /// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume read as zero.
+    /// </summary>
+    /// <param name="x">The x coordinate of the first voxel of the box.</param>
+    /// <param name="y">The y coordinate of the first voxel of the box.</param>
+    /// <param name="z">The z coordinate of the first voxel of the box.</param>
+    /// <param name="size">The number of voxels along each edge of the box.</param>
+    /// <param name="pVoxels">Returns the voxels of the box.</param>
+    /// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+    void                        CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const;
+
+    /// <summary>
+    /// Get the blocks which may hold observed voxels.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetStoredBlocks(std::vector<UINT64> &blockKeys) const;
+
+    /// <summary>
+    /// Overwrite the voxels of a block, ordered x fastest, then y, then z.
+    /// </summary>
+    /// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+    /// <param name="pVoxels">The voxels of the block.</param>
+    /// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels);
+
+    /// <summary>
+    /// Time the integration of a sequence of depth frames into a volume, with the integration
+    /// limited to 1, 2, 4 and so on cores up to all cores of the host. The frames are integrated
+    /// from the default camera pose into a volume cleared before each core count.
+    /// </summary>
+    /// <param name="reconstructionParams">The size and resolution of the volume.</param>
+    /// <param name="ppDepthFloatFrames">The depth float frames.</param>
+    /// <param name="cFrames">The number of frames.</param>
+    /// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT              Benchmark(
+                                    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+                                    const NUI_FUSION_IMAGE_FRAME * const *ppDepthFloatFrames,
+                                    unsigned int cFrames,
+                                    USHORT maxIntegrationWeight,
+                                    KinectFusionIntegrationBenchmark *pResults);
+
+private:
+    /// <summary>
+    /// Release the voxel storage.
+    /// </summary>
+    void                        FreeVoxels();
+
+    /// <summary>
+    /// Allocate the color voxels on first use.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     AllocateColorVoxels();
+
+    /// <summary>
+    /// Get the index of a voxel in the voxel arrays.
+    /// </summary>
+    inline UINT64               VoxelIndex(int x, int y, int z) const
+    {
+        return (static_cast<UINT64>(z) * m_params.voxelCountY + y) * m_params.voxelCountX + x;
+    }
+
+    /// <summary>
+    /// Get the index of a block in the changed block flags.
+    /// </summary>
+    inline size_t               BlockIndex(int blockX, int blockY, int blockZ) const
+    {
+        return (static_cast<size_t>(blockZ) * m_blockCountY + blockY) * m_blockCountX + blockX;
+    }
+
+    unsigned int*               m_pVoxels;
+    unsigned int*               m_pColorVoxels;
+    UINT64                      m_cVoxels;
+
+    // A flag per block of KinectFusionVoxel::BlockSize voxels, set when integration changes the block
+    std::vector<unsigned char>  m_changedBlocks;
+    int                         m_blockCountX;
+    int                         m_blockCountY;
+    int                         m_blockCountZ;
+    bool                        m_bChangesReset;
+
+    NUI_FUSION_RECONSTRUCTION_PARAMETERS m_params;
+    Matrix4                     m_worldToVolumeTransform;
+    Matrix4                     m_defaultWorldToVolumeTransform;
+};
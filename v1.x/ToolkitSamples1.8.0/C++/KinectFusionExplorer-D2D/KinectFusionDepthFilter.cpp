@@ -0,0 +1,434 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionDepthFilter.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <float.h>
+#include <math.h>
+#include <new>
+#include <emmintrin.h>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionDepthFilter.h"
+
+namespace
+{
+    /// <summary>
+    /// The weights and thresholds of a pass over the frame.
+    /// </summary>
+    struct FilterKernel
+    {
+        const float*            pWeights;           // the spatial weight of each distance from the center
+        float                   invRangeSquared;    // 1 / rangeThreshold^2
+        float                   rangeThreshold;
+        bool                    fillHoles;
+    };
+
+    /// <summary>
+    /// Filter one pixel from the taps kMin to kMax around it, stride floats apart. A valid pixel
+    /// is the mean of the valid taps weighted by distance and by how close their depth is to its
+    /// own, falling to zero at the range threshold. An invalid pixel is filled with the mean of
+    /// the valid taps weighted by distance, when there are valid taps on both sides of it which
+    /// hold at least half of the weight and lie within the range threshold of each other.
+    /// </summary>
+    float FilterPixel(const float *pCenter, ptrdiff_t stride, int kMin, int kMax, const FilterKernel &kernel)
+    {
+        const float center = pCenter[0];
+
+        if (center > 0.0f)
+        {
+            float sum = 0.0f;
+            float sumWeights = 0.0f;
+
+            for (int k = kMin; k <= kMax; ++k)
+            {
+                const float depth = pCenter[k * stride];
+                if (depth > 0.0f)
+                {
+                    const float difference = depth - center;
+                    const float range = 1.0f - (difference * difference * kernel.invRangeSquared);
+
+                    if (range > 0.0f)
+                    {
+                        const float weight = kernel.pWeights[abs(k)] * range;
+                        sum += weight * depth;
+                        sumWeights += weight;
+                    }
+                }
+            }
+
+            return sum / sumWeights;
+        }
+
+        if (!kernel.fillHoles)
+        {
+            return 0.0f;
+        }
+
+        float sum = 0.0f;
+        float sumWeights = 0.0f;
+        float totalWeights = 0.0f;
+        float nearest = FLT_MAX;
+        float farthest = 0.0f;
+        bool before = false;
+        bool after = false;
+
+        for (int k = kMin; k <= kMax; ++k)
+        {
+            if (0 == k)
+            {
+                continue;
+            }
+
+            const float weight = kernel.pWeights[abs(k)];
+            const float depth = pCenter[k * stride];
+            totalWeights += weight;
+
+            if (depth > 0.0f)
+            {
+                sum += weight * depth;
+                sumWeights += weight;
+                nearest = min(nearest, depth);
+                farthest = max(farthest, depth);
+                before |= k < 0;
+                after |= k > 0;
+            }
+        }
+
+        if (before && after && sumWeights * 2.0f >= totalWeights && farthest - nearest <= kernel.rangeThreshold)
+        {
+            return sum / sumWeights;
+        }
+
+        return 0.0f;
+    }
+
+    /// <summary>
+    /// Filter four adjacent pixels as FilterPixel does. Invalid pixels are zero, so the caller
+    /// fills holes in them.
+    /// </summary>
+    __m128 FilterPixels(const float *pCenter, ptrdiff_t stride, int kMin, int kMax, const FilterKernel &kernel)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 invRangeSquared = _mm_set1_ps(kernel.invRangeSquared);
+        const __m128 center = _mm_loadu_ps(pCenter);
+
+        __m128 sum = zero;
+        __m128 sumWeights = zero;
+
+        for (int k = kMin; k <= kMax; ++k)
+        {
+            const __m128 depth = _mm_loadu_ps(pCenter + (k * stride));
+            const __m128 difference = _mm_sub_ps(depth, center);
+            const __m128 range = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(difference, difference), invRangeSquared)), zero);
+            const __m128 weight = _mm_and_ps(_mm_cmpgt_ps(depth, zero), _mm_mul_ps(range, _mm_set1_ps(kernel.pWeights[abs(k)])));
+
+            sum = _mm_add_ps(sum, _mm_mul_ps(weight, depth));
+            sumWeights = _mm_add_ps(sumWeights, weight);
+        }
+
+        // The center weighs 1 in every valid pixel, and the division of the others is discarded
+        const __m128 valid = _mm_cmpgt_ps(center, zero);
+        return _mm_and_ps(valid, _mm_div_ps(sum, _mm_max_ps(sumWeights, one)));
+    }
+
+    /// <summary>
+    /// Filter a row with the taps kMin to kMax around each pixel, stride floats apart.
+    /// </summary>
+    void FilterRow(const float *pSrc, ptrdiff_t stride, float *pDest, unsigned int width, int kMin, int kMax, const FilterKernel &kernel)
+    {
+        unsigned int x = 0;
+
+        for (; x + 4 <= width; x += 4)
+        {
+            _mm_storeu_ps(pDest + x, FilterPixels(pSrc + x, stride, kMin, kMax, kernel));
+
+            if (kernel.fillHoles)
+            {
+                for (unsigned int i = x; i < x + 4; ++i)
+                {
+                    if (!(pSrc[i] > 0.0f))
+                    {
+                        pDest[i] = FilterPixel(pSrc + i, stride, kMin, kMax, kernel);
+                    }
+                }
+            }
+        }
+
+        for (; x < width; ++x)
+        {
+            pDest[x] = FilterPixel(pSrc + x, stride, kMin, kMax, kernel);
+        }
+    }
+
+    /// <summary>
+    /// Filter a row along itself. The taps are clipped at either end of the row, so the pixels
+    /// there are filtered one at a time.
+    /// </summary>
+    void FilterRowHorizontal(const float *pSrc, float *pDest, unsigned int width, int radius, const FilterKernel &kernel)
+    {
+        const int lastX = static_cast<int>(width) - 1;
+        int x = 0;
+
+        for (; x < radius && x <= lastX; ++x)
+        {
+            pDest[x] = FilterPixel(pSrc + x, 1, -x, min(radius, lastX - x), kernel);
+        }
+
+        const int interiorEnd = lastX - radius + 1;
+        if (x < interiorEnd)
+        {
+            FilterRow(pSrc + x, 1, pDest + x, static_cast<unsigned int>(interiorEnd - x), -radius, radius, kernel);
+            x = interiorEnd;
+        }
+
+        for (; x <= lastX; ++x)
+        {
+            pDest[x] = FilterPixel(pSrc + x, 1, -min(radius, x), min(radius, lastX - x), kernel);
+        }
+    }
+
+    /// <summary>
+    /// Blend a row of filtered depth with the previous frame in place. Pixels which are invalid
+    /// in either frame or moved further than the motion threshold take the new depth.
+    /// </summary>
+    void BlendRow(const float *pDepth, float *pHistory, unsigned int width, float weight, float motionThreshold)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 weights = _mm_set1_ps(weight);
+        const __m128 thresholds = _mm_set1_ps(motionThreshold);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        unsigned int x = 0;
+
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128 depth = _mm_loadu_ps(pDepth + x);
+            const __m128 previous = _mm_loadu_ps(pHistory + x);
+            const __m128 difference = _mm_sub_ps(depth, previous);
+
+            const __m128 blend = _mm_and_ps(
+                _mm_and_ps(_mm_cmpgt_ps(depth, zero), _mm_cmpgt_ps(previous, zero)),
+                _mm_cmple_ps(_mm_and_ps(difference, absMask), thresholds));
+
+            const __m128 blended = _mm_add_ps(previous, _mm_mul_ps(weights, difference));
+            _mm_storeu_ps(pHistory + x, _mm_or_ps(_mm_and_ps(blend, blended), _mm_andnot_ps(blend, depth)));
+        }
+
+        for (; x < width; ++x)
+        {
+            const float depth = pDepth[x];
+            const float previous = pHistory[x];
+
+            if (depth > 0.0f && previous > 0.0f && fabsf(depth - previous) <= motionThreshold)
+            {
+                pHistory[x] = previous + (weight * (depth - previous));
+            }
+            else
+            {
+                pHistory[x] = depth;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionDepthFilter::KinectFusionDepthFilter() :
+    m_width(0),
+    m_height(0),
+    m_radius(1),
+    m_rangeThreshold(0.0f),
+    m_temporalWeight(1.0f),
+    m_motionThreshold(0.0f),
+    m_bFillHoles(false),
+    m_bHistoryValid(false)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionDepthFilter::~KinectFusionDepthFilter()
+{
+}
+
+/// <summary>
+/// Filter a depth float frame in place.
+/// </summary>
+/// <param name="pDepthFloatFrame">The depth float frame, with zero where there is no depth.</param>
+/// <param name="radius">The radius of the spatial kernel in pixels, between 1 and cMaxRadius.</param>
+/// <param name="rangeThreshold">The depth difference in meters at which a neighbor no longer
+/// contributes to a pixel. Holes are only filled from neighbors within it of each other.</param>
+/// <param name="temporalWeight">The weight of the new depth when it is blended with the
+/// previous frame, between 0 and 1. 1 turns the temporal smoothing off.</param>
+/// <param name="motionThreshold">The depth change in meters above which a pixel takes the new
+/// depth rather than a blend with the previous frame.</param>
+/// <param name="fillHoles">Whether to fill small holes.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionDepthFilter::Filter(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    unsigned int radius,
+    float rangeThreshold,
+    float temporalWeight,
+    float motionThreshold,
+    bool fillHoles)
+{
+    if (nullptr == pDepthFloatFrame || nullptr == pDepthFloatFrame->pFrameTexture
+        || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (0 == radius || radius > cMaxRadius || !(rangeThreshold > 0.0f) || !(temporalWeight > 0.0f) || temporalWeight > 1.0f)
+    {
+        return E_INVALIDARG;
+    }
+
+    const unsigned int width = pDepthFloatFrame->width;
+    const unsigned int height = pDepthFloatFrame->height;
+    const unsigned int bandCount = (height + cBandRows - 1) / cBandRows;
+
+    if (width != m_width || height != m_height)
+    {
+        try
+        {
+            m_history.assign(static_cast<size_t>(width) * height, 0.0f);
+            m_bandBuffers.resize(static_cast<size_t>(bandCount) * cBandBufferRows * width);
+        }
+        catch (std::bad_alloc)
+        {
+            m_width = 0;
+            m_height = 0;
+            m_bHistoryValid = false;
+            return E_OUTOFMEMORY;
+        }
+
+        m_width = width;
+        m_height = height;
+        m_bHistoryValid = false;
+    }
+
+    if (0 == width || 0 == height)
+    {
+        return S_OK;
+    }
+
+    // A gaussian falling to exp(-2) at the radius
+    const float sigma = 0.5f * static_cast<float>(radius);
+    for (unsigned int k = 0; k <= radius; ++k)
+    {
+        m_spatialWeights[k] = expf(-static_cast<float>(k * k) / (2.0f * sigma * sigma));
+    }
+
+    m_radius = radius;
+    m_rangeThreshold = rangeThreshold;
+    m_temporalWeight = temporalWeight;
+    m_bFillHoles = fillHoles;
+
+    // Without a previous frame no pixel is within the motion threshold, so each takes its new depth
+    m_motionThreshold = (m_bHistoryValid && temporalWeight < 1.0f) ? motionThreshold : -1.0f;
+
+    NUI_LOCKED_RECT lockedRect;
+
+    // Lock the frame data so the Kinect knows not to modify it while we're reading it
+    HRESULT hr = pDepthFloatFrame->pFrameTexture->LockRect(0, &lockedRect, nullptr, 0);
+
+    // Make sure we've received valid data
+    if (FAILED(hr) || lockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    BYTE *pBits = lockedRect.pBits;
+    const unsigned int pitch = static_cast<unsigned int>(lockedRect.Pitch);
+
+    // Each band reads the frame rows around it, so the frame is only written once all are filtered
+    Concurrency::parallel_for(0u, bandCount, [&](unsigned int band)
+    {
+        FilterBand(pBits, pitch, band);
+    });
+
+    Concurrency::parallel_for(0u, bandCount, [&](unsigned int band)
+    {
+        const unsigned int yEnd = min((band + 1) * cBandRows, height);
+        for (unsigned int y = band * cBandRows; y < yEnd; ++y)
+        {
+            memcpy(pBits + (static_cast<size_t>(y) * pitch), &m_history[static_cast<size_t>(y) * width], width * sizeof(float));
+        }
+    });
+
+    m_bHistoryValid = true;
+
+    // We're done with the texture so unlock it
+    pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Filter the rows of a band.
+/// </summary>
+/// <param name="pSrc">The source frame pixels.</param>
+/// <param name="srcPitch">The source row pitch in bytes.</param>
+/// <param name="band">The band.</param>
+void KinectFusionDepthFilter::FilterBand(const BYTE *pSrc, unsigned int srcPitch, unsigned int band)
+{
+    const int radius = static_cast<int>(m_radius);
+    const unsigned int width = m_width;
+
+    const FilterKernel kernel = { m_spatialWeights, 1.0f / (m_rangeThreshold * m_rangeThreshold), m_rangeThreshold, m_bFillHoles };
+
+    const int yBegin = static_cast<int>(band * cBandRows);
+    const int yEnd = static_cast<int>(min((band + 1) * cBandRows, m_height));
+    const int haloBegin = max(yBegin - radius, 0);
+    const int haloEnd = min(yEnd + radius, static_cast<int>(m_height));
+
+    float *pBuffer = &m_bandBuffers[static_cast<size_t>(band) * cBandBufferRows * width];
+
+    // Filter the band and the rows around it along x
+    for (int y = haloBegin; y < haloEnd; ++y)
+    {
+        const float *pRow = reinterpret_cast<const float*>(pSrc + (static_cast<size_t>(y) * srcPitch));
+        FilterRowHorizontal(pRow, pBuffer + (static_cast<size_t>(y - haloBegin) * width), width, radius, kernel);
+    }
+
+    // Filter the band along y a row at a time into the scratch row after the buffered rows,
+    // and blend it into the history
+    float *pScratch = pBuffer + (static_cast<size_t>(haloEnd - haloBegin) * width);
+
+    for (int y = yBegin; y < yEnd; ++y)
+    {
+        const float *pCenter = pBuffer + (static_cast<size_t>(y - haloBegin) * width);
+        float *pHistory = &m_history[static_cast<size_t>(y) * width];
+
+        FilterRow(pCenter, static_cast<ptrdiff_t>(width), pScratch, width, max(-radius, haloBegin - y), min(radius, haloEnd - 1 - y), kernel);
+        BlendRow(pScratch, pHistory, width, m_temporalWeight, m_motionThreshold);
+    }
+}
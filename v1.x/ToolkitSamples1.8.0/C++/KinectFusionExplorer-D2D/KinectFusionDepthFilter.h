@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionDepthFilter.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+/// <summary>
+/// Filters depth float frames ahead of tracking and integration. Each frame is smoothed with a
+/// separable bilateral filter, which only averages depths within a range threshold of each pixel
+/// so depth discontinuities stay sharp, small holes are filled from the valid pixels around
+/// them, and each pixel is then blended with its filtered depth in the previous frame unless it
+/// moved further than a motion threshold. The frame is processed in bands of rows, each filtered
+/// horizontally into a buffer of its own and then vertically while the band is in the cache.
+/// </summary>
+class KinectFusionDepthFilter
+{
+    // Rows in each band processed by a task
+    static const unsigned int   cBandRows = 16;
+
+public:
+    // The largest kernel radius, in pixels
+    static const unsigned int   cMaxRadius = 4;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionDepthFilter();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionDepthFilter();
+
+    /// <summary>
+    /// Filter a depth float frame in place.
+    /// </summary>
+    /// <param name="pDepthFloatFrame">The depth float frame, with zero where there is no depth.</param>
+    /// <param name="radius">The radius of the spatial kernel in pixels, between 1 and cMaxRadius.</param>
+    /// <param name="rangeThreshold">The depth difference in meters at which a neighbor no longer
+    /// contributes to a pixel. Holes are only filled from neighbors within it of each other.</param>
+    /// <param name="temporalWeight">The weight of the new depth when it is blended with the
+    /// previous frame, between 0 and 1. 1 turns the temporal smoothing off.</param>
+    /// <param name="motionThreshold">The depth change in meters above which a pixel takes the new
+    /// depth rather than a blend with the previous frame.</param>
+    /// <param name="fillHoles">Whether to fill small holes.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Filter(
+        const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+        unsigned int radius,
+        float rangeThreshold,
+        float temporalWeight,
+        float motionThreshold,
+        bool fillHoles);
+
+    /// <summary>
+    /// Forget the previous frame, so the next frame is not blended with it.
+    /// </summary>
+    void                        ResetHistory()
+    {
+        m_bHistoryValid = false;
+    }
+
+private:
+    // Rows of the band buffers: the band, the rows the vertical pass reads above and below it,
+    // and a row the vertical pass writes to
+    static const unsigned int   cBandBufferRows = cBandRows + (2 * cMaxRadius) + 1;
+
+    /// <summary>
+    /// Filter the rows of a band.
+    /// </summary>
+    /// <param name="pSrc">The source frame pixels.</param>
+    /// <param name="srcPitch">The source row pitch in bytes.</param>
+    /// <param name="band">The band.</param>
+    void                        FilterBand(const BYTE *pSrc, unsigned int srcPitch, unsigned int band);
+
+    unsigned int                m_width;
+    unsigned int                m_height;
+    unsigned int                m_radius;
+    float                       m_rangeThreshold;
+    float                       m_temporalWeight;
+    float                       m_motionThreshold;
+    bool                        m_bFillHoles;
+    float                       m_spatialWeights[cMaxRadius + 1];
+
+    // The filtered depth of the last frame, which is also where each frame is filtered to
+    std::vector<float>          m_history;
+    bool                        m_bHistoryValid;
+
+    // The horizontally filtered rows of each band
+    std::vector<float>          m_bandBuffers;
+};
@@ -20,12 +20,15 @@
 
 // System includes
 #include "stdafx.h"
+#include <shellapi.h>
 
 // Project includes
 #include "resource.h"
 #include "KinectFusionExplorer.h"
 #include "KinectFusionProcessorFrame.h"
 #include "KinectFusionHelper.h"
+#include "KinectFusionTiledVolume.h"
+#include "KinectFusionDepthFilter.h"
 
 #define MIN_DEPTH_DISTANCE_MM 350   // Must be greater than 0
 #define MAX_DEPTH_DISTANCE_MM 8000
@@ -46,6 +49,7 @@
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
 {
     CKinectFusionExplorer application;
+    application.ParseCommandLine(lpCmdLine);
     application.Run(hInstance, nCmdShow);
 }
 
@@ -60,6 +64,7 @@ m_hWnd(nullptr),
     m_pDrawDepth(nullptr),
     m_bSavingMesh(false),
     m_saveMeshFormat(Stl),
+    m_bBenchmarkVisualization(false),
     m_bInitializeError(false),
     m_pSensorChooserUI(nullptr),
     m_bColorCaptured(false),
@@ -88,6 +93,152 @@ CKinectFusionExplorer::~CKinectFusionExplorer()
     SafeRelease(m_pD2DFactory);
 }
 
+/// <summary>
+/// Parses the command line options:
+///   /replay <file>  process a recorded session in place of a sensor
+///   /fast           replay as fast as possible rather than in real time
+///   /exit           close the application once the replay finishes
+///   /record <file>  record the sensor streams to a file
+///   /visualization scalar|lookup|avx2
+///                   how the depth, residual and native volume surface images are converted
+///   /benchmark      time the image conversions on each path, the color to depth remap and the
+///                   keyframe database before processing starts, and with /replay, the
+///                   integration of the session into the native CPU volume on 1, 2, 4 and so on
+///                   cores
+///   /trace <file>   write the timings of each processing stage to a .csv or .json file
+///   /keyframes <file>
+///                   load the camera pose finder key frames from a file, and save them on exit
+///   /checkpoint <file>
+///                   resume the native volume scan from a snapshot file, and save snapshots to it
+///                   in the background and on exit
+///   /checkpointinterval <seconds>
+///                   the time between background snapshots, 60 seconds by default
+///   /tiles <count>  split the native volume into tiles integrated and raycast by a worker each
+///   /rolling        shift the native volume to follow the camera, storing the voxels left behind
+///   /rollingdistance <meters>
+///                   how far the camera moves before the volume is shifted, 0.25m by default
+///   /filterdepth    smooth the depth spatially and over time and fill small holes before
+///                   tracking and integration
+///   /filterradius <pixels>
+///                   the radius of the depth filter kernel, from 1 to 4, 2 by default
+/// </summary>
+/// <param name="lpCmdLine">the command line, excluding the program name</param>
+void CKinectFusionExplorer::ParseCommandLine(LPCWSTR lpCmdLine)
+{
+    if (nullptr == lpCmdLine || L'\0' == lpCmdLine[0])
+    {
+        return;
+    }
+
+    int argc = 0;
+    LPWSTR *argv = CommandLineToArgvW(lpCmdLine, &argc);
+    if (nullptr == argv)
+    {
+        return;
+    }
+
+    for (int i = 0; i < argc; ++i)
+    {
+        LPCWSTR szOption = argv[i];
+        if (L'/' != szOption[0] && L'-' != szOption[0])
+        {
+            continue;
+        }
+        ++szOption;
+
+        if (0 == _wcsicmp(szOption, L"replay") && i + 1 < argc)
+        {
+            wcscpy_s(m_params.m_szReplayFile, ARRAYSIZE(m_params.m_szReplayFile), argv[++i]);
+        }
+        else if (0 == _wcsicmp(szOption, L"record") && i + 1 < argc)
+        {
+            wcscpy_s(m_params.m_szRecordFile, ARRAYSIZE(m_params.m_szRecordFile), argv[++i]);
+        }
+        else if (0 == _wcsicmp(szOption, L"trace") && i + 1 < argc)
+        {
+            wcscpy_s(m_params.m_szTraceFile, ARRAYSIZE(m_params.m_szTraceFile), argv[++i]);
+        }
+        else if (0 == _wcsicmp(szOption, L"keyframes") && i + 1 < argc)
+        {
+            wcscpy_s(m_params.m_szKeyframeFile, ARRAYSIZE(m_params.m_szKeyframeFile), argv[++i]);
+        }
+        else if (0 == _wcsicmp(szOption, L"checkpoint") && i + 1 < argc)
+        {
+            wcscpy_s(m_params.m_szCheckpointFile, ARRAYSIZE(m_params.m_szCheckpointFile), argv[++i]);
+        }
+        else if (0 == _wcsicmp(szOption, L"checkpointinterval") && i + 1 < argc)
+        {
+            int seconds = _wtoi(argv[++i]);
+            if (seconds > 0)
+            {
+                m_params.m_cCheckpointIntervalSeconds = static_cast<unsigned int>(seconds);
+            }
+        }
+        else if (0 == _wcsicmp(szOption, L"tiles") && i + 1 < argc)
+        {
+            int tiles = _wtoi(argv[++i]);
+            if (tiles > 0)
+            {
+                m_params.m_cVolumeTiles = min(static_cast<unsigned int>(tiles), KinectFusionTiledVolume::cMaxTiles);
+            }
+        }
+        else if (0 == _wcsicmp(szOption, L"rolling"))
+        {
+            m_params.m_bRollingVolume = true;
+        }
+        else if (0 == _wcsicmp(szOption, L"rollingdistance") && i + 1 < argc)
+        {
+            float distance = static_cast<float>(_wtof(argv[++i]));
+            if (distance > 0.0f)
+            {
+                m_params.m_fRollingVolumeShiftDistance = distance;
+            }
+        }
+        else if (0 == _wcsicmp(szOption, L"filterdepth"))
+        {
+            m_params.m_bFilterDepth = true;
+        }
+        else if (0 == _wcsicmp(szOption, L"filterradius") && i + 1 < argc)
+        {
+            int radius = _wtoi(argv[++i]);
+            if (radius > 0)
+            {
+                m_params.m_cDepthFilterRadius = min(static_cast<unsigned int>(radius), KinectFusionDepthFilter::cMaxRadius);
+            }
+        }
+        else if (0 == _wcsicmp(szOption, L"fast"))
+        {
+            m_params.m_bReplayRealTime = false;
+        }
+        else if (0 == _wcsicmp(szOption, L"exit"))
+        {
+            m_params.m_bExitAfterReplay = true;
+        }
+        else if (0 == _wcsicmp(szOption, L"visualization") && i + 1 < argc)
+        {
+            LPCWSTR szPath = argv[++i];
+            if (0 == _wcsicmp(szPath, L"scalar"))
+            {
+                m_params.m_visualizationPath = VisualizationScalar;
+            }
+            else if (0 == _wcsicmp(szPath, L"lookup"))
+            {
+                m_params.m_visualizationPath = VisualizationLookup;
+            }
+            else if (0 == _wcsicmp(szPath, L"avx2"))
+            {
+                m_params.m_visualizationPath = VisualizationAvx2;
+            }
+        }
+        else if (0 == _wcsicmp(szOption, L"benchmark"))
+        {
+            m_bBenchmarkVisualization = true;
+        }
+    }
+
+    LocalFree(argv);
+}
+
 /// <summary>
 /// Creates the main window and begins processing
 /// </summary>
@@ -249,6 +400,18 @@ LRESULT CALLBACK CKinectFusionExplorer::DlgProc(
                 m_bInitializeError = true;
             }
 
+            if (m_bBenchmarkVisualization)
+            {
+                ReportVisualizationBenchmark();
+                ReportKeyframeDatabaseBenchmark();
+                ReportColorRemapBenchmark();
+
+                if (L'\0' != m_params.m_szReplayFile[0])
+                {
+                    ReportIntegrationBenchmark();
+                }
+            }
+
             if (FAILED(m_processor.SetWindow(m_hWnd, WM_FRAMEREADY, WM_UPDATESENSORSTATUS)) ||
                 FAILED(m_processor.SetParams(m_params)) ||
                 FAILED(m_processor.StartProcessing()))
@@ -478,7 +641,8 @@ HRESULT CKinectFusionExplorer::SaveMeshFile(INuiFusionColorMesh* pMesh, KinectFu
                     else if (Ply == saveMeshType)
                     {
                         COMDLG_FILTERSPEC allPossibleFileTypes[] = {
-                            { L"Ply mesh files", L"*.ply" },
+                            { L"Binary Ply mesh files", L"*.ply" },
+                            { L"ASCII Ply mesh files", L"*.ply" },
                             { L"All files", L"*.*" }
                         };
 
@@ -512,13 +676,31 @@ HRESULT CKinectFusionExplorer::SaveMeshFile(INuiFusionColorMesh* pMesh, KinectFu
                                     {
                                         hr = WriteBinarySTLMeshFile(pMesh, pwsz);
                                     }
-                                    else if (Obj == saveMeshType)
-                                    {
-                                        hr = WriteAsciiObjMeshFile(pMesh, pwsz);
-                                    }
-                                    else if (Ply == saveMeshType)
+                                    else
                                     {
-                                        hr = WriteAsciiPlyMeshFile(pMesh, pwsz, true, m_bColorCaptured);
+                                        // Obj and Ply meshes share vertices between triangles
+                                        KinectFusionIndexedMesh indexedMesh;
+                                        hr = WeldMeshVertices(pMesh, m_params.m_fMeshWeldTolerance, &indexedMesh);
+
+                                        if (SUCCEEDED(hr) && Obj == saveMeshType)
+                                        {
+                                            hr = WriteAsciiObjMeshFile(indexedMesh, pwsz);
+                                        }
+                                        else if (SUCCEEDED(hr) && Ply == saveMeshType)
+                                        {
+                                            // Binary is the first file type, and the default
+                                            UINT fileTypeIndex = 1;
+                                            pSaveDlg->GetFileTypeIndex(&fileTypeIndex);
+
+                                            if (2 == fileTypeIndex)
+                                            {
+                                                hr = WriteAsciiPlyMeshFile(indexedMesh, pwsz, true, m_bColorCaptured);
+                                            }
+                                            else
+                                            {
+                                                hr = WriteBinaryPlyMeshFile(indexedMesh, pwsz, true, m_bColorCaptured);
+                                            }
+                                        }
                                     }
 
                                     CoTaskMemFree(pwsz);
@@ -787,14 +969,23 @@ void CKinectFusionExplorer::ProcessUI(WPARAM wParam, LPARAM lParam)
         m_processor.SetParams(m_params);
 
         INuiFusionColorMesh *mesh = nullptr;
-        HRESULT hr = m_processor.CalculateMesh(&mesh);
+        KinectFusionMeshStatistics meshStatistics;
+        HRESULT hr = m_processor.CalculateMesh(&mesh, &meshStatistics);
 
         if (SUCCEEDED(hr))
         {
             // Save mesh
             hr = SaveMeshFile(mesh, m_saveMeshFormat);
 
-            if (SUCCEEDED(hr))
+            if (SUCCEEDED(hr) && meshStatistics.surfaceBlocks > 0)
+            {
+                // Native volumes report how much of the mesh was extracted again
+                WCHAR str[MAX_PATH];
+                swprintf_s(str, ARRAYSIZE(str), L"Saved Kinect Fusion mesh. Re-meshed %u blocks in %.0fms, %u blocks with surface.",
+                    meshStatistics.remeshedBlocks, meshStatistics.extractionTime * 1000.0, meshStatistics.surfaceBlocks);
+                SetStatusMessage(str);
+            }
+            else if (SUCCEEDED(hr))
             {
                 SetStatusMessage(L"Saved Kinect Fusion mesh.");
             }
@@ -962,6 +1153,136 @@ void CKinectFusionExplorer::UpdateHSliders()
     m_processor.SetParams(m_params);
 }
 
+/// <summary>
+/// Time the image conversions on each visualization path and show the times
+/// </summary>
+void CKinectFusionExplorer::ReportVisualizationBenchmark()
+{
+    const unsigned int cIterations = 200;
+    static const WCHAR* pathNames[VisualizationPathCount] = { L"Scalar", L"Lookup", L"AVX2" };
+
+    KinectFusionVisualizationBenchmark results;
+    HRESULT hr = m_processor.BenchmarkVisualization(m_params.m_cDepthWidth, m_params.m_cDepthHeight, cIterations, &results);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Failed to benchmark the visualization paths.");
+        return;
+    }
+
+    WCHAR report[512];
+    int length = swprintf_s(report, ARRAYSIZE(report), L"Milliseconds per %ux%u image\n\nPath\tDepth\tResidual\tShade\n",
+        results.width, results.height);
+
+    for (int path = 0; path < VisualizationPathCount && length > 0; ++path)
+    {
+        int written = (results.depthTime[path] < 0.0)
+            ? swprintf_s(report + length, ARRAYSIZE(report) - length, L"%s\tnot supported\n", pathNames[path])
+            : swprintf_s(report + length, ARRAYSIZE(report) - length, L"%s\t%.3f\t%.3f\t%.3f\n", pathNames[path],
+                results.depthTime[path], results.residualTime[path], results.shadeTime[path]);
+
+        length = (written > 0) ? length + written : -1;
+    }
+
+    MessageBoxW(m_hWnd, report, L"Visualization Benchmark", MB_OK | MB_ICONINFORMATION);
+}
+
+/// <summary>
+/// Time saving, loading and querying a keyframe database and show the times
+/// </summary>
+void CKinectFusionExplorer::ReportKeyframeDatabaseBenchmark()
+{
+    const unsigned int cKeyframes = 10000;
+
+    KinectFusionKeyframeBenchmark results;
+    HRESULT hr = m_processor.BenchmarkKeyframeDatabase(cKeyframes, &results);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Failed to benchmark the keyframe database.");
+        return;
+    }
+
+    WCHAR report[256];
+    swprintf_s(report, ARRAYSIZE(report), L"%u key frames, %I64u bytes\n\nSave\t%.3f ms\nLoad\t%.3f ms\nQuery\t%.3f ms\n",
+        results.keyframes, results.cbFile, results.saveTime, results.loadTime, results.queryTime);
+
+    MessageBoxW(m_hWnd, report, L"Keyframe Database Benchmark", MB_OK | MB_ICONINFORMATION);
+}
+
+/// <summary>
+/// Time the color to depth remap at 640x480 and 320x240 depth and show the times
+/// </summary>
+void CKinectFusionExplorer::ReportColorRemapBenchmark()
+{
+    const unsigned int cIterations = 200;
+    static const UINT depthSizes[][2] = { { 640, 480 }, { 320, 240 } };
+    static const WCHAR* pathNames[NuiColorToDepthRemapBenchmark::PathCount] = { L"Scalar", L"SSE2", L"AVX2" };
+
+    WCHAR report[512];
+    int length = swprintf_s(report, ARRAYSIZE(report), L"Milliseconds per frame from 640x480 color\n");
+
+    for (UINT size = 0; size < ARRAYSIZE(depthSizes) && length > 0; ++size)
+    {
+        NuiColorToDepthRemapBenchmark results;
+        HRESULT hr = NuiColorToDepthRemap::Benchmark(depthSizes[size][0], depthSizes[size][1], 640, 480, cIterations, &results);
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Failed to benchmark the color to depth remap.");
+            return;
+        }
+
+        int written = swprintf_s(report + length, ARRAYSIZE(report) - length, L"\n%ux%u depth\nRebuild table\t%.3f\nTable still valid\t%.3f\n",
+            results.depthWidth, results.depthHeight, results.rebuildTime, results.cachedTime);
+
+        length = (written > 0) ? length + written : -1;
+
+        for (int path = 0; path < NuiColorToDepthRemapBenchmark::PathCount && length > 0; ++path)
+        {
+            written = (results.applyTime[path] < 0.0)
+                ? swprintf_s(report + length, ARRAYSIZE(report) - length, L"Apply %s\tnot supported\n", pathNames[path])
+                : swprintf_s(report + length, ARRAYSIZE(report) - length, L"Apply %s\t%.3f\n", pathNames[path], results.applyTime[path]);
+
+            length = (written > 0) ? length + written : -1;
+        }
+    }
+
+    MessageBoxW(m_hWnd, report, L"Color Remap Benchmark", MB_OK | MB_ICONINFORMATION);
+}
+
+/// <summary>
+/// Time the integration of the replayed session into the native CPU volume by number of cores
+/// and show the times
+/// </summary>
+void CKinectFusionExplorer::ReportIntegrationBenchmark()
+{
+    const unsigned int cMaxFrames = 100;
+
+    KinectFusionIntegrationBenchmark results;
+    HRESULT hr = m_processor.BenchmarkIntegration(m_params, cMaxFrames, &results);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Failed to benchmark the integration of the recorded session.");
+        return;
+    }
+
+    WCHAR report[512];
+    int length = swprintf_s(report, ARRAYSIZE(report), L"%u frames into %ux%ux%u voxels\n\nCores\tms/frame\tSpeedup\n",
+        results.frames,
+        m_params.m_reconstructionParams.voxelCountX,
+        m_params.m_reconstructionParams.voxelCountY,
+        m_params.m_reconstructionParams.voxelCountZ);
+
+    for (unsigned int i = 0; i < results.coreCounts && length > 0; ++i)
+    {
+        int written = swprintf_s(report + length, ARRAYSIZE(report) - length, L"%u\t%.2f\t%.2fx\n",
+            results.cores[i], results.integrationTime[i],
+            (results.integrationTime[i] > 0.0) ? results.integrationTime[0] / results.integrationTime[i] : 0.0);
+
+        length = (written > 0) ? length + written : -1;
+    }
+
+    MessageBoxW(m_hWnd, report, L"Integration Benchmark", MB_OK | MB_ICONINFORMATION);
+}
+
 /// <summary>
 /// Set the status bar message
 /// </summary>
@@ -63,6 +63,12 @@ public:
     /// <returns>result of message processing</returns>
     LRESULT CALLBACK            DlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
+    /// <summary>
+    /// Parses the replay and recording options from the command line
+    /// </summary>
+    /// <param name="lpCmdLine">the command line</param>
+    void                        ParseCommandLine(LPCWSTR lpCmdLine);
+
     /// <summary>
     /// Creates the main window and begins processing
     /// </summary>
@@ -119,6 +125,27 @@ private:
     /// <param name="szMessage">message to display</param>
     void                        SetStatusMessage(const WCHAR* szMessage);
 
+    /// <summary>
+    /// Time the image conversions on each visualization path and show the times
+    /// </summary>
+    void                        ReportVisualizationBenchmark();
+
+    /// <summary>
+    /// Time saving, loading and querying a keyframe database and show the times
+    /// </summary>
+    void                        ReportKeyframeDatabaseBenchmark();
+
+    /// <summary>
+    /// Time the color to depth remap at 640x480 and 320x240 depth and show the times
+    /// </summary>
+    void                        ReportColorRemapBenchmark();
+
+    /// <summary>
+    /// Time the integration of the replayed session into the native CPU volume by number of
+    /// cores and show the times
+    /// </summary>
+    void                        ReportIntegrationBenchmark();
+
     /// <summary>
     /// Set the frames-per-second message
     /// </summary>
@@ -146,6 +173,7 @@ private:
     bool                        m_bSavingMesh;
     KinectFusionMeshTypes       m_saveMeshFormat;
     bool                        m_bColorCaptured;
+    bool                        m_bBenchmarkVisualization;
 
     /// <summary>
     /// Most recently reported frame rate
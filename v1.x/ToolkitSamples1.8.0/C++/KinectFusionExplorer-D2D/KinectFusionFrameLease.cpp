@@ -0,0 +1,269 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionFrameLease.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+
+#include <new>
+#include "KinectFusionFrameLease.h"
+
+namespace
+{
+    /// <summary>
+    /// Lease of a sensor frame, whose texture stays locked while leased.
+    /// </summary>
+    class SensorFrameLease : public KinectFusionFrameLease
+    {
+    public:
+        SensorFrameLease(
+            INuiSensor *pNuiSensor,
+            HANDLE hStream,
+            const NUI_IMAGE_FRAME &imageFrame,
+            INuiFrameTexture *pTexture,
+            const NUI_LOCKED_RECT &lockedRect) :
+            KinectFusionFrameLease(lockedRect.pBits, static_cast<UINT>(lockedRect.size), static_cast<UINT>(lockedRect.Pitch)),
+            m_pNuiSensor(pNuiSensor),
+            m_hStream(hStream),
+            m_imageFrame(imageFrame),
+            m_pTexture(pTexture)
+        {
+            m_pNuiSensor->AddRef();
+        }
+
+    protected:
+        ~SensorFrameLease()
+        {
+            m_pTexture->UnlockRect(0);
+            m_pNuiSensor->NuiImageStreamReleaseFrame(m_hStream, &m_imageFrame);
+            m_pNuiSensor->Release();
+        }
+
+    private:
+        INuiSensor*             m_pNuiSensor;
+        HANDLE                  m_hStream;
+        NUI_IMAGE_FRAME         m_imageFrame;
+        INuiFrameTexture*       m_pTexture;
+    };
+
+    /// <summary>
+    /// Lease of memory owned elsewhere.
+    /// </summary>
+    class MemoryLease : public KinectFusionFrameLease
+    {
+    public:
+        MemoryLease(const BYTE *pPixels, UINT cbPixels, UINT pitch) :
+            KinectFusionFrameLease(pPixels, cbPixels, pitch)
+        {
+        }
+    };
+
+    /// <summary>
+    /// Lease of a pooled buffer.
+    /// </summary>
+    class PooledBufferLease : public KinectFusionFrameLease
+    {
+    public:
+        PooledBufferLease(NuiFrameBuffer *pBuffer, UINT pitch) :
+            KinectFusionFrameLease(pBuffer->GetData(), pBuffer->GetSize(), pitch),
+            m_pBuffer(pBuffer)
+        {
+        }
+
+    protected:
+        ~PooledBufferLease()
+        {
+            m_pBuffer->Release();
+        }
+
+    private:
+        NuiFrameBuffer*         m_pBuffer;
+    };
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionFrameLease::KinectFusionFrameLease(const BYTE *pPixels, UINT cbPixels, UINT pitch) :
+    m_pPixels(pPixels),
+    m_cbPixels(cbPixels),
+    m_pitch(pitch),
+    m_cRef(1)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionFrameLease::~KinectFusionFrameLease()
+{
+}
+
+/// <summary>
+/// Add a reference to the lease
+/// </summary>
+ULONG KinectFusionFrameLease::AddRef()
+{
+    return static_cast<ULONG>(InterlockedIncrement(&m_cRef));
+}
+
+/// <summary>
+/// Release a reference, ending the lease when it was the last
+/// </summary>
+ULONG KinectFusionFrameLease::Release()
+{
+    ULONG cRef = static_cast<ULONG>(InterlockedDecrement(&m_cRef));
+    if (0 == cRef)
+    {
+        delete this;
+    }
+
+    return cRef;
+}
+
+/// <summary>
+/// Lease a locked sensor frame
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionFrameLease::CreateFromSensorFrame(
+    INuiSensor *pNuiSensor,
+    HANDLE hStream,
+    const NUI_IMAGE_FRAME &imageFrame,
+    INuiFrameTexture *pTexture,
+    KinectFusionFrameLease **ppLease)
+{
+    if (nullptr == pNuiSensor || nullptr == ppLease)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ppLease = nullptr;
+
+    NUI_IMAGE_FRAME frame = imageFrame;
+    NUI_LOCKED_RECT lockedRect;
+
+    HRESULT hr = E_INVALIDARG;
+    if (nullptr != pTexture)
+    {
+        hr = pTexture->LockRect(0, &lockedRect, nullptr, 0);
+    }
+
+    if (SUCCEEDED(hr) && 0 == lockedRect.Pitch)
+    {
+        pTexture->UnlockRect(0);
+        hr = E_FAIL;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppLease = new(std::nothrow) SensorFrameLease(pNuiSensor, hStream, frame, pTexture, lockedRect);
+        if (nullptr == *ppLease)
+        {
+            pTexture->UnlockRect(0);
+            hr = E_OUTOFMEMORY;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        pNuiSensor->NuiImageStreamReleaseFrame(hStream, &frame);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Lease memory owned elsewhere
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionFrameLease::CreateFromMemory(
+    const BYTE *pPixels,
+    UINT cbPixels,
+    UINT pitch,
+    KinectFusionFrameLease **ppLease)
+{
+    if (nullptr == pPixels || nullptr == ppLease)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ppLease = new(std::nothrow) MemoryLease(pPixels, cbPixels, pitch);
+
+    return nullptr != *ppLease ? S_OK : E_OUTOFMEMORY;
+}
+
+/// <summary>
+/// Lease a buffer from a pool
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionFrameLease::CreateFromPool(
+    KinectFusionBufferPool *pPool,
+    UINT pitch,
+    KinectFusionFrameLease **ppLease,
+    BYTE **ppBuffer)
+{
+    if (nullptr == pPool || nullptr == ppLease || nullptr == ppBuffer)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ppLease = nullptr;
+    *ppBuffer = nullptr;
+
+    NuiFrameBuffer *pBuffer = nullptr;
+    HRESULT hr = pPool->Acquire(&pBuffer);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    *ppLease = new(std::nothrow) PooledBufferLease(pBuffer, pitch);
+    if (nullptr == *ppLease)
+    {
+        pBuffer->Release();
+        return E_OUTOFMEMORY;
+    }
+
+    *ppBuffer = pBuffer->GetData();
+
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionBufferPool::KinectFusionBufferPool() :
+    m_pSharedPool(NuiFrameBufferPool::GetShared()),
+    m_cbBuffer(0)
+{
+}
+
+/// <summary>
+/// Take a buffer of the current size from the shared pool
+/// </summary>
+/// <param name="ppBuffer">Returns the buffer with one reference.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionBufferPool::Acquire(NuiFrameBuffer **ppBuffer)
+{
+    if (nullptr == m_pSharedPool)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return m_pSharedPool->Acquire(m_cbBuffer, ppBuffer);
+}
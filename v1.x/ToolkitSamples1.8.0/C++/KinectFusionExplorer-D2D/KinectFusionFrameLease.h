@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionFrameLease.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <NuiApi.h>
+#include <NuiFrameBufferPool.h>
+
+class KinectFusionBufferPool;
+
+/// <summary>
+/// A reference counted lease on the pixels of an image frame. The processor works directly on
+/// the leased pixels, and whatever holds them (a locked sensor frame, a mapped recording, or a
+/// pooled buffer) is given back when the last reference is released.
+/// </summary>
+class KinectFusionFrameLease
+{
+public:
+    /// <summary>
+    /// Lease a locked sensor frame. The frame is returned to its stream when the lease is released.
+    /// On failure the frame is returned to its stream immediately.
+    /// </summary>
+    /// <param name="pNuiSensor">The sensor which owns the stream.</param>
+    /// <param name="hStream">The stream the frame came from.</param>
+    /// <param name="imageFrame">The frame to lease.</param>
+    /// <param name="pTexture">The texture of the frame holding the pixels to lease.</param>
+    /// <param name="ppLease">Returns the lease.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT              CreateFromSensorFrame(
+                                    INuiSensor *pNuiSensor,
+                                    HANDLE hStream,
+                                    const NUI_IMAGE_FRAME &imageFrame,
+                                    INuiFrameTexture *pTexture,
+                                    KinectFusionFrameLease **ppLease);
+
+    /// <summary>
+    /// Lease memory owned elsewhere, which must stay valid until the lease is released.
+    /// </summary>
+    /// <param name="pPixels">The pixels to lease.</param>
+    /// <param name="cbPixels">The size of the pixels in bytes.</param>
+    /// <param name="pitch">The size of a row of pixels in bytes.</param>
+    /// <param name="ppLease">Returns the lease.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT              CreateFromMemory(
+                                    const BYTE *pPixels,
+                                    UINT cbPixels,
+                                    UINT pitch,
+                                    KinectFusionFrameLease **ppLease);
+
+    /// <summary>
+    /// Lease a buffer from a pool. The buffer goes back to the shared frame buffer pool when the
+    /// lease is released, so the lease may outlive the pool it was taken from.
+    /// </summary>
+    /// <param name="pPool">The pool to take the buffer from.</param>
+    /// <param name="pitch">The size of a row of pixels in bytes.</param>
+    /// <param name="ppLease">Returns the lease.</param>
+    /// <param name="ppBuffer">Returns the buffer, to be filled before the lease is used.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT              CreateFromPool(
+                                    KinectFusionBufferPool *pPool,
+                                    UINT pitch,
+                                    KinectFusionFrameLease **ppLease,
+                                    BYTE **ppBuffer);
+
+    /// <summary>
+    /// Add a reference to the lease.
+    /// </summary>
+    ULONG                       AddRef();
+
+    /// <summary>
+    /// Release a reference, ending the lease when it was the last.
+    /// </summary>
+    ULONG                       Release();
+
+    const BYTE*                 GetPixels() const { return m_pPixels; }
+    UINT                        GetSize() const { return m_cbPixels; }
+    UINT                        GetPitch() const { return m_pitch; }
+
+protected:
+    KinectFusionFrameLease(const BYTE *pPixels, UINT cbPixels, UINT pitch);
+    virtual ~KinectFusionFrameLease();
+
+    const BYTE*                 m_pPixels;
+    UINT                        m_cbPixels;
+    UINT                        m_pitch;
+
+private:
+    // Leases are not copyable
+    KinectFusionFrameLease(const KinectFusionFrameLease&);
+    KinectFusionFrameLease& operator=(const KinectFusionFrameLease&);
+
+    volatile LONG               m_cRef;
+};
+
+/// <summary>
+/// The buffers of one size, reused for the frames which cannot be leased in place. The buffers
+/// come from the frame buffer pool shared with the other streams, so a depth resolution change
+/// reuses buffers of the new size class instead of freeing and reallocating.
+/// </summary>
+class KinectFusionBufferPool
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionBufferPool();
+
+    /// <summary>
+    /// Set the size of the buffers.
+    /// </summary>
+    /// <param name="cbBuffer">The size of each buffer in bytes.</param>
+    void                        SetBufferSize(UINT cbBuffer) { m_cbBuffer = cbBuffer; }
+
+    /// <summary>
+    /// Take a buffer of the current size from the shared pool.
+    /// </summary>
+    /// <param name="ppBuffer">Returns the buffer with one reference.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Acquire(NuiFrameBuffer **ppBuffer);
+
+    UINT                        GetBufferSize() const { return m_cbBuffer; }
+
+private:
+    NuiFrameBufferPool*         m_pSharedPool;
+    UINT                        m_cbBuffer;
+};
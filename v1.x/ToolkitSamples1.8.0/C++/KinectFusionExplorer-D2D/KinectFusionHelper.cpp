@@ -24,8 +24,10 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <vector>
+#include <new>
 #include <stdio.h>
 #include <string.h>
+#include <emmintrin.h>
 
 #pragma warning(push)
 #pragma warning(disable:6255)
@@ -36,6 +38,7 @@
 
 // Project includes
 #include "KinectFusionHelper.h"
+#include "KinectFusionReduction.h"
 
 /// <summary>
 /// Set Identity in a Matrix4
@@ -277,6 +280,268 @@ Matrix4 InvertMatrix4Pose(const Matrix4 &transform)
     return invRotation;
 }
 
+/// <summary>
+/// Invert a Matrix4 affine transformation with an arbitrary (e.g. scaled) 3x3 component,
+/// such as the world to volume transform.
+/// </summary>
+/// <param name="transform">The affine transform matrix.</param>
+/// <returns>Returns a Matrix4 containing the inverted transform.</returns>
+Matrix4 InvertMatrix4Affine(const Matrix4 &transform)
+{
+    const Matrix4 &m = transform;
+
+    Matrix4 inverse;
+    SetIdentityMatrix(inverse);
+
+    // Invert the 3x3 component as its adjugate divided by its determinant
+    float c11 = (m.M22 * m.M33) - (m.M23 * m.M32);
+    float c12 = (m.M23 * m.M31) - (m.M21 * m.M33);
+    float c13 = (m.M21 * m.M32) - (m.M22 * m.M31);
+
+    float determinant = (m.M11 * c11) + (m.M12 * c12) + (m.M13 * c13);
+
+    if (0.0f == determinant)
+    {
+        // Singular transform, return identity
+        return inverse;
+    }
+
+    float oneOverDeterminant = 1.0f / determinant;
+
+    inverse.M11 = c11 * oneOverDeterminant;
+    inverse.M12 = ((m.M13 * m.M32) - (m.M12 * m.M33)) * oneOverDeterminant;
+    inverse.M13 = ((m.M12 * m.M23) - (m.M13 * m.M22)) * oneOverDeterminant;
+
+    inverse.M21 = c12 * oneOverDeterminant;
+    inverse.M22 = ((m.M11 * m.M33) - (m.M13 * m.M31)) * oneOverDeterminant;
+    inverse.M23 = ((m.M13 * m.M21) - (m.M11 * m.M23)) * oneOverDeterminant;
+
+    inverse.M31 = c13 * oneOverDeterminant;
+    inverse.M32 = ((m.M12 * m.M31) - (m.M11 * m.M32)) * oneOverDeterminant;
+    inverse.M33 = ((m.M11 * m.M22) - (m.M12 * m.M21)) * oneOverDeterminant;
+
+    // The inverse translation is the negated translation transformed by the inverse 3x3 component
+    inverse.M41 = -((m.M41 * inverse.M11) + (m.M42 * inverse.M21) + (m.M43 * inverse.M31));
+    inverse.M42 = -((m.M41 * inverse.M12) + (m.M42 * inverse.M22) + (m.M43 * inverse.M32));
+    inverse.M43 = -((m.M41 * inverse.M13) + (m.M42 * inverse.M23) + (m.M43 * inverse.M33));
+
+    return inverse;
+}
+
+/// <summary>
+/// Concatenate two Matrix4 transformations. As points are transformed as row vectors, the
+/// resulting transform applies the first transform followed by the second.
+/// </summary>
+/// <param name="first">The first transform to apply.</param>
+/// <param name="second">The second transform to apply.</param>
+/// <returns>Returns a Matrix4 containing the concatenated transform.</returns>
+Matrix4 MultiplyMatrix4(const Matrix4 &first, const Matrix4 &second)
+{
+    const Matrix4 &a = first;
+    const Matrix4 &b = second;
+    Matrix4 result;
+
+    result.M11 = (a.M11 * b.M11) + (a.M12 * b.M21) + (a.M13 * b.M31) + (a.M14 * b.M41);
+    result.M12 = (a.M11 * b.M12) + (a.M12 * b.M22) + (a.M13 * b.M32) + (a.M14 * b.M42);
+    result.M13 = (a.M11 * b.M13) + (a.M12 * b.M23) + (a.M13 * b.M33) + (a.M14 * b.M43);
+    result.M14 = (a.M11 * b.M14) + (a.M12 * b.M24) + (a.M13 * b.M34) + (a.M14 * b.M44);
+
+    result.M21 = (a.M21 * b.M11) + (a.M22 * b.M21) + (a.M23 * b.M31) + (a.M24 * b.M41);
+    result.M22 = (a.M21 * b.M12) + (a.M22 * b.M22) + (a.M23 * b.M32) + (a.M24 * b.M42);
+    result.M23 = (a.M21 * b.M13) + (a.M22 * b.M23) + (a.M23 * b.M33) + (a.M24 * b.M43);
+    result.M24 = (a.M21 * b.M14) + (a.M22 * b.M24) + (a.M23 * b.M34) + (a.M24 * b.M44);
+
+    result.M31 = (a.M31 * b.M11) + (a.M32 * b.M21) + (a.M33 * b.M31) + (a.M34 * b.M41);
+    result.M32 = (a.M31 * b.M12) + (a.M32 * b.M22) + (a.M33 * b.M32) + (a.M34 * b.M42);
+    result.M33 = (a.M31 * b.M13) + (a.M32 * b.M23) + (a.M33 * b.M33) + (a.M34 * b.M43);
+    result.M34 = (a.M31 * b.M14) + (a.M32 * b.M24) + (a.M33 * b.M34) + (a.M34 * b.M44);
+
+    result.M41 = (a.M41 * b.M11) + (a.M42 * b.M21) + (a.M43 * b.M31) + (a.M44 * b.M41);
+    result.M42 = (a.M41 * b.M12) + (a.M42 * b.M22) + (a.M43 * b.M32) + (a.M44 * b.M42);
+    result.M43 = (a.M41 * b.M13) + (a.M42 * b.M23) + (a.M43 * b.M33) + (a.M44 * b.M43);
+    result.M44 = (a.M41 * b.M14) + (a.M42 * b.M24) + (a.M43 * b.M34) + (a.M44 * b.M44);
+
+    return result;
+}
+
+/// <summary>
+/// Meshes are written in batches: the elements (vertices, normals or faces) of a batch are
+/// transformed and packed into the blocks of a buffer in parallel, then the batch is written
+/// with a single fwrite, so saving costs a few large writes rather than several per triangle.
+/// </summary>
+static const unsigned int cMeshElementsPerBlock = 4096;
+static const unsigned int cMeshBatchBufferSize = 8 * 1024 * 1024;
+
+/// <summary>
+/// Upper bound on the size of one line of an ASCII mesh file, which holds at most 9 values.
+/// A float printed with %f takes at most 47 characters, and an unsigned int at most 10.
+/// </summary>
+static const unsigned int cMaxAsciiMeshLineSize = 9 * 48 + 8;
+
+/// <summary>
+/// Open a mesh file for writing
+/// </summary>
+/// <param name="lpOleFileName">The full path and filename of the file to open.</param>
+/// <param name="mode">The fopen mode to open the file with.</param>
+/// <param name="ppMeshFile">Returns the opened file.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+static HRESULT OpenMeshFile(LPOLESTR lpOleFileName, const char *mode, FILE **ppMeshFile)
+{
+    USES_CONVERSION;
+    char* pszFileName = NULL;
+
+    try
+    {
+        pszFileName = OLE2A(lpOleFileName);
+    }
+    catch (...)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ppMeshFile = NULL;
+    errno_t err = fopen_s(ppMeshFile, pszFileName, mode);
+
+    // Could not open file for writing - return
+    if (0 != err || NULL == *ppMeshFile)
+    {
+        return E_ACCESSDENIED;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Close a mesh file, flushing what remains to be written
+/// </summary>
+/// <param name="meshFile">The file to close.</param>
+/// <param name="hr">The result of writing the file so far.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+static HRESULT CloseMeshFile(FILE *meshFile, HRESULT hr)
+{
+    if (0 != fflush(meshFile) && SUCCEEDED(hr))
+    {
+        hr = E_FAIL;
+    }
+
+    if (0 != fclose(meshFile) && SUCCEEDED(hr))
+    {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Write a string to a mesh file
+/// </summary>
+/// <param name="meshFile">The file to write to.</param>
+/// <param name="text">The string to write.</param>
+/// <param name="length">The length of the string in characters.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+static HRESULT WriteMeshText(FILE *meshFile, const char *text, size_t length)
+{
+    return length == fwrite(text, sizeof(char), length, meshFile) ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Pack elements in parallel and write them to a mesh file in order.
+/// packElement(index, dest) packs element index to dest, and returns the number of bytes
+/// packed, which must not exceed maxElementSize.
+/// </summary>
+/// <param name="meshFile">The file to write to.</param>
+/// <param name="numElements">The number of elements to write.</param>
+/// <param name="maxElementSize">The largest size of a packed element in bytes.</param>
+/// <param name="packElement">The function packing an element.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+template <typename PackElement>
+static HRESULT WriteMeshElements(FILE *meshFile, unsigned int numElements, unsigned int maxElementSize, const PackElement &packElement)
+{
+    if (0 == numElements)
+    {
+        return S_OK;
+    }
+
+    const unsigned int blockCapacity = cMeshElementsPerBlock * maxElementSize;
+    const unsigned int numBlocks = (numElements + cMeshElementsPerBlock - 1) / cMeshElementsPerBlock;
+    const unsigned int blocksPerBatch = min(numBlocks, max(1u, cMeshBatchBufferSize / blockCapacity));
+
+    char *buffer = new(std::nothrow) char[blocksPerBatch * blockCapacity];
+    unsigned int *blockSizes = new(std::nothrow) unsigned int[blocksPerBatch];
+
+    if (nullptr == buffer || nullptr == blockSizes)
+    {
+        delete[] buffer;
+        delete[] blockSizes;
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = S_OK;
+
+    for (unsigned int firstBlock = 0; firstBlock < numBlocks && SUCCEEDED(hr); firstBlock += blocksPerBatch)
+    {
+        unsigned int batchBlocks = min(blocksPerBatch, numBlocks - firstBlock);
+
+        Concurrency::parallel_for(0u, batchBlocks, [&](unsigned int block)
+        {
+            unsigned int element = (firstBlock + block) * cMeshElementsPerBlock;
+            unsigned int endElement = min(element + cMeshElementsPerBlock, numElements);
+            char *dest = buffer + block * blockCapacity;
+            char *blockStart = dest;
+
+            for (; element < endElement; ++element)
+            {
+                dest += packElement(element, dest);
+            }
+
+            blockSizes[block] = static_cast<unsigned int>(dest - blockStart);
+        });
+
+        // Close the gaps left by blocks which packed less than their capacity
+        size_t batchSize = blockSizes[0];
+        for (unsigned int block = 1; block < batchBlocks; ++block)
+        {
+            if (batchSize != block * blockCapacity)
+            {
+                memmove(buffer + batchSize, buffer + block * blockCapacity, blockSizes[block]);
+            }
+
+            batchSize += blockSizes[block];
+        }
+
+        if (batchSize != fwrite(buffer, 1, batchSize, meshFile))
+        {
+            hr = E_FAIL;
+        }
+    }
+
+    delete[] buffer;
+    delete[] blockSizes;
+
+    return hr;
+}
+
+/// <summary>
+/// Copy a Vector3 to unaligned memory, optionally flipping the Y and Z values
+/// </summary>
+/// <param name="dest">The memory to copy to.</param>
+/// <param name="vector">The vector to copy.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped.</param>
+/// <returns>The number of bytes copied</returns>
+static inline unsigned int PackVector3(char *dest, const Vector3 &vector, bool flipYZ)
+{
+    Vector3 packed = vector;
+
+    if (flipYZ)
+    {
+        packed.y = -packed.y;
+        packed.z = -packed.z;
+    }
+
+    memcpy(dest, &packed, sizeof(packed));
+    return sizeof(packed);
+}
+
 /// <summary>
 /// Write Binary .STL file
 /// see http://en.wikipedia.org/wiki/STL_(file_format) for STL format
@@ -317,78 +582,109 @@ HRESULT WriteBinarySTLMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName
         return hr;
     }
 
-    const int *triangleIndices = NULL;
-    hr = mesh->GetTriangleIndices(&triangleIndices);
+    FILE *meshFile = NULL;
+    hr = OpenMeshFile(lpOleFileName, "wb", &meshFile);
     if (FAILED(hr))
     {
         return hr;
     }
 
-    // Open File
-    USES_CONVERSION;
-    char* pszFileName = NULL;
+    // Write the header line
+    const unsigned char header[80] = {0};   // initialize all values to 0
+    fwrite(&header, sizeof(unsigned char), ARRAYSIZE(header), meshFile);
 
-    try
-    {
-        pszFileName = OLE2A(lpOleFileName);
-    }
-    catch (...)
+    // Write number of triangles
+    fwrite(&numTriangles, sizeof(int), 1, meshFile);
+
+    // Each triangle is the normal, 3 vertices of the triangle and attribute
+    const unsigned int triangleSize = 4 * sizeof(Vector3) + sizeof(unsigned short);
+
+    hr = WriteMeshElements(meshFile, numTriangles, triangleSize, [=](unsigned int t, char *dest) -> unsigned int
     {
-        return E_INVALIDARG;
-    }
+        unsigned int vertexIndex = t * 3;
 
-    FILE *meshFile = NULL;
-    errno_t err = fopen_s(&meshFile, pszFileName, "wb");
+        dest += PackVector3(dest, normals[vertexIndex], flipYZ);
+        dest += PackVector3(dest, vertices[vertexIndex], flipYZ);
+        dest += PackVector3(dest, vertices[vertexIndex + 1], flipYZ);
+        dest += PackVector3(dest, vertices[vertexIndex + 2], flipYZ);
 
-    // Could not open file for writing - return
-    if (0 != err || NULL == meshFile)
+        const unsigned short attribute = 0;
+        memcpy(dest, &attribute, sizeof(attribute));
+
+        return triangleSize;
+    });
+
+    return CloseMeshFile(meshFile, hr);
+}
+
+/// <summary>
+/// Write ASCII Wavefront .OBJ file from mesh buffers
+/// </summary>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="numVertices">The number of vertices and normals.</param>
+/// <param name="vertices">The vertices.</param>
+/// <param name="normals">The normals of the vertices.</param>
+/// <param name="numTriangles">The number of triangles.</param>
+/// <param name="triangleIndices">The 3 vertex indices of each triangle.</param>
+/// <returns>indicates success or failure</returns>
+static HRESULT WriteAsciiObjMesh(
+    LPOLESTR lpOleFileName,
+    bool flipYZ,
+    unsigned int numVertices,
+    const Vector3 *vertices,
+    const Vector3 *normals,
+    unsigned int numTriangles,
+    const int *triangleIndices)
+{
+    FILE *meshFile = NULL;
+    HRESULT hr = OpenMeshFile(lpOleFileName, "wt", &meshFile);
+    if (FAILED(hr))
     {
-        return E_ACCESSDENIED;
+        return hr;
     }
 
     // Write the header line
-    const unsigned char header[80] = {0};   // initialize all values to 0
-    fwrite(&header, sizeof(unsigned char), ARRAYSIZE(header), meshFile);
+    std::string header = "#\n# OBJ file created by Microsoft Kinect Fusion\n#\n";
+    hr = WriteMeshText(meshFile, header.c_str(), header.length());
 
-    // Write number of triangles
-    fwrite(&numTriangles, sizeof(int), 1, meshFile);
+    const float flip = flipYZ ? -1.0f : 1.0f;
 
-    // Sequentially write the normal, 3 vertices of the triangle and attribute, for each triangle
-    for (unsigned int t=0; t < numTriangles; ++t)
+    // Sequentially write the vertices, then the normals
+    if (SUCCEEDED(hr))
     {
-        Vector3 normal = normals[t*3];
-
-        if (flipYZ)
+        hr = WriteMeshElements(meshFile, numVertices, cMaxAsciiMeshLineSize, [=](unsigned int v, char *dest) -> unsigned int
         {
-            normal.y = -normal.y;
-            normal.z = -normal.z;
-        }
-
-        // Write normal
-        fwrite(&normal, sizeof(float), 3, meshFile);
+            return sprintf_s(dest, cMaxAsciiMeshLineSize, "v %f %f %f\n", vertices[v].x, flip * vertices[v].y, flip * vertices[v].z);
+        });
+    }
 
-        // Write vertices
-        for (unsigned int v=0; v<3; v++)
+    if (SUCCEEDED(hr))
+    {
+        hr = WriteMeshElements(meshFile, numVertices, cMaxAsciiMeshLineSize, [=](unsigned int n, char *dest) -> unsigned int
         {
-            Vector3 vertex = vertices[(t*3) + v];
-
-            if (flipYZ)
-            {
-                vertex.y = -vertex.y;
-                vertex.z = -vertex.z;
-            }
+            return sprintf_s(dest, cMaxAsciiMeshLineSize, "n %f %f %f\n", normals[n].x, flip * normals[n].y, flip * normals[n].z);
+        });
+    }
 
-            fwrite(&vertex, sizeof(float), 3, meshFile);
-        }
+    // Sequentially write the 3 vertex indices of the triangle face, for each triangle
+    // Note this is typically 1-indexed in an OBJ file when using absolute referencing!
+    if (SUCCEEDED(hr))
+    {
+        hr = WriteMeshElements(meshFile, numTriangles, cMaxAsciiMeshLineSize, [=](unsigned int t, char *dest) -> unsigned int
+        {
+            // +1 for the 1-based indexing
+            unsigned int index0 = triangleIndices[t * 3] + 1;
+            unsigned int index1 = triangleIndices[t * 3 + 1] + 1;
+            unsigned int index2 = triangleIndices[t * 3 + 2] + 1;
 
-        unsigned short attribute = 0;
-        fwrite(&attribute, sizeof(unsigned short), 1, meshFile);
+            return sprintf_s(dest, cMaxAsciiMeshLineSize, "f %u//%u %u//%u %u//%u\n",
+                index0, index0, index1, index1, index2, index2);
+        });
     }
 
-    fflush(meshFile);
-    fclose(meshFile);
-
-    return hr;
+    // Note: we do not have texcoords to store, if we did, we would put the index of the texcoords between the vertex and normal indices (i.e. between the two slashes //) in the string above
+    return CloseMeshFile(meshFile, hr);
 }
 
 /// <summary>
@@ -438,107 +734,193 @@ HRESULT WriteAsciiObjMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName,
         return hr;
     }
 
-    // Open File
-    USES_CONVERSION;
-    char* pszFileName = NULL;
+    return WriteAsciiObjMesh(lpOleFileName, flipYZ, numVertices, vertices, normals, numTriangles, triangleIndices);
+}
 
-    try
+/// <summary>
+/// Write ASCII Wavefront .OBJ file from an indexed mesh
+/// See http://en.wikipedia.org/wiki/Wavefront_.obj_file for .OBJ format
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteAsciiObjMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool flipYZ)
+{
+    if (mesh.vertices.empty() || mesh.triangleIndices.empty() || mesh.normals.size() != mesh.vertices.size())
     {
-        pszFileName = OLE2A(lpOleFileName);
+        return E_INVALIDARG;
     }
-    catch (...)
+
+    return WriteAsciiObjMesh(
+        lpOleFileName,
+        flipYZ,
+        static_cast<unsigned int>(mesh.vertices.size()),
+        &mesh.vertices[0],
+        &mesh.normals[0],
+        static_cast<unsigned int>(mesh.triangleIndices.size() / 3),
+        &mesh.triangleIndices[0]);
+}
+
+/// <summary>
+/// Write the header of a .PLY file
+/// </summary>
+/// <param name="meshFile">The file to write to.</param>
+/// <param name="format">The PLY format line.</param>
+/// <param name="numVertices">The number of vertices.</param>
+/// <param name="numTriangles">The number of triangles.</param>
+/// <param name="outputColor">Whether the vertices have a color.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+static HRESULT WritePlyHeader(FILE *meshFile, const char *format, unsigned int numVertices, unsigned int numTriangles, bool outputColor)
+{
+    const unsigned int bufSize = MAX_PATH*3;
+    char outStr[bufSize];
+
+    int written = sprintf_s(outStr, bufSize, "ply\n%s\ncomment file created by Microsoft Kinect Fusion\n", format);
+    HRESULT hr = WriteMeshText(meshFile, outStr, written);
+
+    if (SUCCEEDED(hr))
     {
-        return E_INVALIDARG;
+        if (outputColor)
+        {
+            // Elements are: x,y,z, r,g,b
+            written = sprintf_s(outStr, bufSize, "element vertex %u\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\n", numVertices);
+        }
+        else
+        {
+            // Elements are: x,y,z
+            written = sprintf_s(outStr, bufSize, "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n", numVertices);
+        }
+
+        hr = WriteMeshText(meshFile, outStr, written);
     }
 
-    FILE *meshFile = NULL;
-    errno_t err = fopen_s(&meshFile, pszFileName, "wt");
+    if (SUCCEEDED(hr))
+    {
+        written = sprintf_s(outStr, bufSize, "element face %u\nproperty list uchar int vertex_index\nend_header\n", numTriangles);
+        hr = WriteMeshText(meshFile, outStr, written);
+    }
 
-    // Could not open file for writing - return
-    if (0 != err || NULL == meshFile)
+    return hr;
+}
+
+/// <summary>
+/// Write .PLY file from mesh buffers
+/// </summary>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="binary">Whether to write binary little endian rather than ASCII.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="numVertices">The number of vertices.</param>
+/// <param name="vertices">The vertices.</param>
+/// <param name="colors">The colors of the vertices, or NULL to write no color.</param>
+/// <param name="numTriangles">The number of triangles.</param>
+/// <param name="triangleIndices">The 3 vertex indices of each triangle.</param>
+/// <returns>indicates success or failure</returns>
+static HRESULT WritePlyMesh(
+    LPOLESTR lpOleFileName,
+    bool binary,
+    bool flipYZ,
+    unsigned int numVertices,
+    const Vector3 *vertices,
+    const int *colors,
+    unsigned int numTriangles,
+    const int *triangleIndices)
+{
+    FILE *meshFile = NULL;
+    HRESULT hr = OpenMeshFile(lpOleFileName, binary ? "wb" : "wt", &meshFile);
+    if (FAILED(hr))
     {
-        return E_ACCESSDENIED;
+        return hr;
     }
 
-    // Write the header line
-    std::string header = "#\n# OBJ file created by Microsoft Kinect Fusion\n#\n";
-    fwrite(header.c_str(), sizeof(char), header.length(), meshFile);
+    const bool outputColor = (NULL != colors);
 
-    const unsigned int bufSize = MAX_PATH*3;
-    char outStr[bufSize];
-    int written = 0;
+    // The x86 and x64 targets are little endian, so binary values are written as they are in memory
+    hr = WritePlyHeader(meshFile, binary ? "format binary_little_endian 1.0" : "format ascii 1.0", numVertices, numTriangles, outputColor);
 
-    if (flipYZ)
+    const float flip = flipYZ ? -1.0f : 1.0f;
+
+    if (SUCCEEDED(hr) && binary)
     {
-        // Sequentially write the 3 vertices of the triangle, for each triangle
-        for (unsigned int t=0, vertexIndex=0; t < numTriangles; ++t, vertexIndex += 3)
+        // Each vertex is x,y,z, and r,g,b when writing color
+        const unsigned int vertexSize = sizeof(Vector3) + (outputColor ? 3 : 0);
+
+        hr = WriteMeshElements(meshFile, numVertices, vertexSize, [=](unsigned int v, char *dest) -> unsigned int
         {
-            written = sprintf_s(outStr, bufSize, "v %f %f %f\nv %f %f %f\nv %f %f %f\n", 
-                vertices[vertexIndex].x, -vertices[vertexIndex].y, -vertices[vertexIndex].z, 
-                vertices[vertexIndex+1].x, -vertices[vertexIndex+1].y, -vertices[vertexIndex+1].z, 
-                vertices[vertexIndex+2].x, -vertices[vertexIndex+2].y, -vertices[vertexIndex+2].z);
-            fwrite(outStr, sizeof(char), written, meshFile);
-        }
+            dest += PackVector3(dest, vertices[v], flipYZ);
 
-        // Sequentially write the 3 normals of the triangle, for each triangle
-        for (unsigned int t=0, normalIndex=0; t < numTriangles; ++t, normalIndex += 3)
+            if (outputColor)
+            {
+                unsigned int color = colors[v];
+
+                dest[0] = static_cast<char>((color >> 16) & 255);
+                dest[1] = static_cast<char>((color >> 8) & 255);
+                dest[2] = static_cast<char>(color & 255);
+            }
+
+            return vertexSize;
+        });
+
+        // Each face is the vertex count followed by the 3 vertex indices of the triangle (0-referenced in PLY)
+        if (SUCCEEDED(hr))
         {
-            written = sprintf_s(outStr, bufSize, "n %f %f %f\nn %f %f %f\nn %f %f %f\n", 
-                normals[normalIndex].x, -normals[normalIndex].y, -normals[normalIndex].z, 
-                normals[normalIndex+1].x, -normals[normalIndex+1].y, -normals[normalIndex+1].z, 
-                normals[normalIndex+2].x, -normals[normalIndex+2].y, -normals[normalIndex+2].z);
-            fwrite(outStr, sizeof(char), written, meshFile);
+            const unsigned int faceSize = sizeof(unsigned char) + 3 * sizeof(int);
+
+            hr = WriteMeshElements(meshFile, numTriangles, faceSize, [=](unsigned int t, char *dest) -> unsigned int
+            {
+                dest[0] = 3;
+                memcpy(dest + 1, &triangleIndices[t * 3], 3 * sizeof(int));
+
+                return faceSize;
+            });
         }
     }
-    else
+    else if (SUCCEEDED(hr))
     {
-        // Sequentially write the 3 vertices of the triangle, for each triangle
-        for (unsigned int t=0, vertexIndex=0; t < numTriangles; ++t, vertexIndex += 3)
+        // Sequentially write the vertices
+        if (outputColor)
         {
-            written = sprintf_s(outStr, bufSize, "v %f %f %f\nv %f %f %f\nv %f %f %f\n", 
-                vertices[vertexIndex].x, vertices[vertexIndex].y, vertices[vertexIndex].z, 
-                vertices[vertexIndex+1].x, vertices[vertexIndex+1].y, vertices[vertexIndex+1].z, 
-                vertices[vertexIndex+2].x, vertices[vertexIndex+2].y, vertices[vertexIndex+2].z);
-            fwrite(outStr, sizeof(char), written, meshFile);
-        }
+            hr = WriteMeshElements(meshFile, numVertices, cMaxAsciiMeshLineSize, [=](unsigned int v, char *dest) -> unsigned int
+            {
+                unsigned int color = colors[v];
 
-        // Sequentially write the 3 normals of the triangle, for each triangle
-        for (unsigned int t=0, normalIndex=0; t < numTriangles; ++t, normalIndex += 3)
+                return sprintf_s(dest, cMaxAsciiMeshLineSize, "%f %f %f %u %u %u\n",
+                    vertices[v].x, flip * vertices[v].y, flip * vertices[v].z,
+                    ((color >> 16) & 255), ((color >> 8) & 255), (color & 255));
+            });
+        }
+        else
         {
-            written = sprintf_s(outStr, bufSize, "n %f %f %f\nn %f %f %f\nn %f %f %f\n", 
-                normals[normalIndex].x, normals[normalIndex].y, normals[normalIndex].z, 
-                normals[normalIndex+1].x, normals[normalIndex+1].y, normals[normalIndex+1].z, 
-                normals[normalIndex+2].x, normals[normalIndex+2].y, normals[normalIndex+2].z);
-            fwrite(outStr, sizeof(char), written, meshFile);
+            hr = WriteMeshElements(meshFile, numVertices, cMaxAsciiMeshLineSize, [=](unsigned int v, char *dest) -> unsigned int
+            {
+                return sprintf_s(dest, cMaxAsciiMeshLineSize, "%f %f %f\n", vertices[v].x, flip * vertices[v].y, flip * vertices[v].z);
+            });
         }
-    }
 
-    // Sequentially write the 3 vertex indices of the triangle face, for each triangle
-    // Note this is typically 1-indexed in an OBJ file when using absolute referencing!
-    for (unsigned int t=0, baseIndex=1; t < numTriangles; ++t, baseIndex += 3) // Start at baseIndex=1 for the 1-based indexing.
-    {
-        written = sprintf_s(outStr, bufSize, "f %u//%u %u//%u %u//%u\n", 
-            baseIndex, baseIndex, baseIndex+1, baseIndex+1, baseIndex+2, baseIndex+2);
-        fwrite(outStr, sizeof(char), written, meshFile);
+        // Sequentially write the 3 vertex indices of the triangle face, for each triangle (0-referenced in PLY)
+        if (SUCCEEDED(hr))
+        {
+            hr = WriteMeshElements(meshFile, numTriangles, cMaxAsciiMeshLineSize, [=](unsigned int t, char *dest) -> unsigned int
+            {
+                return sprintf_s(dest, cMaxAsciiMeshLineSize, "3 %d %d %d\n",
+                    triangleIndices[t * 3], triangleIndices[t * 3 + 1], triangleIndices[t * 3 + 2]);
+            });
+        }
     }
 
-    // Note: we do not have texcoords to store, if we did, we would put the index of the texcoords between the vertex and normal indices (i.e. between the two slashes //) in the string above
-    fflush(meshFile);
-    fclose(meshFile);
-
-    return hr;
+    return CloseMeshFile(meshFile, hr);
 }
 
 /// <summary>
-/// Write ASCII .PLY file
-/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// Write .PLY file from a Kinect Fusion mesh
 /// </summary>
 /// <param name="mesh">The Kinect Fusion mesh object.</param>
 /// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="binary">Whether to write binary little endian rather than ASCII.</param>
 /// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
 /// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
 /// <returns>indicates success or failure</returns>
-HRESULT WriteAsciiPlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool flipYZ, bool outputColor)
+static HRESULT WritePlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool binary, bool flipYZ, bool outputColor)
 {
     HRESULT hr = S_OK;
 
@@ -582,134 +964,90 @@ HRESULT WriteAsciiPlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName,
         }
     }
 
-    // Open File
-    USES_CONVERSION;
-    char* pszFileName = NULL;
+    return WritePlyMesh(lpOleFileName, binary, flipYZ, numVertices, vertices, colors, numTriangles, triangleIndices);
+}
 
-    try
-    {
-        pszFileName = OLE2A(lpOleFileName);
-    }
-    catch (...)
+/// <summary>
+/// Write .PLY file from an indexed mesh
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="binary">Whether to write binary little endian rather than ASCII.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+static HRESULT WritePlyMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool binary, bool flipYZ, bool outputColor)
+{
+    if (mesh.vertices.empty() || mesh.triangleIndices.empty() || (outputColor && mesh.colors.size() != mesh.vertices.size()))
     {
         return E_INVALIDARG;
     }
 
-    FILE *meshFile = NULL;
-    errno_t err = fopen_s(&meshFile, pszFileName, "wt");
-
-    // Could not open file for writing - return
-    if (0 != err || NULL == meshFile)
-    {
-        return E_ACCESSDENIED;
-    }
-
-    // Write the header line
-    std::string header = "ply\nformat ascii 1.0\ncomment file created by Microsoft Kinect Fusion\n";
-    fwrite(header.c_str(), sizeof(char), header.length(), meshFile);
-
-    const unsigned int bufSize = MAX_PATH*3;
-    char outStr[bufSize];
-    int written = 0;
-
-    if (outputColor)
-    {
-        // Elements are: x,y,z, r,g,b
-        written = sprintf_s(outStr, bufSize, "element vertex %u\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\n", numVertices);
-        fwrite(outStr, sizeof(char), written, meshFile);
-    }
-    else
-    {
-        // Elements are: x,y,z
-        written = sprintf_s(outStr, bufSize, "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n", numVertices);
-        fwrite(outStr, sizeof(char), written, meshFile);
-    }
-
-    written = sprintf_s(outStr, bufSize, "element face %u\nproperty list uchar int vertex_index\nend_header\n", numTriangles);
-    fwrite(outStr, sizeof(char), written, meshFile);
+    return WritePlyMesh(
+        lpOleFileName,
+        binary,
+        flipYZ,
+        static_cast<unsigned int>(mesh.vertices.size()),
+        &mesh.vertices[0],
+        outputColor ? &mesh.colors[0] : NULL,
+        static_cast<unsigned int>(mesh.triangleIndices.size() / 3),
+        &mesh.triangleIndices[0]);
+}
 
-    if (flipYZ)
-    {
-        if (outputColor)
-        {
-            // Sequentially write the 3 vertices of the triangle, for each triangle
-            for (unsigned int t=0, vertexIndex=0; t < numTriangles; ++t, vertexIndex += 3)
-            {
-                unsigned int color0 = colors[vertexIndex];
-                unsigned int color1 = colors[vertexIndex+1];
-                unsigned int color2 = colors[vertexIndex+2];
-
-                written = sprintf_s(outStr, bufSize, "%f %f %f %u %u %u\n%f %f %f %u %u %u\n%f %f %f %u %u %u\n", 
-                    vertices[vertexIndex].x, -vertices[vertexIndex].y, -vertices[vertexIndex].z, 
-                    ((color0 >> 16) & 255), ((color0 >> 8) & 255), (color0 & 255), 
-                    vertices[vertexIndex+1].x, -vertices[vertexIndex+1].y, -vertices[vertexIndex+1].z,
-                    ((color1 >> 16) & 255), ((color1 >> 8) & 255), (color1 & 255), 
-                    vertices[vertexIndex+2].x, -vertices[vertexIndex+2].y, -vertices[vertexIndex+2].z,
-                    ((color2 >> 16) & 255), ((color2 >> 8) & 255), (color2 & 255));
-
-                fwrite(outStr, sizeof(char), written, meshFile);
-            }
-        }
-        else
-        {
-            // Sequentially write the 3 vertices of the triangle, for each triangle
-            for (unsigned int t=0, vertexIndex=0; t < numTriangles; ++t, vertexIndex += 3)
-            {
-                written = sprintf_s(outStr, bufSize, "%f %f %f\n%f %f %f\n%f %f %f\n", 
-                    vertices[vertexIndex].x, -vertices[vertexIndex].y, -vertices[vertexIndex].z, 
-                    vertices[vertexIndex+1].x, -vertices[vertexIndex+1].y, -vertices[vertexIndex+1].z, 
-                    vertices[vertexIndex+2].x, -vertices[vertexIndex+2].y, -vertices[vertexIndex+2].z);
-                fwrite(outStr, sizeof(char), written, meshFile);
-            }
-        }
-    }
-    else
-    {
-        if (outputColor)
-        {
-            // Sequentially write the 3 vertices of the triangle, for each triangle
-            for (unsigned int t=0, vertexIndex=0; t < numTriangles; ++t, vertexIndex += 3)
-            {
-                unsigned int color0 = colors[vertexIndex];
-                unsigned int color1 = colors[vertexIndex+1];
-                unsigned int color2 = colors[vertexIndex+2];
-
-                written = sprintf_s(outStr, bufSize, "%f %f %f %u %u %u\n%f %f %f %u %u %u\n%f %f %f %u %u %u\n", 
-                    vertices[vertexIndex].x, vertices[vertexIndex].y, vertices[vertexIndex].z, 
-                    ((color0 >> 16) & 255), ((color0 >> 8) & 255), (color0 & 255), 
-                    vertices[vertexIndex+1].x, vertices[vertexIndex+1].y, vertices[vertexIndex+1].z,
-                    ((color1 >> 16) & 255), ((color1 >> 8) & 255), (color1 & 255), 
-                    vertices[vertexIndex+2].x, vertices[vertexIndex+2].y, vertices[vertexIndex+2].z,
-                    ((color2 >> 16) & 255), ((color2 >> 8) & 255), (color2 & 255));
-
-                fwrite(outStr, sizeof(char), written, meshFile);
-            }
-        }
-        else
-        {
-            // Sequentially write the 3 vertices of the triangle, for each triangle
-            for (unsigned int t=0, vertexIndex=0; t < numTriangles; ++t, vertexIndex += 3)
-            {
-                written = sprintf_s(outStr, bufSize, "%f %f %f\n%f %f %f\n%f %f %f\n", 
-                    vertices[vertexIndex].x, vertices[vertexIndex].y, vertices[vertexIndex].z, 
-                    vertices[vertexIndex+1].x, vertices[vertexIndex+1].y, vertices[vertexIndex+1].z,
-                    vertices[vertexIndex+2].x, vertices[vertexIndex+2].y, vertices[vertexIndex+2].z);
-                fwrite(outStr, sizeof(char), written, meshFile);
-            }
-        }
-    }
+/// <summary>
+/// Write ASCII .PLY file
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The Kinect Fusion mesh object.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteAsciiPlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool flipYZ, bool outputColor)
+{
+    return WritePlyMeshFile(mesh, lpOleFileName, false, flipYZ, outputColor);
+}
 
-    // Sequentially write the 3 vertex indices of the triangle face, for each triangle (0-referenced in PLY)
-    for (unsigned int t=0, baseIndex=0; t < numTriangles; ++t, baseIndex += 3)
-    {
-        written = sprintf_s(outStr, bufSize, "3 %u %u %u\n", baseIndex, baseIndex+1, baseIndex+2);
-        fwrite(outStr, sizeof(char), written, meshFile);
-    }
+/// <summary>
+/// Write ASCII .PLY file from an indexed mesh
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteAsciiPlyMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool flipYZ, bool outputColor)
+{
+    return WritePlyMeshFile(mesh, lpOleFileName, false, flipYZ, outputColor);
+}
 
-    fflush(meshFile);
-    fclose(meshFile);
+/// <summary>
+/// Write binary little endian .PLY file
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The Kinect Fusion mesh object.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteBinaryPlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool flipYZ, bool outputColor)
+{
+    return WritePlyMeshFile(mesh, lpOleFileName, true, flipYZ, outputColor);
+}
 
-    return hr;
+/// <summary>
+/// Write binary little endian .PLY file from an indexed mesh
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteBinaryPlyMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool flipYZ, bool outputColor)
+{
+    return WritePlyMeshFile(mesh, lpOleFileName, true, flipYZ, outputColor);
 }
 
 /// <summary>
@@ -1070,7 +1408,7 @@ HRESULT CopyImageFrame(const NUI_FUSION_IMAGE_FRAME *pSrc, const NUI_FUSION_IMAG
     // Make sure we've received valid data
     if (SUCCEEDED(hr) && srcLockedRect.Pitch != 0)
     {
-        INuiFrameTexture *destImageFrameTexture = pSrc->pFrameTexture;
+        INuiFrameTexture *destImageFrameTexture = pDest->pFrameTexture;
         NUI_LOCKED_RECT destLockedRect;
 
         // Lock the frame data so the Kinect knows not to modify it while we're reading it
@@ -1096,93 +1434,12 @@ HRESULT CopyImageFrame(const NUI_FUSION_IMAGE_FRAME *pSrc, const NUI_FUSION_IMAG
     return hr;
 }
 
-/// <summary>
-/// Color the residual/delta image from the AlignDepthFloatToReconstruction call
-/// </summary>
-/// <param name="pFloatDeltaFromReference">A pointer to the source FloatDeltaFromReference image.</param>
-/// <param name="pShadedDeltaFromReference">A pointer to the destination color ShadedDeltaFromReference image.</param>
-/// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT ColorResiduals(const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFromReference, const NUI_FUSION_IMAGE_FRAME *pShadedDeltaFromReference)
-{
-    HRESULT hr = S_OK;
-
-    if (nullptr == pShadedDeltaFromReference || 
-        nullptr == pFloatDeltaFromReference)
-    {
-        return E_FAIL;
-    }
-
-    if (nullptr == pShadedDeltaFromReference->pFrameTexture ||
-        nullptr == pFloatDeltaFromReference->pFrameTexture)
-    {
-        return E_NOINTERFACE;
-    }
-
-    if (pFloatDeltaFromReference->imageType !=  NUI_FUSION_IMAGE_TYPE_FLOAT || pShadedDeltaFromReference->imageType !=  NUI_FUSION_IMAGE_TYPE_COLOR)
-    {
-        return E_INVALIDARG;
-    }
-
-    unsigned int width = pShadedDeltaFromReference->width;
-    unsigned int height = pShadedDeltaFromReference->height;
-
-    if (width != pFloatDeltaFromReference->width 
-        || height != pFloatDeltaFromReference->height)
-    {
-        return E_INVALIDARG;
-    }
-
-    // 32bit ABGR color pixels for shaded image
-    NUI_LOCKED_RECT shadedDeltasLockedRect;
-    hr = pShadedDeltaFromReference->pFrameTexture->LockRect(0, &shadedDeltasLockedRect, nullptr, 0);
-    if (FAILED(hr) || shadedDeltasLockedRect.Pitch == 0)
-    {
-        return hr;
-    }
-
-    // 32bit float per pixel signifies distance delta from the reconstructed surface model after AlignDepthFloatToReconstruction
-    NUI_LOCKED_RECT floatDeltasLockedRect;
-    hr = pFloatDeltaFromReference->pFrameTexture->LockRect(0, &floatDeltasLockedRect, nullptr, 0);
-    if (FAILED(hr) || floatDeltasLockedRect.Pitch == 0)
-    {
-        return hr;
-    }
-
-    unsigned int *pColorBuffer = reinterpret_cast<unsigned int *>(shadedDeltasLockedRect.pBits);
-    const float *pFloatBuffer = reinterpret_cast<float *>(floatDeltasLockedRect.pBits);
-
-    Concurrency::parallel_for(0u, height, [&](unsigned int y)
-    {
-        unsigned int* pColorRow = reinterpret_cast<unsigned int*>(reinterpret_cast<unsigned char*>(pColorBuffer) + (y * shadedDeltasLockedRect.Pitch));
-        const float* pFloatRow = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(pFloatBuffer) + (y * floatDeltasLockedRect.Pitch));
-
-        for (unsigned int x = 0; x < width; ++x)
-        {
-            float residue = pFloatRow[x];
-            unsigned int color = 0;
-
-            if (residue <= 1.0f)   // Pixel byte ordering: ARGB
-            {
-                color |= (255 << 24);                                                                               // a
-                color |= (static_cast<unsigned char>(255.0f * clamp(1.0f + residue, 0.0f, 1.0f)) << 16);            // r
-                color |= (static_cast<unsigned char>(255.0f * clamp(1.0f - std::abs(residue), 0.0f, 1.0f)) << 8);   // g
-                color |= (static_cast<unsigned char>(255.0f * clamp(1.0f - residue, 0.0f, 1.0f)));                  // b
-            }
-
-            pColorRow[x] = color;
-        }
-    });
-
-    pShadedDeltaFromReference->pFrameTexture->UnlockRect(0);
-    pFloatDeltaFromReference->pFrameTexture->UnlockRect(0);
-
-    return hr;
-}
-
 /// <summary>
 /// Calculate statistics on the residual/delta image from the AlignDepthFloatToReconstruction call.
 /// </summary>
 /// <param name="pFloatDeltaFromReference">A pointer to the source FloatDeltaFromReference image.</param>
+/// <param name="stats">A pointer to a DeltaFromReferenceImageStatistics struct to fill with the statistics,
+/// including the histogram of the valid residuals.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
 HRESULT CalculateResidualStatistics(const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFromReference, DeltaFromReferenceImageStatistics *stats)
 {
@@ -1215,57 +1472,44 @@ HRESULT CalculateResidualStatistics(const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFro
     }
 
     const float *pFloatBuffer = reinterpret_cast<float *>(floatDeltasLockedRect.pBits);
+    const unsigned int lastBin = DeltaFromReferenceImageStatistics::cResidualHistogramBins - 1;
+    const float binsPerResidual = static_cast<float>(DeltaFromReferenceImageStatistics::cResidualHistogramBins);
 
     // Measurement stats
-    std::vector<unsigned int> zeroPixelsRow;
-    std::vector<unsigned int> validPixelsRow;
-    std::vector<unsigned int> invalidDepthOutsideVolumePixelsRow;
-    std::vector<float> validPixelDistanceRow;
-
-    zeroPixelsRow.resize(height, 0);
-    validPixelsRow.resize(height, 0);
-    invalidDepthOutsideVolumePixelsRow.resize(height, 0);
-    validPixelDistanceRow.resize(height, 0);
+    KinectFusionReduction<DeltaFromReferenceImageStatistics> reduction;
 
-    Concurrency::parallel_for(0u, height, [&](unsigned int y)
+    *stats = reduction.Reduce(height, [&](unsigned int yBegin, unsigned int yEnd, DeltaFromReferenceImageStatistics &partStats)
     {
-        const float* pFloatRow = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(pFloatBuffer) + (y * floatDeltasLockedRect.Pitch));
-
-        for (unsigned int x = 0; x < width; ++x)
+        for (unsigned int y = yBegin; y < yEnd; ++y)
         {
-            float residue = pFloatRow[x];
+            const float* pFloatRow = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(pFloatBuffer) + (y * floatDeltasLockedRect.Pitch));
 
-            // If the depth was invalid or the depth back-projected outside the volume, the residual is set to 2.0f
-            // However, if the voxel contents are 0 the residual will also return 0 here.
-            if (residue == 0.0f)
-            {
-                ++zeroPixelsRow[y];
-            }
-            else if (residue == 2.0f)
+            for (unsigned int x = 0; x < width; ++x)
             {
-                ++invalidDepthOutsideVolumePixelsRow[y];
-            }
-            else if (residue <= 1.0f)   // Pixel byte ordering: ARGB
-            {
-                ++validPixelsRow[y];
-                validPixelDistanceRow[y] += residue;
+                float residue = pFloatRow[x];
+
+                // If the depth was invalid or the depth back-projected outside the volume, the residual is set to 2.0f
+                // However, if the voxel contents are 0 the residual will also return 0 here.
+                if (residue == 0.0f)
+                {
+                    ++partStats.zeroPixels;
+                }
+                else if (residue == 2.0f)
+                {
+                    ++partStats.invalidDepthOutsideVolumePixels;
+                }
+                else if (residue <= 1.0f)   // Pixel byte ordering: ARGB
+                {
+                    ++partStats.validPixels;
+                    partStats.totalValidPixelsDistance += residue;
+                    ++partStats.residualHistogram[min(static_cast<unsigned int>(fabsf(residue) * binsPerResidual), lastBin)];
+                }
             }
         }
     });
 
-    stats->validPixels = stats->zeroPixels = stats->invalidDepthOutsideVolumePixels = 0;
-    stats->totalValidPixelsDistance = 0;
     stats->totalPixels = width * height;
 
-    for (unsigned int y=0; y<height; ++y)
-    {
-        stats->zeroPixels += zeroPixelsRow[y];
-        stats->validPixels += validPixelsRow[y];
-        stats->invalidDepthOutsideVolumePixels += invalidDepthOutsideVolumePixelsRow[y];
-
-        stats->totalValidPixelsDistance += validPixelDistanceRow[y];
-    }
-
     pFloatDeltaFromReference->pFrameTexture->UnlockRect(0);
 
     return hr;
@@ -1410,13 +1654,13 @@ static inline bool IsValidResampleFactor(unsigned int factor)
 }
 
 /// <summary>
-/// Down sample color, depth float or point cloud frame with nearest neighbor
+/// Up sample color or depth float (32bits/pixel) frame with nearest neighbor - replicates pixels
 /// </summary>
-/// <param name="src">The source depth float or pointcloud image.</param>
-/// <param name="dest">The destination down sampled depth float or pointcloud image.</param>
-/// <param name="factor">The down sample factor (1=just copy, 2=x/2,y/2, 4=x/4,y/4).</param>
+/// <param name="src">The source color image.</param>
+/// <param name="dest">The destination up-sampled color image.</param>
+/// <param name="factor">The up sample factor (1=just copy, 2=x*2,y*2, 4=x*4,y*4).</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_IMAGE_FRAME *dest, unsigned int factor)
+HRESULT UpsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_IMAGE_FRAME *dest, unsigned int factor)
 {
     HRESULT hr = S_OK;
 
@@ -1425,8 +1669,7 @@ HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_I
         return E_INVALIDARG;
     }
 
-    if (!(src->imageType == NUI_FUSION_IMAGE_TYPE_COLOR || src->imageType == NUI_FUSION_IMAGE_TYPE_FLOAT || src->imageType == NUI_FUSION_IMAGE_TYPE_POINT_CLOUD)
-        || src->imageType != dest->imageType)
+    if (src->imageType != dest->imageType || !(src->imageType == NUI_FUSION_IMAGE_TYPE_COLOR || src->imageType == NUI_FUSION_IMAGE_TYPE_FLOAT))
     {
         return E_INVALIDARG;
     }
@@ -1437,16 +1680,16 @@ HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_I
     }
 
     INuiFrameTexture *srcFrameTexture = src->pFrameTexture;
-    INuiFrameTexture *downsampledFloatFrameTexture = dest->pFrameTexture;
+    INuiFrameTexture *upsampledDestFrameTexture = dest->pFrameTexture;
 
-    unsigned int downsampledWidth = src->width / factor;
-    unsigned int downsampleHeight = src->height / factor;
+    unsigned int upsampledWidth = src->width * factor;
+    unsigned int upsampleHeight = src->height * factor;
 
-    if (1 == factor && srcFrameTexture->BufferLen() != downsampledFloatFrameTexture->BufferLen())
+    if (1 == factor && srcFrameTexture->BufferLen() != upsampledDestFrameTexture->BufferLen())
     {
         return E_INVALIDARG;
     }
-    else if (dest->width != downsampledWidth || dest->height != downsampleHeight)
+    else if (dest->width != upsampledWidth || dest->height != upsampleHeight)
     {
         return E_INVALIDARG;
     }
@@ -1462,26 +1705,27 @@ HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_I
         return E_NOINTERFACE;
     }
 
-    NUI_LOCKED_RECT downsampledLockedRect;
+    NUI_LOCKED_RECT upsampledLockedRect;
 
     // Lock the frame data so the Kinect knows not to modify it while we're reading it
-    hr = downsampledFloatFrameTexture->LockRect(0, &downsampledLockedRect, nullptr, 0);
+    hr = upsampledDestFrameTexture->LockRect(0, &upsampledLockedRect, nullptr, 0);
 
     // Make sure we've received valid data
-    if (FAILED(hr) || downsampledLockedRect.Pitch == 0)
+    if (FAILED(hr) || upsampledLockedRect.Pitch == 0)
     {
         srcFrameTexture->UnlockRect(0);
         return E_NOINTERFACE;
     }
 
-    float *srcValues = (float *)srcLockedRect.pBits;
-    float *downsampledDestValues = (float *)downsampledLockedRect.pBits;
+    unsigned int *srcValues = (unsigned int *)srcLockedRect.pBits;
+    unsigned int *upsampledDestValues = (unsigned int *)upsampledLockedRect.pBits;
 
     const unsigned int srcImageWidth = src->width;
+    const unsigned int srcImageHeight = src->height;
 
     if (1 == factor)
     {
-        errno_t err = memcpy_s(downsampledDestValues, downsampledFloatFrameTexture->BufferLen(), srcValues, srcFrameTexture->BufferLen());
+        errno_t err = memcpy_s(upsampledDestValues, upsampledDestFrameTexture->BufferLen(), srcValues, srcFrameTexture->BufferLen());
         if (0 != err)
         {
             hr = E_FAIL;
@@ -1489,157 +1733,363 @@ HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_I
     }
     else
     {
-        // Adjust for point cloud image size (6 floats per pixel)
-        unsigned int step = (src->imageType == NUI_FUSION_IMAGE_TYPE_POINT_CLOUD) ? 6 : 1;
-        unsigned int factorStep = factor * step;
+        const unsigned int rowByteSize = upsampledWidth * sizeof(unsigned int);
 
-        Concurrency::parallel_for(0u, downsampleHeight, [=, &downsampledDestValues, &srcValues](unsigned int y)
+        // Each source row fills factor destination rows, so the rows are independent
+        Concurrency::parallel_for(0u, srcImageHeight, [=](unsigned int y)
         {
-            unsigned int index = downsampledWidth * y * step;
-            unsigned int srcIndex = srcImageWidth * y * factorStep;
+            const unsigned int *pSrcRow = srcValues + (srcImageWidth * y);
+            unsigned int *pDestRow = upsampledDestValues + (upsampledWidth * factor * y);
+
+            // Replicate pixels horizontally, four destination pixels at a time
+            if (2 == factor)
+            {
+                unsigned int x = 0;
+                for (; x + 4 <= srcImageWidth; x += 4)
+                {
+                    const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrcRow + x));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(pDestRow + (2 * x)), _mm_unpacklo_epi32(pixels, pixels));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(pDestRow + (2 * x) + 4), _mm_unpackhi_epi32(pixels, pixels));
+                }
 
-            for (unsigned int x=0; x<downsampledWidth; ++x, srcIndex += factorStep)
+                for (; x < srcImageWidth; ++x)
+                {
+                    pDestRow[2 * x] = pSrcRow[x];
+                    pDestRow[(2 * x) + 1] = pSrcRow[x];
+                }
+            }
+            else
             {
-                for (unsigned int s=0, localSourceIndex=srcIndex; s<step; ++s, ++index, ++localSourceIndex)
+                // The remaining factors are multiples of four
+                for (unsigned int x = 0; x < srcImageWidth; ++x)
                 {
-                    downsampledDestValues[index] = srcValues[localSourceIndex];
+                    const __m128i pixel = _mm_set1_epi32(static_cast<int>(pSrcRow[x]));
+
+                    for (unsigned int s = 0; s < factor; s += 4)
+                    {
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDestRow + (factor * x) + s), pixel);
+                    }
                 }
             }
+
+            // Duplicate the row
+            for (unsigned int r = 1; r < factor; ++r)
+            {
+                CopyMemory(pDestRow + (upsampledWidth * r), pDestRow, rowByteSize);
+            }
         });
     }
 
     // We're done with the textures so unlock them
     srcFrameTexture->UnlockRect(0);
-    downsampledFloatFrameTexture->UnlockRect(0);
+    upsampledDestFrameTexture->UnlockRect(0);
 
     return hr;
 }
 
 /// <summary>
-/// Up sample color or depth float (32bits/pixel) frame with nearest neighbor - replicates pixels
+/// Get the focal lengths and principal point of a Kinect Fusion image frame in pixels.
+/// Frames created without camera parameters use the nominal Kinect depth camera intrinsics.
 /// </summary>
-/// <param name="src">The source color image.</param>
-/// <param name="dest">The destination up-sampled color image.</param>
-/// <param name="factor">The up sample factor (1=just copy, 2=x*2,y*2, 4=x*4,y*4).</param>
+/// <param name="pFrame">The image frame.</param>
+/// <param name="flx">Returns the focal length in the x axis, in pixels.</param>
+/// <param name="fly">Returns the focal length in the y axis, in pixels.</param>
+/// <param name="ppx">Returns the principal point of the image in the x axis, in pixels.</param>
+/// <param name="ppy">Returns the principal point of the image in the y axis, in pixels.</param>
+void GetFrameIntrinsics(const NUI_FUSION_IMAGE_FRAME *pFrame, float &flx, float &fly, float &ppx, float &ppy)
+{
+    const float width = static_cast<float>(pFrame->width);
+    const float height = static_cast<float>(pFrame->height);
+
+    if (nullptr != pFrame->pCameraParameters)
+    {
+        // Kinect Fusion camera parameters are normalized by the image size
+        flx = pFrame->pCameraParameters->focalLengthX * width;
+        fly = pFrame->pCameraParameters->focalLengthY * height;
+        ppx = pFrame->pCameraParameters->principalPointX * width;
+        ppy = pFrame->pCameraParameters->principalPointY * height;
+    }
+    else
+    {
+        // The nominal focal length is specified for a 320x240 depth image
+        flx = NUI_CAMERA_DEPTH_NOMINAL_FOCAL_LENGTH_IN_PIXELS * (width / 320.0f);
+        fly = flx;
+        ppx = width * 0.5f;
+        ppy = height * 0.5f;
+    }
+}
+
+/// <summary>
+/// Smooth a depth float frame on the CPU by averaging each pixel with the neighbors within a 
+/// depth distance threshold, which preserves depth discontinuities.
+/// </summary>
+/// <param name="src">The source depth float image.</param>
+/// <param name="dest">The destination smoothed depth float image.</param>
+/// <param name="kernelWidth">The half width of the kernel (0=just copy, 1=3x3, 2=5x5, 3=7x7).</param>
+/// <param name="distanceThreshold">The maximum depth difference in meters of neighbors included in the average.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT UpsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_IMAGE_FRAME *dest, unsigned int factor)
+HRESULT SmoothDepthFloatFrame(const NUI_FUSION_IMAGE_FRAME *src, const NUI_FUSION_IMAGE_FRAME *dest, unsigned int kernelWidth, float distanceThreshold)
 {
     HRESULT hr = S_OK;
 
-    if (nullptr == src || nullptr == dest)
+    if (nullptr == src || nullptr == dest || nullptr == src->pFrameTexture || nullptr == dest->pFrameTexture)
     {
         return E_INVALIDARG;
     }
 
-    if (src->imageType != dest->imageType || !(src->imageType == NUI_FUSION_IMAGE_TYPE_COLOR || src->imageType == NUI_FUSION_IMAGE_TYPE_FLOAT))
+    if (NUI_FUSION_IMAGE_TYPE_FLOAT != src->imageType || NUI_FUSION_IMAGE_TYPE_FLOAT != dest->imageType)
     {
         return E_INVALIDARG;
     }
 
-    if (!IsValidResampleFactor(factor))
+    if (0 == src->width || 0 == src->height || src->width != dest->width || src->height != dest->height)
     {
         return E_INVALIDARG;
     }
 
-    INuiFrameTexture *srcFrameTexture = src->pFrameTexture;
-    INuiFrameTexture *upsampledDestFrameTexture = dest->pFrameTexture;
+    NUI_LOCKED_RECT srcLockedRect;
+    hr = src->pFrameTexture->LockRect(0, &srcLockedRect, nullptr, 0);
+    if (FAILED(hr) || srcLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
 
-    unsigned int upsampledWidth = src->width * factor;
-    unsigned int upsampleHeight = src->height * factor;
+    NUI_LOCKED_RECT destLockedRect;
+    hr = dest->pFrameTexture->LockRect(0, &destLockedRect, nullptr, 0);
+    if (FAILED(hr) || destLockedRect.Pitch == 0)
+    {
+        src->pFrameTexture->UnlockRect(0);
+        return E_NOINTERFACE;
+    }
 
-    if (1 == factor && srcFrameTexture->BufferLen() != upsampledDestFrameTexture->BufferLen())
+    const float *pSrc = reinterpret_cast<const float *>(srcLockedRect.pBits);
+    float *pDest = reinterpret_cast<float *>(destLockedRect.pBits);
+
+    const int width = static_cast<int>(src->width);
+    const int height = static_cast<int>(src->height);
+    const int kernel = static_cast<int>(kernelWidth);
+
+    Concurrency::parallel_for(0, height, [&](int y)
+    {
+        const int yStart = max(0, y - kernel);
+        const int yEnd = min(height - 1, y + kernel);
+
+        for (int x = 0; x < width; ++x)
+        {
+            const float center = pSrc[y * width + x];
+
+            if (center <= 0.0f)
+            {
+                pDest[y * width + x] = 0.0f;
+                continue;
+            }
+
+            const int xStart = max(0, x - kernel);
+            const int xEnd = min(width - 1, x + kernel);
+
+            float sum = 0.0f;
+            unsigned int count = 0;
+
+            for (int ky = yStart; ky <= yEnd; ++ky)
+            {
+                const float *pRow = pSrc + (ky * width);
+
+                for (int kx = xStart; kx <= xEnd; ++kx)
+                {
+                    const float depth = pRow[kx];
+
+                    if (depth > 0.0f && fabsf(depth - center) <= distanceThreshold)
+                    {
+                        sum += depth;
+                        ++count;
+                    }
+                }
+            }
+
+            // The center pixel always contributes, so count is at least 1
+            pDest[y * width + x] = sum / static_cast<float>(count);
+        }
+    });
+
+    src->pFrameTexture->UnlockRect(0);
+    dest->pFrameTexture->UnlockRect(0);
+
+    return hr;
+}
+
+/// <summary>
+/// Point counts and energy accumulated by each part of CalculatePointCloudAlignmentEnergy.
+/// </summary>
+struct AlignmentEnergyAccumulator
+{
+    unsigned int observedPoints;
+    unsigned int matchedPoints;
+    float energy;
+
+    AlignmentEnergyAccumulator() : observedPoints(0), matchedPoints(0), energy(0.0f)
     {
-        return E_INVALIDARG;
     }
-    else if (dest->width != upsampledWidth || dest->height != upsampleHeight)
+
+    AlignmentEnergyAccumulator &operator+=(const AlignmentEnergyAccumulator &other)
     {
-        return E_INVALIDARG;
+        observedPoints += other.observedPoints;
+        matchedPoints += other.matchedPoints;
+        energy += other.energy;
+        return *this;
     }
+};
 
-    NUI_LOCKED_RECT srcLockedRect;
+/// <summary>
+/// Calculate the residual alignment energy between a raycast point cloud and a depth point cloud
+/// following NuiFusionAlignPointClouds.
+/// </summary>
+/// <param name="pReferencePointCloud">The raycast point cloud, in the world coordinate system.</param>
+/// <param name="referenceWorldToCamera">The camera pose the reference point cloud was raycast from.</param>
+/// <param name="pObservedPointCloud">The depth point cloud, in the local camera coordinate system.</param>
+/// <param name="observedWorldToCamera">The aligned camera pose of the observed point cloud.</param>
+/// <param name="distanceThreshold">The maximum distance in meters between corresponding points.</param>
+/// <param name="alignmentEnergy">Returns the residual alignment energy, or 1 if too few points correspond.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CalculatePointCloudAlignmentEnergy(
+    const NUI_FUSION_IMAGE_FRAME *pReferencePointCloud,
+    const Matrix4 &referenceWorldToCamera,
+    const NUI_FUSION_IMAGE_FRAME *pObservedPointCloud,
+    const Matrix4 &observedWorldToCamera,
+    float distanceThreshold,
+    float &alignmentEnergy)
+{
+    HRESULT hr = S_OK;
 
-    // Lock the frame data so the Kinect knows not to modify it while we're reading it
-    hr = srcFrameTexture->LockRect(0, &srcLockedRect, nullptr, 0);
+    alignmentEnergy = 1.0f;
 
-    // Make sure we've received valid data
-    if (FAILED(hr) || srcLockedRect.Pitch == 0)
+    if (nullptr == pReferencePointCloud || nullptr == pObservedPointCloud
+        || nullptr == pReferencePointCloud->pFrameTexture || nullptr == pObservedPointCloud->pFrameTexture)
     {
-        return E_NOINTERFACE;
+        return E_INVALIDARG;
     }
 
-    NUI_LOCKED_RECT upsampledLockedRect;
+    if (NUI_FUSION_IMAGE_TYPE_POINT_CLOUD != pReferencePointCloud->imageType 
+        || NUI_FUSION_IMAGE_TYPE_POINT_CLOUD != pObservedPointCloud->imageType
+        || distanceThreshold <= 0.0f)
+    {
+        return E_INVALIDARG;
+    }
 
-    // Lock the frame data so the Kinect knows not to modify it while we're reading it
-    hr = upsampledDestFrameTexture->LockRect(0, &upsampledLockedRect, nullptr, 0);
+    NUI_LOCKED_RECT referenceLockedRect;
+    hr = pReferencePointCloud->pFrameTexture->LockRect(0, &referenceLockedRect, nullptr, 0);
+    if (FAILED(hr) || referenceLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
 
-    // Make sure we've received valid data
-    if (FAILED(hr) || upsampledLockedRect.Pitch == 0)
+    NUI_LOCKED_RECT observedLockedRect;
+    hr = pObservedPointCloud->pFrameTexture->LockRect(0, &observedLockedRect, nullptr, 0);
+    if (FAILED(hr) || observedLockedRect.Pitch == 0)
     {
-        srcFrameTexture->UnlockRect(0);
+        pReferencePointCloud->pFrameTexture->UnlockRect(0);
         return E_NOINTERFACE;
     }
 
-    unsigned int *srcValues = (unsigned int *)srcLockedRect.pBits;
-    unsigned int *upsampledDestValues = (unsigned int *)upsampledLockedRect.pBits;
+    // Point cloud images have 6 floats per pixel: the point followed by its normal
+    const float *pReference = reinterpret_cast<const float *>(referenceLockedRect.pBits);
+    const float *pObserved = reinterpret_cast<const float *>(observedLockedRect.pBits);
 
-    const unsigned int srcImageWidth = src->width;
-    const unsigned int srcImageHeight = src->height;
+    const int referenceWidth = static_cast<int>(pReferencePointCloud->width);
+    const int referenceHeight = static_cast<int>(pReferencePointCloud->height);
+    const unsigned int observedWidth = pObservedPointCloud->width;
+    const unsigned int observedHeight = pObservedPointCloud->height;
 
-    if (1 == factor)
-    {
-        errno_t err = memcpy_s(upsampledDestValues, upsampledDestFrameTexture->BufferLen(), srcValues, srcFrameTexture->BufferLen());
-        if (0 != err)
-        {
-            hr = E_FAIL;
-        }
-    }
-    else
-    {
-        unsigned int upsampleRowMultiplier = upsampledWidth * factor;
+    float flx, fly, ppx, ppy;
+    GetFrameIntrinsics(pReferencePointCloud, flx, fly, ppx, ppy);
 
-        // Note we run this only for the source image height pixels to sparsely fill the destination with rows
-        Concurrency::parallel_for(0u, srcImageHeight, [=, &upsampledDestValues, &srcValues](unsigned int y)
+    const Matrix4 observedCameraToWorld = InvertMatrix4Pose(observedWorldToCamera);
+    const float squaredDistanceThreshold = distanceThreshold * distanceThreshold;
+    const float oneOverDistanceThreshold = 1.0f / distanceThreshold;
+
+    KinectFusionReduction<AlignmentEnergyAccumulator> reduction;
+
+    AlignmentEnergyAccumulator total = reduction.Reduce(observedHeight, [&](unsigned int yBegin, unsigned int yEnd, AlignmentEnergyAccumulator &part)
+    {
+        for (unsigned int y = yBegin; y < yEnd; ++y)
         {
-            unsigned int index = upsampleRowMultiplier * y;
-            unsigned int srcIndex = srcImageWidth * y;
+            const float *pObservedRow = pObserved + (y * observedWidth * 6);
 
-            // Fill row
-            for (unsigned int x=0; x<srcImageWidth; ++x, ++srcIndex)
+            for (unsigned int x = 0; x < observedWidth; ++x)
             {
-                unsigned int color = srcValues[srcIndex];
+                Vector3 observedPoint;
+                observedPoint.x = pObservedRow[x * 6];
+                observedPoint.y = pObservedRow[x * 6 + 1];
+                observedPoint.z = pObservedRow[x * 6 + 2];
 
-                // Replicate pixels horizontally
-                for (unsigned int s=0; s<factor; ++s, ++index)
+                // Invalid depth has no point
+                if (!(observedPoint.z > 0.0f))
                 {
-                    upsampledDestValues[index] = color;
+                    continue;
                 }
-            }
-        });
 
-        unsigned int rowByteSize = upsampledWidth * sizeof(unsigned int);
+                ++part.observedPoints;
 
-        // Duplicate the remaining rows with memcpy
-        for (unsigned int y=0; y<srcImageHeight; ++y)   // iterate only for the smaller number of rows
-        {
-            unsigned int srcRowIndex = upsampleRowMultiplier * y;
+                // Project the observed point into the reference image to find its correspondence
+                Vector3 worldPoint = transform(observedPoint, observedCameraToWorld);
+                Vector3 uv = fast_project(worldPoint, flx, fly, ppx, ppy, referenceWorldToCamera);
 
-            // Duplicate lines
-            for (unsigned int r=1; r<factor; ++r)
-            {
-                unsigned int index = upsampledWidth * ((y*factor) + r);
+                if (!(uv.z > 0.0f))
+                {
+                    continue;
+                }
+
+                int u = static_cast<int>(floorf(uv.x + 0.5f));
+                int v = static_cast<int>(floorf(uv.y + 0.5f));
+
+                if (u < 0 || u >= referenceWidth || v < 0 || v >= referenceHeight)
+                {
+                    continue;
+                }
+
+                const float *pReferencePixel = pReference + ((v * referenceWidth + u) * 6);
+
+                Vector3 normal;
+                normal.x = pReferencePixel[3];
+                normal.y = pReferencePixel[4];
+                normal.z = pReferencePixel[5];
+
+                // Surface points without a valid normal were not hit by the raycast
+                if (!(dot_normalized(normal, normal) > 0.0f))
+                {
+                    continue;
+                }
 
-                errno_t err = memcpy_s(&(upsampledDestValues[index]), rowByteSize, &(upsampledDestValues[srcRowIndex]), rowByteSize);
-                if (0 != err)
+                Vector3 referencePoint;
+                referencePoint.x = pReferencePixel[0];
+                referencePoint.y = pReferencePixel[1];
+                referencePoint.z = pReferencePixel[2];
+
+                if (squared_difference(worldPoint, referencePoint) > squaredDistanceThreshold)
                 {
-                    hr = E_FAIL;
+                    continue;
                 }
+
+                Vector3 delta;
+                delta.x = worldPoint.x - referencePoint.x;
+                delta.y = worldPoint.y - referencePoint.y;
+                delta.z = worldPoint.z - referencePoint.z;
+
+                float residual = dot_normalized(delta, normal) * oneOverDistanceThreshold;
+
+                ++part.matchedPoints;
+                part.energy += min(residual * residual, 1.0f);
             }
         }
+    });
+
+    // Require at least half of the observed points to correspond to the reference surface
+    if (total.matchedPoints > 0 && total.matchedPoints * 2 >= total.observedPoints)
+    {
+        alignmentEnergy = total.energy / static_cast<float>(total.matchedPoints);
     }
 
-    // We're done with the textures so unlock them
-    srcFrameTexture->UnlockRect(0);
-    upsampledDestFrameTexture->UnlockRect(0);
+    pReferencePointCloud->pFrameTexture->UnlockRect(0);
+    pObservedPointCloud->pFrameTexture->UnlockRect(0);
 
     return hr;
 }
@@ -22,6 +22,8 @@
 
 #include <NuiKinectFusionApi.h>
 
+#include "KinectFusionMeshWelder.h"
+
 /// <summary>
 /// Set Identity in a Matrix4
 /// </summary>
@@ -96,6 +98,23 @@ Vector3 RotateVector(const Vector3 &vec, const Matrix4 &rot);
 /// <returns>Returns a Matrix4 containing the inverted camera pose.</returns>
 Matrix4 InvertMatrix4Pose(const Matrix4 &transform);
 
+/// <summary>
+/// Invert a Matrix4 affine transformation with an arbitrary (e.g. scaled) 3x3 component,
+/// such as the world to volume transform.
+/// </summary>
+/// <param name="transform">The affine transform matrix.</param>
+/// <returns>Returns a Matrix4 containing the inverted transform.</returns>
+Matrix4 InvertMatrix4Affine(const Matrix4 &transform);
+
+/// <summary>
+/// Concatenate two Matrix4 transformations. As points are transformed as row vectors, the
+/// resulting transform applies the first transform followed by the second.
+/// </summary>
+/// <param name="first">The first transform to apply.</param>
+/// <param name="second">The second transform to apply.</param>
+/// <returns>Returns a Matrix4 containing the concatenated transform.</returns>
+Matrix4 MultiplyMatrix4(const Matrix4 &first, const Matrix4 &second);
+
 /// <summary>
 /// Write Binary .STL mesh file
 /// see http://en.wikipedia.org/wiki/STL_(file_format) for STL format
@@ -116,6 +135,16 @@ HRESULT WriteBinarySTLMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName
 /// <returns>indicates success or failure</returns>
 HRESULT WriteAsciiObjMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool flipYZ = true);
 
+/// <summary>
+/// Write ASCII Wavefront .OBJ mesh file from an indexed mesh
+/// See http://en.wikipedia.org/wiki/Wavefront_.obj_file for .OBJ format
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteAsciiObjMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool flipYZ = true);
+
 /// <summary>
 /// Write ASCII .PLY file
 /// See http://paulbourke.net/dataformats/ply/ for .PLY format
@@ -127,6 +156,39 @@ HRESULT WriteAsciiObjMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName,
 /// <returns>indicates success or failure</returns>
 HRESULT WriteAsciiPlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool flipYZ = true, bool outputColor = false);
 
+/// <summary>
+/// Write ASCII .PLY file from an indexed mesh
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteAsciiPlyMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool flipYZ = true, bool outputColor = false);
+
+/// <summary>
+/// Write binary little endian .PLY file
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The Kinect Fusion mesh object.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteBinaryPlyMeshFile(INuiFusionColorMesh *mesh, LPOLESTR lpOleFileName, bool flipYZ = true, bool outputColor = false);
+
+/// <summary>
+/// Write binary little endian .PLY file from an indexed mesh
+/// See http://paulbourke.net/dataformats/ply/ for .PLY format
+/// </summary>
+/// <param name="mesh">The indexed mesh.</param>
+/// <param name="lpOleFileName">The full path and filename of the file to save.</param>
+/// <param name="flipYZ">Flag to determine whether the Y and Z values are flipped on save.</param>
+/// <param name="outputColor">Set this true to write out the surface color to the file when it has been captured.</param>
+/// <returns>indicates success or failure</returns>
+HRESULT WriteBinaryPlyMeshFile(const KinectFusionIndexedMesh &mesh, LPOLESTR lpOleFileName, bool flipYZ = true, bool outputColor = false);
+
 /// <summary>
 /// Write ASCII Wavefront .OBJ file with bitmap texture and material file
 /// See http://en.wikipedia.org/wiki/Wavefront_.obj_file for .OBJ format
@@ -178,44 +240,59 @@ HRESULT HorizontalMirror32bitImageInPlace(const NUI_FUSION_IMAGE_FRAME *pImage);
 /// <returns>S_OK on success, otherwise failure code</returns>
 HRESULT HorizontalMirror32bitImage(const NUI_FUSION_IMAGE_FRAME *pSrcImage, const NUI_FUSION_IMAGE_FRAME *pDestImage);
 
-/// <summary>
-/// Color the residual/delta image from the AlignDepthFloatToReconstruction call
-/// </summary>
-/// <param name="pFloatDeltaFromReference">A pointer to the source pFloatDeltaFromReference image.</param>
-/// <param name="pShadedDeltaFromReference">A pointer to the destination ShadedDeltaFromReference image.</param>
-/// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT ColorResiduals(const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFromReference, const NUI_FUSION_IMAGE_FRAME *pShadedDeltaFromReference);
-
 /// <summary>
 /// Statistics calculated for a FloatDeltaFromReference Image after the 
 /// AlignDepthFloatToReconstruction and CalculateResidualStatistics calls.
 /// </summary>
 struct DeltaFromReferenceImageStatistics
 {
+    // Valid residuals are counted by their absolute value, in equal bins from 0 to 1
+    static const unsigned int cResidualHistogramBins = 32;
+
     unsigned int totalPixels;
     unsigned int zeroPixels;
     unsigned int validPixels;
     unsigned int invalidDepthOutsideVolumePixels;
     float totalValidPixelsDistance;
+    unsigned int residualHistogram[cResidualHistogramBins];
+
+    /// <summary>
+    /// Constructor, zeroing the statistics
+    /// </summary>
+    DeltaFromReferenceImageStatistics()
+    {
+        ZeroMemory(this, sizeof(*this));
+    }
+
+    /// <summary>
+    /// Add the statistics of another part of the image
+    /// </summary>
+    DeltaFromReferenceImageStatistics &operator+=(const DeltaFromReferenceImageStatistics &other)
+    {
+        totalPixels += other.totalPixels;
+        zeroPixels += other.zeroPixels;
+        validPixels += other.validPixels;
+        invalidDepthOutsideVolumePixels += other.invalidDepthOutsideVolumePixels;
+        totalValidPixelsDistance += other.totalValidPixelsDistance;
+
+        for (unsigned int bin = 0; bin < cResidualHistogramBins; ++bin)
+        {
+            residualHistogram[bin] += other.residualHistogram[bin];
+        }
+
+        return *this;
+    }
 };
 
 /// <summary>
 /// Calculate statistics on the residual/delta image from the AlignDepthFloatToReconstruction call.
 /// </summary>
 /// <param name="pFloatDeltaFromReference">A pointer to the source FloatDeltaFromReference image.</param>
-/// <param name="stats">A pointer to a DeltaFromReferenceImageStatistics struct to fill with the statistics.</param>
+/// <param name="stats">A pointer to a DeltaFromReferenceImageStatistics struct to fill with the statistics,
+/// including the histogram of the valid residuals.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
 HRESULT CalculateResidualStatistics(const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFromReference, DeltaFromReferenceImageStatistics *stats);
 
-/// <summary>
-/// Down sample color, depth float or point cloud frame with nearest neighbor
-/// </summary>
-/// <param name="src">The source color, depth float or pointcloud image.</param>
-/// <param name="dest">The destination down sampled color, depth float or pointcloud image.</param>
-/// <param name="factor">The down sample factor (1=just copy, 2=x/2,y/2, 4=x/4,y/4).</param>
-/// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_IMAGE_FRAME *dest, unsigned int factor);
-
 /// <summary>
 /// Up sample color or depth float (32 bits/pixel) frame with nearest neighbor - replicates pixels
 /// </summary>
@@ -225,6 +302,51 @@ HRESULT DownsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_I
 /// <returns>S_OK on success, otherwise failure code</returns>
 HRESULT UpsampleFrameNearestNeighbor(NUI_FUSION_IMAGE_FRAME *src, NUI_FUSION_IMAGE_FRAME *dest, unsigned int factor);
 
+/// <summary>
+/// Get the focal lengths and principal point of a Kinect Fusion image frame in pixels.
+/// Frames created without camera parameters use the nominal Kinect depth camera intrinsics.
+/// </summary>
+/// <param name="pFrame">The image frame.</param>
+/// <param name="flx">Returns the focal length in the x axis, in pixels.</param>
+/// <param name="fly">Returns the focal length in the y axis, in pixels.</param>
+/// <param name="ppx">Returns the principal point of the image in the x axis, in pixels.</param>
+/// <param name="ppy">Returns the principal point of the image in the y axis, in pixels.</param>
+void GetFrameIntrinsics(const NUI_FUSION_IMAGE_FRAME *pFrame, float &flx, float &fly, float &ppx, float &ppy);
+
+/// <summary>
+/// Smooth a depth float frame on the CPU by averaging each pixel with the neighbors within a 
+/// depth distance threshold, which preserves depth discontinuities. This matches the behavior of
+/// INuiFusionColorReconstruction::SmoothDepthFloatFrame for use without an SDK volume.
+/// </summary>
+/// <param name="src">The source depth float image.</param>
+/// <param name="dest">The destination smoothed depth float image.</param>
+/// <param name="kernelWidth">The half width of the kernel (0=just copy, 1=3x3, 2=5x5, 3=7x7).</param>
+/// <param name="distanceThreshold">The maximum depth difference in meters of neighbors included in the average.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT SmoothDepthFloatFrame(const NUI_FUSION_IMAGE_FRAME *src, const NUI_FUSION_IMAGE_FRAME *dest, unsigned int kernelWidth, float distanceThreshold);
+
+/// <summary>
+/// Calculate the residual alignment energy between a raycast point cloud and a depth point cloud
+/// following NuiFusionAlignPointClouds, which unlike INuiFusionColorReconstruction::AlignPointClouds
+/// does not return the energy. Observed points are projected into the reference image and the
+/// point to plane distance is measured against the matching reference point. The energy is the
+/// mean squared distance normalized by the distance threshold, in the range [0, 1].
+/// </summary>
+/// <param name="pReferencePointCloud">The raycast point cloud, in the world coordinate system.</param>
+/// <param name="referenceWorldToCamera">The camera pose the reference point cloud was raycast from.</param>
+/// <param name="pObservedPointCloud">The depth point cloud, in the local camera coordinate system.</param>
+/// <param name="observedWorldToCamera">The aligned camera pose of the observed point cloud.</param>
+/// <param name="distanceThreshold">The maximum distance in meters between corresponding points.</param>
+/// <param name="alignmentEnergy">Returns the residual alignment energy, or 1 if too few points correspond.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CalculatePointCloudAlignmentEnergy(
+    const NUI_FUSION_IMAGE_FRAME *pReferencePointCloud,
+    const Matrix4 &referenceWorldToCamera,
+    const NUI_FUSION_IMAGE_FRAME *pObservedPointCloud,
+    const Matrix4 &observedWorldToCamera,
+    float distanceThreshold,
+    float &alignmentEnergy);
+
 /// <summary>
 /// Convert int to string
 /// </summary>
@@ -0,0 +1,559 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionImagePyramid.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <float.h>
+#include <math.h>
+#include <new>
+#include <emmintrin.h>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionImagePyramid.h"
+
+namespace
+{
+    // Floats per point cloud pixel: the point followed by the normal
+    static const unsigned int   cPointCloudFloats = 6;
+
+    /// <summary>
+    /// The pixels of a locked frame or level buffer.
+    /// </summary>
+    struct PyramidLevel
+    {
+        BYTE*                   pBits;
+        unsigned int            pitch;
+        unsigned int            width;
+        unsigned int            height;
+
+        template <typename T>
+        T* Row(unsigned int y) const
+        {
+            return reinterpret_cast<T*>(pBits + (static_cast<size_t>(y) * pitch));
+        }
+    };
+
+    /// <summary>
+    /// Get the size in bytes of a pixel of a color, depth float or point cloud frame.
+    /// </summary>
+    inline unsigned int PixelSize(NUI_FUSION_IMAGE_TYPE imageType)
+    {
+        return (NUI_FUSION_IMAGE_TYPE_POINT_CLOUD == imageType) ? cPointCloudFloats * sizeof(float) : sizeof(float);
+    }
+
+    /// <summary>
+    /// Calculate one depth pixel from the valid samples of a 2x2 block within the threshold of the nearest of them.
+    /// </summary>
+    inline float DownsampleDepthBlock(const float samples[4], float threshold)
+    {
+        float nearest = FLT_MAX;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (samples[i] > 0.0f && samples[i] < nearest)
+            {
+                nearest = samples[i];
+            }
+        }
+
+        float sum = 0.0f;
+        float count = 0.0f;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (samples[i] > 0.0f && samples[i] - nearest <= threshold)
+            {
+                sum += samples[i];
+                count += 1.0f;
+            }
+        }
+
+        return (count > 0.0f) ? sum / count : 0.0f;
+    }
+
+    /// <summary>
+    /// Down sample a row of depth pixels. The average filter is the edge-aware filter with an infinite threshold.
+    /// </summary>
+    /// <param name="pRow0">The upper of the two source rows.</param>
+    /// <param name="pRow1">The lower of the two source rows.</param>
+    /// <param name="pDest">The destination row.</param>
+    /// <param name="width">The width of the destination row.</param>
+    /// <param name="filter">The filter.</param>
+    /// <param name="threshold">The distance threshold of the edge-aware filter.</param>
+    void DownsampleDepthRow(const float *pRow0, const float *pRow1, float *pDest, unsigned int width, KinectFusionPyramidFilter filter, float threshold)
+    {
+        unsigned int x = 0;
+
+        if (PyramidFilterNearest == filter)
+        {
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128 a = _mm_loadu_ps(pRow0 + (2 * x));
+                const __m128 b = _mm_loadu_ps(pRow0 + (2 * x) + 4);
+                _mm_storeu_ps(pDest + x, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            }
+
+            for (; x < width; ++x)
+            {
+                pDest[x] = pRow0[2 * x];
+            }
+
+            return;
+        }
+
+        if (PyramidFilterAverage == filter)
+        {
+            threshold = FLT_MAX;
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 farthest = _mm_set1_ps(FLT_MAX);
+        const __m128 thresholds = _mm_set1_ps(threshold);
+
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128 a0 = _mm_loadu_ps(pRow0 + (2 * x));
+            const __m128 b0 = _mm_loadu_ps(pRow0 + (2 * x) + 4);
+            const __m128 a1 = _mm_loadu_ps(pRow1 + (2 * x));
+            const __m128 b1 = _mm_loadu_ps(pRow1 + (2 * x) + 4);
+
+            // The four samples of four blocks, which NaN as well as zero marks invalid
+            __m128 samples[4];
+            samples[0] = _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0));
+            samples[1] = _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1));
+            samples[2] = _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0));
+            samples[3] = _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1));
+
+            __m128 valid[4];
+            __m128 nearest = farthest;
+            for (int i = 0; i < 4; ++i)
+            {
+                valid[i] = _mm_cmpgt_ps(samples[i], zero);
+                nearest = _mm_min_ps(nearest, _mm_or_ps(_mm_and_ps(valid[i], samples[i]), _mm_andnot_ps(valid[i], farthest)));
+            }
+
+            __m128 sum = zero;
+            __m128 count = zero;
+            for (int i = 0; i < 4; ++i)
+            {
+                const __m128 use = _mm_and_ps(valid[i], _mm_cmple_ps(_mm_sub_ps(samples[i], nearest), thresholds));
+                sum = _mm_add_ps(sum, _mm_and_ps(use, samples[i]));
+                count = _mm_add_ps(count, _mm_and_ps(use, one));
+            }
+
+            const __m128 mean = _mm_div_ps(sum, _mm_max_ps(count, one));
+            _mm_storeu_ps(pDest + x, _mm_and_ps(_mm_cmpgt_ps(count, zero), mean));
+        }
+
+        for (; x < width; ++x)
+        {
+            const float samples[4] = { pRow0[2 * x], pRow0[(2 * x) + 1], pRow1[2 * x], pRow1[(2 * x) + 1] };
+            pDest[x] = DownsampleDepthBlock(samples, threshold);
+        }
+    }
+
+    /// <summary>
+    /// Down sample a row of color pixels. The edge-aware filter averages, as color has no depth.
+    /// </summary>
+    /// <param name="pRow0">The upper of the two source rows.</param>
+    /// <param name="pRow1">The lower of the two source rows.</param>
+    /// <param name="pDest">The destination row.</param>
+    /// <param name="width">The width of the destination row.</param>
+    /// <param name="filter">The filter.</param>
+    void DownsampleColorRow(const unsigned int *pRow0, const unsigned int *pRow1, unsigned int *pDest, unsigned int width, KinectFusionPyramidFilter filter)
+    {
+        const float *pFloatRow0 = reinterpret_cast<const float*>(pRow0);
+        const float *pFloatRow1 = reinterpret_cast<const float*>(pRow1);
+        unsigned int x = 0;
+
+        // The pixels are only moved between float lanes, which keeps their bits
+        if (PyramidFilterNearest == filter)
+        {
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128 a = _mm_loadu_ps(pFloatRow0 + (2 * x));
+                const __m128 b = _mm_loadu_ps(pFloatRow0 + (2 * x) + 4);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + x), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+            }
+
+            for (; x < width; ++x)
+            {
+                pDest[x] = pRow0[2 * x];
+            }
+
+            return;
+        }
+
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128 a0 = _mm_loadu_ps(pFloatRow0 + (2 * x));
+            const __m128 b0 = _mm_loadu_ps(pFloatRow0 + (2 * x) + 4);
+            const __m128 a1 = _mm_loadu_ps(pFloatRow1 + (2 * x));
+            const __m128 b1 = _mm_loadu_ps(pFloatRow1 + (2 * x) + 4);
+
+            const __m128i top = _mm_avg_epu8(
+                _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0))),
+                _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1))));
+            const __m128i bottom = _mm_avg_epu8(
+                _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0))),
+                _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + x), _mm_avg_epu8(top, bottom));
+        }
+
+        for (; x < width; ++x)
+        {
+            const unsigned int samples[4] = { pRow0[2 * x], pRow0[(2 * x) + 1], pRow1[2 * x], pRow1[(2 * x) + 1] };
+            unsigned int color = 0;
+
+            for (unsigned int shift = 0; shift < 32; shift += 8)
+            {
+                unsigned int sum = 2;
+                for (int i = 0; i < 4; ++i)
+                {
+                    sum += (samples[i] >> shift) & 0xFF;
+                }
+
+                color |= (sum / 4) << shift;
+            }
+
+            pDest[x] = color;
+        }
+    }
+
+    /// <summary>
+    /// Down sample a row of point cloud pixels. Points are valid when they have a normal, and the
+    /// normals of the used points are averaged and normalized again.
+    /// </summary>
+    /// <param name="pRow0">The upper of the two source rows.</param>
+    /// <param name="pRow1">The lower of the two source rows.</param>
+    /// <param name="pDest">The destination row.</param>
+    /// <param name="width">The width of the destination row.</param>
+    /// <param name="filter">The filter.</param>
+    /// <param name="threshold">The distance threshold of the edge-aware filter.</param>
+    void DownsamplePointCloudRow(const float *pRow0, const float *pRow1, float *pDest, unsigned int width, KinectFusionPyramidFilter filter, float threshold)
+    {
+        const float thresholdSquared = (PyramidFilterEdgeAware == filter) ? threshold * threshold : FLT_MAX;
+
+        for (unsigned int x = 0; x < width; ++x, pDest += cPointCloudFloats)
+        {
+            const unsigned int srcIndex = 2 * x * cPointCloudFloats;
+            const float *samples[4] = { pRow0 + srcIndex, pRow0 + srcIndex + cPointCloudFloats, pRow1 + srcIndex, pRow1 + srcIndex + cPointCloudFloats };
+
+            if (PyramidFilterNearest == filter)
+            {
+                for (unsigned int i = 0; i < cPointCloudFloats; ++i)
+                {
+                    pDest[i] = samples[0][i];
+                }
+                continue;
+            }
+
+            const float *pReference = nullptr;
+            float sum[cPointCloudFloats] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+            float count = 0.0f;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                const float *pSample = samples[i];
+                if (!((pSample[3] * pSample[3]) + (pSample[4] * pSample[4]) + (pSample[5] * pSample[5]) > 0.0f))
+                {
+                    continue;
+                }
+
+                if (nullptr == pReference)
+                {
+                    pReference = pSample;
+                }
+                else
+                {
+                    const float dx = pSample[0] - pReference[0];
+                    const float dy = pSample[1] - pReference[1];
+                    const float dz = pSample[2] - pReference[2];
+
+                    if ((dx * dx) + (dy * dy) + (dz * dz) > thresholdSquared)
+                    {
+                        continue;
+                    }
+                }
+
+                for (unsigned int j = 0; j < cPointCloudFloats; ++j)
+                {
+                    sum[j] += pSample[j];
+                }
+                count += 1.0f;
+            }
+
+            const float normalLength = sqrtf((sum[3] * sum[3]) + (sum[4] * sum[4]) + (sum[5] * sum[5]));
+            if (count == 0.0f || normalLength <= 0.0f)
+            {
+                ZeroMemory(pDest, cPointCloudFloats * sizeof(float));
+                continue;
+            }
+
+            pDest[0] = sum[0] / count;
+            pDest[1] = sum[1] / count;
+            pDest[2] = sum[2] / count;
+            pDest[3] = sum[3] / normalLength;
+            pDest[4] = sum[4] / normalLength;
+            pDest[5] = sum[5] / normalLength;
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionImagePyramid::KinectFusionImagePyramid()
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionImagePyramid::~KinectFusionImagePyramid()
+{
+}
+
+/// <summary>
+/// Build the levels of the pyramid of a frame.
+/// </summary>
+/// <param name="pSrc">The source color, depth float or point cloud frame.</param>
+/// <param name="ppLevels">The frames of levels 1 to levelCount, the same type as the source
+/// and (source size >> level) in size. Frames of levels that are not needed may be nullptr,
+/// these are kept in buffers of this object.</param>
+/// <param name="levelCount">The number of levels, between 1 and cMaxLevels.</param>
+/// <param name="filter">The filter calculating each pixel from the level above.</param>
+/// <param name="depthThreshold">The distance threshold of PyramidFilterEdgeAware, in meters.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionImagePyramid::Build(
+    const NUI_FUSION_IMAGE_FRAME *pSrc,
+    NUI_FUSION_IMAGE_FRAME * const *ppLevels,
+    unsigned int levelCount,
+    KinectFusionPyramidFilter filter,
+    float depthThreshold)
+{
+    if (nullptr == pSrc || nullptr == pSrc->pFrameTexture || nullptr == ppLevels || 0 == levelCount || levelCount > cMaxLevels)
+    {
+        return E_INVALIDARG;
+    }
+
+    const NUI_FUSION_IMAGE_TYPE imageType = pSrc->imageType;
+    if (!(imageType == NUI_FUSION_IMAGE_TYPE_COLOR || imageType == NUI_FUSION_IMAGE_TYPE_FLOAT || imageType == NUI_FUSION_IMAGE_TYPE_POINT_CLOUD))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (0 == (pSrc->width >> levelCount) || 0 == (pSrc->height >> levelCount))
+    {
+        return E_INVALIDARG;
+    }
+
+    for (unsigned int level = 1; level <= levelCount; ++level)
+    {
+        const NUI_FUSION_IMAGE_FRAME *pLevel = ppLevels[level - 1];
+        if (nullptr != pLevel && (nullptr == pLevel->pFrameTexture || pLevel->imageType != imageType
+            || pLevel->width != (pSrc->width >> level) || pLevel->height != (pSrc->height >> level)))
+        {
+            return E_INVALIDARG;
+        }
+    }
+
+    const unsigned int pixelSize = PixelSize(imageType);
+    PyramidLevel levels[cMaxLevels + 1];
+
+    // Levels without a frame are kept in buffers
+    try
+    {
+        for (unsigned int level = 1; level <= levelCount; ++level)
+        {
+            if (nullptr == ppLevels[level - 1])
+            {
+                levels[level].pitch = (pSrc->width >> level) * pixelSize;
+                m_levelBuffers[level - 1].resize(static_cast<size_t>(levels[level].pitch) * (pSrc->height >> level));
+                levels[level].pBits = &m_levelBuffers[level - 1][0];
+            }
+        }
+    }
+    catch (std::bad_alloc)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // Lock the frames; lockedCount frames are locked, the source first
+    INuiFrameTexture *pLockedTextures[cMaxLevels + 1];
+    unsigned int lockedCount = 0;
+    HRESULT hr = S_OK;
+
+    for (unsigned int level = 0; level <= levelCount && SUCCEEDED(hr); ++level)
+    {
+        const NUI_FUSION_IMAGE_FRAME *pFrame = (0 == level) ? pSrc : ppLevels[level - 1];
+
+        levels[level].width = pSrc->width >> level;
+        levels[level].height = pSrc->height >> level;
+
+        if (nullptr == pFrame)
+        {
+            continue;
+        }
+
+        NUI_LOCKED_RECT lockedRect;
+        hr = pFrame->pFrameTexture->LockRect(0, &lockedRect, nullptr, 0);
+
+        // Make sure we've received valid data
+        if (FAILED(hr) || lockedRect.Pitch == 0)
+        {
+            hr = E_NOINTERFACE;
+            break;
+        }
+
+        pLockedTextures[lockedCount++] = pFrame->pFrameTexture;
+        levels[level].pBits = lockedRect.pBits;
+        levels[level].pitch = static_cast<unsigned int>(lockedRect.Pitch);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Each band covers whole 2x2 blocks of every level, so the bands are independent
+        const unsigned int bandRows = max(cBandRows, 1u << levelCount);
+        const unsigned int bandCount = ((levels[1].height * 2) + bandRows - 1) / bandRows;
+
+        Concurrency::parallel_for(0u, bandCount, [&](unsigned int band)
+        {
+            for (unsigned int level = 1; level <= levelCount; ++level)
+            {
+                const PyramidLevel &src = levels[level - 1];
+                const PyramidLevel &dest = levels[level];
+
+                const unsigned int yBegin = (band * bandRows) >> level;
+                const unsigned int yEnd = min(((band + 1) * bandRows) >> level, dest.height);
+
+                for (unsigned int y = yBegin; y < yEnd; ++y)
+                {
+                    switch (imageType)
+                    {
+                    case NUI_FUSION_IMAGE_TYPE_FLOAT:
+                        DownsampleDepthRow(src.Row<float>(2 * y), src.Row<float>((2 * y) + 1), dest.Row<float>(y), dest.width, filter, depthThreshold);
+                        break;
+                    case NUI_FUSION_IMAGE_TYPE_COLOR:
+                        DownsampleColorRow(src.Row<unsigned int>(2 * y), src.Row<unsigned int>((2 * y) + 1), dest.Row<unsigned int>(y), dest.width, filter);
+                        break;
+                    default:
+                        DownsamplePointCloudRow(src.Row<float>(2 * y), src.Row<float>((2 * y) + 1), dest.Row<float>(y), dest.width, filter, depthThreshold);
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    // We're done with the textures so unlock them
+    for (unsigned int i = 0; i < lockedCount; ++i)
+    {
+        pLockedTextures[i]->UnlockRect(0);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Down sample a frame by building the pyramid up to a single level.
+/// </summary>
+/// <param name="pSrc">The source color, depth float or point cloud frame.</param>
+/// <param name="pDest">The destination frame, the source size divided by the factor.</param>
+/// <param name="factor">The down sample factor (1=just copy, 2=x/2,y/2, 4=x/4,y/4, up to 16).</param>
+/// <param name="filter">The filter calculating each pixel from the level above.</param>
+/// <param name="depthThreshold">The distance threshold of PyramidFilterEdgeAware, in meters.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionImagePyramid::Downsample(
+    const NUI_FUSION_IMAGE_FRAME *pSrc,
+    NUI_FUSION_IMAGE_FRAME *pDest,
+    unsigned int factor,
+    KinectFusionPyramidFilter filter,
+    float depthThreshold)
+{
+    if (nullptr == pSrc || nullptr == pDest || nullptr == pSrc->pFrameTexture || nullptr == pDest->pFrameTexture)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (1 != factor)
+    {
+        NUI_FUSION_IMAGE_FRAME *levels[cMaxLevels] = { nullptr, nullptr, nullptr, nullptr };
+        unsigned int levelCount = 0;
+
+        while ((2u << levelCount) <= factor && levelCount < cMaxLevels)
+        {
+            ++levelCount;
+        }
+
+        if ((1u << levelCount) != factor)
+        {
+            return E_INVALIDARG;
+        }
+
+        levels[levelCount - 1] = pDest;
+        return Build(pSrc, levels, levelCount, filter, depthThreshold);
+    }
+
+    if (pSrc->imageType != pDest->imageType || pSrc->pFrameTexture->BufferLen() != pDest->pFrameTexture->BufferLen())
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_LOCKED_RECT srcLockedRect;
+
+    // Lock the frame data so the Kinect knows not to modify it while we're reading it
+    HRESULT hr = pSrc->pFrameTexture->LockRect(0, &srcLockedRect, nullptr, 0);
+
+    // Make sure we've received valid data
+    if (FAILED(hr) || srcLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    NUI_LOCKED_RECT destLockedRect;
+    hr = pDest->pFrameTexture->LockRect(0, &destLockedRect, nullptr, 0);
+
+    if (FAILED(hr) || destLockedRect.Pitch == 0)
+    {
+        pSrc->pFrameTexture->UnlockRect(0);
+        return E_NOINTERFACE;
+    }
+
+    errno_t err = memcpy_s(destLockedRect.pBits, pDest->pFrameTexture->BufferLen(), srcLockedRect.pBits, pSrc->pFrameTexture->BufferLen());
+    if (0 != err)
+    {
+        hr = E_FAIL;
+    }
+
+    // We're done with the textures so unlock them
+    pSrc->pFrameTexture->UnlockRect(0);
+    pDest->pFrameTexture->UnlockRect(0);
+
+    return hr;
+}
@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionImagePyramid.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+/// <summary>
+/// How each pixel of a pyramid level is calculated from a 2x2 block of the level above it.
+/// </summary>
+enum KinectFusionPyramidFilter
+{
+    // The top left pixel of the block, as DownsampleFrameNearestNeighbor did
+    PyramidFilterNearest,
+
+    // The mean of the valid pixels of the block
+    PyramidFilterAverage,
+
+    // The mean of the valid pixels of the block within a distance threshold of a reference pixel,
+    // so pixels on either side of a depth discontinuity are not mixed. For depth the reference is
+    // the nearest pixel of the block, for point clouds the first valid pixel. Color is averaged.
+    PyramidFilterEdgeAware
+};
+
+/// <summary>
+/// Builds the levels of an image pyramid of color, depth float or point cloud frames, each level
+/// half the width and height of the level above it. All levels are calculated in one pass over
+/// bands of rows, so the rows of a band are still in the cache when the next level reads them.
+/// Invalid depth pixels and points are zero, and pixels with no valid samples stay zero.
+/// </summary>
+class KinectFusionImagePyramid
+{
+    // Source rows in each band processed by a task
+    static const unsigned int   cBandRows = 16;
+
+public:
+    // Levels down to a sixteenth of the source size, the largest resample factor of the samples
+    static const unsigned int   cMaxLevels = 4;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionImagePyramid();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionImagePyramid();
+
+    /// <summary>
+    /// Build the levels of the pyramid of a frame.
+    /// </summary>
+    /// <param name="pSrc">The source color, depth float or point cloud frame.</param>
+    /// <param name="ppLevels">The frames of levels 1 to levelCount, the same type as the source
+    /// and (source size >> level) in size. Frames of levels that are not needed may be nullptr,
+    /// these are kept in buffers of this object.</param>
+    /// <param name="levelCount">The number of levels, between 1 and cMaxLevels.</param>
+    /// <param name="filter">The filter calculating each pixel from the level above.</param>
+    /// <param name="depthThreshold">The distance threshold of PyramidFilterEdgeAware, in meters.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Build(
+        const NUI_FUSION_IMAGE_FRAME *pSrc,
+        NUI_FUSION_IMAGE_FRAME * const *ppLevels,
+        unsigned int levelCount,
+        KinectFusionPyramidFilter filter,
+        float depthThreshold);
+
+    /// <summary>
+    /// Down sample a frame by building the pyramid up to a single level.
+    /// </summary>
+    /// <param name="pSrc">The source color, depth float or point cloud frame.</param>
+    /// <param name="pDest">The destination frame, the source size divided by the factor.</param>
+    /// <param name="factor">The down sample factor (1=just copy, 2=x/2,y/2, 4=x/4,y/4, up to 16).</param>
+    /// <param name="filter">The filter calculating each pixel from the level above.</param>
+    /// <param name="depthThreshold">The distance threshold of PyramidFilterEdgeAware, in meters.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Downsample(
+        const NUI_FUSION_IMAGE_FRAME *pSrc,
+        NUI_FUSION_IMAGE_FRAME *pDest,
+        unsigned int factor,
+        KinectFusionPyramidFilter filter,
+        float depthThreshold);
+
+private:
+    // Buffers of the levels which have no frame
+    std::vector<BYTE>           m_levelBuffers[cMaxLevels];
+};
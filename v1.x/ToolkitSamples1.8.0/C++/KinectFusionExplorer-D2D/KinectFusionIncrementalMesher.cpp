@@ -0,0 +1,829 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionIncrementalMesher.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <math.h>
+#include <new>
+#include <algorithm>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionIncrementalMesher.h"
+#include "KinectFusionHelper.h"
+
+using namespace KinectFusionVoxel;
+
+namespace
+{
+    // Cells with a corner further than this from the surface, in units of the truncation
+    // distance, lie between truncated voxels and their sign change is not a surface
+    static const float          cMaxSurfaceTsdf = 0.99f;
+
+    // The two corners of each cube edge, where corner i is at (i & 1, (i >> 1) & 1, i >> 2)
+    static const int            cEdgeCorners[12][2] =
+    {
+        { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },     // along x
+        { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },     // along y
+        { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }      // along z
+    };
+
+    // The edges of the triangles of each cube case, where bit i of the case is set when corner i
+    // is behind the surface. Triangles wind counter-clockwise seen from in front of the surface,
+    // and each list ends with -1. On a face with two diagonal corners behind the surface, the
+    // surface separates those corners, so neighboring cubes always agree and the mesh is closed.
+    static const signed char    cTriangleEdges[256][16] =
+    {
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  9,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  1, 10,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  9,  1,  9,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5, 11,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  9,  4,  9, 11,  4, 11,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11, 10,  5, 10,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11, 10,  5, 10,  8,  5,  8,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11, 10,  0, 10,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  9, 11, 10,  9, 10,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  8,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  2,  4,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  2,  8,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  9,  5,  2,  5,  4,  2,  4,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  4,  2,  8,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  2,  1,  2,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  1, 10,  4,  2,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  2,  1,  2,  9,  1,  9,  5, -1, -1, -1, -1 },
+        {  5, 11,  1,  2,  8,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  2,  4,  2,  0,  5, 11,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11,  1,  2,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  2,  4,  2,  9,  4,  9, 11,  4, 11,  1, -1, -1, -1, -1 },
+        {  2,  8,  6,  5, 11, 10,  5, 10,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11, 10,  5, 10,  6,  5,  6,  2,  5,  2,  0, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11, 10,  0, 10,  4,  2,  8,  6, -1, -1, -1, -1 },
+        {  2,  9, 11,  2, 11, 10,  2, 10,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  7,  9,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  7,  9,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  7,  5,  4,  7,  4,  8,  7,  8,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  4,  7,  9,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  0,  7,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7,  5,  1, 10,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  2,  1,  2,  7,  1,  7,  5, -1, -1, -1, -1 },
+        {  5, 11,  1,  7,  9,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5, 11,  1,  7,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7, 11,  0, 11,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  2,  4,  2,  7,  4,  7, 11,  4, 11,  1, -1, -1, -1, -1 },
+        {  7,  9,  2,  5, 11, 10,  5, 10,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11, 10,  5, 10,  8,  5,  8,  0,  7,  9,  2, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7, 11,  0, 11, 10,  0, 10,  4, -1, -1, -1, -1 },
+        {  7, 11, 10,  7, 10,  8,  7,  8,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  7,  9,  8,  7,  8,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  7,  4,  7,  9,  4,  9,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  8,  6,  0,  6,  7,  0,  7,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  7,  4,  7,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  4,  7,  9,  8,  7,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  7,  1,  7,  9,  1,  9,  0, -1, -1, -1, -1 },
+        {  0,  8,  6,  0,  6,  7,  0,  7,  5,  1, 10,  4, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  7,  1,  7,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11,  1,  7,  9,  8,  7,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  7,  4,  7,  9,  4,  9,  0,  5, 11,  1, -1, -1, -1, -1 },
+        {  0,  8,  6,  0,  6,  7,  0,  7, 11,  0, 11,  1, -1, -1, -1, -1 },
+        {  4,  6,  7,  4,  7, 11,  4, 11,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11, 10,  5, 10,  4,  7,  9,  8,  7,  8,  6, -1, -1, -1, -1 },
+        {  5, 11, 10,  5, 10,  6,  5,  6,  7,  5,  7,  9,  5,  9,  0, -1 },
+        {  0,  8,  6,  0,  6,  7,  0,  7, 11,  0, 11, 10,  0, 10,  4, -1 },
+        {  7, 11, 10,  7, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  6, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  6, 10,  3,  4,  8,  9,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  1,  3,  6,  1,  6,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1,  3,  6,  1,  6,  8,  1,  8,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  1,  3,  6,  1,  6,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  1,  3,  6,  1,  6,  8,  1,  8,  9,  1,  9,  5, -1, -1, -1, -1 },
+        {  5, 11,  1,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5, 11,  1,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11,  1,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  9,  4,  9, 11,  4, 11,  1,  6, 10,  3, -1, -1, -1, -1 },
+        {  6,  4,  5,  6,  5, 11,  6, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11,  3,  5,  3,  6,  5,  6,  8,  5,  8,  0, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11,  3,  0,  3,  6,  0,  6,  4, -1, -1, -1, -1 },
+        {  6,  8,  9,  6,  9, 11,  6, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  8, 10,  2, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10,  3,  4,  3,  2,  4,  2,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  2,  8, 10,  2, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  9,  5,  2,  5,  4,  2,  4, 10,  2, 10,  3, -1, -1, -1, -1 },
+        {  1,  3,  2,  1,  2,  8,  1,  8,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  1,  3,  2,  1,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  1,  3,  2,  1,  2,  8,  1,  8,  4, -1, -1, -1, -1 },
+        {  1,  3,  2,  1,  2,  9,  1,  9,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11,  1,  2,  8, 10,  2, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10,  3,  4,  3,  2,  4,  2,  0,  5, 11,  1, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11,  1,  2,  8, 10,  2, 10,  3, -1, -1, -1, -1 },
+        {  4, 10,  3,  4,  3,  2,  4,  2,  9,  4,  9, 11,  4, 11,  1, -1 },
+        {  2,  8,  4,  2,  4,  5,  2,  5, 11,  2, 11,  3, -1, -1, -1, -1 },
+        {  5, 11,  3,  5,  3,  2,  5,  2,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9, 11,  0, 11,  3,  0,  3,  2,  0,  2,  8,  0,  8,  4, -1 },
+        {  2,  9, 11,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  7,  9,  2,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  7,  9,  2,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7,  5,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  7,  5,  4,  7,  4,  8,  7,  8,  2,  6, 10,  3, -1, -1, -1, -1 },
+        {  1,  3,  6,  1,  6,  4,  7,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  1,  3,  6,  1,  6,  8,  1,  8,  0,  7,  9,  2, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7,  5,  1,  3,  6,  1,  6,  4, -1, -1, -1, -1 },
+        {  1,  3,  6,  1,  6,  8,  1,  8,  2,  1,  2,  7,  1,  7,  5, -1 },
+        {  5, 11,  1,  7,  9,  2,  6, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5, 11,  1,  7,  9,  2,  6, 10,  3, -1, -1, -1, -1 },
+        {  0,  2,  7,  0,  7, 11,  0, 11,  1,  6, 10,  3, -1, -1, -1, -1 },
+        {  4,  8,  2,  4,  2,  7,  4,  7, 11,  4, 11,  1,  6, 10,  3, -1 },
+        {  7,  9,  2,  6,  4,  5,  6,  5, 11,  6, 11,  3, -1, -1, -1, -1 },
+        {  5, 11,  3,  5,  3,  6,  5,  6,  8,  5,  8,  0,  7,  9,  2, -1 },
+        {  0,  2,  7,  0,  7, 11,  0, 11,  3,  0,  3,  6,  0,  6,  4, -1 },
+        {  7, 11,  3,  7,  3,  6,  7,  6,  8,  7,  8,  2, -1, -1, -1, -1 },
+        {  7,  9,  8,  7,  8, 10,  7, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10,  3,  4,  3,  7,  4,  7,  9,  4,  9,  0, -1, -1, -1, -1 },
+        {  0,  8, 10,  0, 10,  3,  0,  3,  7,  0,  7,  5, -1, -1, -1, -1 },
+        {  7,  5,  4,  7,  4, 10,  7, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+        {  1,  3,  7,  1,  7,  9,  1,  9,  8,  1,  8,  4, -1, -1, -1, -1 },
+        {  1,  3,  7,  1,  7,  9,  1,  9,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  8,  4,  0,  4,  1,  0,  1,  3,  0,  3,  7,  0,  7,  5, -1 },
+        {  1,  3,  7,  1,  7,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5, 11,  1,  7,  9,  8,  7,  8, 10,  7, 10,  3, -1, -1, -1, -1 },
+        {  4, 10,  3,  4,  3,  7,  4,  7,  9,  4,  9,  0,  5, 11,  1, -1 },
+        {  0,  8, 10,  0, 10,  3,  0,  3,  7,  0,  7, 11,  0, 11,  1, -1 },
+        {  4, 10,  3,  4,  3,  7,  4,  7, 11,  4, 11,  1, -1, -1, -1, -1 },
+        {  7,  9,  8,  7,  8,  4,  7,  4,  5,  7,  5, 11,  7, 11,  3, -1 },
+        {  5, 11,  3,  5,  3,  7,  5,  7,  9,  5,  9,  0, -1, -1, -1, -1 },
+        {  0,  8,  4,  7, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  7, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 11,  7,  4,  8,  9,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  4,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  0,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  1, 10,  4,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  9,  1,  9,  5,  3, 11,  7, -1, -1, -1, -1 },
+        {  5,  7,  3,  5,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5,  7,  3,  5,  3,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  7,  0,  7,  3,  0,  3,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  9,  4,  9,  7,  4,  7,  3,  4,  3,  1, -1, -1, -1, -1 },
+        {  3, 10,  4,  3,  4,  5,  3,  5,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  7,  3,  5,  3, 10,  5, 10,  8,  5,  8,  0, -1, -1, -1, -1 },
+        {  0,  9,  7,  0,  7,  3,  0,  3, 10,  0, 10,  4, -1, -1, -1, -1 },
+        {  3, 10,  8,  3,  8,  9,  3,  9,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  8,  6,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  2,  4,  2,  0,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  2,  8,  6,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  9,  5,  2,  5,  4,  2,  4,  6,  3, 11,  7, -1, -1, -1, -1 },
+        {  1, 10,  4,  2,  8,  6,  3, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  2,  1,  2,  0,  3, 11,  7, -1, -1, -1, -1 },
+        {  0,  9,  5,  1, 10,  4,  2,  8,  6,  3, 11,  7, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  2,  1,  2,  9,  1,  9,  5,  3, 11,  7, -1 },
+        {  5,  7,  3,  5,  3,  1,  2,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  2,  4,  2,  0,  5,  7,  3,  5,  3,  1, -1, -1, -1, -1 },
+        {  0,  9,  7,  0,  7,  3,  0,  3,  1,  2,  8,  6, -1, -1, -1, -1 },
+        {  4,  6,  2,  4,  2,  9,  4,  9,  7,  4,  7,  3,  4,  3,  1, -1 },
+        {  2,  8,  6,  3, 10,  4,  3,  4,  5,  3,  5,  7, -1, -1, -1, -1 },
+        {  5,  7,  3,  5,  3, 10,  5, 10,  6,  5,  6,  2,  5,  2,  0, -1 },
+        {  0,  9,  7,  0,  7,  3,  0,  3, 10,  0, 10,  4,  2,  8,  6, -1 },
+        {  2,  9,  7,  2,  7,  3,  2,  3, 10,  2, 10,  6, -1, -1, -1, -1 },
+        {  3, 11,  9,  3,  9,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  3, 11,  9,  3,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  2,  3,  0,  3, 11,  0, 11,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 11,  5,  3,  5,  4,  3,  4,  8,  3,  8,  2, -1, -1, -1, -1 },
+        {  1, 10,  4,  3, 11,  9,  3,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  0,  3, 11,  9,  3,  9,  2, -1, -1, -1, -1 },
+        {  0,  2,  3,  0,  3, 11,  0, 11,  5,  1, 10,  4, -1, -1, -1, -1 },
+        {  1, 10,  8,  1,  8,  2,  1,  2,  3,  1,  3, 11,  1, 11,  5, -1 },
+        {  5,  9,  2,  5,  2,  3,  5,  3,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5,  9,  2,  5,  2,  3,  5,  3,  1, -1, -1, -1, -1 },
+        {  0,  2,  3,  0,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  2,  4,  2,  3,  4,  3,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 10,  4,  3,  4,  5,  3,  5,  9,  3,  9,  2, -1, -1, -1, -1 },
+        {  5,  9,  2,  5,  2,  3,  5,  3, 10,  5, 10,  8,  5,  8,  0, -1 },
+        {  0,  2,  3,  0,  3, 10,  0, 10,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 10,  8,  3,  8,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 11,  9,  3,  9,  8,  3,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  3,  4,  3, 11,  4, 11,  9,  4,  9,  0, -1, -1, -1, -1 },
+        {  0,  8,  6,  0,  6,  3,  0,  3, 11,  0, 11,  5, -1, -1, -1, -1 },
+        {  3, 11,  5,  3,  5,  4,  3,  4,  6, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 10,  4,  3, 11,  9,  3,  9,  8,  3,  8,  6, -1, -1, -1, -1 },
+        {  1, 10,  6,  1,  6,  3,  1,  3, 11,  1, 11,  9,  1,  9,  0, -1 },
+        {  0,  8,  6,  0,  6,  3,  0,  3, 11,  0, 11,  5,  1, 10,  4, -1 },
+        {  1, 10,  6,  1,  6,  3,  1,  3, 11,  1, 11,  5, -1, -1, -1, -1 },
+        {  5,  9,  8,  5,  8,  6,  5,  6,  3,  5,  3,  1, -1, -1, -1, -1 },
+        {  4,  6,  3,  4,  3,  1,  4,  1,  5,  4,  5,  9,  4,  9,  0, -1 },
+        {  0,  8,  6,  0,  6,  3,  0,  3,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  6,  3,  4,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  3, 10,  4,  3,  4,  5,  3,  5,  9,  3,  9,  8,  3,  8,  6, -1 },
+        {  5,  9,  0,  3, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  8,  6,  0,  6,  3,  0,  3, 10,  0, 10,  4, -1, -1, -1, -1 },
+        {  3, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  6, 10, 11,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  6, 10, 11,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  6, 10, 11,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  9,  4,  9,  5,  6, 10, 11,  6, 11,  7, -1, -1, -1, -1 },
+        {  1, 11,  7,  1,  7,  6,  1,  6,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 11,  7,  1,  7,  6,  1,  6,  8,  1,  8,  0, -1, -1, -1, -1 },
+        {  0,  9,  5,  1, 11,  7,  1,  7,  6,  1,  6,  4, -1, -1, -1, -1 },
+        {  1, 11,  7,  1,  7,  6,  1,  6,  8,  1,  8,  9,  1,  9,  5, -1 },
+        {  5,  7,  6,  5,  6, 10,  5, 10,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5,  7,  6,  5,  6, 10,  5, 10,  1, -1, -1, -1, -1 },
+        {  0,  9,  7,  0,  7,  6,  0,  6, 10,  0, 10,  1, -1, -1, -1, -1 },
+        {  4,  8,  9,  4,  9,  7,  4,  7,  6,  4,  6, 10,  4, 10,  1, -1 },
+        {  5,  7,  6,  5,  6,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  7,  6,  5,  6,  8,  5,  8,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  7,  0,  7,  6,  0,  6,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  6,  8,  9,  6,  9,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  8, 10,  2, 10, 11,  2, 11,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10, 11,  4, 11,  7,  4,  7,  2,  4,  2,  0, -1, -1, -1, -1 },
+        {  0,  9,  5,  2,  8, 10,  2, 10, 11,  2, 11,  7, -1, -1, -1, -1 },
+        {  2,  9,  5,  2,  5,  4,  2,  4, 10,  2, 10, 11,  2, 11,  7, -1 },
+        {  1, 11,  7,  1,  7,  2,  1,  2,  8,  1,  8,  4, -1, -1, -1, -1 },
+        {  1, 11,  7,  1,  7,  2,  1,  2,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  5,  1, 11,  7,  1,  7,  2,  1,  2,  8,  1,  8,  4, -1 },
+        {  1, 11,  7,  1,  7,  2,  1,  2,  9,  1,  9,  5, -1, -1, -1, -1 },
+        {  5,  7,  2,  5,  2,  8,  5,  8, 10,  5, 10,  1, -1, -1, -1, -1 },
+        {  4, 10,  1,  4,  1,  5,  4,  5,  7,  4,  7,  2,  4,  2,  0, -1 },
+        {  0,  9,  7,  0,  7,  2,  0,  2,  8,  0,  8, 10,  0, 10,  1, -1 },
+        {  4, 10,  1,  2,  9,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  2,  8,  4,  2,  4,  5,  2,  5,  7, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  7,  2,  5,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  9,  7,  0,  7,  2,  0,  2,  8,  0,  8,  4, -1, -1, -1, -1 },
+        {  2,  9,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  6, 10, 11,  6, 11,  9,  6,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  0,  6, 10, 11,  6, 11,  9,  6,  9,  2, -1, -1, -1, -1 },
+        {  0,  2,  6,  0,  6, 10,  0, 10, 11,  0, 11,  5, -1, -1, -1, -1 },
+        {  6, 10, 11,  6, 11,  5,  6,  5,  4,  6,  4,  8,  6,  8,  2, -1 },
+        {  1, 11,  9,  1,  9,  2,  1,  2,  6,  1,  6,  4, -1, -1, -1, -1 },
+        {  1, 11,  9,  1,  9,  2,  1,  2,  6,  1,  6,  8,  1,  8,  0, -1 },
+        {  0,  2,  6,  0,  6,  4,  0,  4,  1,  0,  1, 11,  0, 11,  5, -1 },
+        {  1, 11,  5,  6,  8,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  9,  2,  5,  2,  6,  5,  6, 10,  5, 10,  1, -1, -1, -1, -1 },
+        {  4,  8,  0,  5,  9,  2,  5,  2,  6,  5,  6, 10,  5, 10,  1, -1 },
+        {  0,  2,  6,  0,  6, 10,  0, 10,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4,  8,  2,  4,  2,  6,  4,  6, 10,  4, 10,  1, -1, -1, -1, -1 },
+        {  6,  4,  5,  6,  5,  9,  6,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  9,  2,  5,  2,  6,  5,  6,  8,  5,  8,  0, -1, -1, -1, -1 },
+        {  0,  2,  6,  0,  6,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  6,  8,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  8, 10, 11,  8, 11,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10, 11,  4, 11,  9,  4,  9,  0, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  8, 10,  0, 10, 11,  0, 11,  5, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10, 11,  4, 11,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 11,  9,  1,  9,  8,  1,  8,  4, -1, -1, -1, -1, -1, -1, -1 },
+        {  1, 11,  9,  1,  9,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  8,  4,  0,  4,  1,  0,  1, 11,  0, 11,  5, -1, -1, -1, -1 },
+        {  1, 11,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  9,  8,  5,  8, 10,  5, 10,  1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10,  1,  4,  1,  5,  4,  5,  9,  4,  9,  0, -1, -1, -1, -1 },
+        {  0,  8, 10,  0, 10,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  4, 10,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  9,  8,  5,  8,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  5,  9,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  8,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }
+    };
+
+    /// <summary>
+    /// Kinect Fusion mesh created on the host, with three unshared vertices per triangle.
+    /// </summary>
+    class KinectFusionHostMesh : public INuiFusionColorMesh
+    {
+    public:
+        KinectFusionHostMesh() : m_cRef(1)
+        {
+        }
+
+        // IUnknown methods
+        STDMETHODIMP_(ULONG) AddRef()
+        {
+            return static_cast<ULONG>(InterlockedIncrement(&m_cRef));
+        }
+
+        STDMETHODIMP_(ULONG) Release()
+        {
+            ULONG cRef = static_cast<ULONG>(InterlockedDecrement(&m_cRef));
+            if (0 == cRef)
+            {
+                delete this;
+            }
+
+            return cRef;
+        }
+
+        STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+        {
+            if (nullptr == ppv)
+            {
+                return E_POINTER;
+            }
+
+            if (riid == IID_IUnknown)
+            {
+                AddRef();
+                *ppv = static_cast<IUnknown*>(this);
+                return S_OK;
+            }
+
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        // INuiFusionColorMesh methods
+        STDMETHODIMP_(UINT) VertexCount()
+        {
+            return static_cast<UINT>(vertices.size());
+        }
+
+        STDMETHODIMP GetVertices(const Vector3 **pVertices)
+        {
+            return GetData(vertices, pVertices);
+        }
+
+        STDMETHODIMP_(UINT) NormalCount()
+        {
+            return static_cast<UINT>(normals.size());
+        }
+
+        STDMETHODIMP GetNormals(const Vector3 **pNormals)
+        {
+            return GetData(normals, pNormals);
+        }
+
+        STDMETHODIMP_(UINT) TriangleVertexIndexCount()
+        {
+            return static_cast<UINT>(triangleIndices.size());
+        }
+
+        STDMETHODIMP GetTriangleIndices(const int **pTriangleVertexIndices)
+        {
+            return GetData(triangleIndices, pTriangleVertexIndices);
+        }
+
+        STDMETHODIMP_(UINT) ColorCount()
+        {
+            return static_cast<UINT>(colors.size());
+        }
+
+        STDMETHODIMP GetColors(const int **pColors)
+        {
+            return GetData(colors, pColors);
+        }
+
+        std::vector<Vector3>    vertices;
+        std::vector<Vector3>    normals;
+        std::vector<int>        colors;
+        std::vector<int>        triangleIndices;
+
+    private:
+        ~KinectFusionHostMesh()
+        {
+        }
+
+        template <typename T>
+        static HRESULT GetData(const std::vector<T> &data, const T **ppData)
+        {
+            if (nullptr == ppData)
+            {
+                return E_POINTER;
+            }
+
+            *ppData = data.empty() ? nullptr : &data[0];
+            return S_OK;
+        }
+
+        volatile LONG           m_cRef;
+    };
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionIncrementalMesher::KinectFusionIncrementalMesher() :
+    m_cCopiedKeys(0),
+    m_cExtractedKeys(0),
+    m_updateStartTime(0)
+{
+    ZeroMemory(&m_statistics, sizeof(m_statistics));
+    SetIdentityMatrix(m_worldToVolumeTransform);
+    SetIdentityMatrix(m_volumeToWorldTransform);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionIncrementalMesher::~KinectFusionIncrementalMesher()
+{
+}
+
+/// <summary>
+/// Start an update by taking the changed blocks of the volume. Call with the volume locked.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionIncrementalMesher::BeginUpdate(KinectFusionVolume *pVolume)
+{
+    if (nullptr == pVolume)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_updateStartTime = m_timer.AbsoluteTime();
+    ZeroMemory(&m_statistics, sizeof(m_statistics));
+
+    // Blocks left over by an update which failed are extracted by this one
+    m_pendingKeys.erase(m_pendingKeys.begin(), m_pendingKeys.begin() + m_cExtractedKeys);
+    m_cCopiedKeys = 0;
+    m_cExtractedKeys = 0;
+
+    HRESULT hr = pVolume->GetCurrentWorldToVolumeTransform(&m_worldToVolumeTransform);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_volumeToWorldTransform = InvertMatrix4Affine(m_worldToVolumeTransform);
+
+    try
+    {
+        std::vector<UINT64> changedKeys;
+        bool bReset = false;
+
+        hr = pVolume->TakeChangedBlocks(changedKeys, bReset);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        // A reset volume is empty apart from the blocks integrated since
+        if (bReset)
+        {
+            m_blocks.clear();
+            m_pendingKeys.clear();
+        }
+
+        // The cells and gradients of a block read the voxels of its neighbors, so a change
+        // also affects the neighboring blocks
+        m_pendingKeys.reserve(m_pendingKeys.size() + changedKeys.size() * 27);
+
+        for (size_t i = 0; i < changedKeys.size(); ++i)
+        {
+            int blockX, blockY, blockZ;
+            BlockCoordinates(changedKeys[i], blockX, blockY, blockZ);
+
+            for (int z = max(blockZ - 1, 0); z <= blockZ + 1; ++z)
+            {
+                for (int y = max(blockY - 1, 0); y <= blockY + 1; ++y)
+                {
+                    for (int x = max(blockX - 1, 0); x <= blockX + 1; ++x)
+                    {
+                        m_pendingKeys.push_back(BlockKey(x, y, z));
+                    }
+                }
+            }
+        }
+
+        std::sort(m_pendingKeys.begin(), m_pendingKeys.end());
+        m_pendingKeys.erase(std::unique(m_pendingKeys.begin(), m_pendingKeys.end()), m_pendingKeys.end());
+    }
+    catch (const std::bad_alloc&)
+    {
+        // The changes taken from the volume are lost, so those blocks stay stale until they next change
+        m_pendingKeys.clear();
+        return E_OUTOFMEMORY;
+    }
+
+    m_statistics.copyTime += m_timer.AbsoluteTime() - m_updateStartTime;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Whether blocks taken by BeginUpdate remain to be copied and extracted.
+/// </summary>
+bool KinectFusionIncrementalMesher::HasPendingBlocks() const
+{
+    return m_cExtractedKeys < m_pendingKeys.size();
+}
+
+/// <summary>
+/// Copy the voxels of the next batch of pending blocks. Call with the volume locked.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionIncrementalMesher::CopyPendingBlocks(const KinectFusionVolume *pVolume)
+{
+    if (nullptr == pVolume)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_cCopiedKeys != m_cExtractedKeys)
+    {
+        // The previous batch has not been extracted yet
+        return E_UNEXPECTED;
+    }
+
+    const double copyStartTime = m_timer.AbsoluteTime();
+    const size_t cBlocks = min(m_pendingKeys.size() - m_cExtractedKeys, static_cast<size_t>(cBlocksPerBatch));
+
+    try
+    {
+        m_copiedVoxels.resize(cBlocks * cCopyVoxels);
+        m_copiedColorVoxels.resize(cBlocks * cCopyVoxels);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    Concurrency::parallel_for(static_cast<size_t>(0), cBlocks, [&](size_t i)
+    {
+        int blockX, blockY, blockZ;
+        BlockCoordinates(m_pendingKeys[m_cExtractedKeys + i], blockX, blockY, blockZ);
+
+        pVolume->CopyVoxels(
+            blockX * BlockSize - 1,
+            blockY * BlockSize - 1,
+            blockZ * BlockSize - 1,
+            cCopySize,
+            &m_copiedVoxels[i * cCopyVoxels],
+            &m_copiedColorVoxels[i * cCopyVoxels]);
+    });
+
+    m_cCopiedKeys = m_cExtractedKeys + cBlocks;
+    m_statistics.copyTime += m_timer.AbsoluteTime() - copyStartTime;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Extract the meshes of the copied blocks, replacing their cached meshes. The volume need not be locked.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionIncrementalMesher::ExtractCopiedBlocks()
+{
+    const size_t cBlocks = m_cCopiedKeys - m_cExtractedKeys;
+
+    try
+    {
+        std::vector<BlockMesh> meshes(cBlocks);
+
+        Concurrency::parallel_for(static_cast<size_t>(0), cBlocks, [&](size_t i)
+        {
+            ExtractBlock(
+                m_pendingKeys[m_cExtractedKeys + i],
+                &m_copiedVoxels[i * cCopyVoxels],
+                &m_copiedColorVoxels[i * cCopyVoxels],
+                meshes[i]);
+        });
+
+        for (size_t i = 0; i < cBlocks; ++i)
+        {
+            const UINT64 key = m_pendingKeys[m_cExtractedKeys + i];
+
+            if (meshes[i].vertices.empty())
+            {
+                m_blocks.erase(key);
+            }
+            else
+            {
+                BlockMesh &cached = m_blocks[key];
+                cached.vertices.swap(meshes[i].vertices);
+                cached.normals.swap(meshes[i].normals);
+                cached.colors.swap(meshes[i].colors);
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        // The batch stays pending, and is copied again by this or the next update
+        m_cCopiedKeys = m_cExtractedKeys;
+        return E_OUTOFMEMORY;
+    }
+
+    m_statistics.remeshedBlocks += static_cast<unsigned int>(cBlocks);
+    m_cExtractedKeys = m_cCopiedKeys;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Finish the update and create a mesh of all cached blocks.
+/// </summary>
+/// <param name="ppMesh">Returns the mesh, which the caller releases.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionIncrementalMesher::EndUpdate(INuiFusionColorMesh **ppMesh)
+{
+    if (nullptr == ppMesh)
+    {
+        return E_INVALIDARG;
+    }
+
+    *ppMesh = nullptr;
+
+    if (HasPendingBlocks())
+    {
+        return E_UNEXPECTED;
+    }
+
+    KinectFusionHostMesh *pMesh = new(std::nothrow) KinectFusionHostMesh();
+    if (nullptr == pMesh)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    try
+    {
+        // Find where each block goes in the mesh, then gather the blocks in parallel
+        std::vector<const BlockMesh*> blocks;
+        std::vector<size_t> offsets;
+        blocks.reserve(m_blocks.size());
+        offsets.reserve(m_blocks.size());
+
+        size_t cVertices = 0;
+        for (std::map<UINT64, BlockMesh>::const_iterator it = m_blocks.begin(); it != m_blocks.end(); ++it)
+        {
+            blocks.push_back(&it->second);
+            offsets.push_back(cVertices);
+            cVertices += it->second.vertices.size();
+        }
+
+        pMesh->vertices.resize(cVertices);
+        pMesh->normals.resize(cVertices);
+        pMesh->colors.resize(cVertices);
+        pMesh->triangleIndices.resize(cVertices);
+
+        Concurrency::parallel_for(static_cast<size_t>(0), blocks.size(), [&](size_t i)
+        {
+            const BlockMesh &block = *blocks[i];
+            const size_t offset = offsets[i];
+
+            std::copy(block.vertices.begin(), block.vertices.end(), pMesh->vertices.begin() + offset);
+            std::copy(block.normals.begin(), block.normals.end(), pMesh->normals.begin() + offset);
+            std::copy(block.colors.begin(), block.colors.end(), pMesh->colors.begin() + offset);
+
+            for (size_t vertex = 0; vertex < block.vertices.size(); ++vertex)
+            {
+                pMesh->triangleIndices[offset + vertex] = static_cast<int>(offset + vertex);
+            }
+        });
+    }
+    catch (const std::bad_alloc&)
+    {
+        pMesh->Release();
+        return E_OUTOFMEMORY;
+    }
+
+    m_statistics.surfaceBlocks = static_cast<unsigned int>(m_blocks.size());
+    m_statistics.extractionTime = m_timer.AbsoluteTime() - m_updateStartTime;
+
+    *ppMesh = pMesh;
+    return S_OK;
+}
+
+/// <summary>
+/// Extract the mesh of one copied block.
+/// </summary>
+/// <param name="key">The key of the block.</param>
+/// <param name="pVoxels">The copied voxels around the block.</param>
+/// <param name="pColorVoxels">The copied color voxels around the block.</param>
+/// <param name="mesh">Returns the mesh of the block.</param>
+void KinectFusionIncrementalMesher::ExtractBlock(UINT64 key, const unsigned int *pVoxels, const unsigned int *pColorVoxels, BlockMesh &mesh) const
+{
+    const int strideY = cCopySize;
+    const int strideZ = cCopySize * cCopySize;
+
+    // Offsets of the cube corners in the copy
+    int cornerOffsets[8];
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        cornerOffsets[corner] = (corner & 1) + (((corner >> 1) & 1) * strideY) + ((corner >> 2) * strideZ);
+    }
+
+    int blockX, blockY, blockZ;
+    BlockCoordinates(key, blockX, blockY, blockZ);
+
+    // Volume coordinates of the first voxel of the copy
+    const float copyX = static_cast<float>(blockX * BlockSize - 1);
+    const float copyY = static_cast<float>(blockY * BlockSize - 1);
+    const float copyZ = static_cast<float>(blockZ * BlockSize - 1);
+
+    const Matrix4 &worldToVolume = m_worldToVolumeTransform;
+
+    // The cells of the block start one voxel into the copy
+    for (int z = 1; z <= BlockSize; ++z)
+    {
+        for (int y = 1; y <= BlockSize; ++y)
+        {
+            for (int x = 1; x <= BlockSize; ++x)
+            {
+                const int cellOffset = (z * strideZ) + (y * strideY) + x;
+
+                float tsdf[8];
+                int cubeCase = 0;
+                bool surfaceCell = true;
+
+                for (int corner = 0; corner < 8 && surfaceCell; ++corner)
+                {
+                    const unsigned int voxel = pVoxels[cellOffset + cornerOffsets[corner]];
+                    tsdf[corner] = Tsdf(voxel);
+
+                    surfaceCell = 0 != voxel && fabsf(tsdf[corner]) <= cMaxSurfaceTsdf;
+
+                    if (tsdf[corner] < 0.0f)
+                    {
+                        cubeCase |= 1 << corner;
+                    }
+                }
+
+                if (!surfaceCell || 0 == cubeCase || 255 == cubeCase)
+                {
+                    continue;
+                }
+
+                const signed char *pTriangleEdges = cTriangleEdges[cubeCase];
+
+                for (int i = 0; pTriangleEdges[i] >= 0; ++i)
+                {
+                    const int corner0 = cEdgeCorners[pTriangleEdges[i]][0];
+                    const int corner1 = cEdgeCorners[pTriangleEdges[i]][1];
+                    const float t = tsdf[corner0] / (tsdf[corner0] - tsdf[corner1]);
+
+                    // Position along the edge where the signed distance is zero
+                    Vector3 position;
+                    position.x = copyX + static_cast<float>(x + (corner0 & 1)) + t * static_cast<float>((corner1 & 1) - (corner0 & 1));
+                    position.y = copyY + static_cast<float>(y + ((corner0 >> 1) & 1)) + t * static_cast<float>(((corner1 >> 1) & 1) - ((corner0 >> 1) & 1));
+                    position.z = copyZ + static_cast<float>(z + (corner0 >> 2)) + t * static_cast<float>((corner1 >> 2) - (corner0 >> 2));
+
+                    // Normal from the central difference gradients at the edge corners
+                    const int offset0 = cellOffset + cornerOffsets[corner0];
+                    const int offset1 = cellOffset + cornerOffsets[corner1];
+
+                    const float gx = lerp(
+                        Tsdf(pVoxels[offset0 + 1]) - Tsdf(pVoxels[offset0 - 1]),
+                        Tsdf(pVoxels[offset1 + 1]) - Tsdf(pVoxels[offset1 - 1]), t);
+                    const float gy = lerp(
+                        Tsdf(pVoxels[offset0 + strideY]) - Tsdf(pVoxels[offset0 - strideY]),
+                        Tsdf(pVoxels[offset1 + strideY]) - Tsdf(pVoxels[offset1 - strideY]), t);
+                    const float gz = lerp(
+                        Tsdf(pVoxels[offset0 + strideZ]) - Tsdf(pVoxels[offset0 - strideZ]),
+                        Tsdf(pVoxels[offset1 + strideZ]) - Tsdf(pVoxels[offset1 - strideZ]), t);
+
+                    // Gradients transform to world space by the transpose of the world to volume linear part
+                    Vector3 normal;
+                    normal.x = (worldToVolume.M11 * gx) + (worldToVolume.M12 * gy) + (worldToVolume.M13 * gz);
+                    normal.y = (worldToVolume.M21 * gx) + (worldToVolume.M22 * gy) + (worldToVolume.M23 * gz);
+                    normal.z = (worldToVolume.M31 * gx) + (worldToVolume.M32 * gy) + (worldToVolume.M33 * gz);
+
+                    const float normalLength = sqrtf(dot_normalized(normal, normal));
+                    if (normalLength > 0.0f)
+                    {
+                        normal.x /= normalLength;
+                        normal.y /= normalLength;
+                        normal.z /= normalLength;
+                    }
+
+                    // Color of the nearest corner, as in the raycast
+                    const unsigned int colorVoxel = pColorVoxels[(t < 0.5f) ? offset0 : offset1];
+
+                    mesh.vertices.push_back(transform(position, m_volumeToWorldTransform));
+                    mesh.normals.push_back(normal);
+                    mesh.colors.push_back(static_cast<int>((0 != colorVoxel) ? (colorVoxel | 0xFF000000) : 0));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,142 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionIncrementalMesher.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "Timer.h"
+#include "KinectFusionVolume.h"
+
+/// <summary>
+/// Work done by a KinectFusionIncrementalMesher update.
+/// </summary>
+struct KinectFusionMeshStatistics
+{
+    unsigned int                remeshedBlocks;     // blocks extracted again because they changed
+    unsigned int                surfaceBlocks;      // blocks with a surface, cached or extracted
+    double                      copyTime;           // time the volume was locked to copy voxels, in seconds
+    double                      extractionTime;     // total time of the update, in seconds
+};
+
+/// <summary>
+/// Marching cubes mesher for the native reconstruction volumes, which caches the mesh of each
+/// block of KinectFusionVoxel::BlockSize voxels and only extracts the blocks that changed since
+/// the last update again. The volume only has to be locked while the voxels of changed blocks
+/// are copied, so tracking can carry on while the copies are meshed.
+/// </summary>
+class KinectFusionIncrementalMesher
+{
+    // Number of changed blocks copied from the volume at a time
+    static const unsigned int   cBlocksPerBatch = 512;
+
+    // Blocks are copied with one voxel before and two after them, for the gradients at the cell corners
+    static const int            cCopySize = KinectFusionVoxel::BlockSize + 3;
+    static const int            cCopyVoxels = cCopySize * cCopySize * cCopySize;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionIncrementalMesher();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionIncrementalMesher();
+
+    /// <summary>
+    /// Start an update by taking the changed blocks of the volume. Call with the volume locked.
+    /// </summary>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     BeginUpdate(KinectFusionVolume *pVolume);
+
+    /// <summary>
+    /// Whether blocks taken by BeginUpdate remain to be copied and extracted.
+    /// </summary>
+    bool                        HasPendingBlocks() const;
+
+    /// <summary>
+    /// Copy the voxels of the next batch of pending blocks. Call with the volume locked.
+    /// </summary>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CopyPendingBlocks(const KinectFusionVolume *pVolume);
+
+    /// <summary>
+    /// Extract the meshes of the copied blocks, replacing their cached meshes. The volume need not be locked.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ExtractCopiedBlocks();
+
+    /// <summary>
+    /// Finish the update and create a mesh of all cached blocks.
+    /// </summary>
+    /// <param name="ppMesh">Returns the mesh, which the caller releases.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     EndUpdate(INuiFusionColorMesh **ppMesh);
+
+    /// <summary>
+    /// Get the work done by the last update.
+    /// </summary>
+    const KinectFusionMeshStatistics& GetStatistics() const
+    {
+        return m_statistics;
+    }
+
+private:
+    /// <summary>
+    /// The cached mesh of a block: three unshared vertices per triangle, as in Kinect Fusion meshes.
+    /// </summary>
+    struct BlockMesh
+    {
+        std::vector<Vector3>    vertices;
+        std::vector<Vector3>    normals;
+        std::vector<int>        colors;
+    };
+
+    /// <summary>
+    /// Extract the mesh of one copied block.
+    /// </summary>
+    /// <param name="key">The key of the block.</param>
+    /// <param name="pVoxels">The copied voxels around the block.</param>
+    /// <param name="pColorVoxels">The copied color voxels around the block.</param>
+    /// <param name="mesh">Returns the mesh of the block.</param>
+    void                        ExtractBlock(UINT64 key, const unsigned int *pVoxels, const unsigned int *pColorVoxels, BlockMesh &mesh) const;
+
+    std::map<UINT64, BlockMesh> m_blocks;
+
+    // Blocks to extract in this update, and the voxels of the current batch
+    std::vector<UINT64>         m_pendingKeys;
+    size_t                      m_cCopiedKeys;
+    size_t                      m_cExtractedKeys;
+    std::vector<unsigned int>   m_copiedVoxels;
+    std::vector<unsigned int>   m_copiedColorVoxels;
+
+    Matrix4                     m_worldToVolumeTransform;
+    Matrix4                     m_volumeToWorldTransform;
+
+    KinectFusionMeshStatistics  m_statistics;
+    Timing::Timer               m_timer;
+    double                      m_updateStartTime;
+};
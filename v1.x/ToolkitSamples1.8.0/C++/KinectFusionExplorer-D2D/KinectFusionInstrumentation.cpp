@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionInstrumentation.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <algorithm>
+#include <wchar.h>
+
+// Project includes
+#include "KinectFusionInstrumentation.h"
+
+namespace
+{
+    const char* const cStageNames[] =
+    {
+        "GetKinectFrames",
+        "MapColorToDepth",
+        "DepthToDepthFloat",
+        "FilterDepth",
+        "SmoothDepth",
+        "AlignPointClouds",
+        "AlignDepthFloatToReconstruction",
+        "Integrate",
+        "Raycast",
+        "RenderWaitForVolume",
+        "ShiftVolume",
+        "CameraPoseFinderProcessFrame",
+        "CameraPoseFinderFindCameraPose",
+        "StoreImageToFrameBuffer",
+        "Capture",
+        "Queue",
+        "Track",
+        "Render",
+        "Latency"
+    };
+
+    static_assert(ARRAYSIZE(cStageNames) == KinectFusionStageCount, "Every stage needs a name.");
+
+    /// <summary>
+    /// Nearest rank percentile of sorted samples.
+    /// </summary>
+    float Percentile(const float *pSorted, unsigned int count, unsigned int percent)
+    {
+        unsigned int rank = (count * percent + 99) / 100;
+        return pSorted[(rank > 0 ? rank : 1) - 1];
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionInstrumentation::KinectFusionInstrumentation() :
+    m_pTraceFile(nullptr),
+    m_bTraceJson(false),
+    m_bTraceEmpty(true)
+{
+    ZeroMemory(m_rings, sizeof(m_rings));
+}
+
+/// <summary>
+/// Destructor, closing the trace file
+/// </summary>
+KinectFusionInstrumentation::~KinectFusionInstrumentation()
+{
+    CloseTrace();
+}
+
+/// <summary>
+/// Add the time of a call of a stage. May be called from any thread.
+/// </summary>
+/// <param name="stage">The stage.</param>
+/// <param name="seconds">The time spent in the stage, in seconds.</param>
+void KinectFusionInstrumentation::AddSample(KinectFusionStage stage, double seconds)
+{
+    if (stage < 0 || stage >= KinectFusionStageCount)
+    {
+        return;
+    }
+
+    SampleRing &ring = m_rings[stage];
+    ULONG slot = static_cast<ULONG>(InterlockedIncrement(&ring.written)) - 1;
+    ring.milliseconds[slot % cSamples] = static_cast<float>(seconds * 1000.0);
+}
+
+/// <summary>
+/// Calculate the statistics of the samples added to each stage since the previous snapshot.
+/// </summary>
+/// <param name="statistics">Returns the statistics of each stage.</param>
+void KinectFusionInstrumentation::Snapshot(KinectFusionStageStatistics statistics[KinectFusionStageCount])
+{
+    float sorted[cSamples];
+
+    for (int stage = 0; stage < KinectFusionStageCount; ++stage)
+    {
+        SampleRing &ring = m_rings[stage];
+        KinectFusionStageStatistics &stageStatistics = statistics[stage];
+        ZeroMemory(&stageStatistics, sizeof(stageStatistics));
+
+        ULONG written = static_cast<ULONG>(ring.written);
+        ULONG added = written - static_cast<ULONG>(ring.snapshotWritten);
+        ring.snapshotWritten = static_cast<LONG>(written);
+
+        if (0 == added)
+        {
+            continue;
+        }
+
+        // The ring holds the most recent samples
+        unsigned int count = min(added, static_cast<ULONG>(cSamples));
+        float total = 0.0f;
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            sorted[i] = ring.milliseconds[(written - count + i) % cSamples];
+            total += sorted[i];
+        }
+
+        std::sort(sorted, sorted + count);
+
+        stageStatistics.count = added;
+        stageStatistics.meanMilliseconds = total / count;
+        stageStatistics.p50Milliseconds = Percentile(sorted, count, 50);
+        stageStatistics.p95Milliseconds = Percentile(sorted, count, 95);
+        stageStatistics.p99Milliseconds = Percentile(sorted, count, 99);
+        stageStatistics.maxMilliseconds = sorted[count - 1];
+    }
+}
+
+/// <summary>
+/// The name of a stage, as written to the trace file.
+/// </summary>
+const char* KinectFusionInstrumentation::StageName(KinectFusionStage stage)
+{
+    return (stage >= 0 && stage < KinectFusionStageCount) ? cStageNames[stage] : "Unknown";
+}
+
+/// <summary>
+/// Create a trace file to write snapshots to. Files ending in .json are written as a JSON
+/// array of records, other files as CSV with one row per stage and snapshot.
+/// </summary>
+/// <param name="szFileName">The trace file name.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionInstrumentation::OpenTrace(LPCWSTR szFileName)
+{
+    if (nullptr == szFileName || L'\0' == szFileName[0])
+    {
+        return E_INVALIDARG;
+    }
+
+    CloseTrace();
+
+    if (0 != _wfopen_s(&m_pTraceFile, szFileName, L"wt") || nullptr == m_pTraceFile)
+    {
+        m_pTraceFile = nullptr;
+        return E_ACCESSDENIED;
+    }
+
+    size_t length = wcslen(szFileName);
+    m_bTraceJson = length >= 5 && 0 == _wcsicmp(szFileName + length - 5, L".json");
+    m_bTraceEmpty = true;
+
+    int written = m_bTraceJson
+        ? fprintf(m_pTraceFile, "[\n")
+        : fprintf(m_pTraceFile, "time_s,stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+
+    return written < 0 ? E_FAIL : S_OK;
+}
+
+/// <summary>
+/// Write a snapshot to the trace file, if one is open.
+/// </summary>
+/// <param name="time">The time of the snapshot in seconds.</param>
+/// <param name="statistics">The statistics of each stage.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionInstrumentation::WriteTrace(double time, const KinectFusionStageStatistics statistics[KinectFusionStageCount])
+{
+    if (nullptr == m_pTraceFile)
+    {
+        return S_OK;
+    }
+
+    for (int stage = 0; stage < KinectFusionStageCount; ++stage)
+    {
+        const KinectFusionStageStatistics &s = statistics[stage];
+
+        // Stages which did not run, such as the tracking method not in use, are left out
+        if (0 == s.count)
+        {
+            continue;
+        }
+
+        int written = m_bTraceJson
+            ? fprintf(m_pTraceFile,
+                "%s{\"time\":%.3f,\"stage\":\"%s\",\"count\":%u,\"mean\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                m_bTraceEmpty ? "" : ",\n", time, cStageNames[stage], s.count,
+                s.meanMilliseconds, s.p50Milliseconds, s.p95Milliseconds, s.p99Milliseconds, s.maxMilliseconds)
+            : fprintf(m_pTraceFile,
+                "%.3f,%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                time, cStageNames[stage], s.count,
+                s.meanMilliseconds, s.p50Milliseconds, s.p95Milliseconds, s.p99Milliseconds, s.maxMilliseconds);
+
+        if (written < 0)
+        {
+            return E_FAIL;
+        }
+
+        m_bTraceEmpty = false;
+    }
+
+    fflush(m_pTraceFile);
+    return S_OK;
+}
+
+/// <summary>
+/// Finish and close the trace file, if one is open.
+/// </summary>
+void KinectFusionInstrumentation::CloseTrace()
+{
+    if (nullptr == m_pTraceFile)
+    {
+        return;
+    }
+
+    if (m_bTraceJson)
+    {
+        fprintf(m_pTraceFile, m_bTraceEmpty ? "]\n" : "\n]\n");
+    }
+
+    fclose(m_pTraceFile);
+    m_pTraceFile = nullptr;
+}
@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionInstrumentation.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdio.h>
+
+#include "Timer.h"
+
+/// <summary>
+/// The instrumented stages of KinectFusionProcessor.
+/// </summary>
+enum KinectFusionStage
+{
+    KinectFusionStageGetKinectFrames,
+    KinectFusionStageMapColorToDepth,
+    KinectFusionStageDepthToDepthFloat,
+    KinectFusionStageFilterDepth,
+    KinectFusionStageSmoothDepth,
+    KinectFusionStageAlignPointClouds,
+    KinectFusionStageAlignDepthFloatToReconstruction,
+    KinectFusionStageIntegrate,
+    KinectFusionStageRaycast,
+    KinectFusionStageRenderWaitForVolume,
+    KinectFusionStageShiftVolume,
+    KinectFusionStageCameraPoseFinderProcessFrame,
+    KinectFusionStageCameraPoseFinderFindCameraPose,
+    KinectFusionStageStoreImageToFrameBuffer,
+
+    // Whole pipeline stages, and the latency from the start of capture to the display of a frame
+    KinectFusionStageCapture,
+    KinectFusionStageQueue,
+    KinectFusionStageTrack,
+    KinectFusionStageRender,
+    KinectFusionStageLatency,
+    KinectFusionStageCount
+};
+
+/// <summary>
+/// The distribution of the time spent in a stage by the calls since the previous snapshot.
+/// The percentiles and maximum are of the most recent KinectFusionInstrumentation::cSamples
+/// calls, and all times are zero when there were no calls.
+/// </summary>
+struct KinectFusionStageStatistics
+{
+    unsigned int                count;
+    float                       meanMilliseconds;
+    float                       p50Milliseconds;
+    float                       p95Milliseconds;
+    float                       p99Milliseconds;
+    float                       maxMilliseconds;
+};
+
+/// <summary>
+/// Collects the time spent in each stage of the processor. Any thread may add samples without
+/// taking a lock: each sample claims a slot of its stage's ring with an interlocked increment.
+/// A snapshot racing with a sample may miss that one sample, which statistics over hundreds of
+/// samples do not notice. Snapshots and the trace file are only used by one thread at a time.
+/// </summary>
+class KinectFusionInstrumentation
+{
+public:
+    // Samples kept per stage, a power of two so the ring index wraps with the counter
+    static const unsigned int   cSamples = 256;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionInstrumentation();
+
+    /// <summary>
+    /// Destructor, closing the trace file
+    /// </summary>
+    ~KinectFusionInstrumentation();
+
+    /// <summary>
+    /// The current time in seconds, for timing a stage.
+    /// </summary>
+    double                      Now()
+    {
+        return m_timer.AbsoluteTime();
+    }
+
+    /// <summary>
+    /// Add the time of a call of a stage. May be called from any thread.
+    /// </summary>
+    /// <param name="stage">The stage.</param>
+    /// <param name="seconds">The time spent in the stage, in seconds.</param>
+    void                        AddSample(KinectFusionStage stage, double seconds);
+
+    /// <summary>
+    /// Calculate the statistics of the samples added to each stage since the previous snapshot.
+    /// </summary>
+    /// <param name="statistics">Returns the statistics of each stage.</param>
+    void                        Snapshot(KinectFusionStageStatistics statistics[KinectFusionStageCount]);
+
+    /// <summary>
+    /// The name of a stage, as written to the trace file.
+    /// </summary>
+    static const char*          StageName(KinectFusionStage stage);
+
+    /// <summary>
+    /// Create a trace file to write snapshots to. Files ending in .json are written as a JSON
+    /// array of records, other files as CSV with one row per stage and snapshot.
+    /// </summary>
+    /// <param name="szFileName">The trace file name.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     OpenTrace(LPCWSTR szFileName);
+
+    /// <summary>
+    /// Whether a trace file is open.
+    /// </summary>
+    bool                        IsTraceOpen() const
+    {
+        return nullptr != m_pTraceFile;
+    }
+
+    /// <summary>
+    /// Write a snapshot to the trace file, if one is open.
+    /// </summary>
+    /// <param name="time">The time of the snapshot in seconds.</param>
+    /// <param name="statistics">The statistics of each stage.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     WriteTrace(double time, const KinectFusionStageStatistics statistics[KinectFusionStageCount]);
+
+    /// <summary>
+    /// Finish and close the trace file, if one is open.
+    /// </summary>
+    void                        CloseTrace();
+
+private:
+    // Each ring starts a cache line, so stages timed on different threads do not share one
+    struct __declspec(align(64)) SampleRing
+    {
+        volatile LONG           written;
+        LONG                    snapshotWritten;
+        float                   milliseconds[cSamples];
+    };
+
+    SampleRing                  m_rings[KinectFusionStageCount];
+    Timing::Timer               m_timer;
+
+    FILE*                       m_pTraceFile;
+    bool                        m_bTraceJson;
+    bool                        m_bTraceEmpty;
+};
+
+/// <summary>
+/// Adds the time from its construction to its destruction, or to Stop, to a stage.
+/// </summary>
+class KinectFusionScopedTimer
+{
+public:
+    /// <summary>
+    /// Constructor, starting the timer
+    /// </summary>
+    KinectFusionScopedTimer(KinectFusionInstrumentation &instrumentation, KinectFusionStage stage) :
+        m_instrumentation(instrumentation),
+        m_stage(stage),
+        m_startTime(instrumentation.Now()),
+        m_bStopped(false)
+    {
+    }
+
+    /// <summary>
+    /// Destructor, adding the time unless the timer was stopped
+    /// </summary>
+    ~KinectFusionScopedTimer()
+    {
+        Stop();
+    }
+
+    /// <summary>
+    /// Add the time so far, when the stage ends before the scope.
+    /// </summary>
+    void                        Stop()
+    {
+        if (!m_bStopped)
+        {
+            m_bStopped = true;
+            m_instrumentation.AddSample(m_stage, m_instrumentation.Now() - m_startTime);
+        }
+    }
+
+private:
+    KinectFusionScopedTimer(const KinectFusionScopedTimer&);
+    KinectFusionScopedTimer& operator=(const KinectFusionScopedTimer&);
+
+    KinectFusionInstrumentation& m_instrumentation;
+    KinectFusionStage           m_stage;
+    double                      m_startTime;
+    bool                        m_bStopped;
+};
@@ -0,0 +1,672 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionKeyframeDatabase.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <new>
+
+// Project includes
+#include "KinectFusionKeyframeDatabase.h"
+#include "KinectFusionHelper.h"
+#include "Timer.h"
+
+using namespace KinectFusionKeyframeFormat;
+
+namespace
+{
+    // Depth given to samples with no valid pixels, so holes compare as far away
+    const float cInvalidDepth = 100.0f;
+
+    // Keyframes below this count are scanned on the calling thread
+    const unsigned int cMinParallelKeyframes = 2048;
+
+    /// <summary>
+    /// Count the set bits of a word.
+    /// </summary>
+    inline unsigned int PopCount(UINT64 value)
+    {
+        value = value - ((value >> 1) & 0x5555555555555555ULL);
+        value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+        value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<unsigned int>((value * 0x0101010101010101ULL) >> 56);
+    }
+
+    /// <summary>
+    /// The number of bits which differ between two descriptors.
+    /// </summary>
+    inline unsigned int HammingDistance(const UINT64 *pA, const UINT64 *pB)
+    {
+        unsigned int distance = 0;
+        for (unsigned int i = 0; i < DescriptorWords; ++i)
+        {
+            distance += PopCount(pA[i] ^ pB[i]);
+        }
+
+        return distance;
+    }
+
+    /// <summary>
+    /// Linear congruential generator, so every database compares the same pixel pairs.
+    /// </summary>
+    inline float NextRandom(UINT32 &state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1 << 24);
+    }
+
+    /// <summary>
+    /// The mean depth of the valid pixels of the 3x3 block around a pixel.
+    /// </summary>
+    float SampleDepth(const BYTE *pBits, int pitch, int width, int height, int x, int y)
+    {
+        float sum = 0.0f;
+        int count = 0;
+
+        for (int sy = max(y - 1, 0); sy <= min(y + 1, height - 1); ++sy)
+        {
+            const float *pRow = reinterpret_cast<const float*>(pBits + sy * pitch);
+            for (int sx = max(x - 1, 0); sx <= min(x + 1, width - 1); ++sx)
+            {
+                if (pRow[sx] > 0.0f)
+                {
+                    sum += pRow[sx];
+                    ++count;
+                }
+            }
+        }
+
+        return (count > 0) ? sum / count : cInvalidDepth;
+    }
+
+    /// <summary>
+    /// The mean luminance of the 3x3 block around a pixel, times 9.
+    /// </summary>
+    unsigned int SampleLuminance(const BYTE *pBits, int pitch, int width, int height, int x, int y)
+    {
+        unsigned int sum = 0;
+
+        for (int sy = max(y - 1, 0); sy <= min(y + 1, height - 1); ++sy)
+        {
+            const unsigned int *pRow = reinterpret_cast<const unsigned int*>(pBits + sy * pitch);
+            for (int sx = max(x - 1, 0); sx <= min(x + 1, width - 1); ++sx)
+            {
+                const unsigned int color = pRow[sx];
+                sum += (77 * ((color >> 16) & 0xFF) + 150 * ((color >> 8) & 0xFF) + 29 * (color & 0xFF)) >> 8;
+            }
+        }
+
+        return sum;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionKeyframeDatabase::KinectFusionKeyframeDatabase() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(nullptr),
+    m_pView(nullptr),
+    m_pMapped(nullptr),
+    m_cMapped(0),
+    m_iMappedFirst(0),
+    m_cMaxKeyframes(NUI_FUSION_CAMERA_POSE_FINDER_DEFAULT_POSE_HISTORY_COUNT)
+{
+    m_szFileName[0] = L'\0';
+
+    // Pairs within the central 80% of the image, where the depth is most often valid
+    UINT32 state = 0x4B464B44;
+    for (unsigned int i = 0; i < DescriptorBits; ++i)
+    {
+        m_samplePairs[i].x0 = 0.1f + 0.8f * NextRandom(state);
+        m_samplePairs[i].y0 = 0.1f + 0.8f * NextRandom(state);
+        m_samplePairs[i].x1 = 0.1f + 0.8f * NextRandom(state);
+        m_samplePairs[i].y1 = 0.1f + 0.8f * NextRandom(state);
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionKeyframeDatabase::~KinectFusionKeyframeDatabase()
+{
+    CloseFile();
+}
+
+/// <summary>
+/// Describe a depth float frame and a color frame of the same view.
+/// </summary>
+HRESULT KinectFusionKeyframeDatabase::Describe(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+    const NUI_FUSION_IMAGE_FRAME *pColorImage,
+    UINT64 *pDescriptor) const
+{
+    if (nullptr == pDepthFloatImage || nullptr == pDepthFloatImage->pFrameTexture || nullptr == pDescriptor)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr != pColorImage &&
+        (pColorImage->width != pDepthFloatImage->width || pColorImage->height != pDepthFloatImage->height))
+    {
+        return E_INVALIDARG;
+    }
+
+    ZeroMemory(pDescriptor, DescriptorWords * sizeof(UINT64));
+
+    const int width = static_cast<int>(pDepthFloatImage->width);
+    const int height = static_cast<int>(pDepthFloatImage->height);
+    const unsigned int depthBits = DescriptorBits / 2;
+
+    NUI_LOCKED_RECT depthLock;
+    HRESULT hr = pDepthFloatImage->pFrameTexture->LockRect(0, &depthLock, nullptr, 0);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (0 != depthLock.Pitch)
+    {
+        for (unsigned int i = 0; i < depthBits; ++i)
+        {
+            const SamplePair &pair = m_samplePairs[i];
+            const float depth0 = SampleDepth(depthLock.pBits, depthLock.Pitch, width, height,
+                static_cast<int>(pair.x0 * width), static_cast<int>(pair.y0 * height));
+            const float depth1 = SampleDepth(depthLock.pBits, depthLock.Pitch, width, height,
+                static_cast<int>(pair.x1 * width), static_cast<int>(pair.y1 * height));
+
+            if (depth0 < depth1)
+            {
+                pDescriptor[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+    else
+    {
+        hr = E_NOINTERFACE;
+    }
+
+    pDepthFloatImage->pFrameTexture->UnlockRect(0);
+
+    // Without a color image the luminance bits stay zero
+    if (SUCCEEDED(hr) && nullptr != pColorImage && nullptr != pColorImage->pFrameTexture)
+    {
+        NUI_LOCKED_RECT colorLock;
+        hr = pColorImage->pFrameTexture->LockRect(0, &colorLock, nullptr, 0);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        if (0 != colorLock.Pitch)
+        {
+            for (unsigned int i = depthBits; i < DescriptorBits; ++i)
+            {
+                const SamplePair &pair = m_samplePairs[i];
+                const unsigned int luminance0 = SampleLuminance(colorLock.pBits, colorLock.Pitch, width, height,
+                    static_cast<int>(pair.x0 * width), static_cast<int>(pair.y0 * height));
+                const unsigned int luminance1 = SampleLuminance(colorLock.pBits, colorLock.Pitch, width, height,
+                    static_cast<int>(pair.x1 * width), static_cast<int>(pair.y1 * height));
+
+                if (luminance0 < luminance1)
+                {
+                    pDescriptor[i / 64] |= 1ULL << (i % 64);
+                }
+            }
+        }
+        else
+        {
+            hr = E_NOINTERFACE;
+        }
+
+        pColorImage->pFrameTexture->UnlockRect(0);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Add a keyframe, removing the oldest keyframe when the database is full.
+/// </summary>
+HRESULT KinectFusionKeyframeDatabase::Add(const UINT64 *pDescriptor, const Matrix4 &worldToCameraTransform)
+{
+    if (nullptr == pDescriptor)
+    {
+        return E_INVALIDARG;
+    }
+
+    Keyframe keyframe;
+    memcpy(keyframe.descriptor, pDescriptor, sizeof(keyframe.descriptor));
+    keyframe.worldToCameraTransform = worldToCameraTransform;
+
+    try
+    {
+        m_keyframes.push_back(keyframe);
+    }
+    catch (std::bad_alloc)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    Trim();
+
+    return S_OK;
+}
+
+/// <summary>
+/// Keep a match if it is among the nearest found so far. Equal distances are ordered by
+/// index, so the result does not depend on how the scan was split.
+/// </summary>
+void KinectFusionKeyframeDatabase::NearestKeyframes::Insert(unsigned int keyframeIndex, unsigned int keyframeDistance)
+{
+    unsigned int position = count;
+    while (position > 0 &&
+        (distance[position - 1] > keyframeDistance ||
+        (distance[position - 1] == keyframeDistance && index[position - 1] > keyframeIndex)))
+    {
+        --position;
+    }
+
+    if (position >= cMaxMatches)
+    {
+        return;
+    }
+
+    const unsigned int last = min(count, cMaxMatches - 1);
+    for (unsigned int i = last; i > position; --i)
+    {
+        index[i] = index[i - 1];
+        distance[i] = distance[i - 1];
+    }
+
+    index[position] = keyframeIndex;
+    distance[position] = keyframeDistance;
+    count = min(count + 1, cMaxMatches);
+}
+
+/// <summary>
+/// Combine the matches found by another part of the scan.
+/// </summary>
+KinectFusionKeyframeDatabase::NearestKeyframes& KinectFusionKeyframeDatabase::NearestKeyframes::operator+=(const NearestKeyframes &other)
+{
+    for (unsigned int i = 0; i < other.count; ++i)
+    {
+        Insert(other.index[i], other.distance[i]);
+    }
+
+    return *this;
+}
+
+/// <summary>
+/// Find the keyframes nearest to a descriptor, nearest first.
+/// </summary>
+unsigned int KinectFusionKeyframeDatabase::FindNearest(const UINT64 *pDescriptor, unsigned int k, bool bLoadedOnly, KinectFusionKeyframeMatch *pMatches)
+{
+    if (nullptr == pDescriptor || nullptr == pMatches)
+    {
+        return 0;
+    }
+
+    const unsigned int cLoaded = GetLoadedKeyframeCount();
+    const Keyframe *pLoaded = m_pMapped + m_iMappedFirst;
+    const Keyframe *pAdded = m_keyframes.empty() ? nullptr : &m_keyframes[0];
+
+    // The loaded keyframes come first, then those added since
+    auto scan = [=](unsigned int begin, unsigned int end, NearestKeyframes &nearest)
+    {
+        for (unsigned int i = begin; i < min(end, cLoaded); ++i)
+        {
+            nearest.Insert(i, HammingDistance(pDescriptor, pLoaded[i].descriptor));
+        }
+
+        for (unsigned int i = max(begin, cLoaded); i < end; ++i)
+        {
+            nearest.Insert(i, HammingDistance(pDescriptor, pAdded[i - cLoaded].descriptor));
+        }
+    };
+
+    const unsigned int cKeyframes = bLoadedOnly ? cLoaded : GetKeyframeCount();
+    NearestKeyframes nearest;
+
+    if (cKeyframes < cMinParallelKeyframes)
+    {
+        scan(0, cKeyframes, nearest);
+    }
+    else
+    {
+        nearest = m_reduction.Reduce(cKeyframes, scan);
+    }
+
+    const unsigned int cMatches = min(nearest.count, min(k, cMaxMatches));
+    for (unsigned int i = 0; i < cMatches; ++i)
+    {
+        pMatches[i].index = nearest.index[i];
+        pMatches[i].distance = static_cast<float>(nearest.distance[i]) / DescriptorBits;
+    }
+
+    return cMatches;
+}
+
+/// <summary>
+/// Set the most keyframes the database holds, the oldest being removed first.
+/// </summary>
+void KinectFusionKeyframeDatabase::SetMaxKeyframes(unsigned int maxKeyframes)
+{
+    m_cMaxKeyframes = max(maxKeyframes, 1u);
+    Trim();
+}
+
+/// <summary>
+/// Remove the oldest keyframes over the maximum.
+/// </summary>
+void KinectFusionKeyframeDatabase::Trim()
+{
+    unsigned int excess = (GetKeyframeCount() > m_cMaxKeyframes) ? GetKeyframeCount() - m_cMaxKeyframes : 0;
+    if (0 == excess)
+    {
+        return;
+    }
+
+    const unsigned int cLoadedRemoved = min(excess, GetLoadedKeyframeCount());
+    m_iMappedFirst += cLoadedRemoved;
+    excess -= cLoadedRemoved;
+
+    if (excess > 0)
+    {
+        m_keyframes.erase(m_keyframes.begin(), m_keyframes.begin() + excess);
+    }
+
+    if (nullptr != m_pView && 0 == GetLoadedKeyframeCount())
+    {
+        CloseFile();
+    }
+}
+
+/// <summary>
+/// Remove every keyframe and close the loaded file.
+/// </summary>
+void KinectFusionKeyframeDatabase::Clear()
+{
+    CloseFile();
+    m_keyframes.clear();
+}
+
+/// <summary>
+/// Unmap and close the loaded file.
+/// </summary>
+void KinectFusionKeyframeDatabase::CloseFile()
+{
+    if (nullptr != m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = nullptr;
+    }
+
+    if (nullptr != m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_pMapped = nullptr;
+    m_cMapped = 0;
+    m_iMappedFirst = 0;
+    m_szFileName[0] = L'\0';
+}
+
+/// <summary>
+/// Write the keyframes to a file, replacing it. The keyframes are written to a temporary file
+/// which then replaces the file, so a failed save leaves the previous file intact.
+/// </summary>
+HRESULT KinectFusionKeyframeDatabase::Save(LPCWSTR szFileName)
+{
+    if (nullptr == szFileName)
+    {
+        return E_INVALIDARG;
+    }
+
+    WCHAR szTempFileName[MAX_PATH];
+    if (0 != wcscpy_s(szTempFileName, szFileName) || 0 != wcscat_s(szTempFileName, L".tmp"))
+    {
+        return E_INVALIDARG;
+    }
+
+    const UINT64 cbLoaded = static_cast<UINT64>(GetLoadedKeyframeCount()) * sizeof(Keyframe);
+    const UINT64 cbAdded = static_cast<UINT64>(m_keyframes.size()) * sizeof(Keyframe);
+    if (cbLoaded > MAXDWORD || cbAdded > MAXDWORD)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HANDLE hFile = CreateFileW(szTempFileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    FileHeader header;
+    ZeroMemory(&header, sizeof(header));
+    header.magic = Magic;
+    header.version = Version;
+    header.cKeyframes = GetKeyframeCount();
+    header.cbKeyframe = sizeof(Keyframe);
+    header.descriptorBits = DescriptorBits;
+
+    HRESULT hr = S_OK;
+    DWORD cbWritten = 0;
+
+    if (!WriteFile(hFile, &header, sizeof(header), &cbWritten, nullptr) || cbWritten != sizeof(header) ||
+        (cbLoaded > 0 && (!WriteFile(hFile, m_pMapped + m_iMappedFirst, static_cast<DWORD>(cbLoaded), &cbWritten, nullptr) || cbWritten != cbLoaded)) ||
+        (cbAdded > 0 && (!WriteFile(hFile, &m_keyframes[0], static_cast<DWORD>(cbAdded), &cbWritten, nullptr) || cbWritten != cbAdded)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(hFile);
+
+    if (FAILED(hr))
+    {
+        DeleteFileW(szTempFileName);
+        return hr;
+    }
+
+    // The loaded file cannot be replaced while it is mapped, so it is reloaded once replaced
+    const bool bReplacingLoadedFile = (nullptr != m_pView && 0 == _wcsicmp(m_szFileName, szFileName));
+    if (bReplacingLoadedFile)
+    {
+        Clear();
+    }
+
+    if (!MoveFileExW(szTempFileName, szFileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+
+        // The temporary file is the only copy of the keyframes once the database is cleared
+        if (bReplacingLoadedFile)
+        {
+            Load(szTempFileName);
+        }
+        else
+        {
+            DeleteFileW(szTempFileName);
+        }
+    }
+    else if (bReplacingLoadedFile)
+    {
+        hr = Load(szFileName);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Replace the keyframes with those of a file, which stays mapped until the database is cleared.
+/// </summary>
+HRESULT KinectFusionKeyframeDatabase::Load(LPCWSTR szFileName)
+{
+    if (nullptr == szFileName)
+    {
+        return E_INVALIDARG;
+    }
+
+    HANDLE hFile = CreateFileW(szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader)))
+    {
+        CloseHandle(hFile);
+        return E_FAIL;
+    }
+
+    HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr == hMapping)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(hFile);
+        return hr;
+    }
+
+    const BYTE *pView = static_cast<const BYTE*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (nullptr == pView)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return hr;
+    }
+
+    // The keyframes are used in place, so the file must hold exactly the keyframes of its header
+    const FileHeader *pHeader = reinterpret_cast<const FileHeader*>(pView);
+    if (Magic != pHeader->magic || Version != pHeader->version ||
+        sizeof(Keyframe) != pHeader->cbKeyframe || DescriptorBits != pHeader->descriptorBits ||
+        static_cast<UINT64>(fileSize.QuadPart) != sizeof(FileHeader) + static_cast<UINT64>(pHeader->cKeyframes) * sizeof(Keyframe))
+    {
+        UnmapViewOfFile(pView);
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return E_FAIL;
+    }
+
+    Clear();
+
+    m_hFile = hFile;
+    m_hMapping = hMapping;
+    m_pView = pView;
+    m_pMapped = reinterpret_cast<const Keyframe*>(pView + sizeof(FileHeader));
+    m_cMapped = pHeader->cKeyframes;
+    m_iMappedFirst = 0;
+    wcscpy_s(m_szFileName, szFileName);
+
+    Trim();
+
+    return S_OK;
+}
+
+/// <summary>
+/// Time saving, loading and querying a database of synthetic keyframes.
+/// </summary>
+HRESULT KinectFusionKeyframeDatabase::Benchmark(LPCWSTR szFileName, unsigned int keyframes, KinectFusionKeyframeBenchmark *pResults)
+{
+    if (nullptr == szFileName || 0 == keyframes || nullptr == pResults)
+    {
+        return E_INVALIDARG;
+    }
+
+    const unsigned int cQueries = 100;
+
+    KinectFusionKeyframeDatabase *pDatabase = new(std::nothrow) KinectFusionKeyframeDatabase();
+    if (nullptr == pDatabase)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pDatabase->SetMaxKeyframes(keyframes);
+
+    HRESULT hr = S_OK;
+    UINT32 state = 1;
+
+    // Keyframes along a line through the volume, with random descriptors
+    for (unsigned int i = 0; i < keyframes && SUCCEEDED(hr); ++i)
+    {
+        UINT64 descriptor[DescriptorWords];
+        for (unsigned int word = 0; word < DescriptorWords; ++word)
+        {
+            state = state * 1664525u + 1013904223u;
+            UINT64 high = state;
+            state = state * 1664525u + 1013904223u;
+            descriptor[word] = (high << 32) | state;
+        }
+
+        Matrix4 worldToCameraTransform;
+        SetIdentityMatrix(worldToCameraTransform);
+        worldToCameraTransform.M43 = 0.001f * i;
+
+        hr = pDatabase->Add(descriptor, worldToCameraTransform);
+    }
+
+    Timing::Timer timer;
+    pResults->keyframes = keyframes;
+    pResults->cbFile = sizeof(FileHeader) + static_cast<UINT64>(keyframes) * sizeof(Keyframe);
+
+    if (SUCCEEDED(hr))
+    {
+        double startTime = timer.AbsoluteTime();
+        hr = pDatabase->Save(szFileName);
+        pResults->saveTime = (timer.AbsoluteTime() - startTime) * 1000.0;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pDatabase->Clear();
+
+        double startTime = timer.AbsoluteTime();
+        hr = pDatabase->Load(szFileName);
+        pResults->loadTime = (timer.AbsoluteTime() - startTime) * 1000.0;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        KinectFusionKeyframeMatch matches[cMaxMatches];
+
+        double startTime = timer.AbsoluteTime();
+        for (unsigned int i = 0; i < cQueries; ++i)
+        {
+            const unsigned int index = (i * 7919u) % keyframes;
+            pDatabase->FindNearest(pDatabase->GetKeyframe(index).descriptor, cMaxMatches, matches);
+        }
+
+        pResults->queryTime = (timer.AbsoluteTime() - startTime) * 1000.0 / cQueries;
+    }
+
+    delete pDatabase;
+    DeleteFileW(szFileName);
+
+    return hr;
+}
@@ -0,0 +1,251 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionKeyframeDatabase.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionReduction.h"
+
+/// <summary>
+/// A keyframe database file is a header followed by the keyframes, oldest first. The file is
+/// memory mapped when loaded and its keyframes are searched in place.
+/// </summary>
+namespace KinectFusionKeyframeFormat
+{
+    // 'KFKD' file signature
+    static const UINT32         Magic = 0x444B464B;
+    static const UINT32         Version = 1;
+
+    // Bits of each descriptor: the first half compare depth, the second half compare luminance
+    static const unsigned int   DescriptorBits = 256;
+    static const unsigned int   DescriptorWords = DescriptorBits / 64;
+
+    struct FileHeader
+    {
+        UINT32                  magic;
+        UINT32                  version;
+        UINT32                  cKeyframes;
+        UINT32                  cbKeyframe;
+        UINT32                  descriptorBits;
+        UINT32                  reserved;
+    };
+
+    struct Keyframe
+    {
+        UINT64                  descriptor[DescriptorWords];
+        Matrix4                 worldToCameraTransform;
+    };
+}
+
+/// <summary>
+/// A keyframe found by KinectFusionKeyframeDatabase::FindNearest.
+/// </summary>
+struct KinectFusionKeyframeMatch
+{
+    unsigned int                index;
+    float                       distance;   // normalized from 0 (identical) to 1
+};
+
+/// <summary>
+/// Times of the keyframe database operations, in milliseconds.
+/// </summary>
+struct KinectFusionKeyframeBenchmark
+{
+    unsigned int                keyframes;
+    UINT64                      cbFile;
+    double                      saveTime;
+    double                      loadTime;
+    double                      queryTime;
+};
+
+/// <summary>
+/// A database of keyframe poses which can be saved and reloaded, so a later session can
+/// relocalize in a known scene. Each keyframe is described by comparing the depth and the
+/// luminance of fixed pairs of pixel locations, one bit per pair, and keyframes are matched by
+/// the Hamming distance between descriptors. The index is the array of descriptors itself,
+/// scanned in parallel, which at 96 bytes per keyframe finds the nearest of 10,000 keyframes
+/// in well under a millisecond. Keyframes loaded from a file stay in the mapped file, and
+/// keyframes added later are kept in memory. Not thread safe.
+/// </summary>
+class KinectFusionKeyframeDatabase
+{
+public:
+    // The most keyframes FindNearest returns
+    static const unsigned int   cMaxMatches = 16;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionKeyframeDatabase();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionKeyframeDatabase();
+
+    /// <summary>
+    /// Describe a depth float frame and a color frame of the same view.
+    /// </summary>
+    /// <param name="pDepthFloatImage">The depth float image.</param>
+    /// <param name="pColorImage">The color image, the same size as the depth image, or nullptr.</param>
+    /// <param name="pDescriptor">Returns the KinectFusionKeyframeFormat::DescriptorWords words of the descriptor.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Describe(
+        const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+        const NUI_FUSION_IMAGE_FRAME *pColorImage,
+        UINT64 *pDescriptor) const;
+
+    /// <summary>
+    /// Add a keyframe, removing the oldest keyframe when the database is full.
+    /// </summary>
+    /// <param name="pDescriptor">The descriptor of the keyframe.</param>
+    /// <param name="worldToCameraTransform">The camera pose of the keyframe.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Add(const UINT64 *pDescriptor, const Matrix4 &worldToCameraTransform);
+
+    /// <summary>
+    /// Find the keyframes nearest to a descriptor, nearest first.
+    /// </summary>
+    /// <param name="pDescriptor">The descriptor to match.</param>
+    /// <param name="k">The number of keyframes to find, up to cMaxMatches.</param>
+    /// <param name="bLoadedOnly">Whether to only search the keyframes loaded from a file.</param>
+    /// <param name="pMatches">Returns the matches.</param>
+    /// <returns>The number of matches, less than k when there are fewer keyframes</returns>
+    unsigned int                FindNearest(const UINT64 *pDescriptor, unsigned int k, bool bLoadedOnly, KinectFusionKeyframeMatch *pMatches);
+
+    /// <summary>
+    /// The keyframe at an index, from 0 for the oldest.
+    /// </summary>
+    const KinectFusionKeyframeFormat::Keyframe& GetKeyframe(unsigned int index) const
+    {
+        return (index < m_cMapped - m_iMappedFirst)
+            ? m_pMapped[m_iMappedFirst + index]
+            : m_keyframes[index - (m_cMapped - m_iMappedFirst)];
+    }
+
+    /// <summary>
+    /// The number of keyframes.
+    /// </summary>
+    unsigned int                GetKeyframeCount() const
+    {
+        return (m_cMapped - m_iMappedFirst) + static_cast<unsigned int>(m_keyframes.size());
+    }
+
+    /// <summary>
+    /// The number of keyframes loaded from a file which are still in the database.
+    /// </summary>
+    unsigned int                GetLoadedKeyframeCount() const
+    {
+        return m_cMapped - m_iMappedFirst;
+    }
+
+    /// <summary>
+    /// Set the most keyframes the database holds, the oldest being removed first.
+    /// </summary>
+    void                        SetMaxKeyframes(unsigned int maxKeyframes);
+
+    /// <summary>
+    /// Remove every keyframe and close the loaded file.
+    /// </summary>
+    void                        Clear();
+
+    /// <summary>
+    /// Remove the keyframes added since the file was loaded, keeping the loaded keyframes.
+    /// </summary>
+    void                        RemoveAddedKeyframes()
+    {
+        m_keyframes.clear();
+    }
+
+    /// <summary>
+    /// Write the keyframes to a file, replacing it.
+    /// </summary>
+    /// <param name="szFileName">The path of the file.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Save(LPCWSTR szFileName);
+
+    /// <summary>
+    /// Replace the keyframes with those of a file, which stays mapped until the database is cleared.
+    /// </summary>
+    /// <param name="szFileName">The path of the file.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Load(LPCWSTR szFileName);
+
+    /// <summary>
+    /// Time saving, loading and querying a database of synthetic keyframes.
+    /// </summary>
+    /// <param name="szFileName">The path of a temporary file, deleted afterwards.</param>
+    /// <param name="keyframes">The number of keyframes.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT              Benchmark(LPCWSTR szFileName, unsigned int keyframes, KinectFusionKeyframeBenchmark *pResults);
+
+private:
+    /// <summary>
+    /// The best matches found by part of a scan, combined with operator+= by KinectFusionReduction.
+    /// </summary>
+    struct NearestKeyframes
+    {
+        unsigned int            count;
+        unsigned int            index[cMaxMatches];
+        unsigned int            distance[cMaxMatches];
+
+        NearestKeyframes() : count(0) {}
+
+        void Insert(unsigned int keyframeIndex, unsigned int keyframeDistance);
+
+        NearestKeyframes& operator+=(const NearestKeyframes &other);
+    };
+
+    /// <summary>
+    /// Unmap and close the loaded file.
+    /// </summary>
+    void                        CloseFile();
+
+    /// <summary>
+    /// Remove the oldest keyframes over the maximum.
+    /// </summary>
+    void                        Trim();
+
+    // The pixel pairs compared by each descriptor bit, in fractions of the image size
+    struct SamplePair
+    {
+        float                   x0, y0, x1, y1;
+    };
+
+    SamplePair                  m_samplePairs[KinectFusionKeyframeFormat::DescriptorBits];
+
+    HANDLE                      m_hFile;
+    HANDLE                      m_hMapping;
+    const void*                 m_pView;
+    WCHAR                       m_szFileName[MAX_PATH];
+
+    // The mapped keyframes before m_iMappedFirst have been removed as the oldest
+    const KinectFusionKeyframeFormat::Keyframe* m_pMapped;
+    unsigned int                m_cMapped;
+    unsigned int                m_iMappedFirst;
+
+    std::vector<KinectFusionKeyframeFormat::Keyframe> m_keyframes;
+    unsigned int                m_cMaxKeyframes;
+
+    KinectFusionReduction<NearestKeyframes> m_reduction;
+};
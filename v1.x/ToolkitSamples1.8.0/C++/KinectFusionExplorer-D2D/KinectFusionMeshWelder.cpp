@@ -0,0 +1,409 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionMeshWelder.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <math.h>
+#include <new>
+#include <unordered_map>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionMeshWelder.h"
+
+namespace
+{
+    // Vertices are spread over this many partitions by the hash of their weld cell, so the
+    // partitions can be welded in parallel without sharing a hash table
+    static const unsigned int   cWeldPartitions = 64;
+
+    // Number of elements counted by each task of a parallel prefix sum
+    static const unsigned int   cPrefixSumBlockSize = 64 * 1024;
+
+    /// <summary>
+    /// The weld grid cell of a vertex, or its exact position when welding identical positions.
+    /// </summary>
+    struct WeldKey
+    {
+        int x;
+        int y;
+        int z;
+
+        bool operator==(const WeldKey &other) const
+        {
+            return x == other.x && y == other.y && z == other.z;
+        }
+    };
+
+    struct WeldKeyHash
+    {
+        size_t operator()(const WeldKey &key) const
+        {
+            return static_cast<size_t>(
+                (static_cast<unsigned int>(key.x) * 73856093u) ^
+                (static_cast<unsigned int>(key.y) * 19349663u) ^
+                (static_cast<unsigned int>(key.z) * 83492791u));
+        }
+    };
+
+    /// <summary>
+    /// Sum of the colors of the vertices welded into one.
+    /// </summary>
+    struct ColorSum
+    {
+        unsigned int red;
+        unsigned int green;
+        unsigned int blue;
+    };
+
+    /// <summary>
+    /// Make the weld key of a vertex
+    /// </summary>
+    /// <param name="vertex">The vertex position.</param>
+    /// <param name="inverseTolerance">One over the weld grid spacing, or 0 for exact positions.</param>
+    /// <returns>The weld key</returns>
+    WeldKey MakeWeldKey(const Vector3 &vertex, float inverseTolerance)
+    {
+        WeldKey key;
+
+        if (inverseTolerance > 0)
+        {
+            key.x = static_cast<int>(floorf(vertex.x * inverseTolerance + 0.5f));
+            key.y = static_cast<int>(floorf(vertex.y * inverseTolerance + 0.5f));
+            key.z = static_cast<int>(floorf(vertex.z * inverseTolerance + 0.5f));
+        }
+        else
+        {
+            // Adding zero turns -0 into +0, so both weld together
+            float x = vertex.x + 0.0f, y = vertex.y + 0.0f, z = vertex.z + 0.0f;
+            memcpy(&key.x, &x, sizeof(float));
+            memcpy(&key.y, &y, sizeof(float));
+            memcpy(&key.z, &z, sizeof(float));
+        }
+
+        return key;
+    }
+
+    /// <summary>
+    /// Calculate the exclusive prefix sum of an array of flags in parallel
+    /// </summary>
+    /// <param name="flags">The flags, each 0 or 1.</param>
+    /// <param name="offsets">Receives, for each flag, the number of flags set before it.</param>
+    /// <returns>The number of flags set</returns>
+    unsigned int PrefixSum(const std::vector<unsigned char> &flags, std::vector<unsigned int> &offsets)
+    {
+        unsigned int count = static_cast<unsigned int>(flags.size());
+        unsigned int numBlocks = (count + cPrefixSumBlockSize - 1) / cPrefixSumBlockSize;
+        std::vector<unsigned int> blockOffsets(numBlocks + 1, 0);
+
+        offsets.resize(count);
+
+        Concurrency::parallel_for(0u, numBlocks, [&](unsigned int block)
+        {
+            unsigned int end = min((block + 1) * cPrefixSumBlockSize, count);
+            unsigned int sum = 0;
+
+            for (unsigned int i = block * cPrefixSumBlockSize; i < end; ++i)
+            {
+                sum += flags[i];
+            }
+
+            blockOffsets[block + 1] = sum;
+        });
+
+        for (unsigned int block = 0; block < numBlocks; ++block)
+        {
+            blockOffsets[block + 1] += blockOffsets[block];
+        }
+
+        Concurrency::parallel_for(0u, numBlocks, [&](unsigned int block)
+        {
+            unsigned int end = min((block + 1) * cPrefixSumBlockSize, count);
+            unsigned int sum = blockOffsets[block];
+
+            for (unsigned int i = block * cPrefixSumBlockSize; i < end; ++i)
+            {
+                offsets[i] = sum;
+                sum += flags[i];
+            }
+        });
+
+        return blockOffsets[numBlocks];
+    }
+}
+
+/// <summary>
+/// Weld the vertices of a Kinect Fusion mesh into an indexed mesh
+/// </summary>
+/// <param name="mesh">The Kinect Fusion mesh object.</param>
+/// <param name="weldTolerance">The grid spacing in meters, or 0 to weld only identical positions.</param>
+/// <param name="pIndexedMesh">Receives the indexed mesh.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT WeldMeshVertices(INuiFusionColorMesh *mesh, float weldTolerance, KinectFusionIndexedMesh *pIndexedMesh)
+{
+    if (nullptr == mesh || nullptr == pIndexedMesh || weldTolerance < 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    unsigned int numVertices = mesh->VertexCount();
+    unsigned int numTriangleIndices = mesh->TriangleVertexIndexCount();
+    unsigned int numColors = mesh->ColorCount();
+
+    if (0 == numVertices || 0 == numTriangleIndices || 0 != numTriangleIndices % 3
+        || (0 != numColors && numVertices != numColors))
+    {
+        return E_INVALIDARG;
+    }
+
+    const Vector3 *vertices = nullptr;
+    HRESULT hr = mesh->GetVertices(&vertices);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const Vector3 *normals = nullptr;
+    hr = mesh->GetNormals(&normals);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const int *triangleIndices = nullptr;
+    hr = mesh->GetTriangleIndices(&triangleIndices);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const int *colors = nullptr;
+    if (0 != numColors)
+    {
+        hr = mesh->GetColors(&colors);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    const float inverseTolerance = weldTolerance > 0 ? 1.0f / weldTolerance : 0.0f;
+    const unsigned int numTriangles = numTriangleIndices / 3;
+
+    try
+    {
+        // Key each vertex by its weld cell, and choose its partition from the key
+        std::vector<WeldKey> keys(numVertices);
+        std::vector<unsigned char> partitions(numVertices);
+
+        Concurrency::parallel_for(0u, numVertices, [&](unsigned int i)
+        {
+            keys[i] = MakeWeldKey(vertices[i], inverseTolerance);
+            partitions[i] = static_cast<unsigned char>((WeldKeyHash()(keys[i]) >> 8) % cWeldPartitions);
+        });
+
+        // Counting sort the vertices by partition, keeping them in order within each partition
+        std::vector<unsigned int> partitionStarts(cWeldPartitions + 1, 0);
+        for (unsigned int i = 0; i < numVertices; ++i)
+        {
+            ++partitionStarts[partitions[i] + 1];
+        }
+
+        for (unsigned int p = 0; p < cWeldPartitions; ++p)
+        {
+            partitionStarts[p + 1] += partitionStarts[p];
+        }
+
+        std::vector<unsigned int> partitionVertices(numVertices);
+        {
+            std::vector<unsigned int> next(partitionStarts.begin(), partitionStarts.end() - 1);
+            for (unsigned int i = 0; i < numVertices; ++i)
+            {
+                partitionVertices[next[partitions[i]]++] = i;
+            }
+        }
+
+        // Weld each partition. The first vertex in a cell represents the cell, and accumulates
+        // the normals and colors of the cell. A cell lies in one partition, so no two tasks
+        // write the same representative.
+        std::vector<unsigned int> representatives(numVertices);
+        std::vector<Vector3> normalSums(numVertices);
+        std::vector<ColorSum> colorSums(nullptr != colors ? numVertices : 0);
+        std::vector<unsigned int> cellCounts(numVertices, 0);
+
+        Concurrency::parallel_for(0u, cWeldPartitions, [&](unsigned int p)
+        {
+            std::unordered_map<WeldKey, unsigned int, WeldKeyHash> cells;
+            cells.rehash(partitionStarts[p + 1] - partitionStarts[p]);
+
+            for (unsigned int v = partitionStarts[p]; v < partitionStarts[p + 1]; ++v)
+            {
+                unsigned int i = partitionVertices[v];
+                unsigned int rep = cells.insert(std::make_pair(keys[i], i)).first->second;
+
+                representatives[i] = rep;
+
+                if (rep == i)
+                {
+                    normalSums[rep] = normals[i];
+                }
+                else
+                {
+                    normalSums[rep].x += normals[i].x;
+                    normalSums[rep].y += normals[i].y;
+                    normalSums[rep].z += normals[i].z;
+                }
+
+                if (nullptr != colors)
+                {
+                    unsigned int color = colors[i];
+                    ColorSum &sum = colorSums[rep];
+
+                    if (rep == i)
+                    {
+                        sum.red = sum.green = sum.blue = 0;
+                    }
+
+                    sum.red += (color >> 16) & 255;
+                    sum.green += (color >> 8) & 255;
+                    sum.blue += color & 255;
+                }
+
+                ++cellCounts[rep];
+            }
+        });
+
+        // Number the representatives in vertex order, so the welded mesh keeps the vertex order
+        std::vector<unsigned char> isRepresentative(numVertices);
+        Concurrency::parallel_for(0u, numVertices, [&](unsigned int i)
+        {
+            isRepresentative[i] = (representatives[i] == i) ? 1 : 0;
+        });
+
+        std::vector<unsigned int> weldedIndices;
+        unsigned int numWelded = PrefixSum(isRepresentative, weldedIndices);
+
+        pIndexedMesh->vertices.resize(numWelded);
+        pIndexedMesh->normals.resize(numWelded);
+        pIndexedMesh->colors.resize(nullptr != colors ? numWelded : 0);
+
+        Concurrency::parallel_for(0u, numVertices, [&](unsigned int i)
+        {
+            if (0 == isRepresentative[i])
+            {
+                return;
+            }
+
+            unsigned int welded = weldedIndices[i];
+            pIndexedMesh->vertices[welded] = vertices[i];
+
+            // Average the normals of the cell
+            Vector3 normal = normalSums[i];
+            float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+            if (length > 0)
+            {
+                normal.x /= length;
+                normal.y /= length;
+                normal.z /= length;
+            }
+            else
+            {
+                normal = normals[i];
+            }
+
+            pIndexedMesh->normals[welded] = normal;
+
+            // Average the colors of the cell, keeping the alpha of the representative
+            if (nullptr != colors)
+            {
+                unsigned int count = cellCounts[i];
+                const ColorSum &sum = colorSums[i];
+
+                pIndexedMesh->colors[welded] = static_cast<int>(
+                    (static_cast<unsigned int>(colors[i]) & 0xFF000000) |
+                    (((sum.red + count / 2) / count) << 16) |
+                    (((sum.green + count / 2) / count) << 8) |
+                    ((sum.blue + count / 2) / count));
+            }
+        });
+
+        // Remap the triangles to the welded vertices, dropping those which collapsed
+        std::vector<unsigned char> keepTriangle(numTriangles);
+        bool indicesValid = true;
+
+        Concurrency::parallel_for(0u, numTriangles, [&](unsigned int t)
+        {
+            unsigned int corner0 = static_cast<unsigned int>(triangleIndices[t * 3]);
+            unsigned int corner1 = static_cast<unsigned int>(triangleIndices[t * 3 + 1]);
+            unsigned int corner2 = static_cast<unsigned int>(triangleIndices[t * 3 + 2]);
+
+            if (corner0 >= numVertices || corner1 >= numVertices || corner2 >= numVertices)
+            {
+                indicesValid = false;
+                keepTriangle[t] = 0;
+                return;
+            }
+
+            unsigned int rep0 = representatives[corner0];
+            unsigned int rep1 = representatives[corner1];
+            unsigned int rep2 = representatives[corner2];
+
+            keepTriangle[t] = (rep0 != rep1 && rep1 != rep2 && rep2 != rep0) ? 1 : 0;
+        });
+
+        if (!indicesValid)
+        {
+            return E_INVALIDARG;
+        }
+
+        std::vector<unsigned int> triangleOffsets;
+        unsigned int numKept = PrefixSum(keepTriangle, triangleOffsets);
+
+        pIndexedMesh->triangleIndices.resize(numKept * 3);
+
+        Concurrency::parallel_for(0u, numTriangles, [&](unsigned int t)
+        {
+            if (0 == keepTriangle[t])
+            {
+                return;
+            }
+
+            int *pDest = &pIndexedMesh->triangleIndices[triangleOffsets[t] * 3];
+            for (unsigned int corner = 0; corner < 3; ++corner)
+            {
+                unsigned int rep = representatives[triangleIndices[t * 3 + corner]];
+                pDest[corner] = static_cast<int>(weldedIndices[rep]);
+            }
+        });
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,48 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionMeshWelder.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+/// <summary>
+/// A mesh whose triangles share vertices, indexing a single vertex per position.
+/// Normals and colors are per vertex; colors are empty when the mesh has none.
+/// </summary>
+struct KinectFusionIndexedMesh
+{
+    std::vector<Vector3>        vertices;
+    std::vector<Vector3>        normals;
+    std::vector<int>            colors;
+    std::vector<int>            triangleIndices;
+};
+
+/// <summary>
+/// Weld the vertices of a Kinect Fusion mesh, which has three unshared vertices per triangle,
+/// into an indexed mesh. Vertices are welded when they fall in the same cell of a grid of
+/// weldTolerance spacing, and a welded vertex takes the average normal and color of the
+/// vertices it replaces. Triangles left with fewer than three distinct vertices are dropped.
+/// </summary>
+/// <param name="mesh">The Kinect Fusion mesh object.</param>
+/// <param name="weldTolerance">The grid spacing in meters, or 0 to weld only identical positions.</param>
+/// <param name="pIndexedMesh">Receives the indexed mesh.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT WeldMeshVertices(INuiFusionColorMesh *mesh, float weldTolerance, KinectFusionIndexedMesh *pIndexedMesh);
@@ -30,6 +30,14 @@ enum KinectFusionMeshTypes
     Ply = 2
 };
 
+enum KinectFusionVisualizationPath
+{
+    VisualizationScalar = 0,
+    VisualizationLookup = 1,
+    VisualizationAvx2 = 2,
+    VisualizationPathCount = 3
+};
+
 /// <summary>
 /// Parameters to control the behavior of the KinectFusionProcessor.
 /// </summary>
@@ -58,6 +66,8 @@ struct KinectFusionParams
         m_cColorIntegrationInterval(3),
         m_bTranslateResetPoseByMinDepthThreshold(true),
         m_saveMeshType(Stl),
+        m_fMeshWeldTolerance(0.0001f),              // 0.1mm, far below the voxel size
+        m_visualizationPath(VisualizationAvx2),     // falls back to the lookup tables without AVX2
         m_cDeltaFromReferenceFrameCalculationInterval(2),
         m_cMinSuccessfulTrackingFramesForCameraPoseFinder(45), // only update the camera pose finder initially after 45 successful frames (1.5s)
         m_cMinSuccessfulTrackingFramesForCameraPoseFinderAfterFailure(200), // resume integration following 200 successful frames after tracking failure (~7s)
@@ -75,6 +85,8 @@ struct KinectFusionParams
         m_cSmoothingKernelWidth(1),                 // 0=just copy, 1=3x3, 2=5x5, 3=7x7, here we create a 3x3 kernel
         m_fSmoothingDistanceThreshold(0.04f),       // 4cm, could use up to around 0.1f
         m_cAlignPointCloudsImageDownsampleFactor(2),// 1 = no down sample (process at m_depthImageResolution), 2=x/2,y/2, 4=x/4,y/4
+        m_bAlignPointCloudsEdgeAwareDownsample(false), // false = nearest neighbor down sampling
+        m_bAlignPointCloudsCoarseToFine(false),     // true = first align at half the AlignPointClouds resolution
         m_fMaxTranslationDelta(0.3f),               // 0.15 - 0.3m per frame typical
         m_fMaxRotationDelta(20.0f)                  // 10-20 degrees per frame typical
     {
@@ -111,6 +123,59 @@ struct KinectFusionParams
         // GPUs, hence users should manually select GPU indices when multiple reconstruction volumes 
         // are required, each on a separate device.
         m_deviceIndex = -1;    // automatically choose device index for processing
+
+        // When CPU processing is selected, we can choose to use the multithreaded reconstruction volume
+        // implemented in this sample in place of the Kinect Fusion CPU reconstruction, which is
+        // considerably faster on multi-core processors. Camera tracking then always uses AlignPointClouds.
+        m_bUseNativeCpuVolume = true;
+
+        // The native volume can store voxels sparsely, in bricks allocated only around observed
+        // surfaces. The voxel counts above then only bound the extent of the reconstruction, so
+        // much larger extents can be scanned, e.g. 2048x1024x2048 voxels = 8m x 4m x 8m at 256vpm.
+        // Voxel counts must be multiples of 8 when this is enabled.
+        m_bUseSparseVolume = false;
+
+        // The native volume can be split along x into tiles, each integrated and raycast by its
+        // own worker thread, and only the tiles in view of the camera are processed. Each tile is
+        // sparse when m_bUseSparseVolume is set. voxelCountX must then be a multiple of 8, with at
+        // least 8 voxels per tile. Set from the command line, see CKinectFusionExplorer::ParseCommandLine.
+        m_cVolumeTiles = 1;
+
+        // A recorded session can be replayed in place of a live sensor, either at the rate it was
+        // recorded or as fast as frames can be processed, and live sessions can be recorded for
+        // later replay. Both are set from the command line, see CKinectFusionExplorer::ParseCommandLine.
+        m_szReplayFile[0] = L'\0';
+        m_bReplayRealTime = true;
+        m_bExitAfterReplay = false;
+        m_szRecordFile[0] = L'\0';
+
+        // Per stage timings of the processor can be written to a CSV or JSON trace file.
+        m_szTraceFile[0] = L'\0';
+
+        // The camera pose finder key frames can be loaded when processing starts and saved when
+        // it stops, so a later session can relocalize against them.
+        m_szKeyframeFile[0] = L'\0';
+
+        // A native volume can be checkpointed in the background while it is scanned, and the
+        // scan resumed from the checkpoint when the volume is first created.
+        m_szCheckpointFile[0] = L'\0';
+        m_cCheckpointIntervalSeconds = 60;
+
+        // A native volume can roll with the camera, so scans are not limited to the volume
+        // extent: once the camera moves the shift distance, the volume is shifted to follow it,
+        // streaming the voxels left behind out to a host store and back in when revisited.
+        m_bRollingVolume = false;
+        m_fRollingVolumeShiftDistance = 0.25f;
+
+        // The depth can be filtered before it is tracked and integrated: smoothed within 3cm of
+        // each pixel over a 5x5 kernel, small holes filled, and each pixel blended half and half
+        // with the previous frame unless it moved more than 2cm.
+        m_bFilterDepth = false;
+        m_cDepthFilterRadius = 2;
+        m_fDepthFilterRangeThreshold = 0.03f;
+        m_fDepthFilterTemporalWeight = 0.5f;
+        m_fDepthFilterMotionThreshold = 0.02f;
+        m_bDepthFilterFillHoles = true;
     }
 
     /// <summary>
@@ -124,7 +189,10 @@ struct KinectFusionParams
             m_reconstructionParams.voxelCountZ != params.m_reconstructionParams.voxelCountZ ||
             m_reconstructionParams.voxelsPerMeter != params.m_reconstructionParams.voxelsPerMeter ||
             m_processorType != params.m_processorType ||
-            m_deviceIndex != params.m_deviceIndex;
+            m_deviceIndex != params.m_deviceIndex ||
+            m_bUseNativeCpuVolume != params.m_bUseNativeCpuVolume ||
+            m_bUseSparseVolume != params.m_bUseSparseVolume ||
+            m_cVolumeTiles != params.m_cVolumeTiles;
     }
 
     /// <summary>
@@ -132,6 +200,9 @@ struct KinectFusionParams
     /// </summary>
     int                         m_deviceIndex;
     NUI_FUSION_RECONSTRUCTION_PROCESSOR_TYPE m_processorType;
+    bool                        m_bUseNativeCpuVolume;
+    bool                        m_bUseSparseVolume;
+    unsigned int                m_cVolumeTiles;
 
     /// <summary>
     /// Parameter to pause integration of new frames
@@ -191,6 +262,19 @@ struct KinectFusionParams
     bool                        m_bCaptureColor;
     int							m_cColorIntegrationInterval;
     KinectFusionMeshTypes       m_saveMeshType;
+
+    /// <summary>
+    /// Vertices of saved .OBJ and .PLY meshes closer than this distance in meters are welded
+    /// into one vertex shared by their triangles. Set 0 to weld only identical vertices.
+    /// </summary>
+    float                       m_fMeshWeldTolerance;
+
+    /// <summary>
+    /// How the depth, residual and native volume surface images are converted for display.
+    /// Can be set from the command line, see CKinectFusionExplorer::ParseCommandLine.
+    /// </summary>
+    KinectFusionVisualizationPath m_visualizationPath;
+
     unsigned int                m_cDeltaFromReferenceFrameCalculationInterval;
 
     /// <summary>
@@ -267,8 +351,57 @@ struct KinectFusionParams
     /// Camera pose finder AlignPointClouds Camera Tracking related parameters
     /// </summary>
     unsigned int                m_cAlignPointCloudsImageDownsampleFactor;
+    bool                        m_bAlignPointCloudsEdgeAwareDownsample;
+    bool                        m_bAlignPointCloudsCoarseToFine;
     unsigned int                m_cSmoothingKernelWidth;
     float                       m_fSmoothingDistanceThreshold;
     float                       m_fMaxTranslationDelta;
     float                       m_fMaxRotationDelta;
+
+    /// <summary>
+    /// Recorded session replay and recording parameters. The file names are empty when unused.
+    /// The replay file is only read when processing starts.
+    /// </summary>
+    WCHAR                       m_szReplayFile[MAX_PATH];
+    bool                        m_bReplayRealTime;
+    bool                        m_bExitAfterReplay;
+    WCHAR                       m_szRecordFile[MAX_PATH];
+
+    /// <summary>
+    /// The file the per stage timings are written to, empty when unused. A name ending in .json
+    /// is written as JSON, any other as CSV. The file is only opened when processing starts.
+    /// </summary>
+    WCHAR                       m_szTraceFile[MAX_PATH];
+
+    /// <summary>
+    /// The keyframe database file, empty when unused. It is loaded if it exists when processing
+    /// first starts, and replaced with the key frames of the session when processing stops.
+    /// </summary>
+    WCHAR                       m_szKeyframeFile[MAX_PATH];
+
+    /// <summary>
+    /// The volume snapshot file of a native volume, empty when unused. The scan is resumed from
+    /// it when the volume is first created, and it is replaced with a snapshot of the volume
+    /// every m_cCheckpointIntervalSeconds while frames are tracked, and when processing stops.
+    /// </summary>
+    WCHAR                       m_szCheckpointFile[MAX_PATH];
+    unsigned int                m_cCheckpointIntervalSeconds;
+
+    /// <summary>
+    /// Whether the native volume is shifted with the camera, and how far in meters the point the
+    /// camera looks at can move along any axis before it is.
+    /// </summary>
+    bool                        m_bRollingVolume;
+    float                       m_fRollingVolumeShiftDistance;
+
+    /// <summary>
+    /// Depth filter parameters, see KinectFusionDepthFilter::Filter. The filter runs on the
+    /// capture thread after each depth frame is converted to depth float.
+    /// </summary>
+    bool                        m_bFilterDepth;
+    unsigned int                m_cDepthFilterRadius;
+    float                       m_fDepthFilterRangeThreshold;
+    float                       m_fDepthFilterTemporalWeight;
+    float                       m_fDepthFilterMotionThreshold;
+    bool                        m_bDepthFilterFillHoles;
 };
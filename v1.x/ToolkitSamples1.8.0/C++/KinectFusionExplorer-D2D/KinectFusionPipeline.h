@@ -0,0 +1,120 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionPipeline.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <NuiApi.h>
+#include <NuiKinectFusionApi.h>
+
+/// <summary>
+/// Bounded queue between exactly one producer thread and one consumer thread. Neither side
+/// takes a lock: each index is only written by its own side, and the item is published to the
+/// other side by the interlocked (full barrier) index update.
+/// </summary>
+template <typename T, unsigned int Capacity>
+class KinectFusionPipelineQueue
+{
+    static_assert(0 == (Capacity & (Capacity - 1)), "Capacity must be a power of two so the indices can wrap.");
+
+public:
+    KinectFusionPipelineQueue() : m_head(0), m_tail(0)
+    {
+    }
+
+    /// <summary>
+    /// Add an item at the tail of the queue. Only called by the producer.
+    /// </summary>
+    /// <returns>false if the queue is full</returns>
+    bool TryPush(const T &item)
+    {
+        ULONG tail = static_cast<ULONG>(m_tail);
+        if (tail - static_cast<ULONG>(m_head) >= Capacity)
+        {
+            return false;
+        }
+
+        m_items[tail % Capacity] = item;
+        InterlockedExchange(&m_tail, static_cast<LONG>(tail + 1));
+        return true;
+    }
+
+    /// <summary>
+    /// Remove the item at the head of the queue. Only called by the consumer.
+    /// </summary>
+    /// <returns>false if the queue is empty</returns>
+    bool TryPop(T &item)
+    {
+        ULONG head = static_cast<ULONG>(m_head);
+        if (head == static_cast<ULONG>(m_tail))
+        {
+            return false;
+        }
+
+        item = m_items[head % Capacity];
+        InterlockedExchange(&m_head, static_cast<LONG>(head + 1));
+        return true;
+    }
+
+    /// <summary>
+    /// Whether the queue is empty. Exact only when called by the consumer.
+    /// </summary>
+    bool IsEmpty() const
+    {
+        return m_head == m_tail;
+    }
+
+    /// <summary>
+    /// Empty the queue. Only called while neither the producer nor the consumer is running.
+    /// </summary>
+    void Clear()
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+private:
+    T                           m_items[Capacity];
+    volatile LONG               m_head;
+    volatile LONG               m_tail;
+};
+
+/// <summary>
+/// A captured frame on its way from the capture stage to the tracking stage.
+/// </summary>
+struct KinectFusionPipelineFrame
+{
+    NUI_FUSION_IMAGE_FRAME*     pDepthFloatImage;
+    NUI_FUSION_IMAGE_FRAME*     pColorImageDepthAligned;    // valid when integrateColor is set
+    NUI_FUSION_IMAGE_FRAME*     pCameraPoseFinderColorImage;// valid when the camera pose finder is enabled
+    bool                        colorSynchronized;
+    bool                        integrateColor;
+    bool                        resetReconstruction;
+    double                      captureStartTime;           // when the capture stage started on the frame, in seconds
+    double                      queuedTime;                 // when the frame was handed to the tracking stage, in seconds
+};
+
+/// <summary>
+/// A request from the tracking stage for the render stage to raycast the volume for display.
+/// </summary>
+struct KinectFusionRenderRequest
+{
+    Matrix4                     worldToCameraTransform;
+    double                      captureStartTime;
+};
@@ -20,6 +20,7 @@
 
 // System includes
 #include "stdafx.h"
+#include <utility>
 
 #pragma warning(push)
 #pragma warning(disable:6255)
@@ -31,13 +32,16 @@
 // Project includes
 #include "KinectFusionProcessor.h"
 #include "KinectFusionHelper.h"
+#include "KinectFusionCpuVolume.h"
+#include "KinectFusionSparseVolume.h"
+#include "KinectFusionTiledVolume.h"
 #include "resource.h"
 
 #define AssertOwnThread() \
-    _ASSERT_EXPR(GetCurrentThreadId() == m_threadId, __FUNCTIONW__ L" called on wrong thread!");
+    _ASSERT_EXPR(IsProcessingThread(), __FUNCTIONW__ L" called on wrong thread!");
 
 #define AssertOtherThread() \
-    _ASSERT_EXPR(GetCurrentThreadId() != m_threadId, __FUNCTIONW__ L" called on wrong thread!");
+    _ASSERT_EXPR(!IsProcessingThread(), __FUNCTIONW__ L" called on wrong thread!");
 
 /// <summary>
 /// Constructor
@@ -50,6 +54,7 @@ KinectFusionProcessor::KinectFusionProcessor() :
     m_threadId(0),
     m_pVolume(nullptr),
     m_hrRecreateVolume(S_OK),
+    m_pNativeVolume(nullptr),
     m_pSensorChooser(nullptr),
     m_hStatusChangeEvent(INVALID_HANDLE_VALUE),
     m_pNuiSensor(nullptr),
@@ -64,10 +69,38 @@ KinectFusionProcessor::KinectFusionProcessor() :
     m_cLastDepthFrameTimeStamp(0),
     m_cLastColorFrameTimeStamp(0),
     m_fMostRecentRaycastTime(0),
-    m_pDepthImagePixelBuffer(nullptr),
+    m_hTrackingThread(nullptr),
+    m_trackingThreadId(0),
+    m_hRenderThread(nullptr),
+    m_renderThreadId(0),
+    m_hStopPipelineEvent(INVALID_HANDLE_VALUE),
+    m_hFrameCapturedEvent(INVALID_HANDLE_VALUE),
+    m_hFrameFreedEvent(INVALID_HANDLE_VALUE),
+    m_hFrameTrackedEvent(INVALID_HANDLE_VALUE),
+    m_hRenderRequestEvent(INVALID_HANDLE_VALUE),
+    m_pCaptureFrame(nullptr),
+    m_cCapturedFrames(0),
+    m_cSubmittedFrames(0),
+    m_cTrackedFrames(0),
+    m_bResetOnNextCapturedFrame(false),
+    m_bCaptureStalled(false),
+    m_cameraPoseFinderWorker(m_instrumentation),
+    m_bKeyframesLoaded(false),
+    m_hCheckpointThread(nullptr),
+    m_checkpointThreadId(0),
+    m_cVolumeGeneration(0),
+    m_bCheckpointResumed(false),
+    m_pReplay(nullptr),
+    m_iReplayFrame(0),
+    m_cReplayDroppedFrames(0),
+    m_cReplayStartTimeStamp(0),
+    m_fReplayStartTime(0),
+    m_bReplayFinished(false),
+    m_pRecorder(nullptr),
+    m_pDepthImagePixels(nullptr),
+    m_pDepthFrameLease(nullptr),
     m_pColorCoordinates(nullptr),
     m_pMapper(nullptr),
-    m_cPixelBufferLength(0),
     m_cColorCoordinateBufferLength(0),
     m_pDepthFloatImage(nullptr),
     m_pColorImage(nullptr),
@@ -76,6 +109,7 @@ KinectFusionProcessor::KinectFusionProcessor() :
     m_pSmoothDepthFloatImage(nullptr),
     m_pDepthPointCloud(nullptr),
     m_pRaycastPointCloud(nullptr),
+    m_pRenderPointCloud(nullptr),
     m_pRaycastDepthFloatImage(nullptr),
     m_pShadedSurface(nullptr),
     m_pShadedSurfaceNormals(nullptr),
@@ -83,23 +117,31 @@ KinectFusionProcessor::KinectFusionProcessor() :
     m_pFloatDeltaFromReference(nullptr),
     m_pShadedDeltaFromReference(nullptr),
     m_bKinectFusionInitialized(false),
+    m_bParamsChanged(false),
     m_bResetReconstruction(false),
     m_bResolveSensorConflict(false),
     m_bIntegrationResumed(false),
     m_hStopProcessingEvent(INVALID_HANDLE_VALUE),
     m_pCameraPoseFinder(nullptr),
+    m_cameraPoseFinderDepthResolution(NUI_IMAGE_RESOLUTION_INVALID),
+    m_pCameraPoseFinderColorImage(nullptr),
     m_bTrackingHasFailedPreviously(false),
     m_pDownsampledDepthFloatImage(nullptr),
     m_pDownsampledSmoothDepthFloatImage(nullptr),
     m_pDownsampledDepthPointCloud(nullptr),
     m_pDownsampledShadedDeltaFromReference(nullptr),
     m_pDownsampledRaycastPointCloud(nullptr),
+    m_pCoarseDepthFloatImage(nullptr),
+    m_pCoarseSmoothDepthFloatImage(nullptr),
+    m_pCoarseDepthPointCloud(nullptr),
+    m_pCoarseRaycastPointCloud(nullptr),
     m_bCalculateDeltaFrame(false)
 {
     // Initialize synchronization objects
     InitializeCriticalSection(&m_lockParams);
     InitializeCriticalSection(&m_lockFrame);
     InitializeCriticalSection(&m_lockVolume);
+    InitializeCriticalSection(&m_lockRenderRaycast);
 
     m_hStatusChangeEvent = CreateEvent(
         nullptr,
@@ -122,6 +164,34 @@ KinectFusionProcessor::KinectFusionProcessor() :
         FALSE, /* bInitialState */
         nullptr
         );
+    m_hStopPipelineEvent = CreateEvent(
+        nullptr,
+        TRUE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hFrameCapturedEvent = CreateEvent(
+        nullptr,
+        FALSE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hFrameFreedEvent = CreateEvent(
+        nullptr,
+        FALSE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hFrameTrackedEvent = CreateEvent(
+        nullptr,
+        FALSE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hRenderRequestEvent = CreateEvent(
+        nullptr,
+        FALSE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+
+    ZeroMemory(m_pipelineFrames, sizeof(m_pipelineFrames));
+    ZeroMemory(&m_cameraPoseFinderParameters, sizeof(m_cameraPoseFinderParameters));
 
     SetIdentityMatrix(m_worldToCameraTransform);
     SetIdentityMatrix(m_defaultWorldToVolumeTransform);
@@ -139,9 +209,16 @@ KinectFusionProcessor::~KinectFusionProcessor()
 
     // Clean up Kinect Fusion
     SafeRelease(m_pVolume);
+    SAFE_DELETE(m_pNativeVolume);
     SafeRelease(m_pMapper);
 
+    // Complete the recording and close the recorded session
+    SAFE_DELETE(m_pRecorder);
+    SAFE_DELETE(m_pReplay);
+
     // Clean up Kinect Fusion Camera Pose Finder
+    m_cameraPoseFinderWorker.Stop();
+    m_cameraPoseFinderWorker.SetCameraPoseFinder(nullptr);
     SafeRelease(m_pCameraPoseFinder);
 
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pDepthFloatImage);
@@ -149,6 +226,7 @@ KinectFusionProcessor::~KinectFusionProcessor()
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pResampledColorImage);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pResampledColorImageDepthAligned);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pRaycastPointCloud);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pRenderPointCloud);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pRaycastDepthFloatImage);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pShadedSurface);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pShadedSurfaceNormals);
@@ -161,9 +239,27 @@ KinectFusionProcessor::~KinectFusionProcessor()
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pDownsampledSmoothDepthFloatImage);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pDownsampledDepthPointCloud);
     SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pDownsampledShadedDeltaFromReference);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pDownsampledRaycastPointCloud);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pCoarseDepthFloatImage);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pCoarseSmoothDepthFloatImage);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pCoarseDepthPointCloud);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pCoarseRaycastPointCloud);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pCameraPoseFinderColorImage);
+
+    for (size_t i = 0; i < m_poseProposals.size(); ++i)
+    {
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(m_poseProposals[i].pRaycastPointCloud);
+    }
+
+    for (unsigned int i = 0; i < cPipelineFrameCount; ++i)
+    {
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pipelineFrames[i].pDepthFloatImage);
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pipelineFrames[i].pColorImageDepthAligned);
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(m_pipelineFrames[i].pCameraPoseFinderColorImage);
+    }
 
-    // Clean up the depth pixel array
-    SAFE_DELETE_ARRAY(m_pDepthImagePixelBuffer);
+    // Return any leased depth frame before its pool is freed
+    ReleaseDepthFrameLease();
 
     // Clean up the color coordinate array
     SAFE_DELETE_ARRAY(m_pColorCoordinates);
@@ -185,10 +281,31 @@ KinectFusionProcessor::~KinectFusionProcessor()
     {
         CloseHandle(m_hStopProcessingEvent);
     }
+    if (m_hStopPipelineEvent != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hStopPipelineEvent);
+    }
+    if (m_hFrameCapturedEvent != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFrameCapturedEvent);
+    }
+    if (m_hFrameFreedEvent != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFrameFreedEvent);
+    }
+    if (m_hFrameTrackedEvent != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFrameTrackedEvent);
+    }
+    if (m_hRenderRequestEvent != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hRenderRequestEvent);
+    }
 
     DeleteCriticalSection(&m_lockParams);
     DeleteCriticalSection(&m_lockFrame);
     DeleteCriticalSection(&m_lockVolume);
+    DeleteCriticalSection(&m_lockRenderRaycast);
 }
 
 /// <summary>
@@ -264,6 +381,208 @@ DWORD WINAPI KinectFusionProcessor::ThreadProc(LPVOID lpParameter)
     return reinterpret_cast<KinectFusionProcessor*>(lpParameter)->MainLoop();
 }
 
+/// <summary>
+/// Tracking stage thread procedure
+/// </summary>
+DWORD WINAPI KinectFusionProcessor::TrackingThreadProc(LPVOID lpParameter)
+{
+    return reinterpret_cast<KinectFusionProcessor*>(lpParameter)->TrackingLoop();
+}
+
+/// <summary>
+/// Render stage thread procedure
+/// </summary>
+DWORD WINAPI KinectFusionProcessor::RenderThreadProc(LPVOID lpParameter)
+{
+    return reinterpret_cast<KinectFusionProcessor*>(lpParameter)->RenderLoop();
+}
+
+/// <summary>
+/// Volume checkpoint thread procedure
+/// </summary>
+DWORD WINAPI KinectFusionProcessor::CheckpointThreadProc(LPVOID lpParameter)
+{
+    return reinterpret_cast<KinectFusionProcessor*>(lpParameter)->CheckpointLoop();
+}
+
+/// <summary>
+/// Whether the calling thread is one of the processing threads
+/// </summary>
+bool KinectFusionProcessor::IsProcessingThread() const
+{
+    DWORD threadId = GetCurrentThreadId();
+
+    return threadId == m_threadId || threadId == m_trackingThreadId || threadId == m_renderThreadId
+        || threadId == m_checkpointThreadId;
+}
+
+/// <summary>
+/// Start the tracking and render stage threads, with every pipeline frame free for capture
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::StartPipeline()
+{
+    AssertOwnThread();
+
+    m_capturedFrames.Clear();
+    m_freeFrames.Clear();
+    m_renderRequests.Clear();
+
+    for (unsigned int i = 0; i < cPipelineFrameCount; ++i)
+    {
+        m_freeFrames.TryPush(&m_pipelineFrames[i]);
+    }
+
+    m_pCaptureFrame = nullptr;
+    m_cCapturedFrames = 0;
+    m_cSubmittedFrames = 0;
+    m_cTrackedFrames = 0;
+    m_bResetOnNextCapturedFrame = false;
+    m_bCaptureStalled = false;
+
+    // Trace the stage timings of the first session to the file set on the command line
+    if (L'\0' != m_paramsCurrent.m_szTraceFile[0] && !m_instrumentation.IsTraceOpen())
+    {
+        if (FAILED(m_instrumentation.OpenTrace(m_paramsCurrent.m_szTraceFile)))
+        {
+            SetStatusMessage(L"Failed to create the stage timing trace file.");
+        }
+    }
+
+    ResetEvent(m_hStopPipelineEvent);
+    ResetEvent(m_hFrameCapturedEvent);
+    ResetEvent(m_hFrameFreedEvent);
+    ResetEvent(m_hFrameTrackedEvent);
+    ResetEvent(m_hRenderRequestEvent);
+
+    // The threads start suspended so their ids are known before they run
+    HRESULT hr = S_OK;
+
+    m_hTrackingThread = CreateThread(nullptr, 0, TrackingThreadProc, this, CREATE_SUSPENDED, &m_trackingThreadId);
+    if (nullptr == m_hTrackingThread)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else
+    {
+        m_hRenderThread = CreateThread(nullptr, 0, RenderThreadProc, this, CREATE_SUSPENDED, &m_renderThreadId);
+        if (nullptr == m_hRenderThread)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    // Native volume snapshots are written to the checkpoint file in the background
+    if (SUCCEEDED(hr) && L'\0' != m_paramsCurrent.m_szCheckpointFile[0])
+    {
+        m_hCheckpointThread = CreateThread(nullptr, 0, CheckpointThreadProc, this, CREATE_SUSPENDED, &m_checkpointThreadId);
+        if (nullptr == m_hCheckpointThread)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    // Key frames are added to the camera pose finder in the background
+    if (SUCCEEDED(hr) && nullptr != m_pCameraPoseFinder)
+    {
+        hr = m_cameraPoseFinderWorker.Start();
+    }
+
+    // Load the key frames of an earlier session once, the first time the pipeline starts
+    if (SUCCEEDED(hr) && nullptr != m_pCameraPoseFinder && !m_bKeyframesLoaded && L'\0' != m_paramsCurrent.m_szKeyframeFile[0])
+    {
+        m_bKeyframesLoaded = true;
+
+        HRESULT hrLoad = m_cameraPoseFinderWorker.LoadKeyframes(m_paramsCurrent.m_szKeyframeFile);
+        if (FAILED(hrLoad) && HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) != hrLoad)
+        {
+            SetStatusMessage(L"Failed to load the camera pose finder keyframe database.");
+        }
+    }
+
+    if (nullptr != m_hTrackingThread)
+    {
+        ResumeThread(m_hTrackingThread);
+    }
+
+    if (nullptr != m_hRenderThread)
+    {
+        ResumeThread(m_hRenderThread);
+    }
+
+    if (nullptr != m_hCheckpointThread)
+    {
+        ResumeThread(m_hCheckpointThread);
+    }
+
+    if (FAILED(hr))
+    {
+        StopPipeline();
+        SetStatusMessage(L"Failed to start the Kinect Fusion processing threads.");
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Stop the tracking and render stage threads, discarding the frames in flight
+/// </summary>
+void KinectFusionProcessor::StopPipeline()
+{
+    AssertOwnThread();
+
+    m_bKinectFusionInitialized = false;
+
+    SetEvent(m_hStopPipelineEvent);
+
+    if (nullptr != m_hTrackingThread)
+    {
+        WaitForSingleObject(m_hTrackingThread, INFINITE);
+        CloseHandle(m_hTrackingThread);
+        m_hTrackingThread = nullptr;
+    }
+
+    if (nullptr != m_hRenderThread)
+    {
+        WaitForSingleObject(m_hRenderThread, INFINITE);
+        CloseHandle(m_hRenderThread);
+        m_hRenderThread = nullptr;
+    }
+
+    // The checkpoint thread writes a last snapshot before it exits
+    if (nullptr != m_hCheckpointThread)
+    {
+        WaitForSingleObject(m_hCheckpointThread, INFINITE);
+        CloseHandle(m_hCheckpointThread);
+        m_hCheckpointThread = nullptr;
+    }
+
+    m_cameraPoseFinderWorker.Stop();
+
+    m_trackingThreadId = 0;
+    m_renderThreadId = 0;
+    m_checkpointThreadId = 0;
+    m_pCaptureFrame = nullptr;
+}
+
+/// <summary>
+/// Wait until the tracking stage has processed every captured frame
+/// </summary>
+void KinectFusionProcessor::WaitForPipelineIdle()
+{
+    AssertOwnThread();
+
+    HANDLE handles[] = { m_hStopProcessingEvent, m_hFrameTrackedEvent };
+
+    while (nullptr != m_hTrackingThread && m_cTrackedFrames != m_cSubmittedFrames)
+    {
+        if (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+        {
+            break;
+        }
+    }
+}
+
 /// <summary>
 /// Is reconstruction volume initialized
 /// </summary>
@@ -271,7 +590,7 @@ bool KinectFusionProcessor::IsVolumeInitialized()
 {
     AssertOtherThread();
 
-    return nullptr != m_pVolume;
+    return nullptr != m_pVolume || nullptr != m_pNativeVolume;
 }
 
 /// <summary>
@@ -281,11 +600,11 @@ bool KinectFusionProcessor::IsCameraPoseFinderAvailable()
 {
     return m_paramsCurrent.m_bAutoFindCameraPoseWhenLost 
         && nullptr != m_pCameraPoseFinder 
-        && m_pCameraPoseFinder->GetStoredPoseCount() > 0;
+        && (m_cameraPoseFinderWorker.GetStoredPoseCount() > 0 || m_cameraPoseFinderWorker.GetLoadedKeyframeCount() > 0);
 }
 
 /// <summary>
-/// Main processing function
+/// Main processing function, which runs the capture stage
 /// </summary>
 DWORD KinectFusionProcessor::MainLoop()
 {
@@ -294,6 +613,7 @@ DWORD KinectFusionProcessor::MainLoop()
     // Bring in the first set of parameters
     EnterCriticalSection(&m_lockParams);
     m_paramsCurrent = m_paramsNext;
+    m_bParamsChanged = false;
     LeaveCriticalSection(&m_lockParams);
 
     // Set the sensor status callback
@@ -311,99 +631,164 @@ DWORD KinectFusionProcessor::MainLoop()
     // Propagate any updates to the gpu index in use
     m_paramsNext.m_deviceIndex = m_paramsCurrent.m_deviceIndex;
 
-    // Attempt to find a sensor for the first time
-    UpdateSensorAndStatus(NUISENSORCHOOSER_SENSOR_CHANGED_FLAG);
+    if (L'\0' != m_paramsCurrent.m_szReplayFile[0])
+    {
+        // Replay a recorded session in place of a sensor
+        if (SUCCEEDED(OpenReplay()) && SUCCEEDED(StartPipeline()))
+        {
+            m_bKinectFusionInitialized = true;
+        }
+        else
+        {
+            NotifyEmptyFrame();
+        }
+    }
+    else
+    {
+        // Attempt to find a sensor for the first time
+        UpdateSensorAndStatus(NUISENSORCHOOSER_SENSOR_CHANGED_FLAG);
+    }
 
     bool bStopProcessing = false;
 
     // Main loop
     while (!bStopProcessing)
     {
-        HANDLE handles[] = { m_hStopProcessingEvent, m_hNextDepthFrameEvent, m_hStatusChangeEvent };
-        DWORD waitResult = WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE);
+        // Only wait for the next frame once a pipeline frame is free to capture it into. While
+        // the tracking stage is behind, the sensor frames wait in their streams instead.
+        bool bFrameFree = !m_bKinectFusionInitialized || AcquireCaptureFrame();
+
+        HANDLE handles[] = { m_hStopProcessingEvent, bFrameFree ? m_hNextDepthFrameEvent : m_hFrameFreedEvent, m_hStatusChangeEvent };
+        DWORD waitResult = WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, bFrameFree ? GetReplayWaitTime() : INFINITE);
+
+        if (WAIT_TIMEOUT == waitResult)
+        {
+            // The next frame of the recorded session is due
+            waitResult = WAIT_OBJECT_0 + 1;
+        }
 
         // Get parameters and other external signals
 
+        KinectFusionParams paramsNext;
+
         EnterCriticalSection(&m_lockParams);
-        bool bChangeNearMode = m_paramsCurrent.m_bNearMode != m_paramsNext.m_bNearMode;
-        bool bRecreateVolume = m_paramsCurrent.VolumeChanged(m_paramsNext);
+        bool bParamsChanged = m_bParamsChanged;
+        m_bParamsChanged = false;
+        if (bParamsChanged)
+        {
+            paramsNext = m_paramsNext;
+        }
         bool bResetReconstruction = m_bResetReconstruction;
         m_bResetReconstruction = false;
         bool bResolveSensorConflict = m_bResolveSensorConflict;
         m_bResolveSensorConflict = false;
+        LeaveCriticalSection(&m_lockParams);
+
+        bool bChangeNearMode = false;
+        bool bRecreateVolume = false;
 
-        if (m_paramsCurrent.m_bPauseIntegration != m_paramsNext.m_bPauseIntegration)
+        if (bParamsChanged)
         {
-            m_bIntegrationResumed = !m_paramsNext.m_bPauseIntegration;
-        }
+            bChangeNearMode = m_paramsCurrent.m_bNearMode != paramsNext.m_bNearMode;
+            bRecreateVolume = m_paramsCurrent.VolumeChanged(paramsNext);
 
-        m_paramsCurrent = m_paramsNext;
-        LeaveCriticalSection(&m_lockParams);
+            // The tracking and render stages read the current parameters under the volume lock
+            EnterCriticalSection(&m_lockVolume);
 
-        switch (waitResult)
-        {
-        case WAIT_OBJECT_0: // m_hStopProcessingEvent
-            bStopProcessing = true;
-            break;
+            if (m_paramsCurrent.m_bPauseIntegration != paramsNext.m_bPauseIntegration)
+            {
+                m_bIntegrationResumed = !paramsNext.m_bPauseIntegration;
+            }
+
+            m_paramsCurrent = paramsNext;
+
+            LeaveCriticalSection(&m_lockVolume);
+        }
 
-        case WAIT_OBJECT_0 + 1: // m_hNextDepthFrameEvent
+        if (m_bKinectFusionInitialized && WAIT_OBJECT_0 != waitResult)
+        {
+            if (bChangeNearMode)
             {
-                if (m_bKinectFusionInitialized)
+                if (nullptr != m_pNuiSensor)
                 {
-                    // Clear status message from previous frame
-                    SetStatusMessage(L"");
+                    DWORD flags =
+                        m_paramsCurrent.m_bNearMode ?
+                        NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE :
+                        0;
+
+                    m_pNuiSensor->NuiImageStreamSetImageFrameFlags(
+                        m_pDepthStreamHandle,
+                        flags);
+                }
+            }
 
-                    if (bChangeNearMode)
-                    {
-                        if (nullptr != m_pNuiSensor)
-                        {
-                            DWORD flags =
-                                m_paramsCurrent.m_bNearMode ?
-                                NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE :
-                                0;
-
-                            m_pNuiSensor->NuiImageStreamSetImageFrameFlags(
-                                m_pDepthStreamHandle,
-                                flags);
-                        }
-                    }
+            bool bCreateVolume = nullptr == m_pVolume && nullptr == m_pNativeVolume && !FAILED(m_hrRecreateVolume);
+
+            if (bCreateVolume || bRecreateVolume || bResetReconstruction)
+            {
+                EnterCriticalSection(&m_lockVolume);
 
-                    EnterCriticalSection(&m_lockVolume);
+                if (bCreateVolume)
+                {
+                    m_hrRecreateVolume = RecreateVolume();
 
-                    if (nullptr == m_pVolume && !FAILED(m_hrRecreateVolume))
+                    // Set an introductory message on success
+                    if (SUCCEEDED(m_hrRecreateVolume))
                     {
-                        m_hrRecreateVolume = RecreateVolume();
+                        SetStatusMessage(
+                            L"Click ‘Near Mode’ to change sensor range, and ‘Reset Reconstruction’ to clear!");
 
-                        // Set an introductory message on success
-                        if (SUCCEEDED(m_hrRecreateVolume))
+                        // Resume the scan of an earlier session once, the first time the volume is created
+                        if (!m_bCheckpointResumed && L'\0' != m_paramsCurrent.m_szCheckpointFile[0])
                         {
-                            SetStatusMessage(
-                                L"Click ‘Near Mode’ to change sensor range, and ‘Reset Reconstruction’ to clear!");
+                            m_bCheckpointResumed = true;
+                            ResumeFromVolumeCheckpoint();
                         }
                     }
-                    else if (bRecreateVolume)
+                }
+                else if (bRecreateVolume)
+                {
+                    m_hrRecreateVolume = RecreateVolume();
+                }
+                else if (bResetReconstruction)
+                {
+                    HRESULT hr = InternalResetReconstruction();
+
+                    if (SUCCEEDED(hr))
                     {
-                        m_hrRecreateVolume = RecreateVolume();
+                        SetStatusMessage(L"Reconstruction has been reset.");
                     }
-                    else if (bResetReconstruction)
+                    else
                     {
-                        HRESULT hr = InternalResetReconstruction();
-
-                        if (SUCCEEDED(hr))
-                        {
-                            SetStatusMessage(L"Reconstruction has been reset.");
-                        }
-                        else
-                        {
-                            SetStatusMessage(L"Failed to reset reconstruction.");
-                        }
+                        SetStatusMessage(L"Failed to reset reconstruction.");
                     }
+                }
+
+                LeaveCriticalSection(&m_lockVolume);
+            }
+        }
 
-                    ProcessDepth();
+        switch (waitResult)
+        {
+        case WAIT_OBJECT_0: // m_hStopProcessingEvent
+            bStopProcessing = true;
+            break;
 
-                    LeaveCriticalSection(&m_lockVolume);
+        case WAIT_OBJECT_0 + 1: // m_hNextDepthFrameEvent, or m_hFrameFreedEvent when no frame was free
+            {
+                if (!bFrameFree)
+                {
+                    // The sensor streams ran on while the tracking stage caught up
+                    m_bCaptureStalled = true;
+                }
+                else if (m_bKinectFusionInitialized)
+                {
+                    CaptureFrame();
 
-                    NotifyFrameReady();
+                    if (nullptr != m_pReplay && m_bReplayFinished)
+                    {
+                        FinishReplay();
+                    }
                 }
                 break;
             }
@@ -413,7 +798,11 @@ DWORD KinectFusionProcessor::MainLoop()
                 DWORD dwChangeFlags = 0;
                 HRESULT hr = E_FAIL;
 
-                if (nullptr != m_pSensorChooser && !bResolveSensorConflict)
+                if (nullptr != m_pReplay)
+                {
+                    // Sensor changes do not affect a replayed session
+                }
+                else if (nullptr != m_pSensorChooser && !bResolveSensorConflict)
                 {
                     // Handle sensor status change event
                     hr = m_pSensorChooser->HandleNuiStatusChanged(&dwChangeFlags);
@@ -435,13 +824,27 @@ DWORD KinectFusionProcessor::MainLoop()
             bStopProcessing = true;
         }
 
-        if (m_pNuiSensor == nullptr)
+        if (m_pNuiSensor == nullptr && nullptr == m_pReplay)
         {
             // We have no sensor: Set frame rate to zero and notify the UI
             NotifyEmptyFrame();
         }
     }
 
+    StopPipeline();
+
+    // Keep the key frames for the next session
+    if (m_bKeyframesLoaded && nullptr != m_pCameraPoseFinder)
+    {
+        if (FAILED(m_cameraPoseFinderWorker.SaveKeyframes(m_paramsCurrent.m_szKeyframeFile)))
+        {
+            SetStatusMessage(L"Failed to save the camera pose finder keyframe database.");
+        }
+    }
+
+    // Complete the recording while the sensor is still open
+    SAFE_DELETE(m_pRecorder);
+
     ShutdownSensor();
 
     return 0;
@@ -462,9 +865,15 @@ void KinectFusionProcessor::UpdateSensorAndStatus(DWORD dwChangeFlags)
             SafeRelease(m_pNuiSensor);
             if (SUCCEEDED(CreateFirstConnected()))
             {
-                if (SUCCEEDED(InitializeKinectFusion()))
+                if (SUCCEEDED(InitializeKinectFusion()) && SUCCEEDED(StartPipeline()))
                 {
                     m_bKinectFusionInitialized = true;
+
+                    // Record the streams of the first sensor found
+                    if (L'\0' != m_paramsCurrent.m_szRecordFile[0] && nullptr == m_pRecorder)
+                    {
+                        OpenRecorder();
+                    }
                 }
                 else
                 {
@@ -514,12 +923,13 @@ HRESULT KinectFusionProcessor::CreateFirstConnected()
 
     if (SUCCEEDED(hr) && nullptr != m_pNuiSensor)
     {
-        // Open a depth image stream to receive depth frames
+        // Open a depth image stream to receive depth frames. One more frame is buffered than
+        // for color, as the processor holds the frame it is working on until it is integrated.
         hr = m_pNuiSensor->NuiImageStreamOpen(
             NUI_IMAGE_TYPE_DEPTH,
             m_paramsCurrent.m_depthImageResolution,
             0,
-            2,
+            3,
             m_hNextDepthFrameEvent,
             &m_pDepthStreamHandle);
 
@@ -600,59 +1010,186 @@ HRESULT KinectFusionProcessor::SetParams(const KinectFusionParams& params)
 
     EnterCriticalSection(&m_lockParams);
     m_paramsNext = params;
+    m_bParamsChanged = true;
     LeaveCriticalSection(&m_lockParams);
     return S_OK;
 }
 
 /// <summary>
-/// Lock the current frame while rendering it to the screen.
+/// Time the depth, residual and surface image conversions on each visualization path.
 /// </summary>
+/// <param name="width">The width of the images.</param>
+/// <param name="height">The height of the images.</param>
+/// <param name="iterations">The number of calls timed per conversion and path.</param>
+/// <param name="pResults">Returns the times.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT KinectFusionProcessor::LockFrame(KinectFusionProcessorFrame const** ppFrame)
+HRESULT KinectFusionProcessor::BenchmarkVisualization(
+    unsigned int width,
+    unsigned int height,
+    unsigned int iterations,
+    KinectFusionVisualizationBenchmark* pResults)
 {
     AssertOtherThread();
 
-    EnterCriticalSection(&m_lockFrame);
-    *ppFrame = &m_frame;
-
-    return S_OK;
+    return m_visualization.Benchmark(width, height, iterations, pResults);
 }
 
 /// <summary>
-/// Unlock the previously locked frame.
+/// Time saving, loading and querying a keyframe database of synthetic key frames.
 /// </summary>
+/// <param name="keyframes">The number of key frames.</param>
+/// <param name="pResults">Returns the times.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT KinectFusionProcessor::UnlockFrame()
+HRESULT KinectFusionProcessor::BenchmarkKeyframeDatabase(
+    unsigned int keyframes,
+    KinectFusionKeyframeBenchmark* pResults)
 {
     AssertOtherThread();
 
-    LeaveCriticalSection(&m_lockFrame);
+    WCHAR szTempPath[MAX_PATH];
+    WCHAR szFileName[MAX_PATH];
+    if (0 == GetTempPathW(ARRAYSIZE(szTempPath), szTempPath) ||
+        0 == GetTempFileNameW(szTempPath, L"kfk", 0, szFileName))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
 
-    return S_OK;
+    return KinectFusionKeyframeDatabase::Benchmark(szFileName, keyframes, pResults);
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////
-
 /// <summary>
-/// Initialize Kinect Fusion volume and images for processing
+/// Time the integration of the depth frames of a recorded session into the native CPU volume
+/// by number of cores.
 /// </summary>
+/// <param name="params">The parameters naming the recorded session and the volume layout.</param>
+/// <param name="maxFrames">The maximum number of frames of the session to integrate.</param>
+/// <param name="pResults">Returns the times.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT KinectFusionProcessor::InitializeKinectFusion()
+HRESULT KinectFusionProcessor::BenchmarkIntegration(
+    const KinectFusionParams& params,
+    unsigned int maxFrames,
+    KinectFusionIntegrationBenchmark* pResults)
 {
-    AssertOwnThread();
-
-    HRESULT hr = S_OK;
+    AssertOtherThread();
 
-    hr = m_frame.Initialize(m_paramsCurrent.m_cDepthImagePixels);
+    KinectFusionReplay replay;
+    HRESULT hr = replay.Open(params.m_szReplayFile);
     if (FAILED(hr))
     {
-        SetStatusMessage(L"Failed to allocate frame buffers.");
         return hr;
     }
 
-    // Check to ensure suitable DirectX11 compatible hardware exists before initializing Kinect Fusion
-    WCHAR description[MAX_PATH];
-    WCHAR instancePath[MAX_PATH];
+    const KinectFusionRecordingFormat::FileHeader &header = replay.GetHeader();
+    const unsigned int cFrames = min(replay.GetFrameCount(), maxFrames);
+    if (0 == cFrames)
+    {
+        return E_FAIL;
+    }
+
+    // Convert the frames up front, so only the integration is timed
+    std::vector<NUI_FUSION_IMAGE_FRAME*> depthFloatFrames(cFrames, nullptr);
+
+    for (unsigned int i = 0; i < cFrames && SUCCEEDED(hr); ++i)
+    {
+        hr = NuiFusionCreateImageFrame(
+            NUI_FUSION_IMAGE_TYPE_FLOAT,
+            header.depthWidth,
+            header.depthHeight,
+            nullptr,
+            &depthFloatFrames[i]);
+
+        KinectFusionReplayFrame frame;
+        if (SUCCEEDED(hr))
+        {
+            hr = replay.MapFrame(i, frame);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = NuiFusionDepthToDepthFloatFrame(
+                reinterpret_cast<const NUI_DEPTH_IMAGE_PIXEL*>(frame.pDepthPixels),
+                header.depthWidth,
+                header.depthHeight,
+                depthFloatFrames[i],
+                params.m_fMinDepthThreshold,
+                params.m_fMaxDepthThreshold,
+                params.m_bMirrorDepthFrame);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = KinectFusionCpuVolume::Benchmark(
+            params.m_reconstructionParams,
+            &depthFloatFrames[0],
+            cFrames,
+            params.m_cMaxIntegrationWeight,
+            pResults);
+    }
+
+    for (unsigned int i = 0; i < cFrames; ++i)
+    {
+        if (nullptr != depthFloatFrames[i])
+        {
+            static_cast<void>(NuiFusionReleaseImageFrame(depthFloatFrames[i]));
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Lock the current frame while rendering it to the screen.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::LockFrame(KinectFusionProcessorFrame const** ppFrame)
+{
+    AssertOtherThread();
+
+    EnterCriticalSection(&m_lockFrame);
+    *ppFrame = &m_frame;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Unlock the previously locked frame.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::UnlockFrame()
+{
+    AssertOtherThread();
+
+    LeaveCriticalSection(&m_lockFrame);
+
+    return S_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Initialize Kinect Fusion volume and images for processing
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::InitializeKinectFusion()
+{
+    AssertOwnThread();
+
+    // The frames are shared with the tracking and render stages
+    StopPipeline();
+
+    HRESULT hr = S_OK;
+
+    hr = m_frame.Initialize(m_paramsCurrent.m_cDepthImagePixels);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Failed to allocate frame buffers.");
+        return hr;
+    }
+
+    // Check to ensure suitable DirectX11 compatible hardware exists before initializing Kinect Fusion
+    WCHAR description[MAX_PATH];
+    WCHAR instancePath[MAX_PATH];
 
     if (FAILED(hr = NuiFusionGetDeviceInfo(
         m_paramsCurrent.m_processorType, 
@@ -708,6 +1245,12 @@ HRESULT KinectFusionProcessor::InitializeKinectFusion()
         return hr;
     }
 
+    // Copy of the raw color input of Kinect for use in the camera pose finder
+    if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_COLOR, colorWidth, colorHeight, &m_pCameraPoseFinderColorImage)))
+    {
+        return hr;
+    }
+
     // Frame generated from the raw color input of Kinect for use in the camera pose finder.
     // Note color will be down-sampled to the depth size if depth and color capture resolutions differ.
     if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_COLOR, width, height, &m_pResampledColorImage)))
@@ -733,6 +1276,12 @@ HRESULT KinectFusionProcessor::InitializeKinectFusion()
         return hr;
     }
 
+    // Point Cloud generated from ray-casting the volume for display
+    if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_POINT_CLOUD, width, height, &m_pRenderPointCloud)))
+    {
+        return hr;
+    }
+
     // Depth frame generated from ray-casting the volume
     if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_FLOAT, width, height, &m_pRaycastDepthFloatImage)))
     {
@@ -799,30 +1348,55 @@ HRESULT KinectFusionProcessor::InitializeKinectFusion()
         return hr;
     }
 
-    if (nullptr != m_pDepthImagePixelBuffer)
+    // Frames at half the down sampled size, which AlignPointClouds aligns first for coarse to fine tracking
+    if (m_paramsCurrent.m_bAlignPointCloudsCoarseToFine
+        && m_paramsCurrent.m_cAlignPointCloudsImageDownsampleFactor < (1u << KinectFusionImagePyramid::cMaxLevels))
     {
-        // If buffer length has changed, delete the old one.
-        if (m_paramsCurrent.m_cDepthImagePixels != m_cPixelBufferLength)
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_FLOAT, downsampledWidth / 2, downsampledHeight / 2, &m_pCoarseDepthFloatImage)))
+        {
+            return hr;
+        }
+
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_FLOAT, downsampledWidth / 2, downsampledHeight / 2, &m_pCoarseSmoothDepthFloatImage)))
+        {
+            return hr;
+        }
+
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_POINT_CLOUD, downsampledWidth / 2, downsampledHeight / 2, &m_pCoarseDepthPointCloud)))
+        {
+            return hr;
+        }
+
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_POINT_CLOUD, downsampledWidth / 2, downsampledHeight / 2, &m_pCoarseRaycastPointCloud)))
         {
-            SAFE_DELETE_ARRAY(m_pDepthImagePixelBuffer);
+            return hr;
         }
     }
 
-    if (nullptr == m_pDepthImagePixelBuffer)
+    // Frames handed from the capture stage to the tracking stage
+    for (unsigned int i = 0; i < cPipelineFrameCount; ++i)
     {
-        // Depth pixel array to capture data from Kinect sensor
-        m_pDepthImagePixelBuffer =
-            new(std::nothrow) NUI_DEPTH_IMAGE_PIXEL[m_paramsCurrent.m_cDepthImagePixels];
+        KinectFusionPipelineFrame &frame = m_pipelineFrames[i];
+
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_FLOAT, width, height, &frame.pDepthFloatImage)))
+        {
+            return hr;
+        }
 
-        if (nullptr == m_pDepthImagePixelBuffer)
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_COLOR, width, height, &frame.pColorImageDepthAligned)))
         {
-            SetStatusMessage(L"Failed to initialize Kinect Fusion depth image pixel buffer.");
             return hr;
         }
 
-        m_cPixelBufferLength = m_paramsCurrent.m_cDepthImagePixels;
+        if (FAILED(hr = CreateFrame(NUI_FUSION_IMAGE_TYPE_COLOR, colorWidth, colorHeight, &frame.pCameraPoseFinderColorImage)))
+        {
+            return hr;
+        }
     }
 
+    // Depth pixels which cannot be leased in place are copied to buffers from this pool
+    m_depthBufferPool.SetBufferSize(m_paramsCurrent.m_cDepthImagePixels * sizeof(NUI_DEPTH_IMAGE_PIXEL));
+
     if (nullptr != m_pColorCoordinates)
     {
         // If buffer length has changed, delete the old one.
@@ -848,20 +1422,32 @@ HRESULT KinectFusionProcessor::InitializeKinectFusion()
         m_cColorCoordinateBufferLength = m_paramsCurrent.m_cDepthImagePixels;
     }
 
-    if (nullptr != m_pCameraPoseFinder)
+    // The coordinate mapper may have changed, so the remap table is rebuilt on the next frame
+    m_colorRemap.Invalidate();
+
+    NUI_FUSION_CAMERA_POSE_FINDER_PARAMETERS cameraPoseFinderParameters;
+
+    cameraPoseFinderParameters.featureSampleLocationsPerFrameCount = m_paramsCurrent.m_cCameraPoseFinderFeatureSampleLocationsPerFrame;
+    cameraPoseFinderParameters.maxPoseHistoryCount = m_paramsCurrent.m_cMaxCameraPoseFinderPoseHistory;
+    cameraPoseFinderParameters.maxDepthThreshold = m_paramsCurrent.m_fMaxCameraPoseFinderDepthThreshold;
+
+    // The volume survives re-initialization, e.g. when the sensor is reconnected or a session is
+    // replayed, so the key frames to relocalize in it are kept unless the camera pose finder changes
+    if (nullptr != m_pCameraPoseFinder
+        && (cameraPoseFinderParameters.featureSampleLocationsPerFrameCount != m_cameraPoseFinderParameters.featureSampleLocationsPerFrameCount
+            || cameraPoseFinderParameters.maxPoseHistoryCount != m_cameraPoseFinderParameters.maxPoseHistoryCount
+            || cameraPoseFinderParameters.maxDepthThreshold != m_cameraPoseFinderParameters.maxDepthThreshold
+            || m_paramsCurrent.m_depthImageResolution != m_cameraPoseFinderDepthResolution))
     {
+        // The added key frames belong to the old camera pose finder
+        m_cameraPoseFinderWorker.Reset();
+        m_cameraPoseFinderWorker.SetCameraPoseFinder(nullptr);
         SafeRelease(m_pCameraPoseFinder);
     }
 
     // Create the camera pose finder if necessary
     if (nullptr == m_pCameraPoseFinder)
     {
-        NUI_FUSION_CAMERA_POSE_FINDER_PARAMETERS cameraPoseFinderParameters;
-
-        cameraPoseFinderParameters.featureSampleLocationsPerFrameCount = m_paramsCurrent.m_cCameraPoseFinderFeatureSampleLocationsPerFrame;
-        cameraPoseFinderParameters.maxPoseHistoryCount = m_paramsCurrent.m_cMaxCameraPoseFinderPoseHistory;
-        cameraPoseFinderParameters.maxDepthThreshold = m_paramsCurrent.m_fMaxCameraPoseFinderDepthThreshold;
-
         if (FAILED(hr = NuiFusionCreateCameraPoseFinder(
             &cameraPoseFinderParameters,
             nullptr,
@@ -869,6 +1455,12 @@ HRESULT KinectFusionProcessor::InitializeKinectFusion()
         {
             return hr;
         }
+
+        m_cameraPoseFinderParameters = cameraPoseFinderParameters;
+        m_cameraPoseFinderDepthResolution = m_paramsCurrent.m_depthImageResolution;
+
+        m_cameraPoseFinderWorker.SetCameraPoseFinder(m_pCameraPoseFinder);
+        m_cameraPoseFinderWorker.SetMaxKeyframes(m_paramsCurrent.m_cMaxCameraPoseFinderPoseHistory);
     }
 
     return hr;
@@ -923,19 +1515,96 @@ HRESULT KinectFusionProcessor::RecreateVolume()
 
     HRESULT hr = S_OK;
 
-    // Clean up Kinect Fusion
+    // Clean up Kinect Fusion, once the render stage has finished any raycast of the native volume
     SafeRelease(m_pVolume);
 
+    EnterCriticalSection(&m_lockRenderRaycast);
+    SAFE_DELETE(m_pNativeVolume);
+    LeaveCriticalSection(&m_lockRenderRaycast);
+
+    ++m_cVolumeGeneration;
+
     SetIdentityMatrix(m_worldToCameraTransform);
 
-    // Create the Kinect Fusion Reconstruction Volume
-    // Here we create a color volume, enabling optional color processing in the Integrate, ProcessFrame and CalculatePointCloud calls
-    hr = NuiFusionCreateColorReconstruction(
-        &m_paramsCurrent.m_reconstructionParams,
-        m_paramsCurrent.m_processorType,
-        m_paramsCurrent.m_deviceIndex,
-        &m_worldToCameraTransform,
-        &m_pVolume);
+    if (NUI_FUSION_RECONSTRUCTION_PROCESSOR_TYPE_CPU == m_paramsCurrent.m_processorType
+        && m_paramsCurrent.m_bUseNativeCpuVolume && m_paramsCurrent.m_cVolumeTiles > 1)
+    {
+        // Create the native tiled CPU Reconstruction Volume, with a worker thread per tile
+        KinectFusionTiledVolume *pTiledVolume = new(std::nothrow) KinectFusionTiledVolume();
+        if (nullptr == pTiledVolume)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        else
+        {
+            hr = pTiledVolume->Initialize(
+                m_paramsCurrent.m_reconstructionParams,
+                m_paramsCurrent.m_cVolumeTiles,
+                m_paramsCurrent.m_bUseSparseVolume);
+            if (FAILED(hr))
+            {
+                delete pTiledVolume;
+            }
+            else
+            {
+                m_pNativeVolume = pTiledVolume;
+            }
+        }
+    }
+    else if (NUI_FUSION_RECONSTRUCTION_PROCESSOR_TYPE_CPU == m_paramsCurrent.m_processorType
+        && m_paramsCurrent.m_bUseNativeCpuVolume && m_paramsCurrent.m_bUseSparseVolume)
+    {
+        // Create the native sparse CPU Reconstruction Volume, which allocates voxel bricks on demand
+        KinectFusionSparseVolume *pSparseVolume = new(std::nothrow) KinectFusionSparseVolume();
+        if (nullptr == pSparseVolume)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        else
+        {
+            hr = pSparseVolume->Initialize(m_paramsCurrent.m_reconstructionParams);
+            if (FAILED(hr))
+            {
+                delete pSparseVolume;
+            }
+            else
+            {
+                m_pNativeVolume = pSparseVolume;
+            }
+        }
+    }
+    else if (NUI_FUSION_RECONSTRUCTION_PROCESSOR_TYPE_CPU == m_paramsCurrent.m_processorType && m_paramsCurrent.m_bUseNativeCpuVolume)
+    {
+        // Create the native multithreaded CPU Reconstruction Volume
+        KinectFusionCpuVolume *pCpuVolume = new(std::nothrow) KinectFusionCpuVolume();
+        if (nullptr == pCpuVolume)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        else
+        {
+            hr = pCpuVolume->Initialize(m_paramsCurrent.m_reconstructionParams);
+            if (FAILED(hr))
+            {
+                delete pCpuVolume;
+            }
+            else
+            {
+                m_pNativeVolume = pCpuVolume;
+            }
+        }
+    }
+    else
+    {
+        // Create the Kinect Fusion Reconstruction Volume
+        // Here we create a color volume, enabling optional color processing in the Integrate, ProcessFrame and CalculatePointCloud calls
+        hr = NuiFusionCreateColorReconstruction(
+            &m_paramsCurrent.m_reconstructionParams,
+            m_paramsCurrent.m_processorType,
+            m_paramsCurrent.m_deviceIndex,
+            &m_worldToCameraTransform,
+            &m_pVolume);
+    }
 
     if (FAILED(hr))
     {
@@ -969,7 +1638,15 @@ HRESULT KinectFusionProcessor::RecreateVolume()
     else
     {
         // Save the default world to volume transformation to be optionally used in ResetReconstruction
-        hr = m_pVolume->GetCurrentWorldToVolumeTransform(&m_defaultWorldToVolumeTransform);
+        if (nullptr != m_pNativeVolume)
+        {
+            hr = m_pNativeVolume->GetCurrentWorldToVolumeTransform(&m_defaultWorldToVolumeTransform);
+        }
+        else
+        {
+            hr = m_pVolume->GetCurrentWorldToVolumeTransform(&m_defaultWorldToVolumeTransform);
+        }
+
         if (FAILED(hr))
         {
             SetStatusMessage(L"Failed in call to GetCurrentWorldToVolumeTransform.");
@@ -989,6 +1666,15 @@ HRESULT KinectFusionProcessor::RecreateVolume()
         {
             // Reset pause and signal that the integration resumed
             ResetTracking();
+
+            if (nullptr != m_pNativeVolume)
+            {
+                hr = m_rollingVolume.Reset(m_pNativeVolume, m_paramsCurrent.m_reconstructionParams, m_worldToCameraTransform);
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
+            }
         }
 
         // Map X axis to blue channel, Y axis to green channel and Z axis to red channel,
@@ -1008,27 +1694,20 @@ HRESULT KinectFusionProcessor::RecreateVolume()
 }
 
 /// <summary>
-/// Get Extended depth data
+/// Lease the extended depth data of a Kinect image frame. The frame stays locked, so the depth
+/// is processed in place, and is returned to the stream when the lease is released.
 /// </summary>
-/// <param name="imageFrame">The extended depth image frame to copy.</param>
+/// <param name="imageFrame">The extended depth image frame to lease. It is released on failure.</param>
 /// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT KinectFusionProcessor::CopyExtendedDepth(NUI_IMAGE_FRAME &imageFrame)
+HRESULT KinectFusionProcessor::LeaseExtendedDepth(NUI_IMAGE_FRAME &imageFrame)
 {
     AssertOwnThread();
 
-    HRESULT hr = S_OK;
-
-    if (nullptr == m_pDepthImagePixelBuffer)
-    {
-        SetStatusMessage(L"Error depth image pixel buffer is nullptr.");
-        return E_FAIL;
-    }
-
     INuiFrameTexture *extendedDepthTex = nullptr;
 
     // Extract the extended depth in NUI_DEPTH_IMAGE_PIXEL format from the frame
     BOOL nearModeOperational = FALSE;
-    hr = m_pNuiSensor->NuiImageFrameGetDepthImagePixelFrameTexture(
+    HRESULT hr = m_pNuiSensor->NuiImageFrameGetDepthImagePixelFrameTexture(
         m_pDepthStreamHandle,
         &imageFrame,
         &nearModeOperational,
@@ -1036,37 +1715,90 @@ HRESULT KinectFusionProcessor::CopyExtendedDepth(NUI_IMAGE_FRAME &imageFrame)
 
     if (FAILED(hr))
     {
+        m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
         SetStatusMessage(L"Error getting extended depth texture.");
         return hr;
     }
 
-    NUI_LOCKED_RECT extendedDepthLockedRect;
-
     // Lock the frame data to access the un-clamped NUI_DEPTH_IMAGE_PIXELs
-    hr = extendedDepthTex->LockRect(0, &extendedDepthLockedRect, nullptr, 0);
+    KinectFusionFrameLease *pLease = nullptr;
+    hr = KinectFusionFrameLease::CreateFromSensorFrame(
+        m_pNuiSensor,
+        m_pDepthStreamHandle,
+        imageFrame,
+        extendedDepthTex,
+        &pLease);
 
-    if (FAILED(hr) || extendedDepthLockedRect.Pitch == 0)
+    if (FAILED(hr))
     {
         SetStatusMessage(L"Error getting extended depth texture pixels.");
         return hr;
     }
 
-    // Copy the depth pixels so we can return the image frame
-    errno_t err = memcpy_s(
-        m_pDepthImagePixelBuffer,
-        m_paramsCurrent.m_cDepthImagePixels * sizeof(NUI_DEPTH_IMAGE_PIXEL),
-        extendedDepthLockedRect.pBits,
-        extendedDepthTex->BufferLen());
+    return SetDepthFrameLease(pLease);
+}
 
-    extendedDepthTex->UnlockRect(0);
+/// <summary>
+/// Make a leased frame the current extended depth. The processing reads whole rows of
+/// NUI_DEPTH_IMAGE_PIXELs, so a frame with padded rows or misaligned pixels is copied to a
+/// pooled buffer instead.
+/// </summary>
+/// <param name="pLease">The lease, whose reference is taken over.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::SetDepthFrameLease(KinectFusionFrameLease *pLease)
+{
+    ReleaseDepthFrameLease();
 
-    if (0 != err)
+    const UINT cbRow = m_paramsCurrent.m_cDepthWidth * sizeof(NUI_DEPTH_IMAGE_PIXEL);
+    const UINT cRows = m_paramsCurrent.m_cDepthHeight;
+
+    if (pLease->GetPitch() < cbRow || pLease->GetSize() < pLease->GetPitch() * (cRows - 1) + cbRow)
     {
+        pLease->Release();
         SetStatusMessage(L"Error copying extended depth texture pixels.");
-        return hr;
+        return E_FAIL;
     }
 
-    return hr;
+    bool aligned = 0 == (reinterpret_cast<UINT_PTR>(pLease->GetPixels()) % __alignof(NUI_DEPTH_IMAGE_PIXEL));
+
+    if (pLease->GetPitch() != cbRow || !aligned)
+    {
+        // The copy is unavoidable, so reuse a buffer from the pool for it
+        KinectFusionFrameLease *pPooledLease = nullptr;
+        BYTE *pBuffer = nullptr;
+
+        m_depthBufferPool.SetBufferSize(cbRow * cRows);
+
+        HRESULT hr = KinectFusionFrameLease::CreateFromPool(&m_depthBufferPool, cbRow, &pPooledLease, &pBuffer);
+        if (FAILED(hr))
+        {
+            pLease->Release();
+            SetStatusMessage(L"Failed to allocate a depth image pixel buffer.");
+            return hr;
+        }
+
+        for (UINT y = 0; y < cRows; ++y)
+        {
+            memcpy(pBuffer + y * cbRow, pLease->GetPixels() + y * pLease->GetPitch(), cbRow);
+        }
+
+        pLease->Release();
+        pLease = pPooledLease;
+    }
+
+    m_pDepthFrameLease = pLease;
+    m_pDepthImagePixels = reinterpret_cast<const NUI_DEPTH_IMAGE_PIXEL*>(pLease->GetPixels());
+
+    return S_OK;
+}
+
+/// <summary>
+/// Release the lease on the current extended depth
+/// </summary>
+void KinectFusionProcessor::ReleaseDepthFrameLease()
+{
+    m_pDepthImagePixels = nullptr;
+    SafeRelease(m_pDepthFrameLease);
 }
 
 /// <summary>
@@ -1085,9 +1817,8 @@ HRESULT KinectFusionProcessor::CopyColor(NUI_IMAGE_FRAME &imageFrame)
     }
 
     INuiFrameTexture *srcColorTex = imageFrame.pFrameTexture;
-    INuiFrameTexture *destColorTex = m_pColorImage->pFrameTexture;
 
-    if (nullptr == srcColorTex || nullptr == destColorTex)
+    if (nullptr == srcColorTex || nullptr == m_pColorImage->pFrameTexture)
     {
         return E_NOINTERFACE;
     }
@@ -1103,26 +1834,47 @@ HRESULT KinectFusionProcessor::CopyColor(NUI_IMAGE_FRAME &imageFrame)
         return E_NOINTERFACE;
     }
 
+    // Copy the color pixels so we can return the image frame
+    hr = CopyColor(srcLockedRect.pBits, srcLockedRect.size);
+
+    srcColorTex->UnlockRect(0);
+
+    return hr;
+}
+
+/// <summary>
+/// Copy color pixels into the color image
+/// </summary>
+/// <param name="pPixels">The BGRX color pixels to copy.</param>
+/// <param name="cbPixels">The size of the pixels in bytes.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::CopyColor(const BYTE *pPixels, UINT cbPixels)
+{
+    if (nullptr == m_pColorImage || nullptr == m_pColorImage->pFrameTexture)
+    {
+        SetStatusMessage(L"Error copying color texture pixels.");
+        return E_FAIL;
+    }
+
+    INuiFrameTexture *destColorTex = m_pColorImage->pFrameTexture;
+
     // Lock the frame data to access the color pixels
     NUI_LOCKED_RECT destLockedRect;
 
-    hr = destColorTex->LockRect(0, &destLockedRect, nullptr, 0);
+    HRESULT hr = destColorTex->LockRect(0, &destLockedRect, nullptr, 0);
 
     if (FAILED(hr) || destLockedRect.Pitch == 0)
     {
-        srcColorTex->UnlockRect(0);
         SetStatusMessage(L"Error copying color texture pixels.");
         return E_NOINTERFACE;
     }
 
-    // Copy the color pixels so we can return the image frame
     errno_t err = memcpy_s(
         destLockedRect.pBits, 
         m_paramsCurrent.m_cColorImagePixels * KinectFusionParams::BytesPerPixel,
-        srcLockedRect.pBits,
-        srcLockedRect.size);
+        pPixels,
+        cbPixels);
 
-    srcColorTex->UnlockRect(0);
     destColorTex->UnlockRect(0);
 
     if (0 != err)
@@ -1137,19 +1889,24 @@ HRESULT KinectFusionProcessor::CopyColor(NUI_IMAGE_FRAME &imageFrame)
 /// <summary>
 /// Adjust color to the same space as depth
 /// </summary>
+/// <param name="pColorImageDepthAligned">The frame to receive the color aligned to depth.</param>
 /// <returns>S_OK for success, or failure code</returns>
-HRESULT KinectFusionProcessor::MapColorToDepth()
+HRESULT KinectFusionProcessor::MapColorToDepth(NUI_FUSION_IMAGE_FRAME *pColorImageDepthAligned)
 {
+    AssertOwnThread();
+
+    KinectFusionScopedTimer timer(m_instrumentation, KinectFusionStageMapColorToDepth);
+
     HRESULT hr;
 
-    if (nullptr == m_pColorImage || nullptr == m_pResampledColorImageDepthAligned 
-        || nullptr == m_pDepthImagePixelBuffer || nullptr == m_pColorCoordinates)
+    if (nullptr == m_pColorImage || nullptr == pColorImageDepthAligned 
+        || nullptr == m_pDepthImagePixels || nullptr == m_pColorCoordinates)
     {
         return E_FAIL;
     }
 
     INuiFrameTexture *srcColorTex = m_pColorImage->pFrameTexture;
-    INuiFrameTexture *destColorTex = m_pResampledColorImageDepthAligned->pFrameTexture;
+    INuiFrameTexture *destColorTex = pColorImageDepthAligned->pFrameTexture;
 
     if (nullptr == srcColorTex || nullptr == destColorTex)
     {
@@ -1182,18 +1939,39 @@ HRESULT KinectFusionProcessor::MapColorToDepth()
         return  E_FAIL;
     }
 
-    int *rawColorData = reinterpret_cast<int*>(srcLockedRect.pBits);
-    int *colorDataInDepthFrame = reinterpret_cast<int*>(destLockedRect.pBits);
+    // Horizontal flip the color image unless mirrored, as the standard depth image is flipped internally
+    // in Kinect Fusion to give a viewpoint as though from behind the Kinect looking forward by default.
+    hr = m_colorRemap.Initialize(
+        m_paramsCurrent.m_cDepthWidth,
+        m_paramsCurrent.m_cDepthHeight,
+        m_paramsCurrent.m_cColorWidth,
+        m_paramsCurrent.m_cColorHeight,
+        1,
+        !m_paramsCurrent.m_bMirrorDepthFrame,
+        NuiColorToDepthRemap::MapNonZeroDepth);
+
+    // Unlike the display-only samples, the table is rebuilt every frame: color mapped through a
+    // table built for slightly different depth would be integrated into the volume for good
+    m_colorRemap.SetCacheTolerance(0, 0);
+
+    // Get the coordinates to convert color to depth space. The mapper does not write the depth
+    // pixels, which may be a read-only mapping of a recorded session.
+    if (SUCCEEDED(hr) && m_colorRemap.BeginFrame(m_pDepthImagePixels))
+    {
+        hr = m_pMapper->MapDepthFrameToColorFrame(
+            m_paramsCurrent.m_depthImageResolution, 
+            m_paramsCurrent.m_cDepthImagePixels, 
+            const_cast<NUI_DEPTH_IMAGE_PIXEL*>(m_pDepthImagePixels), 
+            NUI_IMAGE_TYPE_COLOR, 
+            m_paramsCurrent.m_colorImageResolution, 
+            m_paramsCurrent.m_cDepthImagePixels,   // the color coordinates that get set are the same array size as the depth image
+            m_pColorCoordinates );
 
-    // Get the coordinates to convert color to depth space
-    hr = m_pMapper->MapDepthFrameToColorFrame(
-        m_paramsCurrent.m_depthImageResolution, 
-        m_paramsCurrent.m_cDepthImagePixels, 
-        m_pDepthImagePixelBuffer, 
-        NUI_IMAGE_TYPE_COLOR, 
-        m_paramsCurrent.m_colorImageResolution, 
-        m_paramsCurrent.m_cDepthImagePixels,   // the color coordinates that get set are the same array size as the depth image
-        m_pColorCoordinates );
+        if (SUCCEEDED(hr))
+        {
+            m_colorRemap.UpdateTable(m_pColorCoordinates);
+        }
+    }
 
     if (FAILED(hr))
     {
@@ -1202,78 +1980,18 @@ HRESULT KinectFusionProcessor::MapColorToDepth()
         return hr;
     }
 
-    // Loop over each row and column of the destination color image and copy from the source image
+    // Copy each pixel of the destination color image from the source image through the remap table
     // Note that we could also do this the other way, and convert the depth pixels into the color space, 
     // avoiding black areas in the converted color image and repeated color images in the background
     // However, then the depth would have radial and tangential distortion like the color camera image,
     // which is not ideal for Kinect Fusion reconstruction.
-    if (m_paramsCurrent.m_bMirrorDepthFrame)
+    Concurrency::parallel_for(0u, m_colorRemap.GetOutputHeight(), [&](UINT y)
     {
-        Concurrency::parallel_for(0, static_cast<int>(m_paramsCurrent.m_cDepthHeight), [&](int y)
-        {
-            unsigned int destIndex = y * m_paramsCurrent.m_cDepthWidth;
+        m_colorRemap.ApplyRow(srcLockedRect.pBits, destLockedRect.pBits, destLockedRect.Pitch, nullptr, y);
+    });
 
-            for (int x = 0; x < m_paramsCurrent.m_cDepthWidth; ++x, ++destIndex)
-            {
-                // calculate index into depth array
-                int colorInDepthX = m_pColorCoordinates[destIndex].x;
-                int colorInDepthY = m_pColorCoordinates[destIndex].y;
-
-                // make sure the depth pixel maps to a valid point in color space
-                if ( colorInDepthX >= 0 && colorInDepthX < m_paramsCurrent.m_cColorWidth 
-                    && colorInDepthY >= 0 && colorInDepthY < m_paramsCurrent.m_cColorHeight 
-                    && m_pDepthImagePixelBuffer[destIndex].depth != 0)
-                {
-                    // Calculate index into color array
-                    unsigned int sourceColorIndex = colorInDepthX + (colorInDepthY * m_paramsCurrent.m_cColorWidth);
-
-                    // Copy color pixel
-                    colorDataInDepthFrame[destIndex] = rawColorData[sourceColorIndex];
-                }
-                else
-                {
-                    colorDataInDepthFrame[destIndex] = 0;
-                }
-            }
-        });
-    }
-    else
-    {
-        Concurrency::parallel_for(0, static_cast<int>(m_paramsCurrent.m_cDepthHeight), [&](int y)
-        {
-            unsigned int destIndex = y * m_paramsCurrent.m_cDepthWidth;
-
-            // Horizontal flip the color image as the standard depth image is flipped internally in Kinect Fusion
-            // to give a viewpoint as though from behind the Kinect looking forward by default.
-            unsigned int flippedDestIndex = destIndex + (m_paramsCurrent.m_cDepthWidth-1);
-
-            for (int x = 0; x < m_paramsCurrent.m_cDepthWidth; ++x, ++destIndex, --flippedDestIndex)
-            {
-                // calculate index into depth array
-                int colorInDepthX = m_pColorCoordinates[destIndex].x;
-                int colorInDepthY = m_pColorCoordinates[destIndex].y;
-
-                // make sure the depth pixel maps to a valid point in color space
-                if ( colorInDepthX >= 0 && colorInDepthX < m_paramsCurrent.m_cColorWidth 
-                    && colorInDepthY >= 0 && colorInDepthY < m_paramsCurrent.m_cColorHeight 
-                    && m_pDepthImagePixelBuffer[destIndex].depth != 0)
-                {
-                    // Calculate index into color array- this will perform a horizontal flip as well
-                    unsigned int sourceColorIndex = colorInDepthX + (colorInDepthY * m_paramsCurrent.m_cColorWidth);
-
-                    // Copy color pixel
-                    colorDataInDepthFrame[flippedDestIndex] = rawColorData[sourceColorIndex];
-                }
-                else
-                {
-                    colorDataInDepthFrame[flippedDestIndex] = 0;
-                }
-            }
-        });
-    }
-
-    srcColorTex->UnlockRect(0);
-    destColorTex->UnlockRect(0);
+    srcColorTex->UnlockRect(0);
+    destColorTex->UnlockRect(0);
 
     return hr;
 }
@@ -1289,6 +2007,13 @@ HRESULT KinectFusionProcessor::GetKinectFrames(bool &colorSynchronized)
     LONGLONG currentColorFrameTime = 0;
     colorSynchronized = true;   // assume we are synchronized to start with
 
+    KinectFusionScopedTimer timer(m_instrumentation, KinectFusionStageGetKinectFrames);
+
+    if (nullptr != m_pReplay)
+    {
+        return GetReplayFrames(colorSynchronized);
+    }
+
     ////////////////////////////////////////////////////////
     // Get an extended depth frame from Kinect
 
@@ -1299,16 +2024,13 @@ HRESULT KinectFusionProcessor::GetKinectFrames(bool &colorSynchronized)
         return hr;
     }
 
-    hr = CopyExtendedDepth(imageFrame);
-
     currentDepthFrameTime = imageFrame.liTimeStamp.QuadPart;
 
-    // Release the Kinect camera frame
-    m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
+    // The Kinect camera frame is released with the lease, once the depth has been processed
+    hr = LeaseExtendedDepth(imageFrame);
 
     if (FAILED(hr))
     {
-        SetStatusMessage(L"Kinect depth stream NuiImageStreamReleaseFrame call failed.");
         return hr;
     }
 
@@ -1343,50 +2065,30 @@ HRESULT KinectFusionProcessor::GetKinectFrames(bool &colorSynchronized)
     // If not, we attempt to re-synchronize by getting a new frame from the stream that is behind.
     int timestampDiff = static_cast<int>(abs(currentColorFrameTime - currentDepthFrameTime));
 
-    if (timestampDiff >= cMinTimestampDifferenceForFrameReSync && m_cSuccessfulFrameCounter > 0 && (m_paramsCurrent.m_bAutoFindCameraPoseWhenLost || m_paramsCurrent.m_bCaptureColor))
+    if (timestampDiff >= cMinTimestampDifferenceForFrameReSync && m_cCapturedFrames > 0 && (m_paramsCurrent.m_bAutoFindCameraPoseWhenLost || m_paramsCurrent.m_bCaptureColor))
     {
         // Get another frame to try and re-sync
         if (currentColorFrameTime - currentDepthFrameTime >= cMinTimestampDifferenceForFrameReSync)
         {
-            // Perform camera tracking only from this current depth frame
-            if (nullptr != m_pVolume)
+            // Hand the current depth frame to the tracking stage without color, so camera tracking
+            // follows it, provided another pipeline frame is free to capture the next depth frame
+            if (!m_freeFrames.IsEmpty())
             {
-                // Convert the pixels describing extended depth as unsigned short type in millimeters to depth
-                // as floating point type in meters.
-                hr = m_pVolume->DepthToDepthFloatFrame(
-                            m_pDepthImagePixelBuffer,
-                            m_paramsCurrent.m_cDepthImagePixels * sizeof(NUI_DEPTH_IMAGE_PIXEL),
-                            m_pDepthFloatImage,
-                            m_paramsCurrent.m_fMinDepthThreshold,
-                            m_paramsCurrent.m_fMaxDepthThreshold,
-                            m_paramsCurrent.m_bMirrorDepthFrame);
+                double captureStartTime = m_pCaptureFrame->captureStartTime;
 
+                hr = SubmitCapturedFrame(false);
                 if (FAILED(hr))
                 {
-                    SetStatusMessage(L"Kinect Fusion NuiFusionDepthToDepthFloatFrame call failed.");
                     return hr;
                 }
 
-                Matrix4 calculatedCameraPose = m_worldToCameraTransform;
-                FLOAT alignmentEnergy = 1.0f;
-
-                hr = TrackCameraAlignPointClouds(calculatedCameraPose, alignmentEnergy);
-
-                if (SUCCEEDED(hr))
-                {
-                    m_worldToCameraTransform = calculatedCameraPose;
-
-                    // Raycast and set reference frame for tracking with AlignDepthFloatToReconstruction
-                    hr = SetReferenceFrame(m_worldToCameraTransform);
-
-                    SetTrackingSucceeded();
-                }
-                else
-                {
-                    SetTrackingFailed();
-                }
+                AcquireCaptureFrame();
+                m_pCaptureFrame->captureStartTime = captureStartTime;
             }
 
+            // Return the current depth frame to the stream before getting the next
+            ReleaseDepthFrameLease();
+
             // Get another depth frame to try and re-sync as color ahead of depth
             hr = m_pNuiSensor->NuiImageStreamGetNextFrame(m_pDepthStreamHandle, timestampDiff, &imageFrame);
             if (FAILED(hr))
@@ -1395,16 +2097,12 @@ HRESULT KinectFusionProcessor::GetKinectFrames(bool &colorSynchronized)
                 return hr;
             }
 
-            hr = CopyExtendedDepth(imageFrame);
-
             currentDepthFrameTime = imageFrame.liTimeStamp.QuadPart;
 
-            // Release the Kinect camera frame
-            m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
+            hr = LeaseExtendedDepth(imageFrame);
 
             if (FAILED(hr))
             {
-                SetStatusMessage(L"Kinect depth stream NuiImageStreamReleaseFrame call failed.");
                 return hr;
             }
         }
@@ -1461,21 +2159,16 @@ HRESULT KinectFusionProcessor::GetKinectFrames(bool &colorSynchronized)
         cResetOnTimeStampSkippedMilliseconds = cResetOnTimeStampSkippedMillisecondsCPU;
     }
 
-    if (m_paramsCurrent.m_bAutoResetReconstructionOnTimeout && m_cFrameCounter != 0 && nullptr != m_pVolume 
+    // Timestamps also skip while the capture stage waits for the tracking stage, for example while
+    // a mesh is calculated, so frames captured after a stall are not checked.
+    if (m_paramsCurrent.m_bAutoResetReconstructionOnTimeout && m_cCapturedFrames != 0 && !m_bCaptureStalled
         && abs(currentDepthFrameTime - m_cLastDepthFrameTimeStamp) > cResetOnTimeStampSkippedMilliseconds)
     {
-        hr = InternalResetReconstruction();
-
-        if (SUCCEEDED(hr))
-        {
-            SetStatusMessage(L"Reconstruction has been reset.");
-        }
-        else
-        {
-            SetStatusMessage(L"Failed to reset reconstruction.");
-        }
+        // The tracking stage resets the reconstruction before it processes this frame
+        m_bResetOnNextCapturedFrame = true;
     }
 
+    m_bCaptureStalled = false;
     m_cLastDepthFrameTimeStamp = currentDepthFrameTime;
     m_cLastColorFrameTimeStamp = currentColorFrameTime;
 
@@ -1483,273 +2176,876 @@ HRESULT KinectFusionProcessor::GetKinectFrames(bool &colorSynchronized)
 }
 
 /// <summary>
-/// Perform camera tracking using AlignPointClouds
+/// Open the recorded session named in the parameters in place of a sensor
 /// </summary>
-HRESULT KinectFusionProcessor::TrackCameraAlignPointClouds(Matrix4 &calculatedCameraPose, FLOAT &alignmentEnergy)
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::OpenReplay()
 {
-    ////////////////////////////////////////////////////////
-    // Down sample the depth image
+    AssertOwnThread();
 
-    HRESULT hr = DownsampleFrameNearestNeighbor(
-        m_pDepthFloatImage, 
-        m_pDownsampledDepthFloatImage,
-        m_paramsCurrent.m_cAlignPointCloudsImageDownsampleFactor);
+    m_pReplay = new(std::nothrow) KinectFusionReplay();
+    if (nullptr == m_pReplay)
+    {
+        SetStatusMessage(L"Memory allocation failure");
+        return E_OUTOFMEMORY;
+    }
 
+    HRESULT hr = m_pReplay->Open(m_paramsCurrent.m_szReplayFile);
     if (FAILED(hr))
     {
-        SetStatusMessage(L"Kinect Fusion DownsampleFrameNearestNeighbor call failed.");
+        SetStatusMessage(L"Failed to open the recorded session.");
+        SAFE_DELETE(m_pReplay);
         return hr;
     }
 
-    ////////////////////////////////////////////////////////
-    // Smooth depth image
-
-    hr = m_pVolume->SmoothDepthFloatFrame(
-        m_pDownsampledDepthFloatImage, 
-        m_pDownsampledSmoothDepthFloatImage, 
-        m_paramsCurrent.m_cSmoothingKernelWidth, 
-        m_paramsCurrent.m_fSmoothingDistanceThreshold);
+    const KinectFusionRecordingFormat::FileHeader &header = m_pReplay->GetHeader();
 
-    if (FAILED(hr))
+    // The frame buffers are sized from the parameters, so the recording must match them
+    if (header.depthImageResolution != m_paramsCurrent.m_depthImageResolution
+        || header.colorImageResolution != m_paramsCurrent.m_colorImageResolution)
     {
-        SetStatusMessage(L"Kinect Fusion SmoothDepth call failed.");
-        return hr;
+        SetStatusMessage(L"The recorded session resolution does not match the depth and color resolution parameters.");
+        SAFE_DELETE(m_pReplay);
+        return E_INVALIDARG;
     }
 
-    ////////////////////////////////////////////////////////
-    // Calculate Point Cloud from smoothed input Depth Image
-
-    hr = NuiFusionDepthFloatFrameToPointCloud(
-        m_pDownsampledSmoothDepthFloatImage,
-        m_pDownsampledDepthPointCloud);
+    if (0 == m_pReplay->GetFrameCount())
+    {
+        SetStatusMessage(L"The recorded session contains no frames.");
+        SAFE_DELETE(m_pReplay);
+        return E_FAIL;
+    }
 
+    // Map color to depth with the calibration of the sensor which made the recording
+    SafeRelease(m_pMapper);
+    hr = m_pReplay->CreateCoordinateMapper(&m_pMapper);
     if (FAILED(hr))
     {
-        SetStatusMessage(L"Kinect Fusion NuiFusionDepthFloatFrameToPointCloud call failed.");
+        SetStatusMessage(L"Failed to create a coordinate mapper for the recorded session.");
+        SAFE_DELETE(m_pReplay);
         return hr;
     }
 
-    ////////////////////////////////////////////////////////
-    // CalculatePointCloud
-
-    // Raycast even if camera tracking failed, to enable us to visualize what is 
-    // happening with the system
-    hr = m_pVolume->CalculatePointCloud(
-        m_pDownsampledRaycastPointCloud,
-        nullptr, 
-        &calculatedCameraPose);
-
+    hr = InitializeKinectFusion();
     if (FAILED(hr))
     {
-        SetStatusMessage(L"Kinect Fusion CalculatePointCloud call failed.");
+        SAFE_DELETE(m_pReplay);
         return hr;
     }
 
-    ////////////////////////////////////////////////////////
-    // Call AlignPointClouds
+    m_iReplayFrame = 0;
+    m_cReplayDroppedFrames = 0;
+    m_bReplayFinished = false;
 
-    HRESULT tracking = S_OK;
+    return S_OK;
+}
 
-    // Only calculate the residual delta from reference frame every m_cDeltaFromReferenceFrameCalculationInterval
-    // frames to reduce computation time
-    if (m_bCalculateDeltaFrame)
+/// <summary>
+/// Get the next frames from the recorded session. When replaying in real time, frames which
+/// fell due while the previous frame was processed are dropped, as a live sensor would.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::GetReplayFrames(bool &colorSynchronized)
+{
+    AssertOwnThread();
+
+    colorSynchronized = false;
+
+    UINT cFrames = m_pReplay->GetFrameCount();
+    if (m_iReplayFrame >= cFrames)
     {
-        tracking = NuiFusionAlignPointClouds(
-            m_pDownsampledRaycastPointCloud,
-            m_pDownsampledDepthPointCloud,
-            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
-            m_pDownsampledShadedDeltaFromReference,
-            &calculatedCameraPose); 
+        return E_FAIL;
+    }
 
-        // Up sample the delta from reference image to display as the original resolution
-        hr = UpsampleFrameNearestNeighbor(
-            m_pDownsampledShadedDeltaFromReference, 
-            m_pShadedDeltaFromReference, 
-            m_paramsCurrent.m_cAlignPointCloudsImageDownsampleFactor);
+    if (0 == m_iReplayFrame)
+    {
+        // The replay clock starts with the first frame
+        m_fReplayStartTime = m_timer.AbsoluteTime();
+        m_cReplayStartTimeStamp = m_pReplay->GetDepthTimeStamp(0);
+    }
+    else if (m_paramsCurrent.m_bReplayRealTime)
+    {
+        // Skip by the timestamps of the index, so only the frame which is processed is mapped
+        double elapsedMilliseconds = (m_timer.AbsoluteTime() - m_fReplayStartTime) * 1000.0;
 
-        if (FAILED(hr))
+        while (m_iReplayFrame + 1 < cFrames
+            && static_cast<double>(m_pReplay->GetDepthTimeStamp(m_iReplayFrame + 1) - m_cReplayStartTimeStamp) <= elapsedMilliseconds)
         {
-            SetStatusMessage(L"Kinect Fusion UpsampleFrameNearestNeighbor call failed.");
-            return hr;
+            ++m_iReplayFrame;
+            ++m_cReplayDroppedFrames;
         }
     }
-    else
+
+    KinectFusionReplayFrame frame;
+    HRESULT hr = m_pReplay->MapFrame(m_iReplayFrame, frame);
+
+    ++m_iReplayFrame;
+    m_bReplayFinished = m_iReplayFrame >= cFrames;
+
+    if (FAILED(hr))
     {
-        tracking = NuiFusionAlignPointClouds(
-            m_pDownsampledRaycastPointCloud,
-            m_pDownsampledDepthPointCloud,
-            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
-            nullptr,
-            &calculatedCameraPose); 
+        SetStatusMessage(L"Failed to read a frame of the recorded session.");
+        return hr;
     }
 
-    if (!FAILED(tracking))
+    // The mapped view stays valid until the next frame is mapped, after this one is processed
+    KinectFusionFrameLease *pLease = nullptr;
+    hr = KinectFusionFrameLease::CreateFromMemory(
+        frame.pDepthPixels,
+        frame.cbDepth,
+        m_paramsCurrent.m_cDepthWidth * sizeof(NUI_DEPTH_IMAGE_PIXEL),
+        &pLease);
+
+    if (SUCCEEDED(hr))
     {
-        // Perform additional transform magnitude check
-        // Camera Tracking has converged but did we get a sensible pose estimate?
-        // see if relative rotation and translation exceed thresholds 
-        if (CameraTransformFailed(
-            m_worldToCameraTransform,
-            calculatedCameraPose,
-            m_paramsCurrent.m_fMaxTranslationDelta,
-            m_paramsCurrent.m_fMaxRotationDelta))
-        {
-            // We calculated too large a move for this to be a sensible estimate,
-            // quite possibly the camera tracking drifted. Force camera pose finding.
-            hr = E_NUI_FUSION_TRACKING_ERROR;
+        hr = SetDepthFrameLease(pLease);
+    }
 
-            SetStatusMessage(
-                L"Kinect Fusion AlignPointClouds camera tracking failed "
-                L"in transform magnitude check!");
-        }
+    if (FAILED(hr))
+    {
+        return hr;
     }
-    else
+
+    if (nullptr != frame.pColorPixels)
     {
-        hr = tracking;
+        // Here we just do not integrate color rather than reporting an error
+        int timestampDiff = static_cast<int>(abs(frame.colorTimeStamp - frame.depthTimeStamp));
+
+        colorSynchronized =
+            SUCCEEDED(CopyColor(frame.pColorPixels, frame.cbColor))
+            && timestampDiff <= cMinTimestampDifferenceForFrameReSync;
     }
 
-    return hr;
+    m_cLastDepthFrameTimeStamp = frame.depthTimeStamp;
+    m_cLastColorFrameTimeStamp = frame.colorTimeStamp;
+
+    return S_OK;
 }
 
 /// <summary>
-/// Perform camera tracking using AlignDepthFloatToReconstruction
+/// Time until the next frame of the recorded session is due
 /// </summary>
-/// <returns>S_OK on success, otherwise failure code</returns>
-HRESULT KinectFusionProcessor::TrackCameraAlignDepthFloatToReconstruction(Matrix4 &calculatedCameraPose, FLOAT &alignmentEnergy)
+/// <returns>The time in milliseconds, or INFINITE when not replaying</returns>
+DWORD KinectFusionProcessor::GetReplayWaitTime()
 {
-    HRESULT hr = S_OK;
-
-    // Only calculate the residual delta from reference frame every m_cDeltaFromReferenceFrameCalculationInterval
-    // frames to reduce computation time
-    HRESULT tracking = S_OK;
-
-    if (m_bCalculateDeltaFrame)
+    if (nullptr == m_pReplay || m_bReplayFinished || !m_bKinectFusionInitialized)
     {
-        tracking = m_pVolume->AlignDepthFloatToReconstruction(
-            m_pDepthFloatImage,
-            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
-            m_pFloatDeltaFromReference,
-            &alignmentEnergy,
-            &calculatedCameraPose);
+        return INFINITE;
     }
-    else
+
+    if (!m_paramsCurrent.m_bReplayRealTime || 0 == m_iReplayFrame)
     {
-        tracking = m_pVolume->AlignDepthFloatToReconstruction(
-            m_pDepthFloatImage,
-            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
-            nullptr,
-            &alignmentEnergy,
-            &calculatedCameraPose);
+        return 0;
     }
 
-    bool trackingSuccess = !(FAILED(tracking) || alignmentEnergy > m_paramsCurrent.m_fMaxAlignToReconstructionEnergyForSuccess || (alignmentEnergy == 0.0f && m_cSuccessfulFrameCounter > 1));
+    LONGLONG depthTimeStamp = m_pReplay->GetDepthTimeStamp(m_iReplayFrame);
 
-    if (trackingSuccess)
-    {
-        // Get the camera pose
-        m_pVolume->GetCurrentWorldToCameraTransform(&calculatedCameraPose);
-    }
-    else
-    {
-        if (FAILED(tracking))
-        {
-            hr = tracking;
-        }
-        else
-        {
-            // We failed in the energy check
-            hr = E_NUI_FUSION_TRACKING_ERROR;
-        }
-    }
+    double dueTime = m_fReplayStartTime + static_cast<double>(depthTimeStamp - m_cReplayStartTimeStamp) / 1000.0;
+    double waitTime = dueTime - m_timer.AbsoluteTime();
 
-    return hr;
+    return waitTime > 0.0 ? static_cast<DWORD>(waitTime * 1000.0) : 0;
 }
 
 /// <summary>
-/// Handle new depth data and perform Kinect Fusion processing
+/// Report the replay throughput once the last frame of the recorded session is processed
 /// </summary>
-void KinectFusionProcessor::ProcessDepth()
+void KinectFusionProcessor::FinishReplay()
 {
     AssertOwnThread();
 
-    HRESULT hr = S_OK;
-    bool depthAvailable = false;
-    bool raycastFrame = false;
-    bool cameraPoseFinderAvailable = IsCameraPoseFinderAvailable();
-    bool integrateColor = m_paramsCurrent.m_bCaptureColor && m_cFrameCounter % m_paramsCurrent.m_cColorIntegrationInterval == 0;
-    bool colorSynchronized = false;
-    FLOAT alignmentEnergy = 1.0f;
-    Matrix4 calculatedCameraPose = m_worldToCameraTransform;
-    m_bCalculateDeltaFrame = (m_cFrameCounter % m_paramsCurrent.m_cDeltaFromReferenceFrameCalculationInterval == 0) 
-                            || (m_bTrackingHasFailedPreviously && m_cSuccessfulFrameCounter <= 2);
-
-    // Get the next frames from Kinect
-    hr = GetKinectFrames(colorSynchronized);
+    // The last frames are still in the pipeline
+    WaitForPipelineIdle();
 
-    if (FAILED(hr))
-    {
-        goto FinishFrame;
-    }
+    double elapsedTime = m_timer.AbsoluteTime() - m_fReplayStartTime;
+    UINT cProcessedFrames = m_pReplay->GetFrameCount() - m_cReplayDroppedFrames;
 
-    // Only integrate when color is synchronized with depth
-    integrateColor = integrateColor && colorSynchronized;
+    WCHAR szMessage[KinectFusionProcessorFrame::StatusMessageMaxLen];
+    swprintf_s(
+        szMessage,
+        ARRAYSIZE(szMessage),
+        L"Replay finished: %u frames processed, %u dropped, in %.2f s (%.1f fps).",
+        cProcessedFrames,
+        m_cReplayDroppedFrames,
+        elapsedTime,
+        elapsedTime > 0.0 ? cProcessedFrames / elapsedTime : 0.0);
+    SetStatusMessage(szMessage);
 
-    ////////////////////////////////////////////////////////
-    // Depth to Depth Float
+    NotifyEmptyFrame();
 
-    // Convert the pixels describing extended depth as unsigned short type in millimeters to depth
-    // as floating point type in meters.
-    if (nullptr == m_pVolume)
+    if (m_paramsCurrent.m_bExitAfterReplay && nullptr != m_hWnd)
     {
-        hr =  NuiFusionDepthToDepthFloatFrame(
-            m_pDepthImagePixelBuffer,
-            m_paramsCurrent.m_cDepthWidth,
-            m_paramsCurrent.m_cDepthHeight,
-            m_pDepthFloatImage,
-            m_paramsCurrent.m_fMinDepthThreshold,
-            m_paramsCurrent.m_fMaxDepthThreshold,
-            m_paramsCurrent.m_bMirrorDepthFrame);
+        PostMessage(m_hWnd, WM_CLOSE, 0, 0);
     }
-    else
+}
+
+/// <summary>
+/// Create the recording file named in the parameters for the connected sensor
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::OpenRecorder()
+{
+    AssertOwnThread();
+
+    m_pRecorder = new(std::nothrow) KinectFusionRecorder();
+    if (nullptr == m_pRecorder)
     {
-        hr = m_pVolume->DepthToDepthFloatFrame(
-                m_pDepthImagePixelBuffer,
-                m_paramsCurrent.m_cDepthImagePixels * sizeof(NUI_DEPTH_IMAGE_PIXEL),
-                m_pDepthFloatImage,
-                m_paramsCurrent.m_fMinDepthThreshold,
-                m_paramsCurrent.m_fMaxDepthThreshold,
-                m_paramsCurrent.m_bMirrorDepthFrame);
+        SetStatusMessage(L"Memory allocation failure");
+        return E_OUTOFMEMORY;
     }
 
+    HRESULT hr = m_pRecorder->Open(
+        m_paramsCurrent.m_szRecordFile,
+        m_paramsCurrent.m_depthImageResolution,
+        m_paramsCurrent.m_colorImageResolution,
+        m_pMapper);
+
     if (FAILED(hr))
     {
-        SetStatusMessage(L"Kinect Fusion NuiFusionDepthToDepthFloatFrame call failed.");
-        goto FinishFrame;
+        SetStatusMessage(L"Failed to create the recording file.");
+        SAFE_DELETE(m_pRecorder);
     }
 
-    depthAvailable = true;
+    return hr;
+}
 
-    // Return if the volume is not initialized, just drawing the depth image
-    if (nullptr == m_pVolume)
+/// <summary>
+/// Append the current depth and color frames to the recording
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::RecordFrames()
+{
+    AssertOwnThread();
+
+    // The color image holds the most recent color frame, whose timestamp tells replay whether
+    // it was synchronized with this depth frame
+    const BYTE *pColorPixels = nullptr;
+    NUI_LOCKED_RECT colorLockedRect;
+    INuiFrameTexture *colorTex = m_pColorImage->pFrameTexture;
+
+    if (0 != m_cLastColorFrameTimeStamp && SUCCEEDED(colorTex->LockRect(0, &colorLockedRect, nullptr, 0)))
     {
-        SetStatusMessage(
-            L"Kinect Fusion reconstruction volume not initialized. "
-            L"Please try reducing volume size or restarting.");
-        goto FinishFrame;
+        pColorPixels = colorLockedRect.pBits;
     }
 
-    ////////////////////////////////////////////////////////
-    // Perform Camera Tracking
+    HRESULT hr = m_pRecorder->WriteFrame(
+        m_pDepthImagePixels,
+        m_cLastDepthFrameTimeStamp,
+        pColorPixels,
+        m_cLastColorFrameTimeStamp);
 
-    HRESULT tracking = E_NUI_FUSION_TRACKING_ERROR;
+    if (nullptr != pColorPixels)
+    {
+        colorTex->UnlockRect(0);
+    }
 
-    if (!m_bTrackingFailed && 0 != m_cFrameCounter)
+    if (FAILED(hr))
+    {
+        // Keep the frames recorded so far
+        SetStatusMessage(L"Failed to write to the recording file, recording stopped.");
+        SAFE_DELETE(m_pRecorder);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Down sample the depth float image to the AlignPointClouds resolution, and to half of it
+/// for coarse to fine tracking, in one pass.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::DownsampleDepthForAlignPointClouds()
+{
+    const unsigned int factor = m_paramsCurrent.m_cAlignPointCloudsImageDownsampleFactor;
+    const KinectFusionPyramidFilter filter =
+        m_paramsCurrent.m_bAlignPointCloudsEdgeAwareDownsample ? PyramidFilterEdgeAware : PyramidFilterNearest;
+    const float threshold = m_paramsCurrent.m_fSmoothingDistanceThreshold;
+
+    if (nullptr == m_pCoarseDepthFloatImage || !m_paramsCurrent.m_bAlignPointCloudsCoarseToFine)
+    {
+        return m_depthPyramid.Downsample(m_pDepthFloatImage, m_pDownsampledDepthFloatImage, factor, filter, threshold);
+    }
+
+    if (1 == factor)
+    {
+        // Tracking runs at the depth resolution, so only the coarse level is down sampled
+        HRESULT hr = m_depthPyramid.Downsample(m_pDepthFloatImage, m_pDownsampledDepthFloatImage, 1, filter, threshold);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        return m_depthPyramid.Downsample(m_pDepthFloatImage, m_pCoarseDepthFloatImage, 2, filter, threshold);
+    }
+
+    // Both levels are built together, the levels above them are kept by the pyramid
+    NUI_FUSION_IMAGE_FRAME *levels[KinectFusionImagePyramid::cMaxLevels] = { nullptr, nullptr, nullptr, nullptr };
+    unsigned int level = 0;
+
+    while ((1u << level) < factor)
+    {
+        ++level;
+    }
+
+    levels[level - 1] = m_pDownsampledDepthFloatImage;
+    levels[level] = m_pCoarseDepthFloatImage;
+
+    return m_depthPyramid.Build(m_pDepthFloatImage, levels, level + 1, filter, threshold);
+}
+
+/// <summary>
+/// Smooth a down sampled depth float image and calculate its point cloud for AlignPointClouds.
+/// </summary>
+/// <param name="pDepthFloatImage">The down sampled depth float image.</param>
+/// <param name="pSmoothDepthFloatImage">Returns the smoothed depth float image.</param>
+/// <param name="pPointCloud">Returns the point cloud of the smoothed depth.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::CalculateDepthPointCloud(
+    NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+    NUI_FUSION_IMAGE_FRAME *pSmoothDepthFloatImage,
+    NUI_FUSION_IMAGE_FRAME *pPointCloud)
+{
+    ////////////////////////////////////////////////////////
+    // Smooth depth image
+
+    HRESULT hr = S_OK;
+
+    KinectFusionScopedTimer smoothTimer(m_instrumentation, KinectFusionStageSmoothDepth);
+
+    if (nullptr != m_pNativeVolume)
+    {
+        hr = SmoothDepthFloatFrame(
+            pDepthFloatImage, 
+            pSmoothDepthFloatImage, 
+            m_paramsCurrent.m_cSmoothingKernelWidth, 
+            m_paramsCurrent.m_fSmoothingDistanceThreshold);
+    }
+    else
+    {
+        hr = m_pVolume->SmoothDepthFloatFrame(
+            pDepthFloatImage, 
+            pSmoothDepthFloatImage, 
+            m_paramsCurrent.m_cSmoothingKernelWidth, 
+            m_paramsCurrent.m_fSmoothingDistanceThreshold);
+    }
+
+    smoothTimer.Stop();
+
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Kinect Fusion SmoothDepth call failed.");
+        return hr;
+    }
+
+    ////////////////////////////////////////////////////////
+    // Calculate Point Cloud from smoothed input Depth Image
+
+    hr = NuiFusionDepthFloatFrameToPointCloud(
+        pSmoothDepthFloatImage,
+        pPointCloud);
+
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Kinect Fusion NuiFusionDepthFloatFrameToPointCloud call failed.");
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Perform camera tracking using AlignPointClouds
+/// </summary>
+HRESULT KinectFusionProcessor::TrackCameraAlignPointClouds(Matrix4 &calculatedCameraPose, FLOAT &alignmentEnergy)
+{
+    const bool coarseToFine = nullptr != m_pCoarseDepthFloatImage && m_paramsCurrent.m_bAlignPointCloudsCoarseToFine;
+
+    ////////////////////////////////////////////////////////
+    // Down sample the depth image
+
+    HRESULT hr = DownsampleDepthForAlignPointClouds();
+
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Kinect Fusion depth image down sampling failed.");
+        return hr;
+    }
+
+    ////////////////////////////////////////////////////////
+    // Smooth the depth images and calculate their point clouds
+
+    hr = CalculateDepthPointCloud(
+        m_pDownsampledDepthFloatImage,
+        m_pDownsampledSmoothDepthFloatImage,
+        m_pDownsampledDepthPointCloud);
+
+    if (SUCCEEDED(hr) && coarseToFine)
+    {
+        hr = CalculateDepthPointCloud(
+            m_pCoarseDepthFloatImage,
+            m_pCoarseSmoothDepthFloatImage,
+            m_pCoarseDepthPointCloud);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ////////////////////////////////////////////////////////
+    // CalculatePointCloud
+
+    // Raycast even if camera tracking failed, to enable us to visualize what is 
+    // happening with the system
+    KinectFusionScopedTimer raycastTimer(m_instrumentation, KinectFusionStageRaycast);
+
+    if (nullptr != m_pNativeVolume)
+    {
+        hr = m_pNativeVolume->CalculatePointCloud(
+            m_pDownsampledRaycastPointCloud,
+            nullptr, 
+            &calculatedCameraPose);
+    }
+    else
+    {
+        hr = m_pVolume->CalculatePointCloud(
+            m_pDownsampledRaycastPointCloud,
+            nullptr, 
+            &calculatedCameraPose);
+    }
+
+    raycastTimer.Stop();
+
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Kinect Fusion CalculatePointCloud call failed.");
+        return hr;
+    }
+
+    ////////////////////////////////////////////////////////
+    // Coarse to fine: align the point clouds at half resolution first
+
+    KinectFusionScopedTimer alignTimer(m_instrumentation, KinectFusionStageAlignPointClouds);
+
+    if (coarseToFine)
+    {
+        hr = m_raycastPyramid.Downsample(
+            m_pDownsampledRaycastPointCloud,
+            m_pCoarseRaycastPointCloud,
+            2,
+            m_paramsCurrent.m_bAlignPointCloudsEdgeAwareDownsample ? PyramidFilterEdgeAware : PyramidFilterNearest,
+            m_paramsCurrent.m_fSmoothingDistanceThreshold);
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Kinect Fusion point cloud down sampling failed.");
+            return hr;
+        }
+
+        // The fine alignment starts from the coarse pose when it converged, otherwise from the last pose
+        Matrix4 coarseCameraPose = calculatedCameraPose;
+
+        if (SUCCEEDED(NuiFusionAlignPointClouds(
+            m_pCoarseRaycastPointCloud,
+            m_pCoarseDepthPointCloud,
+            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
+            nullptr,
+            &coarseCameraPose)))
+        {
+            calculatedCameraPose = coarseCameraPose;
+        }
+    }
+
+    ////////////////////////////////////////////////////////
+    // Call AlignPointClouds
+
+    HRESULT tracking = S_OK;
+
+    // Only calculate the residual delta from reference frame every m_cDeltaFromReferenceFrameCalculationInterval
+    // frames to reduce computation time
+    if (m_bCalculateDeltaFrame)
+    {
+        tracking = NuiFusionAlignPointClouds(
+            m_pDownsampledRaycastPointCloud,
+            m_pDownsampledDepthPointCloud,
+            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
+            m_pDownsampledShadedDeltaFromReference,
+            &calculatedCameraPose); 
+
+        // Up sample the delta from reference image to display as the original resolution
+        hr = UpsampleFrameNearestNeighbor(
+            m_pDownsampledShadedDeltaFromReference, 
+            m_pShadedDeltaFromReference, 
+            m_paramsCurrent.m_cAlignPointCloudsImageDownsampleFactor);
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Kinect Fusion UpsampleFrameNearestNeighbor call failed.");
+            return hr;
+        }
+    }
+    else
+    {
+        tracking = NuiFusionAlignPointClouds(
+            m_pDownsampledRaycastPointCloud,
+            m_pDownsampledDepthPointCloud,
+            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
+            nullptr,
+            &calculatedCameraPose); 
+    }
+
+    alignTimer.Stop();
+
+    if (!FAILED(tracking))
+    {
+        // Perform additional transform magnitude check
+        // Camera Tracking has converged but did we get a sensible pose estimate?
+        // see if relative rotation and translation exceed thresholds 
+        if (CameraTransformFailed(
+            m_worldToCameraTransform,
+            calculatedCameraPose,
+            m_paramsCurrent.m_fMaxTranslationDelta,
+            m_paramsCurrent.m_fMaxRotationDelta))
+        {
+            // We calculated too large a move for this to be a sensible estimate,
+            // quite possibly the camera tracking drifted. Force camera pose finding.
+            hr = E_NUI_FUSION_TRACKING_ERROR;
+
+            SetStatusMessage(
+                L"Kinect Fusion AlignPointClouds camera tracking failed "
+                L"in transform magnitude check!");
+        }
+    }
+    else
+    {
+        hr = tracking;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Perform camera tracking using AlignDepthFloatToReconstruction
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::TrackCameraAlignDepthFloatToReconstruction(Matrix4 &calculatedCameraPose, FLOAT &alignmentEnergy)
+{
+    HRESULT hr = S_OK;
+
+    // Only calculate the residual delta from reference frame every m_cDeltaFromReferenceFrameCalculationInterval
+    // frames to reduce computation time
+    HRESULT tracking = S_OK;
+
+    KinectFusionScopedTimer alignTimer(m_instrumentation, KinectFusionStageAlignDepthFloatToReconstruction);
+
+    if (m_bCalculateDeltaFrame)
+    {
+        tracking = m_pVolume->AlignDepthFloatToReconstruction(
+            m_pDepthFloatImage,
+            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
+            m_pFloatDeltaFromReference,
+            &alignmentEnergy,
+            &calculatedCameraPose);
+    }
+    else
+    {
+        tracking = m_pVolume->AlignDepthFloatToReconstruction(
+            m_pDepthFloatImage,
+            NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT,
+            nullptr,
+            &alignmentEnergy,
+            &calculatedCameraPose);
+    }
+
+    alignTimer.Stop();
+
+    bool trackingSuccess = !(FAILED(tracking) || alignmentEnergy > m_paramsCurrent.m_fMaxAlignToReconstructionEnergyForSuccess || (alignmentEnergy == 0.0f && m_cSuccessfulFrameCounter > 1));
+
+    if (trackingSuccess)
+    {
+        // Get the camera pose
+        m_pVolume->GetCurrentWorldToCameraTransform(&calculatedCameraPose);
+    }
+    else
+    {
+        if (FAILED(tracking))
+        {
+            hr = tracking;
+        }
+        else
+        {
+            // We failed in the energy check
+            hr = E_NUI_FUSION_TRACKING_ERROR;
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Take a free pipeline frame for the capture stage to fill, if it does not hold one
+/// </summary>
+/// <returns>true if the capture stage holds a free frame</returns>
+bool KinectFusionProcessor::AcquireCaptureFrame()
+{
+    AssertOwnThread();
+
+    if (nullptr == m_pCaptureFrame)
+    {
+        m_freeFrames.TryPop(m_pCaptureFrame);
+    }
+
+    return nullptr != m_pCaptureFrame;
+}
+
+/// <summary>
+/// Capture stage: get the next frames from Kinect and hand them to the tracking stage
+/// </summary>
+void KinectFusionProcessor::CaptureFrame()
+{
+    AssertOwnThread();
+
+    if (nullptr == m_pCaptureFrame)
+    {
+        return;
+    }
+
+    bool colorSynchronized = false;
+
+    m_pCaptureFrame->captureStartTime = m_timer.AbsoluteTime();
+
+    // Get the next frames from Kinect
+    HRESULT hr = GetKinectFrames(colorSynchronized);
+
+    if (SUCCEEDED(hr))
+    {
+        if (nullptr != m_pRecorder)
+        {
+            RecordFrames();
+        }
+
+        hr = SubmitCapturedFrame(colorSynchronized);
+    }
+
+    // Return the depth frame to its sensor stream or pool, now it has been converted
+    ReleaseDepthFrameLease();
+
+    if (FAILED(hr))
+    {
+        // The tracking stage never sees this frame, so show its status here
+        NotifyFrameReady();
+    }
+}
+
+/// <summary>
+/// Convert the current depth and color into the capture frame and hand it to the tracking stage
+/// </summary>
+/// <param name="colorSynchronized">Whether the color was captured at the same time as the depth.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::SubmitCapturedFrame(bool colorSynchronized)
+{
+    AssertOwnThread();
+
+    KinectFusionPipelineFrame *pFrame = m_pCaptureFrame;
+    if (nullptr == pFrame)
+    {
+        return E_FAIL;
+    }
+
+    ////////////////////////////////////////////////////////
+    // Depth to Depth Float
+
+    // Convert the pixels describing extended depth as unsigned short type in millimeters to depth
+    // as floating point type in meters. The conversion does not need the volume, so it runs while
+    // the tracking stage holds it.
+    KinectFusionScopedTimer depthTimer(m_instrumentation, KinectFusionStageDepthToDepthFloat);
+
+    HRESULT hr = NuiFusionDepthToDepthFloatFrame(
+        m_pDepthImagePixels,
+        m_paramsCurrent.m_cDepthWidth,
+        m_paramsCurrent.m_cDepthHeight,
+        pFrame->pDepthFloatImage,
+        m_paramsCurrent.m_fMinDepthThreshold,
+        m_paramsCurrent.m_fMaxDepthThreshold,
+        m_paramsCurrent.m_bMirrorDepthFrame);
+
+    depthTimer.Stop();
+
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Kinect Fusion NuiFusionDepthToDepthFloatFrame call failed.");
+        return hr;
+    }
+
+    if (m_paramsCurrent.m_bFilterDepth)
+    {
+        // Filter the depth before it is tracked, integrated and displayed
+        KinectFusionScopedTimer filterTimer(m_instrumentation, KinectFusionStageFilterDepth);
+
+        hr = m_depthFilter.Filter(
+            pFrame->pDepthFloatImage,
+            m_paramsCurrent.m_cDepthFilterRadius,
+            m_paramsCurrent.m_fDepthFilterRangeThreshold,
+            m_paramsCurrent.m_fDepthFilterTemporalWeight,
+            m_paramsCurrent.m_fDepthFilterMotionThreshold,
+            m_paramsCurrent.m_bDepthFilterFillHoles);
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Kinect Fusion depth filter failed.");
+            return hr;
+        }
+    }
+    else
+    {
+        // The next filtered frame is not blended with the one before the filter was turned off
+        m_depthFilter.ResetHistory();
+    }
+
+    // Only integrate when color is synchronized with depth
+    pFrame->colorSynchronized = colorSynchronized;
+    pFrame->integrateColor = m_paramsCurrent.m_bCaptureColor && colorSynchronized
+        && m_cCapturedFrames % m_paramsCurrent.m_cColorIntegrationInterval == 0;
+
+    if (pFrame->integrateColor)
+    {
+        // Map the color frame to the depth while the previous frame is tracked
+        pFrame->integrateColor = SUCCEEDED(MapColorToDepth(pFrame->pColorImageDepthAligned));
+    }
+
+    if (m_paramsCurrent.m_bAutoFindCameraPoseWhenLost)
+    {
+        // The camera pose finder uses the most recent color frame, synchronized or not
+        hr = CopyImageFrame(m_pColorImage, pFrame->pCameraPoseFinderColorImage);
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Kinect Fusion CopyImageFrame call failed.");
+            return hr;
+        }
+    }
+
+    pFrame->resetReconstruction = m_bResetOnNextCapturedFrame;
+    m_bResetOnNextCapturedFrame = false;
+
+    EnterCriticalSection(&m_lockFrame);
+
+    StoreImageToFrameBuffer(pFrame->pDepthFloatImage, m_frame.m_pDepthRGBX);
+
+    pFrame->queuedTime = m_timer.AbsoluteTime();
+    m_instrumentation.AddSample(KinectFusionStageCapture, pFrame->queuedTime - pFrame->captureStartTime);
+
+    LeaveCriticalSection(&m_lockFrame);
+
+    // There are only as many frames as the queue holds, so the frame always fits
+    m_capturedFrames.TryPush(pFrame);
+    m_pCaptureFrame = nullptr;
+
+    m_cCapturedFrames++;
+    InterlockedIncrement(&m_cSubmittedFrames);
+    SetEvent(m_hFrameCapturedEvent);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Tracking stage processing function
+/// </summary>
+DWORD KinectFusionProcessor::TrackingLoop()
+{
+    AssertOwnThread();
+
+    HANDLE handles[] = { m_hStopPipelineEvent, m_hFrameCapturedEvent };
+
+    while (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        KinectFusionPipelineFrame *pFrame = nullptr;
+
+        while (WaitForSingleObject(m_hStopPipelineEvent, 0) == WAIT_TIMEOUT && m_capturedFrames.TryPop(pFrame))
+        {
+            KinectFusionPipelineFrame frame = *pFrame;
+
+            // Take over the captured images and give the capture stage the previous ones, so the
+            // next frame is captured while this one is tracked
+            std::swap(pFrame->pDepthFloatImage, m_pDepthFloatImage);
+            std::swap(pFrame->pColorImageDepthAligned, m_pResampledColorImageDepthAligned);
+            std::swap(pFrame->pCameraPoseFinderColorImage, m_pCameraPoseFinderColorImage);
+
+            m_freeFrames.TryPush(pFrame);
+            SetEvent(m_hFrameFreedEvent);
+
+            EnterCriticalSection(&m_lockVolume);
+            TrackFrame(frame);
+            LeaveCriticalSection(&m_lockVolume);
+
+            InterlockedIncrement(&m_cTrackedFrames);
+            SetEvent(m_hFrameTrackedEvent);
+
+            NotifyFrameReady();
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Tracking stage: track the camera and integrate a captured frame into the volume
+/// </summary>
+/// <param name="frame">The captured frame, whose images are now in the tracking stage frames.</param>
+void KinectFusionProcessor::TrackFrame(const KinectFusionPipelineFrame &frame)
+{
+    AssertOwnThread();
+
+    double trackingStartTime = m_timer.AbsoluteTime();
+    HRESULT hr = S_OK;
+    bool raycastFrame = false;
+    bool floatDeltaFromReference = false;
+    bool cameraPoseFinderAvailable = IsCameraPoseFinderAvailable();
+    FLOAT alignmentEnergy = 1.0f;
+    Matrix4 calculatedCameraPose = m_worldToCameraTransform;
+    m_bCalculateDeltaFrame = (m_cFrameCounter % m_paramsCurrent.m_cDeltaFromReferenceFrameCalculationInterval == 0) 
+                            || (m_bTrackingHasFailedPreviously && m_cSuccessfulFrameCounter <= 2);
+
+    // Clear status message from previous frame
+    SetStatusMessage(L"");
+
+    // Return if the volume is not initialized, just drawing the depth image
+    if (nullptr == m_pVolume && nullptr == m_pNativeVolume)
+    {
+        SetStatusMessage(
+            L"Kinect Fusion reconstruction volume not initialized. "
+            L"Please try reducing volume size or restarting.");
+        goto FinishFrame;
+    }
+
+    if (frame.resetReconstruction)
+    {
+        // The capture stage saw the frame timestamp skip
+        hr = InternalResetReconstruction();
+
+        if (SUCCEEDED(hr))
+        {
+            SetStatusMessage(L"Reconstruction has been reset.");
+        }
+        else
+        {
+            SetStatusMessage(L"Failed to reset reconstruction.");
+        }
+
+        calculatedCameraPose = m_worldToCameraTransform;
+    }
+
+    ////////////////////////////////////////////////////////
+    // Perform Camera Tracking
+
+    HRESULT tracking = E_NUI_FUSION_TRACKING_ERROR;
+
+    if (!m_bTrackingFailed && 0 != m_cFrameCounter)
     {
         // Here we can either call or TrackCameraAlignDepthFloatToReconstruction or TrackCameraAlignPointClouds
         // The TrackCameraAlignPointClouds function typically has higher performance with the camera pose finder 
         // due to its wider basin of convergence, enabling it to more robustly regain tracking from nearby poses
         // suggested by the camera pose finder after tracking is lost.
-        if (m_paramsCurrent.m_bAutoFindCameraPoseWhenLost)
+        // The native volume does not implement AlignDepthFloatToReconstruction, so always uses AlignPointClouds.
+        if (m_paramsCurrent.m_bAutoFindCameraPoseWhenLost || nullptr != m_pNativeVolume)
         {
             tracking = TrackCameraAlignPointClouds(calculatedCameraPose, alignmentEnergy);
         }
@@ -1757,6 +3053,9 @@ void KinectFusionProcessor::ProcessDepth()
         {
             // If the camera pose finder is not turned on, we use AlignDepthFloatToReconstruction
             tracking = TrackCameraAlignDepthFloatToReconstruction(calculatedCameraPose, alignmentEnergy);
+
+            // Only AlignDepthFloatToReconstruction returns the float residuals the statistics are of
+            floatDeltaFromReference = m_bCalculateDeltaFrame;
         }
     }
 
@@ -1798,7 +3097,7 @@ void KinectFusionProcessor::ProcessDepth()
         if (m_bTrackingHasFailedPreviously)
         {
             WCHAR str[MAX_PATH];
-            if (!m_paramsCurrent.m_bAutoFindCameraPoseWhenLost)
+            if (!m_paramsCurrent.m_bAutoFindCameraPoseWhenLost && nullptr == m_pNativeVolume)
             {
                 swprintf_s(str, ARRAYSIZE(str), L"Kinect Fusion camera tracking RECOVERED! Residual energy=%f", alignmentEnergy);
             }
@@ -1834,6 +3133,20 @@ void KinectFusionProcessor::ProcessDepth()
         }
     }
 
+    ////////////////////////////////////////////////////////
+    // Shift a rolling volume to follow the camera
+
+    if (!m_bTrackingFailed && m_paramsCurrent.m_bRollingVolume && nullptr != m_pNativeVolume)
+    {
+        hr = ShiftVolumeWithCamera();
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Failed to shift the rolling reconstruction volume.");
+            goto FinishFrame;
+        }
+    }
+
     ////////////////////////////////////////////////////////
     // Integrate Depth Data into volume
 
@@ -1856,32 +3169,57 @@ void KinectFusionProcessor::ProcessDepth()
         // Reset this flag as we are now integrating data again
         m_bTrackingHasFailedPreviously = false;
 
-        if (integrateColor)
+        KinectFusionScopedTimer integrateTimer(m_instrumentation, KinectFusionStageIntegrate);
+
+        if (frame.integrateColor)
         {
-            // Map the color frame to the depth - this fills m_pResampledColorImageDepthAligned
-            MapColorToDepth();
+            // The capture stage mapped the color frame to the depth in m_pResampledColorImageDepthAligned
 
             // Integrate the depth and color data into the volume from the calculated camera pose
-            hr = m_pVolume->IntegrateFrame(
-                    m_pDepthFloatImage,
-                    m_pResampledColorImageDepthAligned,
-                    m_paramsCurrent.m_cMaxIntegrationWeight,
-                    NUI_FUSION_DEFAULT_COLOR_INTEGRATION_OF_ALL_ANGLES,
-                    &m_worldToCameraTransform);
+            if (nullptr != m_pNativeVolume)
+            {
+                hr = m_pNativeVolume->IntegrateFrame(
+                        m_pDepthFloatImage,
+                        m_pResampledColorImageDepthAligned,
+                        m_paramsCurrent.m_cMaxIntegrationWeight,
+                        &m_worldToCameraTransform);
+            }
+            else
+            {
+                hr = m_pVolume->IntegrateFrame(
+                        m_pDepthFloatImage,
+                        m_pResampledColorImageDepthAligned,
+                        m_paramsCurrent.m_cMaxIntegrationWeight,
+                        NUI_FUSION_DEFAULT_COLOR_INTEGRATION_OF_ALL_ANGLES,
+                        &m_worldToCameraTransform);
+            }
 
             m_frame.m_bColorCaptured = true;
         }
         else
         {
             // Integrate just the depth data into the volume from the calculated camera pose
-            hr = m_pVolume->IntegrateFrame(
-                    m_pDepthFloatImage,
-                    nullptr,
-                    m_paramsCurrent.m_cMaxIntegrationWeight,
-                    NUI_FUSION_DEFAULT_COLOR_INTEGRATION_OF_ALL_ANGLES,
-                    &m_worldToCameraTransform);
+            if (nullptr != m_pNativeVolume)
+            {
+                hr = m_pNativeVolume->IntegrateFrame(
+                        m_pDepthFloatImage,
+                        nullptr,
+                        m_paramsCurrent.m_cMaxIntegrationWeight,
+                        &m_worldToCameraTransform);
+            }
+            else
+            {
+                hr = m_pVolume->IntegrateFrame(
+                        m_pDepthFloatImage,
+                        nullptr,
+                        m_paramsCurrent.m_cMaxIntegrationWeight,
+                        NUI_FUSION_DEFAULT_COLOR_INTEGRATION_OF_ALL_ANGLES,
+                        &m_worldToCameraTransform);
+            }
         }
 
+        integrateTimer.Stop();
+
         if (FAILED(hr))
         {
             SetStatusMessage(L"Kinect Fusion IntegrateFrame call failed.");
@@ -1896,7 +3234,7 @@ void KinectFusionProcessor::ProcessDepth()
         double currentTime = m_timer.AbsoluteTime();
 
         // Is another frame already waiting?
-        if (WaitForSingleObject(m_hNextDepthFrameEvent, 0) == WAIT_TIMEOUT)
+        if (m_capturedFrames.IsEmpty())
         {
             // No: We should have enough time to raycast.
             raycastFrame = true;
@@ -1910,45 +3248,22 @@ void KinectFusionProcessor::ProcessDepth()
 
         if (raycastFrame)
         {
-            m_fMostRecentRaycastTime = currentTime;
-        }
-    }
-
-    if (raycastFrame)
-    {
-        ////////////////////////////////////////////////////////
-        // CalculatePointCloud
-
-        // Raycast even if camera tracking failed, to enable us to visualize what is 
-        // happening with the system
-        hr = m_pVolume->CalculatePointCloud(
-            m_pRaycastPointCloud,
-            (m_paramsCurrent.m_bCaptureColor ? m_pCapturedSurfaceColor : nullptr), 
-            &m_worldToCameraTransform);
-
-        if (FAILED(hr))
-        {
-            SetStatusMessage(L"Kinect Fusion CalculatePointCloud call failed.");
-            goto FinishFrame;
+            m_fMostRecentRaycastTime = currentTime;
         }
+    }
 
-        ////////////////////////////////////////////////////////
-        // ShadePointCloud
+    if (raycastFrame)
+    {
+        // Raycast even if camera tracking failed, to enable us to visualize what is 
+        // happening with the system. The render stage raycasts while the next frame is tracked.
+        KinectFusionRenderRequest request;
+        request.worldToCameraTransform = m_worldToCameraTransform;
+        request.captureStartTime = frame.captureStartTime;
 
-        if (!m_paramsCurrent.m_bCaptureColor)
+        // When the render stage is still busy with earlier requests, this one is skipped
+        if (m_renderRequests.TryPush(request))
         {
-            hr = NuiFusionShadePointCloud(
-                m_pRaycastPointCloud,
-                &m_worldToCameraTransform,
-                &m_worldToBGRTransform,
-                m_pShadedSurface,
-                m_paramsCurrent.m_bDisplaySurfaceNormals ?  m_pShadedSurfaceNormals : nullptr);
-
-            if (FAILED(hr))
-            {
-                SetStatusMessage(L"Kinect Fusion NuiFusionShadePointCloud call failed.");
-                goto FinishFrame;
-            }
+            SetEvent(m_hRenderRequestEvent);
         }
     }
 
@@ -1958,7 +3273,7 @@ void KinectFusionProcessor::ProcessDepth()
     if (m_paramsCurrent.m_bAutoFindCameraPoseWhenLost && !m_bTrackingHasFailedPreviously
         && m_cSuccessfulFrameCounter > m_paramsCurrent.m_cMinSuccessfulTrackingFramesForCameraPoseFinder
         && m_cFrameCounter % m_paramsCurrent.m_cCameraPoseFinderProcessFrameCalculationInterval == 0
-        && colorSynchronized)
+        && frame.colorSynchronized)
     {    
         hr  = UpdateCameraPoseFinder();
 
@@ -1971,8 +3286,14 @@ void KinectFusionProcessor::ProcessDepth()
 
 FinishFrame:
 
+    ReportCameraPoseFinderInsert();
+
     EnterCriticalSection(&m_lockFrame);
 
+    m_frame.m_cAllocatedBricks = (nullptr != m_pNativeVolume) ? m_pNativeVolume->GetAllocatedBrickCount() : 0;
+    m_frame.m_cResidentBytes = (nullptr != m_pNativeVolume) ? m_pNativeVolume->GetResidentBytes() : 0;
+    m_frame.m_cCameraPoseFinderPoses = m_cameraPoseFinderWorker.GetStoredPoseCount();
+
     if (cameraPoseFinderAvailable)
     {
         // Do not set false, as camera pose finder will toggle automatically depending on whether it has
@@ -1988,27 +3309,6 @@ FinishFrame:
     ////////////////////////////////////////////////////////
     // Copy the images to their frame buffers
 
-    if (depthAvailable)
-    {
-        StoreImageToFrameBuffer(m_pDepthFloatImage, m_frame.m_pDepthRGBX);
-    }
-
-    if (raycastFrame)
-    {
-        if (m_paramsCurrent.m_bCaptureColor)
-        {
-            StoreImageToFrameBuffer(m_pCapturedSurfaceColor, m_frame.m_pReconstructionRGBX);
-        }
-        else if (m_paramsCurrent.m_bDisplaySurfaceNormals)
-        {
-            StoreImageToFrameBuffer(m_pShadedSurfaceNormals, m_frame.m_pReconstructionRGBX);
-        }
-        else
-        {
-            StoreImageToFrameBuffer(m_pShadedSurface, m_frame.m_pReconstructionRGBX);
-        }
-    }
-
     // Display raycast depth image when in pose finding mode
     if (m_bTrackingFailed && cameraPoseFinderAvailable)
     {
@@ -2019,10 +3319,26 @@ FinishFrame:
         // Don't calculate the residual delta from reference frame every frame to reduce computation time
         if (m_bCalculateDeltaFrame )
         {
-            if (!m_paramsCurrent.m_bAutoFindCameraPoseWhenLost)
+            if (floatDeltaFromReference)
             {
                 // Color the float residuals from the AlignDepthFloatToReconstruction
-                hr  = ColorResiduals(m_pFloatDeltaFromReference, m_pShadedDeltaFromReference);
+                hr = m_visualization.ColorResiduals(m_pFloatDeltaFromReference, m_pShadedDeltaFromReference, m_paramsCurrent.m_visualizationPath);
+
+                if (SUCCEEDED(hr))
+                {
+                    m_frame.m_fAlignmentEnergy = alignmentEnergy;
+                    hr = CalculateResidualStatistics(m_pFloatDeltaFromReference, &m_frame.m_residualStatistics);
+                }
+
+                m_frame.m_bResidualStatisticsValid = SUCCEEDED(hr);
+            }
+            else
+            {
+                // AlignPointClouds shaded its residuals itself, or tracking did not run, so there
+                // are no residuals to take the statistics of
+                m_frame.m_bResidualStatisticsValid = false;
+                m_frame.m_fAlignmentEnergy = 0;
+                m_frame.m_residualStatistics = DeltaFromReferenceImageStatistics();
             }
 
             if (SUCCEEDED(hr))
@@ -2032,6 +3348,9 @@ FinishFrame:
         }
     }
 
+    m_instrumentation.AddSample(KinectFusionStageQueue, trackingStartTime - frame.queuedTime);
+    m_instrumentation.AddSample(KinectFusionStageTrack, m_timer.AbsoluteTime() - trackingStartTime);
+
     ////////////////////////////////////////////////////////
     // Periodically Display Fps
 
@@ -2046,10 +3365,50 @@ FinishFrame:
         {
             m_frame.m_fFramesPerSecond = 0;
 
+            // Snapshot the time spent in each processing stage for the UI and the trace file
+            m_instrumentation.Snapshot(m_frame.m_stageStatistics);
+
             // Update status display
             if (!m_bTrackingFailed)
             {
                 m_frame.m_fFramesPerSecond = static_cast<float>(m_cFrameCounter / elapsed);
+
+                // Report the average time of each pipeline stage, and the latency from the start of
+                // capture to the display of a frame. Render raycasts take turns with tracking on the
+                // volume, so the render time includes the wait for the volume.
+                WCHAR str[KinectFusionProcessorFrame::StatusMessageMaxLen];
+                int cch = swprintf_s(
+                    str,
+                    ARRAYSIZE(str),
+                    L"Capture %.1f ms, queued %.1f ms, tracking %.1f ms, render %.1f ms (%.1f ms waiting for tracking), latency %.1f ms.",
+                    m_frame.m_stageStatistics[KinectFusionStageCapture].meanMilliseconds,
+                    m_frame.m_stageStatistics[KinectFusionStageQueue].meanMilliseconds,
+                    m_frame.m_stageStatistics[KinectFusionStageTrack].meanMilliseconds,
+                    m_frame.m_stageStatistics[KinectFusionStageRender].meanMilliseconds,
+                    m_frame.m_stageStatistics[KinectFusionStageRenderWaitForVolume].meanMilliseconds,
+                    m_frame.m_stageStatistics[KinectFusionStageLatency].meanMilliseconds);
+
+                // Report the average integration time of the native volume
+                const KinectFusionStageStatistics &integrate = m_frame.m_stageStatistics[KinectFusionStageIntegrate];
+                if (nullptr != m_pNativeVolume && integrate.count > 0 && cch > 0)
+                {
+                    swprintf_s(
+                        str + cch,
+                        ARRAYSIZE(str) - cch,
+                        L" Native CPU volume integration %.1f ms/frame on %u cores, %u MB resident, %u bricks.",
+                        integrate.meanMilliseconds,
+                        Concurrency::GetProcessorCount(),
+                        static_cast<unsigned int>(m_frame.m_cResidentBytes >> 20),
+                        m_frame.m_cAllocatedBricks);
+                }
+
+                SetStatusMessage(str);
+            }
+
+            if (FAILED(m_instrumentation.WriteTrace(m_timer.AbsoluteTime(), m_frame.m_stageStatistics)))
+            {
+                m_instrumentation.CloseTrace();
+                SetStatusMessage(L"Failed to write the stage timing trace file, tracing stopped.");
             }
 
             m_cFrameCounter = 0;
@@ -2057,9 +3416,176 @@ FinishFrame:
         }
     }
 
-    m_frame.SetStatusMessage(m_statusMessage);
+    LeaveCriticalSection(&m_lockFrame);
+}
+
+/// <summary>
+/// Render stage processing function
+/// </summary>
+DWORD KinectFusionProcessor::RenderLoop()
+{
+    AssertOwnThread();
+
+    HANDLE handles[] = { m_hStopPipelineEvent, m_hRenderRequestEvent };
+
+    while (WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        // Only the most recent camera pose is worth displaying
+        KinectFusionRenderRequest request;
+        bool requested = false;
+
+        while (m_renderRequests.TryPop(request))
+        {
+            requested = true;
+        }
+
+        if (requested)
+        {
+            RenderFrame(request);
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Render stage: raycast and shade the volume for display
+/// </summary>
+/// <param name="request">The camera pose to display and when its frame was captured.</param>
+void KinectFusionProcessor::RenderFrame(const KinectFusionRenderRequest &request)
+{
+    AssertOwnThread();
+
+    double renderStartTime = m_timer.AbsoluteTime();
+    HRESULT hr = S_OK;
+    bool volumeAvailable = false;
+
+    ////////////////////////////////////////////////////////
+    // CalculatePointCloud
+
+    // The raycast waits for the tracking stage to finish its current frame
+    KinectFusionScopedTimer waitTimer(m_instrumentation, KinectFusionStageRenderWaitForVolume);
+    EnterCriticalSection(&m_lockVolume);
+    waitTimer.Stop();
+
+    // The volume may have been released since the request was made
+    volumeAvailable = nullptr != m_pVolume || nullptr != m_pNativeVolume;
+
+    bool captureColor = m_paramsCurrent.m_bCaptureColor;
+    bool displaySurfaceNormals = m_paramsCurrent.m_bDisplaySurfaceNormals;
+    Matrix4 worldToBGRTransform = m_worldToBGRTransform;
+    KinectFusionVisualizationPath visualizationPath = m_paramsCurrent.m_visualizationPath;
+    bool nativeVolume = nullptr != m_pNativeVolume;
+
+    // A volume which supports it is raycast while the next frame is tracked and integrated. Only
+    // releasing the volume waits for the raycast.
+    bool raycastDuringUpdates = nativeVolume && m_pNativeVolume->SupportsRaycastDuringUpdates();
+
+    if (raycastDuringUpdates)
+    {
+        EnterCriticalSection(&m_lockRenderRaycast);
+        LeaveCriticalSection(&m_lockVolume);
+    }
+
+    KinectFusionScopedTimer raycastTimer(m_instrumentation, KinectFusionStageRaycast);
+
+    if (nativeVolume)
+    {
+        hr = m_pNativeVolume->CalculatePointCloud(
+            m_pRenderPointCloud,
+            (captureColor ? m_pCapturedSurfaceColor : nullptr), 
+            &request.worldToCameraTransform);
+    }
+    else if (nullptr != m_pVolume)
+    {
+        hr = m_pVolume->CalculatePointCloud(
+            m_pRenderPointCloud,
+            (captureColor ? m_pCapturedSurfaceColor : nullptr), 
+            &request.worldToCameraTransform);
+    }
+
+    raycastTimer.Stop();
+
+    if (raycastDuringUpdates)
+    {
+        LeaveCriticalSection(&m_lockRenderRaycast);
+    }
+    else
+    {
+        LeaveCriticalSection(&m_lockVolume);
+    }
+
+    if (!volumeAvailable)
+    {
+        return;
+    }
+
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Kinect Fusion CalculatePointCloud call failed.");
+        return;
+    }
+
+    ////////////////////////////////////////////////////////
+    // ShadePointCloud
+
+    if (!captureColor && nativeVolume)
+    {
+        hr = m_visualization.ShadePointCloud(
+            m_pRenderPointCloud,
+            &request.worldToCameraTransform,
+            &worldToBGRTransform,
+            m_pShadedSurface,
+            displaySurfaceNormals ?  m_pShadedSurfaceNormals : nullptr,
+            visualizationPath);
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Kinect Fusion ShadePointCloud call failed.");
+            return;
+        }
+    }
+    else if (!captureColor)
+    {
+        hr = NuiFusionShadePointCloud(
+            m_pRenderPointCloud,
+            &request.worldToCameraTransform,
+            &worldToBGRTransform,
+            m_pShadedSurface,
+            displaySurfaceNormals ?  m_pShadedSurfaceNormals : nullptr);
+
+        if (FAILED(hr))
+        {
+            SetStatusMessage(L"Kinect Fusion NuiFusionShadePointCloud call failed.");
+            return;
+        }
+    }
+
+    ////////////////////////////////////////////////////////
+    // Copy the image to its frame buffer
+
+    EnterCriticalSection(&m_lockFrame);
+
+    if (captureColor)
+    {
+        StoreImageToFrameBuffer(m_pCapturedSurfaceColor, m_frame.m_pReconstructionRGBX);
+    }
+    else if (displaySurfaceNormals)
+    {
+        StoreImageToFrameBuffer(m_pShadedSurfaceNormals, m_frame.m_pReconstructionRGBX);
+    }
+    else
+    {
+        StoreImageToFrameBuffer(m_pShadedSurface, m_frame.m_pReconstructionRGBX);
+    }
+
+    double renderEndTime = m_timer.AbsoluteTime();
+    m_instrumentation.AddSample(KinectFusionStageRender, renderEndTime - renderStartTime);
+    m_instrumentation.AddSample(KinectFusionStageLatency, renderEndTime - request.captureStartTime);
 
     LeaveCriticalSection(&m_lockFrame);
+
+    NotifyFrameReady();
 }
 
 /// <summary>
@@ -2085,24 +3611,19 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
     }
 
     // Start  kNN (k nearest neighbors) camera pose finding
-    INuiFusionMatchCandidates *pMatchCandidates = nullptr;
+    const Matrix4 *pNeighbors = nullptr;
+    unsigned int cPoses = 0;
+    float minDistance = 1.0f;   // initialize to the maximum normalized distance
 
     // Test the camera pose finder to see how similar the input images are to previously captured images.
     // This will return an error code if there are no matched frames in the camera pose finder database.
-    hr = m_pCameraPoseFinder->FindCameraPose(
+    hr = m_cameraPoseFinderWorker.FindCameraPose(
         m_pDepthFloatImage, 
-        resampled ? m_pResampledColorImage : m_pColorImage,
-        &pMatchCandidates);
-
-    if (FAILED(hr) || nullptr == pMatchCandidates)
-    {
-        goto FinishFrame;
-    }
-
-    unsigned int cPoses = pMatchCandidates->MatchPoseCount();
-
-    float minDistance = 1.0f;   // initialize to the maximum normalized distance
-    hr = pMatchCandidates->CalculateMinimumDistance(&minDistance);
+        resampled ? m_pResampledColorImage : m_pCameraPoseFinderColorImage,
+        m_paramsCurrent.m_cMaxCameraPoseFinderPoseTests,
+        &pNeighbors,
+        &cPoses,
+        &minDistance);
 
     if (FAILED(hr) || 0 == cPoses)
     {
@@ -2119,23 +3640,25 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
         goto FinishFrame;
     }
 
-    // Get the actual matched poses
-    const Matrix4 *pNeighbors = nullptr;
-    hr = pMatchCandidates->GetMatchPoses(&pNeighbors);
-
-    if (FAILED(hr))
-    {
-        goto FinishFrame;
-    }
-
     ////////////////////////////////////////////////////////
     // Smooth depth image
 
-    hr = m_pVolume->SmoothDepthFloatFrame(
-        m_pDepthFloatImage, 
-        m_pSmoothDepthFloatImage, 
-        m_paramsCurrent.m_cSmoothingKernelWidth, 
-        m_paramsCurrent.m_fSmoothingDistanceThreshold); // ON GPU
+    if (nullptr != m_pNativeVolume)
+    {
+        hr = SmoothDepthFloatFrame(
+            m_pDepthFloatImage, 
+            m_pSmoothDepthFloatImage, 
+            m_paramsCurrent.m_cSmoothingKernelWidth, 
+            m_paramsCurrent.m_fSmoothingDistanceThreshold);
+    }
+    else
+    {
+        hr = m_pVolume->SmoothDepthFloatFrame(
+            m_pDepthFloatImage, 
+            m_pSmoothDepthFloatImage, 
+            m_paramsCurrent.m_cSmoothingKernelWidth, 
+            m_paramsCurrent.m_fSmoothingDistanceThreshold); // ON GPU
+    }
 
     if (FAILED(hr))
     {
@@ -2156,11 +3679,8 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
         goto FinishFrame;
     }
 
-    HRESULT tracking = S_OK;
     FLOAT alignmentEnergy = 0;
 
-    unsigned short relocIterationCount = NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT;
-
     double smallestEnergy = DBL_MAX;
     int smallestEnergyNeighborIndex = -1;
 
@@ -2173,32 +3693,53 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
     // Run alignment with best matched poses (i.e. k nearest neighbors (kNN))
     unsigned int maxTests = min(m_paramsCurrent.m_cMaxCameraPoseFinderPoseTests, cPoses);
 
-    for (unsigned int n = 0; n < maxTests; n++)
-    {
-        ////////////////////////////////////////////////////////
-        // Call AlignPointClouds
+    bool bConcurrentRaycasts = nullptr != m_pNativeVolume && m_pNativeVolume->SupportsConcurrentRaycasts();
 
-        Matrix4 poseProposal = pNeighbors[n];
+    hr = CreatePoseProposals(maxTests, bConcurrentRaycasts);
 
-        // Get the saved pose view by raycasting the volume
-        hr = m_pVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &poseProposal);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Failed to initialize Kinect Fusion pose proposal images.");
+        goto FinishFrame;
+    }
 
-        tracking = m_pVolume->AlignPointClouds(
-            m_pRaycastPointCloud,
-            m_pDepthPointCloud,
-            relocIterationCount,
-            nullptr,
-            &alignmentEnergy,
-            &poseProposal); 
+    if (bConcurrentRaycasts)
+    {
+        // Raycasting this volume only reads it, and the volume is locked while tracking, so the
+        // proposals are raycast in parallel, each into its own point cloud. The SDK alignment
+        // calls are not documented as reentrant, so the raycasts are aligned one at a time.
+        Concurrency::parallel_for(0u, maxTests, [&](unsigned int n)
+        {
+            RaycastPoseProposal(pNeighbors[n], m_poseProposals[n]);
+        });
+
+        for (unsigned int n = 0; n < maxTests; n++)
+        {
+            AlignPoseProposal(pNeighbors[n], m_poseProposals[n]);
+        }
+    }
+    else
+    {
+        // The proposals share m_pRaycastPointCloud
+        for (unsigned int n = 0; n < maxTests; n++)
+        {
+            RaycastPoseProposal(pNeighbors[n], m_poseProposals[n]);
+            AlignPoseProposal(pNeighbors[n], m_poseProposals[n]);
+        }
+    }
 
+    for (unsigned int n = 0; n < maxTests; n++)
+    {
+        const KinectFusionPoseProposal &proposal = m_poseProposals[n];
+        alignmentEnergy = proposal.alignmentEnergy;
 
-        if (SUCCEEDED(tracking) && alignmentEnergy < bestNeighborAlignmentEnergy  && alignmentEnergy > m_paramsCurrent.m_fMinAlignPointCloudsEnergyForSuccess)
+        if (SUCCEEDED(proposal.tracking) && alignmentEnergy < bestNeighborAlignmentEnergy  && alignmentEnergy > m_paramsCurrent.m_fMinAlignPointCloudsEnergyForSuccess)
         {
             bestNeighborAlignmentEnergy = alignmentEnergy;
             bestNeighborIndex = n;
 
             // This is after tracking succeeds, so should be a more accurate pose to store...
-            bestNeighborCameraPose = poseProposal; 
+            bestNeighborCameraPose = proposal.worldToCameraTransform; 
         }
 
         // Find smallest energy neighbor independent of tracking success
@@ -2218,7 +3759,14 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
         m_worldToCameraTransform = bestNeighborCameraPose;
 
         // Get the saved pose view by raycasting the volume
-        hr = m_pVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &m_worldToCameraTransform);
+        if (nullptr != m_pNativeVolume)
+        {
+            hr = m_pNativeVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &m_worldToCameraTransform);
+        }
+        else
+        {
+            hr = m_pVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &m_worldToCameraTransform);
+        }
 
         if (FAILED(hr))
         {
@@ -2231,17 +3779,31 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
         SetTrackingSucceeded();
 
         // Run a single iteration of AlignPointClouds to get the deltas frame
-        hr = m_pVolume->AlignPointClouds(
-            m_pRaycastPointCloud,
-            m_pDepthPointCloud,
-            1,
-            m_pShadedDeltaFromReference,
-            &alignmentEnergy,
-            &bestNeighborCameraPose); 
+        if (nullptr != m_pNativeVolume)
+        {
+            hr = NuiFusionAlignPointClouds(
+                m_pRaycastPointCloud,
+                m_pDepthPointCloud,
+                1,
+                m_pShadedDeltaFromReference,
+                &bestNeighborCameraPose);
+        }
+        else
+        {
+            hr = m_pVolume->AlignPointClouds(
+                m_pRaycastPointCloud,
+                m_pDepthPointCloud,
+                1,
+                m_pShadedDeltaFromReference,
+                &alignmentEnergy,
+                &bestNeighborCameraPose); 
+        }
 
         if (SUCCEEDED(hr))
         {
+            EnterCriticalSection(&m_lockFrame);
             StoreImageToFrameBuffer(m_pShadedDeltaFromReference, m_frame.m_pTrackingDataRGBX);
+            LeaveCriticalSection(&m_lockFrame);
         }
 
         // Stop the residual image being displayed as we have stored our own
@@ -2256,29 +3818,158 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignPointClouds()
         m_worldToCameraTransform = pNeighbors[smallestEnergyNeighborIndex];
 
         // Get the smallest energy view by raycasting the volume
-        hr = m_pVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &m_worldToCameraTransform);
+        if (nullptr != m_pNativeVolume)
+        {
+            hr = m_pNativeVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &m_worldToCameraTransform);
+        }
+        else
+        {
+            hr = m_pVolume->CalculatePointCloud(m_pRaycastPointCloud, nullptr, &m_worldToCameraTransform);
+        }
+
+        if (FAILED(hr))
+        {
+            goto FinishFrame;
+        }
+
+        // Camera pose finding failed - return the tracking failed error code
+        hr = E_NUI_FUSION_TRACKING_ERROR;
+
+        // Tracking Failed will be set again on the next iteration in TrackFrame
+        WCHAR str[MAX_PATH];
+        swprintf_s(str, ARRAYSIZE(str), L"Camera Pose Finder FAILED! Residual energy=%f, %d frames stored, minimum distance=%f, best match index=%d", smallestEnergy, cPoses, minDistance, smallestEnergyNeighborIndex);
+        SetStatusMessage(str);
+    }
+
+FinishFrame:
+
+    return hr;
+}
+
+
+/// <summary>
+/// Make sure there are enough pose proposals for relocalization.
+/// </summary>
+/// <param name="count">The number of proposals to be tested.</param>
+/// <param name="createPointClouds">Whether each proposal needs its own raycast point cloud.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::CreatePoseProposals(unsigned int count, bool createPointClouds)
+{
+    if (m_poseProposals.size() < count)
+    {
+        KinectFusionPoseProposal proposal;
+        ZeroMemory(&proposal, sizeof(proposal));
+
+        try
+        {
+            m_poseProposals.resize(count, proposal);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    HRESULT hr = S_OK;
+
+    // The point clouds are only created when first needed, as each is the size of the depth image.
+    // Proposals without one share m_pRaycastPointCloud.
+    for (unsigned int n = 0; n < count && SUCCEEDED(hr); n++)
+    {
+        if (createPointClouds)
+        {
+            hr = CreateFrame(
+                NUI_FUSION_IMAGE_TYPE_POINT_CLOUD,
+                m_pRaycastPointCloud->width,
+                m_pRaycastPointCloud->height,
+                &m_poseProposals[n].pRaycastPointCloud);
+        }
+        else
+        {
+            SAFE_FUSION_RELEASE_IMAGE_FRAME(m_poseProposals[n].pRaycastPointCloud);
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Raycast a pose from the camera pose finder into the point cloud of the proposal.
+/// Proposals with their own point cloud may be raycast in parallel, so this does not report status.
+/// </summary>
+/// <param name="neighborPose">The pose from the camera pose finder.</param>
+/// <param name="proposal">Returns the pose and the raycast result.</param>
+void KinectFusionProcessor::RaycastPoseProposal(const Matrix4 &neighborPose, KinectFusionPoseProposal &proposal)
+{
+    NUI_FUSION_IMAGE_FRAME *pRaycastPointCloud = (nullptr != proposal.pRaycastPointCloud) ? proposal.pRaycastPointCloud : m_pRaycastPointCloud;
+
+    proposal.worldToCameraTransform = neighborPose;
 
-        if (FAILED(hr))
-        {
-            goto FinishFrame;
-        }
+    // Proposals which fail before the energy is calculated have the maximum normalized energy
+    proposal.alignmentEnergy = 1.0f;
 
-        // Camera pose finding failed - return the tracking failed error code
-        hr = E_NUI_FUSION_TRACKING_ERROR;
+    // Get the saved pose view by raycasting the volume
+    if (nullptr != m_pNativeVolume)
+    {
+        proposal.tracking = m_pNativeVolume->CalculatePointCloud(pRaycastPointCloud, nullptr, &proposal.worldToCameraTransform);
+    }
+    else
+    {
+        proposal.tracking = m_pVolume->CalculatePointCloud(pRaycastPointCloud, nullptr, &proposal.worldToCameraTransform);
+    }
+}
 
-        // Tracking Failed will be set again on the next iteration in ProcessDepth
-        WCHAR str[MAX_PATH];
-        swprintf_s(str, ARRAYSIZE(str), L"Camera Pose Finder FAILED! Residual energy=%f, %d frames stored, minimum distance=%f, best match index=%d", smallestEnergy, cPoses, minDistance, smallestEnergyNeighborIndex);
-        SetStatusMessage(str);
+/// <summary>
+/// Align the depth point cloud to the raycast of a proposal.
+/// </summary>
+/// <param name="neighborPose">The pose from the camera pose finder.</param>
+/// <param name="proposal">Returns the aligned pose, its alignment energy and the tracking result.</param>
+void KinectFusionProcessor::AlignPoseProposal(const Matrix4 &neighborPose, KinectFusionPoseProposal &proposal)
+{
+    if (FAILED(proposal.tracking))
+    {
+        return;
     }
 
-FinishFrame:
+    NUI_FUSION_IMAGE_FRAME *pRaycastPointCloud = (nullptr != proposal.pRaycastPointCloud) ? proposal.pRaycastPointCloud : m_pRaycastPointCloud;
+    unsigned short relocIterationCount = NUI_FUSION_DEFAULT_ALIGN_ITERATION_COUNT;
 
-    SafeRelease(pMatchCandidates);
+    ////////////////////////////////////////////////////////
+    // Call AlignPointClouds
 
-    return hr;
-}
+    if (nullptr != m_pNativeVolume)
+    {
+        proposal.tracking = NuiFusionAlignPointClouds(
+            pRaycastPointCloud,
+            m_pDepthPointCloud,
+            relocIterationCount,
+            nullptr,
+            &proposal.worldToCameraTransform);
 
+        // NuiFusionAlignPointClouds does not return the residual alignment energy, so calculate it here,
+        // rejecting correspondences further apart than the maximum translation per frame
+        if (SUCCEEDED(proposal.tracking))
+        {
+            proposal.tracking = CalculatePointCloudAlignmentEnergy(
+                pRaycastPointCloud,
+                neighborPose,
+                m_pDepthPointCloud,
+                proposal.worldToCameraTransform,
+                m_paramsCurrent.m_fMaxTranslationDelta,
+                proposal.alignmentEnergy);
+        }
+    }
+    else
+    {
+        proposal.tracking = m_pVolume->AlignPointClouds(
+            pRaycastPointCloud,
+            m_pDepthPointCloud,
+            relocIterationCount,
+            nullptr,
+            &proposal.alignmentEnergy,
+            &proposal.worldToCameraTransform); 
+    }
+}
 
 /// <summary>
 /// Perform camera pose finding when tracking is lost using AlignDepthFloatToReconstruction.
@@ -2302,24 +3993,19 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignDepthFloatToReconstruction()
     }
 
     // Start  kNN (k nearest neighbors) camera pose finding
-    INuiFusionMatchCandidates *pMatchCandidates = nullptr;
+    const Matrix4 *pNeighbors = nullptr;
+    unsigned int cPoses = 0;
+    float minDistance = 1.0f;   // initialize to the maximum normalized distance
 
     // Test the camera pose finder to see how similar the input images are to previously captured images.
     // This will return an error code if there are no matched frames in the camera pose finder database.
-    hr = m_pCameraPoseFinder->FindCameraPose(
+    hr = m_cameraPoseFinderWorker.FindCameraPose(
         m_pDepthFloatImage, 
-        resampled ? m_pResampledColorImage : m_pColorImage,
-        &pMatchCandidates);
-
-    if (FAILED(hr) || nullptr == pMatchCandidates)
-    {
-        goto FinishFrame;
-    }
-
-    unsigned int cPoses = pMatchCandidates->MatchPoseCount();
-
-    float minDistance = 1.0f;   // initialize to the maximum normalized distance
-    hr = pMatchCandidates->CalculateMinimumDistance(&minDistance);
+        resampled ? m_pResampledColorImage : m_pCameraPoseFinderColorImage,
+        m_paramsCurrent.m_cMaxCameraPoseFinderPoseTests,
+        &pNeighbors,
+        &cPoses,
+        &minDistance);
 
     if (FAILED(hr) || 0 == cPoses)
     {
@@ -2336,15 +4022,6 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignDepthFloatToReconstruction()
         goto FinishFrame;
     }
 
-    // Get the actual matched poses
-    const Matrix4 *pNeighbors = nullptr;
-    hr = pMatchCandidates->GetMatchPoses(&pNeighbors);
-
-    if (FAILED(hr))
-    {
-        goto FinishFrame;
-    }
-
     HRESULT tracking = S_OK;
     FLOAT alignmentEnergy = 0;
 
@@ -2444,7 +4121,7 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignDepthFloatToReconstruction()
         // Camera pose finding failed - return the tracking failed error code
         hr = E_NUI_FUSION_TRACKING_ERROR;
 
-        // Tracking Failed will be set again on the next iteration in ProcessDepth
+        // Tracking Failed will be set again on the next iteration in TrackFrame
         WCHAR str[MAX_PATH];
         swprintf_s(str, ARRAYSIZE(str), L"Camera Pose Finder FAILED! Residual energy=%f, %d frames stored, minimum distance=%f, best match index=%d", smallestEnergy, cPoses, minDistance, smallestEnergyNeighborIndex);
         SetStatusMessage(str);
@@ -2452,8 +4129,6 @@ HRESULT KinectFusionProcessor::FindCameraPoseAlignDepthFloatToReconstruction()
 
 FinishFrame:
 
-    SafeRelease(pMatchCandidates);
-
     return hr;
 }
 
@@ -2467,11 +4142,22 @@ HRESULT KinectFusionProcessor::SetReferenceFrame(const Matrix4 &worldToCamera)
     HRESULT hr = S_OK;
 
     // Raycast to get the predicted previous frame to align against in the next frame
-    hr = m_pVolume->CalculatePointCloudAndDepth(
-        m_pRaycastPointCloud, 
-        m_pRaycastDepthFloatImage, 
-        nullptr, 
-        &worldToCamera);
+    if (nullptr != m_pNativeVolume)
+    {
+        hr = m_pNativeVolume->CalculatePointCloudAndDepth(
+            m_pRaycastPointCloud, 
+            m_pRaycastDepthFloatImage, 
+            nullptr, 
+            &worldToCamera);
+    }
+    else
+    {
+        hr = m_pVolume->CalculatePointCloudAndDepth(
+            m_pRaycastPointCloud, 
+            m_pRaycastDepthFloatImage, 
+            nullptr, 
+            &worldToCamera);
+    }
 
     if (FAILED(hr))
     {
@@ -2479,6 +4165,12 @@ HRESULT KinectFusionProcessor::SetReferenceFrame(const Matrix4 &worldToCamera)
         return hr;
     }
 
+    // The native volume always tracks with AlignPointClouds, which needs no reference frame
+    if (nullptr != m_pNativeVolume)
+    {
+        return hr;
+    }
+
     // Set this frame as a reference for AlignDepthFloatToReconstruction
     hr =  m_pVolume->SetAlignDepthFloatToReconstructionReferenceFrame(m_pRaycastDepthFloatImage);
 
@@ -2534,7 +4226,7 @@ void KinectFusionProcessor::ResetTracking()
 
     if (nullptr != m_pCameraPoseFinder)
     {
-        m_pCameraPoseFinder->ResetCameraPoseFinder();
+        m_cameraPoseFinderWorker.Reset();
     }
 }
 
@@ -2550,23 +4242,23 @@ HRESULT KinectFusionProcessor::ProcessColorForCameraPoseFinder(bool &resampled)
     // before passing to the CameraPoseFinder
     if (m_paramsCurrent.m_cDepthImagePixels != m_paramsCurrent.m_cColorImagePixels)
     {
-        if (m_pColorImage->width > m_pResampledColorImage->width)
+        if (m_pCameraPoseFinderColorImage->width > m_pResampledColorImage->width)
         {
             // Down-sample
-            unsigned int factor = m_pColorImage->width / m_pResampledColorImage->width;
-            hr = DownsampleFrameNearestNeighbor(m_pColorImage, m_pResampledColorImage, factor);
+            unsigned int factor = m_pCameraPoseFinderColorImage->width / m_pResampledColorImage->width;
+            hr = m_colorPyramid.Downsample(m_pCameraPoseFinderColorImage, m_pResampledColorImage, factor, PyramidFilterNearest, 0.0f);
 
             if (FAILED(hr))
             {
-                SetStatusMessage(L"Kinect Fusion DownsampleFrameNearestNeighbor call failed.");
+                SetStatusMessage(L"Kinect Fusion color image down sampling failed.");
                 return hr;
             }
         }
         else
         {
             // Up-sample
-            unsigned int factor = m_pResampledColorImage->width / m_pColorImage->width;
-            hr = UpsampleFrameNearestNeighbor(m_pColorImage, m_pResampledColorImage, factor);
+            unsigned int factor = m_pResampledColorImage->width / m_pCameraPoseFinderColorImage->width;
+            hr = UpsampleFrameNearestNeighbor(m_pCameraPoseFinderColorImage, m_pResampledColorImage, factor);
 
             if (FAILED(hr))
             {
@@ -2586,66 +4278,66 @@ HRESULT KinectFusionProcessor::ProcessColorForCameraPoseFinder(bool &resampled)
 }
 
 /// <summary>
-/// Update the camera pose finder data.
+/// Submit the current frame to the camera pose finder worker to store as a key frame.
 /// </summary>
 /// <returns>S_OK on success, otherwise failure code</returns>
 HRESULT KinectFusionProcessor::UpdateCameraPoseFinder()
 {
     AssertOwnThread();
 
-    HRESULT hr = S_OK;
-
-    if (nullptr == m_pDepthFloatImage || nullptr == m_pColorImage  
-        || nullptr == m_pResampledColorImage || nullptr == m_pCameraPoseFinder)
+    if (nullptr == m_pDepthFloatImage || nullptr == m_pCameraPoseFinderColorImage || nullptr == m_pCameraPoseFinder)
     {
         return E_FAIL;
     }
 
-    bool resampled = false;
+    // The worker will add the pose to the camera pose finding database when the input frame's minimum
+    // distance to the existing database is equal to or above m_fDistanceThresholdAccept (i.e. indicating 
+    // that the input has become dis-similar to the existing database and a new frame should be captured).
+    // It copies the frames and re-samples the color to the depth size itself, and skips the frame when
+    // still busy with the previous one, so tracking does not wait for the database as it grows.
+    // Note that the horizontal mirroring setting does not have to be consistent between depth and color.
+    // It does have to be consistent between camera pose finder database creation and calling
+    // FindCameraPose though, hence we always reset both the reconstruction and database when changing
+    // the mirror depth setting.
+    HRESULT hr = m_cameraPoseFinderWorker.Submit(
+        m_pDepthFloatImage, 
+        m_pCameraPoseFinderColorImage,
+        m_worldToCameraTransform, 
+        m_paramsCurrent.m_fCameraPoseFinderDistanceThresholdAccept);
 
-    hr = ProcessColorForCameraPoseFinder(resampled);
+    return FAILED(hr) ? hr : S_OK;
+}
 
-    if (FAILED(hr))
-    {
-        return hr;
-    }
+/// <summary>
+/// Report the key frames added by the camera pose finder worker since the last call.
+/// </summary>
+void KinectFusionProcessor::ReportCameraPoseFinderInsert()
+{
+    AssertOwnThread();
 
-    BOOL poseHistoryTrimmed = FALSE;
-    BOOL addedPose = FALSE;
+    KinectFusionCameraPoseFinderInsert insert;
 
-    // This function will add the pose to the camera pose finding database when the input frame's minimum
-    // distance to the existing database is equal to or above m_fDistanceThresholdAccept (i.e. indicating 
-    // that the input has become dis-similar to the existing database and a new frame should be captured).
-    // Note that the color and depth frames must be the same size, however, the horizontal mirroring
-    // setting does not have to be consistent between depth and color. It does have to be consistent
-    // between camera pose finder database creation and calling FindCameraPose though, hence we always
-    // reset both the reconstruction and database when changing the mirror depth setting.
-    hr = m_pCameraPoseFinder->ProcessFrame(
-        m_pDepthFloatImage, 
-        resampled ? m_pResampledColorImage : m_pColorImage,
-        &m_worldToCameraTransform, 
-        m_paramsCurrent.m_fCameraPoseFinderDistanceThresholdAccept, 
-        &addedPose, 
-        &poseHistoryTrimmed);
+    if (!m_cameraPoseFinderWorker.TakeInsertResult(insert))
+    {
+        return;
+    }
 
-    if (TRUE == addedPose)
+    if (TRUE == insert.addedPose)
     {
         WCHAR str[MAX_PATH];
-        swprintf_s(str, ARRAYSIZE(str), L"Camera Pose Finder Added Frame! %d frames stored, minimum distance>=%f\n", m_pCameraPoseFinder->GetStoredPoseCount(), m_paramsCurrent.m_fCameraPoseFinderDistanceThresholdAccept);
+        swprintf_s(str, ARRAYSIZE(str), L"Camera Pose Finder Added Frame! %u frames stored, minimum distance>=%f\n", insert.storedPoseCount, insert.distanceThresholdAccept);
         SetStatusMessage(str);
     }
 
-    if (TRUE == poseHistoryTrimmed)
+    if (TRUE == insert.poseHistoryTrimmed)
     {
         SetStatusMessage(L"Kinect Fusion Camera Pose Finder pose history is full, overwritten oldest pose to store current pose.");
     }
 
-    if (FAILED(hr))
+    if (FAILED(insert.hr))
     {
         SetStatusMessage(L"Kinect Fusion Camera Pose Finder Process Frame call failed.");
     }
-
-    return hr;
 }
 
 /// <summary>
@@ -2661,6 +4353,8 @@ HRESULT KinectFusionProcessor::StoreImageToFrameBuffer(
 {
     AssertOwnThread();
 
+    KinectFusionScopedTimer timer(m_instrumentation, KinectFusionStageStoreImageToFrameBuffer);
+
     HRESULT hr = S_OK;
 
     if (nullptr == imageFrame || nullptr == imageFrame->pFrameTexture || nullptr == buffer)
@@ -2679,6 +4373,12 @@ HRESULT KinectFusionProcessor::StoreImageToFrameBuffer(
         return E_NOINTERFACE;
     }
 
+    // Convert from floating point depth if required
+    if (NUI_FUSION_IMAGE_TYPE_FLOAT == imageFrame->imageType)
+    {
+        return m_visualization.DepthFloatToRgbx(imageFrame, buffer, m_paramsCurrent.m_visualizationPath);
+    }
+
     INuiFrameTexture *imageFrameTexture = imageFrame->pFrameTexture;
     NUI_LOCKED_RECT LockedRect;
 
@@ -2688,49 +4388,18 @@ HRESULT KinectFusionProcessor::StoreImageToFrameBuffer(
     // Make sure we've received valid data
     if (LockedRect.Pitch != 0)
     {
-        // Convert from floating point depth if required
-        if (NUI_FUSION_IMAGE_TYPE_FLOAT == imageFrame->imageType)
-        {
-            // Depth ranges set here for better visualization, and map to black at 0 and white at 4m
-            const FLOAT range = 4.0f;
-            const FLOAT oneOverRange = (1.0f / range) * 256.0f;
-            const FLOAT minRange = 0.0f;
-
-            const float *pFloatBuffer = reinterpret_cast<float *>(LockedRect.pBits);
-
-            Concurrency::parallel_for(0u, imageFrame->height, [&](unsigned int y)
-            {
-                unsigned int* pColorRow = reinterpret_cast<unsigned int*>(reinterpret_cast<unsigned char*>(buffer) + (y * LockedRect.Pitch));
-                const float* pFloatRow = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(pFloatBuffer) + (y * LockedRect.Pitch));
-
-                for (unsigned int x = 0; x < imageFrame->width; ++x)
-                {
-                    float depth = pFloatRow[x];
-
-                    // Note: Using conditionals in this loop could degrade performance.
-                    // Consider using a lookup table instead when writing production code.
-                    BYTE intensity = (depth >= minRange) ?
-                        static_cast<BYTE>( (int)((depth - minRange) * oneOverRange) % 256 ) :
-                        0; // % 256 to enable it to wrap around after the max range
-
-                    pColorRow[x] = (255 << 24) | (intensity << 16) | (intensity << 8 ) | intensity;
-                }
-            });
-        }
-        else	// already in 4 bytes per int (RGBA/BGRA) format
-        {
-            const size_t destPixelCount =
-                m_paramsCurrent.m_cDepthWidth * m_paramsCurrent.m_cDepthHeight;
+        // Already in 4 bytes per int (RGBA/BGRA) format
+        const size_t destPixelCount =
+            m_paramsCurrent.m_cDepthWidth * m_paramsCurrent.m_cDepthHeight;
 
-            BYTE * pBuffer = (BYTE *)LockedRect.pBits;
+        BYTE * pBuffer = (BYTE *)LockedRect.pBits;
 
-            // Draw the data with Direct2D
-            memcpy_s(
-                buffer,
-                destPixelCount * KinectFusionParams::BytesPerPixel,
-                pBuffer,
-                imageFrame->width * imageFrame->height * KinectFusionParams::BytesPerPixel);
-        }
+        // Draw the data with Direct2D
+        memcpy_s(
+            buffer,
+            destPixelCount * KinectFusionParams::BytesPerPixel,
+            pBuffer,
+            imageFrame->width * imageFrame->height * KinectFusionParams::BytesPerPixel);
     }
     else
     {
@@ -2766,7 +4435,7 @@ HRESULT KinectFusionProcessor::InternalResetReconstruction()
 {
     AssertOwnThread();
 
-    if (nullptr == m_pVolume)
+    if (nullptr == m_pVolume && nullptr == m_pNativeVolume)
     {
         return E_FAIL;
     }
@@ -2774,6 +4443,7 @@ HRESULT KinectFusionProcessor::InternalResetReconstruction()
     HRESULT hr = S_OK;
 
     SetIdentityMatrix(m_worldToCameraTransform);
+    ++m_cVolumeGeneration;
 
     // Translate the world origin away from the reconstruction volume location by an amount equal
     // to the minimum depth threshold. This ensures that some depth signal falls inside the volume.
@@ -2788,11 +4458,25 @@ HRESULT KinectFusionProcessor::InternalResetReconstruction()
         float minDist = (m_paramsCurrent.m_fMinDepthThreshold < m_paramsCurrent.m_fMaxDepthThreshold) ? m_paramsCurrent.m_fMinDepthThreshold : m_paramsCurrent.m_fMaxDepthThreshold;
         worldToVolumeTransform.M43 -= (minDist * m_paramsCurrent.m_reconstructionParams.voxelsPerMeter);
 
-        hr = m_pVolume->ResetReconstruction(&m_worldToCameraTransform, &worldToVolumeTransform);
+        if (nullptr != m_pNativeVolume)
+        {
+            hr = m_pNativeVolume->ResetReconstruction(&worldToVolumeTransform);
+        }
+        else
+        {
+            hr = m_pVolume->ResetReconstruction(&m_worldToCameraTransform, &worldToVolumeTransform);
+        }
     }
     else
     {
-        hr = m_pVolume->ResetReconstruction(&m_worldToCameraTransform, nullptr);
+        if (nullptr != m_pNativeVolume)
+        {
+            hr = m_pNativeVolume->ResetReconstruction(nullptr);
+        }
+        else
+        {
+            hr = m_pVolume->ResetReconstruction(&m_worldToCameraTransform, nullptr);
+        }
     }
 
     m_cFrameCounter = 0;
@@ -2807,22 +4491,40 @@ HRESULT KinectFusionProcessor::InternalResetReconstruction()
         ResetTracking();
     }
 
+    if (SUCCEEDED(hr) && nullptr != m_pNativeVolume)
+    {
+        hr = m_rollingVolume.Reset(m_pNativeVolume, m_paramsCurrent.m_reconstructionParams, m_worldToCameraTransform);
+    }
+
     return hr;
 }
 
 /// <summary>
-/// Calculate a mesh for the current volume
+/// Calculate a mesh for the current volume. Native volumes are meshed incrementally, only
+/// extracting the blocks changed since the previous call again.
 /// </summary>
 /// <param name="ppMesh">returns the new mesh</param>
-HRESULT KinectFusionProcessor::CalculateMesh(INuiFusionColorMesh** ppMesh)
+/// <param name="pStatistics">optionally returns the work done to mesh a native volume</param>
+HRESULT KinectFusionProcessor::CalculateMesh(INuiFusionColorMesh** ppMesh, KinectFusionMeshStatistics* pStatistics)
 {
     AssertOtherThread();
 
+    if (nullptr != pStatistics)
+    {
+        ZeroMemory(pStatistics, sizeof(*pStatistics));
+    }
+
     EnterCriticalSection(&m_lockVolume);
 
     HRESULT hr = E_FAIL;
+    bool bNativeVolume = false;
 
-    if (m_pVolume != nullptr)
+    if (m_pNativeVolume != nullptr)
+    {
+        bNativeVolume = true;
+        hr = m_mesher.BeginUpdate(m_pNativeVolume);
+    }
+    else if (m_pVolume != nullptr)
     {
         hr = m_pVolume->CalculateMesh(1, ppMesh);
 
@@ -2834,6 +4536,229 @@ HRESULT KinectFusionProcessor::CalculateMesh(INuiFusionColorMesh** ppMesh)
 
     LeaveCriticalSection(&m_lockVolume);
 
+    if (bNativeVolume)
+    {
+        // Only hold the volume lock to copy each batch of changed blocks, and mesh the copies
+        // while tracking carries on
+        while (SUCCEEDED(hr) && m_mesher.HasPendingBlocks())
+        {
+            EnterCriticalSection(&m_lockVolume);
+            hr = (nullptr != m_pNativeVolume) ? m_mesher.CopyPendingBlocks(m_pNativeVolume) : E_FAIL;
+            LeaveCriticalSection(&m_lockVolume);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = m_mesher.ExtractCopiedBlocks();
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_mesher.EndUpdate(ppMesh);
+        }
+
+        if (SUCCEEDED(hr) && nullptr != pStatistics)
+        {
+            *pStatistics = m_mesher.GetStatistics();
+        }
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Volume checkpoint processing function, which replaces the checkpoint file with a snapshot of
+/// the native volume at each interval in which frames were tracked, and once more on stopping
+/// </summary>
+DWORD KinectFusionProcessor::CheckpointLoop()
+{
+    EnterCriticalSection(&m_lockVolume);
+    const DWORD intervalMilliseconds = m_paramsCurrent.m_cCheckpointIntervalSeconds * 1000;
+    LeaveCriticalSection(&m_lockVolume);
+
+    LONG cCheckpointFrames = m_cTrackedFrames;
+    bool bStop = false;
+
+    while (!bStop)
+    {
+        bStop = WaitForSingleObject(m_hStopPipelineEvent, intervalMilliseconds) != WAIT_TIMEOUT;
+
+        // The volume has not changed while no frames were tracked
+        const LONG cTrackedFrames = m_cTrackedFrames;
+        if (cTrackedFrames == cCheckpointFrames)
+        {
+            continue;
+        }
+
+        HRESULT hr = WriteVolumeCheckpoint();
+
+        if (SUCCEEDED(hr))
+        {
+            cCheckpointFrames = cTrackedFrames;
+        }
+        else if (E_ABORT != hr && E_NOTIMPL != hr)
+        {
+            SetStatusMessage(L"Failed to write the volume checkpoint file.");
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Write a snapshot of the native volume to the checkpoint file. As in CalculateMesh, the volume
+/// lock is only held to copy each batch of blocks, and the copies are compressed and written
+/// while tracking and integration carry on.
+/// </summary>
+/// <returns>S_OK on success, E_ABORT if the volume was reset or recreated meanwhile, E_NOTIMPL
+/// without a native volume, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::WriteVolumeCheckpoint()
+{
+    AssertOwnThread();
+
+    EnterCriticalSection(&m_lockVolume);
+
+    // Snapshots hold the voxels of native volumes only
+    HRESULT hr = E_NOTIMPL;
+    const unsigned int volumeGeneration = m_cVolumeGeneration;
+
+    if (nullptr != m_pNativeVolume)
+    {
+        hr = m_volumeSnapshot.BeginWrite(
+            m_paramsCurrent.m_szCheckpointFile,
+            m_pNativeVolume,
+            m_paramsCurrent.m_reconstructionParams,
+            m_worldToCameraTransform,
+            m_paramsCurrent.m_bCaptureColor);
+    }
+
+    LeaveCriticalSection(&m_lockVolume);
+
+    while (SUCCEEDED(hr) && m_volumeSnapshot.HasPendingBlocks())
+    {
+        EnterCriticalSection(&m_lockVolume);
+
+        if (nullptr == m_pNativeVolume || volumeGeneration != m_cVolumeGeneration)
+        {
+            hr = E_ABORT;
+        }
+        else
+        {
+            hr = m_volumeSnapshot.CopyPendingBlocks(m_pNativeVolume);
+        }
+
+        LeaveCriticalSection(&m_lockVolume);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_volumeSnapshot.WriteCopiedBlocks();
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_volumeSnapshot.EndWrite();
+    }
+    else
+    {
+        m_volumeSnapshot.AbortWrite();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Load the checkpoint file into the newly created native volume and continue tracking from
+/// the camera pose of the checkpoint. Called with the volume locked.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::ResumeFromVolumeCheckpoint()
+{
+    AssertOwnThread();
+
+    if (nullptr == m_pNativeVolume)
+    {
+        SetStatusMessage(L"Volume checkpoints need the native CPU reconstruction volume.");
+        return E_NOTIMPL;
+    }
+
+    Matrix4 worldToCameraTransform;
+    HRESULT hr = KinectFusionVolumeSnapshot::Read(
+        m_paramsCurrent.m_szCheckpointFile,
+        m_pNativeVolume,
+        m_paramsCurrent.m_reconstructionParams,
+        &worldToCameraTransform);
+
+    if (SUCCEEDED(hr))
+    {
+        m_worldToCameraTransform = worldToCameraTransform;
+        hr = SetReferenceFrame(m_worldToCameraTransform);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // The volume rolls on from where it was checkpointed
+        hr = m_rollingVolume.Reset(m_pNativeVolume, m_paramsCurrent.m_reconstructionParams, m_worldToCameraTransform);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Track the first frame against the restored surface rather than integrating it at the
+        // pose of the checkpoint, as the camera has most likely moved since
+        m_cFrameCounter = 1;
+        SetStatusMessage(L"Resumed the reconstruction from the volume checkpoint.");
+    }
+    else if (HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) == hr)
+    {
+        // There is nothing to resume on the first run
+    }
+    else if (E_INVALIDARG == hr)
+    {
+        SetStatusMessage(L"The volume checkpoint does not match the reconstruction volume size.");
+    }
+    else
+    {
+        // A volume which failed to load part way is cleared, so start the scan afresh
+        InternalResetReconstruction();
+        SetStatusMessage(L"Failed to load the volume checkpoint file.");
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Shift the native volume to follow the camera when it has moved far enough. Called with the
+/// volume locked.
+/// </summary>
+/// <returns>S_OK if the volume was shifted, S_FALSE if it did not need to be, otherwise failure code</returns>
+HRESULT KinectFusionProcessor::ShiftVolumeWithCamera()
+{
+    AssertOwnThread();
+
+    int shift[3];
+    if (!m_rollingVolume.GetShift(
+            m_pNativeVolume,
+            m_paramsCurrent.m_reconstructionParams,
+            m_worldToCameraTransform,
+            m_paramsCurrent.m_fRollingVolumeShiftDistance,
+            shift))
+    {
+        return S_FALSE;
+    }
+
+    KinectFusionScopedTimer timer(m_instrumentation, KinectFusionStageShiftVolume);
+
+    // A checkpoint being written no longer matches the volume
+    ++m_cVolumeGeneration;
+
+    HRESULT hr = m_rollingVolume.Shift(m_pNativeVolume, m_paramsCurrent.m_reconstructionParams, shift);
+
+    if (FAILED(hr))
+    {
+        // A volume which failed to shift part way is incomplete, so start the scan afresh
+        InternalResetReconstruction();
+    }
+
     return hr;
 }
 
@@ -2845,7 +4770,12 @@ void KinectFusionProcessor::SetStatusMessage(WCHAR * szMessage)
 {
     AssertOwnThread();
 
+    // Each pipeline stage reports its own status, so the message is passed on to the frame
+    // straight away rather than at the end of a stage
+    EnterCriticalSection(&m_lockFrame);
     StringCchCopy(m_statusMessage, ARRAYSIZE(m_statusMessage), szMessage);
+    m_frame.SetStatusMessage(m_statusMessage);
+    LeaveCriticalSection(&m_lockFrame);
 }
 
 /// <summary>
@@ -23,16 +23,42 @@
 #include <NuiApi.h>
 #include <NuiKinectFusionApi.h>
 #include <NuiSensorChooser.h>
+#include <NuiColorToDepthRemap.h>
 
 #include "Timer.h"
 #include "KinectFusionParams.h"
 #include "KinectFusionProcessorFrame.h"
+#include "KinectFusionVolume.h"
+#include "KinectFusionCpuVolume.h"
+#include "KinectFusionIncrementalMesher.h"
+#include "KinectFusionImagePyramid.h"
+#include "KinectFusionVisualization.h"
+#include "KinectFusionRecording.h"
+#include "KinectFusionFrameLease.h"
+#include "KinectFusionPipeline.h"
+#include "KinectFusionCameraPoseFinderWorker.h"
+#include "KinectFusionVolumeSnapshot.h"
+#include "KinectFusionRollingVolume.h"
+#include "KinectFusionDepthFilter.h"
 
 #include "KinectFusionHelper.h"
 
+/// <summary>
+/// A pose from the camera pose finder aligned to the current depth point cloud while relocalizing.
+/// </summary>
+struct KinectFusionPoseProposal
+{
+    NUI_FUSION_IMAGE_FRAME*     pRaycastPointCloud;         // raycast of the pose, or nullptr to use m_pRaycastPointCloud
+    Matrix4                     worldToCameraTransform;     // the aligned pose
+    FLOAT                       alignmentEnergy;
+    HRESULT                     tracking;
+};
+
 /// <summary>
 /// Performs all Kinect Fusion processing for the KinectFusionExplorer.
-/// All data capture and processing is done on a worker thread.
+/// Processing is a pipeline of three worker threads: the capture stage converts the sensor
+/// frames, the tracking stage tracks the camera and integrates into the volume, and the render
+/// stage raycasts the volume for display. Frames pass between the stages in lock-free queues.
 /// </summary>
 class KinectFusionProcessor
 {
@@ -42,6 +68,7 @@ class KinectFusionProcessor
     static const int            cTimeDisplayInterval = 4;
     static const int            cRenderIntervalMilliseconds = 100; // Render every 100ms
     static const int            cMinTimestampDifferenceForFrameReSync = 17; // The minimum timestamp difference between depth and color (in ms) at which they are considered un-synchronized. 
+    static const unsigned int   cPipelineFrameCount = 2; // Frames in flight between the capture and tracking stages
 
 public:
     /// <summary>
@@ -91,10 +118,13 @@ public:
     HRESULT                     ResetReconstruction();
 
     /// <summary>
-    /// Calculate a mesh for the current volume.
+    /// Calculate a mesh for the current volume. Native volumes are meshed incrementally, only
+    /// extracting the blocks changed since the previous call again.
     /// </summary>
+    /// <param name="ppMesh">Returns the mesh, which the caller releases.</param>
+    /// <param name="pStatistics">Optionally returns the work done to mesh a native volume, or nullptr.</param>
     /// <returns>S_OK on success, otherwise failure code</returns>
-    HRESULT                     CalculateMesh(INuiFusionColorMesh** ppMesh);
+    HRESULT                     CalculateMesh(INuiFusionColorMesh** ppMesh, KinectFusionMeshStatistics* pStatistics = nullptr);
 
     /// <summary>
     /// Lock the current frame while rendering it to the screen.
@@ -118,6 +148,43 @@ public:
     /// </summary>
     bool                        IsCameraPoseFinderAvailable();
 
+    /// <summary>
+    /// Time the depth, residual and surface image conversions on each visualization path.
+    /// </summary>
+    /// <param name="width">The width of the images.</param>
+    /// <param name="height">The height of the images.</param>
+    /// <param name="iterations">The number of calls timed per conversion and path.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     BenchmarkVisualization(
+                                    unsigned int width,
+                                    unsigned int height,
+                                    unsigned int iterations,
+                                    KinectFusionVisualizationBenchmark* pResults);
+
+    /// <summary>
+    /// Time saving, loading and querying a keyframe database of synthetic key frames.
+    /// </summary>
+    /// <param name="keyframes">The number of key frames.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     BenchmarkKeyframeDatabase(
+                                    unsigned int keyframes,
+                                    KinectFusionKeyframeBenchmark* pResults);
+
+    /// <summary>
+    /// Time the integration of the depth frames of a recorded session into the native CPU
+    /// volume by number of cores.
+    /// </summary>
+    /// <param name="params">The parameters naming the recorded session and the volume layout.</param>
+    /// <param name="maxFrames">The maximum number of frames of the session to integrate.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     BenchmarkIntegration(
+                                    const KinectFusionParams& params,
+                                    unsigned int maxFrames,
+                                    KinectFusionIntegrationBenchmark* pResults);
+
 private:
     KinectFusionParams          m_paramsNext;
     KinectFusionParams          m_paramsCurrent;
@@ -159,10 +226,61 @@ private:
     static DWORD WINAPI         ThreadProc(LPVOID lpParameter);
 
     /// <summary>
-    /// Main processing function
+    /// Main processing function, which runs the capture stage.
     /// </summary>
     DWORD                       MainLoop();
 
+    /// <summary>
+    /// Tracking stage thread procedure.
+    /// </summary>
+    static DWORD WINAPI         TrackingThreadProc(LPVOID lpParameter);
+
+    /// <summary>
+    /// Tracking stage processing function.
+    /// </summary>
+    DWORD                       TrackingLoop();
+
+    /// <summary>
+    /// Render stage thread procedure.
+    /// </summary>
+    static DWORD WINAPI         RenderThreadProc(LPVOID lpParameter);
+
+    /// <summary>
+    /// Render stage processing function.
+    /// </summary>
+    DWORD                       RenderLoop();
+
+    /// <summary>
+    /// Volume checkpoint thread procedure.
+    /// </summary>
+    static DWORD WINAPI         CheckpointThreadProc(LPVOID lpParameter);
+
+    /// <summary>
+    /// Volume checkpoint processing function.
+    /// </summary>
+    DWORD                       CheckpointLoop();
+
+    /// <summary>
+    /// Whether the calling thread is one of the processing threads.
+    /// </summary>
+    bool                        IsProcessingThread() const;
+
+    /// <summary>
+    /// Start the tracking and render stage threads.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     StartPipeline();
+
+    /// <summary>
+    /// Stop the tracking and render stage threads, discarding the frames in flight.
+    /// </summary>
+    void                        StopPipeline();
+
+    /// <summary>
+    /// Wait until the tracking stage has processed every captured frame.
+    /// </summary>
+    void                        WaitForPipelineIdle();
+
     /// <summary>
     /// Update the sensor and status based on the changed flags.
     /// </summary>
@@ -207,10 +325,31 @@ private:
     HRESULT                     RecreateVolume();
 
     /// <summary>
-    /// Copy the extended depth data out of a Kinect image frame.
+    /// Write a snapshot of the native volume to the checkpoint file, holding the volume lock
+    /// only while each batch of blocks is copied.
+    /// </summary>
+    /// <returns>S_OK on success, E_ABORT if the volume was reset or recreated meanwhile, E_NOTIMPL
+    /// without a native volume, otherwise failure code</returns>
+    HRESULT                     WriteVolumeCheckpoint();
+
+    /// <summary>
+    /// Load the checkpoint file into the newly created native volume and continue tracking from
+    /// the camera pose of the checkpoint.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ResumeFromVolumeCheckpoint();
+
+    /// <summary>
+    /// Shift the native volume to follow the camera when it has moved far enough.
+    /// </summary>
+    /// <returns>S_OK if the volume was shifted, S_FALSE if it did not need to be, otherwise failure code</returns>
+    HRESULT                     ShiftVolumeWithCamera();
+
+    /// <summary>
+    /// Lease the extended depth data of a Kinect image frame. The frame is released with the lease.
     /// </summary>
     /// <returns>S_OK on success, otherwise failure code</returns>
-    HRESULT                     CopyExtendedDepth(NUI_IMAGE_FRAME &imageFrame);
+    HRESULT                     LeaseExtendedDepth(NUI_IMAGE_FRAME &imageFrame);
 
     /// <summary>
     /// Copy the color data out of a Kinect image frame
@@ -218,22 +357,97 @@ private:
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                     CopyColor(NUI_IMAGE_FRAME &imageFrame);
 
+    /// <summary>
+    /// Make a leased frame the current extended depth, copying it to a pooled buffer if
+    /// it cannot be used in place. Takes over the reference of the caller.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     SetDepthFrameLease(KinectFusionFrameLease *pLease);
+
+    /// <summary>
+    /// Release the lease on the current extended depth.
+    /// </summary>
+    void                        ReleaseDepthFrameLease();
+
+    /// <summary>
+    /// Copy BGRX color pixels into the color image.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CopyColor(const BYTE *pPixels, UINT cbPixels);
+
     /// <summary>
     /// Get the next frames from Kinect, re-synchronizing depth with color if required.
     /// </summary>
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                     GetKinectFrames(bool &integrateColor);
 
+    /// <summary>
+    /// Open the recorded session named in the parameters in place of a sensor.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     OpenReplay();
+
+    /// <summary>
+    /// Get the next frames from the recorded session.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetReplayFrames(bool &integrateColor);
+
+    /// <summary>
+    /// Time until the next frame of the recorded session is due.
+    /// </summary>
+    /// <returns>The time in milliseconds, or INFINITE when not replaying</returns>
+    DWORD                       GetReplayWaitTime();
+
+    /// <summary>
+    /// Report the replay throughput once the last frame of the recorded session is processed.
+    /// </summary>
+    void                        FinishReplay();
+
+    /// <summary>
+    /// Create the recording file named in the parameters for the connected sensor.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     OpenRecorder();
+
+    /// <summary>
+    /// Append the current depth and color frames to the recording.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     RecordFrames();
+
     /// <summary>
     /// Adjust color to the same space as depth
     /// </summary>
     /// <returns>S_OK on success, otherwise failure code</returns>
-    HRESULT                     MapColorToDepth();
+    HRESULT                     MapColorToDepth(NUI_FUSION_IMAGE_FRAME *pColorImageDepthAligned);
+
+    /// <summary>
+    /// Take a free pipeline frame for the capture stage to fill, if it does not hold one.
+    /// </summary>
+    /// <returns>true if the capture stage holds a free frame</returns>
+    bool                        AcquireCaptureFrame();
+
+    /// <summary>
+    /// Capture stage: get the next frames from Kinect and hand them to the tracking stage.
+    /// </summary>
+    void                        CaptureFrame();
+
+    /// <summary>
+    /// Convert the current depth and color into a pipeline frame and hand it to the tracking stage.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     SubmitCapturedFrame(bool colorSynchronized);
 
     /// <summary>
-    /// Handle new depth data and perform Kinect Fusion Processing.
+    /// Tracking stage: track the camera and integrate a captured frame into the volume.
     /// </summary>
-    void                        ProcessDepth();
+    void                        TrackFrame(const KinectFusionPipelineFrame &frame);
+
+    /// <summary>
+    /// Render stage: raycast and shade the volume for display.
+    /// </summary>
+    void                        RenderFrame(const KinectFusionRenderRequest &request);
 
     /// <summary>
     /// Perform camera tracking using AlignDepthFloatToReconstruction
@@ -247,6 +461,25 @@ private:
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                     TrackCameraAlignPointClouds(Matrix4 &calculatedCameraPose, FLOAT &alignmentEnergy);
 
+    /// <summary>
+    /// Down sample the depth float image to the AlignPointClouds resolution, and to half of it
+    /// for coarse to fine tracking, in one pass.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     DownsampleDepthForAlignPointClouds();
+
+    /// <summary>
+    /// Smooth a down sampled depth float image and calculate its point cloud for AlignPointClouds.
+    /// </summary>
+    /// <param name="pDepthFloatImage">The down sampled depth float image.</param>
+    /// <param name="pSmoothDepthFloatImage">Returns the smoothed depth float image.</param>
+    /// <param name="pPointCloud">Returns the point cloud of the smoothed depth.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CalculateDepthPointCloud(
+        NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+        NUI_FUSION_IMAGE_FRAME *pSmoothDepthFloatImage,
+        NUI_FUSION_IMAGE_FRAME *pPointCloud);
+
     /// <summary>
     /// Perform camera pose finding when tracking is lost using AlignPointClouds.
     /// This is typically more successful than FindCameraPoseAlignDepthFloatToReconstruction.
@@ -254,6 +487,29 @@ private:
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                     FindCameraPoseAlignPointClouds();
 
+    /// <summary>
+    /// Make sure there are enough pose proposals for relocalization.
+    /// </summary>
+    /// <param name="count">The number of proposals to be tested.</param>
+    /// <param name="createPointClouds">Whether each proposal needs its own raycast point cloud.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CreatePoseProposals(unsigned int count, bool createPointClouds);
+
+    /// <summary>
+    /// Raycast a pose from the camera pose finder into the point cloud of the proposal.
+    /// Proposals with their own point cloud may be raycast in parallel, so this does not report status.
+    /// </summary>
+    /// <param name="neighborPose">The pose from the camera pose finder.</param>
+    /// <param name="proposal">Returns the pose and the raycast result.</param>
+    void                        RaycastPoseProposal(const Matrix4 &neighborPose, KinectFusionPoseProposal &proposal);
+
+    /// <summary>
+    /// Align the depth point cloud to the raycast of a proposal.
+    /// </summary>
+    /// <param name="neighborPose">The pose from the camera pose finder.</param>
+    /// <param name="proposal">Returns the aligned pose, its alignment energy and the tracking result.</param>
+    void                        AlignPoseProposal(const Matrix4 &neighborPose, KinectFusionPoseProposal &proposal);
+
     /// <summary>
     /// Perform camera pose finding when tracking is lost using AlignDepthFloatToReconstruction.
     /// </summary>
@@ -296,11 +552,16 @@ private:
                                     bool &resampled);
 
     /// <summary>
-    /// Update data for camera pose finding and store key frame poses.
+    /// Submit the current frame to the camera pose finder worker to store as a key frame.
     /// </summary>
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                     UpdateCameraPoseFinder();
 
+    /// <summary>
+    /// Report the key frames added by the camera pose finder worker since the last call.
+    /// </summary>
+    void                        ReportCameraPoseFinderInsert();
+
     /// <summary>
     /// Store a Kinect Fusion image to a frame buffer.
     /// Accepts Depth Float, and Color image types.
@@ -326,6 +587,7 @@ private:
     void                        NotifyEmptyFrame();
 
     bool                        m_bKinectFusionInitialized;
+    bool                        m_bParamsChanged;
     bool                        m_bResetReconstruction;
     bool                        m_bResolveSensorConflict;
     bool                        m_bIntegrationResumed;
@@ -340,8 +602,33 @@ private:
     /// </summary>
     INuiFusionColorReconstruction* m_pVolume;
     HRESULT                     m_hrRecreateVolume;
+
+    /// <summary>
+    /// The native reconstruction volume, used in place of m_pVolume for CPU processing when
+    /// KinectFusionParams::m_bUseNativeCpuVolume is set. Only one of the two volumes exists.
+    /// </summary>
+    KinectFusionVolume*         m_pNativeVolume;
+
+    /// <summary>
+    /// Held by the tracking stage for a whole frame, by the render stage while it raycasts, and by
+    /// the processing thread while it recreates or resets the volume. The time the render stage
+    /// waits for it is reported as KinectFusionStageRenderWaitForVolume. Volumes which support
+    /// raycasts during updates are only held by the render stage until m_lockRenderRaycast is
+    /// taken, so the raycast overlaps the tracking and integration of the next frame.
+    /// </summary>
     CRITICAL_SECTION            m_lockVolume;
 
+    /// <summary>
+    /// Held by the render stage while it raycasts a volume without m_lockVolume, and by the
+    /// processing thread while it releases the volume. Taken after m_lockVolume.
+    /// </summary>
+    CRITICAL_SECTION            m_lockRenderRaycast;
+
+    /// <summary>
+    /// Mesher of the native volume, which caches the mesh between CalculateMesh calls.
+    /// </summary>
+    KinectFusionIncrementalMesher m_mesher;
+
     /// <summary>
     // The Kinect Fusion Camera Transform.
     /// </summary>
@@ -353,10 +640,12 @@ private:
     Matrix4                     m_defaultWorldToVolumeTransform;
 
     /// <summary>
-    /// Frames from the depth input.
+    /// Frames from the depth input. The extended depth pixels point into the leased frame,
+    /// which is held by the capture stage until the frame is handed to the tracking stage.
     /// </summary>
-    NUI_DEPTH_IMAGE_PIXEL*      m_pDepthImagePixelBuffer;
-    int                         m_cPixelBufferLength;
+    const NUI_DEPTH_IMAGE_PIXEL* m_pDepthImagePixels;
+    KinectFusionFrameLease*     m_pDepthFrameLease;
+    KinectFusionBufferPool      m_depthBufferPool;
 
     /// <summary>
     /// Frames generated from the depth input for AlignPointClouds
@@ -364,28 +653,42 @@ private:
     NUI_FUSION_IMAGE_FRAME*     m_pDownsampledDepthFloatImage;
     NUI_FUSION_IMAGE_FRAME*     m_pDownsampledSmoothDepthFloatImage;
     NUI_FUSION_IMAGE_FRAME*     m_pDownsampledDepthPointCloud;
+    KinectFusionImagePyramid    m_depthPyramid;
+
+    /// <summary>
+    /// Frames at half the AlignPointClouds resolution, created for coarse to fine tracking
+    /// </summary>
+    NUI_FUSION_IMAGE_FRAME*     m_pCoarseDepthFloatImage;
+    NUI_FUSION_IMAGE_FRAME*     m_pCoarseSmoothDepthFloatImage;
+    NUI_FUSION_IMAGE_FRAME*     m_pCoarseDepthPointCloud;
+    NUI_FUSION_IMAGE_FRAME*     m_pCoarseRaycastPointCloud;
+    KinectFusionImagePyramid    m_raycastPyramid;
 
     /// <summary>
-    /// For mapping color to depth
+    /// For mapping color to depth. The color image belongs to the capture stage, and the depth
+    /// aligned color to the tracking stage.
     /// </summary>
     NUI_FUSION_IMAGE_FRAME*     m_pColorImage;
     NUI_FUSION_IMAGE_FRAME*     m_pResampledColorImageDepthAligned;
     int                         m_cColorCoordinateBufferLength;
     NUI_COLOR_IMAGE_POINT*      m_pColorCoordinates;
+    NuiColorToDepthRemap        m_colorRemap;
     float                       m_colorToDepthDivisor;
     float                       m_oneOverDepthDivisor;
     INuiCoordinateMapper*       m_pMapper;
 
     /// <summary>
-    /// Frames generated from ray-casting the Reconstruction Volume.
+    /// Frames generated from ray-casting the Reconstruction Volume. The render point cloud
+    /// belongs to the render stage, the others to the tracking stage.
     /// </summary>
     Matrix4                     m_worldToBGRTransform;
+    NUI_FUSION_IMAGE_FRAME*     m_pRenderPointCloud;
     NUI_FUSION_IMAGE_FRAME*     m_pRaycastPointCloud;
     NUI_FUSION_IMAGE_FRAME*     m_pRaycastDepthFloatImage;
     NUI_FUSION_IMAGE_FRAME*     m_pDownsampledRaycastPointCloud;
 
     /// <summary>
-    /// Images for display.
+    /// Images for display. The shaded surfaces and the captured surface color belong to the render stage.
     /// </summary>
     NUI_FUSION_IMAGE_FRAME*     m_pDepthFloatImage;
     NUI_FUSION_IMAGE_FRAME*     m_pShadedSurface;
@@ -406,13 +709,29 @@ private:
     /// Note color will be re-sampled to the depth size if depth and color capture resolutions differ.
     /// </summary>
     INuiFusionCameraPoseFinder* m_pCameraPoseFinder;
+
+    /// <summary>
+    /// The parameters and depth resolution the camera pose finder was created with. It is kept,
+    /// with the key frames of its worker, while Kinect Fusion is re-initialized with the same ones.
+    /// </summary>
+    NUI_FUSION_CAMERA_POSE_FINDER_PARAMETERS m_cameraPoseFinderParameters;
+    NUI_IMAGE_RESOLUTION        m_cameraPoseFinderDepthResolution;
+
+    NUI_FUSION_IMAGE_FRAME*     m_pCameraPoseFinderColorImage;
     NUI_FUSION_IMAGE_FRAME*     m_pResampledColorImage;
+    KinectFusionImagePyramid    m_colorPyramid;
     NUI_FUSION_IMAGE_FRAME*     m_pDepthPointCloud;
     NUI_FUSION_IMAGE_FRAME*     m_pSmoothDepthFloatImage;
+    std::vector<KinectFusionPoseProposal> m_poseProposals;
     unsigned                    m_cSuccessfulFrameCounter;
     bool                        m_bTrackingHasFailedPreviously;
     bool                        m_bCalculateDeltaFrame;
 
+    /// <summary>
+    /// Converts the depth, residual and native volume surface images for display.
+    /// </summary>
+    KinectFusionVisualization   m_visualization;
+
     /// <summary>
     /// Frame counter and timer.
     /// </summary>
@@ -420,4 +739,79 @@ private:
     Timing::Timer               m_timer;
     double                      m_fFrameCounterStartTime;
     double                      m_fMostRecentRaycastTime;
+
+    /// <summary>
+    /// Pipeline stage threads. Frames circulate between the capture and tracking stages through the
+    /// captured and free queues, so the capture stage works on frame N+1 while frame N is tracked.
+    /// The tracking stage passes the camera pose of frames to display to the render stage.
+    /// </summary>
+    HANDLE                      m_hTrackingThread;
+    DWORD                       m_trackingThreadId;
+    HANDLE                      m_hRenderThread;
+    DWORD                       m_renderThreadId;
+    HANDLE                      m_hStopPipelineEvent;
+    HANDLE                      m_hFrameCapturedEvent;
+    HANDLE                      m_hFrameFreedEvent;
+    HANDLE                      m_hFrameTrackedEvent;
+    HANDLE                      m_hRenderRequestEvent;
+    KinectFusionPipelineFrame   m_pipelineFrames[cPipelineFrameCount];
+    KinectFusionPipelineFrame*  m_pCaptureFrame;
+    KinectFusionPipelineQueue<KinectFusionPipelineFrame*, cPipelineFrameCount> m_capturedFrames;
+    KinectFusionPipelineQueue<KinectFusionPipelineFrame*, cPipelineFrameCount> m_freeFrames;
+    KinectFusionPipelineQueue<KinectFusionRenderRequest, 2> m_renderRequests;
+    unsigned int                m_cCapturedFrames;
+    volatile LONG               m_cSubmittedFrames;
+    volatile LONG               m_cTrackedFrames;
+    bool                        m_bResetOnNextCapturedFrame;
+    bool                        m_bCaptureStalled;
+
+    /// <summary>
+    /// Time spent in each processing stage, on any thread. Snapshots are taken at each frame rate
+    /// update and written to the trace file when one is set.
+    /// </summary>
+    KinectFusionInstrumentation m_instrumentation;
+
+    /// <summary>
+    /// Adds key frames to the camera pose finder in the background while the pipeline runs, and
+    /// serializes every other use of the camera pose finder with them.
+    /// </summary>
+    KinectFusionCameraPoseFinderWorker m_cameraPoseFinderWorker;
+    bool                        m_bKeyframesLoaded;
+
+    /// <summary>
+    /// Writes snapshots of the native volume to the checkpoint file while the pipeline runs.
+    /// The volume generation counts resets and recreations of the volume, so a snapshot taken
+    /// across one is abandoned. Guarded by m_lockVolume.
+    /// </summary>
+    HANDLE                      m_hCheckpointThread;
+    DWORD                       m_checkpointThreadId;
+    KinectFusionVolumeSnapshot  m_volumeSnapshot;
+    unsigned int                m_cVolumeGeneration;
+    bool                        m_bCheckpointResumed;
+
+    /// <summary>
+    /// Shifts the native volume with the camera and stores the blocks it leaves behind.
+    /// Guarded by m_lockVolume.
+    /// </summary>
+    KinectFusionRollingVolume   m_rollingVolume;
+
+    /// <summary>
+    /// Filters each depth float frame before it is tracked. Only used by the capture thread.
+    /// </summary>
+    KinectFusionDepthFilter     m_depthFilter;
+
+    /// <summary>
+    /// Recorded session replayed in place of a sensor, and the replay progress.
+    /// </summary>
+    KinectFusionReplay*         m_pReplay;
+    UINT                        m_iReplayFrame;
+    UINT                        m_cReplayDroppedFrames;
+    LONGLONG                    m_cReplayStartTimeStamp;
+    double                      m_fReplayStartTime;
+    bool                        m_bReplayFinished;
+
+    /// <summary>
+    /// Recording of the live sensor streams.
+    /// </summary>
+    KinectFusionRecorder*       m_pRecorder;
 };
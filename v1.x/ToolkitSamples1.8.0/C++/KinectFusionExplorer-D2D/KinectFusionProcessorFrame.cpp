@@ -34,9 +34,15 @@ KinectFusionProcessorFrame::KinectFusionProcessorFrame() :
     m_cbImageSize(0),
     m_fFramesPerSecond(0),
     m_bColorCaptured(false),
-    m_deviceMemory(0)
+    m_deviceMemory(0),
+    m_cAllocatedBricks(0),
+    m_cResidentBytes(0),
+    m_cCameraPoseFinderPoses(0),
+    m_bResidualStatisticsValid(false),
+    m_fAlignmentEnergy(0)
 {
     ZeroMemory(m_statusMessage, sizeof(m_statusMessage));
+    ZeroMemory(m_stageStatistics, sizeof(m_stageStatistics));
 }
 
 /// <summary>
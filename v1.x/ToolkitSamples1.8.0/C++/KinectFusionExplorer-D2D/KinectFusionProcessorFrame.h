@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include "KinectFusionHelper.h"
+#include "KinectFusionInstrumentation.h"
+
 /// <summary>
 /// Contains the per-frame data produced by KinectFusionProcessor.
 /// </summary>
@@ -75,6 +78,27 @@ public:
     // for a given volume size has doubled. Here we return the total dedicated memory available.
     unsigned int m_deviceMemory;
 
+    // The number of voxel bricks allocated by a sparse native volume, and the host memory in
+    // bytes used by a native volume. Both are zero for the Kinect Fusion SDK volume.
+    unsigned int m_cAllocatedBricks;
+    UINT64 m_cResidentBytes;
+
+    // The number of key frames stored by the camera pose finder. The time to add and to query
+    // key frames is in m_stageStatistics.
+    unsigned int m_cCameraPoseFinderPoses;
+
+    // The alignment energy of AlignDepthFloatToReconstruction and the statistics of its residuals,
+    // including a histogram of the residuals, from the most recent frame which calculated the
+    // residual image. Compare to KinectFusionParams::m_fMaxAlignToReconstructionEnergyForSuccess.
+    // AlignPointClouds only produces a shaded residual image, so when it tracked that frame the
+    // statistics are zero and m_bResidualStatisticsValid is false.
+    bool m_bResidualStatisticsValid;
+    float m_fAlignmentEnergy;
+    DeltaFromReferenceImageStatistics m_residualStatistics;
+
+    // The time spent in each stage of the processor since the previous status update
+    KinectFusionStageStatistics m_stageStatistics[KinectFusionStageCount];
+
 private:
     /// <summary>
     /// Frees the frame buffers.
@@ -0,0 +1,545 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionRecording.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <new>
+
+// Project includes
+#include "KinectFusionRecording.h"
+
+using namespace KinectFusionRecordingFormat;
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionRecorder::KinectFusionRecorder() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_cbWritten(0)
+{
+    ZeroMemory(&m_header, sizeof(m_header));
+}
+
+/// <summary>
+/// Destructor. Completes the recording if it is still open.
+/// </summary>
+KinectFusionRecorder::~KinectFusionRecorder()
+{
+    Close();
+}
+
+/// <summary>
+/// Write a block of bytes at the end of the file.
+/// </summary>
+HRESULT KinectFusionRecorder::Write(const void *pData, DWORD cbData)
+{
+    DWORD cbWritten = 0;
+    if (!WriteFile(m_hFile, pData, cbData, &cbWritten, nullptr) || cbWritten != cbData)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_cbWritten += cbData;
+    return S_OK;
+}
+
+/// <summary>
+/// Create the recording file and write its header.
+/// </summary>
+/// <param name="szFileName">The path of the file to create.</param>
+/// <param name="depthImageResolution">The depth stream resolution.</param>
+/// <param name="colorImageResolution">The color stream resolution.</param>
+/// <param name="pMapper">The coordinate mapper of the sensor, whose parameters are stored so replay can map color to depth.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionRecorder::Open(
+    LPCWSTR szFileName,
+    NUI_IMAGE_RESOLUTION depthImageResolution,
+    NUI_IMAGE_RESOLUTION colorImageResolution,
+    INuiCoordinateMapper *pMapper)
+{
+    if (nullptr == szFileName || nullptr == pMapper)
+    {
+        return E_INVALIDARG;
+    }
+
+    Close();
+
+    ULONG cbMapperParameters = 0;
+    void *pMapperParameters = nullptr;
+
+    HRESULT hr = pMapper->GetColorToDepthRelationalParameters(&cbMapperParameters, &pMapperParameters);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DWORD depthWidth = 0, depthHeight = 0, colorWidth = 0, colorHeight = 0;
+    NuiImageResolutionToSize(depthImageResolution, depthWidth, depthHeight);
+    NuiImageResolutionToSize(colorImageResolution, colorWidth, colorHeight);
+
+    m_hFile = CreateFileW(szFileName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    ZeroMemory(&m_header, sizeof(m_header));
+    m_header.magic = Magic;
+    m_header.version = Version;
+    m_header.depthImageResolution = depthImageResolution;
+    m_header.colorImageResolution = colorImageResolution;
+    m_header.depthWidth = depthWidth;
+    m_header.depthHeight = depthHeight;
+    m_header.colorWidth = colorWidth;
+    m_header.colorHeight = colorHeight;
+    m_header.cbMapperParameters = cbMapperParameters;
+
+    m_cbWritten = 0;
+    m_index.clear();
+
+    // The frame count and index offset are filled in when the recording is closed
+    hr = Write(&m_header, sizeof(m_header));
+
+    if (SUCCEEDED(hr))
+    {
+        hr = Write(pMapperParameters, cbMapperParameters);
+    }
+
+    if (FAILED(hr))
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Append a frame to the recording.
+/// </summary>
+/// <param name="pDepthPixels">The extended depth pixels.</param>
+/// <param name="depthTimeStamp">The depth frame timestamp in milliseconds.</param>
+/// <param name="pColorPixels">The BGRX color pixels, or nullptr if no color frame was captured.</param>
+/// <param name="colorTimeStamp">The color frame timestamp in milliseconds.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionRecorder::WriteFrame(
+    const NUI_DEPTH_IMAGE_PIXEL *pDepthPixels,
+    LONGLONG depthTimeStamp,
+    const BYTE *pColorPixels,
+    LONGLONG colorTimeStamp)
+{
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pDepthPixels)
+    {
+        return E_INVALIDARG;
+    }
+
+    FrameHeader frameHeader;
+    frameHeader.depthTimeStamp = depthTimeStamp;
+    frameHeader.colorTimeStamp = colorTimeStamp;
+    frameHeader.cbDepth = m_header.depthWidth * m_header.depthHeight * sizeof(NUI_DEPTH_IMAGE_PIXEL);
+    frameHeader.cbColor = (nullptr != pColorPixels) ? m_header.colorWidth * m_header.colorHeight * sizeof(RGBQUAD) : 0;
+
+    IndexEntry indexEntry;
+    indexEntry.chunkOffset = m_cbWritten;
+    indexEntry.frameHeader = frameHeader;
+
+    try
+    {
+        m_index.push_back(indexEntry);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = Write(&frameHeader, sizeof(frameHeader));
+
+    if (SUCCEEDED(hr))
+    {
+        hr = Write(pDepthPixels, frameHeader.cbDepth);
+    }
+
+    if (SUCCEEDED(hr) && 0 != frameHeader.cbColor)
+    {
+        hr = Write(pColorPixels, frameHeader.cbColor);
+    }
+
+    if (FAILED(hr))
+    {
+        // Leave the partial chunk out of the index
+        m_index.pop_back();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Write the chunk index and close the file.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionRecorder::Close()
+{
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = S_OK;
+
+    m_header.cFrames = static_cast<UINT32>(m_index.size());
+    m_header.indexOffset = m_cbWritten;
+
+    if (!m_index.empty())
+    {
+        hr = Write(&m_index[0], static_cast<DWORD>(m_index.size() * sizeof(IndexEntry)));
+    }
+
+    // Rewrite the header with the frame count and index offset
+    if (SUCCEEDED(hr))
+    {
+        LARGE_INTEGER start = {0};
+        DWORD cbWritten = 0;
+
+        if (!SetFilePointerEx(m_hFile, start, nullptr, FILE_BEGIN)
+            || !WriteFile(m_hFile, &m_header, sizeof(m_header), &cbWritten, nullptr)
+            || sizeof(m_header) != cbWritten)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+
+    return hr;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionReplay::KinectFusionReplay() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(nullptr),
+    m_pView(nullptr),
+    m_cbFile(0),
+    m_iMappedFrame(UINT_MAX)
+{
+    ZeroMemory(&m_header, sizeof(m_header));
+    ZeroMemory(&m_mappedFrame, sizeof(m_mappedFrame));
+
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    m_allocationGranularity = systemInfo.dwAllocationGranularity;
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionReplay::~KinectFusionReplay()
+{
+    Close();
+}
+
+/// <summary>
+/// Unmap the current view and close the file.
+/// </summary>
+void KinectFusionReplay::Close()
+{
+    if (nullptr != m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = nullptr;
+    }
+
+    if (nullptr != m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_cbFile = 0;
+    m_iMappedFrame = UINT_MAX;
+    m_index.clear();
+    m_mapperParameters.clear();
+}
+
+/// <summary>
+/// Map a range of the file, unmapping the previous view.
+/// </summary>
+/// <param name="offset">The offset of the range in the file.</param>
+/// <param name="cbRange">The size of the range in bytes.</param>
+/// <returns>Pointer to the start of the range, or nullptr on failure.</returns>
+const BYTE* KinectFusionReplay::MapRange(UINT64 offset, UINT64 cbRange)
+{
+    if (offset > m_cbFile || cbRange > m_cbFile - offset || cbRange > static_cast<UINT64>(static_cast<SIZE_T>(-1)))
+    {
+        return nullptr;
+    }
+
+    if (nullptr != m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = nullptr;
+        m_iMappedFrame = UINT_MAX;
+    }
+
+    // Views must start on a multiple of the allocation granularity
+    const UINT64 viewOffset = offset - (offset % m_allocationGranularity);
+    const UINT64 cbView = cbRange + (offset - viewOffset);
+
+    m_pView = MapViewOfFile(
+        m_hMapping,
+        FILE_MAP_READ,
+        static_cast<DWORD>(viewOffset >> 32),
+        static_cast<DWORD>(viewOffset & 0xFFFFFFFF),
+        static_cast<SIZE_T>(cbView));
+
+    if (nullptr == m_pView)
+    {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const BYTE*>(m_pView) + (offset - viewOffset);
+}
+
+/// <summary>
+/// Open a recording and read its header and chunk index.
+/// </summary>
+/// <param name="szFileName">The path of the recording.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionReplay::Open(LPCWSTR szFileName)
+{
+    if (nullptr == szFileName)
+    {
+        return E_INVALIDARG;
+    }
+
+    Close();
+
+    m_hFile = CreateFileW(szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader)))
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    m_cbFile = static_cast<UINT64>(fileSize.QuadPart);
+
+    m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr == m_hMapping)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    const BYTE *pHeader = MapRange(0, sizeof(FileHeader));
+    if (nullptr == pHeader)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    m_header = *reinterpret_cast<const FileHeader*>(pHeader);
+
+    // A recording which was not closed has no index
+    if (Magic != m_header.magic
+        || (Version != m_header.version && VersionOffsetIndex != m_header.version)
+        || 0 == m_header.indexOffset)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    try
+    {
+        const BYTE *pMapperParameters = MapRange(sizeof(FileHeader), m_header.cbMapperParameters);
+        if (nullptr == pMapperParameters)
+        {
+            Close();
+            return E_FAIL;
+        }
+
+        m_mapperParameters.assign(pMapperParameters, pMapperParameters + m_header.cbMapperParameters);
+
+        const UINT64 cbIndexEntry = (VersionOffsetIndex == m_header.version) ? sizeof(UINT64) : sizeof(IndexEntry);
+        const BYTE *pIndex = MapRange(m_header.indexOffset, static_cast<UINT64>(m_header.cFrames) * cbIndexEntry);
+        if (nullptr == pIndex)
+        {
+            Close();
+            return E_FAIL;
+        }
+
+        if (VersionOffsetIndex == m_header.version)
+        {
+            HRESULT hr = ReadFrameHeaders(reinterpret_cast<const UINT64*>(pIndex));
+            if (FAILED(hr))
+            {
+                Close();
+                return hr;
+            }
+        }
+        else
+        {
+            const IndexEntry *pIndexEntries = reinterpret_cast<const IndexEntry*>(pIndex);
+            m_index.assign(pIndexEntries, pIndexEntries + m_header.cFrames);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        Close();
+        return E_OUTOFMEMORY;
+    }
+
+    // Check the chunk sizes once, so frames can be mapped with a single view
+    const UINT32 cbDepth = m_header.depthWidth * m_header.depthHeight * sizeof(NUI_DEPTH_IMAGE_PIXEL);
+    const UINT32 cbColor = m_header.colorWidth * m_header.colorHeight * sizeof(RGBQUAD);
+
+    for (size_t i = 0; i < m_index.size(); ++i)
+    {
+        const FrameHeader &frameHeader = m_index[i].frameHeader;
+
+        if (frameHeader.cbDepth != cbDepth || (0 != frameHeader.cbColor && frameHeader.cbColor != cbColor))
+        {
+            Close();
+            return E_FAIL;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Read the frame headers of a version 1 recording, whose index holds only the chunk offsets.
+/// </summary>
+/// <param name="pChunkOffsets">The chunk offsets of the index.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionReplay::ReadFrameHeaders(const UINT64 *pChunkOffsets)
+{
+    m_index.resize(m_header.cFrames);
+
+    for (UINT i = 0; i < m_header.cFrames; ++i)
+    {
+        LARGE_INTEGER chunkOffset;
+        chunkOffset.QuadPart = static_cast<LONGLONG>(pChunkOffsets[i]);
+        DWORD cbRead = 0;
+
+        if (!SetFilePointerEx(m_hFile, chunkOffset, nullptr, FILE_BEGIN)
+            || !ReadFile(m_hFile, &m_index[i].frameHeader, sizeof(FrameHeader), &cbRead, nullptr))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        if (sizeof(FrameHeader) != cbRead)
+        {
+            return E_FAIL;
+        }
+
+        m_index[i].chunkOffset = pChunkOffsets[i];
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Map a frame of the recording. The view of the previous frame is unmapped, unless it is
+/// the same frame.
+/// </summary>
+/// <param name="index">The index of the frame.</param>
+/// <param name="frame">Returns the timestamps and pixels of the frame.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionReplay::MapFrame(UINT index, KinectFusionReplayFrame &frame)
+{
+    if (index >= m_index.size())
+    {
+        return E_INVALIDARG;
+    }
+
+    if (index == m_iMappedFrame)
+    {
+        frame = m_mappedFrame;
+        return S_OK;
+    }
+
+    const IndexEntry &indexEntry = m_index[index];
+
+    // Map the whole chunk so the pixels can be read in place
+    const BYTE *pChunk = MapRange(
+        indexEntry.chunkOffset,
+        static_cast<UINT64>(sizeof(FrameHeader)) + indexEntry.frameHeader.cbDepth + indexEntry.frameHeader.cbColor);
+
+    if (nullptr == pChunk)
+    {
+        return E_FAIL;
+    }
+
+    m_mappedFrame.depthTimeStamp = indexEntry.frameHeader.depthTimeStamp;
+    m_mappedFrame.colorTimeStamp = indexEntry.frameHeader.colorTimeStamp;
+    m_mappedFrame.pDepthPixels = pChunk + sizeof(FrameHeader);
+    m_mappedFrame.cbDepth = indexEntry.frameHeader.cbDepth;
+    m_mappedFrame.pColorPixels = (0 != indexEntry.frameHeader.cbColor) ? m_mappedFrame.pDepthPixels + indexEntry.frameHeader.cbDepth : nullptr;
+    m_mappedFrame.cbColor = indexEntry.frameHeader.cbColor;
+    m_iMappedFrame = index;
+
+    frame = m_mappedFrame;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Create a coordinate mapper with the parameters of the sensor which made the recording.
+/// </summary>
+/// <param name="ppMapper">Returns the coordinate mapper.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionReplay::CreateCoordinateMapper(INuiCoordinateMapper **ppMapper)
+{
+    if (nullptr == ppMapper)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_mapperParameters.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    return NuiCreateCoordinateMapperFromParameters(
+        static_cast<ULONG>(m_mapperParameters.size()),
+        &m_mapperParameters[0],
+        ppMapper);
+}
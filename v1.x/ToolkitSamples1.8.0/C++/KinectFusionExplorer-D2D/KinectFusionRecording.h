@@ -0,0 +1,244 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionRecording.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiApi.h>
+
+/// <summary>
+/// A recorded session is a header, the color to depth coordinate mapper parameters of the
+/// sensor, one chunk per frame, and finally an index of the chunks. Each chunk is a frame header
+/// followed by the extended depth pixels and the color pixels. The index holds the file offset
+/// and a copy of the frame header of each chunk, so replay can schedule frames by their
+/// timestamps without reading the chunks.
+/// </summary>
+namespace KinectFusionRecordingFormat
+{
+    // 'KFRC' file signature
+    static const UINT32         Magic = 0x4352464B;
+    static const UINT32         Version = 2;
+
+    // Version 1 indexes hold only the file offsets of the chunks
+    static const UINT32         VersionOffsetIndex = 1;
+
+    struct FileHeader
+    {
+        UINT32                  magic;
+        UINT32                  version;
+        NUI_IMAGE_RESOLUTION    depthImageResolution;
+        NUI_IMAGE_RESOLUTION    colorImageResolution;
+        UINT32                  depthWidth;
+        UINT32                  depthHeight;
+        UINT32                  colorWidth;
+        UINT32                  colorHeight;
+        UINT32                  cbMapperParameters;
+        UINT32                  cFrames;
+        UINT64                  indexOffset;
+    };
+
+    struct FrameHeader
+    {
+        LONGLONG                depthTimeStamp;
+        LONGLONG                colorTimeStamp;
+        UINT32                  cbDepth;
+        UINT32                  cbColor;    // zero when no color frame was captured with the depth frame
+    };
+
+    struct IndexEntry
+    {
+        UINT64                  chunkOffset;
+        FrameHeader             frameHeader;
+    };
+}
+
+/// <summary>
+/// Writes the depth and color streams of a live sensor to a recorded session file.
+/// </summary>
+class KinectFusionRecorder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionRecorder();
+
+    /// <summary>
+    /// Destructor. Completes the recording if it is still open.
+    /// </summary>
+    ~KinectFusionRecorder();
+
+    /// <summary>
+    /// Create the recording file and write its header.
+    /// </summary>
+    /// <param name="szFileName">The path of the file to create.</param>
+    /// <param name="depthImageResolution">The depth stream resolution.</param>
+    /// <param name="colorImageResolution">The color stream resolution.</param>
+    /// <param name="pMapper">The coordinate mapper of the sensor, whose parameters are stored so replay can map color to depth.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Open(
+                                    LPCWSTR szFileName,
+                                    NUI_IMAGE_RESOLUTION depthImageResolution,
+                                    NUI_IMAGE_RESOLUTION colorImageResolution,
+                                    INuiCoordinateMapper *pMapper);
+
+    /// <summary>
+    /// Append a frame to the recording.
+    /// </summary>
+    /// <param name="pDepthPixels">The extended depth pixels.</param>
+    /// <param name="depthTimeStamp">The depth frame timestamp in milliseconds.</param>
+    /// <param name="pColorPixels">The BGRX color pixels, or nullptr if no color frame was captured.</param>
+    /// <param name="colorTimeStamp">The color frame timestamp in milliseconds.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     WriteFrame(
+                                    const NUI_DEPTH_IMAGE_PIXEL *pDepthPixels,
+                                    LONGLONG depthTimeStamp,
+                                    const BYTE *pColorPixels,
+                                    LONGLONG colorTimeStamp);
+
+    /// <summary>
+    /// Write the chunk index and close the file.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Close();
+
+    /// <summary>
+    /// Number of frames written so far.
+    /// </summary>
+    UINT                        GetFrameCount() const { return static_cast<UINT>(m_index.size()); }
+
+private:
+    /// <summary>
+    /// Write a block of bytes at the end of the file.
+    /// </summary>
+    HRESULT                     Write(const void *pData, DWORD cbData);
+
+    HANDLE                      m_hFile;
+    UINT64                      m_cbWritten;
+    KinectFusionRecordingFormat::FileHeader m_header;
+    std::vector<KinectFusionRecordingFormat::IndexEntry> m_index;
+};
+
+/// <summary>
+/// A frame of a recorded session, pointing into the mapped file. Valid until another frame is mapped.
+/// </summary>
+struct KinectFusionReplayFrame
+{
+    LONGLONG                    depthTimeStamp;
+    LONGLONG                    colorTimeStamp;
+    const BYTE*                 pDepthPixels;
+    UINT                        cbDepth;
+    const BYTE*                 pColorPixels;
+    UINT                        cbColor;
+};
+
+/// <summary>
+/// Reads a recorded session through a memory mapping of the file. Only the view of the
+/// current frame chunk is mapped, so sessions of any length can be replayed by 32-bit builds.
+/// The chunk index is held in memory, so timestamps are read without mapping the frames, and
+/// each chunk is mapped once however often its frame is requested in a row.
+/// </summary>
+class KinectFusionReplay
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionReplay();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionReplay();
+
+    /// <summary>
+    /// Open a recording and read its header and chunk index.
+    /// </summary>
+    /// <param name="szFileName">The path of the recording.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Open(LPCWSTR szFileName);
+
+    /// <summary>
+    /// Map a frame of the recording. The view of the previous frame is unmapped, unless it is
+    /// the same frame.
+    /// </summary>
+    /// <param name="index">The index of the frame.</param>
+    /// <param name="frame">Returns the timestamps and pixels of the frame.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     MapFrame(UINT index, KinectFusionReplayFrame &frame);
+
+    /// <summary>
+    /// Get the depth timestamp of a frame from the chunk index, without mapping the frame.
+    /// </summary>
+    /// <param name="index">The index of the frame, less than GetFrameCount.</param>
+    /// <returns>The depth frame timestamp in milliseconds</returns>
+    LONGLONG                    GetDepthTimeStamp(UINT index) const { return m_index[index].frameHeader.depthTimeStamp; }
+
+    /// <summary>
+    /// Create a coordinate mapper with the parameters of the sensor which made the recording.
+    /// </summary>
+    /// <param name="ppMapper">Returns the coordinate mapper.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CreateCoordinateMapper(INuiCoordinateMapper **ppMapper);
+
+    /// <summary>
+    /// Number of frames in the recording.
+    /// </summary>
+    UINT                        GetFrameCount() const { return static_cast<UINT>(m_index.size()); }
+
+    /// <summary>
+    /// The header of the recording.
+    /// </summary>
+    const KinectFusionRecordingFormat::FileHeader& GetHeader() const { return m_header; }
+
+private:
+    /// <summary>
+    /// Map a range of the file, unmapping the previous view.
+    /// </summary>
+    /// <param name="offset">The offset of the range in the file.</param>
+    /// <param name="cbRange">The size of the range in bytes.</param>
+    /// <returns>Pointer to the start of the range, or nullptr on failure.</returns>
+    const BYTE*                 MapRange(UINT64 offset, UINT64 cbRange);
+
+    /// <summary>
+    /// Read the frame headers of a version 1 recording, whose index holds only the chunk offsets.
+    /// </summary>
+    /// <param name="pChunkOffsets">The chunk offsets of the index.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ReadFrameHeaders(const UINT64 *pChunkOffsets);
+
+    /// <summary>
+    /// Unmap the current view and close the file.
+    /// </summary>
+    void                        Close();
+
+    HANDLE                      m_hFile;
+    HANDLE                      m_hMapping;
+    void*                       m_pView;
+    UINT64                      m_cbFile;
+    DWORD                       m_allocationGranularity;
+    KinectFusionRecordingFormat::FileHeader m_header;
+    std::vector<BYTE>           m_mapperParameters;
+    std::vector<KinectFusionRecordingFormat::IndexEntry> m_index;
+
+    // The frame whose chunk is in the current view, or UINT_MAX
+    UINT                        m_iMappedFrame;
+    KinectFusionReplayFrame     m_mappedFrame;
+};
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionReduction.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+/// <summary>
+/// A parallel reduction in the style of Concurrency::combinable, for the per-frame statistics
+/// calculated over the rows of an image. The range is split into at most cMaxPartitions
+/// contiguous parts, each accumulated by one task into its own cache line aligned slot, so tasks
+/// never write to a cache line shared with another task, and nothing is allocated per call.
+/// The slots are combined in order, so floating point sums do not depend on the scheduling.
+/// The accumulator T is zeroed by its default constructor and combined with operator+=.
+/// </summary>
+template <typename T>
+class KinectFusionReduction
+{
+public:
+    // Enough parts to balance the load over the cores of a typical host
+    static const unsigned int   cMaxPartitions = 32;
+
+    /// <summary>
+    /// Accumulate a range in parallel and combine the accumulators of its parts.
+    /// </summary>
+    /// <param name="count">The size of the range, from 0.</param>
+    /// <param name="body">Called as body(begin, end, accumulator) for each part of the range.</param>
+    /// <returns>The combined accumulator</returns>
+    template <typename Body>
+    T Reduce(unsigned int count, const Body &body)
+    {
+        unsigned int partitions = min(count, min(cMaxPartitions, 4 * Concurrency::GetProcessorCount()));
+
+        Concurrency::parallel_for(0u, partitions, [&](unsigned int partition)
+        {
+            unsigned int begin = static_cast<unsigned int>((static_cast<unsigned long long>(count) * partition) / partitions);
+            unsigned int end = static_cast<unsigned int>((static_cast<unsigned long long>(count) * (partition + 1)) / partitions);
+
+            T &accumulator = m_slots[partition].accumulator;
+            accumulator = T();
+            body(begin, end, accumulator);
+        });
+
+        T result = T();
+        for (unsigned int partition = 0; partition < partitions; ++partition)
+        {
+            result += m_slots[partition].accumulator;
+        }
+
+        return result;
+    }
+
+private:
+    // Each slot starts a cache line and is padded to whole cache lines
+    struct __declspec(align(64)) Slot
+    {
+        T                       accumulator;
+    };
+
+    Slot                        m_slots[cMaxPartitions];
+};
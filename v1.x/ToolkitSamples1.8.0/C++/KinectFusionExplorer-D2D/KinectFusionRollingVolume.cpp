@@ -0,0 +1,326 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionRollingVolume.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <new>
+#include <algorithm>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionRollingVolume.h"
+#include "KinectFusionVolumeSnapshot.h"
+#include "KinectFusionHelper.h"
+
+using namespace KinectFusionVoxel;
+using namespace KinectFusionVolumeSnapshotFormat;
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionRollingVolume::KinectFusionRollingVolume() :
+    m_cbStored(0)
+{
+    ZeroMemory(m_origin, sizeof(m_origin));
+    ZeroMemory(m_anchor, sizeof(m_anchor));
+}
+
+/// <summary>
+/// Get the point the camera looks at, in volume voxel coordinates. This is half the depth of
+/// the volume in front of the camera, the center of the volume for the default transform.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="worldToCameraTransform">The camera pose.</param>
+/// <param name="point">Returns the point.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionRollingVolume::LookAtPoint(
+    const KinectFusionVolume *pVolume,
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    const Matrix4 &worldToCameraTransform,
+    float point[3])
+{
+    Matrix4 worldToVolume;
+    HRESULT hr = pVolume->GetCurrentWorldToVolumeTransform(&worldToVolume);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const Matrix4 cameraToVolume = MultiplyMatrix4(InvertMatrix4Pose(worldToCameraTransform), worldToVolume);
+
+    // The camera looks along +z, so the third row is its direction in the volume
+    const float direction[3] = { cameraToVolume.M31, cameraToVolume.M32, cameraToVolume.M33 };
+    const float length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    if (length <= 0.0f)
+    {
+        return E_INVALIDARG;
+    }
+
+    const float distance = 0.5f * static_cast<float>(reconstructionParams.voxelCountZ) / length;
+
+    point[0] = cameraToVolume.M41 + direction[0] * distance;
+    point[1] = cameraToVolume.M42 + direction[1] * distance;
+    point[2] = cameraToVolume.M43 + direction[2] * distance;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Discard the stored blocks and anchor the volume to the camera after the volume is reset,
+/// created or loaded.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="worldToCameraTransform">The current camera pose.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionRollingVolume::Reset(
+    const KinectFusionVolume *pVolume,
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    const Matrix4 &worldToCameraTransform)
+{
+    m_store.clear();
+    m_cbStored = 0;
+    ZeroMemory(m_origin, sizeof(m_origin));
+
+    if (nullptr == pVolume)
+    {
+        return E_INVALIDARG;
+    }
+
+    return LookAtPoint(pVolume, reconstructionParams, worldToCameraTransform, m_anchor);
+}
+
+/// <summary>
+/// Get the shift which brings the point the camera looks at back to where it was when the
+/// volume was reset, once it has moved further than a distance along any axis.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="worldToCameraTransform">The current camera pose.</param>
+/// <param name="shiftDistance">The distance in meters the camera can move before the volume is shifted.</param>
+/// <param name="shift">Returns the shift of the volume along each axis, in blocks.</param>
+/// <returns>true if the volume should be shifted</returns>
+bool KinectFusionRollingVolume::GetShift(
+    const KinectFusionVolume *pVolume,
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    const Matrix4 &worldToCameraTransform,
+    float shiftDistance,
+    int shift[3]) const
+{
+    shift[0] = shift[1] = shift[2] = 0;
+
+    float point[3];
+    if (nullptr == pVolume || FAILED(LookAtPoint(pVolume, reconstructionParams, worldToCameraTransform, point)))
+    {
+        return false;
+    }
+
+    // Shifting less than a block would only move the point back and forth across a block boundary
+    const float threshold = max(shiftDistance * reconstructionParams.voxelsPerMeter, static_cast<float>(BlockSize));
+    bool bShift = false;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float offset = point[axis] - m_anchor[axis];
+        if (fabsf(offset) > threshold)
+        {
+            shift[axis] = static_cast<int>(floorf(offset / BlockSize + 0.5f));
+            bShift = true;
+        }
+    }
+
+    return bShift;
+}
+
+/// <summary>
+/// Shift the volume by whole blocks, streaming the observed blocks out to the store and the
+/// stored blocks inside the shifted volume back in.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="shift">The shift of the volume along each axis, in blocks.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionRollingVolume::Shift(
+    KinectFusionVolume *pVolume,
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    const int shift[3])
+{
+    if (nullptr == pVolume)
+    {
+        return E_INVALIDARG;
+    }
+
+    Matrix4 worldToVolume;
+    HRESULT hr = pVolume->GetCurrentWorldToVolumeTransform(&worldToVolume);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const int blockCount[3] =
+    {
+        static_cast<int>((reconstructionParams.voxelCountX + BlockSize - 1) / BlockSize),
+        static_cast<int>((reconstructionParams.voxelCountY + BlockSize - 1) / BlockSize),
+        static_cast<int>((reconstructionParams.voxelCountZ + BlockSize - 1) / BlockSize)
+    };
+
+    try
+    {
+        // Encode the observed blocks of the volume in parallel. Blocks whose voxels were never
+        // observed have no color either, so are left out
+        std::vector<UINT64> blockKeys;
+        hr = pVolume->GetStoredBlocks(blockKeys);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        std::vector<std::vector<BYTE>> encodedBlocks(blockKeys.size());
+
+        Concurrency::parallel_for(size_t(0), blockKeys.size(), [&](size_t i)
+        {
+            unsigned int voxels[cBlockVoxels];
+            unsigned int colorVoxels[cBlockVoxels];
+
+            int blockX, blockY, blockZ;
+            BlockCoordinates(blockKeys[i], blockX, blockY, blockZ);
+            pVolume->CopyVoxels(blockX * BlockSize, blockY * BlockSize, blockZ * BlockSize, BlockSize, voxels, colorVoxels);
+
+            if (IsEmpty(voxels, cBlockVoxels))
+            {
+                return;
+            }
+
+            std::vector<BYTE> &encoded = encodedBlocks[i];
+            encoded.resize(sizeof(UINT32) + 2 * MaxEncodedBytes(cBlockVoxels));
+
+            const UINT32 cbVoxels = static_cast<UINT32>(EncodeVoxels(voxels, cBlockVoxels, &encoded[sizeof(UINT32)]));
+            size_t cbEncoded = sizeof(UINT32) + cbVoxels;
+
+            if (!IsEmpty(colorVoxels, cBlockVoxels))
+            {
+                cbEncoded += EncodeVoxels(colorVoxels, cBlockVoxels, &encoded[cbEncoded]);
+            }
+
+            memcpy(&encoded[0], &cbVoxels, sizeof(cbVoxels));
+            encoded.resize(cbEncoded);
+            encoded.shrink_to_fit();
+        });
+
+        // Move the blocks to the store, replacing what was stored of them when they were last streamed out
+        for (size_t i = 0; i < blockKeys.size(); ++i)
+        {
+            if (encodedBlocks[i].empty())
+            {
+                continue;
+            }
+
+            int blockX, blockY, blockZ;
+            BlockCoordinates(blockKeys[i], blockX, blockY, blockZ);
+
+            const UINT64 worldKey = BlockKey(
+                blockX + m_origin[0] + cWorldBlockBias,
+                blockY + m_origin[1] + cWorldBlockBias,
+                blockZ + m_origin[2] + cWorldBlockBias);
+
+            std::vector<BYTE> &stored = m_store[worldKey];
+            m_cbStored += encodedBlocks[i].size();
+            m_cbStored -= stored.size();
+            stored.swap(encodedBlocks[i]);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // Move the volume in the world, which clears it
+    worldToVolume.M41 -= static_cast<float>(shift[0] * BlockSize);
+    worldToVolume.M42 -= static_cast<float>(shift[1] * BlockSize);
+    worldToVolume.M43 -= static_cast<float>(shift[2] * BlockSize);
+
+    hr = pVolume->ResetReconstruction(&worldToVolume);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        m_origin[axis] += shift[axis];
+    }
+
+    // Stream the stored blocks inside the volume back in, and remove them from the store
+    unsigned int voxels[cBlockVoxels];
+    unsigned int colorVoxels[cBlockVoxels];
+
+    std::map<UINT64, std::vector<BYTE>>::iterator it = m_store.begin();
+    while (it != m_store.end())
+    {
+        int worldX, worldY, worldZ;
+        BlockCoordinates(it->first, worldX, worldY, worldZ);
+
+        const int blockX = worldX - cWorldBlockBias - m_origin[0];
+        const int blockY = worldY - cWorldBlockBias - m_origin[1];
+        const int blockZ = worldZ - cWorldBlockBias - m_origin[2];
+
+        if (blockX < 0 || blockX >= blockCount[0]
+            || blockY < 0 || blockY >= blockCount[1]
+            || blockZ < 0 || blockZ >= blockCount[2])
+        {
+            ++it;
+            continue;
+        }
+
+        const std::vector<BYTE> &encoded = it->second;
+
+        UINT32 cbVoxels;
+        memcpy(&cbVoxels, &encoded[0], sizeof(cbVoxels));
+
+        const BYTE *pVoxelBytes = &encoded[sizeof(UINT32)];
+        const size_t cbColorVoxels = encoded.size() - sizeof(UINT32) - cbVoxels;
+        const bool bColor = cbColorVoxels > 0;
+
+        if (!DecodeVoxels(pVoxelBytes, cbVoxels, voxels, cBlockVoxels)
+            || (bColor && !DecodeVoxels(pVoxelBytes + cbVoxels, cbColorVoxels, colorVoxels, cBlockVoxels)))
+        {
+            return E_FAIL;
+        }
+
+        hr = pVolume->WriteBlock(BlockKey(blockX, blockY, blockZ), voxels, bColor ? colorVoxels : nullptr);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        m_cbStored -= encoded.size();
+        it = m_store.erase(it);
+    }
+
+    return S_OK;
+}
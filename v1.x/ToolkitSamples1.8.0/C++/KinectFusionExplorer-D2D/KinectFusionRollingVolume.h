@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionRollingVolume.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionVolume.h"
+
+/// <summary>
+/// Moves a native reconstruction volume with the camera, so the extent of a scan is not limited
+/// to the volume. When the point the camera looks at moves away from where it was when the
+/// volume was reset, the volume is shifted by whole blocks to bring it back: the observed
+/// blocks are streamed out to a host store, run length encoded as in volume snapshots, and the
+/// stored blocks which lie inside the shifted volume are streamed back in. The volume memory
+/// stays bounded while the store only holds the compressed blocks outside the volume.
+/// </summary>
+class KinectFusionRollingVolume
+{
+    static const int            cBlockVoxels = KinectFusionVoxel::BlockSize * KinectFusionVoxel::BlockSize * KinectFusionVoxel::BlockSize;
+
+    // Bias of the world block coordinates in the keys of the store, so they can be negative
+    static const int            cWorldBlockBias = 1 << 20;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionRollingVolume();
+
+    /// <summary>
+    /// Discard the stored blocks and anchor the volume to the camera after the volume is reset,
+    /// created or loaded. Call with the volume locked.
+    /// </summary>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <param name="reconstructionParams">The size and resolution of the volume.</param>
+    /// <param name="worldToCameraTransform">The current camera pose.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Reset(
+        const KinectFusionVolume *pVolume,
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        const Matrix4 &worldToCameraTransform);
+
+    /// <summary>
+    /// Get the shift which brings the point the camera looks at back to where it was when the
+    /// volume was reset, once it has moved further than a distance along any axis.
+    /// </summary>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <param name="reconstructionParams">The size and resolution of the volume.</param>
+    /// <param name="worldToCameraTransform">The current camera pose.</param>
+    /// <param name="shiftDistance">The distance in meters the camera can move before the volume is shifted.</param>
+    /// <param name="shift">Returns the shift of the volume along each axis, in blocks.</param>
+    /// <returns>true if the volume should be shifted</returns>
+    bool                        GetShift(
+        const KinectFusionVolume *pVolume,
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        const Matrix4 &worldToCameraTransform,
+        float shiftDistance,
+        int shift[3]) const;
+
+    /// <summary>
+    /// Shift the volume by whole blocks, streaming the observed blocks out to the store and the
+    /// stored blocks inside the shifted volume back in. Call with the volume locked. The volume
+    /// is reset, so every block is reported as changed.
+    /// </summary>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <param name="reconstructionParams">The size and resolution of the volume.</param>
+    /// <param name="shift">The shift of the volume along each axis, in blocks.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Shift(
+        KinectFusionVolume *pVolume,
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        const int shift[3]);
+
+    /// <summary>
+    /// The number of blocks in the store.
+    /// </summary>
+    size_t                      GetStoredBlockCount() const
+    {
+        return m_store.size();
+    }
+
+    /// <summary>
+    /// The number of bytes of encoded voxels in the store.
+    /// </summary>
+    UINT64                      GetStoredBytes() const
+    {
+        return m_cbStored;
+    }
+
+private:
+    /// <summary>
+    /// Get the point the camera looks at, in volume voxel coordinates.
+    /// </summary>
+    static HRESULT              LookAtPoint(
+        const KinectFusionVolume *pVolume,
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        const Matrix4 &worldToCameraTransform,
+        float point[3]);
+
+    // Encoded blocks outside the volume by world block key, each the byte count of the encoded
+    // voxels followed by the encoded voxels and, if any were observed, the encoded color voxels
+    std::map<UINT64, std::vector<BYTE>> m_store;
+    UINT64                      m_cbStored;
+
+    // World block coordinates of block 0 of the volume
+    int                         m_origin[3];
+
+    // The point the camera looked at when the volume was reset, in volume voxel coordinates
+    float                       m_anchor[3];
+};
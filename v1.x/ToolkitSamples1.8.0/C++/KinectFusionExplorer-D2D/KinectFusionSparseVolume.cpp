@@ -0,0 +1,992 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionSparseVolume.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <malloc.h>
+#include <new>
+#include <algorithm>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionSparseVolume.h"
+#include "KinectFusionVoxelKernels.h"
+
+using namespace KinectFusionVoxel;
+
+// Initial number of hash table slots, as a power of two
+static const unsigned int cInitialTableSlotsLog2 = 12;
+
+/// <summary>
+/// Voxel accessor of the sparse volume for the shared raycast kernel. Voxels of unallocated
+/// bricks read as zero, as if they had never been observed.
+/// </summary>
+struct SparseVoxelAccessor
+{
+    static const int    cBrickSize = KinectFusionSparseVolume::cBrickSize;
+    static const int    cBrickMask = KinectFusionSparseVolume::cBrickSize - 1;
+
+    const KinectFusionSparseVolume* pVolume;
+
+    inline unsigned int FindBrick(int x, int y, int z) const
+    {
+        return pVolume->FindBrick(KinectFusionSparseVolume::BrickKey(x / cBrickSize, y / cBrickSize, z / cBrickSize));
+    }
+
+    static inline int Offset(int x, int y, int z)
+    {
+        return (((z & cBrickMask) * cBrickSize) + (y & cBrickMask)) * cBrickSize + (x & cBrickMask);
+    }
+
+    inline unsigned int Voxel(int x, int y, int z) const
+    {
+        const unsigned int brick = FindBrick(x, y, z);
+        return (KinectFusionSparseVolume::cInvalidBrick != brick) ? pVolume->BrickVoxels(brick)[Offset(x, y, z)] : 0;
+    }
+
+    inline unsigned int ColorVoxel(int x, int y, int z) const
+    {
+        const unsigned int brick = FindBrick(x, y, z);
+        if (KinectFusionSparseVolume::cInvalidBrick == brick)
+        {
+            return 0;
+        }
+
+        const unsigned int *pColorVoxels = pVolume->BrickColorVoxels(brick);
+        return (nullptr != pColorVoxels) ? pColorVoxels[Offset(x, y, z)] : 0;
+    }
+
+    inline void Corners(int x, int y, int z, unsigned int corners[8]) const
+    {
+        // Most samples have all 8 corners in one brick and need a single lookup
+        if ((x & cBrickMask) != cBrickMask && (y & cBrickMask) != cBrickMask && (z & cBrickMask) != cBrickMask)
+        {
+            const unsigned int brick = FindBrick(x, y, z);
+            if (KinectFusionSparseVolume::cInvalidBrick == brick)
+            {
+                ZeroMemory(corners, 8 * sizeof(unsigned int));
+                return;
+            }
+
+            const unsigned int *pVoxel = pVolume->BrickVoxels(brick) + Offset(x, y, z);
+            const int strideY = cBrickSize;
+            const int strideZ = cBrickSize * cBrickSize;
+
+            corners[0] = pVoxel[0];
+            corners[1] = pVoxel[1];
+            corners[2] = pVoxel[strideY];
+            corners[3] = pVoxel[strideY + 1];
+            corners[4] = pVoxel[strideZ];
+            corners[5] = pVoxel[strideZ + 1];
+            corners[6] = pVoxel[strideZ + strideY];
+            corners[7] = pVoxel[strideZ + strideY + 1];
+            return;
+        }
+
+        for (int i = 0; i < 8; ++i)
+        {
+            corners[i] = Voxel(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2));
+        }
+    }
+
+    inline float SkipUnallocated(const float start[3], const float direction[3], float t) const
+    {
+        // The raycast tests the voxel nearest to the sample, so brick faces lie half a voxel below multiples of the brick size
+        int brick[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            brick[axis] = static_cast<int>(start[axis] + direction[axis] * t + 0.5f) / cBrickSize;
+        }
+
+        if (KinectFusionSparseVolume::cInvalidBrick != pVolume->FindBrick(KinectFusionSparseVolume::BrickKey(brick[0], brick[1], brick[2])))
+        {
+            return t;
+        }
+
+        // Continue from where the ray leaves the unallocated brick
+        float tExit = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (direction[axis] > 0.0f)
+            {
+                tExit = min(tExit, ((brick[axis] + 1) * cBrickSize - 0.5f - start[axis]) / direction[axis]);
+            }
+            else if (direction[axis] < 0.0f)
+            {
+                tExit = min(tExit, (brick[axis] * cBrickSize - 0.5f - start[axis]) / direction[axis]);
+            }
+        }
+
+        return (FLT_MAX != tExit) ? tExit + 1e-4f : t;
+    }
+};
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionSparseVolume::KinectFusionSparseVolume() :
+    m_cBricks(0),
+    m_bChangesReset(true),
+    m_tableMask(0),
+    m_tableShift(64),
+    m_frameStamp(0)
+{
+    ZeroMemory(&m_params, sizeof(m_params));
+    SetIdentityMatrix(m_worldToVolumeTransform);
+    SetIdentityMatrix(m_defaultWorldToVolumeTransform);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionSparseVolume::~KinectFusionSparseVolume()
+{
+    FreeBricks();
+}
+
+/// <summary>
+/// Release all bricks and the hash table.
+/// </summary>
+void KinectFusionSparseVolume::FreeBricks()
+{
+    for (size_t i = 0; i < m_brickBlocks.size(); ++i)
+    {
+        _aligned_free(m_brickBlocks[i]);
+
+        if (nullptr != m_colorBrickBlocks[i])
+        {
+            _aligned_free(m_colorBrickBlocks[i]);
+        }
+    }
+
+    std::vector<unsigned int*>().swap(m_brickBlocks);
+    std::vector<unsigned int*>().swap(m_colorBrickBlocks);
+    std::vector<UINT64>().swap(m_brickKeys);
+    std::vector<unsigned int>().swap(m_brickFrameStamps);
+    std::vector<unsigned char>().swap(m_brickChanged);
+    std::vector<UINT64>().swap(m_tableKeys);
+    std::vector<unsigned int>().swap(m_tableBricks);
+
+    m_cBricks = 0;
+    m_tableMask = 0;
+    m_tableShift = 64;
+}
+
+/// <summary>
+/// Set up the volume. No voxel storage is allocated until frames are integrated.
+/// </summary>
+/// <param name="reconstructionParams">The extent and resolution of the volume. The voxel counts must be multiples of 8.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::Initialize(const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams)
+{
+    // Brick coordinates are packed into 21 bits per axis in the hash key
+    const UINT maxVoxelCount = cBrickSize << 21;
+
+    if (reconstructionParams.voxelsPerMeter <= 0.0f
+        || 0 == reconstructionParams.voxelCountX || reconstructionParams.voxelCountX >= maxVoxelCount
+        || 0 == reconstructionParams.voxelCountY || reconstructionParams.voxelCountY >= maxVoxelCount
+        || 0 == reconstructionParams.voxelCountZ || reconstructionParams.voxelCountZ >= maxVoxelCount
+        || 0 != reconstructionParams.voxelCountX % cBrickSize
+        || 0 != reconstructionParams.voxelCountY % cBrickSize
+        || 0 != reconstructionParams.voxelCountZ % cBrickSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_params = reconstructionParams;
+
+    // Match the default world to volume transform of the Kinect Fusion SDK volume: the
+    // camera sits at the center of the front face of the volume, looking along +z
+    SetIdentityMatrix(m_defaultWorldToVolumeTransform);
+    m_defaultWorldToVolumeTransform.M11 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M22 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M33 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M41 = static_cast<float>(m_params.voxelCountX / 2);
+    m_defaultWorldToVolumeTransform.M42 = static_cast<float>(m_params.voxelCountY / 2);
+    m_defaultWorldToVolumeTransform.M43 = 0.0f;
+
+    return ResetReconstruction(nullptr);
+}
+
+/// <summary>
+/// Allocate an empty hash table with the given number of slots.
+/// </summary>
+/// <param name="cSlotsLog2">Log2 of the number of slots.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::CreateTable(unsigned int cSlotsLog2)
+{
+    const size_t cSlots = static_cast<size_t>(1) << cSlotsLog2;
+
+    try
+    {
+        std::vector<UINT64>(cSlots, 0).swap(m_tableKeys);
+        std::vector<unsigned int>(cSlots, cInvalidBrick).swap(m_tableBricks);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_tableMask = cSlots - 1;
+    m_tableShift = 64 - cSlotsLog2;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Release all bricks and optionally set a new world to volume transform.
+/// </summary>
+/// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::ResetReconstruction(const Matrix4 *pWorldToVolumeTransform)
+{
+    if (m_params.voxelsPerMeter <= 0.0f)
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_worldToVolumeTransform = (nullptr != pWorldToVolumeTransform) ? *pWorldToVolumeTransform : m_defaultWorldToVolumeTransform;
+
+    FreeBricks();
+    m_bChangesReset = true;
+
+    return CreateTable(cInitialTableSlotsLog2);
+}
+
+/// <summary>
+/// Get the current world to volume transform.
+/// </summary>
+/// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const
+{
+    if (nullptr == pWorldToVolumeTransform)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pWorldToVolumeTransform = m_worldToVolumeTransform;
+    return S_OK;
+}
+
+/// <summary>
+/// Number of bytes of host memory currently allocated by the volume.
+/// </summary>
+UINT64 KinectFusionSparseVolume::GetResidentBytes() const
+{
+    const UINT64 blockBytes = static_cast<UINT64>(cBricksPerBlock) * cBrickVoxels * sizeof(unsigned int);
+
+    UINT64 bytes = 0;
+    for (size_t i = 0; i < m_brickBlocks.size(); ++i)
+    {
+        bytes += blockBytes;
+
+        if (nullptr != m_colorBrickBlocks[i])
+        {
+            bytes += blockBytes;
+        }
+    }
+
+    bytes += m_brickKeys.capacity() * sizeof(UINT64);
+    bytes += m_brickFrameStamps.capacity() * sizeof(unsigned int);
+    bytes += m_brickChanged.capacity();
+    bytes += m_tableKeys.capacity() * sizeof(UINT64);
+    bytes += m_tableBricks.capacity() * sizeof(unsigned int);
+
+    return bytes;
+}
+
+/// <summary>
+/// Number of bricks currently allocated.
+/// </summary>
+unsigned int KinectFusionSparseVolume::GetAllocatedBrickCount() const
+{
+    return m_cBricks;
+}
+
+/// <summary>
+/// Find a brick, allocating it if it does not exist yet.
+/// </summary>
+/// <param name="key">The key of the brick.</param>
+/// <param name="brick">Returns the index of the brick.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::FindOrAllocateBrick(UINT64 key, unsigned int &brick)
+{
+    UINT64 slot = HashSlot(key);
+    while (0 != m_tableKeys[slot])
+    {
+        if (key == m_tableKeys[slot])
+        {
+            brick = m_tableBricks[slot];
+            return S_OK;
+        }
+
+        slot = (slot + 1) & m_tableMask;
+    }
+
+    // Keep the table at most half full so probe sequences stay short
+    if ((static_cast<UINT64>(m_cBricks) + 1) * 2 > m_tableMask + 1)
+    {
+        std::vector<UINT64> oldKeys;
+        std::vector<unsigned int> oldBricks;
+        oldKeys.swap(m_tableKeys);
+        oldBricks.swap(m_tableBricks);
+
+        HRESULT hr = CreateTable(64 - m_tableShift + 1);
+        if (FAILED(hr))
+        {
+            oldKeys.swap(m_tableKeys);
+            oldBricks.swap(m_tableBricks);
+            return hr;
+        }
+
+        for (size_t i = 0; i < oldKeys.size(); ++i)
+        {
+            if (0 != oldKeys[i])
+            {
+                UINT64 newSlot = HashSlot(oldKeys[i]);
+                while (0 != m_tableKeys[newSlot])
+                {
+                    newSlot = (newSlot + 1) & m_tableMask;
+                }
+
+                m_tableKeys[newSlot] = oldKeys[i];
+                m_tableBricks[newSlot] = oldBricks[i];
+            }
+        }
+
+        slot = HashSlot(key);
+        while (0 != m_tableKeys[slot])
+        {
+            slot = (slot + 1) & m_tableMask;
+        }
+    }
+
+    if (0 == m_cBricks % cBricksPerBlock)
+    {
+        const size_t blockBytes = static_cast<size_t>(cBricksPerBlock) * cBrickVoxels * sizeof(unsigned int);
+
+        unsigned int *pBlock = reinterpret_cast<unsigned int*>(_aligned_malloc(blockBytes, 16));
+        if (nullptr == pBlock)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        ZeroMemory(pBlock, blockBytes);
+
+        // Color storage for the block is allocated when color is next integrated
+        m_brickBlocks.push_back(pBlock);
+        m_colorBrickBlocks.push_back(nullptr);
+    }
+
+    brick = m_cBricks++;
+
+    m_brickKeys.push_back(key);
+    m_brickFrameStamps.push_back(0);
+    m_brickChanged.push_back(0);
+
+    m_tableKeys[slot] = key;
+    m_tableBricks[slot] = brick;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Allocate color storage for every brick block which does not have it yet.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::AllocateColorBlocks()
+{
+    const size_t blockBytes = static_cast<size_t>(cBricksPerBlock) * cBrickVoxels * sizeof(unsigned int);
+
+    for (size_t i = 0; i < m_colorBrickBlocks.size(); ++i)
+    {
+        if (nullptr == m_colorBrickBlocks[i])
+        {
+            m_colorBrickBlocks[i] = reinterpret_cast<unsigned int*>(_aligned_malloc(blockBytes, 16));
+            if (nullptr == m_colorBrickBlocks[i])
+            {
+                return E_OUTOFMEMORY;
+            }
+
+            ZeroMemory(m_colorBrickBlocks[i], blockBytes);
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Allocate the bricks within the truncation band of a depth float frame, then integrate
+/// the frame, and optionally a depth aligned color frame, into them.
+/// </summary>
+/// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+/// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+/// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+/// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::IntegrateFrame(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+    USHORT maxIntegrationWeight,
+    const Matrix4 *pWorldToCameraTransform)
+{
+    HRESULT hr = S_OK;
+
+    if (m_tableKeys.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pDepthFloatFrame || nullptr == pDepthFloatFrame->pFrameTexture || nullptr == pWorldToCameraTransform
+        || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr != pColorFrame
+        && (nullptr == pColorFrame->pFrameTexture
+        || NUI_FUSION_IMAGE_TYPE_COLOR != pColorFrame->imageType
+        || pColorFrame->width != pDepthFloatFrame->width
+        || pColorFrame->height != pDepthFloatFrame->height))
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_LOCKED_RECT depthLockedRect;
+    hr = pDepthFloatFrame->pFrameTexture->LockRect(0, &depthLockedRect, nullptr, 0);
+    if (FAILED(hr) || depthLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    NUI_LOCKED_RECT colorLockedRect;
+    colorLockedRect.pBits = nullptr;
+    colorLockedRect.Pitch = 0;
+
+    if (nullptr != pColorFrame)
+    {
+        hr = pColorFrame->pFrameTexture->LockRect(0, &colorLockedRect, nullptr, 0);
+        if (FAILED(hr) || colorLockedRect.Pitch == 0)
+        {
+            pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+            return E_NOINTERFACE;
+        }
+    }
+
+    IntegrationFrame frame;
+    frame.pDepth = depthLockedRect.pBits;
+    frame.depthPitch = depthLockedRect.Pitch;
+    frame.pColor = colorLockedRect.pBits;
+    frame.colorPitch = colorLockedRect.Pitch;
+    frame.width = static_cast<int>(pDepthFloatFrame->width);
+    frame.height = static_cast<int>(pDepthFloatFrame->height);
+    frame.maxWeight = static_cast<float>(max(maxIntegrationWeight, static_cast<USHORT>(1)));
+    frame.maxColorWeight = min(static_cast<unsigned int>(frame.maxWeight), 255u);
+    GetFrameIntrinsics(pDepthFloatFrame, frame.flx, frame.fly, frame.ppx, frame.ppy);
+
+    const Matrix4 cameraToVolume = MultiplyMatrix4(InvertMatrix4Pose(*pWorldToCameraTransform), m_worldToVolumeTransform);
+    const Matrix4 volumeToCamera = MultiplyMatrix4(InvertMatrix4Affine(m_worldToVolumeTransform), *pWorldToCameraTransform);
+
+    const int brickCountX = static_cast<int>(m_params.voxelCountX) / cBrickSize;
+    const int brickCountY = static_cast<int>(m_params.voxelCountY) / cBrickSize;
+    const int brickCountZ = static_cast<int>(m_params.voxelCountZ) / cBrickSize;
+
+    try
+    {
+        m_rowBrickKeys.resize(frame.height);
+
+        // Collect the bricks crossed by each depth ray within the truncation band of its surface,
+        // sampled at half brick intervals so no brick along the band is missed
+        Concurrency::parallel_for(0, frame.height, [&](int y)
+        {
+            std::vector<UINT64> &rowKeys = m_rowBrickKeys[y];
+            rowKeys.clear();
+
+            const float *pDepthRow = reinterpret_cast<const float*>(frame.pDepth + (y * frame.depthPitch));
+            const float rayY = (static_cast<float>(y) - frame.ppy) / frame.fly;
+
+            for (int x = 0; x < frame.width; ++x)
+            {
+                const float depth = pDepthRow[x];
+                if (depth < MinimumDepth)
+                {
+                    continue;
+                }
+
+                Vector3 cameraRay;
+                cameraRay.x = (static_cast<float>(x) - frame.ppx) / frame.flx;
+                cameraRay.y = rayY;
+                cameraRay.z = 1.0f;
+
+                Vector3 nearPoint = cameraRay;
+                nearPoint.x *= depth - TruncationDistance;
+                nearPoint.y *= depth - TruncationDistance;
+                nearPoint.z *= depth - TruncationDistance;
+
+                Vector3 farPoint = cameraRay;
+                farPoint.x *= depth + TruncationDistance;
+                farPoint.y *= depth + TruncationDistance;
+                farPoint.z *= depth + TruncationDistance;
+
+                const Vector3 begin = transform(nearPoint, cameraToVolume);
+                const Vector3 end = transform(farPoint, cameraToVolume);
+
+                Vector3 segment;
+                segment.x = end.x - begin.x;
+                segment.y = end.y - begin.y;
+                segment.z = end.z - begin.z;
+
+                const float length = sqrtf(dot_normalized(segment, segment));
+                const int cSteps = static_cast<int>(length * 2.0f / cBrickSize) + 1;
+
+                UINT64 lastKey = 0;
+                for (int step = 0; step <= cSteps; ++step)
+                {
+                    const float s = static_cast<float>(step) / cSteps;
+                    const int brickX = static_cast<int>(floorf((begin.x + segment.x * s) / cBrickSize));
+                    const int brickY = static_cast<int>(floorf((begin.y + segment.y * s) / cBrickSize));
+                    const int brickZ = static_cast<int>(floorf((begin.z + segment.z * s) / cBrickSize));
+
+                    if (brickX < 0 || brickX >= brickCountX || brickY < 0 || brickY >= brickCountY || brickZ < 0 || brickZ >= brickCountZ)
+                    {
+                        continue;
+                    }
+
+                    const UINT64 key = BrickKey(brickX, brickY, brickZ);
+                    if (key != lastKey)
+                    {
+                        rowKeys.push_back(key);
+                        lastKey = key;
+                    }
+                }
+            }
+
+            // Neighboring pixels mostly cross the same bricks
+            std::sort(rowKeys.begin(), rowKeys.end());
+            rowKeys.erase(std::unique(rowKeys.begin(), rowKeys.end()), rowKeys.end());
+        });
+
+        // Allocate the bricks serially, stamping each so it is integrated once
+        ++m_frameStamp;
+        m_frameBricks.clear();
+
+        for (int y = 0; y < frame.height && SUCCEEDED(hr); ++y)
+        {
+            const std::vector<UINT64> &rowKeys = m_rowBrickKeys[y];
+            for (size_t i = 0; i < rowKeys.size(); ++i)
+            {
+                unsigned int brick;
+                hr = FindOrAllocateBrick(rowKeys[i], brick);
+                if (FAILED(hr))
+                {
+                    break;
+                }
+
+                if (m_frameStamp != m_brickFrameStamps[brick])
+                {
+                    m_brickFrameStamps[brick] = m_frameStamp;
+                    m_frameBricks.push_back(brick);
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    if (SUCCEEDED(hr) && nullptr != pColorFrame)
+    {
+        hr = AllocateColorBlocks();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        const bool integrateColor = nullptr != pColorFrame;
+
+        Concurrency::parallel_for(static_cast<size_t>(0), m_frameBricks.size(), [&](size_t i)
+        {
+            const unsigned int brick = m_frameBricks[i];
+
+            int originX, originY, originZ;
+            BlockCoordinates(m_brickKeys[brick], originX, originY, originZ);
+            originX *= cBrickSize;
+            originY *= cBrickSize;
+            originZ *= cBrickSize;
+
+            unsigned int *pVoxels = BrickVoxels(brick);
+            unsigned int *pColorVoxels = integrateColor ? BrickColorVoxels(brick) : nullptr;
+
+            for (int z = 0; z < cBrickSize; ++z)
+            {
+                for (int y = 0; y < cBrickSize; ++y)
+                {
+                    const int offset = ((z * cBrickSize) + y) * cBrickSize;
+
+                    IntegrateVoxelRun(
+                        frame,
+                        volumeToCamera,
+                        originX,
+                        originY + y,
+                        originZ + z,
+                        cBrickSize,
+                        0,
+                        cBrickSize - 1,
+                        pVoxels + offset,
+                        (nullptr != pColorVoxels) ? pColorVoxels + offset : nullptr,
+                        &m_brickChanged[brick]);
+                }
+            }
+        });
+    }
+
+    if (nullptr != pColorFrame)
+    {
+        pColorFrame->pFrameTexture->UnlockRect(0);
+    }
+
+    pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+
+    return hr;
+}
+
+/// <summary>
+/// Raycast the volume from the given camera pose, skipping unallocated bricks.
+/// </summary>
+/// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+/// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+/// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+/// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::CalculatePointCloudAndDepth(
+    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+    const Matrix4 *pWorldToCameraTransform)
+{
+    HRESULT hr = S_OK;
+
+    if (m_tableKeys.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pPointCloudFrame || nullptr == pPointCloudFrame->pFrameTexture || nullptr == pWorldToCameraTransform
+        || NUI_FUSION_IMAGE_TYPE_POINT_CLOUD != pPointCloudFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    const unsigned int width = pPointCloudFrame->width;
+    const unsigned int height = pPointCloudFrame->height;
+
+    if ((nullptr != pDepthFloatFrame
+        && (nullptr == pDepthFloatFrame->pFrameTexture || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType
+        || width != pDepthFloatFrame->width || height != pDepthFloatFrame->height))
+        || (nullptr != pColorFrame
+        && (nullptr == pColorFrame->pFrameTexture || NUI_FUSION_IMAGE_TYPE_COLOR != pColorFrame->imageType
+        || width != pColorFrame->width || height != pColorFrame->height)))
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_LOCKED_RECT pointCloudLockedRect;
+    hr = pPointCloudFrame->pFrameTexture->LockRect(0, &pointCloudLockedRect, nullptr, 0);
+    if (FAILED(hr) || pointCloudLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    NUI_LOCKED_RECT depthLockedRect;
+    depthLockedRect.pBits = nullptr;
+    depthLockedRect.Pitch = 0;
+
+    NUI_LOCKED_RECT colorLockedRect;
+    colorLockedRect.pBits = nullptr;
+    colorLockedRect.Pitch = 0;
+
+    if (nullptr != pDepthFloatFrame)
+    {
+        hr = pDepthFloatFrame->pFrameTexture->LockRect(0, &depthLockedRect, nullptr, 0);
+        if (FAILED(hr) || depthLockedRect.Pitch == 0)
+        {
+            pPointCloudFrame->pFrameTexture->UnlockRect(0);
+            return E_NOINTERFACE;
+        }
+    }
+
+    if (nullptr != pColorFrame)
+    {
+        hr = pColorFrame->pFrameTexture->LockRect(0, &colorLockedRect, nullptr, 0);
+        if (FAILED(hr) || colorLockedRect.Pitch == 0)
+        {
+            if (nullptr != pDepthFloatFrame)
+            {
+                pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+            }
+
+            pPointCloudFrame->pFrameTexture->UnlockRect(0);
+            return E_NOINTERFACE;
+        }
+    }
+
+    RaycastFrame frame;
+    frame.pPointCloud = pointCloudLockedRect.pBits;
+    frame.pointCloudPitch = pointCloudLockedRect.Pitch;
+    frame.pDepth = depthLockedRect.pBits;
+    frame.depthPitch = depthLockedRect.Pitch;
+    frame.pColor = colorLockedRect.pBits;
+    frame.colorPitch = colorLockedRect.Pitch;
+    frame.width = width;
+    frame.height = height;
+    frame.voxelsPerMeter = m_params.voxelsPerMeter;
+    frame.hasColor = nullptr != pColorFrame;
+    GetFrameIntrinsics(pPointCloudFrame, frame.flx, frame.fly, frame.ppx, frame.ppy);
+
+    // Trilinear sampling and central differences need one voxel either side of the sample
+    frame.boxMin[0] = frame.boxMin[1] = frame.boxMin[2] = 1.0f;
+    frame.boxMax[0] = static_cast<float>(m_params.voxelCountX) - 2.001f;
+    frame.boxMax[1] = static_cast<float>(m_params.voxelCountY) - 2.001f;
+    frame.boxMax[2] = static_cast<float>(m_params.voxelCountZ) - 2.001f;
+
+    SparseVoxelAccessor volume;
+    volume.pVolume = this;
+
+    RaycastVolume(volume, frame, m_worldToVolumeTransform, *pWorldToCameraTransform);
+
+    if (nullptr != pColorFrame)
+    {
+        pColorFrame->pFrameTexture->UnlockRect(0);
+    }
+
+    if (nullptr != pDepthFloatFrame)
+    {
+        pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+    }
+
+    pPointCloudFrame->pFrameTexture->UnlockRect(0);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Get the bricks whose signed distance or color changed since the last call, and start
+/// collecting changes again. Bricks are the blocks in which changes are tracked.
+/// </summary>
+/// <param name="blockKeys">Returns the key of each changed brick.</param>
+/// <param name="bReset">Returns true if the volume was reset since the last call.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset)
+{
+    if (m_tableKeys.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    blockKeys.clear();
+
+    try
+    {
+        for (unsigned int brick = 0; brick < m_cBricks; ++brick)
+        {
+            if (0 != m_brickChanged[brick])
+            {
+                blockKeys.push_back(m_brickKeys[brick]);
+                m_brickChanged[brick] = 0;
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    bReset = m_bChangesReset;
+    m_bChangesReset = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume or in
+/// unallocated bricks read as zero.
+/// </summary>
+/// <param name="x">The x coordinate of the first voxel of the box.</param>
+/// <param name="y">The y coordinate of the first voxel of the box.</param>
+/// <param name="z">The z coordinate of the first voxel of the box.</param>
+/// <param name="size">The number of voxels along each edge of the box.</param>
+/// <param name="pVoxels">Returns the voxels of the box.</param>
+/// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+void KinectFusionSparseVolume::CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const
+{
+    const size_t boxBytes = static_cast<size_t>(size) * size * size * sizeof(unsigned int);
+
+    ZeroMemory(pVoxels, boxBytes);
+    if (nullptr != pColorVoxels)
+    {
+        ZeroMemory(pColorVoxels, boxBytes);
+    }
+
+    if (m_tableKeys.empty())
+    {
+        return;
+    }
+
+    const int voxelCountX = static_cast<int>(m_params.voxelCountX);
+    const int voxelCountY = static_cast<int>(m_params.voxelCountY);
+    const int voxelCountZ = static_cast<int>(m_params.voxelCountZ);
+
+    for (int boxZ = 0; boxZ < size; ++boxZ)
+    {
+        const int voxelZ = z + boxZ;
+        if (voxelZ < 0 || voxelZ >= voxelCountZ)
+        {
+            continue;
+        }
+
+        for (int boxY = 0; boxY < size; ++boxY)
+        {
+            const int voxelY = y + boxY;
+            if (voxelY < 0 || voxelY >= voxelCountY)
+            {
+                continue;
+            }
+
+            // Copy the row a brick at a time
+            int voxelX = max(x, 0);
+            const int xEnd = min(x + size, voxelCountX);
+
+            while (voxelX < xEnd)
+            {
+                const int runEnd = min((voxelX / cBrickSize + 1) * cBrickSize, xEnd);
+                const unsigned int brick = FindBrick(BrickKey(voxelX / cBrickSize, voxelY / cBrickSize, voxelZ / cBrickSize));
+
+                if (cInvalidBrick != brick)
+                {
+                    const int brickOffset = (((voxelZ % cBrickSize) * cBrickSize) + (voxelY % cBrickSize)) * cBrickSize + (voxelX % cBrickSize);
+                    const size_t boxIndex = ((static_cast<size_t>(boxZ) * size) + boxY) * size + (voxelX - x);
+                    const size_t runBytes = (runEnd - voxelX) * sizeof(unsigned int);
+
+                    CopyMemory(pVoxels + boxIndex, BrickVoxels(brick) + brickOffset, runBytes);
+
+                    const unsigned int *pBrickColorVoxels = BrickColorVoxels(brick);
+                    if (nullptr != pColorVoxels && nullptr != pBrickColorVoxels)
+                    {
+                        CopyMemory(pColorVoxels + boxIndex, pBrickColorVoxels + brickOffset, runBytes);
+                    }
+                }
+
+                voxelX = runEnd;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Get the blocks which may hold observed voxels, which are the allocated bricks.
+/// </summary>
+/// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::GetStoredBlocks(std::vector<UINT64> &blockKeys) const
+{
+    if (m_tableKeys.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    try
+    {
+        blockKeys.assign(m_brickKeys.begin(), m_brickKeys.begin() + m_cBricks);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Overwrite the voxels of a block, ordered x fastest, then y, then z. Blocks are bricks, and
+/// a brick is allocated for each block written.
+/// </summary>
+/// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+/// <param name="pVoxels">The voxels of the block.</param>
+/// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionSparseVolume::WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels)
+{
+    if (m_tableKeys.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    int brickX, brickY, brickZ;
+    KinectFusionVoxel::BlockCoordinates(blockKey, brickX, brickY, brickZ);
+
+    if (nullptr == pVoxels
+        || brickX >= static_cast<int>(m_params.voxelCountX) / cBrickSize
+        || brickY >= static_cast<int>(m_params.voxelCountY) / cBrickSize
+        || brickZ >= static_cast<int>(m_params.voxelCountZ) / cBrickSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = S_OK;
+    unsigned int brick = cInvalidBrick;
+
+    try
+    {
+        hr = FindOrAllocateBrick(blockKey, brick);
+    }
+    catch (const std::bad_alloc&)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    if (SUCCEEDED(hr) && nullptr != pColorVoxels)
+    {
+        hr = AllocateColorBlocks();
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    CopyMemory(BrickVoxels(brick), pVoxels, cBrickVoxels * sizeof(unsigned int));
+
+    if (nullptr != pColorVoxels)
+    {
+        CopyMemory(BrickColorVoxels(brick), pColorVoxels, cBrickVoxels * sizeof(unsigned int));
+    }
+
+    m_brickChanged[brick] = 1;
+
+    return S_OK;
+}
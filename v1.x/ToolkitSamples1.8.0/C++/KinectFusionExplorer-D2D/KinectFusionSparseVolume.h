@@ -0,0 +1,264 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionSparseVolume.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionVolume.h"
+
+/// <summary>
+/// Sparse TSDF reconstruction volume integrated and raycast on the host CPU. Voxels are stored
+/// in 8x8x8 bricks allocated on demand around the observed surfaces and found through a spatial
+/// hash, so the voxel counts of the reconstruction parameters only bound the addressable extent
+/// and memory grows with the scanned surface area rather than the volume of the scene.
+/// </summary>
+class KinectFusionSparseVolume : public KinectFusionVolume
+{
+public:
+    // Number of voxels along each edge of a brick
+    static const int            cBrickSize = 8;
+    static const int            cBrickVoxels = cBrickSize * cBrickSize * cBrickSize;
+
+    // Number of bricks allocated at a time
+    static const unsigned int   cBricksPerBlock = 256;
+
+    // Brick index returned for bricks which are not allocated
+    static const unsigned int   cInvalidBrick = 0xFFFFFFFF;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionSparseVolume();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionSparseVolume();
+
+    /// <summary>
+    /// Set up the volume. No voxel storage is allocated until frames are integrated.
+    /// </summary>
+    /// <param name="reconstructionParams">The extent and resolution of the volume. The voxel counts must be multiples of 8.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Initialize(const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams);
+
+    /// <summary>
+    /// Release all bricks and optionally set a new world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ResetReconstruction(const Matrix4 *pWorldToVolumeTransform);
+
+    /// <summary>
+    /// Get the current world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const;
+
+    /// <summary>
+    /// Allocate the bricks within the truncation band of a depth float frame, then integrate
+    /// the frame, and optionally a depth aligned color frame, into them.
+    /// </summary>
+    /// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+    /// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+    /// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     IntegrateFrame(
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    USHORT maxIntegrationWeight,
+                                    const Matrix4 *pWorldToCameraTransform);
+
+    /// <summary>
+    /// Raycast the volume from the given camera pose, skipping unallocated bricks.
+    /// </summary>
+    /// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+    /// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+    /// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CalculatePointCloudAndDepth(
+                                    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    const Matrix4 *pWorldToCameraTransform);
+
+    /// <summary>
+    /// Number of bytes of host memory currently allocated by the volume.
+    /// </summary>
+    UINT64                      GetResidentBytes() const;
+
+    /// <summary>
+    /// Raycasts only read the voxels, so several may run at once.
+    /// </summary>
+    bool                        SupportsConcurrentRaycasts() const { return true; }
+
+    /// <summary>
+    /// Number of bricks currently allocated.
+    /// </summary>
+    unsigned int                GetAllocatedBrickCount() const;
+
+    /// <summary>
+    /// Get the bricks whose signed distance or color changed since the last call, and start
+    /// collecting changes again. Bricks are the blocks in which changes are tracked.
+    /// </summary>
+    /// <param name="blockKeys">Returns the key of each changed brick.</param>
+    /// <param name="bReset">Returns true if the volume was reset since the last call.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset);
+
+    /// <summary>
+    /// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume or in
+    /// unallocated bricks read as zero.
+    /// </summary>
+    /// <param name="x">The x coordinate of the first voxel of the box.</param>
+    /// <param name="y">The y coordinate of the first voxel of the box.</param>
+    /// <param name="z">The z coordinate of the first voxel of the box.</param>
+    /// <param name="size">The number of voxels along each edge of the box.</param>
+    /// <param name="pVoxels">Returns the voxels of the box.</param>
+    /// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+    void                        CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const;
+
+    /// <summary>
+    /// Get the blocks which may hold observed voxels.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetStoredBlocks(std::vector<UINT64> &blockKeys) const;
+
+    /// <summary>
+    /// Overwrite the voxels of a block, ordered x fastest, then y, then z. Blocks are bricks, and a brick is allocated for each block written.
+    /// </summary>
+    /// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+    /// <param name="pVoxels">The voxels of the block.</param>
+    /// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels);
+
+    /// <summary>
+    /// Find an allocated brick.
+    /// </summary>
+    /// <param name="key">The key of the brick.</param>
+    /// <returns>The index of the brick, or cInvalidBrick if it is not allocated.</returns>
+    inline unsigned int         FindBrick(UINT64 key) const
+    {
+        UINT64 slot = HashSlot(key);
+        while (0 != m_tableKeys[slot])
+        {
+            if (key == m_tableKeys[slot])
+            {
+                return m_tableBricks[slot];
+            }
+
+            slot = (slot + 1) & m_tableMask;
+        }
+
+        return cInvalidBrick;
+    }
+
+    /// <summary>
+    /// Get the voxels of an allocated brick, ordered x fastest, then y, then z.
+    /// </summary>
+    inline unsigned int*        BrickVoxels(unsigned int brick) const
+    {
+        return m_brickBlocks[brick / cBricksPerBlock] + ((brick % cBricksPerBlock) * cBrickVoxels);
+    }
+
+    /// <summary>
+    /// Get the color voxels of an allocated brick, or nullptr if no color has been integrated.
+    /// </summary>
+    inline unsigned int*        BrickColorVoxels(unsigned int brick) const
+    {
+        unsigned int *pBlock = m_colorBrickBlocks[brick / cBricksPerBlock];
+        return (nullptr != pBlock) ? pBlock + ((brick % cBricksPerBlock) * cBrickVoxels) : nullptr;
+    }
+
+    /// <summary>
+    /// Get the hash key of the brick with the given brick coordinates. Keys are never zero.
+    /// </summary>
+    static inline UINT64        BrickKey(int brickX, int brickY, int brickZ)
+    {
+        static_assert(cBrickSize == KinectFusionVoxel::BlockSize, "Bricks are the blocks in which changes are tracked.");
+        return KinectFusionVoxel::BlockKey(brickX, brickY, brickZ);
+    }
+
+private:
+    /// <summary>
+    /// Release all bricks and the hash table.
+    /// </summary>
+    void                        FreeBricks();
+
+    /// <summary>
+    /// Get the first hash table slot to probe for a key.
+    /// </summary>
+    inline UINT64               HashSlot(UINT64 key) const
+    {
+        return (key * 0x9E3779B97F4A7C15ull) >> m_tableShift;
+    }
+
+    /// <summary>
+    /// Allocate an empty hash table with the given number of slots.
+    /// </summary>
+    /// <param name="cSlotsLog2">Log2 of the number of slots.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CreateTable(unsigned int cSlotsLog2);
+
+    /// <summary>
+    /// Find a brick, allocating it if it does not exist yet.
+    /// </summary>
+    /// <param name="key">The key of the brick.</param>
+    /// <param name="brick">Returns the index of the brick.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     FindOrAllocateBrick(UINT64 key, unsigned int &brick);
+
+    /// <summary>
+    /// Allocate color storage for every brick block which does not have it yet.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     AllocateColorBlocks();
+
+    // Brick storage, allocated cBricksPerBlock bricks at a time
+    std::vector<unsigned int*>  m_brickBlocks;
+    std::vector<unsigned int*>  m_colorBrickBlocks;
+    std::vector<UINT64>         m_brickKeys;
+    std::vector<unsigned int>   m_brickFrameStamps;
+    std::vector<unsigned char>  m_brickChanged;
+    unsigned int                m_cBricks;
+    bool                        m_bChangesReset;
+
+    // Open addressing hash table from brick key to brick index, kept at most half full
+    std::vector<UINT64>         m_tableKeys;
+    std::vector<unsigned int>   m_tableBricks;
+    UINT64                      m_tableMask;
+    unsigned int                m_tableShift;
+
+    // Scratch lists of the bricks touched by the frame being integrated
+    std::vector<std::vector<UINT64>> m_rowBrickKeys;
+    std::vector<unsigned int>   m_frameBricks;
+    unsigned int                m_frameStamp;
+
+    NUI_FUSION_RECONSTRUCTION_PARAMETERS m_params;
+    Matrix4                     m_worldToVolumeTransform;
+    Matrix4                     m_defaultWorldToVolumeTransform;
+};
@@ -0,0 +1,1038 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionTiledVolume.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <new>
+#include <algorithm>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionTiledVolume.h"
+#include "KinectFusionCpuVolume.h"
+#include "KinectFusionSparseVolume.h"
+#include "KinectFusionVoxelKernels.h"
+
+using namespace KinectFusionVoxel;
+
+namespace
+{
+    /// <summary>
+    /// Create a frame with the camera parameters of another frame, or recreate it when its type
+    /// or size has changed.
+    /// </summary>
+    HRESULT CreateFrameLike(
+        NUI_FUSION_IMAGE_TYPE frameType,
+        const NUI_FUSION_IMAGE_FRAME *pLikeFrame,
+        NUI_FUSION_IMAGE_FRAME **ppImageFrame)
+    {
+        if (nullptr != *ppImageFrame &&
+            ((*ppImageFrame)->width != pLikeFrame->width || (*ppImageFrame)->height != pLikeFrame->height || (*ppImageFrame)->imageType != frameType))
+        {
+            SAFE_FUSION_RELEASE_IMAGE_FRAME(*ppImageFrame);
+        }
+
+        if (nullptr == *ppImageFrame)
+        {
+            return NuiFusionCreateImageFrame(frameType, pLikeFrame->width, pLikeFrame->height, pLikeFrame->pCameraParameters, ppImageFrame);
+        }
+
+        // The raycast projects with the intrinsics of its frames
+        if (nullptr != (*ppImageFrame)->pCameraParameters && nullptr != pLikeFrame->pCameraParameters)
+        {
+            *(*ppImageFrame)->pCameraParameters = *pLikeFrame->pCameraParameters;
+        }
+
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Unlock the frames of a merge which were locked.
+    /// </summary>
+    void UnlockFrames(const NUI_FUSION_IMAGE_FRAME * const *ppFrames, const NUI_LOCKED_RECT *pLockedRects, unsigned int count)
+    {
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            if (nullptr != ppFrames[i] && nullptr != pLockedRects[i].pBits)
+            {
+                ppFrames[i]->pFrameTexture->UnlockRect(0);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionTiledVolume::KinectFusionTiledVolume() :
+    m_cPendingTiles(0),
+    m_cIntegratedTiles(0),
+    m_job(TileJobIntegrate),
+    m_pJobDepthFloat(nullptr),
+    m_pJobColor(nullptr),
+    m_jobMaxIntegrationWeight(0)
+{
+    m_hStopEvent = CreateEvent(
+        nullptr,
+        TRUE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+    m_hDoneEvent = CreateEvent(
+        nullptr,
+        FALSE, /* bManualReset */ 
+        FALSE, /* bInitialState */
+        nullptr);
+
+    ZeroMemory(&m_params, sizeof(m_params));
+    SetIdentityMatrix(m_jobWorldToCameraTransform);
+    SetIdentityMatrix(m_worldToVolumeTransform);
+    SetIdentityMatrix(m_defaultWorldToVolumeTransform);
+}
+
+/// <summary>
+/// Destructor, stopping the worker threads
+/// </summary>
+KinectFusionTiledVolume::~KinectFusionTiledVolume()
+{
+    FreeTiles();
+
+    if (nullptr != m_hStopEvent)
+    {
+        CloseHandle(m_hStopEvent);
+    }
+    if (nullptr != m_hDoneEvent)
+    {
+        CloseHandle(m_hDoneEvent);
+    }
+}
+
+/// <summary>
+/// Stop the worker threads and release the tiles.
+/// </summary>
+void KinectFusionTiledVolume::FreeTiles()
+{
+    if (nullptr != m_hStopEvent)
+    {
+        SetEvent(m_hStopEvent);
+    }
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        Tile &tile = m_tiles[i];
+
+        if (nullptr != tile.hThread)
+        {
+            WaitForSingleObject(tile.hThread, INFINITE);
+            CloseHandle(tile.hThread);
+        }
+        if (nullptr != tile.hWorkEvent)
+        {
+            CloseHandle(tile.hWorkEvent);
+        }
+
+        SAFE_DELETE(tile.pVolume);
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(tile.pPointCloud);
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(tile.pDepthFloat);
+        SAFE_FUSION_RELEASE_IMAGE_FRAME(tile.pColor);
+    }
+
+    m_tiles.clear();
+    m_workerStarts.clear();
+}
+
+/// <summary>
+/// Allocate the tiles and start their worker threads.
+/// </summary>
+/// <param name="reconstructionParams">The size and resolution of the whole volume. voxelCountX
+/// must be a multiple of 8 with at least one block per tile, and with sparse tiles so must
+/// voxelCountY and voxelCountZ.</param>
+/// <param name="tileCount">The number of tiles, between 1 and cMaxTiles.</param>
+/// <param name="bSparse">Whether the tiles are KinectFusionSparseVolume, otherwise KinectFusionCpuVolume.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::Initialize(
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    unsigned int tileCount,
+    bool bSparse)
+{
+    const unsigned int blockCountX = reconstructionParams.voxelCountX / BlockSize;
+
+    if (reconstructionParams.voxelsPerMeter <= 0.0f
+        || 0 != reconstructionParams.voxelCountX % BlockSize
+        || 0 == tileCount
+        || tileCount > cMaxTiles
+        || blockCountX < tileCount)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr == m_hStopEvent || nullptr == m_hDoneEvent)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    FreeTiles();
+
+    m_params = reconstructionParams;
+
+    try
+    {
+        m_tiles.resize(tileCount);
+        m_workerStarts.resize(tileCount);
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_tiles.clear();
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory(&m_tiles[0], tileCount * sizeof(Tile));
+
+    const int voxelCountX = static_cast<int>(m_params.voxelCountX);
+    HRESULT hr = S_OK;
+
+    for (unsigned int i = 0; i < tileCount && SUCCEEDED(hr); ++i)
+    {
+        Tile &tile = m_tiles[i];
+
+        // Whole blocks are divided evenly between the tiles
+        tile.ownedStartX = static_cast<int>(i * blockCountX / tileCount) * BlockSize;
+        tile.ownedEndX = static_cast<int>((i + 1) * blockCountX / tileCount) * BlockSize;
+        tile.storedStartX = max(tile.ownedStartX - cTileOverlap, 0);
+        tile.storedEndX = min(tile.ownedEndX + cTileOverlap, voxelCountX);
+
+        NUI_FUSION_RECONSTRUCTION_PARAMETERS tileParams = m_params;
+        tileParams.voxelCountX = static_cast<unsigned int>(tile.storedEndX - tile.storedStartX);
+
+        if (bSparse)
+        {
+            KinectFusionSparseVolume *pSparseVolume = new(std::nothrow) KinectFusionSparseVolume();
+            tile.pVolume = pSparseVolume;
+            hr = (nullptr != pSparseVolume) ? pSparseVolume->Initialize(tileParams) : E_OUTOFMEMORY;
+        }
+        else
+        {
+            KinectFusionCpuVolume *pCpuVolume = new(std::nothrow) KinectFusionCpuVolume();
+            tile.pVolume = pCpuVolume;
+            hr = (nullptr != pCpuVolume) ? pCpuVolume->Initialize(tileParams) : E_OUTOFMEMORY;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            tile.hWorkEvent = CreateEvent(
+                nullptr,
+                FALSE, /* bManualReset */ 
+                FALSE, /* bInitialState */
+                nullptr);
+
+            hr = (nullptr != tile.hWorkEvent) ? S_OK : E_OUTOFMEMORY;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ResetEvent(m_hStopEvent);
+
+        for (unsigned int i = 0; i < tileCount && SUCCEEDED(hr); ++i)
+        {
+            m_workerStarts[i].pVolume = this;
+            m_workerStarts[i].tile = i;
+
+            m_tiles[i].hThread = CreateThread(nullptr, 0, ThreadProc, &m_workerStarts[i], 0, nullptr);
+            if (nullptr == m_tiles[i].hThread)
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        FreeTiles();
+        return hr;
+    }
+
+    // The default transform of the whole volume, as set by KinectFusionCpuVolume
+    SetIdentityMatrix(m_defaultWorldToVolumeTransform);
+    m_defaultWorldToVolumeTransform.M11 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M22 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M33 = m_params.voxelsPerMeter;
+    m_defaultWorldToVolumeTransform.M41 = static_cast<float>(m_params.voxelCountX / 2);
+    m_defaultWorldToVolumeTransform.M42 = static_cast<float>(m_params.voxelCountY / 2);
+    m_defaultWorldToVolumeTransform.M43 = 0.0f;
+
+    return ResetReconstruction(nullptr);
+}
+
+/// <summary>
+/// Worker thread procedure
+/// </summary>
+DWORD WINAPI KinectFusionTiledVolume::ThreadProc(LPVOID lpParameter)
+{
+    WorkerStart *pStart = reinterpret_cast<WorkerStart*>(lpParameter);
+    return pStart->pVolume->WorkerLoop(pStart->tile);
+}
+
+/// <summary>
+/// Run the jobs given to a tile until stopped.
+/// </summary>
+DWORD KinectFusionTiledVolume::WorkerLoop(unsigned int tileIndex)
+{
+    Tile &tile = m_tiles[tileIndex];
+    HANDLE handles[] = { m_hStopEvent, tile.hWorkEvent };
+
+    for (;;)
+    {
+        DWORD waitResult = WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE);
+        if (WAIT_OBJECT_0 + 1 != waitResult)
+        {
+            break;
+        }
+
+        if (TileJobIntegrate == m_job)
+        {
+            tile.hr = tile.pVolume->IntegrateFrame(
+                m_pJobDepthFloat,
+                m_pJobColor,
+                m_jobMaxIntegrationWeight,
+                &m_jobWorldToCameraTransform);
+        }
+        else
+        {
+            tile.hr = tile.pVolume->CalculatePointCloudAndDepth(
+                tile.pPointCloud,
+                tile.pDepthFloat,
+                tile.pColor,
+                &m_jobWorldToCameraTransform);
+        }
+
+        // The last tile to finish wakes the caller
+        if (0 == InterlockedDecrement(&m_cPendingTiles))
+        {
+            SetEvent(m_hDoneEvent);
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Give the current job to the active tiles and wait until they have all finished it.
+/// </summary>
+/// <returns>S_OK on success, otherwise the failure code of a tile</returns>
+HRESULT KinectFusionTiledVolume::RunActiveTiles()
+{
+    LONG cActive = 0;
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].bActive)
+        {
+            m_tiles[i].hr = S_OK;
+            ++cActive;
+        }
+    }
+
+    if (0 == cActive)
+    {
+        return S_OK;
+    }
+
+    m_cPendingTiles = cActive;
+    ResetEvent(m_hDoneEvent);
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].bActive)
+        {
+            SetEvent(m_tiles[i].hWorkEvent);
+        }
+    }
+
+    WaitForSingleObject(m_hDoneEvent, INFINITE);
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].bActive && FAILED(m_tiles[i].hr))
+        {
+            return m_tiles[i].hr;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Mark the tiles which intersect the camera frustum up to a depth as active. A tile is
+/// outside the frustum when all the corners of its box are outside the same plane.
+/// </summary>
+/// <param name="pFrame">The frame whose intrinsics and size define the frustum.</param>
+/// <param name="worldToCameraTransform">The camera pose.</param>
+/// <param name="farDepth">The far plane of the frustum, or zero for none.</param>
+/// <returns>The number of active tiles</returns>
+unsigned int KinectFusionTiledVolume::SelectTilesInView(
+    const NUI_FUSION_IMAGE_FRAME *pFrame,
+    const Matrix4 &worldToCameraTransform,
+    float farDepth)
+{
+    static const unsigned int cPlanes = 6;
+
+    float flx, fly, ppx, ppy;
+    GetFrameIntrinsics(pFrame, flx, fly, ppx, ppy);
+
+    const float maxU = static_cast<float>(pFrame->width - 1);
+    const float maxV = static_cast<float>(pFrame->height - 1);
+    const Matrix4 volumeToCamera = MultiplyMatrix4(InvertMatrix4Affine(m_worldToVolumeTransform), worldToCameraTransform);
+
+    const float cornerY[2] = { 0.0f, static_cast<float>(m_params.voxelCountY) };
+    const float cornerZ[2] = { 0.0f, static_cast<float>(m_params.voxelCountZ) };
+
+    unsigned int cActive = 0;
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        Tile &tile = m_tiles[i];
+        const float cornerX[2] = { static_cast<float>(tile.storedStartX), static_cast<float>(tile.storedEndX) };
+
+        bool bInside[cPlanes] = { false, farDepth <= 0.0f, false, false, false, false };
+
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const float vx = cornerX[corner & 1];
+            const float vy = cornerY[(corner >> 1) & 1];
+            const float vz = cornerZ[corner >> 2];
+
+            const float cx = volumeToCamera.M41 + (volumeToCamera.M11 * vx) + (volumeToCamera.M21 * vy) + (volumeToCamera.M31 * vz);
+            const float cy = volumeToCamera.M42 + (volumeToCamera.M12 * vx) + (volumeToCamera.M22 * vy) + (volumeToCamera.M32 * vz);
+            const float cz = volumeToCamera.M43 + (volumeToCamera.M13 * vx) + (volumeToCamera.M23 * vy) + (volumeToCamera.M33 * vz);
+
+            // The same constraints as the integration clips its rows to
+            bInside[0] |= cz >= MinimumDepth;
+            bInside[1] |= cz <= farDepth;
+            bInside[2] |= flx * cx + ppx * cz >= 0.0f;
+            bInside[3] |= (maxU - ppx) * cz - flx * cx >= 0.0f;
+            bInside[4] |= fly * cy + ppy * cz >= 0.0f;
+            bInside[5] |= (maxV - ppy) * cz - fly * cy >= 0.0f;
+        }
+
+        tile.bActive = true;
+        for (unsigned int plane = 0; plane < cPlanes; ++plane)
+        {
+            tile.bActive = tile.bActive && bInside[plane];
+        }
+
+        if (tile.bActive)
+        {
+            ++cActive;
+        }
+    }
+
+    return cActive;
+}
+
+/// <summary>
+/// The tile which owns the voxels at an x coordinate.
+/// </summary>
+unsigned int KinectFusionTiledVolume::OwnerTile(int x) const
+{
+    const unsigned int cTiles = static_cast<unsigned int>(m_tiles.size());
+    const unsigned int blockCountX = m_params.voxelCountX / BlockSize;
+    const int blockX = min(max(x / BlockSize, 0), static_cast<int>(blockCountX) - 1);
+
+    // Inverse of the division of blocks in Initialize, corrected for rounding
+    unsigned int tile = min(static_cast<unsigned int>(blockX) * cTiles / blockCountX, cTiles - 1);
+    while (tile > 0 && x < m_tiles[tile].ownedStartX)
+    {
+        --tile;
+    }
+    while (tile + 1 < cTiles && x >= m_tiles[tile].ownedEndX)
+    {
+        ++tile;
+    }
+
+    return tile;
+}
+
+/// <summary>
+/// The world to volume transform of a tile, offset from the transform of the whole volume.
+/// </summary>
+Matrix4 KinectFusionTiledVolume::TileTransform(const Tile &tile) const
+{
+    Matrix4 tileTransform = m_worldToVolumeTransform;
+    tileTransform.M41 -= static_cast<float>(tile.storedStartX);
+    return tileTransform;
+}
+
+/// <summary>
+/// Clear the volume and optionally set a new world to volume transform.
+/// </summary>
+/// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::ResetReconstruction(const Matrix4 *pWorldToVolumeTransform)
+{
+    if (m_tiles.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_worldToVolumeTransform = (nullptr != pWorldToVolumeTransform) ? *pWorldToVolumeTransform : m_defaultWorldToVolumeTransform;
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        const Matrix4 tileTransform = TileTransform(m_tiles[i]);
+
+        HRESULT hr = m_tiles[i].pVolume->ResetReconstruction(&tileTransform);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Get the current world to volume transform.
+/// </summary>
+/// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const
+{
+    if (nullptr == pWorldToVolumeTransform)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pWorldToVolumeTransform = m_worldToVolumeTransform;
+    return S_OK;
+}
+
+/// <summary>
+/// Number of bytes of host memory currently allocated by the tiles.
+/// </summary>
+UINT64 KinectFusionTiledVolume::GetResidentBytes() const
+{
+    UINT64 bytes = 0;
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        bytes += m_tiles[i].pVolume->GetResidentBytes();
+    }
+
+    return bytes;
+}
+
+/// <summary>
+/// Number of voxel bricks currently allocated by sparse tiles.
+/// </summary>
+unsigned int KinectFusionTiledVolume::GetAllocatedBrickCount() const
+{
+    unsigned int cBricks = 0;
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        cBricks += m_tiles[i].pVolume->GetAllocatedBrickCount();
+    }
+
+    return cBricks;
+}
+
+/// <summary>
+/// Integrate a depth float frame, and optionally a depth aligned color frame, into the tiles in view.
+/// </summary>
+/// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+/// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+/// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+/// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::IntegrateFrame(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+    USHORT maxIntegrationWeight,
+    const Matrix4 *pWorldToCameraTransform)
+{
+    if (m_tiles.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pDepthFloatFrame || nullptr == pDepthFloatFrame->pFrameTexture || nullptr == pWorldToCameraTransform
+        || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_LOCKED_RECT depthLockedRect;
+    HRESULT hr = pDepthFloatFrame->pFrameTexture->LockRect(0, &depthLockedRect, nullptr, 0);
+    if (FAILED(hr) || depthLockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    // Tiles beyond the furthest depth pixel plus the truncation distance cannot be updated
+    const float maxDepth = FindMaxDepth(depthLockedRect.pBits, depthLockedRect.Pitch,
+        static_cast<int>(pDepthFloatFrame->width), static_cast<int>(pDepthFloatFrame->height));
+
+    pDepthFloatFrame->pFrameTexture->UnlockRect(0);
+
+    m_cIntegratedTiles = 0;
+    if (maxDepth <= 0.0f)
+    {
+        return S_OK;
+    }
+
+    m_cIntegratedTiles = SelectTilesInView(pDepthFloatFrame, *pWorldToCameraTransform, maxDepth + TruncationDistance);
+
+    m_job = TileJobIntegrate;
+    m_pJobDepthFloat = pDepthFloatFrame;
+    m_pJobColor = pColorFrame;
+    m_jobMaxIntegrationWeight = maxIntegrationWeight;
+    m_jobWorldToCameraTransform = *pWorldToCameraTransform;
+
+    return RunActiveTiles();
+}
+
+/// <summary>
+/// Raycast the tiles in view from the given camera pose, keeping the nearest surface of each pixel.
+/// </summary>
+/// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+/// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+/// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+/// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::CalculatePointCloudAndDepth(
+    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+    const Matrix4 *pWorldToCameraTransform)
+{
+    if (m_tiles.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (nullptr == pPointCloudFrame || nullptr == pPointCloudFrame->pFrameTexture || nullptr == pWorldToCameraTransform
+        || NUI_FUSION_IMAGE_TYPE_POINT_CLOUD != pPointCloudFrame->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    const unsigned int cActive = SelectTilesInView(pPointCloudFrame, *pWorldToCameraTransform, 0.0f);
+
+    // A single tile in view raycasts straight into the frames, which also clears them when none is
+    if (cActive <= 1)
+    {
+        size_t active = 0;
+        while (active + 1 < m_tiles.size() && !m_tiles[active].bActive)
+        {
+            ++active;
+        }
+
+        return m_tiles[active].pVolume->CalculatePointCloudAndDepth(pPointCloudFrame, pDepthFloatFrame, pColorFrame, pWorldToCameraTransform);
+    }
+
+    if ((nullptr != pDepthFloatFrame
+        && (nullptr == pDepthFloatFrame->pFrameTexture || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatFrame->imageType
+        || pPointCloudFrame->width != pDepthFloatFrame->width || pPointCloudFrame->height != pDepthFloatFrame->height))
+        || (nullptr != pColorFrame
+        && (nullptr == pColorFrame->pFrameTexture || NUI_FUSION_IMAGE_TYPE_COLOR != pColorFrame->imageType
+        || pPointCloudFrame->width != pColorFrame->width || pPointCloudFrame->height != pColorFrame->height)))
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = S_OK;
+
+    // Each tile needs its depth to merge by, and its color only if the caller wants the color
+    for (size_t i = 0; i < m_tiles.size() && SUCCEEDED(hr); ++i)
+    {
+        Tile &tile = m_tiles[i];
+        if (!tile.bActive)
+        {
+            continue;
+        }
+
+        hr = CreateFrameLike(NUI_FUSION_IMAGE_TYPE_POINT_CLOUD, pPointCloudFrame, &tile.pPointCloud);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = CreateFrameLike(NUI_FUSION_IMAGE_TYPE_FLOAT, pPointCloudFrame, &tile.pDepthFloat);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            if (nullptr != pColorFrame)
+            {
+                hr = CreateFrameLike(NUI_FUSION_IMAGE_TYPE_COLOR, pPointCloudFrame, &tile.pColor);
+            }
+            else
+            {
+                SAFE_FUSION_RELEASE_IMAGE_FRAME(tile.pColor);
+            }
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_job = TileJobRaycast;
+    m_jobWorldToCameraTransform = *pWorldToCameraTransform;
+
+    hr = RunActiveTiles();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Lock the destination frames followed by the point cloud, depth and color of each active tile
+    static const unsigned int cFramesPerTile = 3;
+    const NUI_FUSION_IMAGE_FRAME *frames[cFramesPerTile * (cMaxTiles + 1)];
+    NUI_LOCKED_RECT lockedRects[cFramesPerTile * (cMaxTiles + 1)];
+    unsigned int cFrames = 0;
+
+    frames[cFrames++] = pPointCloudFrame;
+    frames[cFrames++] = pDepthFloatFrame;
+    frames[cFrames++] = pColorFrame;
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].bActive)
+        {
+            frames[cFrames++] = m_tiles[i].pPointCloud;
+            frames[cFrames++] = m_tiles[i].pDepthFloat;
+            frames[cFrames++] = m_tiles[i].pColor;
+        }
+    }
+
+    for (unsigned int i = 0; i < cFrames; ++i)
+    {
+        lockedRects[i].pBits = nullptr;
+        lockedRects[i].Pitch = 0;
+
+        if (nullptr != frames[i] && SUCCEEDED(hr))
+        {
+            hr = frames[i]->pFrameTexture->LockRect(0, &lockedRects[i], nullptr, 0);
+            if (FAILED(hr) || lockedRects[i].Pitch == 0)
+            {
+                lockedRects[i].pBits = nullptr;
+                hr = E_NOINTERFACE;
+            }
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        UnlockFrames(frames, lockedRects, cFrames);
+        return hr;
+    }
+
+    const unsigned int width = pPointCloudFrame->width;
+    const unsigned int pointBytes = 6 * sizeof(float);
+
+    Concurrency::parallel_for(0u, pPointCloudFrame->height, [&](unsigned int y)
+    {
+        BYTE *pPointRow = lockedRects[0].pBits + (y * lockedRects[0].Pitch);
+        float *pDepthRow = (nullptr != pDepthFloatFrame) ? reinterpret_cast<float*>(lockedRects[1].pBits + (y * lockedRects[1].Pitch)) : nullptr;
+        unsigned int *pColorRow = (nullptr != pColorFrame) ? reinterpret_cast<unsigned int*>(lockedRects[2].pBits + (y * lockedRects[2].Pitch)) : nullptr;
+
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            // The nearest surface of the tiles, misses have zero depth
+            unsigned int nearest = 0;
+            float nearestDepth = FLT_MAX;
+
+            for (unsigned int frame = cFramesPerTile; frame < cFrames; frame += cFramesPerTile)
+            {
+                const float depth = reinterpret_cast<const float*>(lockedRects[frame + 1].pBits + (y * lockedRects[frame + 1].Pitch))[x];
+                if (depth > 0.0f && depth < nearestDepth)
+                {
+                    nearest = frame;
+                    nearestDepth = depth;
+                }
+            }
+
+            if (0 == nearest)
+            {
+                ZeroMemory(pPointRow + (x * pointBytes), pointBytes);
+                if (nullptr != pDepthRow)
+                {
+                    pDepthRow[x] = 0.0f;
+                }
+                if (nullptr != pColorRow)
+                {
+                    pColorRow[x] = 0;
+                }
+                continue;
+            }
+
+            CopyMemory(pPointRow + (x * pointBytes), lockedRects[nearest].pBits + (y * lockedRects[nearest].Pitch) + (x * pointBytes), pointBytes);
+            if (nullptr != pDepthRow)
+            {
+                pDepthRow[x] = nearestDepth;
+            }
+            if (nullptr != pColorRow)
+            {
+                pColorRow[x] = reinterpret_cast<const unsigned int*>(lockedRects[nearest + 2].pBits + (y * lockedRects[nearest + 2].Pitch))[x];
+            }
+        }
+    });
+
+    UnlockFrames(frames, lockedRects, cFrames);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Get the blocks whose signed distance or color changed since the last call, and start
+/// collecting changes again. Each tile reports the changes of the blocks it owns.
+/// </summary>
+/// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each changed block.</param>
+/// <param name="bReset">Returns true if the volume was reset since the last call.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset)
+{
+    if (m_tiles.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    blockKeys.clear();
+    bReset = false;
+
+    std::vector<UINT64> tileKeys;
+
+    try
+    {
+        for (size_t i = 0; i < m_tiles.size(); ++i)
+        {
+            const Tile &tile = m_tiles[i];
+
+            bool bTileReset = false;
+            HRESULT hr = tile.pVolume->TakeChangedBlocks(tileKeys, bTileReset);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            bReset = bReset || bTileReset;
+
+            for (size_t key = 0; key < tileKeys.size(); ++key)
+            {
+                int blockX, blockY, blockZ;
+                BlockCoordinates(tileKeys[key], blockX, blockY, blockZ);
+
+                const int x = (blockX * BlockSize) + tile.storedStartX;
+                if (x >= tile.ownedStartX && x < tile.ownedEndX)
+                {
+                    blockKeys.push_back(BlockKey(x / BlockSize, blockY, blockZ));
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume read as
+/// zero. Each column of the box is copied from the tile which owns it.
+/// </summary>
+/// <param name="x">The x coordinate of the first voxel of the box.</param>
+/// <param name="y">The y coordinate of the first voxel of the box.</param>
+/// <param name="z">The z coordinate of the first voxel of the box.</param>
+/// <param name="size">The number of voxels along each edge of the box.</param>
+/// <param name="pVoxels">Returns the voxels of the box.</param>
+/// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+void KinectFusionTiledVolume::CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const
+{
+    const size_t boxVoxels = static_cast<size_t>(size) * size * size;
+
+    if (m_tiles.empty())
+    {
+        ZeroMemory(pVoxels, boxVoxels * sizeof(unsigned int));
+        if (nullptr != pColorVoxels)
+        {
+            ZeroMemory(pColorVoxels, boxVoxels * sizeof(unsigned int));
+        }
+        return;
+    }
+
+    const int voxelCountX = static_cast<int>(m_params.voxelCountX);
+    const unsigned int firstTile = OwnerTile(max(x, 0));
+    const unsigned int lastTile = OwnerTile(min(x + size, voxelCountX) - 1);
+
+    // Boxes the owner tile stores whole, such as blocks, are copied directly; the tiles at the
+    // ends of the volume also read voxels outside the volume as zero
+    const Tile &owner = m_tiles[firstTile];
+    if (firstTile == lastTile
+        && (x >= owner.storedStartX || 0 == owner.storedStartX)
+        && (x + size <= owner.storedEndX || voxelCountX == owner.storedEndX))
+    {
+        owner.pVolume->CopyVoxels(x - owner.storedStartX, y, z, size, pVoxels, pColorVoxels);
+        return;
+    }
+
+    ZeroMemory(pVoxels, boxVoxels * sizeof(unsigned int));
+    if (nullptr != pColorVoxels)
+    {
+        ZeroMemory(pColorVoxels, boxVoxels * sizeof(unsigned int));
+    }
+
+    std::vector<unsigned int> tileVoxels;
+    std::vector<unsigned int> tileColorVoxels;
+
+    try
+    {
+        tileVoxels.resize(boxVoxels);
+        if (nullptr != pColorVoxels)
+        {
+            tileColorVoxels.resize(boxVoxels);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        // The box reads as never observed
+        return;
+    }
+
+    for (unsigned int i = firstTile; i <= lastTile; ++i)
+    {
+        const Tile &tile = m_tiles[i];
+
+        tile.pVolume->CopyVoxels(x - tile.storedStartX, y, z, size, &tileVoxels[0], (nullptr != pColorVoxels) ? &tileColorVoxels[0] : nullptr);
+
+        // Take the columns of the box which the tile owns
+        const int boxBegin = max(tile.ownedStartX, x) - x;
+        const int boxEnd = min(tile.ownedEndX, x + size) - x;
+        const size_t rowBytes = (boxEnd - boxBegin) * sizeof(unsigned int);
+
+        for (size_t row = 0; row < static_cast<size_t>(size) * size; ++row)
+        {
+            const size_t index = (row * size) + boxBegin;
+
+            CopyMemory(pVoxels + index, &tileVoxels[index], rowBytes);
+            if (nullptr != pColorVoxels)
+            {
+                CopyMemory(pColorVoxels + index, &tileColorVoxels[index], rowBytes);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Get the blocks which may hold observed voxels, from the tile which owns each block.
+/// </summary>
+/// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::GetStoredBlocks(std::vector<UINT64> &blockKeys) const
+{
+    if (m_tiles.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    blockKeys.clear();
+
+    std::vector<UINT64> tileKeys;
+
+    try
+    {
+        for (size_t i = 0; i < m_tiles.size(); ++i)
+        {
+            const Tile &tile = m_tiles[i];
+
+            HRESULT hr = tile.pVolume->GetStoredBlocks(tileKeys);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            for (size_t key = 0; key < tileKeys.size(); ++key)
+            {
+                int blockX, blockY, blockZ;
+                BlockCoordinates(tileKeys[key], blockX, blockY, blockZ);
+
+                const int x = (blockX * BlockSize) + tile.storedStartX;
+                if (x >= tile.ownedStartX && x < tile.ownedEndX)
+                {
+                    blockKeys.push_back(BlockKey(x / BlockSize, blockY, blockZ));
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Overwrite the voxels of a block in every tile which stores it, so the overlaps stay the same.
+/// </summary>
+/// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+/// <param name="pVoxels">The voxels of the block.</param>
+/// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionTiledVolume::WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels)
+{
+    if (m_tiles.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    int blockX, blockY, blockZ;
+    BlockCoordinates(blockKey, blockX, blockY, blockZ);
+
+    const int x = blockX * BlockSize;
+    if (nullptr == pVoxels || x >= static_cast<int>(m_params.voxelCountX))
+    {
+        return E_INVALIDARG;
+    }
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        const Tile &tile = m_tiles[i];
+        if (x < tile.storedStartX || x >= tile.storedEndX)
+        {
+            continue;
+        }
+
+        HRESULT hr = tile.pVolume->WriteBlock(BlockKey((x - tile.storedStartX) / BlockSize, blockY, blockZ), pVoxels, pColorVoxels);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,271 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionTiledVolume.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionVolume.h"
+
+/// <summary>
+/// Reconstruction volume made of several native volumes, each storing a slab of the voxels
+/// along x, so one sensor can be reconstructed by several workers at once. Each tile has its own
+/// worker thread which integrates and raycasts it, and only tiles which intersect the camera
+/// frustum are given work. The tile kernels share the Parallel Patterns Library scheduler, so
+/// the cores left idle by a tile with little work in view are taken by the others.
+/// Neighboring tiles store an overlap of one block each side of their boundary, so surfaces
+/// across a boundary are raycast without a seam, and the tile raycasts are merged by keeping
+/// the nearest surface of each pixel. Each block belongs to the tile in whose slab it lies,
+/// which reports its changes and supplies its voxels.
+/// </summary>
+class KinectFusionTiledVolume : public KinectFusionVolume
+{
+    // Voxels each tile stores beyond either side of its slab
+    static const int            cTileOverlap = KinectFusionVoxel::BlockSize;
+
+public:
+    static const unsigned int   cMaxTiles = 16;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionTiledVolume();
+
+    /// <summary>
+    /// Destructor, stopping the worker threads
+    /// </summary>
+    ~KinectFusionTiledVolume();
+
+    /// <summary>
+    /// Allocate the tiles and start their worker threads.
+    /// </summary>
+    /// <param name="reconstructionParams">The size and resolution of the whole volume. voxelCountX
+    /// must be a multiple of 8 with at least one block per tile, and with sparse tiles so must
+    /// voxelCountY and voxelCountZ.</param>
+    /// <param name="tileCount">The number of tiles, between 1 and cMaxTiles.</param>
+    /// <param name="bSparse">Whether the tiles are KinectFusionSparseVolume, otherwise KinectFusionCpuVolume.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Initialize(
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        unsigned int tileCount,
+        bool bSparse);
+
+    /// <summary>
+    /// Clear the volume and optionally set a new world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ResetReconstruction(const Matrix4 *pWorldToVolumeTransform);
+
+    /// <summary>
+    /// Get the current world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const;
+
+    /// <summary>
+    /// Integrate a depth float frame, and optionally a depth aligned color frame, into the tiles in view.
+    /// </summary>
+    /// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+    /// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+    /// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     IntegrateFrame(
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    USHORT maxIntegrationWeight,
+                                    const Matrix4 *pWorldToCameraTransform);
+
+    /// <summary>
+    /// Raycast the tiles in view from the given camera pose, keeping the nearest surface of each pixel.
+    /// </summary>
+    /// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+    /// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+    /// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CalculatePointCloudAndDepth(
+                                    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    const Matrix4 *pWorldToCameraTransform);
+
+    /// <summary>
+    /// Number of bytes of host memory currently allocated by the tiles.
+    /// </summary>
+    UINT64                      GetResidentBytes() const;
+
+    /// <summary>
+    /// Number of voxel bricks currently allocated by sparse tiles.
+    /// </summary>
+    unsigned int                GetAllocatedBrickCount() const;
+
+    /// <summary>
+    /// Get the blocks whose signed distance or color changed since the last call, and start
+    /// collecting changes again.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each changed block.</param>
+    /// <param name="bReset">Returns true if the volume was reset since the last call.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset);
+
+    /// <summary>
+    /// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume read as zero.
+    /// </summary>
+    /// <param name="x">The x coordinate of the first voxel of the box.</param>
+    /// <param name="y">The y coordinate of the first voxel of the box.</param>
+    /// <param name="z">The z coordinate of the first voxel of the box.</param>
+    /// <param name="size">The number of voxels along each edge of the box.</param>
+    /// <param name="pVoxels">Returns the voxels of the box.</param>
+    /// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+    void                        CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const;
+
+    /// <summary>
+    /// Get the blocks which may hold observed voxels.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     GetStoredBlocks(std::vector<UINT64> &blockKeys) const;
+
+    /// <summary>
+    /// Overwrite the voxels of a block in every tile which stores it.
+    /// </summary>
+    /// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+    /// <param name="pVoxels">The voxels of the block.</param>
+    /// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels);
+
+    /// <summary>
+    /// The number of tiles.
+    /// </summary>
+    unsigned int                GetTileCount() const
+    {
+        return static_cast<unsigned int>(m_tiles.size());
+    }
+
+    /// <summary>
+    /// The number of tiles given work by the last integration.
+    /// </summary>
+    unsigned int                GetIntegratedTileCount() const
+    {
+        return m_cIntegratedTiles;
+    }
+
+private:
+    enum TileJob
+    {
+        TileJobIntegrate,
+        TileJobRaycast
+    };
+
+    /// <summary>
+    /// A tile stores the voxels from storedStartX to storedEndX, and owns the blocks from
+    /// ownedStartX to ownedEndX. Its raycast frames hold its surface before the merge.
+    /// </summary>
+    struct Tile
+    {
+        KinectFusionVolume*     pVolume;
+        int                     storedStartX;
+        int                     storedEndX;
+        int                     ownedStartX;
+        int                     ownedEndX;
+
+        HANDLE                  hThread;
+        HANDLE                  hWorkEvent;
+        bool                    bActive;
+        HRESULT                 hr;
+
+        NUI_FUSION_IMAGE_FRAME* pPointCloud;
+        NUI_FUSION_IMAGE_FRAME* pDepthFloat;
+        NUI_FUSION_IMAGE_FRAME* pColor;
+    };
+
+    struct WorkerStart
+    {
+        KinectFusionTiledVolume* pVolume;
+        unsigned int            tile;
+    };
+
+    /// <summary>
+    /// Worker thread procedure
+    /// </summary>
+    static DWORD WINAPI         ThreadProc(LPVOID lpParameter);
+
+    /// <summary>
+    /// Run the jobs given to a tile until stopped.
+    /// </summary>
+    DWORD                       WorkerLoop(unsigned int tile);
+
+    /// <summary>
+    /// Give the current job to the active tiles and wait until they have all finished it.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise the failure code of a tile</returns>
+    HRESULT                     RunActiveTiles();
+
+    /// <summary>
+    /// Mark the tiles which intersect the camera frustum up to a depth as active.
+    /// </summary>
+    /// <returns>The number of active tiles</returns>
+    unsigned int                SelectTilesInView(
+        const NUI_FUSION_IMAGE_FRAME *pFrame,
+        const Matrix4 &worldToCameraTransform,
+        float farDepth);
+
+    /// <summary>
+    /// Stop the worker threads and release the tiles.
+    /// </summary>
+    void                        FreeTiles();
+
+    /// <summary>
+    /// The tile which owns the voxels at an x coordinate.
+    /// </summary>
+    unsigned int                OwnerTile(int x) const;
+
+    /// <summary>
+    /// The world to volume transform of a tile, offset from the transform of the whole volume.
+    /// </summary>
+    Matrix4                     TileTransform(const Tile &tile) const;
+
+    // Not copyable, as the worker threads refer to this object
+    KinectFusionTiledVolume(const KinectFusionTiledVolume&);
+    KinectFusionTiledVolume& operator=(const KinectFusionTiledVolume&);
+
+    std::vector<Tile>           m_tiles;
+    std::vector<WorkerStart>    m_workerStarts;
+    HANDLE                      m_hStopEvent;
+    HANDLE                      m_hDoneEvent;
+    volatile LONG               m_cPendingTiles;
+    unsigned int                m_cIntegratedTiles;
+
+    // The current job, only written while the workers are idle
+    TileJob                     m_job;
+    const NUI_FUSION_IMAGE_FRAME* m_pJobDepthFloat;
+    const NUI_FUSION_IMAGE_FRAME* m_pJobColor;
+    USHORT                      m_jobMaxIntegrationWeight;
+    Matrix4                     m_jobWorldToCameraTransform;
+
+    NUI_FUSION_RECONSTRUCTION_PARAMETERS m_params;
+    Matrix4                     m_worldToVolumeTransform;
+    Matrix4                     m_defaultWorldToVolumeTransform;
+};
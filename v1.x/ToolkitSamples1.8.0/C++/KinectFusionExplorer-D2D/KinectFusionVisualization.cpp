@@ -0,0 +1,777 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionVisualization.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <math.h>
+#include <intrin.h>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+// Project includes
+#include "KinectFusionVisualization.h"
+#include "KinectFusionHelper.h"
+#include "Timer.h"
+
+// The AVX2 intrinsics first shipped with the Visual Studio 2012 compiler. Older compilers
+// only build the scalar and lookup paths.
+#if defined(_MSC_VER) && (_MSC_VER >= 1700) && (defined(_M_IX86) || defined(_M_X64))
+#define KINECT_FUSION_VISUALIZATION_AVX2 1
+#include <immintrin.h>
+#else
+#define KINECT_FUSION_VISUALIZATION_AVX2 0
+#endif
+
+namespace
+{
+    // Depth is shown black at 0m and white at 4m
+    static const float          cDepthScale = 256.0f / 4.0f;
+
+    // Light reaching surfaces facing away from the camera
+    static const float          cAmbientLight = 0.2f;
+
+    // Floats per point cloud pixel: the point followed by the normal
+    static const unsigned int   cPointCloudFloats = 6;
+
+    static const unsigned int   cOpaque = 0xFF000000;
+
+    /// <summary>
+    /// Pack the color channels of a pixel, each between 0 and 1, into an opaque pixel.
+    /// </summary>
+    inline unsigned int PackColor(float r, float g, float b)
+    {
+        return cOpaque
+            | (static_cast<unsigned int>(255.0f * r) << 16)
+            | (static_cast<unsigned int>(255.0f * g) << 8)
+            | static_cast<unsigned int>(255.0f * b);
+    }
+
+    /// <summary>
+    /// Get the gray pixel of a depth, as converted by the original sample.
+    /// </summary>
+    inline unsigned int DepthPixel(float depth)
+    {
+        // % 256 to enable it to wrap around after the max range
+        const unsigned int intensity = (depth >= 0.0f) ? static_cast<unsigned int>(static_cast<int>(depth * cDepthScale) % 256) : 0;
+        return cOpaque | (intensity << 16) | (intensity << 8) | intensity;
+    }
+
+    /// <summary>
+    /// Get the color of a residual, as converted by the original sample.
+    /// </summary>
+    inline unsigned int ResidualPixel(float residual)
+    {
+        if (!(residual <= 1.0f))
+        {
+            return 0;
+        }
+
+        return PackColor(
+            clamp(1.0f + residual, 0.0f, 1.0f),
+            clamp(1.0f - fabsf(residual), 0.0f, 1.0f),
+            clamp(1.0f - residual, 0.0f, 1.0f));
+    }
+
+    /// <summary>
+    /// Whether the processor and operating system support AVX2.
+    /// </summary>
+    bool CpuSupportsAvx2()
+    {
+#if KINECT_FUSION_VISUALIZATION_AVX2
+        int cpuInfo[4];
+
+        __cpuid(cpuInfo, 0);
+        if (cpuInfo[0] < 7)
+        {
+            return false;
+        }
+
+        // The OS must save the YMM registers on a context switch
+        const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+        __cpuid(cpuInfo, 1);
+        if ((cpuInfo[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+
+        __cpuidex(cpuInfo, 7, 0);
+        return 0 != (cpuInfo[1] & (1 << 5));
+#else
+        return false;
+#endif
+    }
+
+    /// <summary>
+    /// Shade a row of a point cloud. The scalar path, which the AVX2 path matches.
+    /// </summary>
+    /// <param name="pPoints">The point cloud row.</param>
+    /// <param name="rotation">The world to camera rotation, row by row.</param>
+    /// <param name="worldToBGR">The transform from world positions to BGR colors.</param>
+    /// <param name="pSurface">The shaded surface row, or nullptr.</param>
+    /// <param name="pNormals">The shaded normals row, or nullptr.</param>
+    /// <param name="xBegin">The first pixel to shade.</param>
+    /// <param name="xEnd">The end of the pixels to shade.</param>
+    void ShadeRow(const float *pPoints, const Matrix4 &rotation, const Matrix4 &worldToBGR, unsigned int *pSurface, unsigned int *pNormals, unsigned int xBegin, unsigned int xEnd)
+    {
+        for (unsigned int x = xBegin; x < xEnd; ++x)
+        {
+            const float *pPoint = pPoints + (x * cPointCloudFloats);
+            const float nx = pPoint[3];
+            const float ny = pPoint[4];
+            const float nz = pPoint[5];
+
+            if (nx == 0.0f && ny == 0.0f && nz == 0.0f)
+            {
+                if (nullptr != pSurface)
+                {
+                    pSurface[x] = 0;
+                }
+
+                if (nullptr != pNormals)
+                {
+                    pNormals[x] = 0;
+                }
+
+                continue;
+            }
+
+            // Kinect Fusion transforms are applied to row vectors
+            const float cx = (nx * rotation.M11) + (ny * rotation.M21) + (nz * rotation.M31);
+            const float cy = (nx * rotation.M12) + (ny * rotation.M22) + (nz * rotation.M32);
+            const float cz = (nx * rotation.M13) + (ny * rotation.M23) + (nz * rotation.M33);
+
+            if (nullptr != pSurface)
+            {
+                // Surfaces facing the camera have normals pointing back along the view direction
+                const float light = cAmbientLight + ((1.0f - cAmbientLight) * clamp(-cz, 0.0f, 1.0f));
+
+                const float b = (pPoint[0] * worldToBGR.M11) + (pPoint[1] * worldToBGR.M21) + (pPoint[2] * worldToBGR.M31) + worldToBGR.M41;
+                const float g = (pPoint[0] * worldToBGR.M12) + (pPoint[1] * worldToBGR.M22) + (pPoint[2] * worldToBGR.M32) + worldToBGR.M42;
+                const float r = (pPoint[0] * worldToBGR.M13) + (pPoint[1] * worldToBGR.M23) + (pPoint[2] * worldToBGR.M33) + worldToBGR.M43;
+
+                pSurface[x] = PackColor(clamp(r, 0.0f, 1.0f) * light, clamp(g, 0.0f, 1.0f) * light, clamp(b, 0.0f, 1.0f) * light);
+            }
+
+            if (nullptr != pNormals)
+            {
+                pNormals[x] = PackColor(
+                    clamp((cx * 0.5f) + 0.5f, 0.0f, 1.0f),
+                    clamp((cy * 0.5f) + 0.5f, 0.0f, 1.0f),
+                    clamp((cz * 0.5f) + 0.5f, 0.0f, 1.0f));
+            }
+        }
+    }
+
+#if KINECT_FUSION_VISUALIZATION_AVX2
+    /// <summary>
+    /// Pack the color channels of eight pixels, each between 0 and 1, into opaque pixels.
+    /// </summary>
+    inline __m256i PackColorAvx2(__m256 r, __m256 g, __m256 b)
+    {
+        const __m256 scale = _mm256_set1_ps(255.0f);
+
+        __m256i pixels = _mm256_or_si256(_mm256_set1_epi32(static_cast<int>(cOpaque)), _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(scale, r)), 16));
+        pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(scale, g)), 8));
+        return _mm256_or_si256(pixels, _mm256_cvttps_epi32(_mm256_mul_ps(scale, b)));
+    }
+
+    /// <summary>
+    /// Clamp eight values between 0 and 1.
+    /// </summary>
+    inline __m256 Saturate(__m256 value)
+    {
+        return _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+    }
+
+    /// <summary>
+    /// Convert a row of depth eight pixels at a time.
+    /// </summary>
+    /// <returns>The number of pixels converted, a multiple of eight</returns>
+    unsigned int DepthRowAvx2(const float *pDepth, unsigned int *pDest, unsigned int count)
+    {
+        const __m256 scale = _mm256_set1_ps(cDepthScale);
+        const __m256i gray = _mm256_set1_epi32(0x010101);
+        const __m256i intensityMask = _mm256_set1_epi32(0xFF);
+        const __m256i opaque = _mm256_set1_epi32(static_cast<int>(cOpaque));
+        unsigned int x = 0;
+
+        for (; x + 8 <= count; x += 8)
+        {
+            const __m256 depth = _mm256_loadu_ps(pDepth + x);
+
+            // Negative and NaN depths are black, and the intensity wraps around every 256 steps
+            const __m256i visible = _mm256_castps_si256(_mm256_cmp_ps(depth, _mm256_setzero_ps(), _CMP_GE_OQ));
+            const __m256i intensity = _mm256_and_si256(_mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(depth, scale)), intensityMask), visible);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest + x), _mm256_or_si256(_mm256_mullo_epi32(intensity, gray), opaque));
+        }
+
+        _mm256_zeroupper();
+        return x;
+    }
+
+    /// <summary>
+    /// Convert a row of residuals eight pixels at a time.
+    /// </summary>
+    /// <returns>The number of pixels converted, a multiple of eight</returns>
+    unsigned int ResidualRowAvx2(const float *pResiduals, unsigned int *pDest, unsigned int count)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        unsigned int x = 0;
+
+        for (; x + 8 <= count; x += 8)
+        {
+            const __m256 residual = _mm256_loadu_ps(pResiduals + x);
+
+            // Residuals above 1 and NaN mark pixels without a residual
+            const __m256i valid = _mm256_castps_si256(_mm256_cmp_ps(residual, one, _CMP_LE_OQ));
+
+            const __m256i pixels = PackColorAvx2(
+                Saturate(_mm256_add_ps(one, residual)),
+                Saturate(_mm256_sub_ps(one, _mm256_andnot_ps(signMask, residual))),
+                Saturate(_mm256_sub_ps(one, residual)));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest + x), _mm256_and_si256(pixels, valid));
+        }
+
+        _mm256_zeroupper();
+        return x;
+    }
+
+    /// <summary>
+    /// Shade a row of a point cloud eight pixels at a time, gathering the interleaved points.
+    /// </summary>
+    /// <returns>The number of pixels shaded, a multiple of eight</returns>
+    unsigned int ShadeRowAvx2(const float *pPoints, const Matrix4 &rotation, const Matrix4 &worldToBGR, unsigned int *pSurface, unsigned int *pNormals, unsigned int count)
+    {
+        const __m256i offsets = _mm256_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 ambient = _mm256_set1_ps(cAmbientLight);
+        const __m256 diffuse = _mm256_set1_ps(1.0f - cAmbientLight);
+        unsigned int x = 0;
+
+        for (; x + 8 <= count; x += 8)
+        {
+            const float *pPoint = pPoints + (x * cPointCloudFloats);
+
+            const __m256 nx = _mm256_i32gather_ps(pPoint + 3, offsets, 4);
+            const __m256 ny = _mm256_i32gather_ps(pPoint + 4, offsets, 4);
+            const __m256 nz = _mm256_i32gather_ps(pPoint + 5, offsets, 4);
+
+            // Pixels without a surface have a zero normal
+            const __m256 empty = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(nx, zero, _CMP_EQ_OQ), _mm256_cmp_ps(ny, zero, _CMP_EQ_OQ)), _mm256_cmp_ps(nz, zero, _CMP_EQ_OQ));
+            const __m256i surface = _mm256_castps_si256(_mm256_xor_ps(empty, _mm256_castsi256_ps(_mm256_set1_epi32(-1))));
+
+            const __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_set1_ps(rotation.M11)), _mm256_mul_ps(ny, _mm256_set1_ps(rotation.M21))), _mm256_mul_ps(nz, _mm256_set1_ps(rotation.M31)));
+            const __m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_set1_ps(rotation.M12)), _mm256_mul_ps(ny, _mm256_set1_ps(rotation.M22))), _mm256_mul_ps(nz, _mm256_set1_ps(rotation.M32)));
+            const __m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_set1_ps(rotation.M13)), _mm256_mul_ps(ny, _mm256_set1_ps(rotation.M23))), _mm256_mul_ps(nz, _mm256_set1_ps(rotation.M33)));
+
+            if (nullptr != pSurface)
+            {
+                const __m256 px = _mm256_i32gather_ps(pPoint, offsets, 4);
+                const __m256 py = _mm256_i32gather_ps(pPoint + 1, offsets, 4);
+                const __m256 pz = _mm256_i32gather_ps(pPoint + 2, offsets, 4);
+
+                const __m256 light = _mm256_add_ps(ambient, _mm256_mul_ps(diffuse, Saturate(_mm256_sub_ps(zero, cz))));
+
+                const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(worldToBGR.M11)), _mm256_mul_ps(py, _mm256_set1_ps(worldToBGR.M21))), _mm256_mul_ps(pz, _mm256_set1_ps(worldToBGR.M31))), _mm256_set1_ps(worldToBGR.M41));
+                const __m256 g = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(worldToBGR.M12)), _mm256_mul_ps(py, _mm256_set1_ps(worldToBGR.M22))), _mm256_mul_ps(pz, _mm256_set1_ps(worldToBGR.M32))), _mm256_set1_ps(worldToBGR.M42));
+                const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(worldToBGR.M13)), _mm256_mul_ps(py, _mm256_set1_ps(worldToBGR.M23))), _mm256_mul_ps(pz, _mm256_set1_ps(worldToBGR.M33))), _mm256_set1_ps(worldToBGR.M43));
+
+                const __m256i pixels = PackColorAvx2(_mm256_mul_ps(Saturate(r), light), _mm256_mul_ps(Saturate(g), light), _mm256_mul_ps(Saturate(b), light));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pSurface + x), _mm256_and_si256(pixels, surface));
+            }
+
+            if (nullptr != pNormals)
+            {
+                const __m256i pixels = PackColorAvx2(
+                    Saturate(_mm256_add_ps(_mm256_mul_ps(cx, half), half)),
+                    Saturate(_mm256_add_ps(_mm256_mul_ps(cy, half), half)),
+                    Saturate(_mm256_add_ps(_mm256_mul_ps(cz, half), half)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pNormals + x), _mm256_and_si256(pixels, surface));
+            }
+        }
+
+        _mm256_zeroupper();
+        return x;
+    }
+#endif
+
+    /// <summary>
+    /// Lock a color image as a destination for a conversion of an image of the same size.
+    /// </summary>
+    HRESULT LockDestination(const NUI_FUSION_IMAGE_FRAME *pImage, const NUI_FUSION_IMAGE_FRAME *pSource, NUI_LOCKED_RECT &lockedRect)
+    {
+        if (nullptr == pImage->pFrameTexture || NUI_FUSION_IMAGE_TYPE_COLOR != pImage->imageType
+            || pImage->width != pSource->width || pImage->height != pSource->height)
+        {
+            return E_INVALIDARG;
+        }
+
+        HRESULT hr = pImage->pFrameTexture->LockRect(0, &lockedRect, nullptr, 0);
+        if (FAILED(hr) || lockedRect.Pitch == 0)
+        {
+            return E_NOINTERFACE;
+        }
+
+        return S_OK;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionVisualization::KinectFusionVisualization() :
+    m_bAvx2Supported(CpuSupportsAvx2())
+{
+    for (unsigned int i = 0; i < ARRAYSIZE(m_depthTable); ++i)
+    {
+        m_depthTable[i] = cOpaque | (i << 16) | (i << 8) | i;
+    }
+
+    for (unsigned int i = 0; i <= cResidualSteps; ++i)
+    {
+        m_residualTable[i] = ResidualPixel((static_cast<float>(i) * (2.0f / cResidualSteps)) - 1.0f);
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+KinectFusionVisualization::~KinectFusionVisualization()
+{
+}
+
+/// <summary>
+/// Convert a depth float image to gray RGBX, black at 0m and white at 4m, wrapping around
+/// every 4m after that.
+/// </summary>
+/// <param name="pDepthFloatImage">The depth float image.</param>
+/// <param name="pBuffer">The destination buffer, with the row pitch of the image.</param>
+/// <param name="path">The conversion path.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVisualization::DepthFloatToRgbx(
+    const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+    BYTE *pBuffer,
+    KinectFusionVisualizationPath path) const
+{
+    if (nullptr == pDepthFloatImage || nullptr == pDepthFloatImage->pFrameTexture || nullptr == pBuffer
+        || NUI_FUSION_IMAGE_TYPE_FLOAT != pDepthFloatImage->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_LOCKED_RECT lockedRect;
+
+    // Lock the frame data so the Kinect knows not to modify it while we're reading it
+    HRESULT hr = pDepthFloatImage->pFrameTexture->LockRect(0, &lockedRect, nullptr, 0);
+
+    // Make sure we've received valid data
+    if (FAILED(hr) || lockedRect.Pitch == 0)
+    {
+        return E_NOINTERFACE;
+    }
+
+    path = AvailablePath(path);
+    const unsigned int width = pDepthFloatImage->width;
+    const unsigned int *pDepthTable = m_depthTable;
+
+    Concurrency::parallel_for(0u, pDepthFloatImage->height, [&](unsigned int y)
+    {
+        const float *pDepthRow = reinterpret_cast<const float*>(lockedRect.pBits + (y * lockedRect.Pitch));
+        unsigned int *pColorRow = reinterpret_cast<unsigned int*>(pBuffer + (y * lockedRect.Pitch));
+        unsigned int x = 0;
+
+#if KINECT_FUSION_VISUALIZATION_AVX2
+        if (VisualizationAvx2 == path)
+        {
+            x = DepthRowAvx2(pDepthRow, pColorRow, width);
+        }
+#endif
+
+        if (VisualizationLookup == path)
+        {
+            // The table wraps around every 256 steps like the scalar path, and index 0 is black
+            for (; x < width; ++x)
+            {
+                const float depth = pDepthRow[x];
+                pColorRow[x] = pDepthTable[(depth >= 0.0f) ? (static_cast<int>(depth * cDepthScale) & 0xFF) : 0];
+            }
+        }
+        else
+        {
+            for (; x < width; ++x)
+            {
+                pColorRow[x] = DepthPixel(pDepthRow[x]);
+            }
+        }
+    });
+
+    // We're done with the texture so unlock it
+    pDepthFloatImage->pFrameTexture->UnlockRect(0);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Color the residual/delta image from the AlignDepthFloatToReconstruction call: red where
+/// the depth is behind the surface, blue where in front and white where it matches.
+/// Pixels without a residual are black.
+/// </summary>
+/// <param name="pFloatDeltaFromReference">The source FloatDeltaFromReference image.</param>
+/// <param name="pShadedDeltaFromReference">The destination color ShadedDeltaFromReference image.</param>
+/// <param name="path">The conversion path.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVisualization::ColorResiduals(
+    const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFromReference,
+    const NUI_FUSION_IMAGE_FRAME *pShadedDeltaFromReference,
+    KinectFusionVisualizationPath path) const
+{
+    if (nullptr == pFloatDeltaFromReference || nullptr == pShadedDeltaFromReference)
+    {
+        return E_FAIL;
+    }
+
+    if (nullptr == pFloatDeltaFromReference->pFrameTexture || NUI_FUSION_IMAGE_TYPE_FLOAT != pFloatDeltaFromReference->imageType)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 32bit ABGR color pixels for shaded image
+    NUI_LOCKED_RECT shadedDeltasLockedRect;
+    HRESULT hr = LockDestination(pShadedDeltaFromReference, pFloatDeltaFromReference, shadedDeltasLockedRect);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // 32bit float per pixel signifies distance delta from the reconstructed surface model after AlignDepthFloatToReconstruction
+    NUI_LOCKED_RECT floatDeltasLockedRect;
+    hr = pFloatDeltaFromReference->pFrameTexture->LockRect(0, &floatDeltasLockedRect, nullptr, 0);
+    if (FAILED(hr) || floatDeltasLockedRect.Pitch == 0)
+    {
+        pShadedDeltaFromReference->pFrameTexture->UnlockRect(0);
+        return E_NOINTERFACE;
+    }
+
+    path = AvailablePath(path);
+    const unsigned int width = pFloatDeltaFromReference->width;
+    const unsigned int *pResidualTable = m_residualTable;
+
+    Concurrency::parallel_for(0u, pFloatDeltaFromReference->height, [&](unsigned int y)
+    {
+        const float *pFloatRow = reinterpret_cast<const float*>(floatDeltasLockedRect.pBits + (y * floatDeltasLockedRect.Pitch));
+        unsigned int *pColorRow = reinterpret_cast<unsigned int*>(shadedDeltasLockedRect.pBits + (y * shadedDeltasLockedRect.Pitch));
+        unsigned int x = 0;
+
+#if KINECT_FUSION_VISUALIZATION_AVX2
+        if (VisualizationAvx2 == path)
+        {
+            x = ResidualRowAvx2(pFloatRow, pColorRow, width);
+        }
+#endif
+
+        if (VisualizationLookup == path)
+        {
+            // Residuals below -1 have the color of -1
+            const float scale = cResidualSteps * 0.5f;
+
+            for (; x < width; ++x)
+            {
+                const float residual = pFloatRow[x];
+                pColorRow[x] = (residual <= 1.0f) ? pResidualTable[static_cast<int>((max(residual, -1.0f) + 1.0f) * scale + 0.5f)] : 0;
+            }
+        }
+        else
+        {
+            for (; x < width; ++x)
+            {
+                pColorRow[x] = ResidualPixel(pFloatRow[x]);
+            }
+        }
+    });
+
+    pShadedDeltaFromReference->pFrameTexture->UnlockRect(0);
+    pFloatDeltaFromReference->pFrameTexture->UnlockRect(0);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Shade a point cloud calculated from a native volume, in place of NuiFusionShadePointCloud.
+/// The surface takes the color of its position in the world to BGR transform, lit from the
+/// camera, and the normals image maps the camera space normal x, y and z to red, green and
+/// blue. The lookup path shades with the scalar path, as there is no conversion to look up.
+/// </summary>
+/// <param name="pPointCloud">The point cloud, with zero normals where there is no surface.</param>
+/// <param name="pWorldToCameraTransform">The world to camera transform of the point cloud.</param>
+/// <param name="pWorldToBGRTransform">The transform from world positions to BGR colors.</param>
+/// <param name="pShadedSurface">The destination shaded surface image, or nullptr.</param>
+/// <param name="pShadedSurfaceNormals">The destination shaded normals image, or nullptr.</param>
+/// <param name="path">The conversion path.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVisualization::ShadePointCloud(
+    const NUI_FUSION_IMAGE_FRAME *pPointCloud,
+    const Matrix4 *pWorldToCameraTransform,
+    const Matrix4 *pWorldToBGRTransform,
+    const NUI_FUSION_IMAGE_FRAME *pShadedSurface,
+    const NUI_FUSION_IMAGE_FRAME *pShadedSurfaceNormals,
+    KinectFusionVisualizationPath path) const
+{
+    if (nullptr == pPointCloud || nullptr == pPointCloud->pFrameTexture || NUI_FUSION_IMAGE_TYPE_POINT_CLOUD != pPointCloud->imageType
+        || nullptr == pWorldToCameraTransform || nullptr == pWorldToBGRTransform)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (nullptr == pShadedSurface && nullptr == pShadedSurfaceNormals)
+    {
+        return S_OK;
+    }
+
+    NUI_LOCKED_RECT surfaceLockedRect = { 0 };
+    NUI_LOCKED_RECT normalsLockedRect = { 0 };
+    NUI_LOCKED_RECT pointsLockedRect;
+
+    HRESULT hr = S_OK;
+
+    if (nullptr != pShadedSurface)
+    {
+        hr = LockDestination(pShadedSurface, pPointCloud, surfaceLockedRect);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    if (nullptr != pShadedSurfaceNormals)
+    {
+        hr = LockDestination(pShadedSurfaceNormals, pPointCloud, normalsLockedRect);
+        if (FAILED(hr))
+        {
+            if (nullptr != pShadedSurface)
+            {
+                pShadedSurface->pFrameTexture->UnlockRect(0);
+            }
+            return hr;
+        }
+    }
+
+    hr = pPointCloud->pFrameTexture->LockRect(0, &pointsLockedRect, nullptr, 0);
+    if (SUCCEEDED(hr) && pointsLockedRect.Pitch != 0)
+    {
+        path = AvailablePath(path);
+        const unsigned int width = pPointCloud->width;
+        const Matrix4 &rotation = *pWorldToCameraTransform;
+        const Matrix4 &worldToBGR = *pWorldToBGRTransform;
+
+        Concurrency::parallel_for(0u, pPointCloud->height, [&](unsigned int y)
+        {
+            const float *pPoints = reinterpret_cast<const float*>(pointsLockedRect.pBits + (y * pointsLockedRect.Pitch));
+            unsigned int *pSurface = (nullptr != pShadedSurface) ? reinterpret_cast<unsigned int*>(surfaceLockedRect.pBits + (y * surfaceLockedRect.Pitch)) : nullptr;
+            unsigned int *pNormals = (nullptr != pShadedSurfaceNormals) ? reinterpret_cast<unsigned int*>(normalsLockedRect.pBits + (y * normalsLockedRect.Pitch)) : nullptr;
+            unsigned int x = 0;
+
+#if KINECT_FUSION_VISUALIZATION_AVX2
+            if (VisualizationAvx2 == path)
+            {
+                x = ShadeRowAvx2(pPoints, rotation, worldToBGR, pSurface, pNormals, width);
+            }
+#endif
+
+            ShadeRow(pPoints, rotation, worldToBGR, pSurface, pNormals, x, width);
+        });
+
+        pPointCloud->pFrameTexture->UnlockRect(0);
+    }
+    else
+    {
+        hr = E_NOINTERFACE;
+    }
+
+    if (nullptr != pShadedSurface)
+    {
+        pShadedSurface->pFrameTexture->UnlockRect(0);
+    }
+
+    if (nullptr != pShadedSurfaceNormals)
+    {
+        pShadedSurfaceNormals->pFrameTexture->UnlockRect(0);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Time each conversion on each path with synthetic images.
+/// </summary>
+/// <param name="width">The width of the images.</param>
+/// <param name="height">The height of the images.</param>
+/// <param name="iterations">The number of calls timed per conversion and path.</param>
+/// <param name="pResults">Returns the times.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVisualization::Benchmark(
+    unsigned int width,
+    unsigned int height,
+    unsigned int iterations,
+    KinectFusionVisualizationBenchmark *pResults) const
+{
+    if (nullptr == pResults || 0 == width || 0 == height || 0 == iterations)
+    {
+        return E_INVALIDARG;
+    }
+
+    NUI_FUSION_IMAGE_FRAME *pDepth = nullptr;
+    NUI_FUSION_IMAGE_FRAME *pPointCloud = nullptr;
+    NUI_FUSION_IMAGE_FRAME *pShaded = nullptr;
+    NUI_FUSION_IMAGE_FRAME *pShadedNormals = nullptr;
+    BYTE *pBuffer = new(std::nothrow) BYTE[width * height * KinectFusionParams::BytesPerPixel];
+
+    HRESULT hr = (nullptr != pBuffer) ? S_OK : E_OUTOFMEMORY;
+
+    if (SUCCEEDED(hr))
+    {
+        hr = NuiFusionCreateImageFrame(NUI_FUSION_IMAGE_TYPE_FLOAT, width, height, nullptr, &pDepth);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = NuiFusionCreateImageFrame(NUI_FUSION_IMAGE_TYPE_POINT_CLOUD, width, height, nullptr, &pPointCloud);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = NuiFusionCreateImageFrame(NUI_FUSION_IMAGE_TYPE_COLOR, width, height, nullptr, &pShaded);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = NuiFusionCreateImageFrame(NUI_FUSION_IMAGE_TYPE_COLOR, width, height, nullptr, &pShadedNormals);
+    }
+
+    // A tilted plane 0.5m to 4.5m away with a border of invalid pixels, which serves as depth,
+    // as residuals from -1.5 to 2.5 and as a point cloud
+    NUI_LOCKED_RECT depthLockedRect;
+    NUI_LOCKED_RECT pointsLockedRect;
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pDepth->pFrameTexture->LockRect(0, &depthLockedRect, nullptr, 0);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pPointCloud->pFrameTexture->LockRect(0, &pointsLockedRect, nullptr, 0);
+        if (FAILED(hr))
+        {
+            pDepth->pFrameTexture->UnlockRect(0);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            float *pDepthRow = reinterpret_cast<float*>(depthLockedRect.pBits + (y * depthLockedRect.Pitch));
+            float *pPoints = reinterpret_cast<float*>(pointsLockedRect.pBits + (y * pointsLockedRect.Pitch));
+
+            for (unsigned int x = 0; x < width; ++x, pPoints += cPointCloudFloats)
+            {
+                const bool border = (x < 8 || y < 8 || x + 8 >= width || y + 8 >= height);
+                const float depth = border ? 0.0f : 0.5f + (4.0f * (x + y)) / (width + height);
+
+                pDepthRow[x] = depth;
+                pPoints[0] = (static_cast<float>(x) - (width * 0.5f)) * depth / 571.0f;
+                pPoints[1] = (static_cast<float>(y) - (height * 0.5f)) * depth / 571.0f;
+                pPoints[2] = depth;
+                pPoints[3] = border ? 0.0f : -0.5f;
+                pPoints[4] = border ? 0.0f : -0.5f;
+                pPoints[5] = border ? 0.0f : -0.7071f;
+            }
+        }
+
+        pDepth->pFrameTexture->UnlockRect(0);
+        pPointCloud->pFrameTexture->UnlockRect(0);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        Matrix4 worldToCamera;
+        Matrix4 worldToBGR;
+        SetIdentityMatrix(worldToCamera);
+        SetIdentityMatrix(worldToBGR);
+        worldToBGR.M41 = 0.5f;
+        worldToBGR.M42 = 0.5f;
+
+        Timing::Timer timer;
+        pResults->width = width;
+        pResults->height = height;
+
+        for (int path = 0; path < VisualizationPathCount; ++path)
+        {
+            const KinectFusionVisualizationPath visualizationPath = static_cast<KinectFusionVisualizationPath>(path);
+
+            if (AvailablePath(visualizationPath) != visualizationPath)
+            {
+                pResults->depthTime[path] = pResults->residualTime[path] = pResults->shadeTime[path] = -1.0;
+                continue;
+            }
+
+            double startTime = timer.AbsoluteTime();
+            for (unsigned int i = 0; i < iterations && SUCCEEDED(hr); ++i)
+            {
+                hr = DepthFloatToRgbx(pDepth, pBuffer, visualizationPath);
+            }
+
+            double endTime = timer.AbsoluteTime();
+            pResults->depthTime[path] = (endTime - startTime) * 1000.0 / iterations;
+
+            startTime = endTime;
+            for (unsigned int i = 0; i < iterations && SUCCEEDED(hr); ++i)
+            {
+                hr = ColorResiduals(pDepth, pShaded, visualizationPath);
+            }
+
+            endTime = timer.AbsoluteTime();
+            pResults->residualTime[path] = (endTime - startTime) * 1000.0 / iterations;
+
+            startTime = endTime;
+            for (unsigned int i = 0; i < iterations && SUCCEEDED(hr); ++i)
+            {
+                hr = ShadePointCloud(pPointCloud, &worldToCamera, &worldToBGR, pShaded, pShadedNormals, visualizationPath);
+            }
+
+            endTime = timer.AbsoluteTime();
+            pResults->shadeTime[path] = (endTime - startTime) * 1000.0 / iterations;
+        }
+    }
+
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(pDepth);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(pPointCloud);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(pShaded);
+    SAFE_FUSION_RELEASE_IMAGE_FRAME(pShadedNormals);
+    delete[] pBuffer;
+
+    return hr;
+}
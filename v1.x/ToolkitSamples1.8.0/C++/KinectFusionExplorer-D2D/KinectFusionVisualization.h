@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionVisualization.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionParams.h"
+
+/// <summary>
+/// Time per call of each visualization kernel on each path, in milliseconds.
+/// Paths which are not available on this processor have a negative time.
+/// </summary>
+struct KinectFusionVisualizationBenchmark
+{
+    unsigned int                width;
+    unsigned int                height;
+    double                      depthTime[VisualizationPathCount];
+    double                      residualTime[VisualizationPathCount];
+    double                      shadeTime[VisualizationPathCount];
+};
+
+/// <summary>
+/// Converts Kinect Fusion images to color images for display. Each conversion has a scalar
+/// path, a path which looks the colors up in quantized tables and an AVX2 path, selected per
+/// call. The AVX2 path falls back to the lookup path on processors without AVX2.
+/// The methods are const and may be called from several threads at once.
+/// </summary>
+class KinectFusionVisualization
+{
+    // Residuals from -1 to 1 are looked up in this many steps
+    static const unsigned int   cResidualSteps = 1024;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionVisualization();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~KinectFusionVisualization();
+
+    /// <summary>
+    /// Whether the AVX2 path can run on this processor.
+    /// </summary>
+    bool                        IsAvx2Supported() const
+    {
+        return m_bAvx2Supported;
+    }
+
+    /// <summary>
+    /// Convert a depth float image to gray RGBX, black at 0m and white at 4m, wrapping around
+    /// every 4m after that.
+    /// </summary>
+    /// <param name="pDepthFloatImage">The depth float image.</param>
+    /// <param name="pBuffer">The destination buffer, with the row pitch of the image.</param>
+    /// <param name="path">The conversion path.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     DepthFloatToRgbx(
+        const NUI_FUSION_IMAGE_FRAME *pDepthFloatImage,
+        BYTE *pBuffer,
+        KinectFusionVisualizationPath path) const;
+
+    /// <summary>
+    /// Color the residual/delta image from the AlignDepthFloatToReconstruction call: red where
+    /// the depth is behind the surface, blue where in front and white where it matches.
+    /// Pixels without a residual are black.
+    /// </summary>
+    /// <param name="pFloatDeltaFromReference">The source FloatDeltaFromReference image.</param>
+    /// <param name="pShadedDeltaFromReference">The destination color ShadedDeltaFromReference image.</param>
+    /// <param name="path">The conversion path.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ColorResiduals(
+        const NUI_FUSION_IMAGE_FRAME *pFloatDeltaFromReference,
+        const NUI_FUSION_IMAGE_FRAME *pShadedDeltaFromReference,
+        KinectFusionVisualizationPath path) const;
+
+    /// <summary>
+    /// Shade a point cloud calculated from a native volume, in place of NuiFusionShadePointCloud.
+    /// The surface takes the color of its position in the world to BGR transform, lit from the
+    /// camera, and the normals image maps the camera space normal x, y and z to red, green and
+    /// blue. The lookup path shades with the scalar path, as there is no conversion to look up.
+    /// </summary>
+    /// <param name="pPointCloud">The point cloud, with zero normals where there is no surface.</param>
+    /// <param name="pWorldToCameraTransform">The world to camera transform of the point cloud.</param>
+    /// <param name="pWorldToBGRTransform">The transform from world positions to BGR colors.</param>
+    /// <param name="pShadedSurface">The destination shaded surface image, or nullptr.</param>
+    /// <param name="pShadedSurfaceNormals">The destination shaded normals image, or nullptr.</param>
+    /// <param name="path">The conversion path.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     ShadePointCloud(
+        const NUI_FUSION_IMAGE_FRAME *pPointCloud,
+        const Matrix4 *pWorldToCameraTransform,
+        const Matrix4 *pWorldToBGRTransform,
+        const NUI_FUSION_IMAGE_FRAME *pShadedSurface,
+        const NUI_FUSION_IMAGE_FRAME *pShadedSurfaceNormals,
+        KinectFusionVisualizationPath path) const;
+
+    /// <summary>
+    /// Time each conversion on each path with synthetic images.
+    /// </summary>
+    /// <param name="width">The width of the images.</param>
+    /// <param name="height">The height of the images.</param>
+    /// <param name="iterations">The number of calls timed per conversion and path.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     Benchmark(
+        unsigned int width,
+        unsigned int height,
+        unsigned int iterations,
+        KinectFusionVisualizationBenchmark *pResults) const;
+
+private:
+    /// <summary>
+    /// The path which runs for a requested path.
+    /// </summary>
+    KinectFusionVisualizationPath AvailablePath(KinectFusionVisualizationPath path) const
+    {
+        return (VisualizationAvx2 == path && !m_bAvx2Supported) ? VisualizationLookup : path;
+    }
+
+    bool                        m_bAvx2Supported;
+
+    // Gray pixels by depth in 1/64m steps, and residual colors by residual in 2/cResidualSteps steps
+    unsigned int                m_depthTable[256];
+    unsigned int                m_residualTable[cResidualSteps + 1];
+};
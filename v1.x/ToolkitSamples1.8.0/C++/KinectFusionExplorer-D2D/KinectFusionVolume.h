@@ -0,0 +1,211 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionVolume.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+/// <summary>
+/// A truncated signed distance function (TSDF) reconstruction volume implemented natively
+/// in this sample, used by KinectFusionProcessor in place of INuiFusionColorReconstruction.
+/// The calls mirror the INuiFusionColorReconstruction methods of the same name, so volumes
+/// take the same NUI_FUSION_RECONSTRUCTION_PARAMETERS layout, world to volume transform and
+/// Kinect Fusion image frames as the SDK volume.
+/// </summary>
+class KinectFusionVolume
+{
+public:
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~KinectFusionVolume() {}
+
+    /// <summary>
+    /// Clear the volume and optionally set a new world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">The new world to volume transform, or nullptr to use the default.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             ResetReconstruction(const Matrix4 *pWorldToVolumeTransform) = 0;
+
+    /// <summary>
+    /// Get the current world to volume transform.
+    /// </summary>
+    /// <param name="pWorldToVolumeTransform">Returns the world to volume transform.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             GetCurrentWorldToVolumeTransform(Matrix4 *pWorldToVolumeTransform) const = 0;
+
+    /// <summary>
+    /// Integrate a depth float frame, and optionally a depth aligned color frame, into the volume.
+    /// </summary>
+    /// <param name="pDepthFloatFrame">The depth float frame in meters.</param>
+    /// <param name="pColorFrame">The color frame aligned to the depth frame, or nullptr.</param>
+    /// <param name="maxIntegrationWeight">The maximum weight a voxel can accumulate.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose of the frames.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             IntegrateFrame(
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    USHORT maxIntegrationWeight,
+                                    const Matrix4 *pWorldToCameraTransform) = 0;
+
+    /// <summary>
+    /// Raycast the volume from the given camera pose.
+    /// </summary>
+    /// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+    /// <param name="pDepthFloatFrame">Optionally returns the camera space depth of the surface, or nullptr.</param>
+    /// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             CalculatePointCloudAndDepth(
+                                    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pDepthFloatFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    const Matrix4 *pWorldToCameraTransform) = 0;
+
+    /// <summary>
+    /// Raycast the volume from the given camera pose.
+    /// </summary>
+    /// <param name="pPointCloudFrame">Returns the world space points and normals of the surface.</param>
+    /// <param name="pColorFrame">Optionally returns the integrated color of the surface, or nullptr.</param>
+    /// <param name="pWorldToCameraTransform">The camera pose to raycast from.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CalculatePointCloud(
+                                    const NUI_FUSION_IMAGE_FRAME *pPointCloudFrame,
+                                    const NUI_FUSION_IMAGE_FRAME *pColorFrame,
+                                    const Matrix4 *pWorldToCameraTransform)
+    {
+        return CalculatePointCloudAndDepth(pPointCloudFrame, nullptr, pColorFrame, pWorldToCameraTransform);
+    }
+
+    /// <summary>
+    /// Number of bytes of host memory currently allocated by the volume.
+    /// </summary>
+    virtual UINT64              GetResidentBytes() const = 0;
+
+    /// <summary>
+    /// Number of voxel bricks currently allocated, or zero for volumes which are not sparse.
+    /// </summary>
+    virtual unsigned int        GetAllocatedBrickCount() const { return 0; }
+
+    /// <summary>
+    /// Whether a raycast only reads the volume, so raycasts into different frames may run at once
+    /// while nothing modifies the volume.
+    /// </summary>
+    virtual bool                SupportsConcurrentRaycasts() const { return false; }
+
+    /// <summary>
+    /// Whether a raycast may also run while a frame is integrated into the volume or the volume is
+    /// reset or written, seeing some voxels before and some after the change. The volume must not
+    /// be released meanwhile.
+    /// </summary>
+    virtual bool                SupportsRaycastDuringUpdates() const { return false; }
+
+    /// <summary>
+    /// Get the blocks of KinectFusionVoxel::BlockSize voxels along each edge whose signed
+    /// distance or color changed since the last call, and start collecting changes again.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each changed block.</param>
+    /// <param name="bReset">Returns true if the volume was reset since the last call, so every block may have changed.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             TakeChangedBlocks(std::vector<UINT64> &blockKeys, bool &bReset) = 0;
+
+    /// <summary>
+    /// Copy a box of voxels, ordered x fastest, then y, then z. Voxels outside the volume or
+    /// not stored read as zero, as if they had never been observed.
+    /// </summary>
+    /// <param name="x">The x coordinate of the first voxel of the box.</param>
+    /// <param name="y">The y coordinate of the first voxel of the box.</param>
+    /// <param name="z">The z coordinate of the first voxel of the box.</param>
+    /// <param name="size">The number of voxels along each edge of the box.</param>
+    /// <param name="pVoxels">Returns the voxels of the box.</param>
+    /// <param name="pColorVoxels">Returns the color voxels of the box, or nullptr to copy the voxels only.</param>
+    virtual void                CopyVoxels(int x, int y, int z, int size, unsigned int *pVoxels, unsigned int *pColorVoxels) const = 0;
+
+    /// <summary>
+    /// Get the blocks of KinectFusionVoxel::BlockSize voxels along each edge which may hold
+    /// observed voxels. Blocks which are not listed only hold zero voxels.
+    /// </summary>
+    /// <param name="blockKeys">Returns the KinectFusionVoxel::BlockKey of each block.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             GetStoredBlocks(std::vector<UINT64> &blockKeys) const = 0;
+
+    /// <summary>
+    /// Overwrite the voxels of a block, ordered x fastest, then y, then z, as copied by CopyVoxels.
+    /// Voxels outside the volume are ignored, and the block is reported as changed.
+    /// </summary>
+    /// <param name="blockKey">The KinectFusionVoxel::BlockKey of the block.</param>
+    /// <param name="pVoxels">The voxels of the block.</param>
+    /// <param name="pColorVoxels">The color voxels of the block, or nullptr to leave the color unchanged.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT             WriteBlock(UINT64 blockKey, const unsigned int *pVoxels, const unsigned int *pColorVoxels) = 0;
+};
+
+/// <summary>
+/// Voxels store the signed distance in the low 16 bits as a signed fixed point value in
+/// [-1, 1] (in units of the truncation distance), and the integration weight in the high 16
+/// bits. A zero voxel has never been observed.
+/// </summary>
+namespace KinectFusionVoxel
+{
+    // Distance in meters over which the signed distance is truncated either side of the surface
+    static const float          TruncationDistance = 0.03f;
+
+    static const float          TsdfScale = 32767.0f;
+    static const float          InverseTsdfScale = 1.0f / 32767.0f;
+
+    inline float Tsdf(unsigned int voxel)
+    {
+        return static_cast<float>(static_cast<short>(voxel & 0xFFFF)) * InverseTsdfScale;
+    }
+
+    inline unsigned int Weight(unsigned int voxel)
+    {
+        return voxel >> 16;
+    }
+
+    inline unsigned int Pack(float tsdf, unsigned int weight)
+    {
+        int fixedTsdf = static_cast<int>(tsdf * TsdfScale + (tsdf >= 0.0f ? 0.5f : -0.5f));
+        return (weight << 16) | (static_cast<unsigned int>(fixedTsdf) & 0xFFFF);
+    }
+
+    // Number of voxels along each edge of the blocks in which volumes track changes
+    static const int            BlockSize = 8;
+
+    /// <summary>
+    /// Get the key of the block with the given block coordinates. Keys are never zero.
+    /// </summary>
+    inline UINT64 BlockKey(int blockX, int blockY, int blockZ)
+    {
+        return (static_cast<UINT64>(blockX) | (static_cast<UINT64>(blockY) << 21) | (static_cast<UINT64>(blockZ) << 42)) + 1;
+    }
+
+    /// <summary>
+    /// Get the block coordinates of a block key.
+    /// </summary>
+    inline void BlockCoordinates(UINT64 key, int &blockX, int &blockY, int &blockZ)
+    {
+        --key;
+        blockX = static_cast<int>(key & 0x1FFFFF);
+        blockY = static_cast<int>((key >> 21) & 0x1FFFFF);
+        blockZ = static_cast<int>((key >> 42) & 0x1FFFFF);
+    }
+}
@@ -0,0 +1,578 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionVolumeSnapshot.cpp" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+// System includes
+#include "stdafx.h"
+
+#include <new>
+
+// Project includes
+#include "KinectFusionVolumeSnapshot.h"
+
+using namespace KinectFusionVolumeSnapshotFormat;
+
+namespace
+{
+    // Each token of the encoding starts with a control byte: the high bit is set for a run of
+    // one voxel value repeated, and clear for that many literal voxel values, and the low bits
+    // hold the number of voxels less one
+    const unsigned int cMaxTokenVoxels = 128;
+    const BYTE cRunFlag = 0x80;
+
+    /// <summary>
+    /// Read a block of bytes from a file.
+    /// </summary>
+    HRESULT ReadBytes(HANDLE hFile, void *pData, DWORD cbData)
+    {
+        DWORD cbRead = 0;
+        if (!ReadFile(hFile, pData, cbData, &cbRead, nullptr))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        return (cbRead == cbData) ? S_OK : E_FAIL;
+    }
+}
+
+namespace KinectFusionVolumeSnapshotFormat
+{
+    /// <summary>
+    /// The most bytes the encoding of a number of voxels can take.
+    /// </summary>
+    size_t MaxEncodedBytes(size_t count)
+    {
+        return count * sizeof(unsigned int) + (count + cMaxTokenVoxels - 1) / cMaxTokenVoxels;
+    }
+
+    /// <summary>
+    /// Run length encode voxels. Unobserved space is zero and voxels far from the surface
+    /// saturate at the truncation distance and the maximum weight, so most voxels are in runs.
+    /// </summary>
+    /// <param name="pVoxels">The voxels.</param>
+    /// <param name="count">The number of voxels.</param>
+    /// <param name="pDest">Returns the encoding, up to MaxEncodedBytes(count) bytes.</param>
+    /// <returns>The number of bytes of the encoding</returns>
+    size_t EncodeVoxels(const unsigned int *pVoxels, size_t count, BYTE *pDest)
+    {
+        BYTE *pOut = pDest;
+        size_t i = 0;
+
+        while (i < count)
+        {
+            size_t run = 1;
+            while (i + run < count && run < cMaxTokenVoxels && pVoxels[i + run] == pVoxels[i])
+            {
+                ++run;
+            }
+
+            if (run >= 2)
+            {
+                *pOut++ = static_cast<BYTE>(cRunFlag | (run - 1));
+                memcpy(pOut, &pVoxels[i], sizeof(unsigned int));
+                pOut += sizeof(unsigned int);
+                i += run;
+                continue;
+            }
+
+            // Literals up to the next run of two or more
+            size_t end = i + 1;
+            while (end < count && end - i < cMaxTokenVoxels && !(end + 1 < count && pVoxels[end] == pVoxels[end + 1]))
+            {
+                ++end;
+            }
+
+            *pOut++ = static_cast<BYTE>(end - i - 1);
+            memcpy(pOut, &pVoxels[i], (end - i) * sizeof(unsigned int));
+            pOut += (end - i) * sizeof(unsigned int);
+            i = end;
+        }
+
+        return pOut - pDest;
+    }
+
+    /// <summary>
+    /// Decode run length encoded voxels.
+    /// </summary>
+    /// <param name="pSource">The encoding.</param>
+    /// <param name="cbSource">The number of bytes of the encoding.</param>
+    /// <param name="pVoxels">Returns the voxels.</param>
+    /// <param name="count">The number of voxels.</param>
+    /// <returns>true if the encoding holds exactly count voxels</returns>
+    bool DecodeVoxels(const BYTE *pSource, size_t cbSource, unsigned int *pVoxels, size_t count)
+    {
+        const BYTE *pEnd = pSource + cbSource;
+        size_t i = 0;
+
+        while (pSource < pEnd)
+        {
+            const BYTE control = *pSource++;
+            const size_t length = (control & ~cRunFlag) + 1;
+
+            if (i + length > count)
+            {
+                return false;
+            }
+
+            if (0 != (control & cRunFlag))
+            {
+                unsigned int voxel;
+                if (pEnd - pSource < static_cast<ptrdiff_t>(sizeof(voxel)))
+                {
+                    return false;
+                }
+
+                memcpy(&voxel, pSource, sizeof(voxel));
+                pSource += sizeof(voxel);
+                std::fill(pVoxels + i, pVoxels + i + length, voxel);
+            }
+            else
+            {
+                if (pEnd - pSource < static_cast<ptrdiff_t>(length * sizeof(unsigned int)))
+                {
+                    return false;
+                }
+
+                memcpy(pVoxels + i, pSource, length * sizeof(unsigned int));
+                pSource += length * sizeof(unsigned int);
+            }
+
+            i += length;
+        }
+
+        return i == count;
+    }
+
+    /// <summary>
+    /// Whether every voxel is zero.
+    /// </summary>
+    bool IsEmpty(const unsigned int *pVoxels, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (0 != pVoxels[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+KinectFusionVolumeSnapshot::KinectFusionVolumeSnapshot() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_cbWritten(0),
+    m_iNextBlock(0)
+{
+    m_szFileName[0] = L'\0';
+    m_szTempFileName[0] = L'\0';
+    ZeroMemory(&m_header, sizeof(m_header));
+}
+
+/// <summary>
+/// Destructor, abandoning a snapshot which was not completed
+/// </summary>
+KinectFusionVolumeSnapshot::~KinectFusionVolumeSnapshot()
+{
+    AbortWrite();
+}
+
+/// <summary>
+/// Write a block of bytes at the end of the snapshot.
+/// </summary>
+HRESULT KinectFusionVolumeSnapshot::Write(const void *pData, DWORD cbData)
+{
+    DWORD cbWritten = 0;
+    if (!WriteFile(m_hFile, pData, cbData, &cbWritten, nullptr) || cbWritten != cbData)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_cbWritten += cbData;
+    return S_OK;
+}
+
+/// <summary>
+/// Start writing a snapshot by taking the stored blocks of the volume. Call with the volume locked.
+/// </summary>
+/// <param name="szFileName">The path of the snapshot file.</param>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="worldToCameraTransform">The current camera pose, restored with the volume.</param>
+/// <param name="bColor">Whether to save the color voxels.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVolumeSnapshot::BeginWrite(
+    LPCWSTR szFileName,
+    const KinectFusionVolume *pVolume,
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    const Matrix4 &worldToCameraTransform,
+    bool bColor)
+{
+    if (nullptr == szFileName || nullptr == pVolume)
+    {
+        return E_INVALIDARG;
+    }
+
+    AbortWrite();
+
+    if (0 != wcscpy_s(m_szFileName, szFileName)
+        || 0 != wcscpy_s(m_szTempFileName, szFileName)
+        || 0 != wcscat_s(m_szTempFileName, L".tmp"))
+    {
+        return E_INVALIDARG;
+    }
+
+    ZeroMemory(&m_header, sizeof(m_header));
+    m_header.magic = Magic;
+    m_header.version = Version;
+    m_header.flags = bColor ? FlagColor : 0;
+    m_header.blockSize = KinectFusionVoxel::BlockSize;
+    m_header.voxelCountX = reconstructionParams.voxelCountX;
+    m_header.voxelCountY = reconstructionParams.voxelCountY;
+    m_header.voxelCountZ = reconstructionParams.voxelCountZ;
+    m_header.voxelsPerMeter = reconstructionParams.voxelsPerMeter;
+    m_header.worldToCameraTransform = worldToCameraTransform;
+
+    HRESULT hr = pVolume->GetCurrentWorldToVolumeTransform(&m_header.worldToVolumeTransform);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pVolume->GetStoredBlocks(m_blockKeys);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_hFile = CreateFileW(m_szTempFileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        m_blockKeys.clear();
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_cbWritten = 0;
+    m_iNextBlock = 0;
+
+    // The block count is filled in when the snapshot is complete
+    hr = Write(&m_header, sizeof(m_header));
+    if (FAILED(hr))
+    {
+        AbortWrite();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Copy the voxels of the next batch of pending blocks. Call with the volume locked.
+/// </summary>
+/// <param name="pVolume">The reconstruction volume.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVolumeSnapshot::CopyPendingBlocks(const KinectFusionVolume *pVolume)
+{
+    if (nullptr == pVolume || INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    const size_t cBlocks = min(static_cast<size_t>(cBlocksPerBatch), m_blockKeys.size() - m_iNextBlock);
+    const bool bColor = 0 != (m_header.flags & FlagColor);
+
+    try
+    {
+        m_copiedKeys.assign(m_blockKeys.begin() + m_iNextBlock, m_blockKeys.begin() + m_iNextBlock + cBlocks);
+        m_copiedVoxels.resize(cBlocks * cBlockVoxels);
+        m_copiedColorVoxels.resize(bColor ? cBlocks * cBlockVoxels : 0);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (size_t i = 0; i < cBlocks; ++i)
+    {
+        int blockX, blockY, blockZ;
+        KinectFusionVoxel::BlockCoordinates(m_copiedKeys[i], blockX, blockY, blockZ);
+
+        pVolume->CopyVoxels(
+            blockX * KinectFusionVoxel::BlockSize,
+            blockY * KinectFusionVoxel::BlockSize,
+            blockZ * KinectFusionVoxel::BlockSize,
+            KinectFusionVoxel::BlockSize,
+            &m_copiedVoxels[i * cBlockVoxels],
+            bColor ? &m_copiedColorVoxels[i * cBlockVoxels] : nullptr);
+    }
+
+    m_iNextBlock += cBlocks;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Compress the copied blocks and append them to the snapshot, without the volume locked.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVolumeSnapshot::WriteCopiedBlocks()
+{
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    const bool bColor = !m_copiedColorVoxels.empty();
+    const size_t cbMaxBlock = sizeof(BlockHeader) + 2 * MaxEncodedBytes(cBlockVoxels);
+
+    try
+    {
+        m_compressed.resize(m_copiedKeys.size() * cbMaxBlock);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    UINT32 cBlocks = 0;
+    BYTE *pOut = m_compressed.empty() ? nullptr : &m_compressed[0];
+
+    for (size_t i = 0; i < m_copiedKeys.size(); ++i)
+    {
+        const unsigned int *pVoxels = &m_copiedVoxels[i * cBlockVoxels];
+        const unsigned int *pColorVoxels = bColor ? &m_copiedColorVoxels[i * cBlockVoxels] : nullptr;
+
+        // Blocks which were never observed are left out, as loading starts from an empty volume
+        if (IsEmpty(pVoxels, cBlockVoxels) && (nullptr == pColorVoxels || IsEmpty(pColorVoxels, cBlockVoxels)))
+        {
+            continue;
+        }
+
+        BlockHeader blockHeader;
+        blockHeader.key = m_copiedKeys[i];
+
+        BYTE *pData = pOut + sizeof(BlockHeader);
+        blockHeader.cbVoxels = static_cast<UINT32>(EncodeVoxels(pVoxels, cBlockVoxels, pData));
+        blockHeader.cbColorVoxels = (nullptr != pColorVoxels)
+            ? static_cast<UINT32>(EncodeVoxels(pColorVoxels, cBlockVoxels, pData + blockHeader.cbVoxels))
+            : 0;
+
+        memcpy(pOut, &blockHeader, sizeof(BlockHeader));
+        pOut += sizeof(BlockHeader) + blockHeader.cbVoxels + blockHeader.cbColorVoxels;
+        ++cBlocks;
+    }
+
+    m_copiedKeys.clear();
+
+    HRESULT hr = S_OK;
+    if (cBlocks > 0)
+    {
+        hr = Write(&m_compressed[0], static_cast<DWORD>(pOut - &m_compressed[0]));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_header.cBlocks += cBlocks;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Complete the snapshot and replace the snapshot file with it.
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVolumeSnapshot::EndWrite()
+{
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (HasPendingBlocks())
+    {
+        AbortWrite();
+        return E_UNEXPECTED;
+    }
+
+    // Rewrite the header with the block count
+    HRESULT hr = S_OK;
+    LARGE_INTEGER start = {0};
+    DWORD cbWritten = 0;
+
+    if (!SetFilePointerEx(m_hFile, start, nullptr, FILE_BEGIN)
+        || !WriteFile(m_hFile, &m_header, sizeof(m_header), &cbWritten, nullptr)
+        || sizeof(m_header) != cbWritten
+        || !FlushFileBuffers(m_hFile))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+
+    if (SUCCEEDED(hr) && !MoveFileExW(m_szTempFileName, m_szFileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (FAILED(hr))
+    {
+        DeleteFileW(m_szTempFileName);
+    }
+
+    m_blockKeys.clear();
+    m_iNextBlock = 0;
+
+    return hr;
+}
+
+/// <summary>
+/// Abandon the snapshot being written, leaving the snapshot file as it was.
+/// </summary>
+void KinectFusionVolumeSnapshot::AbortWrite()
+{
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+        DeleteFileW(m_szTempFileName);
+    }
+
+    m_blockKeys.clear();
+    m_copiedKeys.clear();
+    m_iNextBlock = 0;
+}
+
+/// <summary>
+/// Load a snapshot into a volume, replacing its voxels and world to volume transform. Call
+/// with the volume locked. If the snapshot cannot be loaded the volume is left empty.
+/// </summary>
+/// <param name="szFileName">The path of the snapshot file.</param>
+/// <param name="pVolume">The reconstruction volume, the size of the snapshot.</param>
+/// <param name="reconstructionParams">The size and resolution of the volume.</param>
+/// <param name="pWorldToCameraTransform">Returns the camera pose when the snapshot was taken.</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT KinectFusionVolumeSnapshot::Read(
+    LPCWSTR szFileName,
+    KinectFusionVolume *pVolume,
+    const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+    Matrix4 *pWorldToCameraTransform)
+{
+    if (nullptr == szFileName || nullptr == pVolume || nullptr == pWorldToCameraTransform)
+    {
+        return E_INVALIDARG;
+    }
+
+    HANDLE hFile = CreateFileW(szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    FileHeader header;
+    HRESULT hr = ReadBytes(hFile, &header, sizeof(header));
+
+    if (SUCCEEDED(hr) && (Magic != header.magic || Version != header.version || KinectFusionVoxel::BlockSize != header.blockSize))
+    {
+        hr = E_FAIL;
+    }
+
+    // The snapshot only fits a volume of the same size and resolution
+    if (SUCCEEDED(hr) &&
+        (reconstructionParams.voxelCountX != header.voxelCountX ||
+        reconstructionParams.voxelCountY != header.voxelCountY ||
+        reconstructionParams.voxelCountZ != header.voxelCountZ ||
+        reconstructionParams.voxelsPerMeter != header.voxelsPerMeter))
+    {
+        hr = E_INVALIDARG;
+    }
+
+    if (FAILED(hr))
+    {
+        CloseHandle(hFile);
+        return hr;
+    }
+
+    const bool bColor = 0 != (header.flags & FlagColor);
+    const size_t cbMaxEncoded = MaxEncodedBytes(cBlockVoxels);
+
+    std::vector<BYTE> encoded;
+    std::vector<unsigned int> voxels;
+    std::vector<unsigned int> colorVoxels;
+
+    try
+    {
+        encoded.resize(2 * cbMaxEncoded);
+        voxels.resize(cBlockVoxels);
+        colorVoxels.resize(cBlockVoxels);
+    }
+    catch (const std::bad_alloc&)
+    {
+        CloseHandle(hFile);
+        return E_OUTOFMEMORY;
+    }
+
+    hr = pVolume->ResetReconstruction(&header.worldToVolumeTransform);
+
+    for (UINT32 i = 0; i < header.cBlocks && SUCCEEDED(hr); ++i)
+    {
+        BlockHeader blockHeader;
+        hr = ReadBytes(hFile, &blockHeader, sizeof(blockHeader));
+
+        if (SUCCEEDED(hr) &&
+            (blockHeader.cbVoxels > cbMaxEncoded || blockHeader.cbColorVoxels > cbMaxEncoded ||
+            (!bColor && 0 != blockHeader.cbColorVoxels)))
+        {
+            hr = E_FAIL;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = ReadBytes(hFile, &encoded[0], blockHeader.cbVoxels + blockHeader.cbColorVoxels);
+        }
+
+        if (SUCCEEDED(hr) &&
+            (!DecodeVoxels(&encoded[0], blockHeader.cbVoxels, &voxels[0], cBlockVoxels) ||
+            (bColor && !DecodeVoxels(&encoded[blockHeader.cbVoxels], blockHeader.cbColorVoxels, &colorVoxels[0], cBlockVoxels))))
+        {
+            hr = E_FAIL;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pVolume->WriteBlock(blockHeader.key, &voxels[0], bColor ? &colorVoxels[0] : nullptr);
+        }
+    }
+
+    CloseHandle(hFile);
+
+    if (FAILED(hr))
+    {
+        pVolume->ResetReconstruction(nullptr);
+        return hr;
+    }
+
+    *pWorldToCameraTransform = header.worldToCameraTransform;
+
+    return S_OK;
+}
@@ -0,0 +1,223 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionVolumeSnapshot.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <NuiKinectFusionApi.h>
+
+#include "KinectFusionVolume.h"
+
+/// <summary>
+/// A volume snapshot file is a header followed by the stored blocks of the volume which hold
+/// observed voxels, each a block header followed by its run length encoded voxels and color
+/// voxels. Blocks whose voxels are all zero are not written.
+/// </summary>
+namespace KinectFusionVolumeSnapshotFormat
+{
+    // 'KFVS' file signature
+    static const UINT32         Magic = 0x5356464B;
+    static const UINT32         Version = 1;
+
+    static const UINT32         FlagColor = 0x1;
+
+    struct FileHeader
+    {
+        UINT32                  magic;
+        UINT32                  version;
+        UINT32                  flags;
+        UINT32                  blockSize;
+        UINT32                  voxelCountX;
+        UINT32                  voxelCountY;
+        UINT32                  voxelCountZ;
+        FLOAT                   voxelsPerMeter;
+        Matrix4                 worldToVolumeTransform;
+        Matrix4                 worldToCameraTransform;
+        UINT32                  cBlocks;        // filled in when the snapshot is complete
+        UINT32                  reserved;
+    };
+
+    struct BlockHeader
+    {
+        UINT64                  key;
+        UINT32                  cbVoxels;
+        UINT32                  cbColorVoxels;
+    };
+
+    /// <summary>
+    /// The most bytes the encoding of a number of voxels can take.
+    /// </summary>
+    size_t                      MaxEncodedBytes(size_t count);
+
+    /// <summary>
+    /// Run length encode voxels.
+    /// </summary>
+    /// <param name="pVoxels">The voxels.</param>
+    /// <param name="count">The number of voxels.</param>
+    /// <param name="pDest">Returns the encoding, up to MaxEncodedBytes(count) bytes.</param>
+    /// <returns>The number of bytes of the encoding</returns>
+    size_t                      EncodeVoxels(const unsigned int *pVoxels, size_t count, BYTE *pDest);
+
+    /// <summary>
+    /// Decode run length encoded voxels.
+    /// </summary>
+    /// <param name="pSource">The encoding.</param>
+    /// <param name="cbSource">The number of bytes of the encoding.</param>
+    /// <param name="pVoxels">Returns the voxels.</param>
+    /// <param name="count">The number of voxels.</param>
+    /// <returns>true if the encoding holds exactly count voxels</returns>
+    bool                        DecodeVoxels(const BYTE *pSource, size_t cbSource, unsigned int *pVoxels, size_t count);
+
+    /// <summary>
+    /// Whether every voxel is zero.
+    /// </summary>
+    bool                        IsEmpty(const unsigned int *pVoxels, size_t count);
+}
+
+/// <summary>
+/// Saves the voxels of a native reconstruction volume to a compressed snapshot file, and loads
+/// them back into a volume of the same size. Like KinectFusionIncrementalMesher, a snapshot is
+/// written a batch of blocks at a time and the volume only has to be locked while a batch is
+/// copied, so tracking and integration carry on while the copies are compressed and written.
+/// The snapshot is written to a temporary file which replaces the file once it is complete,
+/// so an interrupted snapshot leaves the previous one intact.
+/// </summary>
+class KinectFusionVolumeSnapshot
+{
+    // Number of blocks copied from the volume at a time
+    static const unsigned int   cBlocksPerBatch = 1024;
+
+    static const int            cBlockVoxels = KinectFusionVoxel::BlockSize * KinectFusionVoxel::BlockSize * KinectFusionVoxel::BlockSize;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    KinectFusionVolumeSnapshot();
+
+    /// <summary>
+    /// Destructor, abandoning a snapshot which was not completed
+    /// </summary>
+    ~KinectFusionVolumeSnapshot();
+
+    /// <summary>
+    /// Start writing a snapshot by taking the stored blocks of the volume. Call with the volume locked.
+    /// </summary>
+    /// <param name="szFileName">The path of the snapshot file.</param>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <param name="reconstructionParams">The size and resolution of the volume.</param>
+    /// <param name="worldToCameraTransform">The current camera pose, restored with the volume.</param>
+    /// <param name="bColor">Whether to save the color voxels.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     BeginWrite(
+        LPCWSTR szFileName,
+        const KinectFusionVolume *pVolume,
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        const Matrix4 &worldToCameraTransform,
+        bool bColor);
+
+    /// <summary>
+    /// Whether blocks taken by BeginWrite remain to be copied and written.
+    /// </summary>
+    bool                        HasPendingBlocks() const
+    {
+        return m_iNextBlock < m_blockKeys.size();
+    }
+
+    /// <summary>
+    /// Copy the voxels of the next batch of pending blocks. Call with the volume locked.
+    /// </summary>
+    /// <param name="pVolume">The reconstruction volume.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     CopyPendingBlocks(const KinectFusionVolume *pVolume);
+
+    /// <summary>
+    /// Compress the copied blocks and append them to the snapshot, without the volume locked.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     WriteCopiedBlocks();
+
+    /// <summary>
+    /// Complete the snapshot and replace the snapshot file with it.
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                     EndWrite();
+
+    /// <summary>
+    /// Abandon the snapshot being written, leaving the snapshot file as it was.
+    /// </summary>
+    void                        AbortWrite();
+
+    /// <summary>
+    /// The number of non-empty blocks written to the snapshot so far.
+    /// </summary>
+    unsigned int                GetWrittenBlockCount() const
+    {
+        return m_header.cBlocks;
+    }
+
+    /// <summary>
+    /// The number of bytes written to the snapshot so far.
+    /// </summary>
+    UINT64                      GetWrittenBytes() const
+    {
+        return m_cbWritten;
+    }
+
+    /// <summary>
+    /// Load a snapshot into a volume, replacing its voxels and world to volume transform. Call
+    /// with the volume locked.
+    /// </summary>
+    /// <param name="szFileName">The path of the snapshot file.</param>
+    /// <param name="pVolume">The reconstruction volume, the size of the snapshot.</param>
+    /// <param name="reconstructionParams">The size and resolution of the volume.</param>
+    /// <param name="pWorldToCameraTransform">Returns the camera pose when the snapshot was taken.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT              Read(
+        LPCWSTR szFileName,
+        KinectFusionVolume *pVolume,
+        const NUI_FUSION_RECONSTRUCTION_PARAMETERS &reconstructionParams,
+        Matrix4 *pWorldToCameraTransform);
+
+private:
+    /// <summary>
+    /// Write a block of bytes at the end of the snapshot.
+    /// </summary>
+    HRESULT                     Write(const void *pData, DWORD cbData);
+
+    // Not copyable, as the object owns the file handle
+    KinectFusionVolumeSnapshot(const KinectFusionVolumeSnapshot&);
+    KinectFusionVolumeSnapshot& operator=(const KinectFusionVolumeSnapshot&);
+
+    HANDLE                      m_hFile;
+    WCHAR                       m_szFileName[MAX_PATH];
+    WCHAR                       m_szTempFileName[MAX_PATH];
+    KinectFusionVolumeSnapshotFormat::FileHeader m_header;
+    UINT64                      m_cbWritten;
+
+    std::vector<UINT64>         m_blockKeys;
+    size_t                      m_iNextBlock;
+
+    // The voxels of the copied batch, and its compressed blocks
+    std::vector<UINT64>         m_copiedKeys;
+    std::vector<unsigned int>   m_copiedVoxels;
+    std::vector<unsigned int>   m_copiedColorVoxels;
+    std::vector<BYTE>           m_compressed;
+};
@@ -0,0 +1,638 @@
+//------------------------------------------------------------------------------
+// <copyright file="KinectFusionVoxelKernels.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <math.h>
+#include <float.h>
+#include <emmintrin.h>
+
+#include <NuiKinectFusionApi.h>
+
+#pragma warning(push)
+#pragma warning(disable:6255)
+#pragma warning(disable:6263)
+#pragma warning(disable:4995)
+#include "ppl.h"
+#pragma warning(pop)
+
+#include "KinectFusionVolume.h"
+#include "KinectFusionHelper.h"
+#include "KinectFusionReduction.h"
+
+/// <summary>
+/// Integration and raycasting kernels shared by the host reconstruction volumes. The volumes
+/// differ only in how voxels are stored, so the raycast is a template over a voxel accessor
+/// providing:
+///     unsigned int Voxel(int x, int y, int z) const;
+///     unsigned int ColorVoxel(int x, int y, int z) const;
+///     void Corners(int x, int y, int z, unsigned int corners[8]) const;
+///     float SkipUnallocated(const float start[3], const float direction[3], float t) const;
+/// where Corners returns the 2x2x2 voxels at (x, y, z) ordered x fastest, then y, then z, and
+/// SkipUnallocated returns the ray parameter at which to resume when the voxel at t is not
+/// stored at all, or t when it cannot skip.
+/// </summary>
+namespace KinectFusionVoxel
+{
+    // Closest camera space depth in meters at which voxels are integrated or raycast
+    static const float          MinimumDepth = 0.1f;
+
+    /// <summary>
+    /// The locked depth and color images and camera intrinsics of a frame being integrated.
+    /// </summary>
+    struct IntegrationFrame
+    {
+        const BYTE*             pDepth;
+        int                     depthPitch;
+        const BYTE*             pColor;
+        int                     colorPitch;
+        int                     width;
+        int                     height;
+        float                   flx;
+        float                   fly;
+        float                   ppx;
+        float                   ppy;
+        float                   maxWeight;
+        unsigned int            maxColorWeight;
+    };
+
+    /// <summary>
+    /// The furthest depth in part of a depth float image, combined by KinectFusionReduction.
+    /// </summary>
+    struct MaxDepthAccumulator
+    {
+        float                   maxDepth;
+
+        MaxDepthAccumulator() : maxDepth(0.0f)
+        {
+        }
+
+        MaxDepthAccumulator &operator+=(const MaxDepthAccumulator &other)
+        {
+            maxDepth = max(maxDepth, other.maxDepth);
+            return *this;
+        }
+    };
+
+    /// <summary>
+    /// Find the furthest depth of a locked depth float image. The rows are scanned in parallel,
+    /// four pixels at a time with SSE2.
+    /// </summary>
+    /// <param name="pDepth">The depth float pixels.</param>
+    /// <param name="depthPitch">The row pitch of the image in bytes.</param>
+    /// <param name="width">The width of the image.</param>
+    /// <param name="height">The height of the image.</param>
+    /// <returns>The furthest depth in meters, or 0 if the image has no valid depth</returns>
+    inline float FindMaxDepth(const BYTE *pDepth, int depthPitch, int width, int height)
+    {
+        KinectFusionReduction<MaxDepthAccumulator> reduction;
+
+        MaxDepthAccumulator total = reduction.Reduce(static_cast<unsigned int>(height), [&](unsigned int yBegin, unsigned int yEnd, MaxDepthAccumulator &part)
+        {
+            __m128 maxDepth4 = _mm_setzero_ps();
+            float maxDepth = 0.0f;
+
+            for (unsigned int y = yBegin; y < yEnd; ++y)
+            {
+                const float *pDepthRow = reinterpret_cast<const float*>(pDepth + (y * depthPitch));
+
+                int x = 0;
+                for (; x + 4 <= width; x += 4)
+                {
+                    maxDepth4 = _mm_max_ps(_mm_loadu_ps(pDepthRow + x), maxDepth4);
+                }
+
+                // Written so a NaN pixel is skipped, as by _mm_max_ps above
+                for (; x < width; ++x)
+                {
+                    if (pDepthRow[x] > maxDepth)
+                    {
+                        maxDepth = pDepthRow[x];
+                    }
+                }
+            }
+
+            __declspec(align(16)) float lanes[4];
+            _mm_store_ps(lanes, maxDepth4);
+            part.maxDepth = max(max(maxDepth, max(lanes[0], lanes[1])), max(lanes[2], lanes[3]));
+        });
+
+        return total.maxDepth;
+    }
+
+    /// <summary>
+    /// Update the running average of a BGRA color voxel, where the alpha byte stores the color weight.
+    /// </summary>
+    /// <param name="colorVoxel">The color voxel to update.</param>
+    /// <param name="color">The observed BGRA color.</param>
+    /// <param name="maxWeight">The maximum color weight, at most 255.</param>
+    inline void UpdateColorVoxel(unsigned int &colorVoxel, unsigned int color, unsigned int maxWeight)
+    {
+        unsigned int weight = colorVoxel >> 24;
+        unsigned int newWeight = min(weight + 1, maxWeight);
+
+        unsigned int result = newWeight << 24;
+        for (unsigned int shift = 0; shift < 24; shift += 8)
+        {
+            unsigned int oldChannel = (colorVoxel >> shift) & 0xFF;
+            unsigned int newChannel = (color >> shift) & 0xFF;
+            unsigned int channel = ((oldChannel * weight) + newChannel + ((weight + 1) >> 1)) / (weight + 1);
+            result |= min(channel, 255u) << shift;
+        }
+
+        colorVoxel = result;
+    }
+
+    /// <summary>
+    /// Integrate a run of voxels along the volume x axis with SSE2, four voxels at a time.
+    /// </summary>
+    /// <param name="frame">The frame being integrated.</param>
+    /// <param name="volumeToCamera">The volume to camera transform.</param>
+    /// <param name="x">The volume x coordinate of the first voxel in the run.</param>
+    /// <param name="y">The volume y coordinate of the run.</param>
+    /// <param name="z">The volume z coordinate of the run.</param>
+    /// <param name="count">The number of voxels in the run, a multiple of 4.</param>
+    /// <param name="first">The index of the first voxel in the run to update.</param>
+    /// <param name="last">The index of the last voxel in the run to update.</param>
+    /// <param name="pVoxels">The voxels of the run.</param>
+    /// <param name="pColorVoxels">The color voxels of the run, or nullptr to integrate depth only.</param>
+    /// <param name="pChangedBlocks">Flags set to 1 for each block of BlockSize voxels along the run whose signed
+    /// distance or color changed, or nullptr. The run must then start on a block boundary.</param>
+    inline void IntegrateVoxelRun(
+        const IntegrationFrame &frame,
+        const Matrix4 &volumeToCamera,
+        int x,
+        int y,
+        int z,
+        int count,
+        int first,
+        int last,
+        unsigned int *pVoxels,
+        unsigned int *pColorVoxels,
+        unsigned char *pChangedBlocks)
+    {
+        // Camera space position of the first voxel; positions along the run are linear in x
+        const float baseX = volumeToCamera.M41 + (volumeToCamera.M11 * x) + (volumeToCamera.M21 * y) + (volumeToCamera.M31 * z);
+        const float baseY = volumeToCamera.M42 + (volumeToCamera.M12 * x) + (volumeToCamera.M22 * y) + (volumeToCamera.M32 * z);
+        const float baseZ = volumeToCamera.M43 + (volumeToCamera.M13 * x) + (volumeToCamera.M23 * y) + (volumeToCamera.M33 * z);
+
+        const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 vBaseX = _mm_set1_ps(baseX);
+        const __m128 vBaseY = _mm_set1_ps(baseY);
+        const __m128 vBaseZ = _mm_set1_ps(baseZ);
+        const __m128 stepX = _mm_set1_ps(volumeToCamera.M11);
+        const __m128 stepY = _mm_set1_ps(volumeToCamera.M12);
+        const __m128 stepZ = _mm_set1_ps(volumeToCamera.M13);
+        const __m128 vFlx = _mm_set1_ps(frame.flx);
+        const __m128 vFly = _mm_set1_ps(frame.fly);
+        const __m128 vPpx = _mm_set1_ps(frame.ppx + 0.5f);
+        const __m128 vPpy = _mm_set1_ps(frame.ppy + 0.5f);
+        const __m128 vWidth = _mm_set1_ps(static_cast<float>(frame.width));
+        const __m128 vHeight = _mm_set1_ps(static_cast<float>(frame.height));
+        const __m128 vFirst = _mm_set1_ps(static_cast<float>(first));
+        const __m128 vLast = _mm_set1_ps(static_cast<float>(last));
+        const __m128 vMinimumDepth = _mm_set1_ps(MinimumDepth);
+        const __m128 vZero = _mm_setzero_ps();
+        const __m128 vOne = _mm_set1_ps(1.0f);
+        const __m128 vNegativeOne = _mm_set1_ps(-1.0f);
+        const __m128 vMaxWeight = _mm_set1_ps(frame.maxWeight);
+        const __m128 vOneOverTruncation = _mm_set1_ps(1.0f / TruncationDistance);
+        const __m128 vTsdfScale = _mm_set1_ps(TsdfScale);
+        const __m128 vInverseTsdfScale = _mm_set1_ps(InverseTsdfScale);
+        const __m128i vLowMask = _mm_set1_epi32(0xFFFF);
+        const __m128i vZeroInt = _mm_setzero_si128();
+
+        __declspec(align(16)) float laneDepth[4];
+        __declspec(align(16)) float laneTsdf[4];
+        __declspec(align(16)) int lanePixelX[4];
+        __declspec(align(16)) int lanePixelY[4];
+
+        for (int i = first & ~3; i <= last && i < count; i += 4)
+        {
+            const __m128 vIndex = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), laneOffsets);
+
+            // Transform the 4 voxels into the camera and project them into the depth image
+            const __m128 cameraX = _mm_add_ps(vBaseX, _mm_mul_ps(vIndex, stepX));
+            const __m128 cameraY = _mm_add_ps(vBaseY, _mm_mul_ps(vIndex, stepY));
+            const __m128 cameraZ = _mm_add_ps(vBaseZ, _mm_mul_ps(vIndex, stepZ));
+
+            __m128 inRange = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(vIndex, vFirst), _mm_cmple_ps(vIndex, vLast)),
+                _mm_cmpge_ps(cameraZ, vMinimumDepth));
+
+            if (0 == _mm_movemask_ps(inRange))
+            {
+                continue;
+            }
+
+            // Guard the division for lanes behind the camera
+            const __m128 oneOverZ = _mm_div_ps(vOne, _mm_or_ps(_mm_and_ps(inRange, cameraZ), _mm_andnot_ps(inRange, vOne)));
+
+            // u and v include the half pixel offset, so truncation rounds to the nearest pixel
+            const __m128 u = _mm_add_ps(vPpx, _mm_mul_ps(vFlx, _mm_mul_ps(cameraX, oneOverZ)));
+            const __m128 v = _mm_add_ps(vPpy, _mm_mul_ps(vFly, _mm_mul_ps(cameraY, oneOverZ)));
+
+            inRange = _mm_and_ps(inRange, _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(u, vZero), _mm_cmplt_ps(u, vWidth)),
+                _mm_and_ps(_mm_cmpge_ps(v, vZero), _mm_cmplt_ps(v, vHeight))));
+
+            const int laneMask = _mm_movemask_ps(inRange);
+            if (0 == laneMask)
+            {
+                continue;
+            }
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanePixelX), _mm_cvttps_epi32(_mm_and_ps(inRange, u)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanePixelY), _mm_cvttps_epi32(_mm_and_ps(inRange, v)));
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                laneDepth[lane] = (laneMask & (1 << lane))
+                    ? reinterpret_cast<const float*>(frame.pDepth + (lanePixelY[lane] * frame.depthPitch))[lanePixelX[lane]]
+                    : 0.0f;
+            }
+
+            // Signed distance from the voxel to the observed surface along the camera z axis
+            const __m128 depth = _mm_load_ps(laneDepth);
+            const __m128 sdf = _mm_sub_ps(depth, cameraZ);
+            const __m128 tsdf = _mm_min_ps(_mm_mul_ps(sdf, vOneOverTruncation), vOne);
+
+            const __m128 update = _mm_and_ps(inRange, _mm_and_ps(_mm_cmpgt_ps(depth, vZero), _mm_cmpge_ps(tsdf, vNegativeOne)));
+            const int updateMask = _mm_movemask_ps(update);
+            if (0 == updateMask)
+            {
+                continue;
+            }
+
+            // Weighted running average of the stored and observed signed distance
+            const __m128i voxels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pVoxels + i));
+            const __m128 oldTsdf = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(voxels, 16), 16)), vInverseTsdfScale);
+            const __m128 oldWeight = _mm_cvtepi32_ps(_mm_srli_epi32(voxels, 16));
+
+            const __m128 newTsdf = _mm_div_ps(_mm_add_ps(_mm_mul_ps(oldTsdf, oldWeight), tsdf), _mm_add_ps(oldWeight, vOne));
+            const __m128 newWeight = _mm_min_ps(_mm_add_ps(oldWeight, vOne), vMaxWeight);
+
+            const __m128i packed = _mm_or_si128(
+                _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(newTsdf, vTsdfScale)), vLowMask),
+                _mm_slli_epi32(_mm_cvtps_epi32(newWeight), 16));
+
+            const __m128i updateInt = _mm_castps_si128(update);
+            const __m128i result = _mm_or_si128(_mm_and_si128(updateInt, packed), _mm_andnot_si128(updateInt, voxels));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pVoxels + i), result);
+
+            if (nullptr != pChangedBlocks)
+            {
+                // Meshes depend on the signed distance, and on whether a voxel has been observed, but not on
+                // the weight, so free space voxels which only gain weight do not change their block
+                const __m128i sameTsdf = _mm_cmpeq_epi32(_mm_and_si128(result, vLowMask), _mm_and_si128(voxels, vLowMask));
+                const __m128i changed = _mm_or_si128(
+                    _mm_andnot_si128(sameTsdf, updateInt),
+                    _mm_and_si128(updateInt, _mm_cmpeq_epi32(voxels, vZeroInt)));
+
+                if (0 != _mm_movemask_epi8(changed))
+                {
+                    pChangedBlocks[i / BlockSize] = 1;
+                }
+            }
+
+            if (nullptr == pColorVoxels || nullptr == frame.pColor)
+            {
+                continue;
+            }
+
+            // Color is only integrated close to the surface
+            _mm_store_ps(laneTsdf, tsdf);
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if ((updateMask & (1 << lane)) && laneTsdf[lane] < 1.0f)
+                {
+                    unsigned int color = reinterpret_cast<const unsigned int*>(frame.pColor + (lanePixelY[lane] * frame.colorPitch))[lanePixelX[lane]];
+
+                    // Depth pixels without a mapped color pixel are zero
+                    if (0 != (color & 0x00FFFFFF))
+                    {
+                        const unsigned int oldColorVoxel = pColorVoxels[i + lane];
+                        UpdateColorVoxel(pColorVoxels[i + lane], color, frame.maxColorWeight);
+
+                        // Meshes take the color but not the color weight
+                        if (nullptr != pChangedBlocks && 0 != ((oldColorVoxel ^ pColorVoxels[i + lane]) & 0x00FFFFFF))
+                        {
+                            pChangedBlocks[i / BlockSize] = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Trilinearly sample the signed distance at a point in volume coordinates.
+    /// </summary>
+    /// <param name="volume">The voxel accessor.</param>
+    /// <param name="x">The x coordinate in voxels.</param>
+    /// <param name="y">The y coordinate in voxels.</param>
+    /// <param name="z">The z coordinate in voxels.</param>
+    /// <param name="tsdf">Returns the signed distance in units of the truncation distance.</param>
+    /// <returns>false if any of the neighboring voxels has never been observed.</returns>
+    template <class VoxelAccessor>
+    inline bool SampleTsdf(const VoxelAccessor &volume, float x, float y, float z, float &tsdf)
+    {
+        const int ix = static_cast<int>(x);
+        const int iy = static_cast<int>(y);
+        const int iz = static_cast<int>(z);
+
+        const float fx = x - ix;
+        const float fy = y - iy;
+        const float fz = z - iz;
+
+        unsigned int corners[8];
+        volume.Corners(ix, iy, iz, corners);
+
+        for (int i = 0; i < 8; ++i)
+        {
+            if (0 == corners[i])
+            {
+                return false;
+            }
+        }
+
+        const float t00 = lerp(Tsdf(corners[0]), Tsdf(corners[1]), fx);
+        const float t10 = lerp(Tsdf(corners[2]), Tsdf(corners[3]), fx);
+        const float t01 = lerp(Tsdf(corners[4]), Tsdf(corners[5]), fx);
+        const float t11 = lerp(Tsdf(corners[6]), Tsdf(corners[7]), fx);
+
+        tsdf = lerp(lerp(t00, t10, fy), lerp(t01, t11, fy), fz);
+        return true;
+    }
+
+    /// <summary>
+    /// The locked output images, camera and bounds of a raycast.
+    /// </summary>
+    struct RaycastFrame
+    {
+        BYTE*                   pPointCloud;
+        int                     pointCloudPitch;
+        BYTE*                   pDepth;
+        int                     depthPitch;
+        BYTE*                   pColor;
+        int                     colorPitch;
+        unsigned int            width;
+        unsigned int            height;
+        float                   flx;
+        float                   fly;
+        float                   ppx;
+        float                   ppy;
+        float                   voxelsPerMeter;
+        float                   boxMin[3];
+        float                   boxMax[3];
+        bool                    hasColor;
+    };
+
+    /// <summary>
+    /// Raycast a volume, writing world space points and normals and optionally depth and color
+    /// for each pixel. Pixels without a surface are set to zero.
+    /// </summary>
+    /// <param name="volume">The voxel accessor.</param>
+    /// <param name="frame">The raycast output images and bounds.</param>
+    /// <param name="worldToVolume">The world to volume transform.</param>
+    /// <param name="worldToCamera">The camera pose to raycast from.</param>
+    template <class VoxelAccessor>
+    void RaycastVolume(const VoxelAccessor &volume, const RaycastFrame &frame, const Matrix4 &worldToVolume, const Matrix4 &worldToCamera)
+    {
+        const Matrix4 volumeToWorld = InvertMatrix4Affine(worldToVolume);
+        const Matrix4 cameraToVolume = MultiplyMatrix4(InvertMatrix4Pose(worldToCamera), worldToVolume);
+
+        // Rays start at the camera center and are parameterized by camera space depth
+        const float start[3] = { cameraToVolume.M41, cameraToVolume.M42, cameraToVolume.M43 };
+
+        const float halfVoxel = 0.5f / frame.voxelsPerMeter;
+
+        Concurrency::parallel_for(0u, frame.height, [&](unsigned int y)
+        {
+            float *pPointRow = reinterpret_cast<float*>(frame.pPointCloud + (y * frame.pointCloudPitch));
+            float *pDepthRow = (nullptr != frame.pDepth) ? reinterpret_cast<float*>(frame.pDepth + (y * frame.depthPitch)) : nullptr;
+            unsigned int *pColorRow = (nullptr != frame.pColor) ? reinterpret_cast<unsigned int*>(frame.pColor + (y * frame.colorPitch)) : nullptr;
+
+            for (unsigned int x = 0; x < frame.width; ++x)
+            {
+                float *pPoint = pPointRow + (x * 6);
+                ZeroMemory(pPoint, 6 * sizeof(float));
+
+                if (nullptr != pDepthRow)
+                {
+                    pDepthRow[x] = 0.0f;
+                }
+
+                if (nullptr != pColorRow)
+                {
+                    pColorRow[x] = 0;
+                }
+
+                Vector3 cameraRay;
+                cameraRay.x = (static_cast<float>(x) - frame.ppx) / frame.flx;
+                cameraRay.y = (static_cast<float>(y) - frame.ppy) / frame.fly;
+                cameraRay.z = 1.0f;
+
+                const float rayLength = sqrtf(dot_normalized(cameraRay, cameraRay));
+
+                float direction[3];
+                direction[0] = (cameraToVolume.M11 * cameraRay.x) + (cameraToVolume.M21 * cameraRay.y) + (cameraToVolume.M31 * cameraRay.z);
+                direction[1] = (cameraToVolume.M12 * cameraRay.x) + (cameraToVolume.M22 * cameraRay.y) + (cameraToVolume.M32 * cameraRay.z);
+                direction[2] = (cameraToVolume.M13 * cameraRay.x) + (cameraToVolume.M23 * cameraRay.y) + (cameraToVolume.M33 * cameraRay.z);
+
+                // Intersect the ray with the volume bounds
+                float tEnter = MinimumDepth;
+                float tExit = FLT_MAX;
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    if (fabsf(direction[axis]) < 1e-9f)
+                    {
+                        if (start[axis] < frame.boxMin[axis] || start[axis] > frame.boxMax[axis])
+                        {
+                            tExit = -1.0f;
+                        }
+                        continue;
+                    }
+
+                    float t0 = (frame.boxMin[axis] - start[axis]) / direction[axis];
+                    float t1 = (frame.boxMax[axis] - start[axis]) / direction[axis];
+
+                    tEnter = max(tEnter, min(t0, t1));
+                    tExit = min(tExit, max(t0, t1));
+                }
+
+                if (tEnter >= tExit)
+                {
+                    continue;
+                }
+
+                const float truncationStep = TruncationDistance * 0.8f / rayLength;
+                const float minimumStep = halfVoxel / rayLength;
+
+                float t = tEnter;
+                float previousT = 0.0f;
+                float previousTsdf = 0.0f;
+                bool hasPrevious = false;
+                bool hit = false;
+                float surfaceT = 0.0f;
+
+                while (t < tExit)
+                {
+                    const float px = start[0] + direction[0] * t;
+                    const float py = start[1] + direction[1] * t;
+                    const float pz = start[2] + direction[2] * t;
+
+                    // Skip through unobserved and free space using the nearest voxel before sampling trilinearly
+                    const unsigned int nearest = volume.Voxel(static_cast<int>(px + 0.5f), static_cast<int>(py + 0.5f), static_cast<int>(pz + 0.5f));
+                    if (0 == nearest)
+                    {
+                        hasPrevious = false;
+                        t = max(t + truncationStep * 0.5f, volume.SkipUnallocated(start, direction, t));
+                        continue;
+                    }
+
+                    float tsdf = Tsdf(nearest);
+                    if (tsdf < 0.99f && !SampleTsdf(volume, px, py, pz, tsdf))
+                    {
+                        hasPrevious = false;
+                        t += minimumStep;
+                        continue;
+                    }
+
+                    if (tsdf <= 0.0f)
+                    {
+                        if (hasPrevious)
+                        {
+                            // Zero crossing: interpolate, then refine with two secant steps
+                            float tFront = previousT;
+                            float tsdfFront = previousTsdf;
+                            float tBack = t;
+                            float tsdfBack = tsdf;
+
+                            surfaceT = tFront + (tBack - tFront) * tsdfFront / (tsdfFront - tsdfBack);
+
+                            for (int iteration = 0; iteration < 2; ++iteration)
+                            {
+                                float tsdfSurface;
+                                if (!SampleTsdf(volume, start[0] + direction[0] * surfaceT, start[1] + direction[1] * surfaceT, start[2] + direction[2] * surfaceT, tsdfSurface))
+                                {
+                                    break;
+                                }
+
+                                if (tsdfSurface > 0.0f)
+                                {
+                                    tFront = surfaceT;
+                                    tsdfFront = tsdfSurface;
+                                }
+                                else
+                                {
+                                    tBack = surfaceT;
+                                    tsdfBack = tsdfSurface;
+                                }
+
+                                if (tsdfFront == tsdfBack)
+                                {
+                                    break;
+                                }
+
+                                surfaceT = tFront + (tBack - tFront) * tsdfFront / (tsdfFront - tsdfBack);
+                            }
+
+                            hit = true;
+                        }
+
+                        // Either the surface, or the back of a surface observed from another side
+                        break;
+                    }
+
+                    previousT = t;
+                    previousTsdf = tsdf;
+                    hasPrevious = true;
+
+                    t += max(tsdf * truncationStep, minimumStep);
+                }
+
+                if (!hit)
+                {
+                    continue;
+                }
+
+                const float sx = start[0] + direction[0] * surfaceT;
+                const float sy = start[1] + direction[1] * surfaceT;
+                const float sz = start[2] + direction[2] * surfaceT;
+
+                // Surface normal from the central difference gradient of the signed distance
+                float xPlus, xMinus, yPlus, yMinus, zPlus, zMinus;
+                if (!SampleTsdf(volume, sx + 1.0f, sy, sz, xPlus) || !SampleTsdf(volume, sx - 1.0f, sy, sz, xMinus)
+                    || !SampleTsdf(volume, sx, sy + 1.0f, sz, yPlus) || !SampleTsdf(volume, sx, sy - 1.0f, sz, yMinus)
+                    || !SampleTsdf(volume, sx, sy, sz + 1.0f, zPlus) || !SampleTsdf(volume, sx, sy, sz - 1.0f, zMinus))
+                {
+                    continue;
+                }
+
+                const float gx = xPlus - xMinus;
+                const float gy = yPlus - yMinus;
+                const float gz = zPlus - zMinus;
+
+                // Gradients transform to world space by the transpose of the world to volume linear part
+                Vector3 normal;
+                normal.x = (worldToVolume.M11 * gx) + (worldToVolume.M12 * gy) + (worldToVolume.M13 * gz);
+                normal.y = (worldToVolume.M21 * gx) + (worldToVolume.M22 * gy) + (worldToVolume.M23 * gz);
+                normal.z = (worldToVolume.M31 * gx) + (worldToVolume.M32 * gy) + (worldToVolume.M33 * gz);
+
+                const float normalLength = sqrtf(dot_normalized(normal, normal));
+                if (normalLength <= 0.0f)
+                {
+                    continue;
+                }
+
+                Vector3 surfaceVolume;
+                surfaceVolume.x = sx;
+                surfaceVolume.y = sy;
+                surfaceVolume.z = sz;
+
+                const Vector3 surfaceWorld = transform(surfaceVolume, volumeToWorld);
+
+                pPoint[0] = surfaceWorld.x;
+                pPoint[1] = surfaceWorld.y;
+                pPoint[2] = surfaceWorld.z;
+                pPoint[3] = normal.x / normalLength;
+                pPoint[4] = normal.y / normalLength;
+                pPoint[5] = normal.z / normalLength;
+
+                if (nullptr != pDepthRow)
+                {
+                    pDepthRow[x] = surfaceT;
+                }
+
+                if (nullptr != pColorRow && frame.hasColor)
+                {
+                    const unsigned int colorVoxel = volume.ColorVoxel(static_cast<int>(sx + 0.5f), static_cast<int>(sy + 0.5f), static_cast<int>(sz + 0.5f));
+                    if (0 != colorVoxel)
+                    {
+                        pColorRow[x] = colorVoxel | 0xFF000000;
+                    }
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,706 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiColorToDepthRemap.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <new>
+#include <intrin.h>
+#include <NuiApi.h>
+
+// Every x86 and x64 compiler builds the SSE2 path, which is what the Visual Studio 2010
+// toolset of the sample projects runs. The AVX2 gather intrinsics first shipped with the
+// Visual Studio 2012 compiler, so only projects built with a later toolset get the AVX2 path.
+#if defined(_M_IX86) || defined(_M_X64)
+#define NUI_COLOR_REMAP_SSE2 1
+#include <emmintrin.h>
+#else
+#define NUI_COLOR_REMAP_SSE2 0
+#endif
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700) && (defined(_M_IX86) || defined(_M_X64))
+#define NUI_COLOR_REMAP_AVX2 1
+#include <immintrin.h>
+#else
+#define NUI_COLOR_REMAP_AVX2 0
+#endif
+
+/// <summary>
+/// Times of NuiColorToDepthRemap::Benchmark in milliseconds per frame. Apply paths which are
+/// not built or not supported by the processor have a negative time.
+/// </summary>
+struct NuiColorToDepthRemapBenchmark
+{
+    enum Path
+    {
+        PathScalar,
+        PathSse2,
+        PathAvx2,
+        PathCount
+    };
+
+    UINT                        depthWidth;
+    UINT                        depthHeight;
+    UINT                        colorWidth;
+    UINT                        colorHeight;
+    double                      rebuildTime;            // BeginFrame and UpdateTable of a changed frame
+    double                      cachedTime;             // BeginFrame of a frame the table still fits
+    double                      applyTime[PathCount];
+};
+
+/// <summary>
+/// Remaps a color frame into depth space, given the color coordinates of each depth pixel.
+///
+/// The depth to color coordinates, the bounds checks, the pixel mask, the output scale and the
+/// horizontal flip are resolved once into a table holding the color pixel index of every output
+/// pixel (or -1 where the output keeps its fallback pixel), so each remap is a single gather.
+/// As the coordinates only move when the depth does, the table is kept from frame to frame while
+/// the depth stays within a tolerance, which also saves recalculating the coordinates.
+/// The gather runs on AVX2 where it is built and supported, otherwise on SSE2.
+///
+/// Per frame:
+///     if (remap.BeginFrame(pDepth))
+///     {
+///         calculate the color coordinates of pDepth, then remap.UpdateTable(pColorCoordinates);
+///     }
+///     remap.Apply(pColor, pOutput, outputPitch, pFallback);
+/// </summary>
+class NuiColorToDepthRemap
+{
+public:
+    /// <summary>
+    /// Which depth pixels take their color from the color frame. The others keep the fallback.
+    /// </summary>
+    enum MaskMode
+    {
+        MapAllPixels,       // every depth pixel which maps inside the color frame
+        MapNonZeroDepth,    // only depth pixels with a valid depth
+        MapPlayerPixels     // only depth pixels belonging to a player
+    };
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    NuiColorToDepthRemap() :
+        m_depthWidth(0),
+        m_depthHeight(0),
+        m_colorWidth(0),
+        m_colorHeight(0),
+        m_outputScale(0),
+        m_bFlipHorizontal(false),
+        m_maskMode(MapAllPixels),
+        m_depthTolerance(0),
+        m_maxChangedPixels(0),
+        m_bTableValid(false),
+        m_path(NuiColorToDepthRemapBenchmark::PathScalar),
+        m_pTable(nullptr),
+        m_pTableKeys(nullptr),
+        m_pFrameKeys(nullptr)
+    {
+    }
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~NuiColorToDepthRemap()
+    {
+        FreeBuffers();
+    }
+
+    /// <summary>
+    /// Set the layout of the remap. Cheap when the layout is unchanged, so it may be called per frame.
+    /// </summary>
+    /// <param name="depthWidth">Width of the depth frame.</param>
+    /// <param name="depthHeight">Height of the depth frame.</param>
+    /// <param name="colorWidth">Width of the color frame.</param>
+    /// <param name="colorHeight">Height of the color frame.</param>
+    /// <param name="outputScale">Output pixels per depth pixel along each axis: 1 for a depth sized
+    /// output, or the color to depth ratio for a color sized output.</param>
+    /// <param name="flipHorizontal">Whether to mirror the output horizontally.</param>
+    /// <param name="maskMode">Which depth pixels take their color from the color frame.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Initialize(
+        UINT depthWidth,
+        UINT depthHeight,
+        UINT colorWidth,
+        UINT colorHeight,
+        UINT outputScale,
+        bool flipHorizontal,
+        MaskMode maskMode)
+    {
+        if (0 == depthWidth || 0 == depthHeight || 0 == colorWidth || 0 == colorHeight || 0 == outputScale)
+        {
+            return E_INVALIDARG;
+        }
+
+        if (depthWidth == m_depthWidth && depthHeight == m_depthHeight &&
+            colorWidth == m_colorWidth && colorHeight == m_colorHeight &&
+            outputScale == m_outputScale && flipHorizontal == m_bFlipHorizontal &&
+            maskMode == m_maskMode && nullptr != m_pTable)
+        {
+            return S_OK;
+        }
+
+        FreeBuffers();
+
+        m_depthWidth = depthWidth;
+        m_depthHeight = depthHeight;
+        m_colorWidth = colorWidth;
+        m_colorHeight = colorHeight;
+        m_outputScale = outputScale;
+        m_bFlipHorizontal = flipHorizontal;
+        m_maskMode = maskMode;
+        m_path = CpuSupportsAvx2() ? NuiColorToDepthRemapBenchmark::PathAvx2 :
+            (CpuSupportsSse2() ? NuiColorToDepthRemapBenchmark::PathSse2 : NuiColorToDepthRemapBenchmark::PathScalar);
+
+        UINT depthPixels = depthWidth * depthHeight;
+        m_pTable = new(std::nothrow) int[depthPixels * outputScale * outputScale];
+        m_pTableKeys = new(std::nothrow) USHORT[depthPixels];
+        m_pFrameKeys = new(std::nothrow) USHORT[depthPixels];
+
+        if (nullptr == m_pTable || nullptr == m_pTableKeys || nullptr == m_pFrameKeys)
+        {
+            FreeBuffers();
+            return E_OUTOFMEMORY;
+        }
+
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Set how far the depth may drift before the table has to be rebuilt. The table is rebuilt
+    /// once more than maxChangedPixels depth pixels moved by more than the tolerance, or changed
+    /// mask state, since it was built. A zero tolerance rebuilds the table every frame.
+    /// </summary>
+    /// <param name="depthToleranceMillimeters">Largest depth change which leaves a pixel unchanged.</param>
+    /// <param name="maxChangedPixels">Number of changed pixels tolerated.</param>
+    void SetCacheTolerance(USHORT depthToleranceMillimeters, UINT maxChangedPixels)
+    {
+        m_depthTolerance = depthToleranceMillimeters;
+        m_maxChangedPixels = maxChangedPixels;
+    }
+
+    /// <summary>
+    /// Discard the table, e.g. when the mapping between the cameras changed.
+    /// </summary>
+    void Invalidate()
+    {
+        m_bTableValid = false;
+    }
+
+    /// <summary>
+    /// Start remapping a new depth frame.
+    /// </summary>
+    /// <param name="pDepth">The extended depth pixels of the frame.</param>
+    /// <returns>true if the color coordinates must be calculated and passed to UpdateTable</returns>
+    bool BeginFrame(const NUI_DEPTH_IMAGE_PIXEL *pDepth)
+    {
+        if (nullptr == m_pFrameKeys || nullptr == pDepth)
+        {
+            return false;
+        }
+
+        UINT depthPixels = m_depthWidth * m_depthHeight;
+        for (UINT i = 0; i < depthPixels; ++i)
+        {
+            m_pFrameKeys[i] = MakeKey(pDepth[i].depth, pDepth[i].playerIndex);
+        }
+
+        return TableNeedsUpdate();
+    }
+
+    /// <summary>
+    /// Start remapping a new depth frame.
+    /// </summary>
+    /// <param name="pDepthD16">The packed depth and player index pixels of the frame.</param>
+    /// <returns>true if the color coordinates must be calculated and passed to UpdateTable</returns>
+    bool BeginFrame(const USHORT *pDepthD16)
+    {
+        if (nullptr == m_pFrameKeys || nullptr == pDepthD16)
+        {
+            return false;
+        }
+
+        UINT depthPixels = m_depthWidth * m_depthHeight;
+        for (UINT i = 0; i < depthPixels; ++i)
+        {
+            m_pFrameKeys[i] = MakeKey(NuiDepthPixelToDepth(pDepthD16[i]), NuiDepthPixelToPlayerIndex(pDepthD16[i]));
+        }
+
+        return TableNeedsUpdate();
+    }
+
+    /// <summary>
+    /// Rebuild the table for the frame passed to the last BeginFrame.
+    /// </summary>
+    /// <param name="pColorCoordinates">The color coordinates of each depth pixel.</param>
+    void UpdateTable(const NUI_COLOR_IMAGE_POINT *pColorCoordinates)
+    {
+        if (nullptr == m_pTable || nullptr == pColorCoordinates)
+        {
+            return;
+        }
+
+        UINT outputWidth = GetOutputWidth();
+        UINT outputHeight = GetOutputHeight();
+        LONG colorWidth = static_cast<LONG>(m_colorWidth);
+        LONG colorHeight = static_cast<LONG>(m_colorHeight);
+
+        for (UINT y = 0; y < outputHeight; ++y)
+        {
+            int *pTableRow = m_pTable + y * outputWidth;
+            UINT depthRowIndex = (y / m_outputScale) * m_depthWidth;
+
+            for (UINT x = 0; x < outputWidth; ++x)
+            {
+                UINT depthX = m_bFlipHorizontal ? (outputWidth - 1 - x) / m_outputScale : x / m_outputScale;
+                UINT depthIndex = depthRowIndex + depthX;
+
+                int colorIndex = -1;
+                if (0 != m_pFrameKeys[depthIndex])
+                {
+                    LONG colorX = pColorCoordinates[depthIndex].x;
+                    LONG colorY = pColorCoordinates[depthIndex].y;
+
+                    // make sure the depth pixel maps to a valid point in color space
+                    if (colorX >= 0 && colorX < colorWidth && colorY >= 0 && colorY < colorHeight)
+                    {
+                        colorIndex = static_cast<int>(colorX + colorY * colorWidth);
+                    }
+                }
+
+                pTableRow[x] = colorIndex;
+            }
+        }
+
+        // The table now belongs to this frame's depth
+        USHORT *pKeys = m_pTableKeys;
+        m_pTableKeys = m_pFrameKeys;
+        m_pFrameKeys = pKeys;
+        m_bTableValid = true;
+    }
+
+    /// <summary>
+    /// Rebuild the table for the frame passed to the last BeginFrame.
+    /// </summary>
+    /// <param name="pColorCoordinates">The interleaved x, y color coordinates of each depth pixel.</param>
+    void UpdateTable(const LONG *pColorCoordinates)
+    {
+        // NUI_COLOR_IMAGE_POINT is an x, y pair of LONGs
+        UpdateTable(reinterpret_cast<const NUI_COLOR_IMAGE_POINT*>(pColorCoordinates));
+    }
+
+    /// <summary>
+    /// Remap the color frame into the output image.
+    /// </summary>
+    /// <param name="pColor">The 32bpp color pixels, rows packed without padding.</param>
+    /// <param name="pOutput">The 32bpp output image of GetOutputWidth x GetOutputHeight pixels.</param>
+    /// <param name="outputPitch">The size of a row of the output image in bytes.</param>
+    /// <param name="pFallback">The 32bpp pixels written where no color maps, packed like the output
+    /// without padding, or nullptr to write zero.</param>
+    void Apply(const BYTE *pColor, BYTE *pOutput, UINT outputPitch, const BYTE *pFallback) const
+    {
+        UINT outputHeight = GetOutputHeight();
+        for (UINT y = 0; y < outputHeight; ++y)
+        {
+            ApplyRow(pColor, pOutput, outputPitch, pFallback, y);
+        }
+    }
+
+    /// <summary>
+    /// Remap one row of the output image. Rows are independent, so may be remapped in parallel.
+    /// </summary>
+    /// <param name="pColor">The 32bpp color pixels, rows packed without padding.</param>
+    /// <param name="pOutput">The 32bpp output image of GetOutputWidth x GetOutputHeight pixels.</param>
+    /// <param name="outputPitch">The size of a row of the output image in bytes.</param>
+    /// <param name="pFallback">The 32bpp pixels written where no color maps, packed like the output
+    /// without padding, or nullptr to write zero.</param>
+    /// <param name="y">The output row to remap.</param>
+    void ApplyRow(const BYTE *pColor, BYTE *pOutput, UINT outputPitch, const BYTE *pFallback, UINT y) const
+    {
+        UINT outputWidth = GetOutputWidth();
+        int *pDest = reinterpret_cast<int*>(pOutput + y * outputPitch);
+        const int *pFallbackRow = (nullptr != pFallback) ? reinterpret_cast<const int*>(pFallback) + y * outputWidth : nullptr;
+
+        if (!m_bTableValid)
+        {
+            // Nothing maps until the first table is built
+            for (UINT x = 0; x < outputWidth; ++x)
+            {
+                pDest[x] = (nullptr != pFallbackRow) ? pFallbackRow[x] : 0;
+            }
+
+            return;
+        }
+
+        const int *pSrc = reinterpret_cast<const int*>(pColor);
+        const int *pIndices = m_pTable + y * outputWidth;
+        UINT x = 0;
+
+#if NUI_COLOR_REMAP_AVX2
+        if (NuiColorToDepthRemapBenchmark::PathAvx2 == m_path)
+        {
+            x = GatherRowAvx2(pSrc, pIndices, pFallbackRow, pDest, outputWidth);
+        }
+#endif
+
+#if NUI_COLOR_REMAP_SSE2
+        if (NuiColorToDepthRemapBenchmark::PathSse2 == m_path)
+        {
+            x = GatherRowSse2(pSrc, pIndices, pFallbackRow, pDest, outputWidth);
+        }
+#endif
+
+        for (; x < outputWidth; ++x)
+        {
+            int colorIndex = pIndices[x];
+            if (colorIndex >= 0)
+            {
+                pDest[x] = pSrc[colorIndex];
+            }
+            else
+            {
+                pDest[x] = (nullptr != pFallbackRow) ? pFallbackRow[x] : 0;
+            }
+        }
+    }
+
+    UINT                        GetOutputWidth() const { return m_depthWidth * m_outputScale; }
+    UINT                        GetOutputHeight() const { return m_depthHeight * m_outputScale; }
+
+    /// <summary>
+    /// Time rebuilding the table, checking a still valid table, and remapping on each path, for
+    /// a synthetic depth sized remap with a scene from 0.5m to 4.5m and scattered invalid depth.
+    /// </summary>
+    /// <param name="depthWidth">Width of the depth frame.</param>
+    /// <param name="depthHeight">Height of the depth frame.</param>
+    /// <param name="colorWidth">Width of the color frame.</param>
+    /// <param name="colorHeight">Height of the color frame.</param>
+    /// <param name="iterations">The number of calls timed per measurement.</param>
+    /// <param name="pResults">Returns the times.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    static HRESULT Benchmark(
+        UINT depthWidth,
+        UINT depthHeight,
+        UINT colorWidth,
+        UINT colorHeight,
+        UINT iterations,
+        NuiColorToDepthRemapBenchmark *pResults)
+    {
+        if (nullptr == pResults || 0 == iterations)
+        {
+            return E_INVALIDARG;
+        }
+
+        NuiColorToDepthRemap remap;
+        HRESULT hr = remap.Initialize(depthWidth, depthHeight, colorWidth, colorHeight, 1, true, MapNonZeroDepth);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        UINT depthPixels = depthWidth * depthHeight;
+        remap.SetCacheTolerance(20, depthPixels / 200);
+
+        NUI_DEPTH_IMAGE_PIXEL *pDepth = new(std::nothrow) NUI_DEPTH_IMAGE_PIXEL[depthPixels];
+        NUI_COLOR_IMAGE_POINT *pColorCoordinates = new(std::nothrow) NUI_COLOR_IMAGE_POINT[depthPixels];
+        int *pColor = new(std::nothrow) int[colorWidth * colorHeight];
+        int *pOutput = new(std::nothrow) int[depthPixels];
+
+        if (nullptr == pDepth || nullptr == pColorCoordinates || nullptr == pColor || nullptr == pOutput)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        else
+        {
+            for (UINT y = 0; y < depthHeight; ++y)
+            {
+                for (UINT x = 0; x < depthWidth; ++x)
+                {
+                    UINT i = y * depthWidth + x;
+                    USHORT depth = (0 == (x * 7 + y * 13) % 11) ? 0 : static_cast<USHORT>(500 + (x * y) % 4000);
+
+                    // The color camera sits beside the depth camera, so near pixels shift further
+                    pDepth[i].depth = depth;
+                    pDepth[i].playerIndex = 0;
+                    pColorCoordinates[i].x = static_cast<LONG>(x * colorWidth / depthWidth) - ((0 != depth) ? 10000 / depth : 0);
+                    pColorCoordinates[i].y = static_cast<LONG>(y * colorHeight / depthHeight);
+                }
+            }
+
+            for (UINT i = 0; i < colorWidth * colorHeight; ++i)
+            {
+                pColor[i] = static_cast<int>(i);
+            }
+
+            LARGE_INTEGER frequency, start, end;
+            QueryPerformanceFrequency(&frequency);
+            const double millisecondsPerCall = 1000.0 / (static_cast<double>(frequency.QuadPart) * iterations);
+
+            QueryPerformanceCounter(&start);
+            for (UINT i = 0; i < iterations; ++i)
+            {
+                remap.Invalidate();
+                if (remap.BeginFrame(pDepth))
+                {
+                    remap.UpdateTable(pColorCoordinates);
+                }
+            }
+            QueryPerformanceCounter(&end);
+            pResults->rebuildTime = (end.QuadPart - start.QuadPart) * millisecondsPerCall;
+
+            QueryPerformanceCounter(&start);
+            for (UINT i = 0; i < iterations; ++i)
+            {
+                if (remap.BeginFrame(pDepth))
+                {
+                    remap.UpdateTable(pColorCoordinates);
+                }
+            }
+            QueryPerformanceCounter(&end);
+            pResults->cachedTime = (end.QuadPart - start.QuadPart) * millisecondsPerCall;
+
+            const bool pathSupported[NuiColorToDepthRemapBenchmark::PathCount] =
+            {
+                true,
+                NUI_COLOR_REMAP_SSE2 && CpuSupportsSse2(),
+                NUI_COLOR_REMAP_AVX2 && CpuSupportsAvx2()
+            };
+
+            for (int path = 0; path < NuiColorToDepthRemapBenchmark::PathCount; ++path)
+            {
+                pResults->applyTime[path] = -1.0;
+
+                if (!pathSupported[path])
+                {
+                    continue;
+                }
+
+                remap.m_path = static_cast<NuiColorToDepthRemapBenchmark::Path>(path);
+
+                QueryPerformanceCounter(&start);
+                for (UINT i = 0; i < iterations; ++i)
+                {
+                    remap.Apply(reinterpret_cast<const BYTE*>(pColor), reinterpret_cast<BYTE*>(pOutput), depthWidth * sizeof(int), nullptr);
+                }
+                QueryPerformanceCounter(&end);
+                pResults->applyTime[path] = (end.QuadPart - start.QuadPart) * millisecondsPerCall;
+            }
+
+            pResults->depthWidth = depthWidth;
+            pResults->depthHeight = depthHeight;
+            pResults->colorWidth = colorWidth;
+            pResults->colorHeight = colorHeight;
+        }
+
+        delete[] pDepth;
+        delete[] pColorCoordinates;
+        delete[] pColor;
+        delete[] pOutput;
+
+        return hr;
+    }
+
+private:
+    // The remap owns its buffers, so is not copyable
+    NuiColorToDepthRemap(const NuiColorToDepthRemap&);
+    NuiColorToDepthRemap& operator=(const NuiColorToDepthRemap&);
+
+    // Keys hold the depth in millimeters below KeyMapped, which is set for pixels taking color
+    static const USHORT         KeyMapped = 0x8000;
+    static const USHORT         KeyDepthMask = 0x7FFF;
+
+    /// <summary>
+    /// Make the key of a depth pixel, which is zero when the pixel does not take color.
+    /// </summary>
+    USHORT MakeKey(USHORT depth, USHORT playerIndex) const
+    {
+        if ((MapNonZeroDepth == m_maskMode && 0 == depth) || (MapPlayerPixels == m_maskMode && 0 == playerIndex))
+        {
+            return 0;
+        }
+
+        return KeyMapped | (depth < KeyDepthMask ? depth : KeyDepthMask);
+    }
+
+    /// <summary>
+    /// Compare the keys of the current frame with those the table was built for.
+    /// </summary>
+    /// <returns>true if the table must be rebuilt</returns>
+    bool TableNeedsUpdate() const
+    {
+        if (!m_bTableValid || 0 == m_depthTolerance)
+        {
+            return true;
+        }
+
+        UINT depthPixels = m_depthWidth * m_depthHeight;
+        UINT changedPixels = 0;
+
+        for (UINT i = 0; i < depthPixels; ++i)
+        {
+            int frameKey = m_pFrameKeys[i];
+            int tableKey = m_pTableKeys[i];
+            int difference = (frameKey & KeyDepthMask) - (tableKey & KeyDepthMask);
+
+            if (((frameKey ^ tableKey) & KeyMapped) || difference > m_depthTolerance || -difference > m_depthTolerance)
+            {
+                if (++changedPixels > m_maxChangedPixels)
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+#if NUI_COLOR_REMAP_AVX2
+    /// <summary>
+    /// Gather a row eight pixels at a time.
+    /// </summary>
+    /// <returns>The number of pixels written, a multiple of eight</returns>
+    static UINT GatherRowAvx2(const int *pSrc, const int *pIndices, const int *pFallbackRow, int *pDest, UINT count)
+    {
+        const __m256i unmapped = _mm256_set1_epi32(-1);
+        UINT x = 0;
+
+        for (; x + 8 <= count; x += 8)
+        {
+            __m256i indices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIndices + x));
+            __m256i fallback = (nullptr != pFallbackRow) ?
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pFallbackRow + x)) : _mm256_setzero_si256();
+
+            // Lanes whose index is -1 are not loaded and keep the fallback pixel
+            __m256i mask = _mm256_cmpgt_epi32(indices, unmapped);
+            __m256i pixels = _mm256_mask_i32gather_epi32(fallback, pSrc, indices, mask, 4);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDest + x), pixels);
+        }
+
+        _mm256_zeroupper();
+        return x;
+    }
+#endif
+
+#if NUI_COLOR_REMAP_SSE2
+    /// <summary>
+    /// Select a row four pixels at a time. SSE2 has no gather, so the four color pixels are
+    /// loaded one by one, but the mask is applied without a branch per pixel.
+    /// </summary>
+    /// <returns>The number of pixels written, a multiple of four</returns>
+    static UINT GatherRowSse2(const int *pSrc, const int *pIndices, const int *pFallbackRow, int *pDest, UINT count)
+    {
+        const __m128i unmapped = _mm_set1_epi32(-1);
+        UINT x = 0;
+
+        for (; x + 4 <= count; x += 4)
+        {
+            // Lanes whose index is -1 load the first color pixel, which the mask then discards
+            int i0 = pIndices[x] & ~(pIndices[x] >> 31);
+            int i1 = pIndices[x + 1] & ~(pIndices[x + 1] >> 31);
+            int i2 = pIndices[x + 2] & ~(pIndices[x + 2] >> 31);
+            int i3 = pIndices[x + 3] & ~(pIndices[x + 3] >> 31);
+
+            __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIndices + x));
+            __m128i fallback = (nullptr != pFallbackRow) ?
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(pFallbackRow + x)) : _mm_setzero_si128();
+
+            __m128i mask = _mm_cmpgt_epi32(indices, unmapped);
+            __m128i pixels = _mm_set_epi32(pSrc[i3], pSrc[i2], pSrc[i1], pSrc[i0]);
+
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(pDest + x),
+                _mm_or_si128(_mm_and_si128(mask, pixels), _mm_andnot_si128(mask, fallback)));
+        }
+
+        return x;
+    }
+#endif
+
+    /// <summary>
+    /// Whether the processor supports SSE2.
+    /// </summary>
+    static bool CpuSupportsSse2()
+    {
+#if NUI_COLOR_REMAP_SSE2
+        return FALSE != IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#else
+        return false;
+#endif
+    }
+
+    /// <summary>
+    /// Whether the processor and operating system support AVX2.
+    /// </summary>
+    static bool CpuSupportsAvx2()
+    {
+#if NUI_COLOR_REMAP_AVX2
+        int cpuInfo[4];
+
+        __cpuid(cpuInfo, 0);
+        if (cpuInfo[0] < 7)
+        {
+            return false;
+        }
+
+        // The OS must save the YMM registers on a context switch
+        const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+        __cpuid(cpuInfo, 1);
+        if ((cpuInfo[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+
+        __cpuidex(cpuInfo, 7, 0);
+        return 0 != (cpuInfo[1] & (1 << 5));
+#else
+        return false;
+#endif
+    }
+
+    void FreeBuffers()
+    {
+        delete[] m_pTable;
+        delete[] m_pTableKeys;
+        delete[] m_pFrameKeys;
+
+        m_pTable = nullptr;
+        m_pTableKeys = nullptr;
+        m_pFrameKeys = nullptr;
+        m_bTableValid = false;
+    }
+
+    UINT                        m_depthWidth;
+    UINT                        m_depthHeight;
+    UINT                        m_colorWidth;
+    UINT                        m_colorHeight;
+    UINT                        m_outputScale;
+    bool                        m_bFlipHorizontal;
+    MaskMode                    m_maskMode;
+
+    int                         m_depthTolerance;
+    UINT                        m_maxChangedPixels;
+
+    bool                        m_bTableValid;
+    NuiColorToDepthRemapBenchmark::Path m_path;  // the Apply path selected for this processor
+    int*                        m_pTable;       // color pixel index of each output pixel, or -1
+    USHORT*                     m_pTableKeys;   // keys of the depth the table was built for
+    USHORT*                     m_pFrameKeys;   // keys of the depth passed to BeginFrame
+};
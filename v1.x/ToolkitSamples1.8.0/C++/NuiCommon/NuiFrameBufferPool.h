@@ -0,0 +1,504 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiFrameBufferPool.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <new>
+#include <windows.h>
+
+class NuiFrameBufferPool;
+
+/// <summary>
+/// A reference counted buffer from a NuiFrameBufferPool. The buffer goes back to its pool when
+/// the last reference is released, and may be handed out again for any size of its size class.
+/// </summary>
+class NuiFrameBuffer
+{
+public:
+    BYTE*                       GetData() const { return m_pData; }
+    UINT                        GetSize() const { return m_cbSize; }
+    UINT                        GetCapacity() const { return m_cbCapacity; }
+    UINT                        GetSizeClass() const { return m_sizeClass; }
+
+    /// <summary>
+    /// Change the size of the buffer within its capacity. The contents are kept.
+    /// </summary>
+    /// <param name="cbSize">The new size in bytes.</param>
+    /// <returns>true on success, false if the size exceeds the capacity</returns>
+    bool SetSize(UINT cbSize)
+    {
+        if (cbSize > m_cbCapacity)
+        {
+            return false;
+        }
+
+        m_cbSize = cbSize;
+        return true;
+    }
+
+    /// <summary>
+    /// Add a reference to the buffer.
+    /// </summary>
+    ULONG AddRef()
+    {
+        return static_cast<ULONG>(InterlockedIncrement(&m_cRef));
+    }
+
+    /// <summary>
+    /// Release a reference, returning the buffer to its pool when it was the last.
+    /// </summary>
+    inline ULONG Release();
+
+private:
+    friend class NuiFrameBufferPool;
+
+    NuiFrameBuffer(NuiFrameBufferPool *pPool, BYTE *pData, UINT cbCapacity, UINT sizeClass, UINT node) :
+        m_pPool(pPool),
+        m_pData(pData),
+        m_cbSize(0),
+        m_cbCapacity(cbCapacity),
+        m_sizeClass(sizeClass),
+        m_node(node),
+        m_pNextFree(nullptr),
+        m_cRef(0)
+    {
+    }
+
+    // Buffers are not copyable
+    NuiFrameBuffer(const NuiFrameBuffer&);
+    NuiFrameBuffer& operator=(const NuiFrameBuffer&);
+
+    NuiFrameBufferPool*         m_pPool;
+    BYTE*                       m_pData;
+    UINT                        m_cbSize;
+    UINT                        m_cbCapacity;
+    UINT                        m_sizeClass;
+    UINT                        m_node;         // NUMA node the memory was allocated on
+    NuiFrameBuffer*             m_pNextFree;    // next idle buffer of the same node and size class
+    volatile LONG               m_cRef;
+};
+
+/// <summary>
+/// Allocation counts of a NuiFrameBufferPool.
+/// </summary>
+struct NuiFrameBufferPoolStatistics
+{
+    UINT                        allocations;    // buffers allocated from the system
+    UINT                        reuses;         // buffers handed out again from the pool
+    SIZE_T                      cbAllocated;    // bytes held by the pool, in use or idle
+    SIZE_T                      cbIdle;         // bytes of idle buffers waiting to be reused
+};
+
+/// <summary>
+/// A pool of frame buffers shared by the streams of all sensors in the process, so switching
+/// resolutions or opening more sensors reuses the buffers already allocated instead of going
+/// back to the heap.
+///
+/// Sizes are rounded up to size classes a quarter of a power of two apart, from 64KB up, so a
+/// buffer is at most 25% larger than asked for and frames of similar sizes share buffers. The
+/// memory of each buffer comes from VirtualAlloc, page aligned and away from the heap, on the
+/// NUMA node of the thread which first asked for it, and idle buffers are handed out again to
+/// threads on the same node first. Idle buffers beyond a byte limit are given back to the system.
+/// </summary>
+class NuiFrameBufferPool
+{
+public:
+    static const UINT           cSizeClasses = 56;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    NuiFrameBufferPool() :
+        m_cbMaxIdle(cDefaultMaxIdleBytes),
+        m_nodeCount(1)
+    {
+        InitializeCriticalSection(&m_lock);
+        ZeroMemory(m_pFree, sizeof(m_pFree));
+        ZeroMemory(&m_statistics, sizeof(m_statistics));
+
+        ULONG highestNode = 0;
+        if (GetNumaHighestNodeNumber(&highestNode))
+        {
+            m_nodeCount = (highestNode + 1 < cMaxNodes) ? highestNode + 1 : cMaxNodes;
+        }
+    }
+
+    /// <summary>
+    /// Destructor. All buffers must have been released.
+    /// </summary>
+    ~NuiFrameBufferPool()
+    {
+        Trim();
+        DeleteCriticalSection(&m_lock);
+    }
+
+    /// <summary>
+    /// The pool shared by the whole process. It lives until the process exits.
+    /// </summary>
+    /// <returns>The shared pool, or nullptr if it could not be created</returns>
+    static NuiFrameBufferPool* GetShared()
+    {
+        static NuiFrameBufferPool* volatile s_pShared = nullptr;
+
+        if (nullptr == s_pShared)
+        {
+            NuiFrameBufferPool *pPool = new(std::nothrow) NuiFrameBufferPool();
+            if (nullptr != pPool && nullptr != InterlockedCompareExchangePointer(
+                reinterpret_cast<PVOID volatile*>(&s_pShared), pPool, nullptr))
+            {
+                // Another thread created the pool first
+                delete pPool;
+            }
+        }
+
+        return s_pShared;
+    }
+
+    /// <summary>
+    /// The size class of a buffer size.
+    /// </summary>
+    /// <param name="cbSize">The buffer size in bytes.</param>
+    /// <returns>The size class, or cSizeClasses if the size is too large to pool</returns>
+    static UINT GetSizeClass(UINT cbSize)
+    {
+        UINT sizeClass = 0;
+        while (sizeClass < cSizeClasses && GetClassCapacity(sizeClass) < cbSize)
+        {
+            ++sizeClass;
+        }
+
+        return sizeClass;
+    }
+
+    /// <summary>
+    /// The capacity of the buffers of a size class: 64KB, 80KB, 96KB, 112KB, 128KB, 160KB, ...
+    /// </summary>
+    static UINT GetClassCapacity(UINT sizeClass)
+    {
+        return (4 + sizeClass % 4) << (cMinClassShift - 2 + sizeClass / 4);
+    }
+
+    /// <summary>
+    /// Set the number of bytes of idle buffers kept for reuse.
+    /// </summary>
+    /// <param name="cbMaxIdle">The largest total size of the idle buffers.</param>
+    void SetMaxIdleBytes(SIZE_T cbMaxIdle)
+    {
+        EnterCriticalSection(&m_lock);
+        m_cbMaxIdle = cbMaxIdle;
+        LeaveCriticalSection(&m_lock);
+    }
+
+    /// <summary>
+    /// Take a buffer of at least a size, reusing an idle buffer of its size class if there is one.
+    /// </summary>
+    /// <param name="cbSize">The size of the buffer in bytes.</param>
+    /// <param name="ppBuffer">Returns the buffer with one reference, and GetSize() of cbSize.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Acquire(UINT cbSize, NuiFrameBuffer **ppBuffer)
+    {
+        if (nullptr == ppBuffer)
+        {
+            return E_POINTER;
+        }
+
+        *ppBuffer = nullptr;
+
+        UINT sizeClass = GetSizeClass(cbSize);
+        if (0 == cbSize || sizeClass >= cSizeClasses)
+        {
+            return E_INVALIDARG;
+        }
+
+        UINT node = GetCurrentNode();
+        NuiFrameBuffer *pBuffer = nullptr;
+
+        EnterCriticalSection(&m_lock);
+
+        // Prefer memory local to this thread, then any idle buffer over a new allocation
+        for (UINT i = 0; i < m_nodeCount && nullptr == pBuffer; ++i)
+        {
+            NuiFrameBuffer **ppFree = &m_pFree[(node + i) % m_nodeCount][sizeClass];
+            if (nullptr != *ppFree)
+            {
+                pBuffer = *ppFree;
+                *ppFree = pBuffer->m_pNextFree;
+                pBuffer->m_pNextFree = nullptr;
+
+                m_statistics.cbIdle -= pBuffer->m_cbCapacity;
+                ++m_statistics.reuses;
+            }
+        }
+
+        LeaveCriticalSection(&m_lock);
+
+        if (nullptr == pBuffer)
+        {
+            pBuffer = AllocateBuffer(sizeClass, node);
+            if (nullptr == pBuffer)
+            {
+                return E_OUTOFMEMORY;
+            }
+        }
+
+        pBuffer->m_cbSize = cbSize;
+        pBuffer->m_cRef = 1;
+
+        *ppBuffer = pBuffer;
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Give all idle buffers back to the system.
+    /// </summary>
+    void Trim()
+    {
+        NuiFrameBuffer *pIdle = nullptr;
+
+        EnterCriticalSection(&m_lock);
+
+        for (UINT node = 0; node < cMaxNodes; ++node)
+        {
+            for (UINT sizeClass = 0; sizeClass < cSizeClasses; ++sizeClass)
+            {
+                while (nullptr != m_pFree[node][sizeClass])
+                {
+                    NuiFrameBuffer *pBuffer = m_pFree[node][sizeClass];
+                    m_pFree[node][sizeClass] = pBuffer->m_pNextFree;
+
+                    pBuffer->m_pNextFree = pIdle;
+                    pIdle = pBuffer;
+                }
+            }
+        }
+
+        m_statistics.cbIdle = 0;
+
+        LeaveCriticalSection(&m_lock);
+
+        while (nullptr != pIdle)
+        {
+            NuiFrameBuffer *pNext = pIdle->m_pNextFree;
+            FreeBuffer(pIdle);
+            pIdle = pNext;
+        }
+    }
+
+    /// <summary>
+    /// Get the allocation counts of the pool.
+    /// </summary>
+    /// <param name="pStatistics">Returns the counts.</param>
+    void GetStatistics(NuiFrameBufferPoolStatistics *pStatistics)
+    {
+        if (nullptr != pStatistics)
+        {
+            EnterCriticalSection(&m_lock);
+            *pStatistics = m_statistics;
+            LeaveCriticalSection(&m_lock);
+        }
+    }
+
+private:
+    friend class NuiFrameBuffer;
+
+    // The pool is shared through pointers, so is not copyable
+    NuiFrameBufferPool(const NuiFrameBufferPool&);
+    NuiFrameBufferPool& operator=(const NuiFrameBufferPool&);
+
+    static const UINT           cMinClassShift = 16;
+    static const UINT           cMaxNodes = 8;
+    static const SIZE_T         cDefaultMaxIdleBytes = 64 * 1024 * 1024;
+
+    /// <summary>
+    /// The NUMA node of the processor running the calling thread.
+    /// </summary>
+    UINT GetCurrentNode() const
+    {
+        UCHAR node = 0;
+        if (m_nodeCount > 1 && !GetNumaProcessorNode(static_cast<UCHAR>(GetCurrentProcessorNumber()), &node))
+        {
+            node = 0;
+        }
+
+        return (node < m_nodeCount) ? node : 0;
+    }
+
+    /// <summary>
+    /// Allocate a buffer of a size class on a NUMA node.
+    /// </summary>
+    /// <returns>The buffer, or nullptr on allocation failure</returns>
+    NuiFrameBuffer* AllocateBuffer(UINT sizeClass, UINT node)
+    {
+        UINT cbCapacity = GetClassCapacity(sizeClass);
+
+        BYTE *pData = static_cast<BYTE*>(VirtualAllocExNuma(
+            GetCurrentProcess(), nullptr, cbCapacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node));
+        if (nullptr == pData)
+        {
+            // The node may have run out of memory
+            pData = static_cast<BYTE*>(VirtualAlloc(nullptr, cbCapacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        }
+
+        if (nullptr == pData)
+        {
+            return nullptr;
+        }
+
+        NuiFrameBuffer *pBuffer = new(std::nothrow) NuiFrameBuffer(this, pData, cbCapacity, sizeClass, node);
+        if (nullptr == pBuffer)
+        {
+            VirtualFree(pData, 0, MEM_RELEASE);
+            return nullptr;
+        }
+
+        EnterCriticalSection(&m_lock);
+        ++m_statistics.allocations;
+        m_statistics.cbAllocated += cbCapacity;
+        LeaveCriticalSection(&m_lock);
+
+        return pBuffer;
+    }
+
+    /// <summary>
+    /// Give a buffer back to the system.
+    /// </summary>
+    void FreeBuffer(NuiFrameBuffer *pBuffer)
+    {
+        EnterCriticalSection(&m_lock);
+        m_statistics.cbAllocated -= pBuffer->m_cbCapacity;
+        LeaveCriticalSection(&m_lock);
+
+        VirtualFree(pBuffer->m_pData, 0, MEM_RELEASE);
+        delete pBuffer;
+    }
+
+    /// <summary>
+    /// Keep a released buffer for reuse, or free it if the idle buffers are over the limit.
+    /// </summary>
+    void Recycle(NuiFrameBuffer *pBuffer)
+    {
+        bool bKept = false;
+
+        EnterCriticalSection(&m_lock);
+
+        if (m_statistics.cbIdle + pBuffer->m_cbCapacity <= m_cbMaxIdle)
+        {
+            NuiFrameBuffer **ppFree = &m_pFree[pBuffer->m_node][pBuffer->m_sizeClass];
+            pBuffer->m_pNextFree = *ppFree;
+            *ppFree = pBuffer;
+
+            m_statistics.cbIdle += pBuffer->m_cbCapacity;
+            bKept = true;
+        }
+
+        LeaveCriticalSection(&m_lock);
+
+        if (!bKept)
+        {
+            FreeBuffer(pBuffer);
+        }
+    }
+
+    CRITICAL_SECTION            m_lock;
+    SIZE_T                      m_cbMaxIdle;
+    UINT                        m_nodeCount;
+    NuiFrameBuffer*             m_pFree[cMaxNodes][cSizeClasses];   // idle buffers by node and size class
+    NuiFrameBufferPoolStatistics m_statistics;
+};
+
+/// <summary>
+/// Release a reference, returning the buffer to its pool when it was the last
+/// </summary>
+ULONG NuiFrameBuffer::Release()
+{
+    ULONG cRef = static_cast<ULONG>(InterlockedDecrement(&m_cRef));
+    if (0 == cRef)
+    {
+        m_pPool->Recycle(this);
+    }
+
+    return cRef;
+}
+
+/// <summary>
+/// Holds one buffer of a pool for an object which used to own a buffer reallocated whenever
+/// its size changed. A new size of the same size class keeps the buffer, any other size
+/// returns it to the pool and takes one of the new size class. As the pool is shared by all
+/// streams, a resolution change can reuse a buffer another stream released.
+/// </summary>
+class NuiPooledBuffer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pPool">The pool to take buffers from, by default the shared pool.</param>
+    explicit NuiPooledBuffer(NuiFrameBufferPool *pPool = NuiFrameBufferPool::GetShared()) :
+        m_pPool(pPool),
+        m_pBuffer(nullptr)
+    {
+    }
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~NuiPooledBuffer()
+    {
+        Reset(0);
+    }
+
+    /// <summary>
+    /// Make the buffer a size. The contents are not kept when the size class changes.
+    /// </summary>
+    /// <param name="cbSize">The size in bytes. Zero returns the buffer to the pool.</param>
+    /// <returns>The buffer, or nullptr if the size is zero or the buffer could not be allocated</returns>
+    BYTE* Reset(UINT cbSize)
+    {
+        if (nullptr != m_pBuffer && 0 != cbSize && NuiFrameBufferPool::GetSizeClass(cbSize) == m_pBuffer->GetSizeClass())
+        {
+            m_pBuffer->SetSize(cbSize);
+            return m_pBuffer->GetData();
+        }
+
+        if (nullptr != m_pBuffer)
+        {
+            m_pBuffer->Release();
+            m_pBuffer = nullptr;
+        }
+
+        if (0 != cbSize && nullptr != m_pPool)
+        {
+            m_pPool->Acquire(cbSize, &m_pBuffer);
+        }
+
+        return GetData();
+    }
+
+    BYTE*                       GetData() const { return (nullptr != m_pBuffer) ? m_pBuffer->GetData() : nullptr; }
+    UINT                        GetSize() const { return (nullptr != m_pBuffer) ? m_pBuffer->GetSize() : 0; }
+
+private:
+    // The holder owns a reference, so is not copyable
+    NuiPooledBuffer(const NuiPooledBuffer&);
+    NuiPooledBuffer& operator=(const NuiPooledBuffer&);
+
+    NuiFrameBufferPool*         m_pPool;
+    NuiFrameBuffer*             m_pBuffer;
+};
@@ -0,0 +1,468 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiInfraredToneMapper.h" company="Microsoft">
+// 	 
+//	 Copyright 2013 Microsoft Corporation 
+// 	 
+//	Licensed under the Apache License, Version 2.0 (the "License"); 
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+// 	 
+//		 http://www.apache.org/licenses/LICENSE-2.0 
+// 	 
+//	Unless required by applicable law or agreed to in writing, software 
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+//	See the License for the specific language governing permissions and 
+//	limitations under the License. 
+// 	 
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <new>
+#include <cmath>
+#include <emmintrin.h>
+#include <NuiApi.h>
+
+/// <summary>
+/// Converts 16 bit infrared frames to 32bpp gray images that stay readable in low light.
+///
+/// Each pixel passes through an optional temporal denoise, which blends it with the filtered
+/// value of the previous frame unless it moved by more than a threshold, and a tone curve
+/// table. With auto exposure the tone curve stretches the levels between a low and a high
+/// percentile of a running histogram to the full output range, with a gamma which brings the
+/// median to a mid gray. The histogram is counted from a quarter of the rows of each frame,
+/// on a different set of rows each frame, and decays from frame to frame, so no pass over the
+/// full frame is spent on it. Without auto exposure the top 8 bits of each pixel are shown.
+///
+/// Per frame:
+///     mapper.Initialize(width, height);
+///     mapper.Apply(pInfrared, pOutput, outputPitch);
+/// </summary>
+class NuiInfraredToneMapper
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    NuiInfraredToneMapper() :
+        m_width(0),
+        m_height(0),
+        m_bAutoExposure(true),
+        m_bDenoise(false),
+        m_denoiseWeight(0),
+        m_motionThreshold(0),
+        m_histogramPhase(0),
+        m_bHistoryValid(false),
+        m_bExposureValid(false),
+        m_blackLevel(0.0f),
+        m_whiteLevel(static_cast<float>(cLevels - 1)),
+        m_gamma(1.0f),
+        m_curveBlackLevel(0.0f),
+        m_curveWhiteLevel(0.0f),
+        m_curveGamma(0.0f),
+        m_pHistory(nullptr)
+    {
+        SetTemporalDenoise(false, 0.35f, 24);
+        ResetExposure();
+    }
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~NuiInfraredToneMapper()
+    {
+        FreeBuffers();
+    }
+
+    /// <summary>
+    /// Set the size of the infrared frames. Cheap when the size is unchanged, so it may be
+    /// called per frame.
+    /// </summary>
+    /// <param name="width">Width of the infrared frame.</param>
+    /// <param name="height">Height of the infrared frame.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Initialize(UINT width, UINT height)
+    {
+        if (0 == width || 0 == height)
+        {
+            return E_INVALIDARG;
+        }
+
+        if (width == m_width && height == m_height && nullptr != m_pHistory)
+        {
+            return S_OK;
+        }
+
+        FreeBuffers();
+
+        m_width = width;
+        m_height = height;
+        m_pHistory = new(std::nothrow) USHORT[width * height];
+
+        if (nullptr == m_pHistory)
+        {
+            FreeBuffers();
+            return E_OUTOFMEMORY;
+        }
+
+        ResetExposure();
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Turn auto exposure on or off. Turning it on starts a new histogram.
+    /// </summary>
+    /// <param name="enable">Whether to stretch the tone curve over the levels in the frames.</param>
+    void SetAutoExposure(bool enable)
+    {
+        if (enable != m_bAutoExposure)
+        {
+            m_bAutoExposure = enable;
+            ResetExposure();
+        }
+    }
+
+    /// <summary>
+    /// Set the temporal denoise. Pixels which moved by more than the motion threshold since the
+    /// last frame take the new value, the others blend it into the filtered value.
+    /// </summary>
+    /// <param name="enable">Whether to denoise.</param>
+    /// <param name="newFrameWeight">Weight of the new frame in the blend, between 0 and 1.</param>
+    /// <param name="motionThreshold">Largest change treated as noise, in 10 bit levels.</param>
+    void SetTemporalDenoise(bool enable, float newFrameWeight, USHORT motionThreshold)
+    {
+        m_bDenoise = enable;
+
+        // The blend takes the high half of twice the difference times the weight in 1/32768ths
+        float weight = (newFrameWeight < 0.0f) ? 0.0f : ((newFrameWeight > 1.0f) ? 1.0f : newFrameWeight);
+        m_denoiseWeight = static_cast<short>((weight * 32768.0f < 32767.0f) ? weight * 32768.0f : 32767.0f);
+
+        m_motionThreshold = (motionThreshold < cLevels) ? motionThreshold : cLevels - 1;
+    }
+
+    /// <summary>
+    /// Convert an infrared frame to a gray image.
+    /// </summary>
+    /// <param name="pInfrared">The infrared pixels, rows packed without padding.</param>
+    /// <param name="pOutput">The 32bpp output image of the same size.</param>
+    /// <param name="outputPitch">The size of a row of the output image in bytes.</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT Apply(const USHORT *pInfrared, BYTE *pOutput, UINT outputPitch)
+    {
+        if (nullptr == m_pHistory)
+        {
+            return E_UNEXPECTED;
+        }
+
+        if (nullptr == pInfrared || nullptr == pOutput)
+        {
+            return E_POINTER;
+        }
+
+        bool denoise = m_bDenoise && m_bHistoryValid;
+
+        for (UINT y = 0; y < m_height; ++y)
+        {
+            bool countRow = m_bAutoExposure && (m_histogramPhase == y % cHistogramRowStride);
+
+            ConvertRow(
+                pInfrared + y * m_width,
+                m_pHistory + y * m_width,
+                reinterpret_cast<UINT*>(pOutput + y * outputPitch),
+                denoise,
+                countRow);
+        }
+
+        // The history holds this frame even without denoise, so denoise can start next frame
+        m_bHistoryValid = true;
+
+        if (m_bAutoExposure)
+        {
+            UpdateExposure();
+            m_histogramPhase = (m_histogramPhase + 1) % cHistogramRowStride;
+        }
+
+        return S_OK;
+    }
+
+private:
+    // The mapper owns its buffers, so is not copyable
+    NuiInfraredToneMapper(const NuiInfraredToneMapper&);
+    NuiInfraredToneMapper& operator=(const NuiInfraredToneMapper&);
+
+    // Infrared pixels hold 10 significant bits, in the high bits of each USHORT
+    static const UINT           cLevels = 1024;
+    static const UINT           cLevelShift = 6;
+
+    // The history keeps 4 fractional bits below the 10 bit level, so it fits in a signed short
+    static const UINT           cHistoryShift = 2;
+    static const UINT           cHistoryFractionBits = 4;
+
+    // One row in this many is counted into the histogram each frame
+    static const UINT           cHistogramRowStride = 4;
+
+    /// <summary>
+    /// Denoise and tone map a row of pixels, eight at a time.
+    /// </summary>
+    void ConvertRow(const USHORT *pSrc, USHORT *pHistory, UINT *pDest, bool denoise, bool countRow)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+        const __m128i weight = _mm_set1_epi16(m_denoiseWeight);
+        const __m128i threshold = _mm_set1_epi16(static_cast<short>(m_motionThreshold << cHistoryFractionBits));
+
+        USHORT levels[8];
+        BYTE gray[8];
+        UINT x = 0;
+
+        for (; x + 8 <= m_width; x += 8)
+        {
+            __m128i current = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + x)), cHistoryShift);
+            __m128i filtered = current;
+
+            if (denoise)
+            {
+                __m128i history = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pHistory + x));
+                __m128i difference = _mm_sub_epi16(current, history);
+                __m128i blended = _mm_add_epi16(history, _mm_mulhi_epi16(_mm_slli_epi16(difference, 1), weight));
+
+                // Pixels which moved take the new value
+                __m128i magnitude = _mm_max_epi16(difference, _mm_sub_epi16(zero, difference));
+                __m128i moved = _mm_cmpgt_epi16(magnitude, threshold);
+                filtered = _mm_or_si128(_mm_and_si128(moved, current), _mm_andnot_si128(moved, blended));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pHistory + x), filtered);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(levels), _mm_srli_epi16(filtered, cHistoryFractionBits));
+
+            for (int i = 0; i < 8; ++i)
+            {
+                gray[i] = m_toneCurve[levels[i]];
+            }
+
+            if (countRow)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    ++m_frameCounts[levels[i]];
+                }
+            }
+
+            // Expand each gray byte to a B, G, R, A pixel
+            __m128i grays = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(gray));
+            __m128i grayGray = _mm_unpacklo_epi8(grays, grays);
+            __m128i grayAlpha = _mm_unpacklo_epi8(grays, alpha);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + x), _mm_unpacklo_epi16(grayGray, grayAlpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + x + 4), _mm_unpackhi_epi16(grayGray, grayAlpha));
+        }
+
+        for (; x < m_width; ++x)
+        {
+            int current = pSrc[x] >> cHistoryShift;
+            int filtered = current;
+
+            if (denoise)
+            {
+                int history = pHistory[x];
+                int difference = current - history;
+                int magnitude = (difference < 0) ? -difference : difference;
+
+                if (magnitude <= (m_motionThreshold << cHistoryFractionBits))
+                {
+                    filtered = history + ((2 * difference * m_denoiseWeight) >> 16);
+                }
+            }
+
+            pHistory[x] = static_cast<USHORT>(filtered);
+
+            int level = filtered >> cHistoryFractionBits;
+            BYTE intensity = m_toneCurve[level];
+            if (countRow)
+            {
+                ++m_frameCounts[level];
+            }
+
+            pDest[x] = 0xFF000000 | (intensity << 16) | (intensity << 8) | intensity;
+        }
+    }
+
+    /// <summary>
+    /// Fold the counts of the frame into the running histogram and move the exposure towards it.
+    /// </summary>
+    void UpdateExposure()
+    {
+        // Older frames fade out within about a second
+        const float histogramDecay = 0.8f;
+
+        float total = 0.0f;
+        for (UINT i = 0; i < cLevels; ++i)
+        {
+            m_histogram[i] = m_histogram[i] * histogramDecay + static_cast<float>(m_frameCounts[i]);
+            m_frameCounts[i] = 0;
+            total += m_histogram[i];
+        }
+
+        if (total <= 0.0f)
+        {
+            return;
+        }
+
+        // The darkest and brightest levels are left out, so a few hot or dead pixels don't set the range
+        const float blackFraction = 0.01f;
+        const float whiteFraction = 0.995f;
+        const float minimumSpan = 16.0f;
+
+        UINT black = 0;
+        UINT median = 0;
+        UINT white = cLevels - 1;
+        float count = 0.0f;
+
+        for (UINT i = 0; i < cLevels; ++i)
+        {
+            float previous = count;
+            count += m_histogram[i];
+
+            if (previous <= blackFraction * total && count > blackFraction * total)
+            {
+                black = i;
+            }
+            if (previous <= 0.5f * total && count > 0.5f * total)
+            {
+                median = i;
+            }
+            if (previous <= whiteFraction * total && count > whiteFraction * total)
+            {
+                white = i;
+            }
+        }
+
+        float blackLevel = static_cast<float>(black);
+        float whiteLevel = static_cast<float>(white) + 1.0f;
+
+        if (whiteLevel - blackLevel < minimumSpan)
+        {
+            whiteLevel = blackLevel + minimumSpan;
+            if (whiteLevel > static_cast<float>(cLevels))
+            {
+                whiteLevel = static_cast<float>(cLevels);
+                blackLevel = whiteLevel - minimumSpan;
+            }
+        }
+
+        // Bring the median to a mid gray, brightening at most as a gamma of 0.3 does
+        const float midGray = 0.45f;
+        float medianFraction = (static_cast<float>(median) + 0.5f - blackLevel) / (whiteLevel - blackLevel);
+        medianFraction = (medianFraction < 0.001f) ? 0.001f : ((medianFraction > 0.999f) ? 0.999f : medianFraction);
+
+        float gamma = logf(midGray) / logf(medianFraction);
+        gamma = (gamma < 0.3f) ? 0.3f : ((gamma > 1.0f) ? 1.0f : gamma);
+
+        if (m_bExposureValid)
+        {
+            // Adapt smoothly, so the image doesn't flicker with the noise in the histogram
+            const float adaptRate = 0.2f;
+
+            m_blackLevel += adaptRate * (blackLevel - m_blackLevel);
+            m_whiteLevel += adaptRate * (whiteLevel - m_whiteLevel);
+            m_gamma += adaptRate * (gamma - m_gamma);
+        }
+        else
+        {
+            m_blackLevel = blackLevel;
+            m_whiteLevel = whiteLevel;
+            m_gamma = gamma;
+            m_bExposureValid = true;
+        }
+
+        // Only rebuild the tone curve once it moved visibly
+        if (fabsf(m_blackLevel - m_curveBlackLevel) > 0.25f ||
+            fabsf(m_whiteLevel - m_curveWhiteLevel) > 0.25f ||
+            fabsf(m_gamma - m_curveGamma) > 0.005f)
+        {
+            BuildToneCurve();
+        }
+    }
+
+    /// <summary>
+    /// Fill the tone curve table from the exposure.
+    /// </summary>
+    void BuildToneCurve()
+    {
+        if (!m_bAutoExposure || !m_bExposureValid)
+        {
+            // The top 8 bits of the pixel
+            for (UINT i = 0; i < cLevels; ++i)
+            {
+                m_toneCurve[i] = static_cast<BYTE>(i >> 2);
+            }
+        }
+        else
+        {
+            float scale = 1.0f / (m_whiteLevel - m_blackLevel);
+
+            for (UINT i = 0; i < cLevels; ++i)
+            {
+                float fraction = (static_cast<float>(i) + 0.5f - m_blackLevel) * scale;
+                fraction = (fraction < 0.0f) ? 0.0f : ((fraction > 1.0f) ? 1.0f : fraction);
+
+                m_toneCurve[i] = static_cast<BYTE>(255.0f * powf(fraction, m_gamma) + 0.5f);
+            }
+        }
+
+        m_curveBlackLevel = m_blackLevel;
+        m_curveWhiteLevel = m_whiteLevel;
+        m_curveGamma = m_gamma;
+    }
+
+    /// <summary>
+    /// Start a new histogram and go back to showing the top 8 bits until it has counts.
+    /// </summary>
+    void ResetExposure()
+    {
+        for (UINT i = 0; i < cLevels; ++i)
+        {
+            m_histogram[i] = 0.0f;
+            m_frameCounts[i] = 0;
+        }
+
+        m_histogramPhase = 0;
+        m_bExposureValid = false;
+        BuildToneCurve();
+    }
+
+    void FreeBuffers()
+    {
+        delete[] m_pHistory;
+
+        m_pHistory = nullptr;
+        m_bHistoryValid = false;
+    }
+
+    UINT                        m_width;
+    UINT                        m_height;
+
+    bool                        m_bAutoExposure;
+    bool                        m_bDenoise;
+    short                       m_denoiseWeight;    // weight of the new frame in 1/32768ths
+    USHORT                      m_motionThreshold;  // in 10 bit levels
+
+    UINT                        m_histogramPhase;   // rows counted this frame, modulo cHistogramRowStride
+    bool                        m_bHistoryValid;
+    bool                        m_bExposureValid;
+
+    // Exposure in 10 bit levels, and the exposure the tone curve was built for
+    float                       m_blackLevel;
+    float                       m_whiteLevel;
+    float                       m_gamma;
+    float                       m_curveBlackLevel;
+    float                       m_curveWhiteLevel;
+    float                       m_curveGamma;
+
+    float                       m_histogram[cLevels];
+    UINT                        m_frameCounts[cLevels];
+    BYTE                        m_toneCurve[cLevels];
+    USHORT*                     m_pHistory;         // filtered pixels of the last frame, 10.4 fixed point
+};